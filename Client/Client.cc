@@ -14,6 +14,7 @@
  */
 
 #include <string.h>
+#include <stdexcept>
 
 #include "Client/Client.h"
 #include "Client/ClientImplBase.h"
@@ -88,6 +89,157 @@ Entry::getLength() const
     return length;
 }
 
+////////// EntryView //////////
+
+EntryView::EntryView()
+    : id(NO_ID)
+    , invalidates(NULL)
+    , numInvalidates(0)
+    , data(NULL)
+    , length(0)
+{
+}
+
+EntryId
+EntryView::getId() const
+{
+    return id;
+}
+
+std::vector<EntryId>
+EntryView::getInvalidates() const
+{
+    return std::vector<EntryId>(invalidates, invalidates + numInvalidates);
+}
+
+const void*
+EntryView::getData() const
+{
+    return data;
+}
+
+uint32_t
+EntryView::getLength() const
+{
+    return length;
+}
+
+////////// ReadResult::Iterator //////////
+
+ReadResult::Iterator::Iterator(const ReadResult& result, size_t index)
+    : result(&result)
+    , index(index)
+{
+}
+
+EntryView
+ReadResult::Iterator::operator*() const
+{
+    return result->impl->get(index);
+}
+
+ReadResult::Iterator&
+ReadResult::Iterator::operator++()
+{
+    ++index;
+    return *this;
+}
+
+bool
+ReadResult::Iterator::operator==(const Iterator& other) const
+{
+    return result == other.result && index == other.index;
+}
+
+bool
+ReadResult::Iterator::operator!=(const Iterator& other) const
+{
+    return !(*this == other);
+}
+
+////////// ReadResult //////////
+
+ReadResult::ReadResult(std::unique_ptr<ReadResultImplBase> impl)
+    : impl(std::move(impl))
+{
+}
+
+ReadResult::ReadResult(ReadResult&& other)
+    : impl(std::move(other.impl))
+{
+}
+
+ReadResult::~ReadResult()
+{
+}
+
+ReadResult&
+ReadResult::operator=(ReadResult&& other)
+{
+    impl = std::move(other.impl);
+    return *this;
+}
+
+size_t
+ReadResult::size() const
+{
+    return impl->size();
+}
+
+bool
+ReadResult::empty() const
+{
+    return impl->size() == 0;
+}
+
+EntryView
+ReadResult::at(size_t index) const
+{
+    if (index >= impl->size())
+        throw std::out_of_range("ReadResult::at");
+    return impl->get(index);
+}
+
+EntryView
+ReadResult::operator[](size_t index) const
+{
+    return impl->get(index);
+}
+
+ReadResult::Iterator
+ReadResult::begin() const
+{
+    return Iterator(*this, 0);
+}
+
+ReadResult::Iterator
+ReadResult::end() const
+{
+    return Iterator(*this, impl->size());
+}
+
+////////// Subscription //////////
+
+Subscription::Subscription(std::unique_ptr<SubscriptionImplBase> impl)
+    : impl(std::move(impl))
+{
+}
+
+Subscription::Subscription(Subscription&& other)
+    : impl(std::move(other.impl))
+{
+}
+
+Subscription::~Subscription()
+{
+}
+
+std::vector<Entry>
+Subscription::next(uint64_t timeoutMs)
+{
+    return impl->next(timeoutMs);
+}
+
 ////////// Log //////////
 
 Log::Log(std::shared_ptr<ClientImplBase> clientImpl,
@@ -117,10 +269,22 @@ Log::invalidate(const std::vector<EntryId>& invalidates,
     return clientImpl->append(logId, entry, expectedId);
 }
 
-std::vector<Entry>
+ReadResult
 Log::read(EntryId from)
 {
-    return clientImpl->read(logId, from);
+    return ReadResult(clientImpl->read(logId, from));
+}
+
+std::vector<Entry>
+Log::watch(EntryId from, uint64_t timeoutMs)
+{
+    return clientImpl->watch(logId, from, timeoutMs);
+}
+
+Subscription
+Log::subscribe(EntryId from)
+{
+    return Subscription(clientImpl->subscribe(logId, from));
 }
 
 EntryId
@@ -141,6 +305,19 @@ ConfigurationResult::~ConfigurationResult()
 {
 }
 
+////////// LeadershipTransferResult //////////
+
+LeadershipTransferResult::LeadershipTransferResult()
+    : status(OK)
+    , leaderId(0)
+    , reason()
+{
+}
+
+LeadershipTransferResult::~LeadershipTransferResult()
+{
+}
+
 ////////// Cluster //////////
 
 Cluster::Cluster(ForTesting t)
@@ -184,14 +361,47 @@ Cluster::listLogs()
 std::pair<uint64_t, Configuration>
 Cluster::getConfiguration()
 {
-    return clientImpl->getConfiguration();
+    Configuration learners;
+    return clientImpl->getConfiguration(learners);
+}
+
+std::pair<uint64_t, Configuration>
+Cluster::getConfiguration(Configuration& learners)
+{
+    return clientImpl->getConfiguration(learners);
 }
 
 ConfigurationResult
 Cluster::setConfiguration(uint64_t oldId,
                           const Configuration& newConfiguration)
 {
-    return clientImpl->setConfiguration(oldId, newConfiguration);
+    return clientImpl->setConfiguration(oldId, newConfiguration, NULL);
+}
+
+ConfigurationResult
+Cluster::setConfiguration(uint64_t oldId,
+                          const Configuration& newConfiguration,
+                          const Configuration& newLearners)
+{
+    return clientImpl->setConfiguration(oldId, newConfiguration, &newLearners);
+}
+
+LeadershipTransferResult
+Cluster::transferLeadership(uint64_t serverId)
+{
+    return clientImpl->transferLeadership(serverId);
+}
+
+void
+Cluster::enableFollowerReads(uint64_t maxStalenessMs)
+{
+    clientImpl->setFollowerReads(true, maxStalenessMs);
+}
+
+void
+Cluster::disableFollowerReads()
+{
+    clientImpl->setFollowerReads(false, 0);
 }
 
 } // namespace LogCabin::Client
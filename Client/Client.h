@@ -30,6 +30,8 @@ namespace LogCabin {
 namespace Client {
 
 class ClientImplBase; // forward declaration
+class ReadResultImplBase; // forward declaration
+class SubscriptionImplBase; // forward declaration
 
 /**
  * The type of a log entry ID.
@@ -97,6 +99,94 @@ class Entry {
     friend class MockClientImpl;
 };
 
+/**
+ * A log entry returned by Log::read. Unlike Entry, this doesn't hold a copy
+ * of the entry's data: it points into the ReadResult it came from, so it's
+ * only valid while that ReadResult exists.
+ */
+class EntryView {
+  public:
+    /// Constructor. The entry ID defaults to NO_ID, and there is no data.
+    EntryView();
+    /// Return the entry ID.
+    EntryId getId() const;
+    /// Return a list of entries that this entry invalidates.
+    std::vector<EntryId> getInvalidates() const;
+    /// Return the binary blob of data, or NULL if none is set.
+    const void* getData() const;
+    /// Return the number of bytes in data.
+    uint32_t getLength() const;
+
+  private:
+    EntryId id;
+    const EntryId* invalidates;
+    uint32_t numInvalidates;
+    const void* data;
+    uint32_t length;
+    friend class ReadResultImplBase;
+};
+
+/**
+ * The entries returned by Log::read. This holds on to the cluster's response
+ * and hands out EntryView objects that point into it, so the entries' data
+ * isn't copied a second time into Entry objects. The response itself is
+ * parsed in full before Log::read returns, though, which still allocates a
+ * string for each entry's data and a list for its invalidates; only the
+ * views are made one at a time as the entries are iterated over or indexed.
+ */
+class ReadResult {
+  private:
+    explicit ReadResult(std::unique_ptr<ReadResultImplBase> impl);
+  public:
+    /**
+     * Iterates over the entries of a ReadResult in order.
+     */
+    class Iterator {
+      public:
+        /// Constructor for the entry at position 'index' of 'result'.
+        Iterator(const ReadResult& result, size_t index);
+        /// Return a view of the current entry.
+        EntryView operator*() const;
+        /// Advance to the next entry.
+        Iterator& operator++();
+        bool operator==(const Iterator& other) const;
+        bool operator!=(const Iterator& other) const;
+      private:
+        const ReadResult* result;
+        size_t index;
+    };
+
+    /// Move constructor.
+    ReadResult(ReadResult&& other);
+    /// Destructor. This frees the entries' data.
+    ~ReadResult();
+    /// Move assignment.
+    ReadResult& operator=(ReadResult&& other);
+    /// Return the number of entries.
+    size_t size() const;
+    /// Return true if there are no entries.
+    bool empty() const;
+    /**
+     * Return the entry at the given position (not entry ID).
+     * \throw std::out_of_range
+     *      If index is not less than size().
+     */
+    EntryView at(size_t index) const;
+    /// Return the entry at the given position (not entry ID), which must be
+    /// less than size().
+    EntryView operator[](size_t index) const;
+    /// Return an iterator to the first entry.
+    Iterator begin() const;
+    /// Return an iterator past the last entry.
+    Iterator end() const;
+
+  private:
+    std::unique_ptr<ReadResultImplBase> impl;
+    // ReadResult is not copyable
+    ReadResult(const ReadResult&) = delete;
+    ReadResult& operator=(const ReadResult&) = delete;
+    friend class Log;
+};
 
 /**
  * This exception is thrown when operating on a log that has been deleted.
@@ -105,6 +195,41 @@ class Entry {
 class LogDisappearedException : public std::exception {
 };
 
+/**
+ * A stream of a log's entries, which the cluster pushes to the client as they
+ * are appended. This is cheaper than Log::watch for following a log: the
+ * client doesn't ask for each batch of entries, and a server with many
+ * subscribers to one log sends them all the same serialized entries. The
+ * client paces the server, so a slow reader won't be flooded.
+ * You can get an instance of Subscription through Log::subscribe.
+ */
+class Subscription {
+  private:
+    explicit Subscription(std::unique_ptr<SubscriptionImplBase> impl);
+  public:
+    /// Move constructor.
+    Subscription(Subscription&& other);
+    /// Destructor. This ends the subscription.
+    ~Subscription();
+
+    /**
+     * Return the next entries of the log, waiting for some if necessary.
+     * \param timeoutMs
+     *      How long to wait for an entry to be appended, in milliseconds.
+     * \return
+     *      The entries that follow those returned by the last call, starting
+     *      with the 'from' entry given to Log::subscribe. This is empty if
+     *      none arrived within the timeout.
+     * \throw LogDisappearedException
+     *      If this log no longer exists because someone deleted it.
+     */
+    std::vector<Entry> next(uint64_t timeoutMs);
+
+  private:
+    std::unique_ptr<SubscriptionImplBase> impl;
+    friend class Log;
+};
+
 /**
  * A handle to a replicated log.
  * You can get an instance of Log through Cluster::openLog.
@@ -161,11 +286,42 @@ class Log {
      *      The entry at which to start reading.
      * \return
      *      The entries starting at and including 'from' through head of the
-     *      log.
+     *      log. The entries' data stays in the result rather than being
+     *      copied out to each entry, but the whole response is decoded up
+     *      front, so a long read still allocates for every entry.
+     * \throw LogDisappearedException
+     *      If this log no longer exists because someone deleted it.
+     */
+    ReadResult read(EntryId from);
+
+    /**
+     * Wait for the log to have entries at or after 'from', then read them.
+     * Use this instead of calling read() in a loop to follow a log as it
+     * grows.
+     * \param from
+     *      The entry at which to start reading.
+     * \param timeoutMs
+     *      How long to wait for an entry with ID 'from' to be appended, in
+     *      milliseconds.
+     * \return
+     *      The entries starting at and including 'from' through head of the
+     *      log. This is empty if none arrived within the timeout.
      * \throw LogDisappearedException
      *      If this log no longer exists because someone deleted it.
      */
-    std::vector<Entry> read(EntryId from);
+    std::vector<Entry> watch(EntryId from, uint64_t timeoutMs);
+
+    /**
+     * Subscribe to the log's entries at or after 'from'. Use this instead of
+     * watch() to follow a busy log, or to have many clients follow one log.
+     * \param from
+     *      The entry at which to start.
+     * \return
+     *      A subscription from which to take the entries as they arrive.
+     *      The LogDisappearedException for a missing log is thrown from
+     *      Subscription::next.
+     */
+    Subscription subscribe(EntryId from);
 
     /**
      * Return the ID for the head of the log.
@@ -221,6 +377,36 @@ struct ConfigurationResult {
     Configuration badServers;
 };
 
+/**
+ * Returned by Cluster::transferLeadership.
+ */
+struct LeadershipTransferResult {
+    LeadershipTransferResult();
+    ~LeadershipTransferResult();
+    enum Status {
+        /**
+         * The old leader stepped down.
+         */
+        OK = 0,
+        /**
+         * The transfer was refused or abandoned, and the old leader is still
+         * leader. See 'reason'.
+         */
+        FAILED = 1,
+    } status;
+
+    /**
+     * If status is OK, the new leader's ID, or 0 if the old leader hadn't
+     * heard from the new leader yet.
+     */
+    uint64_t leaderId;
+
+    /**
+     * If status is FAILED, a human-readable explanation.
+     */
+    std::string reason;
+};
+
 /**
  * A handle to the LogCabin cluster.
  */
@@ -270,7 +456,8 @@ class Cluster {
     std::vector<std::string> listLogs();
 
     /**
-     * Get the current, stable cluster configuration.
+     * Get the current, stable cluster configuration. If the cluster spreads
+     * its logs across several Raft groups, this is group 0's configuration.
      * \return
      *      first: configurationId: Identifies the configuration.
      *             Pass this to setConfiguration later.
@@ -279,7 +466,21 @@ class Cluster {
     std::pair<uint64_t, Configuration> getConfiguration();
 
     /**
-     * Change the cluster's configuration.
+     * Get the current, stable cluster configuration, including its learners.
+     * \param[out] learners
+     *      The servers that receive the log but have no vote.
+     * \return
+     *      See getConfiguration().
+     */
+    std::pair<uint64_t, Configuration> getConfiguration(
+                                Configuration& learners);
+
+    /**
+     * Change the cluster's configuration. Any learners are kept, except for
+     * those listed in newConfiguration, which are promoted to voters. If the
+     * cluster spreads its logs across several Raft groups, oldId refers to
+     * group 0, and the other groups are changed to match once group 0 has
+     * changed.
      * \param oldId
      *      The ID of the cluster's current configuration.
      * \param newConfiguration
@@ -289,6 +490,62 @@ class Cluster {
                                 uint64_t oldId,
                                 const Configuration& newConfiguration);
 
+    /**
+     * Change the cluster's configuration, including its learners. Learners
+     * receive the log but never vote, so adding them does not slow down
+     * commits; once one has caught up, listing it in newConfiguration
+     * promotes it to a voter without waiting for a full log transfer.
+     * \param oldId
+     *      The ID of the cluster's current configuration.
+     * \param newConfiguration
+     *      The list of voting servers in the new configuration.
+     * \param newLearners
+     *      The list of learners in the new configuration. Servers also listed
+     *      in newConfiguration are ignored here.
+     */
+    ConfigurationResult setConfiguration(
+                                uint64_t oldId,
+                                const Configuration& newConfiguration,
+                                const Configuration& newLearners);
+
+    /**
+     * Hand off leadership to another server, for example before restarting
+     * the current leader. The leader stops accepting new writes, brings the
+     * new server's log up to date, and has it start an election right away,
+     * which is much faster than waiting for the followers to time out. If
+     * the cluster spreads its logs across several Raft groups, this only
+     * affects group 0.
+     * \param serverId
+     *      The server that should become leader, or 0 to let the leader pick
+     *      the follower with the most up-to-date log.
+     */
+    LeadershipTransferResult transferLeadership(uint64_t serverId = 0);
+
+    /**
+     * Allow listLogs(), Log::read(), and Log::getLastId() to be answered by
+     * any server, including followers and learners, instead of only the
+     * leader. This spreads the read load across the cluster, but results
+     * may miss operations committed up to about maxStalenessMs ago. They
+     * always include this Cluster object's own earlier operations, though.
+     * Servers that can't meet the bound pass the read on to the leader.
+     * \param maxStalenessMs
+     *      How far behind the leader a server may be and still answer reads,
+     *      in milliseconds. Servers learn how far behind they are from
+     *      heartbeats, so bounds below the heartbeat period are of little
+     *      use. Since servers' clocks can't be compared, a server assumes
+     *      the leader's last heartbeat took no longer to arrive than the
+     *      leader's previous round trip to it did, so the bound can be
+     *      exceeded by however much slower the network has since become.
+     */
+    void enableFollowerReads(uint64_t maxStalenessMs);
+
+    /**
+     * Undo enableFollowerReads(): send all reads to the leader again, so
+     * that they reflect every operation committed before they were issued.
+     * This is the default.
+     */
+    void disableFollowerReads();
+
   private:
     std::shared_ptr<ClientImplBase> clientImpl;
 };
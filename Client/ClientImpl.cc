@@ -18,6 +18,8 @@
 #include "Core/Debug.h"
 #include "Client/ClientImpl.h"
 #include "Core/ProtoBuf.h"
+#include "Core/Random.h"
+#include "Protocol/Common.h"
 #include "RPC/Address.h"
 
 namespace LogCabin {
@@ -33,13 +35,175 @@ const uint32_t MIN_RPC_PROTOCOL_VERSION = 1;
  * The newest RPC protocol version that this client library supports.
  */
 const uint32_t MAX_RPC_PROTOCOL_VERSION = 1;
+
+/**
+ * The number of entries a subscription lets the server push ahead of the
+ * application. The client grants more credits once half of these are used,
+ * so that the server rarely has to stop and wait.
+ */
+const uint64_t SUBSCRIPTION_CREDITS = 1024;
 }
 
 using Protocol::Client::OpCode;
 
+////////// ClientImpl::SubscriptionImpl //////////
+
+class ClientImpl::SubscriptionImpl : public SubscriptionImplBase {
+  public:
+    SubscriptionImpl(std::shared_ptr<ClientImpl> client,
+                     uint64_t logId,
+                     EntryId from)
+        : client(client)
+        , logId(logId)
+        , nextEntryId(from)
+        , stream()
+        , subscriptionId(0)
+        , creditsUsed(0)
+    {
+    }
+
+    ~SubscriptionImpl()
+    {
+        if (stream && subscriptionId != 0) {
+            Protocol::Client::UpdateSubscription::Request request;
+            request.set_subscription_id(subscriptionId);
+            request.set_cancel(true);
+            stream->send(OpCode::UPDATE_SUBSCRIPTION, request);
+        }
+    }
+
+    std::vector<Entry>
+    next(uint64_t timeoutMs)
+    {
+        typedef LeaderRPCBase::Stream::Status Status;
+        Core::Time::SteadyClock::time_point deadline =
+            (Core::Time::SteadyClock::now() +
+             std::chrono::milliseconds(timeoutMs));
+        while (true) {
+            if (!stream)
+                open();
+            Protocol::Client::Subscribe::Response response;
+            Status status = stream->waitForReply(response, deadline);
+            if (status == Status::TIMEOUT)
+                return {};
+            if (status == Status::BROKEN) {
+                // Pick up where this left off on a new stream.
+                stream.reset();
+                if (Core::Time::SteadyClock::now() >= deadline)
+                    return {};
+                continue;
+            }
+            client->updateAppliedId(Protocol::Common::getRaftGroup(logId),
+                                    response.applied_id());
+            if (response.has_subscription_id())
+                subscriptionId = response.subscription_id();
+            if (response.has_log_disappeared()) {
+                stream.reset();
+                throw LogDisappearedException();
+            }
+            if (response.entry_size() == 0)
+                continue;
+            std::vector<Entry> entries =
+                client->toEntries(logId, response.entry());
+            nextEntryId = entries.back().getId() + 1;
+            creditsUsed += entries.size();
+            if (creditsUsed >= SUBSCRIPTION_CREDITS / 2) {
+                Protocol::Client::UpdateSubscription::Request request;
+                request.set_subscription_id(subscriptionId);
+                request.set_add_credits(creditsUsed);
+                stream->send(OpCode::UPDATE_SUBSCRIPTION, request);
+                creditsUsed = 0;
+            }
+            return entries;
+        }
+    }
+
+  private:
+    /**
+     * Open a new stream starting at #nextEntryId.
+     */
+    void
+    open()
+    {
+        Protocol::Client::Subscribe::Request request;
+        request.set_log_id(logId);
+        request.set_from_entry_id(nextEntryId);
+        request.set_credits(SUBSCRIPTION_CREDITS);
+        stream = client->leaderRPC->openStream(
+                    OpCode::SUBSCRIBE,
+                    request,
+                    Protocol::Common::getRaftGroup(logId));
+        subscriptionId = 0;
+        creditsUsed = 0;
+    }
+
+    /**
+     * Keeps the client, and with it the RPC system, alive.
+     */
+    std::shared_ptr<ClientImpl> client;
+    const uint64_t logId;
+    /**
+     * The ID of the entry that the next call to next() will return first.
+     */
+    EntryId nextEntryId;
+    /**
+     * The Subscribe RPC, or NULL if none is open.
+     */
+    std::unique_ptr<LeaderRPCBase::Stream> stream;
+    /**
+     * The server's ID for the subscription, or 0 if it hasn't said yet.
+     */
+    uint64_t subscriptionId;
+    /**
+     * The number of entries received since credits were last granted.
+     */
+    uint64_t creditsUsed;
+};
+
+////////// ClientImpl::ReadResultImpl //////////
+
+class ClientImpl::ReadResultImpl : public ReadResultImplBase {
+  public:
+    ReadResultImpl()
+        : response()
+    {
+    }
+
+    size_t
+    size() const
+    {
+        return size_t(response.ok().entry_size());
+    }
+
+    EntryView
+    get(size_t index) const
+    {
+        const Protocol::Client::Read::Response::OK::Entry& entry =
+            response.ok().entry(int(index));
+        return makeView(entry.entry_id(),
+                        entry.invalidates().data(),
+                        uint32_t(entry.invalidates_size()),
+                        entry.has_data() ? entry.data().data() : NULL,
+                        uint32_t(entry.data().length()));
+    }
+
+    /**
+     * The Read response. The entries' data is complete: read() fetches the
+     * rest of any entries the server cut short before handing this out.
+     */
+    Protocol::Client::Read::Response response;
+};
+
+////////// ClientImpl //////////
+
 ClientImpl::ClientImpl()
     : leaderRPC()             // set in init()
     , rpcProtocolVersion(~0U) // set in init()
+    , numRaftGroups(1)        // set in init()
+    , mutex()
+    , followerReads(false)
+    , maxStalenessMs(0)
+    , appliedIds()
 {
 }
 
@@ -57,7 +221,10 @@ ClientImpl::negotiateRPCVersion()
     Protocol::Client::GetSupportedRPCVersions::Request request;
     Protocol::Client::GetSupportedRPCVersions::Response response;
     leaderRPC->call(OpCode::GET_SUPPORTED_RPC_VERSIONS,
-                    request, response);
+                    request, response, 0);
+    numRaftGroups = response.num_raft_groups();
+    if (numRaftGroups == 0)
+        PANIC("The cluster says it has no Raft groups");
     uint32_t serverMin = response.min_version();
     uint32_t serverMax = response.max_version();
     if (MAX_RPC_PROTOCOL_VERSION < serverMin) {
@@ -80,6 +247,47 @@ ClientImpl::negotiateRPCVersion()
     }
 }
 
+uint32_t
+ClientImpl::getRaftGroup(const std::string& logName) const
+{
+    return Protocol::Common::getRaftGroup(logName, numRaftGroups);
+}
+
+template<typename Request>
+void
+ClientImpl::callReadOnly(OpCode opCode,
+                         Request& request,
+                         google::protobuf::Message& response,
+                         uint32_t groupId)
+{
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    if (!followerReads) {
+        lockGuard.unlock();
+        leaderRPC->call(opCode, request, response, groupId);
+        return;
+    }
+    Protocol::Client::FollowerRead& followerRead =
+        *request.mutable_follower_read();
+    followerRead.set_max_staleness_ms(maxStalenessMs);
+    uint64_t appliedId = appliedIds[groupId];
+    if (appliedId > 0)
+        followerRead.set_min_applied_id(appliedId);
+    lockGuard.unlock();
+    if (leaderRPC->callAnyServer(opCode, request, response, groupId))
+        return;
+    // The leader always answers, so don't make it check staleness.
+    request.clear_follower_read();
+    leaderRPC->call(opCode, request, response, groupId);
+}
+
+void
+ClientImpl::updateAppliedId(uint32_t groupId, uint64_t id)
+{
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    uint64_t& appliedId = appliedIds[groupId];
+    appliedId = std::max(appliedId, id);
+}
+
 
 Log
 ClientImpl::openLog(const std::string& logName)
@@ -87,7 +295,9 @@ ClientImpl::openLog(const std::string& logName)
     Protocol::Client::OpenLog::Request request;
     request.set_log_name(logName);
     Protocol::Client::OpenLog::Response response;
-    leaderRPC->call(OpCode::OPEN_LOG, request, response);
+    uint32_t groupId = getRaftGroup(logName);
+    leaderRPC->call(OpCode::OPEN_LOG, request, response, groupId);
+    updateAppliedId(groupId, response.applied_id());
     return Log(self.lock(), logName, response.log_id());
 }
 
@@ -97,17 +307,26 @@ ClientImpl::deleteLog(const std::string& logName)
     Protocol::Client::DeleteLog::Request request;
     request.set_log_name(logName);
     Protocol::Client::DeleteLog::Response response;
-    leaderRPC->call(OpCode::DELETE_LOG, request, response);
+    uint32_t groupId = getRaftGroup(logName);
+    leaderRPC->call(OpCode::DELETE_LOG, request, response, groupId);
+    updateAppliedId(groupId, response.applied_id());
 }
 
 std::vector<std::string>
 ClientImpl::listLogs()
 {
-    Protocol::Client::ListLogs::Request request;
-    Protocol::Client::ListLogs::Response response;
-    leaderRPC->call(OpCode::LIST_LOGS, request, response);
-    std::vector<std::string> logNames(response.log_names().begin(),
-                                      response.log_names().end());
+    std::vector<std::string> logNames;
+    for (uint32_t groupId = 0; groupId < numRaftGroups; ++groupId) {
+        Protocol::Client::ListLogs::Request request;
+        if (groupId != 0)
+            request.set_group_id(groupId);
+        Protocol::Client::ListLogs::Response response;
+        callReadOnly(OpCode::LIST_LOGS, request, response, groupId);
+        updateAppliedId(groupId, response.applied_id());
+        logNames.insert(logNames.end(),
+                        response.log_names().begin(),
+                        response.log_names().end());
+    }
     std::sort(logNames.begin(), logNames.end());
     return logNames;
 }
@@ -124,10 +343,26 @@ ClientImpl::append(uint64_t logId, const Entry& entry, EntryId expectedId)
          ++it) {
         request.add_invalidates(*it);
     }
-    if (entry.getData() != NULL)
+    bool chunked = (entry.getData() != NULL &&
+                    entry.getLength() > Protocol::Common::MAX_CHUNK_LENGTH);
+    if (entry.getData() != NULL && !chunked)
         request.set_data(entry.getData(), entry.getLength());
     Protocol::Client::Append::Response response;
-    leaderRPC->call(OpCode::APPEND, request, response);
+    uint32_t groupId = Protocol::Common::getRaftGroup(logId);
+    while (true) {
+        if (chunked) {
+            uint64_t uploadId = Core::Random::random64();
+            upload(logId, uploadId, entry);
+            request.set_upload_id(uploadId);
+            request.set_upload_length(entry.getLength());
+        }
+        leaderRPC->call(OpCode::APPEND, request, response, groupId);
+        updateAppliedId(groupId, response.applied_id());
+        // If the cluster dropped the upload to make room for others, stage
+        // it again.
+        if (!response.has_upload_disappeared())
+            break;
+    }
     if (response.has_ok())
         return response.ok().entry_id();
     if (response.has_log_disappeared())
@@ -136,36 +371,56 @@ ClientImpl::append(uint64_t logId, const Entry& entry, EntryId expectedId)
           Core::ProtoBuf::dumpString(response, false).c_str());
 }
 
-std::vector<Entry>
+void
+ClientImpl::upload(uint64_t logId, uint64_t uploadId, const Entry& entry)
+{
+    const char* data = static_cast<const char*>(entry.getData());
+    uint32_t groupId = Protocol::Common::getRaftGroup(logId);
+    Protocol::Client::AppendChunk::Request request;
+    request.set_log_id(logId);
+    request.set_upload_id(uploadId);
+    uint64_t offset = 0;
+    while (offset < entry.getLength()) {
+        uint64_t length = std::min<uint64_t>(
+                                Protocol::Common::MAX_CHUNK_LENGTH,
+                                entry.getLength() - offset);
+        request.set_offset(offset);
+        request.set_data(data + offset, length);
+        Protocol::Client::AppendChunk::Response response;
+        leaderRPC->call(OpCode::APPEND_CHUNK, request, response, groupId);
+        updateAppliedId(groupId, response.applied_id());
+        if (response.has_log_disappeared())
+            throw LogDisappearedException();
+        if (!response.has_ok()) {
+            PANIC("Did not understand server response to append chunk "
+                  "RPC:\n%s",
+                  Core::ProtoBuf::dumpString(response, false).c_str());
+        }
+        if (response.ok().staged_length() == offset + length)
+            offset += length;
+        else // the cluster dropped the upload: start over
+            offset = 0;
+    }
+}
+
+std::unique_ptr<ReadResultImplBase>
 ClientImpl::read(uint64_t logId, EntryId from)
 {
     Protocol::Client::Read::Request request;
     request.set_log_id(logId);
     request.set_from_entry_id(from);
-    Protocol::Client::Read::Response response;
-    leaderRPC->call(OpCode::READ, request, response);
+    std::unique_ptr<ReadResultImpl> result(new ReadResultImpl());
+    Protocol::Client::Read::Response& response = result->response;
+    uint32_t groupId = Protocol::Common::getRaftGroup(logId);
+    callReadOnly(OpCode::READ, request, response, groupId);
+    updateAppliedId(groupId, response.applied_id());
     if (response.has_ok()) {
-        const auto& returnedEntries = response.ok().entry();
-        std::vector<Entry> entries;
-        entries.reserve(returnedEntries.size());
-        for (auto it = returnedEntries.begin();
-             it != returnedEntries.end();
-             ++it) {
-            std::vector<EntryId> invalidates(it->invalidates().begin(),
-                                             it->invalidates().end());
-            if (it->has_data()) {
-                Entry e(it->data().c_str(),
-                        uint32_t(it->data().length()),
-                        invalidates);
-                e.id = it->entry_id();
-                entries.push_back(std::move(e));
-            } else {
-                Entry e(invalidates);
-                e.id = it->entry_id();
-                entries.push_back(std::move(e));
-            }
+        Protocol::Client::Read::Response::OK& ok = *response.mutable_ok();
+        for (int i = 0; i < ok.entry_size(); ++i) {
+            if (ok.entry(i).has_data_length())
+                readRest(logId, *ok.mutable_entry(i));
         }
-        return entries;
+        return std::unique_ptr<ReadResultImplBase>(result.release());
     }
     if (response.has_log_disappeared())
         throw LogDisappearedException();
@@ -173,13 +428,108 @@ ClientImpl::read(uint64_t logId, EntryId from)
           Core::ProtoBuf::dumpString(response, false).c_str());
 }
 
+void
+ClientImpl::readRest(uint64_t logId,
+                     Protocol::Client::Read::Response::OK::Entry& entry)
+{
+    uint32_t groupId = Protocol::Common::getRaftGroup(logId);
+    std::string& data = *entry.mutable_data();
+    while (data.length() < entry.data_length()) {
+        Protocol::Client::Read::Request request;
+        request.set_log_id(logId);
+        request.set_from_entry_id(entry.entry_id());
+        request.set_data_offset(data.length());
+        Protocol::Client::Read::Response response;
+        callReadOnly(OpCode::READ, request, response, groupId);
+        updateAppliedId(groupId, response.applied_id());
+        if (response.has_log_disappeared())
+            throw LogDisappearedException();
+        if (!response.has_ok() ||
+            response.ok().entry_size() != 1 ||
+            response.ok().entry(0).data().empty()) {
+            PANIC("Did not understand server response to read RPC:\n%s",
+                  Core::ProtoBuf::dumpString(response, false).c_str());
+        }
+        data.append(response.ok().entry(0).data());
+    }
+    entry.clear_data_length();
+}
+
+std::vector<Entry>
+ClientImpl::toEntries(uint64_t logId,
+                      const google::protobuf::RepeatedPtrField<
+                                Protocol::Client::Read::Response::OK::Entry>&
+                            returnedEntries)
+{
+    std::vector<Entry> entries;
+    entries.reserve(returnedEntries.size());
+    for (auto it = returnedEntries.begin();
+         it != returnedEntries.end();
+         ++it) {
+        std::vector<EntryId> invalidates(it->invalidates().begin(),
+                                         it->invalidates().end());
+        if (it->has_data_length()) {
+            // The server cut this entry's data short: fetch the rest.
+            Protocol::Client::Read::Response::OK::Entry whole = *it;
+            readRest(logId, whole);
+            Entry e(whole.data().c_str(),
+                    uint32_t(whole.data().length()),
+                    invalidates);
+            e.id = it->entry_id();
+            entries.push_back(std::move(e));
+        } else if (it->has_data()) {
+            Entry e(it->data().c_str(),
+                    uint32_t(it->data().length()),
+                    invalidates);
+            e.id = it->entry_id();
+            entries.push_back(std::move(e));
+        } else {
+            Entry e(invalidates);
+            e.id = it->entry_id();
+            entries.push_back(std::move(e));
+        }
+    }
+    return entries;
+}
+
+std::vector<Entry>
+ClientImpl::watch(uint64_t logId, EntryId from, uint64_t timeoutMs)
+{
+    Protocol::Client::Watch::Request request;
+    request.set_log_id(logId);
+    request.set_from_entry_id(from);
+    request.set_timeout_ms(timeoutMs);
+    Protocol::Client::Watch::Response response;
+    uint32_t groupId = Protocol::Common::getRaftGroup(logId);
+    callReadOnly(OpCode::WATCH, request, response, groupId);
+    updateAppliedId(groupId, response.applied_id());
+    if (response.has_ok())
+        return toEntries(logId, response.ok().entry());
+    if (response.has_log_disappeared())
+        throw LogDisappearedException();
+    PANIC("Did not understand server response to watch RPC:\n%s",
+          Core::ProtoBuf::dumpString(response, false).c_str());
+}
+
+std::unique_ptr<SubscriptionImplBase>
+ClientImpl::subscribe(uint64_t logId, EntryId from)
+{
+    return std::unique_ptr<SubscriptionImplBase>(
+        new SubscriptionImpl(
+            std::static_pointer_cast<ClientImpl>(self.lock()),
+            logId,
+            from));
+}
+
 EntryId
 ClientImpl::getLastId(uint64_t logId)
 {
     Protocol::Client::GetLastId::Request request;
     request.set_log_id(logId);
     Protocol::Client::GetLastId::Response response;
-    leaderRPC->call(OpCode::GET_LAST_ID, request, response);
+    uint32_t groupId = Protocol::Common::getRaftGroup(logId);
+    callReadOnly(OpCode::GET_LAST_ID, request, response, groupId);
+    updateAppliedId(groupId, response.applied_id());
     if (response.has_ok())
         return response.ok().head_entry_id();
     if (response.has_log_disappeared())
@@ -189,26 +539,70 @@ ClientImpl::getLastId(uint64_t logId)
 }
 
 std::pair<uint64_t, Configuration>
-ClientImpl::getConfiguration()
+ClientImpl::getConfiguration(Configuration& learners)
+{
+    return getGroupConfiguration(0, learners);
+}
+
+std::pair<uint64_t, Configuration>
+ClientImpl::getGroupConfiguration(uint32_t groupId, Configuration& learners)
 {
     Protocol::Client::GetConfiguration::Request request;
+    if (groupId != 0)
+        request.set_group_id(groupId);
     Protocol::Client::GetConfiguration::Response response;
-    leaderRPC->call(OpCode::GET_CONFIGURATION, request, response);
+    leaderRPC->call(OpCode::GET_CONFIGURATION, request, response, groupId);
     Configuration configuration;
     for (auto it = response.servers().begin();
          it != response.servers().end();
          ++it) {
         configuration.emplace_back(it->server_id(), it->address());
     }
+    learners.clear();
+    for (auto it = response.learners().begin();
+         it != response.learners().end();
+         ++it) {
+        learners.emplace_back(it->server_id(), it->address());
+    }
     return {response.id(), configuration};
 }
 
 ConfigurationResult
 ClientImpl::setConfiguration(uint64_t oldId,
-                             const Configuration& newConfiguration)
+                             const Configuration& newConfiguration,
+                             const Configuration* newLearners)
+{
+    // Group 0's configuration is the one the caller saw, so it decides
+    // whether the change goes ahead. The other groups then follow it, each
+    // from whatever configuration it has now.
+    ConfigurationResult result = setGroupConfiguration(0, oldId,
+                                                       newConfiguration,
+                                                       newLearners);
+    for (uint32_t groupId = 1;
+         groupId < numRaftGroups &&
+            result.status == ConfigurationResult::OK;
+         ++groupId) {
+        do {
+            Configuration learners;
+            uint64_t groupOldId =
+                getGroupConfiguration(groupId, learners).first;
+            result = setGroupConfiguration(groupId, groupOldId,
+                                           newConfiguration, newLearners);
+        } while (result.status == ConfigurationResult::CHANGED);
+    }
+    return result;
+}
+
+ConfigurationResult
+ClientImpl::setGroupConfiguration(uint32_t groupId,
+                                  uint64_t oldId,
+                                  const Configuration& newConfiguration,
+                                  const Configuration* newLearners)
 {
     Protocol::Client::SetConfiguration::Request request;
     request.set_old_id(oldId);
+    if (groupId != 0)
+        request.set_group_id(groupId);
     for (auto it = newConfiguration.begin();
          it != newConfiguration.end();
          ++it) {
@@ -216,8 +610,17 @@ ClientImpl::setConfiguration(uint64_t oldId,
         s->set_server_id(it->first);
         s->set_address(it->second);
     }
+    if (newLearners != NULL) {
+        request.mutable_new_learners(); // present even if empty
+        for (auto it = newLearners->begin(); it != newLearners->end(); ++it) {
+            Protocol::Client::Server* s =
+                request.mutable_new_learners()->add_servers();
+            s->set_server_id(it->first);
+            s->set_address(it->second);
+        }
+    }
     Protocol::Client::SetConfiguration::Response response;
-    leaderRPC->call(OpCode::SET_CONFIGURATION, request, response);
+    leaderRPC->call(OpCode::SET_CONFIGURATION, request, response, groupId);
     ConfigurationResult result;
     if (response.has_ok()) {
         return result;
@@ -239,5 +642,35 @@ ClientImpl::setConfiguration(uint64_t oldId,
           Core::ProtoBuf::dumpString(response, false).c_str());
 }
 
+LeadershipTransferResult
+ClientImpl::transferLeadership(uint64_t serverId)
+{
+    Protocol::Client::TransferLeadership::Request request;
+    if (serverId != 0)
+        request.set_server_id(serverId);
+    Protocol::Client::TransferLeadership::Response response;
+    leaderRPC->call(OpCode::TRANSFER_LEADERSHIP, request, response, 0);
+    LeadershipTransferResult result;
+    if (response.has_ok()) {
+        result.leaderId = response.ok().leader_id();
+        return result;
+    }
+    if (response.has_failed()) {
+        result.status = LeadershipTransferResult::FAILED;
+        result.reason = response.failed().reason();
+        return result;
+    }
+    PANIC("Did not understand server response to transferLeadership RPC:\n%s",
+          Core::ProtoBuf::dumpString(response, false).c_str());
+}
+
+void
+ClientImpl::setFollowerReads(bool enabled, uint64_t newMaxStalenessMs)
+{
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    followerReads = enabled;
+    maxStalenessMs = newMaxStalenessMs;
+}
+
 } // namespace LogCabin::Client
 } // namespace LogCabin
@@ -13,6 +13,9 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <map>
+#include <mutex>
+
 #include "Client/Client.h"
 #include "Client/ClientImplBase.h"
 #include "Client/LeaderRPC.h"
@@ -38,21 +41,128 @@ class ClientImpl : public ClientImplBase {
     void deleteLog(const std::string& logName);
     std::vector<std::string> listLogs();
     EntryId append(uint64_t logId, const Entry& entry, EntryId expectedId);
-    std::vector<Entry> read(uint64_t logId, EntryId from);
+    std::unique_ptr<ReadResultImplBase> read(uint64_t logId, EntryId from);
+    std::vector<Entry> watch(uint64_t logId, EntryId from,
+                             uint64_t timeoutMs);
+    std::unique_ptr<SubscriptionImplBase> subscribe(uint64_t logId,
+                                                    EntryId from);
     EntryId getLastId(uint64_t logId);
-    std::pair<uint64_t, Configuration> getConfiguration();
+    std::pair<uint64_t, Configuration> getConfiguration(
+                            Configuration& learners);
     ConfigurationResult setConfiguration(
                             uint64_t oldId,
-                            const Configuration& newConfiguration);
+                            const Configuration& newConfiguration,
+                            const Configuration* newLearners);
+    LeadershipTransferResult transferLeadership(uint64_t serverId);
+    void setFollowerReads(bool enabled, uint64_t maxStalenessMs);
 
   private:
+    /**
+     * The implementation of SubscriptionImplBase returned by subscribe().
+     */
+    class SubscriptionImpl;
+
+    /**
+     * The implementation of ReadResultImplBase returned by read(). This
+     * holds the Read response, and its views point into the response's
+     * entries.
+     */
+    class ReadResultImpl;
+
     /**
      * Asks the cluster leader for the range of supported RPC protocol
      * versions, and select the best one. This is used to make sure the client
-     * and server are speaking the same version of the RPC protocol.
+     * and server are speaking the same version of the RPC protocol. The
+     * answer also sets #numRaftGroups.
      */
     uint32_t negotiateRPCVersion();
 
+    /**
+     * Return the Raft group that holds the log with the given name.
+     */
+    uint32_t getRaftGroup(const std::string& logName) const;
+
+    /**
+     * Get the configuration of one Raft group. See getConfiguration().
+     */
+    std::pair<uint64_t, Configuration> getGroupConfiguration(
+                            uint32_t groupId,
+                            Configuration& learners);
+
+    /**
+     * Change the configuration of one Raft group. See setConfiguration().
+     */
+    ConfigurationResult setGroupConfiguration(
+                            uint32_t groupId,
+                            uint64_t oldId,
+                            const Configuration& newConfiguration,
+                            const Configuration* newLearners);
+
+    /**
+     * Stage an entry's data in the cluster with AppendChunk RPCs, for an
+     * Append request to name.
+     * \param logId
+     *      The log the entry will be appended to.
+     * \param uploadId
+     *      Identifies the upload in the AppendChunk and Append requests.
+     * \param entry
+     *      The entry, whose data is longer than MAX_CHUNK_LENGTH.
+     */
+    void upload(uint64_t logId, uint64_t uploadId, const Entry& entry);
+
+    /**
+     * Fetch the rest of the data of an entry that the server cut short (see
+     * Read.Response.OK.Entry.data_length), appending it to entry.data().
+     * \param logId
+     *      The log the entry is from.
+     * \param entry
+     *      The entry from a response, whose data_length is set. This is
+     *      cleared once the data is complete.
+     */
+    void readRest(uint64_t logId,
+                  Protocol::Client::Read::Response::OK::Entry& entry);
+
+    /**
+     * Convert the entries in a Read, Watch, or Subscribe response to the
+     * client's format. This fetches the rest of the data for any entries the
+     * server cut short.
+     * \param logId
+     *      The log the entries are from.
+     * \param returnedEntries
+     *      The entries from the response.
+     */
+    std::vector<Entry> toEntries(
+            uint64_t logId,
+            const google::protobuf::RepeatedPtrField<
+                    Protocol::Client::Read::Response::OK::Entry>&
+                returnedEntries);
+
+    /**
+     * Send a read-only RPC: to any server if follower reads are enabled, or
+     * to the leader otherwise. If the server can't answer, this asks the
+     * leader instead, as the FollowerRead documentation says.
+     * \param opCode
+     *      See LeaderRPCBase::call.
+     * \param request
+     *      A ListLogs, Read, GetLastId, or Watch request. Its follower_read
+     *      field is filled in here.
+     * \param[out] response
+     *      See LeaderRPCBase::call.
+     * \param groupId
+     *      See LeaderRPCBase::call.
+     */
+    template<typename Request>
+    void callReadOnly(Protocol::Client::OpCode opCode,
+                      Request& request,
+                      google::protobuf::Message& response,
+                      uint32_t groupId);
+
+    /**
+     * Remember that the given Raft group has applied the given entry, so
+     * that later follower reads reflect it.
+     */
+    void updateAppliedId(uint32_t groupId, uint64_t id);
+
     /**
      * Used to send RPCs to the leader of the LogCabin cluster.
      */
@@ -64,6 +174,36 @@ class ClientImpl : public ClientImplBase {
      */
     uint32_t rpcProtocolVersion;
 
+    /**
+     * The number of Raft groups the cluster spreads its logs across. (This
+     * is set by negotiateRPCVersion().)
+     */
+    uint32_t numRaftGroups;
+
+    /**
+     * Protects #followerReads, #maxStalenessMs, and #appliedIds.
+     */
+    std::mutex mutex;
+
+    /**
+     * Whether read-only RPCs may be sent to any server. See
+     * Cluster::enableFollowerReads.
+     */
+    bool followerReads;
+
+    /**
+     * See Cluster::enableFollowerReads.
+     */
+    uint64_t maxStalenessMs;
+
+    /**
+     * The largest applied_id returned by any server so far for each Raft
+     * group, keyed by group ID. Follower reads require at least this entry
+     * of their group's log, so that they see this client's earlier
+     * operations.
+     */
+    std::map<uint32_t, uint64_t> appliedIds;
+
     // ClientImpl is not copyable
     ClientImpl(const ClientImpl&) = delete;
     ClientImpl& operator=(const ClientImpl&) = delete;
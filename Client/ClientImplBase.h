@@ -23,6 +23,61 @@
 namespace LogCabin {
 namespace Client {
 
+/**
+ * A base class for the implementation of Subscription. This is implemented
+ * alongside each of the ClientImplBase classes.
+ */
+class SubscriptionImplBase {
+  public:
+    /// Constructor.
+    SubscriptionImplBase() {}
+    /// Destructor. This ends the subscription.
+    virtual ~SubscriptionImplBase() {}
+    /// See Subscription::next.
+    virtual std::vector<Entry> next(uint64_t timeoutMs) = 0;
+
+    // SubscriptionImplBase is not copyable
+    SubscriptionImplBase(const SubscriptionImplBase&) = delete;
+    SubscriptionImplBase& operator=(const SubscriptionImplBase&) = delete;
+};
+
+/**
+ * A base class for the implementation of ReadResult. This is implemented
+ * alongside each of the ClientImplBase classes.
+ */
+class ReadResultImplBase {
+  public:
+    /// Constructor.
+    ReadResultImplBase() {}
+    /// Destructor.
+    virtual ~ReadResultImplBase() {}
+    /// See ReadResult::size.
+    virtual size_t size() const = 0;
+    /// Return a view of the entry at position 'index', which is less than
+    /// size().
+    virtual EntryView get(size_t index) const = 0;
+
+    // ReadResultImplBase is not copyable
+    ReadResultImplBase(const ReadResultImplBase&) = delete;
+    ReadResultImplBase& operator=(const ReadResultImplBase&) = delete;
+
+  protected:
+    /// Build an EntryView, whose members are private to this class.
+    static EntryView makeView(EntryId id,
+                              const EntryId* invalidates,
+                              uint32_t numInvalidates,
+                              const void* data,
+                              uint32_t length) {
+        EntryView view;
+        view.id = id;
+        view.invalidates = invalidates;
+        view.numInvalidates = numInvalidates;
+        view.data = data;
+        view.length = length;
+        return view;
+    }
+};
+
 /**
  * A base class for the implementation of the client library.
  * This is implemented by Client::ClientImpl and Client::MockClientImpl.
@@ -64,14 +119,29 @@ class ClientImplBase {
     virtual EntryId append(uint64_t logId, const Entry& entry,
                            EntryId expectedId) = 0;
     /// See Log::read.
-    virtual std::vector<Entry> read(uint64_t logId, EntryId from) = 0;
+    virtual std::unique_ptr<ReadResultImplBase> read(uint64_t logId,
+                                                     EntryId from) = 0;
+    /// See Log::watch.
+    virtual std::vector<Entry> watch(uint64_t logId, EntryId from,
+                                     uint64_t timeoutMs) = 0;
+    /// See Log::subscribe.
+    virtual std::unique_ptr<SubscriptionImplBase> subscribe(
+                uint64_t logId, EntryId from) = 0;
     /// See Log::getLastId.
     virtual EntryId getLastId(uint64_t logId) = 0;
 
-    virtual std::pair<uint64_t, Configuration> getConfiguration() = 0;
+    /// See Cluster::getConfiguration.
+    virtual std::pair<uint64_t, Configuration> getConfiguration(
+                Configuration& learners) = 0;
+    /// See Cluster::setConfiguration. newLearners may be NULL.
     virtual ConfigurationResult setConfiguration(
                 uint64_t oldId,
-                const Configuration& newConfiguration) = 0;
+                const Configuration& newConfiguration,
+                const Configuration* newLearners) = 0;
+    /// See Cluster::transferLeadership.
+    virtual LeadershipTransferResult transferLeadership(uint64_t serverId) = 0;
+    /// See Cluster::enableFollowerReads and Cluster::disableFollowerReads.
+    virtual void setFollowerReads(bool enabled, uint64_t maxStalenessMs) = 0;
 
   protected:
     /**
@@ -23,6 +23,7 @@
 #include "Client/ClientImpl.h"
 #include "Client/LeaderRPCMock.h"
 #include "Core/ProtoBuf.h"
+#include "Protocol/Common.h"
 #include "build/Protocol/Client.pb.h"
 
 namespace LogCabin {
@@ -101,6 +102,109 @@ TEST_F(ClientClusterTest, listLogs_normal) {
     EXPECT_EQ("", *mockRPC->popRequest());
 }
 
+TEST_F(ClientClusterTest, listLogs_followerReads) {
+    cluster->enableFollowerReads(500);
+    mockRPC->expect(OpCode::LIST_LOGS,
+        fromString<Protocol::Client::ListLogs::Response>(
+            "log_names: ['testLog1'], applied_id: 7"));
+    cluster->listLogs();
+    EXPECT_EQ("follower_read { max_staleness_ms: 500 }",
+              *mockRPC->popRequest());
+
+    // later follower reads must reflect what this client has seen
+    mockRPC->expect(OpCode::LIST_LOGS,
+        fromString<Protocol::Client::ListLogs::Response>(""));
+    cluster->listLogs();
+    EXPECT_EQ("follower_read { max_staleness_ms: 500, min_applied_id: 7 }",
+              *mockRPC->popRequest());
+
+    cluster->disableFollowerReads();
+    mockRPC->expect(OpCode::LIST_LOGS,
+        fromString<Protocol::Client::ListLogs::Response>(""));
+    cluster->listLogs();
+    EXPECT_EQ("", *mockRPC->popRequest());
+}
+
+TEST_F(ClientClusterTest, listLogs_followerReadsFallBack) {
+    cluster->enableFollowerReads(500);
+    mockRPC->expectNoAnswer(OpCode::LIST_LOGS);
+    mockRPC->expect(OpCode::LIST_LOGS,
+        fromString<Protocol::Client::ListLogs::Response>(
+            "log_names: ['testLog1']"));
+    EXPECT_EQ((std::vector<std::string> {"testLog1"}),
+              cluster->listLogs());
+    EXPECT_EQ("follower_read { max_staleness_ms: 500 }",
+              *mockRPC->popRequest());
+    // the leader is asked without the follower_read field
+    EXPECT_EQ("", *mockRPC->popRequest());
+}
+
+TEST_F(ClientClusterTest, listLogs_raftGroups) {
+    dynamic_cast<Client::ClientImpl*>(cluster->clientImpl.get())->
+        numRaftGroups = 2;
+    mockRPC->expect(OpCode::LIST_LOGS,
+        fromString<Protocol::Client::ListLogs::Response>(
+            "log_names: ['testLog2']"));
+    mockRPC->expect(OpCode::LIST_LOGS,
+        fromString<Protocol::Client::ListLogs::Response>(
+            "log_names: ['testLog3', 'testLog1']"));
+    EXPECT_EQ((std::vector<std::string> {
+               "testLog1",
+               "testLog2",
+               "testLog3",
+              }),
+              cluster->listLogs());
+    EXPECT_EQ("", *mockRPC->popRequest());
+    EXPECT_EQ("group_id: 1", *mockRPC->popRequest());
+    EXPECT_EQ(1U, mockRPC->lastGroupId);
+}
+
+TEST_F(ClientClusterTest, raftGroupRouting) {
+    dynamic_cast<Client::ClientImpl*>(cluster->clientImpl.get())->
+        numRaftGroups = 4;
+    uint64_t logId = (3UL << Protocol::Common::RAFT_GROUP_SHIFT) + 1;
+    mockRPC->expect(OpCode::OPEN_LOG,
+        fromString<Protocol::Client::OpenLog::Response>(
+            format("log_id: %lu", logId)));
+    Client::Log log = cluster->openLog("testLog");
+    EXPECT_EQ(Protocol::Common::getRaftGroup("testLog", 4),
+              mockRPC->lastGroupId);
+    mockRPC->expect(OpCode::APPEND,
+        fromString<Protocol::Client::Append::Response>(
+            "ok { entry_id: 0 }"));
+    log.append(Client::Entry("hello", 5));
+    EXPECT_EQ(3U, mockRPC->lastGroupId);
+}
+
+TEST_F(ClientClusterTest, setConfiguration_raftGroups) {
+    dynamic_cast<Client::ClientImpl*>(cluster->clientImpl.get())->
+        numRaftGroups = 2;
+    mockRPC->expect(OpCode::SET_CONFIGURATION,
+        fromString<Protocol::Client::SetConfiguration::Response>("ok {}"));
+    // group 1 changes under the client once
+    mockRPC->expect(OpCode::GET_CONFIGURATION,
+        fromString<Protocol::Client::GetConfiguration::Response>("id: 8"));
+    mockRPC->expect(OpCode::SET_CONFIGURATION,
+        fromString<Protocol::Client::SetConfiguration::Response>(
+            "configuration_changed {}"));
+    mockRPC->expect(OpCode::GET_CONFIGURATION,
+        fromString<Protocol::Client::GetConfiguration::Response>("id: 9"));
+    mockRPC->expect(OpCode::SET_CONFIGURATION,
+        fromString<Protocol::Client::SetConfiguration::Response>("ok {}"));
+    EXPECT_EQ(Client::ConfigurationResult::OK,
+              cluster->setConfiguration(5, {{1, "a"}}).status);
+    EXPECT_EQ("old_id: 5, new_servers { server_id: 1, address: 'a' }",
+              *mockRPC->popRequest());
+    EXPECT_EQ("group_id: 1", *mockRPC->popRequest());
+    EXPECT_EQ("old_id: 8, new_servers { server_id: 1, address: 'a' }, "
+              "group_id: 1",
+              *mockRPC->popRequest());
+    EXPECT_EQ("group_id: 1", *mockRPC->popRequest());
+    EXPECT_EQ("old_id: 9, new_servers { server_id: 1, address: 'a' }, "
+              "group_id: 1",
+              *mockRPC->popRequest());
+}
+
 // TODO(ongaro): test getConfiguration, setConfiguraton
 
 class ClientLogTest : public ClientClusterTest {
@@ -201,6 +305,99 @@ TEST_F(ClientLogTest, append_logDisappeared)
               *mockRPC->popRequest());
 }
 
+TEST_F(ClientLogTest, append_chunked)
+{
+    const uint64_t chunk = Protocol::Common::MAX_CHUNK_LENGTH;
+    std::string data(chunk * 2 + 10, 'x');
+    data.at(chunk) = 'y';
+    Client::Entry entry(data.data(), uint32_t(data.size()));
+    mockRPC->expect(OpCode::APPEND_CHUNK,
+        fromString<Protocol::Client::AppendChunk::Response>(
+            format("ok { staged_length: %lu }", chunk)));
+    // the cluster dropped the upload here, so the client starts over
+    mockRPC->expect(OpCode::APPEND_CHUNK,
+        fromString<Protocol::Client::AppendChunk::Response>(
+            "ok { staged_length: 0 }"));
+    mockRPC->expect(OpCode::APPEND_CHUNK,
+        fromString<Protocol::Client::AppendChunk::Response>(
+            format("ok { staged_length: %lu }", chunk)));
+    mockRPC->expect(OpCode::APPEND_CHUNK,
+        fromString<Protocol::Client::AppendChunk::Response>(
+            format("ok { staged_length: %lu }", chunk * 2)));
+    mockRPC->expect(OpCode::APPEND_CHUNK,
+        fromString<Protocol::Client::AppendChunk::Response>(
+            format("ok { staged_length: %lu }", data.size())));
+    mockRPC->expect(OpCode::APPEND,
+        fromString<Protocol::Client::Append::Response>(
+            "ok { entry_id: 32 }"));
+    EXPECT_EQ(32U, log->append(entry));
+
+    std::vector<uint64_t> offsets;
+    std::string staged;
+    uint64_t uploadId = 0;
+    for (uint32_t i = 0; i < 5; ++i) {
+        Protocol::Client::AppendChunk::Request request;
+        request.CopyFrom(*mockRPC->popRequest());
+        EXPECT_EQ(1U, request.log_id());
+        if (i == 0)
+            uploadId = request.upload_id();
+        EXPECT_EQ(uploadId, request.upload_id());
+        EXPECT_GE(chunk, request.data().size());
+        offsets.push_back(request.offset());
+        if (request.offset() == 0)
+            staged.clear();
+        staged += request.data();
+    }
+    EXPECT_EQ((std::vector<uint64_t>{ 0, chunk, 0, chunk, chunk * 2 }),
+              offsets);
+    EXPECT_TRUE(data == staged);
+    Protocol::Client::Append::Request request;
+    request.CopyFrom(*mockRPC->popRequest());
+    EXPECT_FALSE(request.has_data());
+    EXPECT_EQ(uploadId, request.upload_id());
+    EXPECT_EQ(data.size(), request.upload_length());
+}
+
+TEST_F(ClientLogTest, append_chunkedUploadDisappeared)
+{
+    std::string data(Protocol::Common::MAX_CHUNK_LENGTH + 1, 'x');
+    Client::Entry entry(data.data(), uint32_t(data.size()));
+    for (uint32_t i = 0; i < 2; ++i) {
+        mockRPC->expect(OpCode::APPEND_CHUNK,
+            fromString<Protocol::Client::AppendChunk::Response>(
+                format("ok { staged_length: %u }",
+                       Protocol::Common::MAX_CHUNK_LENGTH)));
+        mockRPC->expect(OpCode::APPEND_CHUNK,
+            fromString<Protocol::Client::AppendChunk::Response>(
+                format("ok { staged_length: %lu }", data.size())));
+        mockRPC->expect(OpCode::APPEND,
+            fromString<Protocol::Client::Append::Response>(
+                i == 0 ? "upload_disappeared {}" : "ok { entry_id: 32 }"));
+    }
+    EXPECT_EQ(32U, log->append(entry));
+    for (uint32_t i = 0; i < 2; ++i) {
+        Protocol::Client::AppendChunk::Request chunk1;
+        chunk1.CopyFrom(*mockRPC->popRequest());
+        Protocol::Client::AppendChunk::Request chunk2;
+        chunk2.CopyFrom(*mockRPC->popRequest());
+        Protocol::Client::Append::Request append;
+        append.CopyFrom(*mockRPC->popRequest());
+        EXPECT_EQ(chunk1.upload_id(), chunk2.upload_id());
+        EXPECT_EQ(chunk1.upload_id(), append.upload_id());
+    }
+}
+
+TEST_F(ClientLogTest, append_chunkedLogDisappeared)
+{
+    std::string data(Protocol::Common::MAX_CHUNK_LENGTH + 1, 'x');
+    Client::Entry entry(data.data(), uint32_t(data.size()));
+    mockRPC->expect(OpCode::APPEND_CHUNK,
+        fromString<Protocol::Client::AppendChunk::Response>(
+            "log_disappeared {}"));
+    EXPECT_THROW(log->append(entry),
+                 Client::LogDisappearedException);
+}
+
 TEST_F(ClientLogTest, invalidate_empty)
 {
     mockRPC->expect(OpCode::APPEND,
@@ -251,7 +448,8 @@ TEST_F(ClientLogTest, invalidate_logDisappeared)
 }
 
 namespace {
-std::string entryDataString(const Client::Entry& entry)
+template<typename EntryType>
+std::string entryDataString(const EntryType& entry)
 {
     return std::string(static_cast<const char*>(entry.getData()),
                        entry.getLength());
@@ -269,7 +467,7 @@ TEST_F(ClientLogTest, read_normal)
             "   entry: { entry_id: 26, invalidates: [16, 18], data: 'bye' } "
             "   entry: { entry_id: 28, data: '' } "
             "}"));
-    std::vector<Client::Entry> entries = log->read(20);
+    Client::ReadResult entries = log->read(20);
     ASSERT_EQ(5U, entries.size());
     EXPECT_EQ(20U, entries[0].getId());
     EXPECT_EQ(22U, entries[1].getId());
@@ -298,6 +496,76 @@ TEST_F(ClientLogTest, read_normal)
               *mockRPC->popRequest());
 }
 
+TEST_F(ClientLogTest, read_iterate)
+{
+    mockRPC->expect(OpCode::READ,
+        fromString<Protocol::Client::Read::Response>(
+            "ok { "
+            "   entry: { entry_id: 20, data: 'hello' } "
+            "   entry: { entry_id: 21 } "
+            "   entry: { entry_id: 23, data: 'bye' } "
+            "}"));
+    Client::ReadResult entries = log->read(20);
+    std::vector<Client::EntryId> ids;
+    for (auto it = entries.begin(); it != entries.end(); ++it)
+        ids.push_back((*it).getId());
+    EXPECT_EQ((std::vector<Client::EntryId>{ 20, 21, 23 }), ids);
+    // views point into the result rather than at copies
+    EXPECT_EQ(entries[0].getData(), entries.at(0).getData());
+    EXPECT_THROW(entries.at(3), std::out_of_range);
+    mockRPC->popRequest();
+}
+
+TEST_F(ClientLogTest, read_dataCutShort)
+{
+    mockRPC->expect(OpCode::READ,
+        fromString<Protocol::Client::Read::Response>(
+            "ok { "
+            "   entry: { entry_id: 20, data: 'he', data_length: 8 } "
+            "   entry: { entry_id: 21, data: 'bye' } "
+            "}"));
+    mockRPC->expect(OpCode::READ,
+        fromString<Protocol::Client::Read::Response>(
+            "ok { entry: { entry_id: 20, data: 'llo', data_length: 8 } }"));
+    mockRPC->expect(OpCode::READ,
+        fromString<Protocol::Client::Read::Response>(
+            "ok { entry: { entry_id: 20, data: ' yo', data_length: 8 } }"));
+    Client::ReadResult entries = log->read(20);
+    ASSERT_EQ(2U, entries.size());
+    EXPECT_EQ(20U, entries[0].getId());
+    EXPECT_EQ("hello yo", entryDataString(entries[0]));
+    EXPECT_EQ("bye", entryDataString(entries[1]));
+    EXPECT_EQ("log_id: 1 "
+              "from_entry_id: 20 ",
+              *mockRPC->popRequest());
+    EXPECT_EQ("log_id: 1 "
+              "from_entry_id: 20 "
+              "data_offset: 2 ",
+              *mockRPC->popRequest());
+    EXPECT_EQ("log_id: 1 "
+              "from_entry_id: 20 "
+              "data_offset: 5 ",
+              *mockRPC->popRequest());
+}
+
+TEST_F(ClientLogTest, read_followerReadsSeeOwnWrites)
+{
+    cluster->enableFollowerReads(500);
+    mockRPC->expect(OpCode::APPEND,
+        fromString<Protocol::Client::Append::Response>(
+            "ok { entry_id: 32 }, applied_id: 9"));
+    log->append(Client::Entry(std::vector<Client::EntryId>{}));
+    mockRPC->popRequest();
+    mockRPC->expect(OpCode::READ,
+        fromString<Protocol::Client::Read::Response>(
+            "ok {}"));
+    EXPECT_EQ(0U, log->read(20).size());
+    EXPECT_EQ("log_id: 1 "
+              "from_entry_id: 20 "
+              "follower_read { max_staleness_ms: 500, min_applied_id: 9 }",
+              *mockRPC->popRequest());
+}
+
 TEST_F(ClientLogTest, read_pastHead)
 {
     mockRPC->expect(OpCode::READ,
@@ -321,6 +589,128 @@ TEST_F(ClientLogTest, read_logDisappeared)
               *mockRPC->popRequest());
 }
 
+TEST_F(ClientLogTest, watch_normal)
+{
+    mockRPC->expect(OpCode::WATCH,
+        fromString<Protocol::Client::Watch::Response>(
+            "ok { "
+            "   entry: { entry_id: 20, data: 'hello' } "
+            "   entry: { entry_id: 21, invalidates: [12] } "
+            "}"));
+    std::vector<Client::Entry> entries = log->watch(20, 5000);
+    ASSERT_EQ(2U, entries.size());
+    EXPECT_EQ(20U, entries[0].getId());
+    EXPECT_EQ("hello", entryDataString(entries[0]));
+    EXPECT_EQ(21U, entries[1].getId());
+    EXPECT_EQ((std::vector<Client::EntryId>{ 12 }),
+              entries[1].getInvalidates());
+    EXPECT_EQ("log_id: 1 "
+              "from_entry_id: 20 "
+              "timeout_ms: 5000 ",
+              *mockRPC->popRequest());
+}
+
+TEST_F(ClientLogTest, watch_logDisappeared)
+{
+    mockRPC->expect(OpCode::WATCH,
+        fromString<Protocol::Client::Watch::Response>(
+            "log_disappeared {}"));
+    EXPECT_THROW(log->watch(20, 5000),
+                 Client::LogDisappearedException);
+    mockRPC->popRequest();
+}
+
+TEST_F(ClientLogTest, subscribe_normal)
+{
+    Client::Subscription subscription = log->subscribe(20);
+    mockRPC->expect(OpCode::SUBSCRIBE,
+        fromString<Protocol::Client::Subscribe::Response>(
+            "subscription_id: 7 "
+            "entry: { entry_id: 20, data: 'hello' } "));
+    mockRPC->expect(OpCode::SUBSCRIBE,
+        fromString<Protocol::Client::Subscribe::Response>(
+            "entry: { entry_id: 21, invalidates: [12] } "));
+    std::vector<Client::Entry> entries = subscription.next(5000);
+    ASSERT_EQ(1U, entries.size());
+    EXPECT_EQ(20U, entries[0].getId());
+    EXPECT_EQ("hello", entryDataString(entries[0]));
+    EXPECT_EQ("log_id: 1 "
+              "from_entry_id: 20 "
+              "credits: 1024 ",
+              *mockRPC->popRequest());
+    entries = subscription.next(5000);
+    ASSERT_EQ(1U, entries.size());
+    EXPECT_EQ(21U, entries[0].getId());
+    EXPECT_EQ(0U, subscription.next(0).size());
+}
+
+TEST_F(ClientLogTest, subscribe_grantsCredits)
+{
+    Client::Subscription subscription = log->subscribe(0);
+    mockRPC->expect(OpCode::SUBSCRIBE,
+        fromString<Protocol::Client::Subscribe::Response>(
+            "subscription_id: 7"));
+    Protocol::Client::Subscribe::Response response;
+    for (uint64_t id = 0; id < 600; ++id)
+        response.add_entry()->set_entry_id(id);
+    mockRPC->expect(OpCode::SUBSCRIBE, response);
+    EXPECT_EQ(600U, subscription.next(5000).size());
+    mockRPC->popRequest();
+    EXPECT_EQ("subscription_id: 7 "
+              "add_credits: 600",
+              *mockRPC->popRequest());
+}
+
+TEST_F(ClientLogTest, subscribe_reopen)
+{
+    Client::Subscription subscription = log->subscribe(20);
+    mockRPC->expect(OpCode::SUBSCRIBE,
+        fromString<Protocol::Client::Subscribe::Response>(
+            "subscription_id: 7 "
+            "entry: { entry_id: 20, data: 'hello' } "));
+    mockRPC->expectBrokenStream(OpCode::SUBSCRIBE);
+    mockRPC->expect(OpCode::SUBSCRIBE,
+        fromString<Protocol::Client::Subscribe::Response>(
+            "subscription_id: 8 "
+            "entry: { entry_id: 21, data: 'world' } "));
+    EXPECT_EQ(1U, subscription.next(5000).size());
+    std::vector<Client::Entry> entries = subscription.next(5000);
+    ASSERT_EQ(1U, entries.size());
+    EXPECT_EQ("world", entryDataString(entries[0]));
+    mockRPC->popRequest();
+    EXPECT_EQ("log_id: 1 "
+              "from_entry_id: 21 "
+              "credits: 1024 ",
+              *mockRPC->popRequest());
+}
+
+TEST_F(ClientLogTest, subscribe_cancel)
+{
+    {
+        Client::Subscription subscription = log->subscribe(0);
+        mockRPC->expect(OpCode::SUBSCRIBE,
+            fromString<Protocol::Client::Subscribe::Response>(
+                "subscription_id: 7"));
+        EXPECT_EQ(0U, subscription.next(0).size());
+    }
+    mockRPC->popRequest();
+    EXPECT_EQ("subscription_id: 7 "
+              "cancel: true",
+              *mockRPC->popRequest());
+}
+
+TEST_F(ClientLogTest, subscribe_logDisappeared)
+{
+    Client::Subscription subscription = log->subscribe(0);
+    mockRPC->expect(OpCode::SUBSCRIBE,
+        fromString<Protocol::Client::Subscribe::Response>(
+            "subscription_id: 7 "
+            "log_disappeared {}"));
+    EXPECT_THROW(subscription.next(5000),
+                 Client::LogDisappearedException);
+    mockRPC->popRequest();
+}
+
 TEST_F(ClientLogTest, getLastId_emptyLog)
 {
     mockRPC->expect(OpCode::GET_LAST_ID,
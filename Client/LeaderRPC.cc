@@ -24,20 +24,101 @@
 namespace LogCabin {
 namespace Client {
 
+////////// LeaderRPC::LeaderStream //////////
+
+class LeaderRPC::LeaderStream : public LeaderRPCBase::Stream {
+  public:
+    LeaderStream(LeaderRPC& leaderRPC,
+                 uint32_t groupId,
+                 std::shared_ptr<RPC::ClientSession> session,
+                 OpCode opCode,
+                 const google::protobuf::Message& request)
+        : leaderRPC(leaderRPC)
+        , groupId(groupId)
+        , session(session)
+        , rpc(session,
+              Protocol::Common::ServiceId::CLIENT_SERVICE,
+              1,
+              opCode,
+              request,
+              0,
+              true)
+        , lastSent()
+        , broken(false)
+    {
+    }
+
+    Status
+    waitForReply(google::protobuf::Message& response,
+                 Core::Time::SteadyClock::time_point deadline)
+    {
+        typedef RPC::ClientRPC::Status RPCStatus;
+        if (broken)
+            return Status::BROKEN;
+        Protocol::Client::Error serviceSpecificError;
+        switch (rpc.waitForStreamReply(&response,
+                                       &serviceSpecificError,
+                                       deadline)) {
+            case RPCStatus::OK:
+                return Status::OK;
+            case RPCStatus::TIMEOUT:
+                return Status::TIMEOUT;
+            case RPCStatus::SERVICE_SPECIFIC_ERROR:
+                leaderRPC.handleServiceSpecificError(groupId,
+                                                     session,
+                                                     serviceSpecificError);
+                break;
+            case RPCStatus::RPC_FAILED:
+                // If the session is broken, get a new one for next time.
+                leaderRPC.connectRandom(groupId, session);
+                break;
+        }
+        broken = true;
+        rpc.cancel();
+        return Status::BROKEN;
+    }
+
+    void
+    send(OpCode opCode, const google::protobuf::Message& request)
+    {
+        // The request is on its way once the ClientRPC is constructed.
+        // Hanging on to it just saves the session from logging the reply as
+        // unexpected.
+        lastSent = RPC::ClientRPC(session,
+                                  Protocol::Common::ServiceId::CLIENT_SERVICE,
+                                  1,
+                                  opCode,
+                                  request);
+    }
+
+  private:
+    LeaderRPC& leaderRPC;
+    uint32_t groupId;
+    std::shared_ptr<RPC::ClientSession> session;
+    RPC::ClientRPC rpc;
+    RPC::ClientRPC lastSent;
+    bool broken;
+};
+
+////////// LeaderRPC //////////
+
 LeaderRPC::LeaderRPC(const RPC::Address& hosts)
     : hosts(hosts)
+    , readHosts(hosts)
     , eventLoop()
     , eventLoopThread(&Event::Loop::runForever, &eventLoop)
     , mutex()
-    , leaderSession() // set by connect()
+    , leaderSessions() // set by connect()
+    , readSession()    // set by callAnyServer()
 {
     std::unique_lock<std::mutex> lockGuard(mutex);
-    connect(hosts, lockGuard);
+    connect(0, hosts, lockGuard);
 }
 
 LeaderRPC::~LeaderRPC()
 {
-    leaderSession.reset();
+    leaderSessions.clear();
+    readSession.reset();
     eventLoop.exit();
     eventLoopThread.join();
 }
@@ -45,19 +126,17 @@ LeaderRPC::~LeaderRPC()
 void
 LeaderRPC::call(OpCode opCode,
                 const google::protobuf::Message& request,
-                google::protobuf::Message& response)
+                google::protobuf::Message& response,
+                uint32_t groupId)
 {
     typedef RPC::ClientRPC::Status Status;
 
     // TODO(ongaro): Rate limit the retries so as not to overwhelm servers
     // while they're choosing a new leader, etc.
     while (true) {
-        // Save a reference to the leaderSession
-        std::shared_ptr<RPC::ClientSession> cachedSession;
-        {
-            std::unique_lock<std::mutex> lockGuard(mutex);
-            cachedSession = leaderSession;
-        }
+        // Save a reference to the group's leader session
+        std::shared_ptr<RPC::ClientSession> cachedSession =
+            getLeaderSession(groupId);
 
         // Execute the RPC
         RPC::ClientRPC rpc(cachedSession,
@@ -73,19 +152,75 @@ LeaderRPC::call(OpCode opCode,
             case Status::OK:
                 return;
             case Status::SERVICE_SPECIFIC_ERROR:
-                handleServiceSpecificError(cachedSession,
+                handleServiceSpecificError(groupId,
+                                           cachedSession,
                                            serviceSpecificError);
                 break;
             case Status::RPC_FAILED:
                 // If the session is broken, get a new one and try again.
-                connectRandom(cachedSession);
+                connectRandom(groupId, cachedSession);
                 break;
+            case Status::TIMEOUT:
+                PANIC("waitForReply() has no deadline, so it can't time out");
+        }
+    }
+}
+
+bool
+LeaderRPC::callAnyServer(OpCode opCode,
+                         const google::protobuf::Message& request,
+                         google::protobuf::Message& response,
+                         uint32_t groupId)
+{
+    typedef RPC::ClientRPC::Status Status;
+
+    std::shared_ptr<RPC::ClientSession> cachedSession;
+    {
+        std::unique_lock<std::mutex> lockGuard(mutex);
+        if (!readSession) {
+            readHosts.refresh();
+            readSession = RPC::ClientSession::makeSession(
+                                eventLoop,
+                                readHosts,
+                                Protocol::Common::MAX_MESSAGE_LENGTH);
         }
+        cachedSession = readSession;
+    }
+
+    RPC::ClientRPC rpc(cachedSession,
+                       Protocol::Common::ServiceId::CLIENT_SERVICE,
+                       1,
+                       opCode,
+                       request);
+    Protocol::Client::Error serviceSpecificError;
+    Status status = rpc.waitForReply(&response, &serviceSpecificError);
+    if (status == Status::OK)
+        return true;
+
+    // The server is too far behind or unreachable. Pick another one for next
+    // time; the caller will have the leader answer this time.
+    VERBOSE("Server could not answer read-only request");
+    {
+        std::unique_lock<std::mutex> lockGuard(mutex);
+        if (cachedSession == readSession)
+            readSession.reset();
     }
+    return false;
+}
+
+std::unique_ptr<LeaderRPCBase::Stream>
+LeaderRPC::openStream(OpCode opCode,
+                      const google::protobuf::Message& request,
+                      uint32_t groupId)
+{
+    return std::unique_ptr<Stream>(
+        new LeaderStream(*this, groupId, getLeaderSession(groupId),
+                         opCode, request));
 }
 
 void
 LeaderRPC::handleServiceSpecificError(
+        uint32_t groupId,
         std::shared_ptr<RPC::ClientSession> cachedSession,
         const Protocol::Client::Error& error)
 {
@@ -96,11 +231,11 @@ LeaderRPC::handleServiceSpecificError(
                 // Server returned hint as to who the leader might be.
                 VERBOSE("Trying suggested %s as new leader",
                         error.leader_hint().c_str());
-                connectHost(error.leader_hint(), cachedSession);
+                connectHost(groupId, error.leader_hint(), cachedSession);
             } else {
                 // Well, this server isn't the leader. Try someone else.
                 VERBOSE("Trying random host as new leader");
-                connectRandom(cachedSession);
+                connectRandom(groupId, cachedSession);
             }
             break;
         default:
@@ -114,35 +249,52 @@ LeaderRPC::handleServiceSpecificError(
     }
 }
 
+std::shared_ptr<RPC::ClientSession>
+LeaderRPC::getLeaderSession(uint32_t groupId)
+{
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    std::shared_ptr<RPC::ClientSession>& session = leaderSessions[groupId];
+    if (!session) {
+        // Any server will do to start with; if it's not the group's leader,
+        // it'll say who is.
+        session = leaderSessions.at(0);
+    }
+    return session;
+}
+
 void
-LeaderRPC::connect(const RPC::Address& address,
+LeaderRPC::connect(uint32_t groupId,
+                   const RPC::Address& address,
                    std::unique_lock<std::mutex>& lockGuard)
 {
-    leaderSession = RPC::ClientSession::makeSession(
-                        eventLoop,
-                        address,
-                        Protocol::Common::MAX_MESSAGE_LENGTH);
+    leaderSessions[groupId] = RPC::ClientSession::makeSession(
+                                    eventLoop,
+                                    address,
+                                    Protocol::Common::MAX_MESSAGE_LENGTH);
 }
 
 void
-LeaderRPC::connectRandom(std::shared_ptr<RPC::ClientSession> cachedSession)
+LeaderRPC::connectRandom(uint32_t groupId,
+                         std::shared_ptr<RPC::ClientSession> cachedSession)
 {
     std::unique_lock<std::mutex> lockGuard(mutex);
-    if (cachedSession == leaderSession) {
+    if (cachedSession == leaderSessions[groupId]) {
         // Hope the next random host is the leader.
         // If that turns out to be false, we will soon find out.
         hosts.refresh();
-        connect(hosts, lockGuard);
+        connect(groupId, hosts, lockGuard);
     }
 }
 
 void
-LeaderRPC::connectHost(const std::string& host,
+LeaderRPC::connectHost(uint32_t groupId,
+                       const std::string& host,
                        std::shared_ptr<RPC::ClientSession> cachedSession)
 {
     std::unique_lock<std::mutex> lockGuard(mutex);
-    if (cachedSession == leaderSession) {
-        connect(RPC::Address(host, Protocol::Common::DEFAULT_PORT),
+    if (cachedSession == leaderSessions[groupId]) {
+        connect(groupId,
+                RPC::Address(host, Protocol::Common::DEFAULT_PORT),
                 lockGuard);
     }
 }
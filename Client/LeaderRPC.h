@@ -14,11 +14,13 @@
  */
 
 #include <cinttypes>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <thread>
 
 #include "build/Protocol/Client.pb.h"
+#include "Core/Time.h"
 #include "Event/Loop.h"
 #include "RPC/Address.h"
 
@@ -37,7 +39,8 @@ namespace Client {
 /**
  * This class is used to send RPCs from clients to the leader of the LogCabin
  * cluster. It automatically finds and connects to the leader and transparently
- * rolls over to a new leader when necessary.
+ * rolls over to a new leader when necessary. A cluster may run several Raft
+ * groups, each with its own leader; callers say which group each RPC is for.
  *
  * There are two implementations of this interface: LeaderRPC is probably the
  * one you're interested in. LeaderRPCMock is used for unit testing only.
@@ -49,6 +52,67 @@ class LeaderRPCBase {
      */
     typedef Protocol::Client::OpCode OpCode;
 
+    /**
+     * A streaming RPC to one server, returned by openStream(). The server
+     * may send back any number of responses. Destroying this cancels the RPC.
+     */
+    class Stream {
+      public:
+        /**
+         * The return type of waitForReply().
+         */
+        enum class Status {
+            /**
+             * The server sent a response, which is now in 'response'.
+             */
+            OK,
+            /**
+             * No response arrived before the deadline. The stream remains
+             * usable.
+             */
+            TIMEOUT,
+            /**
+             * The stream has ended, for example because the server failed or
+             * isn't the leader. The caller should open a new one.
+             */
+            BROKEN,
+        };
+
+        /// Constructor.
+        Stream() {}
+
+        /// Destructor.
+        virtual ~Stream() {}
+
+        /**
+         * Wait for the next response on the stream.
+         * \param[out] response
+         *      The response will be filled in here if this returns OK.
+         * \param deadline
+         *      Return TIMEOUT if no response has arrived by this time.
+         */
+        virtual Status
+        waitForReply(google::protobuf::Message& response,
+                     Core::Time::SteadyClock::time_point deadline) = 0;
+
+        /**
+         * Send an RPC to the same server, on the same session as the stream,
+         * without waiting for its response. This is meant for RPCs that
+         * refer to the stream, such as UpdateSubscription; if the RPC fails,
+         * the stream will break too.
+         * \param opCode
+         *      See call().
+         * \param request
+         *      See call().
+         */
+        virtual void send(OpCode opCode,
+                          const google::protobuf::Message& request) = 0;
+
+        // Stream is not copyable
+        Stream(const Stream&) = delete;
+        Stream& operator=(const Stream&) = delete;
+    };
+
     /// Constructor.
     LeaderRPCBase() {}
 
@@ -67,10 +131,54 @@ class LeaderRPCBase {
      *      PANIC.)
      * \param[out] response
      *      The response to the operation will be filled in here.
+     * \param groupId
+     *      The Raft group whose leader should execute the RPC. This is 0 for
+     *      RPCs that aren't about a particular log.
      */
     virtual void call(OpCode opCode,
                       const google::protobuf::Message& request,
-                      google::protobuf::Message& response) = 0;
+                      google::protobuf::Message& response,
+                      uint32_t groupId) = 0;
+
+    /**
+     * Execute a read-only RPC on any server in the cluster, which need not be
+     * the leader. The request should allow this by setting its follower_read
+     * field. Unlike call(), this only tries once.
+     * \param opCode
+     *      See call().
+     * \param request
+     *      See call().
+     * \param[out] response
+     *      See call().
+     * \param groupId
+     *      See call().
+     * \return
+     *      True if a server answered, false if it couldn't. In that case, the
+     *      caller should send the request to the leader with call() instead,
+     *      without its follower_read field.
+     */
+    virtual bool callAnyServer(OpCode opCode,
+                               const google::protobuf::Message& request,
+                               google::protobuf::Message& response,
+                               uint32_t groupId) = 0;
+
+    /**
+     * Start a streaming RPC on the cluster leader. Unlike call(), this
+     * doesn't retry: errors show up as a BROKEN stream, and it's up to the
+     * caller to open a new one.
+     * \param opCode
+     *      See call().
+     * \param request
+     *      See call().
+     * \param groupId
+     *      See call().
+     * \return
+     *      The stream from which to read the responses.
+     */
+    virtual std::unique_ptr<Stream>
+    openStream(OpCode opCode,
+               const google::protobuf::Message& request,
+               uint32_t groupId) = 0;
 
     // LeaderRPCBase is not copyable
     LeaderRPCBase(const LeaderRPCBase&) = delete;
@@ -97,30 +205,56 @@ class LeaderRPC : public LeaderRPCBase {
 
     void call(OpCode opCode,
               const google::protobuf::Message& request,
-              google::protobuf::Message& response);
+              google::protobuf::Message& response,
+              uint32_t groupId);
+    bool callAnyServer(OpCode opCode,
+                       const google::protobuf::Message& request,
+                       google::protobuf::Message& response,
+                       uint32_t groupId);
+    std::unique_ptr<Stream>
+    openStream(OpCode opCode,
+               const google::protobuf::Message& request,
+               uint32_t groupId);
   private:
 
+    /**
+     * The implementation of Stream returned by openStream().
+     */
+    class LeaderStream;
+
     /**
      * A helper for call() that decodes errors thrown by the service.
      */
     void handleServiceSpecificError(
+        uint32_t groupId,
         std::shared_ptr<RPC::ClientSession> cachedSession,
         const Protocol::Client::Error& error);
 
     /**
-     * Connect to a new host in hopes that it is the cluster leader.
+     * Return the session to the given Raft group's leader, starting out with
+     * group 0's for a group that hasn't been used yet.
+     */
+    std::shared_ptr<RPC::ClientSession> getLeaderSession(uint32_t groupId);
+
+    /**
+     * Connect to a new host in hopes that it is the leader of a Raft group.
+     * \param groupId
+     *      The group whose leader to look for.
      * \param address
      *      The host to connect to.
      * \param lockGuard
      *      Proof that the caller is holding #mutex.
      */
     void
-    connect(const RPC::Address& address,
+    connect(uint32_t groupId,
+            const RPC::Address& address,
             std::unique_lock<std::mutex>& lockGuard);
 
     /**
-     * Connect to a random host in #hosts in hopes that it is the cluster
-     * leader.
+     * Connect to a random host in #hosts in hopes that it is the leader of a
+     * Raft group.
+     * \param groupId
+     *      The group whose leader to look for.
      * \param cachedSession
      *      This operation will only disconnect the current session if it is
      *      the same as the session that is provided here. This is used to
@@ -128,10 +262,14 @@ class LeaderRPC : public LeaderRPCBase {
      *      problem.
      */
     void
-    connectRandom(std::shared_ptr<RPC::ClientSession> cachedSession);
+    connectRandom(uint32_t groupId,
+                  std::shared_ptr<RPC::ClientSession> cachedSession);
 
     /**
-     * Connect to a specific host in hopes that it is the cluster leader.
+     * Connect to a specific host in hopes that it is the leader of a Raft
+     * group.
+     * \param groupId
+     *      The group whose leader to look for.
      * \param host
      *      A string describing the host to connect to. This is passed in
      *      string form rather than as an Address, which might save a DNS
@@ -143,7 +281,8 @@ class LeaderRPC : public LeaderRPCBase {
      *      problem.
      */
     void
-    connectHost(const std::string& host,
+    connectHost(uint32_t groupId,
+                const std::string& host,
                 std::shared_ptr<RPC::ClientSession> cachedSession);
 
     /**
@@ -153,6 +292,12 @@ class LeaderRPC : public LeaderRPCBase {
      */
     RPC::Address hosts;
 
+    /**
+     * A copy of #hosts from which callAnyServer() picks random servers, kept
+     * separately so that it doesn't disturb the search for the leader.
+     */
+    RPC::Address readHosts;
+
     /**
      * The Event::Loop used to drive the underlying RPC mechanism.
      */
@@ -164,17 +309,26 @@ class LeaderRPC : public LeaderRPCBase {
     std::thread eventLoopThread;
 
     /**
-     * Protects #leaderSession. Threads hang on to this mutex while initiating
-     * new sessions to possible cluster leaders, in case other threads are
-     * already handling the problem.
+     * Protects #leaderSessions. Threads hang on to this mutex while
+     * initiating new sessions to possible cluster leaders, in case other
+     * threads are already handling the problem.
      */
     std::mutex mutex;
 
     /**
-     * The goal is to get this session connected to the cluster leader.
-     * This is never null, but it might sometimes point to the wrong host.
+     * The goal is to get each of these sessions connected to the leader of
+     * its Raft group, keyed by group ID. Group 0's session is never null,
+     * but any of them might sometimes point to the wrong host.
+     */
+    std::map<uint32_t, std::shared_ptr<RPC::ClientSession>> leaderSessions;
+
+    /**
+     * The session that callAnyServer() uses, to a random server. Each client
+     * picks its own, which spreads the read load across the cluster. This is
+     * NULL until the first call to callAnyServer() and after that server
+     * fails to answer. Protected by #mutex.
      */
-    std::shared_ptr<RPC::ClientSession> leaderSession;
+    std::shared_ptr<RPC::ClientSession> readSession;
 };
 
 } // namespace LogCabin::Client
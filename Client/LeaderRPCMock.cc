@@ -22,8 +22,45 @@
 namespace LogCabin {
 namespace Client {
 
+class LeaderRPCMock::MockStream : public LeaderRPCBase::Stream {
+  public:
+    MockStream(LeaderRPCMock& mock, OpCode opCode)
+        : mock(mock)
+        , opCode(opCode)
+    {
+    }
+
+    Status
+    waitForReply(google::protobuf::Message& response,
+                 Core::Time::SteadyClock::time_point deadline)
+    {
+        if (mock.responseQueue.empty() ||
+            mock.responseQueue.front().first != opCode) {
+            return Status::TIMEOUT;
+        }
+        MessagePtr primed = std::move(mock.responseQueue.front().second);
+        mock.responseQueue.pop();
+        if (!primed)
+            return Status::BROKEN;
+        response.CopyFrom(*primed);
+        return Status::OK;
+    }
+
+    void
+    send(OpCode opCode, const google::protobuf::Message& request)
+    {
+        mock.logRequest(opCode, request);
+    }
+
+  private:
+    LeaderRPCMock& mock;
+    const OpCode opCode;
+};
+
+
 LeaderRPCMock::LeaderRPCMock()
-    : requestLog()
+    : lastGroupId(0)
+    , requestLog()
     , responseQueue()
 {
 }
@@ -41,6 +78,18 @@ LeaderRPCMock::expect(OpCode opCode,
     responseQueue.push({opCode, std::move(responseCopy)});
 }
 
+void
+LeaderRPCMock::expectBrokenStream(OpCode opCode)
+{
+    responseQueue.push({opCode, MessagePtr()});
+}
+
+void
+LeaderRPCMock::expectNoAnswer(OpCode opCode)
+{
+    responseQueue.push({opCode, MessagePtr()});
+}
+
 LeaderRPCMock::MessagePtr
 LeaderRPCMock::popRequest()
 {
@@ -52,11 +101,11 @@ LeaderRPCMock::popRequest()
 void
 LeaderRPCMock::call(OpCode opCode,
           const google::protobuf::Message& request,
-          google::protobuf::Message& response)
+          google::protobuf::Message& response,
+          uint32_t groupId)
 {
-    MessagePtr requestCopy(request.New());
-    requestCopy->CopyFrom(request);
-    requestLog.push_back({opCode, std::move(requestCopy)});
+    lastGroupId = groupId;
+    logRequest(opCode, request);
     ASSERT_LT(0U, responseQueue.size())
         << "The client sent an unexpected RPC:\n"
         << request.GetTypeName() << ":\n"
@@ -67,5 +116,41 @@ LeaderRPCMock::call(OpCode opCode,
     responseQueue.pop();
 }
 
+bool
+LeaderRPCMock::callAnyServer(OpCode opCode,
+                             const google::protobuf::Message& request,
+                             google::protobuf::Message& response,
+                             uint32_t groupId)
+{
+    if (!responseQueue.empty() && !responseQueue.front().second) {
+        lastGroupId = groupId;
+        logRequest(opCode, request);
+        EXPECT_EQ(opCode, responseQueue.front().first);
+        responseQueue.pop();
+        return false;
+    }
+    call(opCode, request, response, groupId);
+    return true;
+}
+
+std::unique_ptr<LeaderRPCBase::Stream>
+LeaderRPCMock::openStream(OpCode opCode,
+                          const google::protobuf::Message& request,
+                          uint32_t groupId)
+{
+    lastGroupId = groupId;
+    logRequest(opCode, request);
+    return std::unique_ptr<Stream>(new MockStream(*this, opCode));
+}
+
+void
+LeaderRPCMock::logRequest(OpCode opCode,
+                          const google::protobuf::Message& request)
+{
+    MessagePtr requestCopy(request.New());
+    requestCopy->CopyFrom(request);
+    requestLog.push_back({opCode, std::move(requestCopy)});
+}
+
 } // namespace LogCabin::Client
 } // namespace LogCabin
@@ -44,6 +44,16 @@ class LeaderRPCMock : public LeaderRPCBase {
      */
     void expect(OpCode opCode,
                 const google::protobuf::Message& response);
+    /**
+     * Expect the stream that is waiting for a response of type opCode to
+     * break rather than receive one.
+     */
+    void expectBrokenStream(OpCode opCode);
+    /**
+     * Expect the next request operation to have type opCode and to be sent
+     * with callAnyServer(), which will find no server able to answer it.
+     */
+    void expectNoAnswer(OpCode opCode);
     /**
      * Pop the first request from the queue.
      */
@@ -56,8 +66,46 @@ class LeaderRPCMock : public LeaderRPCBase {
      */
     void call(OpCode opCode,
               const google::protobuf::Message& request,
-              google::protobuf::Message& response);
+              google::protobuf::Message& response,
+              uint32_t groupId);
+
+    /**
+     * Same as call(), returning true, unless expectNoAnswer() was called:
+     * the mock doesn't otherwise distinguish the leader from other servers.
+     */
+    bool callAnyServer(OpCode opCode,
+                       const google::protobuf::Message& request,
+                       google::protobuf::Message& response,
+                       uint32_t groupId);
+
+    /**
+     * Mocks out a streaming RPC. The request is logged like call()'s. The
+     * stream's waitForReply() takes the next primed response if it has the
+     * stream's opCode and times out otherwise. Requests sent with the
+     * stream's send() are logged but take no response.
+     */
+    std::unique_ptr<Stream>
+    openStream(OpCode opCode,
+               const google::protobuf::Message& request,
+               uint32_t groupId);
+
+    /**
+     * The Raft group that the most recent call(), callAnyServer(), or
+     * openStream() was for.
+     */
+    uint32_t lastGroupId;
+
   private:
+    /**
+     * The mock Stream returned by openStream().
+     */
+    class MockStream;
+
+    /**
+     * Add a copy of the request to #requestLog.
+     */
+    void logRequest(OpCode opCode, const google::protobuf::Message& request);
+
     /**
      * A queue of requests that have come in from call().
      */
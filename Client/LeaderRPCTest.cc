@@ -74,7 +74,7 @@ class ClientLeaderRPCTest : public ::testing::Test {
 
 TEST_F(ClientLeaderRPCTest, callOK) {
     service->reply(OpCode::OPEN_LOG, request, expResponse);
-    leaderRPC->call(OpCode::OPEN_LOG, request, response);
+    leaderRPC->call(OpCode::OPEN_LOG, request, response, 0);
     EXPECT_EQ(expResponse, response);
 }
 
@@ -84,7 +84,7 @@ TEST_F(ClientLeaderRPCTest, callOK) {
 TEST_F(ClientLeaderRPCTest, callRPCFailed) {
     service->closeSession(OpCode::OPEN_LOG, request);
     service->reply(OpCode::OPEN_LOG, request, expResponse);
-    leaderRPC->call(OpCode::OPEN_LOG, request, response);
+    leaderRPC->call(OpCode::OPEN_LOG, request, response, 0);
     EXPECT_EQ(expResponse, response);
 }
 
@@ -102,21 +102,47 @@ TEST_F(ClientLeaderRPCTest, handleServiceSpecificErrorNotLeader) {
     // ok, fine, let it through
     service->reply(OpCode::OPEN_LOG, request, expResponse);
 
-    leaderRPC->call(OpCode::OPEN_LOG, request, response);
+    leaderRPC->call(OpCode::OPEN_LOG, request, response, 0);
     EXPECT_EQ(expResponse, response);
 }
 
+TEST_F(ClientLeaderRPCTest, callAnyServerOK) {
+    service->reply(OpCode::OPEN_LOG, request, expResponse);
+    EXPECT_TRUE(leaderRPC->callAnyServer(OpCode::OPEN_LOG, request,
+                                         response, 0));
+    EXPECT_EQ(expResponse, response);
+    EXPECT_TRUE(leaderRPC->readSession != NULL);
+}
+
+TEST_F(ClientLeaderRPCTest, callAnyServerFailed) {
+    Protocol::Client::Error error;
+    error.set_error_code(Protocol::Client::Error::NOT_LEADER);
+    service->serviceSpecificError(OpCode::OPEN_LOG, request, error);
+    EXPECT_FALSE(leaderRPC->callAnyServer(OpCode::OPEN_LOG, request,
+                                          response, 0));
+    EXPECT_TRUE(leaderRPC->readSession == NULL);
+}
+
 // connect() tested adequately in tests for call()
 
 TEST_F(ClientLeaderRPCTest, connectRandom) {
     // TODO(ongaro): This is hard to test without control of name resolution.
 }
 
+TEST_F(ClientLeaderRPCTest, getLeaderSession) {
+    std::shared_ptr<RPC::ClientSession> session0 =
+        leaderRPC->getLeaderSession(0);
+    EXPECT_EQ(session0, leaderRPC->getLeaderSession(3));
+    leaderRPC->connectHost(3, "127.0.0.2:0", session0);
+    EXPECT_NE(session0, leaderRPC->getLeaderSession(3));
+    EXPECT_EQ(session0, leaderRPC->getLeaderSession(0));
+}
+
 TEST_F(ClientLeaderRPCTest, connectHost) {
-    leaderRPC->connectHost("127.0.0.2:0", leaderRPC->leaderSession);
+    leaderRPC->connectHost(0, "127.0.0.2:0", leaderRPC->leaderSessions.at(0));
     EXPECT_EQ("Closed session: Failed to connect socket to 127.0.0.2:0 "
               "(resolved to 127.0.0.2:0)",
-              leaderRPC->leaderSession->toString());
+              leaderRPC->leaderSessions.at(0)->toString());
 }
 
 } // namespace LogCabin::Client::<anonymous>
@@ -19,8 +19,63 @@
 namespace LogCabin {
 namespace Client {
 
+class MockClientImpl::MockSubscription : public SubscriptionImplBase {
+  public:
+    MockSubscription(std::shared_ptr<ClientImplBase> client,
+                     uint64_t logId,
+                     EntryId from)
+        : client(client)
+        , logId(logId)
+        , nextEntryId(from)
+    {
+    }
+
+    std::vector<Entry>
+    next(uint64_t timeoutMs)
+    {
+        std::vector<Entry> entries =
+            client->watch(logId, nextEntryId, timeoutMs);
+        if (!entries.empty())
+            nextEntryId = entries.back().getId() + 1;
+        return entries;
+    }
+
+  private:
+    std::shared_ptr<ClientImplBase> client;
+    const uint64_t logId;
+    EntryId nextEntryId;
+};
+
+class MockClientImpl::MockReadResult : public ReadResultImplBase {
+  public:
+    MockReadResult()
+        : entries()
+    {
+    }
+
+    size_t
+    size() const
+    {
+        return entries.size();
+    }
+
+    EntryView
+    get(size_t index) const
+    {
+        const Entry& entry = entries.at(index);
+        return makeView(entry.id,
+                        entry.invalidates.data(),
+                        uint32_t(entry.invalidates.size()),
+                        entry.data.get(),
+                        entry.length);
+    }
+
+    std::vector<Entry> entries;
+};
+
 MockClientImpl::MockClientImpl()
     : mutex()
+    , logChanged()
     , nextLogId(0)
     , logNames()
     , logs()
@@ -58,6 +113,7 @@ MockClientImpl::deleteLog(const std::string& logName)
     uint64_t logId = it->second;
     logNames.erase(it);
     logs.erase(logId);
+    logChanged.notify_all();
 }
 
 std::vector<std::string>
@@ -77,22 +133,37 @@ MockClientImpl::append(uint64_t logId, const Entry& entry, EntryId expectedId)
         return NO_ID;
     log.emplace_back(entry.data.get(), entry.length, entry.invalidates);
     log.back().id = newId;
+    logChanged.notify_all();
     return newId;
 }
 
-std::vector<Entry>
+std::unique_ptr<ReadResultImplBase>
 MockClientImpl::read(uint64_t logId, EntryId from)
 {
     std::unique_lock<std::mutex> lockGuard(mutex);
-    std::vector<Entry>& log = getLog(logId);
-    std::vector<Entry> ret;
-    for (auto it = log.begin(); it != log.end(); ++it) {
-        if (it->id < from)
-            continue;
-        ret.emplace_back(it->data.get(), it->length, it->invalidates);
-        ret.back().id = it->id;
+    std::unique_ptr<MockReadResult> result(new MockReadResult());
+    result->entries = copyEntries(logId, from);
+    return std::unique_ptr<ReadResultImplBase>(result.release());
+}
+
+std::vector<Entry>
+MockClientImpl::watch(uint64_t logId, EntryId from, uint64_t timeoutMs)
+{
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    auto deadline = (std::chrono::steady_clock::now() +
+                     std::chrono::milliseconds(timeoutMs));
+    while (getLog(logId).size() <= from &&
+           std::chrono::steady_clock::now() < deadline) {
+        logChanged.wait_until(lockGuard, deadline);
     }
-    return ret;
+    return copyEntries(logId, from);
+}
+
+std::unique_ptr<SubscriptionImplBase>
+MockClientImpl::subscribe(uint64_t logId, EntryId from)
+{
+    return std::unique_ptr<SubscriptionImplBase>(
+        new MockSubscription(self.lock(), logId, from));
 }
 
 EntryId
@@ -106,14 +177,16 @@ MockClientImpl::getLastId(uint64_t logId)
 }
 
 std::pair<uint64_t, Configuration>
-MockClientImpl::getConfiguration()
+MockClientImpl::getConfiguration(Configuration& learners)
 {
+    learners.clear();
     return {0, {}};
 }
 
 ConfigurationResult
 MockClientImpl::setConfiguration(uint64_t oldId,
-                                 const Configuration& newConfiguration)
+                                 const Configuration& newConfiguration,
+                                 const Configuration* newLearners)
 {
     ConfigurationResult result;
     result.status = ConfigurationResult::BAD;
@@ -121,6 +194,35 @@ MockClientImpl::setConfiguration(uint64_t oldId,
     return result;
 }
 
+LeadershipTransferResult
+MockClientImpl::transferLeadership(uint64_t serverId)
+{
+    LeadershipTransferResult result;
+    result.status = LeadershipTransferResult::FAILED;
+    result.reason = "There are no other voting servers";
+    return result;
+}
+
+void
+MockClientImpl::setFollowerReads(bool enabled, uint64_t maxStalenessMs)
+{
+    // There's only one copy of the data, so every read is up to date.
+}
+
+std::vector<Entry>
+MockClientImpl::copyEntries(uint64_t logId, EntryId from)
+{
+    std::vector<Entry>& log = getLog(logId);
+    std::vector<Entry> ret;
+    for (auto it = log.begin(); it != log.end(); ++it) {
+        if (it->id < from)
+            continue;
+        ret.emplace_back(it->data.get(), it->length, it->invalidates);
+        ret.back().id = it->id;
+    }
+    return ret;
+}
+
 std::vector<Entry>&
 MockClientImpl::getLog(uint64_t logId)
 {
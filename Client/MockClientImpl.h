@@ -13,6 +13,7 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <condition_variable>
 #include <mutex>
 #include <map>
 #include <unordered_map>
@@ -42,14 +43,33 @@ class MockClientImpl : public ClientImplBase {
     void deleteLog(const std::string& logName);
     std::vector<std::string> listLogs();
     EntryId append(uint64_t logId, const Entry& entry, EntryId expectedId);
-    std::vector<Entry> read(uint64_t logId, EntryId from);
+    std::unique_ptr<ReadResultImplBase> read(uint64_t logId, EntryId from);
+    std::vector<Entry> watch(uint64_t logId, EntryId from,
+                             uint64_t timeoutMs);
+    std::unique_ptr<SubscriptionImplBase> subscribe(uint64_t logId,
+                                                    EntryId from);
     EntryId getLastId(uint64_t logId);
-    std::pair<uint64_t, Configuration> getConfiguration();
+    std::pair<uint64_t, Configuration> getConfiguration(
+                Configuration& learners);
     ConfigurationResult setConfiguration(
                 uint64_t oldId,
-                const Configuration& newConfiguration);
+                const Configuration& newConfiguration,
+                const Configuration* newLearners);
+    LeadershipTransferResult transferLeadership(uint64_t serverId);
+    void setFollowerReads(bool enabled, uint64_t maxStalenessMs);
 
   private:
+    /**
+     * The implementation of SubscriptionImplBase returned by subscribe(),
+     * which is built on watch().
+     */
+    class MockSubscription;
+
+    /**
+     * The implementation of ReadResultImplBase returned by read(), which
+     * holds copies of the entries.
+     */
+    class MockReadResult;
 
     /**
      * Look up a log by ID or throw LogDisappearedException.
@@ -57,7 +77,17 @@ class MockClientImpl : public ClientImplBase {
      */
     std::vector<Entry>& getLog(uint64_t logId);
 
+    /**
+     * Return copies of a log's entries starting at 'from', or throw
+     * LogDisappearedException. Must be called holding #mutex.
+     */
+    std::vector<Entry> copyEntries(uint64_t logId, EntryId from);
+
     std::mutex mutex;
+    /**
+     * Notified whenever a log grows or is deleted, for watch().
+     */
+    std::condition_variable logChanged;
     uint64_t nextLogId;
     std::map<std::string, uint64_t> logNames;
     // This shared_ptr just exists to make std::vector<Entry> copyable.
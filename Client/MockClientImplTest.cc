@@ -16,6 +16,7 @@
 #include <gtest/gtest.h>
 #include <deque>
 #include <queue>
+#include <thread>
 
 #include "Core/Debug.h"
 #include "Core/StringUtil.h"
@@ -28,7 +29,8 @@
 namespace LogCabin {
 namespace {
 
-std::string entryDataString(const Client::Entry& entry)
+template<typename EntryType>
+std::string entryDataString(const EntryType& entry)
 {
     return std::string(static_cast<const char*>(entry.getData()),
                        entry.getLength());
@@ -89,8 +91,8 @@ TEST_F(ClientMockClientImplLogTest, append_normal)
     std::vector<Client::EntryId> invalidates = {10, 20, 30};
     Client::Entry entry("hello", 5, invalidates);
     EXPECT_EQ(0U, log->append(entry));
-    std::vector<Client::Entry> entries = log->read(0);
-    Client::Entry& readEntry = entries.at(0);
+    Client::ReadResult entries = log->read(0);
+    Client::EntryView readEntry = entries.at(0);
     EXPECT_EQ(0U, readEntry.getId());
     EXPECT_EQ(invalidates, readEntry.getInvalidates());
     EXPECT_EQ("hello", entryDataString(readEntry));
@@ -123,7 +125,7 @@ TEST_F(ClientMockClientImplLogTest, read_normal)
     EXPECT_EQ(0U, log->read(2).size());
     EXPECT_EQ(0U, log->read(2000).size());
 
-    std::vector<Client::Entry> entries = log->read(1);
+    Client::ReadResult entries = log->read(1);
     EXPECT_EQ("goodbye", entryDataString(entries.at(0)));
 }
 
@@ -134,6 +136,49 @@ TEST_F(ClientMockClientImplLogTest, read_logDisappeared)
                  Client::LogDisappearedException);
 }
 
+TEST_F(ClientMockClientImplLogTest, watch_normal)
+{
+    log->append(Client::Entry("hello", 5));
+    EXPECT_EQ(1U, log->watch(0, 0).size());
+    std::thread appender([this] () {
+        log->append(Client::Entry("goodbye", 7));
+    });
+    std::vector<Client::Entry> entries = log->watch(1, 10000);
+    appender.join();
+    ASSERT_EQ(1U, entries.size());
+    EXPECT_EQ("goodbye", entryDataString(entries.at(0)));
+}
+
+TEST_F(ClientMockClientImplLogTest, watch_timeout)
+{
+    EXPECT_EQ(0U, log->watch(0, 1).size());
+}
+
+TEST_F(ClientMockClientImplLogTest, watch_logDisappeared)
+{
+    cluster->deleteLog("testLog");
+    EXPECT_THROW(log->watch(0, 1000),
+                 Client::LogDisappearedException);
+}
+
+TEST_F(ClientMockClientImplLogTest, subscribe)
+{
+    log->append(Client::Entry("hello", 5));
+    Client::Subscription subscription = log->subscribe(0);
+    EXPECT_EQ(1U, subscription.next(0).size());
+    EXPECT_EQ(0U, subscription.next(1).size());
+    std::thread appender([this] () {
+        log->append(Client::Entry("goodbye", 7));
+    });
+    std::vector<Client::Entry> entries = subscription.next(10000);
+    appender.join();
+    ASSERT_EQ(1U, entries.size());
+    EXPECT_EQ("goodbye", entryDataString(entries.at(0)));
+    cluster->deleteLog("testLog");
+    EXPECT_THROW(subscription.next(1000),
+                 Client::LogDisappearedException);
+}
+
 TEST_F(ClientMockClientImplLogTest, getLastId_normal)
 {
     EXPECT_EQ(Client::NO_ID, log->getLastId());
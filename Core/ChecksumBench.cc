@@ -0,0 +1,72 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string>
+
+#include "bench/Bench.h"
+#include "Core/Checksum.h"
+
+namespace LogCabin {
+namespace Core {
+namespace Checksum {
+namespace {
+
+/**
+ * Checksum a buffer of the given size with the given algorithm.
+ */
+void
+checksum(Bench::State& state, const char* algorithm, uint32_t size)
+{
+    std::string data(size, 'C');
+    char output[MAX_LENGTH];
+    state.setBytesPerIteration(size);
+    for (uint64_t i = 0; i < state.iterations; ++i) {
+        calculate(algorithm, data.data(), size, output);
+        Bench::doNotOptimize(output);
+    }
+}
+
+BENCHMARK(CoreChecksum, crc32_64B) {
+    checksum(state, "CRC32", 64);
+}
+
+BENCHMARK(CoreChecksum, crc32_4KB) {
+    checksum(state, "CRC32", 4096);
+}
+
+BENCHMARK(CoreChecksum, adler32_4KB) {
+    checksum(state, "Adler32", 4096);
+}
+
+BENCHMARK(CoreChecksum, md5_4KB) {
+    checksum(state, "MD5", 4096);
+}
+
+BENCHMARK(CoreChecksum, sha1_64B) {
+    checksum(state, "SHA-1", 64);
+}
+
+BENCHMARK(CoreChecksum, sha1_4KB) {
+    checksum(state, "SHA-1", 4096);
+}
+
+BENCHMARK(CoreChecksum, sha256_4KB) {
+    checksum(state, "SHA-256", 4096);
+}
+
+} // namespace LogCabin::Core::Checksum::<anonymous>
+} // namespace LogCabin::Core::Checksum
+} // namespace LogCabin::Core
+} // namespace LogCabin
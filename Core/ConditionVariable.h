@@ -18,9 +18,12 @@
 #else
 #include <cstdatomic>
 #endif
+#include <cassert>
 #include <condition_variable>
 #include <functional>
 
+#include "Core/Mutex.h"
+
 /**
  * A wrapper around std::condition_variable that is useful for testing
  * purposes. You can set a callback to be called when the condition variable is
@@ -78,6 +81,8 @@ class ConditionVariable {
         Core::Mutex& mutex(*lockGuard.mutex());
         if (mutex.callback)
             mutex.callback();
+        if (mutex.profiled)
+            mutex.suspendHold();
         assert(lockGuard);
         std::unique_lock<std::mutex> stdLockGuard(mutex.m,
                                                   std::adopt_lock_t());
@@ -86,6 +91,8 @@ class ConditionVariable {
         assert(stdLockGuard);
         lockGuard = std::unique_lock<Core::Mutex>(mutex, std::adopt_lock_t());
         stdLockGuard.release();
+        if (mutex.suspended)
+            mutex.resumeHold();
     }
 
 
@@ -118,6 +125,8 @@ class ConditionVariable {
         Core::Mutex& mutex(*lockGuard.mutex());
         if (mutex.callback)
             mutex.callback();
+        if (mutex.profiled)
+            mutex.suspendHold();
         assert(lockGuard);
         std::unique_lock<std::mutex> stdLockGuard(mutex.m,
                                                   std::adopt_lock_t());
@@ -126,6 +135,8 @@ class ConditionVariable {
         assert(stdLockGuard);
         lockGuard = std::unique_lock<Core::Mutex>(mutex, std::adopt_lock_t());
         stdLockGuard.release();
+        if (mutex.suspended)
+            mutex.resumeHold();
     }
 
   private:
@@ -0,0 +1,253 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cxxabi.h>
+#include <execinfo.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+
+#include "Core/LockProfiler.h"
+
+namespace LogCabin {
+namespace Core {
+namespace LockProfiler {
+
+namespace Internal {
+
+std::atomic<bool> enabled(false);
+
+/**
+ * Protects #profiles.
+ */
+std::mutex mutex;
+
+/**
+ * Every profile created by getProfile(), keyed by name. These are leaked on
+ * purpose, since mutexes in static objects may outlive this map.
+ */
+std::map<std::string, Profile*>* profiles = NULL;
+
+/**
+ * Frames whose function names contain any of these are part of the locking
+ * code and are left out of Holder::frames.
+ */
+const char* lockingFrames[] = {
+    "LogCabin::Core::ConditionVariable::",
+    "LogCabin::Core::LockProfiler::",
+    "LogCabin::Core::Mutex::",
+    "std::lock_guard<",
+    "std::unique_lock<",
+};
+
+std::string
+describeFrame(const char* symbol, bool& isLocking)
+{
+    isLocking = false;
+    const char* open = strchr(symbol, '(');
+    const char* plus = (open == NULL) ? NULL : strchr(open, '+');
+    const char* close = (plus == NULL) ? NULL : strchr(plus, ')');
+    if (open == NULL || plus == NULL || close == NULL || plus == open + 1)
+        return symbol;
+    std::string mangled(open + 1, plus);
+    std::string offset(plus, close);
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(mangled.c_str(), NULL, NULL,
+                                          &status);
+    std::string name = (status == 0 && demangled != NULL) ? demangled
+                                                          : mangled;
+    free(demangled);
+    for (size_t i = 0; i < sizeof(lockingFrames) / sizeof(lockingFrames[0]);
+         ++i) {
+        if (name.find(lockingFrames[i]) != std::string::npos)
+            isLocking = true;
+    }
+    return name + offset;
+}
+
+} // namespace LogCabin::Core::LockProfiler::Internal
+
+void
+setEnabled(bool enabled)
+{
+    Internal::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+////////// CallSite //////////
+
+CallSite::CallSite()
+    : numFrames(0)
+    , frames()
+{
+}
+
+bool
+CallSite::operator==(const CallSite& other) const
+{
+    return (numFrames == other.numFrames &&
+            std::equal(frames, frames + numFrames, other.frames));
+}
+
+void
+captureCallSite(CallSite& site)
+{
+    // Skip this function and the Mutex member function that called it.
+    enum { SKIP = 2 };
+    void* frames[CallSite::MAX_FRAMES + SKIP];
+    int numFrames = backtrace(frames, CallSite::MAX_FRAMES + SKIP);
+    if (numFrames <= SKIP) {
+        site.numFrames = 0;
+        return;
+    }
+    site.numFrames = uint32_t(numFrames - SKIP);
+    std::copy(frames + SKIP, frames + numFrames, site.frames);
+}
+
+////////// Holder //////////
+
+Holder::Holder()
+    : frames()
+    , count(0)
+    , totalNanos(0)
+    , maxNanos(0)
+{
+}
+
+////////// Profile //////////
+
+Profile::Profile(const std::string& name)
+    : name(name)
+    , waitNanos()
+    , holdNanos()
+    , contended()
+    , mutex()
+    , sites()
+{
+}
+
+void
+Profile::recordHold(const CallSite& site, uint64_t nanos)
+{
+    holdNanos.record(nanos);
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    auto it = sites.find(site);
+    if (it == sites.end()) {
+        if (sites.size() < MAX_SITES)
+            it = sites.insert({site, SiteStats()}).first;
+        else
+            it = sites.insert({CallSite(), SiteStats()}).first;
+    }
+    SiteStats& stats = it->second;
+    ++stats.count;
+    stats.totalNanos += nanos;
+    stats.maxNanos = std::max(stats.maxNanos, nanos);
+}
+
+std::vector<Holder>
+Profile::getTopHolders(uint32_t maxHolders) const
+{
+    std::vector<std::pair<CallSite, SiteStats>> top;
+    {
+        std::unique_lock<std::mutex> lockGuard(mutex);
+        top.assign(sites.begin(), sites.end());
+    }
+    std::sort(top.begin(), top.end(),
+              [] (const std::pair<CallSite, SiteStats>& a,
+                  const std::pair<CallSite, SiteStats>& b) {
+                  return a.second.totalNanos > b.second.totalNanos;
+              });
+    if (top.size() > maxHolders)
+        top.resize(maxHolders);
+
+    // Only resolve the names of the call sites being returned, since
+    // backtrace_symbols() is slow.
+    std::vector<Holder> holders;
+    for (auto it = top.begin(); it != top.end(); ++it) {
+        const CallSite& site = it->first;
+        Holder holder;
+        holder.count = it->second.count;
+        holder.totalNanos = it->second.totalNanos;
+        holder.maxNanos = it->second.maxNanos;
+        if (site.numFrames > 0) {
+            char** symbols = backtrace_symbols(site.frames,
+                                               int(site.numFrames));
+            // Show the first few frames outside of the locking code.
+            for (uint32_t i = 0;
+                 symbols != NULL && i < site.numFrames &&
+                 holder.frames.size() < 3;
+                 ++i) {
+                bool isLocking;
+                std::string frame = Internal::describeFrame(symbols[i],
+                                                            isLocking);
+                if (!isLocking)
+                    holder.frames.push_back(frame);
+            }
+            free(symbols);
+        }
+        holders.push_back(holder);
+    }
+    return holders;
+}
+
+size_t
+Profile::CallSiteHash::operator()(const CallSite& site) const
+{
+    size_t hash = site.numFrames;
+    for (uint32_t i = 0; i < site.numFrames; ++i)
+        hash = hash * 31 + std::hash<void*>()(site.frames[i]);
+    return hash;
+}
+
+Profile::SiteStats::SiteStats()
+    : count(0)
+    , totalNanos(0)
+    , maxNanos(0)
+{
+}
+
+////////// registry //////////
+
+Profile*
+getProfile(const std::string& name)
+{
+    std::unique_lock<std::mutex> lockGuard(Internal::mutex);
+    if (Internal::profiles == NULL)
+        Internal::profiles = new std::map<std::string, Profile*>();
+    Profile*& profile = (*Internal::profiles)[name];
+    if (profile == NULL)
+        profile = new Profile(name);
+    return profile;
+}
+
+std::vector<const Profile*>
+getProfiles()
+{
+    std::unique_lock<std::mutex> lockGuard(Internal::mutex);
+    std::vector<const Profile*> ret;
+    if (Internal::profiles != NULL) {
+        for (auto it = Internal::profiles->begin();
+             it != Internal::profiles->end();
+             ++it) {
+            ret.push_back(it->second);
+        }
+    }
+    return ret;
+}
+
+} // namespace LogCabin::Core::LockProfiler
+} // namespace LogCabin::Core
+} // namespace LogCabin
@@ -0,0 +1,219 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * An opt-in profiler for contention on Core::Mutex objects.
+ *
+ * Mutexes that are given a name when they are constructed share a Profile
+ * with every other mutex of the same name. While profiling is enabled, each
+ * acquisition of a named mutex records how long the caller waited for it, how
+ * long it was then held, and the call stack that acquired it, so that the
+ * code paths holding a mutex for the longest can be found.
+ *
+ * While profiling is disabled (the default), locking a named mutex costs one
+ * relaxed atomic load more than locking an unnamed one.
+ */
+
+#if __GNUC__ >= 4 && __GNUC_MINOR__ >= 5
+#include <atomic>
+#else
+#include <cstdatomic>
+#endif
+#include <cinttypes>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Core/Stats.h"
+
+#ifndef LOGCABIN_CORE_LOCKPROFILER_H
+#define LOGCABIN_CORE_LOCKPROFILER_H
+
+namespace LogCabin {
+namespace Core {
+namespace LockProfiler {
+
+namespace Internal {
+/// See isEnabled().
+extern std::atomic<bool> enabled;
+
+/**
+ * Return a readable name for a return address, given its entry from
+ * backtrace_symbols(): the demangled function name and offset if the symbol
+ * is exported, or else the entry itself.
+ * \param symbol
+ *      An entry such as "binary(mangledName+0x1f) [0x4012ab]".
+ * \param[out] isLocking
+ *      Set to true if the function is part of the locking code.
+ */
+std::string describeFrame(const char* symbol, bool& isLocking);
+} // namespace LogCabin::Core::LockProfiler::Internal
+
+/**
+ * Return whether acquisitions of named mutexes are currently being profiled.
+ */
+inline bool
+isEnabled()
+{
+    return Internal::enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * Turn profiling on or off. Mutexes that are held when profiling is turned on
+ * are not counted until they are next acquired.
+ */
+void setEnabled(bool enabled);
+
+/**
+ * The return addresses of the stack that acquired a mutex.
+ */
+struct CallSite {
+    /// The number of frames kept.
+    enum { MAX_FRAMES = 8 };
+    /// Constructor for an empty call site.
+    CallSite();
+    bool operator==(const CallSite& other) const;
+    /// The number of valid entries in #frames.
+    uint32_t numFrames;
+    /// Return addresses, innermost first.
+    void* frames[MAX_FRAMES];
+};
+
+/**
+ * Fill in 'site' with the stack of the caller's caller. This is meant to be
+ * called from the out-of-line parts of Core::Mutex.
+ */
+void captureCallSite(CallSite& site);
+
+/**
+ * The hold time attributed to one call site, as returned by
+ * Profile::getTopHolders().
+ */
+struct Holder {
+    Holder();
+    /**
+     * The innermost frames of the call site that aren't part of the locking
+     * code itself, as function names where they can be found.
+     */
+    std::vector<std::string> frames;
+    /// The number of times the call site acquired the mutex.
+    uint64_t count;
+    /// The total time the call site held the mutex, in nanoseconds.
+    uint64_t totalNanos;
+    /// The longest time the call site held the mutex, in nanoseconds.
+    uint64_t maxNanos;
+};
+
+/**
+ * The statistics for all mutexes sharing one name.
+ */
+class Profile {
+  public:
+    /**
+     * Constructor. Use getProfile() instead.
+     */
+    explicit Profile(const std::string& name);
+
+    /**
+     * Attribute the time a mutex was held to the call site that acquired it.
+     */
+    void recordHold(const CallSite& site, uint64_t nanos);
+
+    /**
+     * Return the call sites that held the mutex for the longest total time,
+     * longest first.
+     * \param maxHolders
+     *      Return at most this many call sites.
+     */
+    std::vector<Holder> getTopHolders(uint32_t maxHolders) const;
+
+    /**
+     * The name given to the mutexes.
+     */
+    const std::string name;
+
+    /**
+     * The time each acquisition spent waiting for the mutex, in nanoseconds.
+     * Its count is the number of profiled acquisitions.
+     */
+    Stats::Histogram waitNanos;
+
+    /**
+     * The time each acquisition held the mutex, in nanoseconds.
+     */
+    Stats::Histogram holdNanos;
+
+    /**
+     * The number of acquisitions that found the mutex already held.
+     */
+    Stats::Counter contended;
+
+  private:
+    /**
+     * Hashes a CallSite for #sites.
+     */
+    struct CallSiteHash {
+        size_t operator()(const CallSite& site) const;
+    };
+
+    /**
+     * The hold time attributed to one call site.
+     */
+    struct SiteStats {
+        SiteStats();
+        uint64_t count;
+        uint64_t totalNanos;
+        uint64_t maxNanos;
+    };
+
+    /**
+     * Once this many call sites are being tracked, the hold time of any new
+     * ones is attributed to the empty call site instead.
+     */
+    enum { MAX_SITES = 1024 };
+
+    /**
+     * Protects #sites.
+     */
+    mutable std::mutex mutex;
+
+    /**
+     * The hold time of each call site.
+     */
+    std::unordered_map<CallSite, SiteStats, CallSiteHash> sites;
+
+    // Profile is non-copyable.
+    Profile(const Profile&) = delete;
+    Profile& operator=(const Profile&) = delete;
+}; // class Profile
+
+/**
+ * Return the Profile for mutexes with the given name, creating it if needed.
+ * Profiles are never destroyed.
+ */
+Profile* getProfile(const std::string& name);
+
+/**
+ * Return every Profile created so far, sorted by name.
+ */
+std::vector<const Profile*> getProfiles();
+
+} // namespace LogCabin::Core::LockProfiler
+} // namespace LogCabin::Core
+} // namespace LogCabin
+
+#endif /* LOGCABIN_CORE_LOCKPROFILER_H */
@@ -0,0 +1,166 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <thread>
+#include <unistd.h>
+
+#include "Core/ConditionVariable.h"
+#include "Core/LockProfiler.h"
+#include "Core/Mutex.h"
+
+namespace LogCabin {
+namespace Core {
+namespace LockProfiler {
+namespace {
+
+class CoreLockProfilerTest : public ::testing::Test {
+  public:
+    CoreLockProfilerTest()
+    {
+        setEnabled(true);
+    }
+    ~CoreLockProfilerTest()
+    {
+        setEnabled(false);
+    }
+};
+
+TEST_F(CoreLockProfilerTest, getProfile) {
+    Profile* profile = getProfile("CoreLockProfilerTest.getProfile");
+    EXPECT_EQ("CoreLockProfilerTest.getProfile", profile->name);
+    EXPECT_EQ(profile, getProfile("CoreLockProfilerTest.getProfile"));
+    std::vector<const Profile*> profiles = getProfiles();
+    EXPECT_NE(profiles.end(),
+              std::find(profiles.begin(), profiles.end(), profile));
+}
+
+TEST_F(CoreLockProfilerTest, disabled) {
+    setEnabled(false);
+    Mutex mutex("CoreLockProfilerTest.disabled");
+    mutex.lock();
+    EXPECT_FALSE(mutex.profiled);
+    mutex.unlock();
+    EXPECT_TRUE(mutex.try_lock());
+    mutex.unlock();
+    Profile* profile = getProfile("CoreLockProfilerTest.disabled");
+    EXPECT_EQ(0U, profile->waitNanos.getSnapshot().count);
+    EXPECT_EQ(0U, profile->holdNanos.getSnapshot().count);
+}
+
+TEST_F(CoreLockProfilerTest, unnamed) {
+    Mutex mutex;
+    mutex.lock();
+    EXPECT_FALSE(mutex.profiled);
+    mutex.unlock();
+}
+
+TEST_F(CoreLockProfilerTest, lockUnlock) {
+    Mutex mutex("CoreLockProfilerTest.lockUnlock");
+    for (uint32_t i = 0; i < 3; ++i) {
+        std::unique_lock<Mutex> lockGuard(mutex);
+        EXPECT_TRUE(mutex.profiled);
+        usleep(1000);
+    }
+    Profile* profile = getProfile("CoreLockProfilerTest.lockUnlock");
+    EXPECT_EQ(3U, profile->waitNanos.getSnapshot().count);
+    EXPECT_EQ(0U, profile->contended.get());
+    Stats::Histogram::Snapshot hold = profile->holdNanos.getSnapshot();
+    EXPECT_EQ(3U, hold.count);
+    EXPECT_LE(3000000U, hold.sum);
+    // All three acquisitions came from the same place.
+    std::vector<Holder> holders = profile->getTopHolders(5);
+    ASSERT_EQ(1U, holders.size());
+    EXPECT_EQ(3U, holders.at(0).count);
+    EXPECT_EQ(hold.sum, holders.at(0).totalNanos);
+    EXPECT_FALSE(holders.at(0).frames.empty());
+}
+
+TEST_F(CoreLockProfilerTest, tryLock) {
+    Mutex mutex("CoreLockProfilerTest.tryLock");
+    EXPECT_TRUE(mutex.try_lock());
+    EXPECT_TRUE(mutex.profiled);
+    mutex.unlock();
+    Profile* profile = getProfile("CoreLockProfilerTest.tryLock");
+    EXPECT_EQ(1U, profile->waitNanos.getSnapshot().count);
+    EXPECT_EQ(1U, profile->holdNanos.getSnapshot().count);
+}
+
+TEST_F(CoreLockProfilerTest, contended) {
+    Mutex mutex("CoreLockProfilerTest.contended");
+    std::unique_lock<Mutex> lockGuard(mutex);
+    std::thread thread([&mutex] () {
+        std::unique_lock<Mutex> lockGuard(mutex);
+    });
+    usleep(10000);
+    lockGuard.unlock();
+    thread.join();
+    Profile* profile = getProfile("CoreLockProfilerTest.contended");
+    EXPECT_EQ(1U, profile->contended.get());
+    Stats::Histogram::Snapshot wait = profile->waitNanos.getSnapshot();
+    EXPECT_EQ(2U, wait.count);
+    EXPECT_LE(5000000U, wait.max);
+    // The two acquisitions came from different places.
+    EXPECT_EQ(2U, profile->getTopHolders(5).size());
+    EXPECT_EQ(1U, profile->getTopHolders(1).size());
+}
+
+TEST_F(CoreLockProfilerTest, conditionVariable) {
+    Mutex mutex("CoreLockProfilerTest.conditionVariable");
+    ConditionVariable cv;
+    cv.callback = [] () {
+        usleep(10000);
+    };
+    {
+        std::unique_lock<Mutex> lockGuard(mutex);
+        cv.wait(lockGuard);
+        EXPECT_TRUE(mutex.profiled);
+        EXPECT_FALSE(mutex.suspended);
+    }
+    Profile* profile = getProfile("CoreLockProfilerTest.conditionVariable");
+    EXPECT_EQ(1U, profile->waitNanos.getSnapshot().count);
+    // The wait splits the acquisition into two holds, neither of which
+    // includes the time spent waiting.
+    Stats::Histogram::Snapshot hold = profile->holdNanos.getSnapshot();
+    EXPECT_EQ(2U, hold.count);
+    EXPECT_GT(5000000U, hold.sum);
+    std::vector<Holder> holders = profile->getTopHolders(5);
+    ASSERT_EQ(1U, holders.size());
+    EXPECT_EQ(2U, holders.at(0).count);
+}
+
+TEST_F(CoreLockProfilerTest, describeFrame) {
+    bool isLocking = false;
+    EXPECT_EQ("LogCabin::Core::Mutex::lock()+0x1f",
+              Internal::describeFrame(
+                  "prog(_ZN8LogCabin4Core5Mutex4lockEv+0x1f) [0x4012ab]",
+                  isLocking));
+    EXPECT_TRUE(isLocking);
+    EXPECT_EQ("main+0x5",
+              Internal::describeFrame("prog(main+0x5) [0x4012ab]",
+                                      isLocking));
+    EXPECT_FALSE(isLocking);
+    EXPECT_EQ("prog(+0x10) [0x4012ab]",
+              Internal::describeFrame("prog(+0x10) [0x4012ab]", isLocking));
+    EXPECT_FALSE(isLocking);
+    EXPECT_EQ("[0x4012ab]",
+              Internal::describeFrame("[0x4012ab]", isLocking));
+}
+
+} // namespace LogCabin::Core::LockProfiler::<anonymous>
+} // namespace LogCabin::Core::LockProfiler
+} // namespace LogCabin::Core
+} // namespace LogCabin
@@ -0,0 +1,80 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "Core/Mutex.h"
+
+namespace LogCabin {
+namespace Core {
+
+// The functions below are out of line so that they show up as a known
+// number of stack frames to LockProfiler::captureCallSite().
+
+void
+Mutex::lockProfiled()
+{
+    LockProfiler::CallSite callSite;
+    LockProfiler::captureCallSite(callSite);
+    if (m.try_lock()) {
+        profile->waitNanos.record(0);
+    } else {
+        Time::SteadyClock::time_point start = Time::SteadyClock::now();
+        m.lock();
+        profile->waitNanos.record(Stats::nanosSince(start));
+        profile->contended.add();
+    }
+    site = callSite;
+    profiled = true;
+    acquiredAt = Time::SteadyClock::now();
+}
+
+void
+Mutex::beginHold()
+{
+    LockProfiler::captureCallSite(site);
+    profile->waitNanos.record(0);
+    profiled = true;
+    acquiredAt = Time::SteadyClock::now();
+}
+
+void
+Mutex::unlockProfiled()
+{
+    uint64_t heldNanos = Stats::nanosSince(acquiredAt);
+    LockProfiler::CallSite callSite = site;
+    profiled = false;
+    m.unlock();
+    profile->recordHold(callSite, heldNanos);
+}
+
+void
+Mutex::suspendHold()
+{
+    profile->recordHold(site, Stats::nanosSince(acquiredAt));
+    profiled = false;
+    suspended = true;
+}
+
+void
+Mutex::resumeHold()
+{
+    suspended = false;
+    if (LockProfiler::isEnabled()) {
+        profiled = true;
+        acquiredAt = Time::SteadyClock::now();
+    }
+}
+
+} // namespace LogCabin::Core
+} // namespace LogCabin
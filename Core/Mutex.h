@@ -17,6 +17,8 @@
 #include <mutex>
 
 #include "Core/Debug.h"
+#include "Core/LockProfiler.h"
+#include "Core/Time.h"
 
 #ifndef LOGCABIN_CORE_MUTEX_H
 #define LOGCABIN_CORE_MUTEX_H
@@ -29,6 +31,9 @@ namespace Core {
  * a callback to be called when the mutex is locked and before it is unlocked.
  * This callback can, for example, check the invariants on the protected state.
  *
+ * A mutex may also be given a name, in which case Core::LockProfiler can
+ * measure how long it is waited for and held.
+ *
  * The interface to this class is the same as std::mutex.
  */
 class Mutex {
@@ -38,12 +43,37 @@ class Mutex {
     Mutex()
         : m()
         , callback()
+        , profile(NULL)
+        , profiled(false)
+        , suspended(false)
+        , acquiredAt()
+        , site()
+    {
+    }
+
+    /**
+     * Constructor for a mutex whose contention should be profiled.
+     * \param name
+     *      Identifies the mutex in Core::LockProfiler. Mutexes with the same
+     *      name are counted together.
+     */
+    explicit Mutex(const char* name)
+        : m()
+        , callback()
+        , profile(LockProfiler::getProfile(name))
+        , profiled(false)
+        , suspended(false)
+        , acquiredAt()
+        , site()
     {
     }
 
     void
     lock() {
-        m.lock();
+        if (profile != NULL && LockProfiler::isEnabled())
+            lockProfiled();
+        else
+            m.lock();
         if (callback)
             callback();
     }
@@ -52,6 +82,8 @@ class Mutex {
     try_lock() {
         bool l = m.try_lock();
         if (l) {
+            if (profile != NULL && LockProfiler::isEnabled())
+                beginHold();
             if (callback)
                 callback();
         }
@@ -64,7 +96,10 @@ class Mutex {
         // this will then call the callback without the lock, which is unsafe.
         if (callback)
             callback();
-        m.unlock();
+        if (profiled)
+            unlockProfiled();
+        else
+            m.unlock();
     }
 
     native_handle_type
@@ -82,7 +117,72 @@ class Mutex {
      */
     std::function<void()> callback;
 
+  private:
+    /**
+     * Called by lock() in place of m.lock() while profiling is enabled.
+     */
+    void lockProfiled();
+
+    /**
+     * Start measuring the hold time of an acquisition that didn't wait.
+     */
+    void beginHold();
+
+    /**
+     * Called by unlock() in place of m.unlock() if the current acquisition
+     * is being profiled.
+     */
+    void unlockProfiled();
+
+    /**
+     * Called by ConditionVariable before it releases the mutex to wait, if
+     * the current acquisition is being profiled. This ends the current hold
+     * but remembers its call site for resumeHold().
+     */
+    void suspendHold();
+
+    /**
+     * Called by ConditionVariable once it has reacquired the mutex, if
+     * suspendHold() was called. This starts a new hold for the same call
+     * site as the one suspended. The time spent reacquiring the mutex can't
+     * be told apart from the time spent waiting for the notification, so it
+     * isn't counted as wait time.
+     */
+    void resumeHold();
+
+    /**
+     * Where this mutex's statistics go, or NULL if it has no name.
+     */
+    LockProfiler::Profile* profile;
+
+    /**
+     * True if the current acquisition is being profiled. The following
+     * members are only used while this is true and are only accessed with
+     * the mutex held.
+     */
+    bool profiled;
+
+    /**
+     * True if a ConditionVariable released the mutex in the middle of a
+     * profiled hold.
+     */
+    bool suspended;
+
+    /**
+     * When the current hold started.
+     */
+    Time::SteadyClock::time_point acquiredAt;
+
+    /**
+     * The call stack that acquired the mutex.
+     */
+    LockProfiler::CallSite site;
+
     friend class ConditionVariable;
+
+    // Mutex is not copyable.
+    Mutex(const Mutex&) = delete;
+    Mutex& operator=(const Mutex&) = delete;
 };
 
 } // namespace LogCabin::Core
@@ -0,0 +1,59 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <mutex>
+
+#include "bench/Bench.h"
+#include "Core/Mutex.h"
+
+namespace LogCabin {
+namespace Core {
+namespace {
+
+template<typename M>
+void
+lockUnlock(Bench::State& state, M& mutex)
+{
+    for (uint64_t i = 0; i < state.iterations; ++i) {
+        mutex.lock();
+        mutex.unlock();
+    }
+}
+
+BENCHMARK(CoreMutex, stdMutex) {
+    std::mutex mutex;
+    lockUnlock(state, mutex);
+}
+
+BENCHMARK(CoreMutex, unnamed) {
+    Mutex mutex;
+    lockUnlock(state, mutex);
+}
+
+BENCHMARK(CoreMutex, namedNotProfiled) {
+    Mutex mutex("CoreMutexBench");
+    lockUnlock(state, mutex);
+}
+
+BENCHMARK(CoreMutex, namedProfiled) {
+    Mutex mutex("CoreMutexBench");
+    LockProfiler::setEnabled(true);
+    lockUnlock(state, mutex);
+    LockProfiler::setEnabled(false);
+}
+
+} // namespace LogCabin::Core::<anonymous>
+} // namespace LogCabin::Core
+} // namespace LogCabin
@@ -0,0 +1,83 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cassert>
+#include <utility>
+
+#include "Core/Payload.h"
+
+namespace LogCabin {
+namespace Core {
+
+Payload::Payload()
+    : block()
+    , offset(0)
+    , length(0)
+{
+}
+
+Payload::Payload(std::string bytes)
+    : block()
+    , offset(0)
+    , length(bytes.size())
+{
+    if (length > 0)
+        block = std::make_shared<const std::string>(std::move(bytes));
+}
+
+Payload::Payload(const Payload& whole, uint64_t offset, uint64_t length)
+    : block()
+    , offset(whole.offset + offset)
+    , length(length)
+{
+    assert(offset + length <= whole.length);
+    if (length > 0)
+        block = whole.block;
+}
+
+const char*
+Payload::data() const
+{
+    if (!block)
+        return "";
+    return block->data() + offset;
+}
+
+uint64_t
+Payload::size() const
+{
+    return length;
+}
+
+bool
+Payload::empty() const
+{
+    return length == 0;
+}
+
+bool
+Payload::isShared() const
+{
+    return block && block.use_count() > 1;
+}
+
+std::string
+Payload::toString() const
+{
+    return std::string(data(), length);
+}
+
+} // namespace LogCabin::Core
+} // namespace LogCabin
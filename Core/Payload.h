@@ -0,0 +1,113 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * An immutable, reference-counted byte string.
+ */
+
+#include <cinttypes>
+#include <memory>
+#include <string>
+
+#ifndef LOGCABIN_CORE_PAYLOAD_H
+#define LOGCABIN_CORE_PAYLOAD_H
+
+namespace LogCabin {
+namespace Core {
+
+/**
+ * An immutable byte string that is cheap to copy: copies share the same
+ * block of memory, which is freed when the last of them goes away. A Payload
+ * may also refer to just a slice of a block, so that part of a larger payload
+ * can be kept without copying it out.
+ *
+ * The server uses these for the data in log entries, so that the Raft log,
+ * the entries it hands to the state machine, and the state machine's logs all
+ * share one copy of each entry's bytes.
+ */
+class Payload {
+  public:
+    /**
+     * Constructor for an empty payload.
+     */
+    Payload();
+
+    /**
+     * Constructor. Move a string in to take over its memory without copying
+     * it.
+     */
+    explicit Payload(std::string bytes);
+
+    /**
+     * Constructor for a slice of another payload. The slice shares the
+     * other payload's memory.
+     * \param whole
+     *      The payload to take a slice of.
+     * \param offset
+     *      The position of the slice within 'whole'.
+     * \param length
+     *      The number of bytes in the slice. offset + length must not be
+     *      more than whole.size().
+     */
+    Payload(const Payload& whole, uint64_t offset, uint64_t length);
+
+    /**
+     * Return a pointer to the first byte. This is never NULL, even if the
+     * payload is empty.
+     */
+    const char* data() const;
+
+    /**
+     * Return the number of bytes.
+     */
+    uint64_t size() const;
+
+    /**
+     * Return true if there are no bytes.
+     */
+    bool empty() const;
+
+    /**
+     * Return true if another Payload refers to the same memory as this one.
+     */
+    bool isShared() const;
+
+    /**
+     * Return a copy of the bytes.
+     */
+    std::string toString() const;
+
+  private:
+    /**
+     * The memory that this payload refers to, or NULL if it's empty.
+     */
+    std::shared_ptr<const std::string> block;
+
+    /**
+     * The position of this payload's first byte within #block.
+     */
+    uint64_t offset;
+
+    /**
+     * The number of bytes in this payload.
+     */
+    uint64_t length;
+};
+
+} // namespace LogCabin::Core
+} // namespace LogCabin
+
+#endif /* LOGCABIN_CORE_PAYLOAD_H */
@@ -0,0 +1,75 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Core/Payload.h"
+
+namespace LogCabin {
+namespace Core {
+namespace {
+
+TEST(CorePayloadTest, empty) {
+    Payload payload;
+    EXPECT_TRUE(payload.empty());
+    EXPECT_EQ(0U, payload.size());
+    EXPECT_STREQ("", payload.data());
+    EXPECT_FALSE(payload.isShared());
+    EXPECT_TRUE(Payload(std::string()).empty());
+}
+
+TEST(CorePayloadTest, fromString) {
+    Payload payload(std::string("hello"));
+    EXPECT_EQ(5U, payload.size());
+    EXPECT_EQ("hello", payload.toString());
+    // moving a string in doesn't copy it (if it's too long for the small
+    // string optimization, anyway)
+    std::string bytes(1000, 'x');
+    const char* memory = bytes.data();
+    Payload moved(std::move(bytes));
+    EXPECT_EQ(memory, moved.data());
+}
+
+TEST(CorePayloadTest, copiesShare) {
+    Payload payload(std::string("hello"));
+    EXPECT_FALSE(payload.isShared());
+    {
+        Payload copy = payload;
+        EXPECT_EQ(payload.data(), copy.data());
+        EXPECT_TRUE(payload.isShared());
+        EXPECT_TRUE(copy.isShared());
+    }
+    EXPECT_FALSE(payload.isShared());
+}
+
+TEST(CorePayloadTest, slice) {
+    Payload payload(std::string("hello world"));
+    Payload world(payload, 6, 5);
+    EXPECT_EQ("world", world.toString());
+    EXPECT_EQ(payload.data() + 6, world.data());
+    EXPECT_TRUE(payload.isShared());
+    Payload orl(world, 1, 3);
+    EXPECT_EQ("orl", orl.toString());
+    Payload none(world, 5, 0);
+    EXPECT_TRUE(none.empty());
+    EXPECT_FALSE(none.isShared());
+    // the slice keeps the memory alive
+    payload = Payload();
+    EXPECT_EQ("world", world.toString());
+}
+
+} // namespace LogCabin::Core::<anonymous>
+} // namespace LogCabin::Core
+} // namespace LogCabin
@@ -0,0 +1,145 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <algorithm>
+
+#include "Core/Stats.h"
+#include "Core/ThreadId.h"
+
+namespace LogCabin {
+namespace Core {
+namespace Stats {
+
+uint32_t
+getShard()
+{
+    return uint32_t(ThreadId::getId() % NUM_SHARDS);
+}
+
+////////// Counter //////////
+
+Counter::Counter()
+    : shards()
+{
+}
+
+uint64_t
+Counter::get() const
+{
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < NUM_SHARDS; ++i)
+        total += shards[i].value.load(std::memory_order_relaxed);
+    return total;
+}
+
+////////// Histogram::Snapshot //////////
+
+Histogram::Snapshot::Snapshot()
+    : count(0)
+    , sum(0)
+    , max(0)
+    , buckets(NUM_BUCKETS, 0)
+{
+}
+
+uint64_t
+Histogram::Snapshot::getPercentile(double quantile) const
+{
+    if (count == 0)
+        return 0;
+    uint64_t rank = uint64_t(quantile * double(count));
+    if (rank >= count)
+        rank = count - 1;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < NUM_BUCKETS; ++i) {
+        seen += buckets.at(i);
+        if (seen > rank)
+            return std::min(getBucketUpperBound(i), max);
+    }
+    return max;
+}
+
+////////// Histogram::Shard //////////
+
+Histogram::Shard::Shard()
+    : count(0)
+    , sum(0)
+    , max(0)
+    , buckets()
+    , padding()
+{
+    for (uint32_t i = 0; i < NUM_BUCKETS; ++i)
+        buckets[i].store(0, std::memory_order_relaxed);
+}
+
+////////// Histogram //////////
+
+Histogram::Histogram()
+    : shards()
+{
+}
+
+uint32_t
+Histogram::getBucket(uint64_t value)
+{
+    if (value == 0)
+        return 0;
+    return 64 - uint32_t(__builtin_clzl(value));
+}
+
+uint64_t
+Histogram::getBucketUpperBound(uint32_t bucket)
+{
+    if (bucket >= 64)
+        return ~0UL;
+    return (1UL << bucket) - 1;
+}
+
+void
+Histogram::record(uint64_t value)
+{
+    Shard& shard = shards[getShard()];
+    shard.count.fetch_add(1, std::memory_order_relaxed);
+    shard.sum.fetch_add(value, std::memory_order_relaxed);
+    shard.buckets[getBucket(value)].fetch_add(1, std::memory_order_relaxed);
+    uint64_t max = shard.max.load(std::memory_order_relaxed);
+    while (value > max &&
+           !shard.max.compare_exchange_weak(max, value,
+                                            std::memory_order_relaxed)) {
+        // compare_exchange_weak reloaded max; try again
+    }
+}
+
+Histogram::Snapshot
+Histogram::getSnapshot() const
+{
+    Snapshot snapshot;
+    for (uint32_t i = 0; i < NUM_SHARDS; ++i) {
+        const Shard& shard = shards[i];
+        snapshot.count += shard.count.load(std::memory_order_relaxed);
+        snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+        snapshot.max = std::max(snapshot.max,
+                                shard.max.load(std::memory_order_relaxed));
+        for (uint32_t j = 0; j < NUM_BUCKETS; ++j) {
+            snapshot.buckets.at(j) +=
+                shard.buckets[j].load(std::memory_order_relaxed);
+        }
+    }
+    return snapshot;
+}
+
+} // namespace LogCabin::Core::Stats
+} // namespace LogCabin::Core
+} // namespace LogCabin
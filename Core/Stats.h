@@ -0,0 +1,208 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Counters and histograms for collecting statistics on hot paths.
+ */
+
+#if __GNUC__ >= 4 && __GNUC_MINOR__ >= 5
+#include <atomic>
+#else
+#include <cstdatomic>
+#endif
+#include <chrono>
+#include <cinttypes>
+#include <vector>
+
+#include "Core/Time.h"
+
+#ifndef LOGCABIN_CORE_STATS_H
+#define LOGCABIN_CORE_STATS_H
+
+namespace LogCabin {
+namespace Core {
+namespace Stats {
+
+/**
+ * The number of independent slots each Counter and Histogram spreads its
+ * updates across. Threads are assigned to slots by their Core::ThreadId, so
+ * that threads rarely write to the same cache lines.
+ */
+const uint32_t NUM_SHARDS = 8;
+
+/**
+ * Return the slot in [0, NUM_SHARDS) that the calling thread should update.
+ */
+uint32_t getShard();
+
+/**
+ * Return the number of microseconds that have elapsed since 'start'.
+ */
+inline uint64_t
+microsSince(Time::SteadyClock::time_point start)
+{
+    Time::SteadyClock::time_point now = Time::SteadyClock::now();
+    if (now < start) // possible with a mocked clock
+        return 0;
+    return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+                        now - start).count());
+}
+
+/**
+ * Return the number of nanoseconds that have elapsed since 'start'.
+ */
+inline uint64_t
+nanosSince(Time::SteadyClock::time_point start)
+{
+    Time::SteadyClock::time_point now = Time::SteadyClock::now();
+    if (now < start) // possible with a mocked clock
+        return 0;
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        now - start).count());
+}
+
+/**
+ * A monotonically increasing count that many threads may add to
+ * concurrently. Updates are lock-free and go to a per-thread slot; reads sum
+ * up all the slots. Reads are therefore more expensive than updates, which is
+ * the right trade-off for statistics that are bumped on every request but are
+ * only occasionally collected.
+ */
+class Counter {
+  public:
+    /// Constructor. The count starts at 0.
+    Counter();
+
+    /**
+     * Add to the count.
+     */
+    void add(uint64_t delta = 1) {
+        shards[getShard()].value.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    /**
+     * Return the sum of all prior calls to add(). This does not block
+     * concurrent calls to add(), but it may or may not include them.
+     */
+    uint64_t get() const;
+
+  private:
+    /**
+     * One slot, padded out to its own cache line.
+     */
+    struct Shard {
+        Shard() : value(0), padding() {}
+        std::atomic<uint64_t> value;
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+    Shard shards[NUM_SHARDS];
+
+    // Counter is not copyable.
+    Counter(const Counter&) = delete;
+    Counter& operator=(const Counter&) = delete;
+};
+
+/**
+ * A distribution of non-negative integer samples, such as latencies in
+ * microseconds. Samples are counted in power-of-two buckets: bucket 0 holds
+ * the value 0, and bucket i > 0 holds values in [2^(i-1), 2^i). Like Counter,
+ * updates are lock-free and go to a per-thread slot.
+ */
+class Histogram {
+  public:
+    /**
+     * The number of buckets, enough to hold any uint64_t.
+     */
+    enum { NUM_BUCKETS = 65 };
+
+    /**
+     * A consistent-enough copy of a Histogram, returned by getSnapshot().
+     */
+    struct Snapshot {
+        Snapshot();
+        /**
+         * Return an upper bound on the given quantile of the samples, or 0 if
+         * there are no samples.
+         * \param quantile
+         *      A value in [0, 1], such as 0.99 for the 99th percentile.
+         */
+        uint64_t getPercentile(double quantile) const;
+        /// The total number of samples.
+        uint64_t count;
+        /// The total of all samples.
+        uint64_t sum;
+        /// The largest sample.
+        uint64_t max;
+        /// The number of samples in each bucket (NUM_BUCKETS entries).
+        std::vector<uint64_t> buckets;
+    };
+
+    /// Constructor. The histogram starts out empty.
+    Histogram();
+
+    /**
+     * Return the index of the bucket into which 'value' falls.
+     */
+    static uint32_t getBucket(uint64_t value);
+
+    /**
+     * Return the largest value that falls into the given bucket.
+     */
+    static uint64_t getBucketUpperBound(uint32_t bucket);
+
+    /**
+     * Add a sample.
+     */
+    void record(uint64_t value);
+
+    /**
+     * Add a sample: the number of microseconds elapsed since 'start'.
+     */
+    void recordMicrosSince(Time::SteadyClock::time_point start) {
+        record(microsSince(start));
+    }
+
+    /**
+     * Sum up the samples from every thread. This does not block concurrent
+     * calls to record(), but it may or may not include them.
+     */
+    Snapshot getSnapshot() const;
+
+  private:
+    /**
+     * One thread's portion of the histogram.
+     */
+    struct Shard {
+        Shard();
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> max;
+        std::atomic<uint64_t> buckets[NUM_BUCKETS];
+        // Keep neighboring shards' counts off of this shard's cache lines.
+        char padding[64];
+    };
+    Shard shards[NUM_SHARDS];
+
+    // Histogram is not copyable.
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+};
+
+} // namespace LogCabin::Core::Stats
+} // namespace LogCabin::Core
+} // namespace LogCabin
+
+#endif /* LOGCABIN_CORE_STATS_H */
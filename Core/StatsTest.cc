@@ -0,0 +1,102 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+#include "Core/Stats.h"
+
+namespace LogCabin {
+namespace Core {
+namespace Stats {
+namespace {
+
+void
+addMany(Counter* counter, Histogram* histogram)
+{
+    for (uint64_t i = 0; i < 1000; ++i) {
+        counter->add(2);
+        histogram->record(i);
+    }
+}
+
+TEST(CoreStatsTest, counter) {
+    Counter counter;
+    EXPECT_EQ(0U, counter.get());
+    counter.add();
+    counter.add(4);
+    EXPECT_EQ(5U, counter.get());
+}
+
+TEST(CoreStatsTest, histogram_getBucket) {
+    EXPECT_EQ(0U, Histogram::getBucket(0));
+    EXPECT_EQ(1U, Histogram::getBucket(1));
+    EXPECT_EQ(2U, Histogram::getBucket(2));
+    EXPECT_EQ(2U, Histogram::getBucket(3));
+    EXPECT_EQ(3U, Histogram::getBucket(4));
+    EXPECT_EQ(64U, Histogram::getBucket(~0UL));
+    EXPECT_EQ(0U, Histogram::getBucketUpperBound(0));
+    EXPECT_EQ(3U, Histogram::getBucketUpperBound(2));
+    EXPECT_EQ(~0UL, Histogram::getBucketUpperBound(64));
+}
+
+TEST(CoreStatsTest, histogram_record) {
+    Histogram histogram;
+    histogram.record(0);
+    histogram.record(5);
+    histogram.record(6);
+    histogram.record(100);
+    Histogram::Snapshot snapshot = histogram.getSnapshot();
+    EXPECT_EQ(4U, snapshot.count);
+    EXPECT_EQ(111U, snapshot.sum);
+    EXPECT_EQ(100U, snapshot.max);
+    EXPECT_EQ(1U, snapshot.buckets.at(0));
+    EXPECT_EQ(2U, snapshot.buckets.at(3));
+    EXPECT_EQ(1U, snapshot.buckets.at(7));
+}
+
+TEST(CoreStatsTest, histogram_getPercentile) {
+    Histogram histogram;
+    EXPECT_EQ(0U, histogram.getSnapshot().getPercentile(0.5));
+    for (uint64_t i = 0; i < 99; ++i)
+        histogram.record(10);
+    histogram.record(1000);
+    Histogram::Snapshot snapshot = histogram.getSnapshot();
+    EXPECT_EQ(15U, snapshot.getPercentile(0.5));
+    EXPECT_EQ(15U, snapshot.getPercentile(0.98));
+    EXPECT_EQ(1000U, snapshot.getPercentile(0.999));
+    EXPECT_EQ(1000U, snapshot.getPercentile(1.0));
+}
+
+TEST(CoreStatsTest, threads) {
+    Counter counter;
+    Histogram histogram;
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < 4; ++i)
+        threads.emplace_back(addMany, &counter, &histogram);
+    for (auto it = threads.begin(); it != threads.end(); ++it)
+        it->join();
+    EXPECT_EQ(8000U, counter.get());
+    Histogram::Snapshot snapshot = histogram.getSnapshot();
+    EXPECT_EQ(4000U, snapshot.count);
+    EXPECT_EQ(4 * 999 * 1000 / 2U, snapshot.sum);
+    EXPECT_EQ(999U, snapshot.max);
+}
+
+} // namespace LogCabin::Core::Stats::<anonymous>
+} // namespace LogCabin::Core::Stats
+} // namespace LogCabin::Core
+} // namespace LogCabin
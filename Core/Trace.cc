@@ -0,0 +1,288 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if __GNUC__ >= 4 && __GNUC_MINOR__ >= 5
+#include <atomic>
+#else
+#include <cstdatomic>
+#endif
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+#include "Core/StringUtil.h"
+#include "Core/Trace.h"
+
+namespace LogCabin {
+namespace Core {
+namespace Trace {
+namespace Internal {
+
+/**
+ * Traces whose requests are still in flight are never allowed to exceed this
+ * number. Requests can be dropped without ever sending a reply (for example,
+ * if the client disconnects), and this keeps their traces from accumulating.
+ */
+const size_t MAX_ACTIVE = 4096;
+
+/**
+ * The trace ID for the current thread. See Scope.
+ */
+__thread uint64_t currentTraceId = 0;
+
+/**
+ * Protects all of the following members.
+ */
+std::mutex mutex;
+
+/**
+ * Traces whose requests are still in flight, keyed by trace ID.
+ */
+std::unordered_map<uint64_t, Record> active;
+
+/**
+ * Maps from entry ID to trace ID for traces in #active that have an entry ID.
+ */
+std::unordered_map<uint64_t, uint64_t> activeEntries;
+
+/**
+ * The size of #activeEntries. This is read without the lock so that
+ * recordEntry() can return quickly in the common case.
+ */
+std::atomic<uint64_t> numActiveEntries(0);
+
+/**
+ * Finished traces. Once this reaches #ringSize, new traces overwrite the
+ * oldest ones, starting at #ringNext.
+ */
+std::vector<Record> ring;
+
+/**
+ * The number of traces to keep in #ring.
+ */
+uint32_t ringSize = 1024;
+
+/**
+ * The index in #ring that the next finished trace will be placed, once the
+ * ring is full.
+ */
+uint32_t ringNext = 0;
+
+uint64_t
+toNanos(Time::SteadyClock::time_point when)
+{
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        when.time_since_epoch()).count());
+}
+
+/**
+ * Find or create the trace for the given ID.
+ * Must be called with #mutex held.
+ */
+Record&
+getRecord(uint64_t traceId)
+{
+    auto it = active.find(traceId);
+    if (it != active.end())
+        return it->second;
+    if (active.size() >= MAX_ACTIVE) {
+        auto victim = active.begin();
+        if (victim->second.entryId != 0) {
+            activeEntries.erase(victim->second.entryId);
+            numActiveEntries = activeEntries.size();
+        }
+        active.erase(victim);
+    }
+    Record& record = active[traceId];
+    record.traceId = traceId;
+    return record;
+}
+
+} // namespace LogCabin::Core::Trace::Internal
+
+using namespace Internal; // NOLINT
+
+const char*
+stageToString(Stage stage)
+{
+    switch (stage) {
+        case Stage::RECEIVE:
+            return "receive";
+        case Stage::DEQUEUE:
+            return "dequeue";
+        case Stage::APPEND:
+            return "append";
+        case Stage::COMMIT:
+            return "commit";
+        case Stage::APPLY:
+            return "apply";
+        case Stage::SEND:
+            return "send";
+    }
+    return "unknown";
+}
+
+////////// Record //////////
+
+Record::Record()
+    : traceId(0)
+    , entryId(0)
+    , timestamps()
+{
+}
+
+////////// free functions //////////
+
+void
+record(uint64_t traceId, Stage stage)
+{
+    if (traceId == 0)
+        return;
+    record(traceId, stage, Time::SteadyClock::now());
+}
+
+void
+record(uint64_t traceId, Stage stage, Time::SteadyClock::time_point when)
+{
+    if (traceId == 0)
+        return;
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    getRecord(traceId).timestamps[uint32_t(stage)] = toNanos(when);
+}
+
+void
+setEntryId(uint64_t traceId, uint64_t entryId)
+{
+    if (traceId == 0)
+        return;
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    Record& record = getRecord(traceId);
+    if (record.entryId != 0)
+        activeEntries.erase(record.entryId);
+    record.entryId = entryId;
+    activeEntries[entryId] = traceId;
+    numActiveEntries = activeEntries.size();
+}
+
+void
+recordEntry(uint64_t entryId, Stage stage)
+{
+    if (numActiveEntries == 0)
+        return;
+    Time::SteadyClock::time_point now = Time::SteadyClock::now();
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    auto it = activeEntries.find(entryId);
+    if (it == activeEntries.end())
+        return;
+    getRecord(it->second).timestamps[uint32_t(stage)] = toNanos(now);
+}
+
+void
+finish(uint64_t traceId)
+{
+    if (traceId == 0)
+        return;
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    auto it = active.find(traceId);
+    if (it == active.end())
+        return;
+    if (it->second.entryId != 0) {
+        activeEntries.erase(it->second.entryId);
+        numActiveEntries = activeEntries.size();
+    }
+    if (ringSize > 0) {
+        if (ring.size() < ringSize) {
+            ring.push_back(it->second);
+        } else {
+            ring.at(ringNext) = it->second;
+            ringNext = (ringNext + 1) % ringSize;
+        }
+    }
+    active.erase(it);
+}
+
+std::vector<Record>
+getRecent()
+{
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    std::vector<Record> records;
+    records.reserve(ring.size());
+    for (uint32_t i = 0; i < ring.size(); ++i)
+        records.push_back(ring.at((ringNext + i) % ring.size()));
+    return records;
+}
+
+std::string
+toJSON(const std::vector<Record>& records)
+{
+    std::ostringstream os;
+    os << "[";
+    for (auto it = records.begin(); it != records.end(); ++it) {
+        const Record& record = *it;
+        if (it != records.begin())
+            os << ",";
+        os << "\n  {\"traceId\": \""
+           << StringUtil::format("%016lx", record.traceId) << "\""
+           << ", \"entryId\": " << record.entryId;
+        uint64_t start = record.timestamps[uint32_t(Stage::RECEIVE)];
+        for (uint32_t i = 0; i < NUM_STAGES; ++i) {
+            uint64_t timestamp = record.timestamps[i];
+            if (timestamp == 0 || timestamp < start)
+                continue;
+            os << ", \"" << stageToString(Stage(i)) << "Micros\": "
+               << (timestamp - start) / 1000;
+        }
+        os << "}";
+    }
+    if (!records.empty())
+        os << "\n";
+    os << "]";
+    return os.str();
+}
+
+void
+reset(uint32_t newRingSize)
+{
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    active.clear();
+    activeEntries.clear();
+    numActiveEntries = 0;
+    ring.clear();
+    ringSize = newRingSize;
+    ringNext = 0;
+}
+
+uint64_t
+getCurrentTraceId()
+{
+    return currentTraceId;
+}
+
+////////// Scope //////////
+
+Scope::Scope(uint64_t traceId)
+    : previous(currentTraceId)
+{
+    currentTraceId = traceId;
+}
+
+Scope::~Scope()
+{
+    currentTraceId = previous;
+}
+
+} // namespace LogCabin::Core::Trace
+} // namespace LogCabin::Core
+} // namespace LogCabin
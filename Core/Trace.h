@@ -0,0 +1,173 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Lightweight tracing of individual requests as they pass through the server.
+ *
+ * A request is traced if it carries a non-zero trace ID. As it makes its way
+ * through the RPC system, Raft, and the state machine, each stage records a
+ * timestamp under that trace ID. Once the reply has been sent, the finished
+ * trace is moved into a fixed-size ring of recent traces, from which it can
+ * be read back with getRecent() or dumped with toJSON().
+ *
+ * Requests without a trace ID (the vast majority) cost only a comparison
+ * against 0 at each stage.
+ */
+
+#include <cinttypes>
+#include <string>
+#include <vector>
+
+#include "Core/Time.h"
+
+#ifndef LOGCABIN_CORE_TRACE_H
+#define LOGCABIN_CORE_TRACE_H
+
+namespace LogCabin {
+namespace Core {
+namespace Trace {
+
+/**
+ * The points along a request's path at which timestamps are recorded.
+ */
+enum class Stage {
+    // Keep this in sync with stageToString.
+    /// The RPC server received the request from the network.
+    RECEIVE = 0,
+    /// A worker thread picked the request up from the dispatch queue.
+    DEQUEUE = 1,
+    /// The leader appended the request's entry to its log.
+    APPEND = 2,
+    /// The entry was committed by a quorum.
+    COMMIT = 3,
+    /// The state machine applied the entry.
+    APPLY = 4,
+    /// The reply finished being written to the socket.
+    SEND = 5,
+};
+
+/**
+ * The number of values in Stage.
+ */
+enum { NUM_STAGES = 6 };
+
+/**
+ * Return a short name for the stage, such as "receive".
+ */
+const char* stageToString(Stage stage);
+
+/**
+ * The timestamps collected for one traced request.
+ */
+struct Record {
+    Record();
+    /// The request's trace ID, never 0.
+    uint64_t traceId;
+    /// The log entry the request created, or 0 if none.
+    uint64_t entryId;
+    /**
+     * The time each stage was reached, in nanoseconds since the
+     * Core::Time::SteadyClock epoch, indexed by Stage. Stages that were never
+     * reached are 0.
+     */
+    uint64_t timestamps[NUM_STAGES];
+};
+
+/**
+ * Note that the traced request has reached the given stage now.
+ * \param traceId
+ *      The request's trace ID. If this is 0, this does nothing.
+ * \param stage
+ *      The stage the request reached.
+ */
+void record(uint64_t traceId, Stage stage);
+
+/**
+ * Note that the traced request reached the given stage at the given time.
+ * \copydetails record
+ * \param when
+ *      The time at which the request reached the stage.
+ */
+void record(uint64_t traceId, Stage stage,
+            Time::SteadyClock::time_point when);
+
+/**
+ * Associate a traced request with the log entry it created, so that later
+ * stages that only know the entry ID can be attributed to the trace. See
+ * recordEntry().
+ */
+void setEntryId(uint64_t traceId, uint64_t entryId);
+
+/**
+ * Note that the traced request that created the given log entry, if any, has
+ * reached the given stage now. This is fast when no traced request has
+ * created a log entry that is still in flight.
+ */
+void recordEntry(uint64_t entryId, Stage stage);
+
+/**
+ * Stop recording stages for the traced request and move it into the ring of
+ * recent traces. If traceId is 0 or the trace is unknown, this does nothing.
+ */
+void finish(uint64_t traceId);
+
+/**
+ * Return the recently finished traces, oldest first.
+ */
+std::vector<Record> getRecent();
+
+/**
+ * Format traces as a JSON array, with one object per trace. Each object has
+ * the trace ID (as a hex string), the entry ID, and the number of
+ * microseconds between the receive stage and every later stage reached.
+ */
+std::string toJSON(const std::vector<Record>& records);
+
+/**
+ * Set the number of finished traces to keep. This also discards all traces
+ * collected so far, so it is mainly useful at startup and in unit tests.
+ */
+void reset(uint32_t ringSize = 1024);
+
+/**
+ * Return the trace ID of the request the current thread is working on, or 0
+ * if none. See Scope.
+ */
+uint64_t getCurrentTraceId();
+
+/**
+ * Sets the trace ID that getCurrentTraceId() returns for the lifetime of this
+ * object. This lets code that has no handle on the request, such as the
+ * consensus module, record stages on behalf of the request being processed by
+ * the current thread.
+ */
+class Scope {
+  public:
+    explicit Scope(uint64_t traceId);
+    ~Scope();
+  private:
+    /// The trace ID to restore upon destruction.
+    uint64_t previous;
+    // Scope is not copyable.
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+};
+
+} // namespace LogCabin::Core::Trace
+} // namespace LogCabin::Core
+} // namespace LogCabin
+
+#endif /* LOGCABIN_CORE_TRACE_H */
@@ -0,0 +1,123 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Core/Trace.h"
+
+namespace LogCabin {
+namespace Core {
+namespace Trace {
+namespace {
+
+class CoreTraceTest : public ::testing::Test {
+    CoreTraceTest()
+        : start(Time::SteadyClock::now())
+    {
+        reset(2);
+    }
+    ~CoreTraceTest()
+    {
+        reset();
+    }
+    Time::SteadyClock::time_point
+    at(uint64_t micros)
+    {
+        return start + std::chrono::microseconds(micros);
+    }
+    Time::SteadyClock::time_point start;
+};
+
+TEST_F(CoreTraceTest, stageToString) {
+    EXPECT_STREQ("receive", stageToString(Stage::RECEIVE));
+    EXPECT_STREQ("send", stageToString(Stage::SEND));
+}
+
+TEST_F(CoreTraceTest, record) {
+    record(0, Stage::RECEIVE);
+    finish(0);
+    record(5, Stage::RECEIVE, at(0));
+    record(5, Stage::SEND, at(10));
+    EXPECT_EQ(0U, getRecent().size());
+    finish(5);
+    finish(5);
+    std::vector<Record> records = getRecent();
+    ASSERT_EQ(1U, records.size());
+    EXPECT_EQ(5U, records.at(0).traceId);
+    EXPECT_EQ(0U, records.at(0).entryId);
+    EXPECT_EQ(10000U, (records.at(0).timestamps[uint32_t(Stage::SEND)] -
+                       records.at(0).timestamps[uint32_t(Stage::RECEIVE)]));
+    EXPECT_EQ(0U, records.at(0).timestamps[uint32_t(Stage::APPLY)]);
+}
+
+TEST_F(CoreTraceTest, recordEntry) {
+    recordEntry(9, Stage::APPLY);
+    record(5, Stage::RECEIVE, at(0));
+    setEntryId(5, 9);
+    recordEntry(8, Stage::APPLY);
+    recordEntry(9, Stage::APPLY);
+    finish(5);
+    recordEntry(9, Stage::COMMIT);
+    std::vector<Record> records = getRecent();
+    ASSERT_EQ(1U, records.size());
+    EXPECT_EQ(9U, records.at(0).entryId);
+    EXPECT_NE(0U, records.at(0).timestamps[uint32_t(Stage::APPLY)]);
+    EXPECT_EQ(0U, records.at(0).timestamps[uint32_t(Stage::COMMIT)]);
+}
+
+TEST_F(CoreTraceTest, getRecent_wraps) {
+    for (uint64_t i = 1; i <= 3; ++i) {
+        record(i, Stage::RECEIVE);
+        finish(i);
+    }
+    std::vector<Record> records = getRecent();
+    ASSERT_EQ(2U, records.size());
+    EXPECT_EQ(2U, records.at(0).traceId);
+    EXPECT_EQ(3U, records.at(1).traceId);
+}
+
+TEST_F(CoreTraceTest, toJSON) {
+    EXPECT_EQ("[]", toJSON({}));
+    record(0xab, Stage::RECEIVE, at(0));
+    record(0xab, Stage::DEQUEUE, at(3));
+    record(0xab, Stage::SEND, at(12));
+    setEntryId(0xab, 7);
+    finish(0xab);
+    EXPECT_EQ("[\n"
+              "  {\"traceId\": \"00000000000000ab\", \"entryId\": 7, "
+              "\"receiveMicros\": 0, \"dequeueMicros\": 3, "
+              "\"sendMicros\": 12}\n"
+              "]",
+              toJSON(getRecent()));
+}
+
+TEST_F(CoreTraceTest, scope) {
+    EXPECT_EQ(0U, getCurrentTraceId());
+    {
+        Scope outer(4);
+        EXPECT_EQ(4U, getCurrentTraceId());
+        {
+            Scope inner(6);
+            EXPECT_EQ(6U, getCurrentTraceId());
+        }
+        EXPECT_EQ(4U, getCurrentTraceId());
+    }
+    EXPECT_EQ(0U, getCurrentTraceId());
+}
+
+} // namespace LogCabin::Core::Trace::<anonymous>
+} // namespace LogCabin::Core::Trace
+} // namespace LogCabin::Core
+} // namespace LogCabin
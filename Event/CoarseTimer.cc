@@ -0,0 +1,54 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "Event/CoarseTimer.h"
+#include "Event/Loop.h"
+#include "Event/TimerWheel.h"
+
+namespace LogCabin {
+namespace Event {
+
+CoarseTimer::CoarseTimer(Event::Loop& eventLoop)
+    : eventLoop(eventLoop)
+    , link(this)
+    , expiry(0)
+{
+}
+
+CoarseTimer::~CoarseTimer()
+{
+    deschedule();
+}
+
+void
+CoarseTimer::schedule(uint64_t nanoseconds)
+{
+    eventLoop.timerWheel->schedule(*this, nanoseconds);
+}
+
+void
+CoarseTimer::deschedule()
+{
+    eventLoop.timerWheel->deschedule(*this);
+}
+
+bool
+CoarseTimer::isScheduled() const
+{
+    return eventLoop.timerWheel->isScheduled(*this);
+}
+
+} // namespace LogCabin::Event
+} // namespace LogCabin
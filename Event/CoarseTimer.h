@@ -0,0 +1,117 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cinttypes>
+
+#include "Event/Loop.h"
+#include "Event/TimerWheel.h"
+
+#ifndef LOGCABIN_EVENT_COARSETIMER_H
+#define LOGCABIN_EVENT_COARSETIMER_H
+
+namespace LogCabin {
+namespace Event {
+
+/**
+ * A CoarseTimer is called by the Event::Loop when time has elapsed, like
+ * Event::Timer, but it's kept on the Loop's TimerWheel rather than in
+ * libevent. It may fire up to TimerWheel::TICK_NANOS later than asked, but
+ * rescheduling it is much cheaper. Use this for timeouts that are pushed
+ * back over and over and rarely fire, such as session liveness checks and
+ * RPC deadlines; use Event::Timer when the deadline must be precise.
+ *
+ * The client should inherit from this and implement the trigger method for
+ * when the timer expires. CoarseTimers can be scheduled from any thread, but
+ * they will always fire on the thread running the Event::Loop.
+ */
+class CoarseTimer {
+  public:
+
+    /**
+     * Construct a timer but do not schedule it to trigger.
+     * It will not fire until schedule() is invoked.
+     * \param eventLoop
+     *      Event::Loop that will manage this timer.
+     */
+    explicit CoarseTimer(Event::Loop& eventLoop);
+
+    /**
+     * Destructor. Deschedules the timer.
+     */
+    virtual ~CoarseTimer();
+
+    /**
+     * This method is overridden by a subclass and invoked when the timer
+     * expires. This method will be invoked by the main event loop on whatever
+     * thread is running the Event::Loop.
+     */
+    virtual void handleTimerEvent() = 0;
+
+    /**
+     * Start the timer.
+     * \param nanoseconds
+     *     The timer will trigger once this number of nanoseconds have elapsed,
+     *     rounded up to the next TimerWheel tick. If the timer was already
+     *     scheduled, the old time is forgotten.
+     */
+    void schedule(uint64_t nanoseconds);
+
+    /**
+     * Stop the timer from calling handleTimerEvent().
+     * This behaves like Event::Timer::deschedule() when called concurrently
+     * with the timer firing: it waits for handleTimerEvent() to complete,
+     * unless it's called from handleTimerEvent() itself.
+     */
+    void deschedule();
+
+    /**
+     * Returns true if the timer has been scheduled and has not yet fired.
+     * \return
+     *      True if the timer has been scheduled and will eventually call
+     *      handleTimerEvent().
+     *      False if the timer is currently running handleTimerEvent() or if it
+     *      is not scheduled to call handleTimerEvent() in the future.
+     */
+    bool isScheduled() const;
+
+    /**
+     * Event::Loop that will manage this timer.
+     */
+    Event::Loop& eventLoop;
+
+  private:
+    /**
+     * This timer's entry on one of the TimerWheel's slots.
+     * Protected by the TimerWheel's mutex.
+     */
+    TimerWheel::Link link;
+
+    /**
+     * The TimerWheel tick at which this timer is due, if it's scheduled.
+     * Protected by the TimerWheel's mutex.
+     */
+    uint64_t expiry;
+
+    friend class TimerWheel;
+
+    // CoarseTimer is not copyable.
+    CoarseTimer(const CoarseTimer&) = delete;
+    CoarseTimer& operator=(const CoarseTimer&) = delete;
+};
+
+} // namespace LogCabin::Event
+} // namespace LogCabin
+
+#endif /* LOGCABIN_EVENT_COARSETIMER_H */
@@ -0,0 +1,276 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "Core/Debug.h"
+#include "Core/ThreadId.h"
+#include "Event/Epoll.h"
+
+namespace LogCabin {
+namespace Event {
+
+namespace {
+
+/**
+ * The maximum number of events to collect from each call to epoll_wait().
+ */
+const int MAX_EVENTS = 64;
+
+/**
+ * Return the name of an epoll_ctl() operation, for error messages.
+ */
+const char*
+opName(int op)
+{
+    switch (op) {
+        case EPOLL_CTL_ADD: return "EPOLL_CTL_ADD";
+        case EPOLL_CTL_MOD: return "EPOLL_CTL_MOD";
+        case EPOLL_CTL_DEL: return "EPOLL_CTL_DEL";
+    }
+    return "unknown op";
+}
+
+/**
+ * Wrapper around epoll_ctl() that PANICs on errors.
+ * Like libevent, this tolerates removing a file that has been closed already:
+ * the kernel drops closed files from the epoll set on its own.
+ */
+void
+control(int epollFd, int op, int fd, uint32_t epollEvents, uint64_t key)
+{
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = epollEvents;
+    event.data.u64 = key;
+    if (epoll_ctl(epollFd, op, fd, &event) == 0)
+        return;
+    if (op == EPOLL_CTL_DEL && (errno == EBADF || errno == ENOENT))
+        return;
+    PANIC("epoll_ctl(%s) failed on fd %d: %s",
+          opName(op), fd, strerror(errno));
+}
+
+/**
+ * Create the epoll file descriptor for Epoll::epollFd.
+ */
+int
+createEpollFd()
+{
+    int fd = epoll_create1(EPOLL_CLOEXEC);
+    if (fd < 0)
+        PANIC("epoll_create1 failed: %s", strerror(errno));
+    return fd;
+}
+
+/**
+ * Create the eventfd for Epoll::wakeUpFd.
+ */
+int
+createWakeUpFd()
+{
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0)
+        PANIC("eventfd failed: %s", strerror(errno));
+    return fd;
+}
+
+} // anonymous namespace
+
+Epoll::Entry::Entry()
+    : fd(-1)
+    , callback(NULL)
+    , arg(NULL)
+    , epollEvents(0)
+    , generation(0)
+{
+}
+
+Epoll::Epoll()
+    : epollFd(createEpollFd())
+    , wakeUpFd(createWakeUpFd())
+    , wakeUpRequested(false)
+    , mutex("Event::Epoll::mutex")
+    , entries()
+    , freeIds()
+    , dispatchThread(Core::ThreadId::NONE)
+    , running(NO_ID)
+    , callbackDone()
+{
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLET;
+    event.data.u64 = WAKE_UP_KEY;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeUpFd, &event) != 0)
+        PANIC("epoll_ctl failed to add eventfd: %s", strerror(errno));
+}
+
+Epoll::~Epoll()
+{
+    if (freeIds.size() != entries.size()) {
+        PANIC("Destroying Epoll with %lu files still registered",
+              entries.size() - freeIds.size());
+    }
+    ::close(wakeUpFd);
+    ::close(epollFd);
+}
+
+Epoll::Id
+Epoll::add(int fd, Callback callback, void* arg)
+{
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
+    Id id;
+    if (freeIds.empty()) {
+        id = Id(entries.size());
+        entries.emplace_back();
+    } else {
+        id = freeIds.back();
+        freeIds.pop_back();
+    }
+    Entry& entry = entries.at(id);
+    entry.fd = fd;
+    entry.callback = callback;
+    entry.arg = arg;
+    return id;
+}
+
+void
+Epoll::setEvents(Id id, uint32_t epollEvents)
+{
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
+    Entry& entry = entries.at(id);
+    if (entry.epollEvents != epollEvents) {
+        int op;
+        if (entry.epollEvents == 0)
+            op = EPOLL_CTL_ADD;
+        else if (epollEvents == 0)
+            op = EPOLL_CTL_DEL;
+        else
+            op = EPOLL_CTL_MOD;
+        control(epollFd, op, entry.fd, epollEvents,
+                toKey(id, entry.generation));
+        entry.epollEvents = epollEvents;
+    }
+    if (epollEvents == 0) {
+        while (running == id && dispatchThread != Core::ThreadId::getId())
+            callbackDone.wait(lockGuard);
+    }
+}
+
+void
+Epoll::waitForCallback(Id id)
+{
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
+    while (running == id && dispatchThread != Core::ThreadId::getId())
+        callbackDone.wait(lockGuard);
+}
+
+void
+Epoll::remove(Id id)
+{
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
+    Entry& entry = entries.at(id);
+    if (entry.epollEvents != 0)
+        control(epollFd, EPOLL_CTL_DEL, entry.fd, 0, 0);
+    while (running == id && dispatchThread != Core::ThreadId::getId())
+        callbackDone.wait(lockGuard);
+    entry.fd = -1;
+    entry.callback = NULL;
+    entry.arg = NULL;
+    entry.epollEvents = 0;
+    ++entry.generation;
+    freeIds.push_back(id);
+}
+
+void
+Epoll::dispatch()
+{
+    {
+        std::unique_lock<Core::Mutex> lockGuard(mutex);
+        dispatchThread = Core::ThreadId::getId();
+    }
+    struct epoll_event events[MAX_EVENTS];
+    while (!wakeUpRequested.exchange(false)) {
+        int numEvents = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+        if (numEvents < 0) {
+            if (errno == EINTR)
+                continue;
+            PANIC("epoll_wait failed: %s", strerror(errno));
+        }
+        for (int i = 0; i < numEvents; ++i) {
+            uint64_t key = events[i].data.u64;
+            if (key == WAKE_UP_KEY)
+                continue;
+            Id id = Id(key & 0xffffffff);
+            uint32_t generation = uint32_t(key >> 32);
+            Callback callback;
+            void* arg;
+            uint32_t ready;
+            {
+                std::unique_lock<Core::Mutex> lockGuard(mutex);
+                const Entry& entry = entries.at(id);
+                // The entry may have changed since epoll_wait() returned.
+                if (entry.generation != generation)
+                    continue;
+                uint32_t interest = entry.epollEvents & ~uint32_t(EPOLLET);
+                if (interest == 0)
+                    continue;
+                ready = events[i].events & (interest | EPOLLERR | EPOLLHUP);
+                // Like libevent, report errors and hang-ups as whatever the
+                // callback is interested in, so that it goes on to find out
+                // what happened.
+                if (ready & (EPOLLERR | EPOLLHUP))
+                    ready |= interest;
+                if (ready == 0)
+                    continue;
+                callback = entry.callback;
+                arg = entry.arg;
+                running = id;
+            }
+            callback(ready, arg);
+            {
+                std::unique_lock<Core::Mutex> lockGuard(mutex);
+                running = NO_ID;
+                callbackDone.notify_all();
+            }
+        }
+    }
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
+    dispatchThread = Core::ThreadId::NONE;
+}
+
+void
+Epoll::wakeUp()
+{
+    wakeUpRequested = true;
+    uint64_t one = 1;
+    ssize_t r = write(wakeUpFd, &one, sizeof(one));
+    // EAGAIN means the counter is saturated, and the loop will wake up anyway.
+    if (r != sizeof(one) && errno != EAGAIN)
+        PANIC("write to eventfd failed: %s", strerror(errno));
+}
+
+uint64_t
+Epoll::toKey(Id id, uint32_t generation)
+{
+    return (uint64_t(generation) << 32) | id;
+}
+
+} // namespace LogCabin::Event
+} // namespace LogCabin
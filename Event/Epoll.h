@@ -0,0 +1,231 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * This file contains the epoll backend for Event::Loop.
+ *
+ * \warning
+ *      This file should only be included from Event implementation files --
+ *      never from other header files.
+ */
+
+#include <atomic>
+#include <cinttypes>
+#include <vector>
+
+#include "Core/ConditionVariable.h"
+#include "Core/Mutex.h"
+
+#ifndef LOGCABIN_EVENT_EPOLL_H
+#define LOGCABIN_EVENT_EPOLL_H
+
+namespace LogCabin {
+namespace Event {
+
+/**
+ * This is the core of an Event::Loop constructed with Loop::Backend::EPOLL,
+ * used in place of libevent's event_base. Event::File, Event::Timer, and
+ * Event::Signal register a file descriptor here along with a callback, and
+ * dispatch() invokes the callbacks on the event loop thread.
+ *
+ * Unlike libevent, changes made from other threads never have to stop the
+ * event loop: epoll_ctl() is safe to call while another thread is blocked in
+ * epoll_wait(), so setEvents() applies changes directly. The only time a
+ * caller waits for the loop is when it disables a callback that's running
+ * right now on the event loop thread, so that it may then safely close the
+ * file or free the callback's argument.
+ */
+class Epoll {
+  public:
+    /**
+     * Identifies a registration; returned from add().
+     */
+    typedef uint32_t Id;
+
+    /**
+     * Invoked on the event loop thread when a registered file is ready.
+     * \param epollEvents
+     *      The EPOLL* bits that are ready, restricted to those registered in
+     *      the latest setEvents() call plus EPOLLERR and EPOLLHUP. If either
+     *      of those is set, all of the registered bits are set too.
+     * \param arg
+     *      The argument passed to add().
+     */
+    typedef void (*Callback)(uint32_t epollEvents, void* arg);
+
+    /**
+     * Constructor.
+     */
+    Epoll();
+
+    /**
+     * Destructor. The caller must ensure that nothing is still registered and
+     * that dispatch() is not running.
+     */
+    ~Epoll();
+
+    /**
+     * Register a file descriptor. It isn't monitored for anything until
+     * setEvents() is called.
+     * This method is thread-safe.
+     * \param fd
+     *      The file descriptor to monitor.
+     * \param callback
+     *      Called when the file is ready.
+     * \param arg
+     *      Passed to callback.
+     * \return
+     *      An identifier to pass to setEvents() and remove().
+     */
+    Id add(int fd, Callback callback, void* arg);
+
+    /**
+     * Change which events are monitored for a registered file descriptor.
+     * This method is thread-safe.
+     *
+     * If this sets the events to 0 from another thread while the callback is
+     * running on the event loop thread, this waits for the callback to
+     * return. Changing to a non-zero set of events never waits, since it
+     * makes no difference to a running callback.
+     *
+     * \param id
+     *      Returned from add().
+     * \param epollEvents
+     *      Bitwise OR of EPOLLIN, EPOLLOUT, and optionally EPOLLET. If this is
+     *      0, the file descriptor is removed from the epoll set, so the caller
+     *      may then safely close it.
+     */
+    void setEvents(Id id, uint32_t epollEvents);
+
+    /**
+     * If the callback for 'id' is running on another thread, wait for it to
+     * return. This method is thread-safe.
+     */
+    void waitForCallback(Id id);
+
+    /**
+     * Unregister a file descriptor, waiting for its callback to return if
+     * it's running on another thread. The id may be reused afterwards.
+     * This method is thread-safe.
+     */
+    void remove(Id id);
+
+    /**
+     * Wait for events and invoke callbacks until wakeUp() is called.
+     * Only one thread may call this at a time.
+     */
+    void dispatch();
+
+    /**
+     * Cause dispatch() to return soon. If dispatch() isn't running, the next
+     * call to dispatch() will return right away.
+     * This method is thread-safe.
+     */
+    void wakeUp();
+
+  private:
+    /**
+     * A registered file descriptor.
+     */
+    struct Entry {
+        Entry();
+        /// The file descriptor, or -1 if this entry is free.
+        int fd;
+        /// Invoked when the file is ready.
+        Callback callback;
+        /// Passed to callback.
+        void* arg;
+        /// Events registered with epoll, or 0 if not in the epoll set.
+        uint32_t epollEvents;
+        /**
+         * Incremented each time this entry is freed, so that events that
+         * epoll_wait() returned for a previous user of this entry are
+         * ignored.
+         */
+        uint32_t generation;
+    };
+
+    /**
+     * Pack an entry's index and generation into epoll_event's data field.
+     */
+    static uint64_t toKey(Id id, uint32_t generation);
+
+    /**
+     * The epoll file descriptor.
+     */
+    const int epollFd;
+
+    /**
+     * An eventfd, written to by wakeUp() to interrupt epoll_wait().
+     * This is registered edge-triggered, so dispatch() never needs to read
+     * it: every write generates a new event.
+     */
+    const int wakeUpFd;
+
+    /**
+     * Set by wakeUp() and cleared by dispatch() when it returns.
+     */
+    std::atomic<bool> wakeUpRequested;
+
+    /**
+     * Protects all of the members below.
+     */
+    Core::Mutex mutex;
+
+    /**
+     * Registrations, indexed by Id.
+     */
+    std::vector<Entry> entries;
+
+    /**
+     * Indexes into #entries that are free.
+     */
+    std::vector<Id> freeIds;
+
+    /**
+     * The thread running dispatch(), or Core::ThreadId::NONE.
+     */
+    uint64_t dispatchThread;
+
+    /**
+     * The Id whose callback is running, or NO_ID if none is.
+     */
+    Id running;
+
+    /**
+     * Signaled when a callback returns.
+     */
+    Core::ConditionVariable callbackDone;
+
+    /**
+     * Used in #running when no callback is running.
+     */
+    static const Id NO_ID = ~0U;
+
+    /**
+     * The epoll_event data for #wakeUpFd.
+     */
+    static const uint64_t WAKE_UP_KEY = ~0UL;
+
+    // Epoll is not copyable.
+    Epoll(const Epoll&) = delete;
+    Epoll& operator=(const Epoll&) = delete;
+};
+
+} // namespace LogCabin::Event
+} // namespace LogCabin
+
+#endif /* LOGCABIN_EVENT_EPOLL_H */
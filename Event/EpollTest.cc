@@ -0,0 +1,195 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <sys/epoll.h>
+#include <thread>
+#include <unistd.h>
+
+#include "Event/Epoll.h"
+
+namespace LogCabin {
+namespace Event {
+namespace {
+
+/**
+ * Argument for the callback, which counts its calls and then wakes up the
+ * Epoll so that dispatch() returns.
+ */
+struct Counter {
+    explicit Counter(Epoll& epoll)
+        : epoll(epoll)
+        , count(0)
+        , lastEvents(0)
+        , sleepMs(0)
+    {
+    }
+    Epoll& epoll;
+    uint32_t count;
+    uint32_t lastEvents;
+    uint32_t sleepMs;
+};
+
+void
+onReady(uint32_t epollEvents, void* arg)
+{
+    Counter* counter = static_cast<Counter*>(arg);
+    usleep(counter->sleepMs * 1000);
+    ++counter->count;
+    counter->lastEvents = epollEvents;
+    counter->epoll.wakeUp();
+}
+
+class EventEpollTest : public ::testing::Test {
+  public:
+    EventEpollTest()
+        : epoll()
+        , counter(epoll)
+        , pipeFds()
+    {
+        EXPECT_EQ(0, pipe(pipeFds));
+    }
+    ~EventEpollTest()
+    {
+        EXPECT_EQ(0, close(pipeFds[0]));
+        EXPECT_EQ(0, close(pipeFds[1]));
+    }
+    Epoll epoll;
+    Counter counter;
+    int pipeFds[2];
+};
+
+TEST_F(EventEpollTest, add) {
+    Epoll::Id id1 = epoll.add(pipeFds[0], onReady, &counter);
+    Epoll::Id id2 = epoll.add(pipeFds[1], onReady, &counter);
+    EXPECT_NE(id1, id2);
+    EXPECT_EQ(pipeFds[0], epoll.entries.at(id1).fd);
+    EXPECT_EQ(0U, epoll.entries.at(id1).epollEvents);
+    epoll.remove(id1);
+    // ids are reused
+    EXPECT_EQ(id1, epoll.add(pipeFds[0], onReady, &counter));
+    epoll.remove(id1);
+    epoll.remove(id2);
+}
+
+TEST_F(EventEpollTest, setEvents) {
+    Epoll::Id id = epoll.add(pipeFds[0], onReady, &counter);
+    EXPECT_EQ(1, write(pipeFds[1], "x", 1));
+    epoll.setEvents(id, EPOLLIN);
+    epoll.dispatch();
+    EXPECT_EQ(1U, counter.count);
+    EXPECT_EQ(uint32_t(EPOLLIN), counter.lastEvents);
+    // no-op
+    epoll.setEvents(id, EPOLLIN);
+    // not in the epoll set anymore
+    epoll.setEvents(id, 0);
+    epoll.setEvents(id, 0);
+    EXPECT_EQ(0U, epoll.entries.at(id).epollEvents);
+    epoll.remove(id);
+}
+
+TEST_F(EventEpollTest, setEvents_waitsForCallback) {
+    Epoll::Id id = epoll.add(pipeFds[0], onReady, &counter);
+    counter.sleepMs = 20;
+    EXPECT_EQ(1, write(pipeFds[1], "x", 1));
+    epoll.setEvents(id, EPOLLIN);
+    std::thread thread(&Epoll::dispatch, &epoll);
+    while (true) {
+        std::unique_lock<Core::Mutex> lockGuard(epoll.mutex);
+        if (epoll.running == id)
+            break;
+        lockGuard.unlock();
+        usleep(100);
+    }
+    // changing the events to something else doesn't wait
+    epoll.setEvents(id, EPOLLIN | EPOLLOUT);
+    EXPECT_EQ(0U, counter.count);
+    // but disabling them does
+    epoll.setEvents(id, 0);
+    EXPECT_EQ(1U, counter.count);
+    thread.join();
+    epoll.remove(id);
+}
+
+TEST_F(EventEpollTest, remove) {
+    Epoll::Id id = epoll.add(pipeFds[0], onReady, &counter);
+    epoll.setEvents(id, EPOLLIN);
+    uint32_t generation = epoll.entries.at(id).generation;
+    epoll.remove(id);
+    EXPECT_EQ(-1, epoll.entries.at(id).fd);
+    EXPECT_EQ(generation + 1, epoll.entries.at(id).generation);
+    EXPECT_EQ(1U, epoll.freeIds.size());
+}
+
+TEST_F(EventEpollTest, remove_closedFile) {
+    int fds[2];
+    EXPECT_EQ(0, pipe(fds));
+    Epoll::Id id = epoll.add(fds[0], onReady, &counter);
+    epoll.setEvents(id, EPOLLIN);
+    EXPECT_EQ(0, close(fds[0]));
+    EXPECT_EQ(0, close(fds[1]));
+    // like libevent, this is tolerated
+    epoll.remove(id);
+}
+
+TEST_F(EventEpollTest, dispatch_staleEvent) {
+    // An event from before the entry was reused is ignored.
+    Epoll::Id id = epoll.add(pipeFds[0], onReady, &counter);
+    epoll.setEvents(id, EPOLLIN);
+    epoll.remove(id);
+    Counter counter2(epoll);
+    EXPECT_EQ(id, epoll.add(pipeFds[0], onReady, &counter2));
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = Epoll::toKey(id, 0);
+    EXPECT_EQ(0, epoll_ctl(epoll.epollFd, EPOLL_CTL_ADD, pipeFds[0], &event));
+    EXPECT_EQ(1, write(pipeFds[1], "x", 1));
+    epoll.entries.at(id).epollEvents = EPOLLIN;
+    std::thread thread(&Epoll::dispatch, &epoll);
+    usleep(10000);
+    epoll.wakeUp();
+    thread.join();
+    EXPECT_EQ(0U, counter2.count);
+    epoll.remove(id);
+}
+
+TEST_F(EventEpollTest, dispatch_hangUp) {
+    int fds[2];
+    EXPECT_EQ(0, pipe(fds));
+    Epoll::Id id = epoll.add(fds[0], onReady, &counter);
+    epoll.setEvents(id, EPOLLIN);
+    EXPECT_EQ(0, close(fds[1]));
+    epoll.dispatch();
+    EXPECT_EQ(1U, counter.count);
+    EXPECT_EQ(uint32_t(EPOLLIN | EPOLLHUP), counter.lastEvents);
+    epoll.remove(id);
+    EXPECT_EQ(0, close(fds[0]));
+}
+
+TEST_F(EventEpollTest, wakeUp) {
+    // before dispatch
+    epoll.wakeUp();
+    epoll.dispatch();
+    // from another thread
+    std::thread thread(&Epoll::dispatch, &epoll);
+    usleep(1000);
+    epoll.wakeUp();
+    thread.join();
+    EXPECT_EQ(0U, counter.count);
+}
+
+} // namespace LogCabin::Event::<anonymous>
+} // namespace LogCabin::Event
+} // namespace LogCabin
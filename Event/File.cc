@@ -14,11 +14,13 @@
  */
 
 #include "Core/Debug.h"
+#include "Epoll.h"
 #include "Internal.h"
 #include "Loop.h"
 #include "File.h"
 
 #include <event2/event.h>
+#include <sys/epoll.h>
 
 namespace LogCabin {
 namespace Event {
@@ -71,13 +73,53 @@ onFileEventFired(evutil_socket_t fd,
                                     toFileEvents(libEventEvents));
 }
 
+/**
+ * Convert from File's event mask type to epoll's.
+ * File is level-triggered, since handleFileEvent() needn't drain the file.
+ */
+uint32_t
+toEpollEvents(uint32_t fileEvents)
+{
+    uint32_t epollEvents = 0;
+    if (fileEvents & File::Events::READABLE)
+        epollEvents |= EPOLLIN;
+    if (fileEvents & File::Events::WRITABLE)
+        epollEvents |= EPOLLOUT;
+    return epollEvents;
+}
+
+/**
+ * This is called by Epoll when any file event fires.
+ * \param epollEvents
+ *      The bitwise OR of EPOLLIN, EPOLLOUT, etc describing what has happened.
+ * \param file
+ *      The Event::File object whose file event fired.
+ */
+void
+onEpollFileEvent(uint32_t epollEvents, void* file)
+{
+    uint32_t fileEvents = 0;
+    if (epollEvents & EPOLLIN)
+        fileEvents |= File::Events::READABLE;
+    if (epollEvents & EPOLLOUT)
+        fileEvents |= File::Events::WRITABLE;
+    static_cast<File*>(file)->handleFileEvent(fileEvents);
+}
+
 } // anonymous namespace
 
 File::File(Event::Loop& eventLoop, int fd, uint32_t fileEvents)
     : eventLoop(eventLoop)
     , fd(fd)
     , event(NULL)
+    , epollId(0)
 {
+    if (eventLoop.epoll) {
+        epollId = eventLoop.epoll->add(fd, onEpollFileEvent, this);
+        if (fileEvents != 0)
+            eventLoop.epoll->setEvents(epollId, toEpollEvents(fileEvents));
+        return;
+    }
     event = qualify(event_new(unqualify(eventLoop.base),
                               fd,
                               toLibEventEvents(fileEvents),
@@ -101,12 +143,21 @@ File::File(Event::Loop& eventLoop, int fd, uint32_t fileEvents)
 
 File::~File()
 {
-    event_free(unqualify(event));
+    if (eventLoop.epoll)
+        eventLoop.epoll->remove(epollId);
+    else
+        event_free(unqualify(event));
 }
 
 void
 File::setEvents(uint32_t fileEvents)
 {
+    // Epoll is thread-safe on its own and doesn't need the loop to stop.
+    if (eventLoop.epoll) {
+        eventLoop.epoll->setEvents(epollId, toEpollEvents(fileEvents));
+        return;
+    }
+
     // This Lock is necessary for thread safety when multiple threads are
     // running within setEvents.
     Event::Loop::Lock lockGuard(eventLoop);
@@ -93,7 +93,9 @@ class File {
      * events triggering:
      * - If this method is called from another thread and handleFileEvent() is
      *   running concurrently on the event loop thread, setEvents() will wait
-     *   for handleFileEvent() to complete before returning.
+     *   for handleFileEvent() to complete before returning. (With the EPOLL
+     *   backend, it only waits when 'events' is 0; it returns right away
+     *   otherwise.)
      * - If this method is called from the event loop thread and
      *   handleFileEvent() is currently being fired, then setEvents() can't
      *   wait and returns immediately.
@@ -120,10 +122,16 @@ class File {
 
     /**
      * The file event from libevent.
-     * This is never NULL.
+     * This is NULL if the Event::Loop uses the EPOLL backend.
      */
     LibEvent::event* event;
 
+    /**
+     * Identifies this file to the Event::Loop's Epoll, if it uses the EPOLL
+     * backend.
+     */
+    uint32_t epollId;
+
     // File is not copyable.
     File(const File&) = delete;
     File& operator=(const File&) = delete;
@@ -15,9 +15,11 @@
 
 #include <event2/event.h>
 #include <gtest/gtest.h>
+#include <thread>
 #include <unistd.h>
 
 #include "Core/Debug.h"
+#include "Epoll.h"
 #include "Internal.h"
 #include "File.h"
 
@@ -115,6 +117,50 @@ TEST_F(EventFileTest, setEvents_badFileNotMonitored) {
                                NULL));
 }
 
+struct EventFileEpollTest : public EventFileTest {
+    EventFileEpollTest()
+        : epollLoop(Event::Loop::Backend::EPOLL)
+    {
+    }
+    Event::Loop epollLoop;
+};
+
+TEST_F(EventFileEpollTest, constructor) {
+    MyFile file(epollLoop, pipeFds[0], 0);
+    EXPECT_TRUE(file.event == NULL);
+    EXPECT_EQ(0U, epollLoop.epoll->entries.at(file.epollId).epollEvents);
+}
+
+TEST_F(EventFileEpollTest, fires) {
+    MyFile file(epollLoop, pipeFds[0], File::Events::READABLE);
+    EXPECT_EQ(1, write(pipeFds[1], "x", 1));
+    epollLoop.runForever();
+    EXPECT_EQ(1U, file.triggerCount);
+    // level-triggered: the data wasn't read, so it fires again
+    epollLoop.runForever();
+    EXPECT_EQ(2U, file.triggerCount);
+}
+
+TEST_F(EventFileEpollTest, setEvents) {
+    MyFile file(epollLoop, pipeFds[0], 0);
+    EXPECT_EQ(1, write(pipeFds[1], "x", 1));
+    file.setEvents(File::Events::READABLE);
+    epollLoop.runForever();
+    EXPECT_EQ(1U, file.triggerCount);
+    file.setEvents(0);
+    closePipeFds();
+    EXPECT_EQ(0U, epollLoop.epoll->entries.at(file.epollId).epollEvents);
+}
+
+TEST_F(EventFileEpollTest, setEvents_fromOtherThread) {
+    MyFile file(epollLoop, pipeFds[1], 0);
+    std::thread thread(&Event::Loop::runForever, &epollLoop);
+    // This takes effect without the event loop stopping.
+    file.setEvents(File::Events::WRITABLE);
+    thread.join();
+    EXPECT_EQ(1U, file.triggerCount);
+}
+
 } // namespace LogCabin::Event::<anonymous>
 } // namespace LogCabin::Event
 } // namespace LogCabin
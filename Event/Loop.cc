@@ -19,8 +19,10 @@
 
 #include "Core/Debug.h"
 #include "Core/ThreadId.h"
+#include "Event/Epoll.h"
 #include "Event/Internal.h"
 #include "Event/Loop.h"
+#include "Event/TimerWheel.h"
 
 namespace LogCabin {
 namespace Event {
@@ -63,14 +65,14 @@ scheduleReturnFromLibevent(LibEvent::event* breakEvent)
 Loop::Lock::Lock(Event::Loop& eventLoop)
     : eventLoop(eventLoop)
 {
-    std::unique_lock<std::mutex> lockGuard(eventLoop.mutex);
+    std::unique_lock<Core::Mutex> lockGuard(eventLoop.mutex);
     ++eventLoop.numLocks;
     if (eventLoop.runningThread != Core::ThreadId::getId() &&
         eventLoop.lockOwner != Core::ThreadId::getId()) {
         // This is an actual lock: we're not running inside the event loop, and
         //                         we're not recursively locking.
         if (eventLoop.runningThread != Core::ThreadId::NONE)
-            scheduleReturnFromLibevent(eventLoop.breakEvent);
+            eventLoop.interrupt();
         while (eventLoop.runningThread != Core::ThreadId::NONE ||
                eventLoop.lockOwner != Core::ThreadId::NONE) {
             eventLoop.safeToLock.wait(lockGuard);
@@ -83,7 +85,7 @@ Loop::Lock::Lock(Event::Loop& eventLoop)
 
 Loop::Lock::~Lock()
 {
-    std::unique_lock<std::mutex> lockGuard(eventLoop.mutex);
+    std::unique_lock<Core::Mutex> lockGuard(eventLoop.mutex);
     --eventLoop.numLocks;
     --eventLoop.numActiveLocks;
     if (eventLoop.numActiveLocks == 0) {
@@ -97,10 +99,15 @@ Loop::Lock::~Lock()
 
 ////////// Loop //////////
 
-Loop::Loop()
-    : base(NULL)
+Loop::Backend Loop::defaultBackend = Loop::Backend::LIBEVENT;
+
+Loop::Loop(Backend backend)
+    : backend(backend)
+    , base(NULL)
     , breakEvent(NULL)
-    , mutex()
+    , epoll()
+    , timerWheel()
+    , mutex("Event::Loop::mutex")
     , runningThread(Core::ThreadId::NONE)
     , shouldExit(false)
     , numLocks(0)
@@ -109,6 +116,12 @@ Loop::Loop()
     , safeToLock()
     , unlocked()
 {
+    if (backend == Backend::EPOLL) {
+        epoll.reset(new Epoll());
+        timerWheel.reset(new TimerWheel(*this));
+        return;
+    }
+
     assert(LibEvent::initialized);
     base = qualify(event_base_new());
     if (base == NULL) {
@@ -138,10 +151,17 @@ Loop::Loop()
         PANIC("event_priority_set failed: "
               "No information is available from libevent about this error.");
     }
+
+    timerWheel.reset(new TimerWheel(*this));
 }
 
 Loop::~Loop()
 {
+    timerWheel.reset();
+    if (backend == Backend::EPOLL) {
+        epoll.reset();
+        return;
+    }
     event_free(unqualify(breakEvent));
     event_base_free(unqualify(base));
 }
@@ -151,7 +171,7 @@ Loop::runForever()
 {
     while (true) {
         {
-            std::unique_lock<std::mutex> lockGuard(mutex);
+            std::unique_lock<Core::Mutex> lockGuard(mutex);
             runningThread = Core::ThreadId::NONE;
             // Wait for all Locks to finish up
             while (numLocks > 0) {
@@ -164,6 +184,10 @@ Loop::runForever()
             }
             runningThread = Core::ThreadId::getId();
         }
+        if (epoll) {
+            epoll->dispatch();
+            continue;
+        }
         int r = event_base_dispatch(unqualify(base));
         if (r == -1) {
             PANIC("event_loop_dispatch failed: No information is "
@@ -177,12 +201,21 @@ Loop::exit()
 {
     {
         // Set the flag for runForever to exit.
-        std::unique_lock<std::mutex> lockGuard(mutex);
+        std::unique_lock<Core::Mutex> lockGuard(mutex);
         shouldExit = true;
     }
 
-    // Convince run() to break out of libevent.
-    scheduleReturnFromLibevent(this->breakEvent);
+    // Convince run() to break out of libevent or epoll.
+    interrupt();
+}
+
+void
+Loop::interrupt()
+{
+    if (epoll)
+        epoll->wakeUp();
+    else
+        scheduleReturnFromLibevent(breakEvent);
 }
 
 } // namespace LogCabin::Event
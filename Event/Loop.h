@@ -17,8 +17,10 @@
 #define LOGCABIN_EVENT_LOOP_H
 
 #include <cinttypes>
-#include <condition_variable>
-#include <mutex>
+#include <memory>
+
+#include "Core/ConditionVariable.h"
+#include "Core/Mutex.h"
 
 /**
  * This is a container for types that are used in place of the unqualified
@@ -32,26 +34,49 @@ class event;
 
 namespace LogCabin {
 
-// forward declarations
-namespace RPC {
-class TCPListener;
-}
-
 namespace Event {
 
 // forward declarations
+class CoarseTimer;
+class Epoll;
 class File;
 class Signal;
 class Timer;
+class TimerWheel;
 
 /**
- * This class contains an event loop based on the libevent2 library.
+ * This class contains an event loop based on the libevent2 library or,
+ * optionally, directly on Linux's epoll.
  * It keeps track of interesting events such as timers and socket activity, and
  * arranges for callbacks to be invoked when the events happen.
  */
 class Loop {
   public:
 
+    /**
+     * The mechanism used to wait for events. Event::File, Event::Timer, and
+     * Event::Signal behave the same with either one.
+     */
+    enum class Backend {
+        /**
+         * Use libevent2. Changing events from another thread (for example,
+         * File::setEvents()) has to stop the event loop while it's done.
+         */
+        LIBEVENT,
+        /**
+         * Use epoll, eventfd, and timerfd directly. Changing events from
+         * another thread doesn't stop the event loop.
+         */
+        EPOLL,
+    };
+
+    /**
+     * The Backend used by Loops constructed without specifying one. This is
+     * LIBEVENT unless changed (for example, by a command line option); it
+     * should only be changed before any Loops are constructed.
+     */
+    static Backend defaultBackend;
+
     /**
      * Lock objects are used to synchronize between the Event::Loop thread and
      * other threads.  As long as a Lock object exists the following guarantees
@@ -78,8 +103,10 @@ class Loop {
 
     /**
      * Constructor.
+     * \param backend
+     *      The mechanism to use to wait for events.
      */
-    Loop();
+    explicit Loop(Backend backend = defaultBackend);
 
     /**
      * Destructor. The caller must ensure that no events still exist and that
@@ -106,10 +133,21 @@ class Loop {
      */
     void exit();
 
+    /**
+     * The mechanism this Loop uses to wait for events.
+     */
+    const Backend backend;
+
   private:
+    /**
+     * Convince the thread in runForever() to return to it from libevent or
+     * epoll soon. Used by Lock and exit().
+     */
+    void interrupt();
+
     /**
      * The core of the event loop from libevent.
-     * This is never NULL.
+     * This is NULL if #backend is EPOLL.
      */
     LibEvent::event_base* base;
 
@@ -123,14 +161,27 @@ class Loop {
      * be able to use Event::Loop::Lock if it wanted to, and this member's
      * construction would have to be deferred until the end of the
      * constructor.)
+     * This is NULL if #backend is EPOLL.
      */
     LibEvent::event* breakEvent;
 
+    /**
+     * The core of the event loop if #backend is EPOLL; NULL otherwise.
+     */
+    std::unique_ptr<Epoll> epoll;
+
+    /**
+     * Keeps track of the CoarseTimer objects for this loop. This is never
+     * NULL after the constructor returns. (It can't be created before #base
+     * or #epoll is set up, since it uses an Event::Timer.)
+     */
+    std::unique_ptr<TimerWheel> timerWheel;
+
     /**
      * This mutex protects all of the members of this class defined below this
      * point.
      */
-    std::mutex mutex;
+    Core::Mutex mutex;
 
     /**
      * The thread ID of the thread running the event loop, or
@@ -172,18 +223,19 @@ class Loop {
      * happens either because runForever() just reached its safe place or
      * because some other Lock was destroyed.
      */
-    std::condition_variable safeToLock;
+    Core::ConditionVariable safeToLock;
 
     /**
      * Signaled when there are no longer any Locks active.
      */
-    std::condition_variable unlocked;
+    Core::ConditionVariable unlocked;
 
-    // Event types are friends, since they need to mess with 'base'.
+    // Event types are friends, since they need to mess with 'base' and
+    // 'epoll'.
+    friend class CoarseTimer;
     friend class File;
     friend class Signal;
     friend class Timer;
-    friend class RPC::TCPListener;
 
     // Loop is not copyable.
     Loop(const Loop&) = delete;
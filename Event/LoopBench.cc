@@ -0,0 +1,179 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+
+#include "bench/Bench.h"
+#include "Core/Debug.h"
+#include "Event/File.h"
+#include "Event/Loop.h"
+
+namespace LogCabin {
+namespace Event {
+namespace {
+
+const Loop::Backend LIBEVENT = Loop::Backend::LIBEVENT;
+const Loop::Backend EPOLL = Loop::Backend::EPOLL;
+
+/**
+ * Echoes each byte it reads from one pipe to another.
+ */
+struct Echo : public Event::File {
+    Echo(Event::Loop& loop, int inFd, int outFd)
+        : File(loop, inFd, Events::READABLE)
+        , outFd(outFd)
+    {
+    }
+    void handleFileEvent(uint32_t events) {
+        char c;
+        if (read(fd, &c, 1) == 1 && write(outFd, &c, 1) != 1)
+            PANIC("write failed: %s", strerror(errno));
+    }
+    int outFd;
+};
+
+/**
+ * Never reads or writes anything; only here to have its events changed.
+ */
+struct Idle : public Event::File {
+    Idle(Event::Loop& loop, int fd)
+        : File(loop, fd, Events::READABLE)
+    {
+    }
+    void handleFileEvent(uint32_t events) {}
+};
+
+/**
+ * Create a pipe, PANICing on failure.
+ */
+void
+makePipe(int fds[2])
+{
+    if (pipe(fds) != 0)
+        PANIC("pipe failed: %s", strerror(errno));
+}
+
+/**
+ * Change the events of a File back and forth from another thread while the
+ * event loop runs, like MessageSocket does each time it queues a message.
+ */
+void
+setEvents(Bench::State& state, Loop::Backend backend)
+{
+    state.pauseTiming();
+    int fds[2];
+    makePipe(fds);
+    Event::Loop loop(backend);
+    std::thread loopThread(&Event::Loop::runForever, &loop);
+    {
+        Idle idle(loop, fds[0]);
+        state.resumeTiming();
+        for (uint64_t i = 0; i < state.iterations; ++i) {
+            if (i % 2 == 0)
+                idle.setEvents(File::Events::READABLE |
+                               File::Events::WRITABLE);
+            else
+                idle.setEvents(File::Events::READABLE);
+        }
+        state.pauseTiming();
+        idle.setEvents(0);
+    }
+    loop.exit();
+    loopThread.join();
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/**
+ * Send a byte through the event loop thread and wait for it to come back,
+ * measuring how long it takes the loop to notice a file became readable and
+ * run its handler.
+ */
+void
+roundTrip(Bench::State& state, Loop::Backend backend)
+{
+    state.pauseTiming();
+    int request[2];
+    int response[2];
+    makePipe(request);
+    makePipe(response);
+    Event::Loop loop(backend);
+    std::thread loopThread(&Event::Loop::runForever, &loop);
+    {
+        Echo echo(loop, request[0], response[1]);
+        state.resumeTiming();
+        for (uint64_t i = 0; i < state.iterations; ++i) {
+            char c = 'x';
+            if (write(request[1], &c, 1) != 1 || read(response[0], &c, 1) != 1)
+                PANIC("pipe I/O failed: %s", strerror(errno));
+        }
+        state.pauseTiming();
+        echo.setEvents(0);
+    }
+    loop.exit();
+    loopThread.join();
+    close(request[0]);
+    close(request[1]);
+    close(response[0]);
+    close(response[1]);
+}
+
+/**
+ * Acquire and release a Loop::Lock from another thread while the event loop
+ * runs.
+ */
+void
+lock(Bench::State& state, Loop::Backend backend)
+{
+    state.pauseTiming();
+    Event::Loop loop(backend);
+    std::thread loopThread(&Event::Loop::runForever, &loop);
+    state.resumeTiming();
+    for (uint64_t i = 0; i < state.iterations; ++i)
+        Event::Loop::Lock lockGuard(loop);
+    state.pauseTiming();
+    loop.exit();
+    loopThread.join();
+}
+
+BENCHMARK(EventLoop, setEvents) {
+    setEvents(state, LIBEVENT);
+}
+
+BENCHMARK(EventLoop, setEvents_epoll) {
+    setEvents(state, EPOLL);
+}
+
+BENCHMARK(EventLoop, roundTrip) {
+    roundTrip(state, LIBEVENT);
+}
+
+BENCHMARK(EventLoop, roundTrip_epoll) {
+    roundTrip(state, EPOLL);
+}
+
+BENCHMARK(EventLoop, lock) {
+    lock(state, LIBEVENT);
+}
+
+BENCHMARK(EventLoop, lock_epoll) {
+    lock(state, EPOLL);
+}
+
+} // namespace LogCabin::Event::<anonymous>
+} // namespace LogCabin::Event
+} // namespace LogCabin
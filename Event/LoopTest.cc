@@ -17,6 +17,7 @@
 #include <gtest/gtest.h>
 #include <thread>
 
+#include "Event/Epoll.h"
 #include "Event/Internal.h"
 #include "Event/Loop.h"
 #include "Event/Timer.h"
@@ -54,8 +55,9 @@ lockAndIncrement100(Event::Loop& eventLoop, uint64_t& count)
     }
 }
 
-TEST(EventLoopTest, lock) {
-    Loop loop;
+void
+checkLock(Loop& loop)
+{
     Counter counter(loop);
     counter.schedule(0);
 
@@ -97,9 +99,24 @@ TEST(EventLoopTest, lock) {
     EXPECT_EQ(300U, count);
 }
 
+TEST(EventLoopTest, lock) {
+    Loop loop;
+    checkLock(loop);
+}
+
+TEST(EventLoopTest, lock_epoll) {
+    Loop loop(Loop::Backend::EPOLL);
+    checkLock(loop);
+}
+
 TEST(EventLoopTest, constructor) {
     Loop loop;
-    // nothing to test
+    EXPECT_EQ(Loop::Backend::LIBEVENT, loop.backend);
+    EXPECT_TRUE(loop.base != NULL);
+    EXPECT_FALSE(loop.epoll);
+    Loop epollLoop(Loop::Backend::EPOLL);
+    EXPECT_TRUE(epollLoop.base == NULL);
+    EXPECT_TRUE(epollLoop.epoll);
 }
 
 TEST(EventLoopTest, destructor) {
@@ -133,6 +150,23 @@ TEST(EventLoopTest, exit) {
     thread.join();
 }
 
+TEST(EventLoopTest, exit_epoll) {
+    Loop loop(Loop::Backend::EPOLL);
+    Counter counter(loop, 9);
+    counter.schedule(0);
+    loop.runForever();
+    EXPECT_EQ(10U, counter.count);
+
+    // exit before run
+    loop.exit();
+    loop.runForever();
+
+    // exit from another thread
+    std::thread thread(&Loop::runForever, &loop);
+    loop.exit();
+    thread.join();
+}
+
 } // namespace LogCabin::Event::<anonymous>
 } // namespace LogCabin::Event
 } // namespace LogCabin
@@ -14,11 +14,21 @@
  */
 
 #include "Core/Debug.h"
+#include "Epoll.h"
 #include "Internal.h"
 #include "Loop.h"
 #include "Signal.h"
 
+#include <atomic>
+#include <errno.h>
 #include <event2/event.h>
+#include <mutex>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 namespace LogCabin {
 namespace Event {
@@ -40,12 +50,124 @@ onSignalFired(evutil_socket_t fd, short events, void* signal) // NOLINT
     static_cast<Signal*>(signal)->handleSignalEvent();
 }
 
+/**
+ * The most Event::Signal objects using the EPOLL backend that may handle the
+ * same signal number at once (for example, one per server in a LocalCluster).
+ */
+const uint32_t MAX_SIGNALS_PER_NUMBER = 64;
+
+/**
+ * For each signal number, one more than the eventfds that onSignal() writes
+ * to. Unused slots are 0, so that this is ready before any constructors run.
+ */
+std::atomic<int> signalFdsPlusOne[NSIG][MAX_SIGNALS_PER_NUMBER];
+
+/**
+ * For each signal number, the number of onSignal() calls in progress. The
+ * handler may run on any thread, so blocking the signal in the thread
+ * destroying a Signal isn't enough to keep the handler away from its eventfd;
+ * instead, ~Signal() waits for this to drop to 0 after clearing its slot in
+ * #signalFdsPlusOne, before closing the eventfd.
+ */
+std::atomic<uint32_t> handlersRunning[NSIG];
+
+/**
+ * Protects #numSignals and #oldActions.
+ */
+std::mutex installMutex;
+
+/**
+ * For each signal number, the number of Event::Signal objects using the
+ * EPOLL backend that handle it. onSignal() is installed while this is
+ * non-zero.
+ */
+uint32_t numSignals[NSIG];
+
+/**
+ * For each signal number handled with the EPOLL backend, the action that was
+ * installed before onSignal(), to restore when the last Signal is destroyed.
+ */
+struct sigaction oldActions[NSIG];
+
+/**
+ * Process-wide handler for signals handled with the EPOLL backend. This wakes
+ * up the event loops by writing to their Signals' eventfds, which is
+ * async-signal-safe.
+ */
+void
+onSignal(int signalNumber)
+{
+    int savedErrno = errno;
+    // This must be incremented before reading any slot, so that ~Signal()
+    // can't miss a handler that read its eventfd.
+    ++handlersRunning[signalNumber];
+    for (uint32_t i = 0; i < MAX_SIGNALS_PER_NUMBER; ++i) {
+        int fd = signalFdsPlusOne[signalNumber][i] - 1;
+        if (fd >= 0) {
+            uint64_t one = 1;
+            // Nothing useful can be done here if this fails.
+            ssize_t r = write(fd, &one, sizeof(one));
+            (void) r;
+        }
+    }
+    --handlersRunning[signalNumber];
+    errno = savedErrno;
+}
+
 } // anonymous namespace
 
+void
+Signal::onSignalFdReadable(uint32_t epollEvents, void* arg)
+{
+    Signal* signal = static_cast<Signal*>(arg);
+    uint64_t count;
+    ssize_t r = read(signal->signalFd, &count, sizeof(count));
+    if (r < 0 && errno == EAGAIN)
+        return;
+    if (r != sizeof(count))
+        PANIC("read from eventfd failed: %s", strerror(errno));
+    signal->handleSignalEvent();
+}
+
 Signal::Signal(Event::Loop& eventLoop, int signalNumber)
     : eventLoop(eventLoop)
     , event(NULL)
+    , signalNumber(signalNumber)
+    , signalFd(-1)
+    , epollId(0)
 {
+    if (eventLoop.epoll) {
+        if (signalNumber <= 0 || signalNumber >= NSIG)
+            PANIC("Invalid signal number %d", signalNumber);
+        signalFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (signalFd < 0)
+            PANIC("eventfd failed: %s", strerror(errno));
+        epollId = eventLoop.epoll->add(signalFd, onSignalFdReadable, this);
+        eventLoop.epoll->setEvents(epollId, EPOLLIN | EPOLLET);
+        std::lock_guard<std::mutex> lockGuard(installMutex);
+        uint32_t slot = 0;
+        while (slot < MAX_SIGNALS_PER_NUMBER &&
+               signalFdsPlusOne[signalNumber][slot] != 0) {
+            ++slot;
+        }
+        if (slot == MAX_SIGNALS_PER_NUMBER) {
+            PANIC("Too many Event::Signals for signal %d (limit is %u)",
+                  signalNumber, MAX_SIGNALS_PER_NUMBER);
+        }
+        signalFdsPlusOne[signalNumber][slot] = signalFd + 1;
+        if (numSignals[signalNumber]++ == 0) {
+            struct sigaction action;
+            memset(&action, 0, sizeof(action));
+            action.sa_handler = onSignal;
+            action.sa_flags = SA_RESTART;
+            sigemptyset(&action.sa_mask);
+            if (sigaction(signalNumber, &action,
+                          &oldActions[signalNumber]) != 0) {
+                PANIC("sigaction failed: %s", strerror(errno));
+            }
+        }
+        return;
+    }
     event = qualify(evsignal_new(unqualify(eventLoop.base),
                                  signalNumber,
                                  onSignalFired, this));
@@ -62,6 +184,29 @@ Signal::Signal(Event::Loop& eventLoop, int signalNumber)
 
 Signal::~Signal()
 {
+    if (eventLoop.epoll) {
+        {
+            std::lock_guard<std::mutex> lockGuard(installMutex);
+            if (--numSignals[signalNumber] == 0) {
+                if (sigaction(signalNumber, &oldActions[signalNumber],
+                              NULL) != 0) {
+                    PANIC("sigaction failed: %s", strerror(errno));
+                }
+            }
+            for (uint32_t i = 0; i < MAX_SIGNALS_PER_NUMBER; ++i) {
+                if (signalFdsPlusOne[signalNumber][i] == signalFd + 1)
+                    signalFdsPlusOne[signalNumber][i] = 0;
+            }
+        }
+        // A handler that started before the slot was cleared may still write
+        // to signalFd. Once none are running, later ones can't see it, so
+        // the fd may be closed (and its number reused) safely.
+        while (handlersRunning[signalNumber] != 0)
+            sched_yield();
+        eventLoop.epoll->remove(epollId);
+        ::close(signalFd);
+        return;
+    }
     event_free(unqualify(event));
 }
 
@@ -60,12 +60,34 @@ class Signal {
     Event::Loop& eventLoop;
 
   private:
+    /**
+     * Called by the Event::Loop's Epoll when #signalFd is readable.
+     */
+    static void onSignalFdReadable(uint32_t epollEvents, void* arg);
+
     /**
      * The signal event from libevent.
-     * This is never NULL.
+     * This is NULL if the Event::Loop uses the EPOLL backend.
      */
     LibEvent::event* event;
 
+    /**
+     * The signal number this object handles.
+     */
+    const int signalNumber;
+
+    /**
+     * An eventfd that the process-wide signal handler writes to when the
+     * signal arrives, if the Event::Loop uses the EPOLL backend; -1
+     * otherwise.
+     */
+    int signalFd;
+
+    /**
+     * Identifies #signalFd to the Event::Loop's Epoll.
+     */
+    uint32_t epollId;
+
     // Signal is not copyable.
     Signal(const Signal&) = delete;
     Signal& operator=(const Signal&) = delete;
@@ -65,6 +65,34 @@ TEST_F(EventSignalTest, fires) {
     EXPECT_EQ(1U, signal.triggerCount);
 }
 
+TEST_F(EventSignalTest, fires_epoll) {
+    Event::Loop epollLoop(Event::Loop::Backend::EPOLL);
+    ExitOnSigTerm signal(epollLoop);
+    EXPECT_TRUE(signal.event == NULL);
+    EXPECT_EQ(0, kill(getpid(), SIGTERM));
+    epollLoop.runForever();
+    EXPECT_EQ(1U, signal.triggerCount);
+}
+
+TEST_F(EventSignalTest, fires_epollTwoLoops) {
+    // Unlike libevent, every loop handling the signal sees it.
+    Event::Loop epollLoop1(Event::Loop::Backend::EPOLL);
+    Event::Loop epollLoop2(Event::Loop::Backend::EPOLL);
+    ExitOnSigTerm signal1(epollLoop1);
+    {
+        ExitOnSigTerm signal2(epollLoop2);
+        EXPECT_EQ(0, kill(getpid(), SIGTERM));
+        epollLoop1.runForever();
+        epollLoop2.runForever();
+        EXPECT_EQ(1U, signal1.triggerCount);
+        EXPECT_EQ(1U, signal2.triggerCount);
+    }
+    // still installed for signal1
+    EXPECT_EQ(0, kill(getpid(), SIGTERM));
+    epollLoop1.runForever();
+    EXPECT_EQ(2U, signal1.triggerCount);
+}
+
 } // namespace LogCabin::Event::<anonymous>
 } // namespace LogCabin::Event
 } // namespace LogCabin
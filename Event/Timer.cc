@@ -14,11 +14,17 @@
  */
 
 #include "Core/Debug.h"
+#include "Epoll.h"
 #include "Internal.h"
 #include "Loop.h"
 #include "Timer.h"
 
+#include <errno.h>
 #include <event2/event.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 
 namespace LogCabin {
 namespace Event {
@@ -42,10 +48,43 @@ onTimerFired(evutil_socket_t fd, short events, void* timer) // NOLINT
 
 } // anonymous namespace
 
+void
+Timer::onTimerFdReadable(uint32_t epollEvents, void* arg)
+{
+    Timer* timer = static_cast<Timer*>(arg);
+    {
+        std::lock_guard<std::mutex> lockGuard(timer->epollMutex);
+        uint64_t expirations;
+        ssize_t r = read(timer->timerFd, &expirations, sizeof(expirations));
+        if (r < 0 && errno == EAGAIN) {
+            // The timer was rescheduled or descheduled since it expired.
+            return;
+        }
+        if (r != sizeof(expirations))
+            PANIC("read from timerfd failed: %s", strerror(errno));
+        timer->scheduled = false;
+    }
+    timer->handleTimerEvent();
+}
+
 Timer::Timer(Event::Loop& eventLoop)
     : eventLoop(eventLoop)
     , event(NULL)
+    , timerFd(-1)
+    , epollId(0)
+    , epollMutex()
+    , scheduled(false)
 {
+    if (eventLoop.epoll) {
+        timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (timerFd < 0)
+            PANIC("timerfd_create failed: %s", strerror(errno));
+        epollId = eventLoop.epoll->add(timerFd, onTimerFdReadable, this);
+        // The callback reads the timerfd every time, so edge-triggered is
+        // enough.
+        eventLoop.epoll->setEvents(epollId, EPOLLIN | EPOLLET);
+        return;
+    }
     event = qualify(evtimer_new(unqualify(eventLoop.base),
                                 onTimerFired, this));
     if (event == NULL) {
@@ -56,6 +95,11 @@ Timer::Timer(Event::Loop& eventLoop)
 
 Timer::~Timer()
 {
+    if (eventLoop.epoll) {
+        eventLoop.epoll->remove(epollId);
+        ::close(timerFd);
+        return;
+    }
     event_free(unqualify(event));
 }
 
@@ -63,6 +107,20 @@ void
 Timer::schedule(uint64_t nanoseconds)
 {
     const uint64_t nanosPerSecond = 1000 * 1000 * 1000;
+    if (eventLoop.epoll) {
+        // A zero it_value would disarm the timer, so round up to 1ns.
+        if (nanoseconds == 0)
+            nanoseconds = 1;
+        struct itimerspec spec;
+        memset(&spec, 0, sizeof(spec));
+        spec.it_value.tv_sec  = nanoseconds / nanosPerSecond;
+        spec.it_value.tv_nsec = nanoseconds % nanosPerSecond;
+        std::lock_guard<std::mutex> lockGuard(epollMutex);
+        if (timerfd_settime(timerFd, 0, &spec, NULL) != 0)
+            PANIC("timerfd_settime failed: %s", strerror(errno));
+        scheduled = true;
+        return;
+    }
     struct timeval timeout;
     timeout.tv_sec  =  nanoseconds / nanosPerSecond;
     timeout.tv_usec = (nanoseconds % nanosPerSecond) / 1000;
@@ -76,6 +134,18 @@ Timer::schedule(uint64_t nanoseconds)
 void
 Timer::deschedule()
 {
+    if (eventLoop.epoll) {
+        {
+            struct itimerspec spec;
+            memset(&spec, 0, sizeof(spec));
+            std::lock_guard<std::mutex> lockGuard(epollMutex);
+            if (timerfd_settime(timerFd, 0, &spec, NULL) != 0)
+                PANIC("timerfd_settime failed: %s", strerror(errno));
+            scheduled = false;
+        }
+        eventLoop.epoll->waitForCallback(epollId);
+        return;
+    }
     int r = evtimer_del(unqualify(event));
     if (r == -1) {
         PANIC("evtimer_add failed: "
@@ -86,6 +156,10 @@ Timer::deschedule()
 bool
 Timer::isScheduled() const
 {
+    if (eventLoop.epoll) {
+        std::lock_guard<std::mutex> lockGuard(epollMutex);
+        return scheduled;
+    }
     return evtimer_pending(unqualify(event), NULL);
 }
 
@@ -16,6 +16,8 @@
 #ifndef LOGCABIN_EVENT_TIMER_H
 #define LOGCABIN_EVENT_TIMER_H
 
+#include <mutex>
+
 #include "Loop.h"
 
 namespace LogCabin {
@@ -28,6 +30,10 @@ namespace Event {
  *
  * Timers can be added and scheduled from any thread, but they will always fire
  * on the thread running the Event::Loop.
+ *
+ * With the EPOLL backend, each Timer holds a timerfd, and scheduling it is a
+ * system call. Use Event::CoarseTimer for large numbers of timeouts that are
+ * pushed back often.
  */
 class Timer {
   public:
@@ -92,12 +98,40 @@ class Timer {
     Event::Loop& eventLoop;
 
   private:
+    /**
+     * Called by the Event::Loop's Epoll when #timerFd is readable.
+     */
+    static void onTimerFdReadable(uint32_t epollEvents, void* arg);
+
     /**
      * The timer event from libevent.
-     * This is never NULL.
+     * This is NULL if the Event::Loop uses the EPOLL backend.
      */
     LibEvent::event* event;
 
+    /**
+     * A timerfd that becomes readable when the timer expires, if the
+     * Event::Loop uses the EPOLL backend; -1 otherwise.
+     */
+    int timerFd;
+
+    /**
+     * Identifies #timerFd to the Event::Loop's Epoll.
+     */
+    uint32_t epollId;
+
+    /**
+     * With the EPOLL backend, protects #scheduled and serializes setting
+     * #timerFd with reading it when it expires.
+     */
+    mutable std::mutex epollMutex;
+
+    /**
+     * With the EPOLL backend, true if #timerFd is armed and hasn't yet been
+     * read by the event loop.
+     */
+    bool scheduled;
+
     // Timer is not copyable.
     Timer(const Timer&) = delete;
     Timer& operator=(const Timer&) = delete;
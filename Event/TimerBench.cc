@@ -0,0 +1,96 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "bench/Bench.h"
+#include "Event/CoarseTimer.h"
+#include "Event/Loop.h"
+#include "Event/Timer.h"
+
+namespace LogCabin {
+namespace Event {
+namespace {
+
+/**
+ * How far out the timers are pushed back each time. This is far enough that
+ * they never fire during the benchmark.
+ */
+const uint64_t TIMEOUT_NANOS = 100UL * 1000 * 1000 * 1000;
+
+struct PreciseTimer : public Event::Timer {
+    explicit PreciseTimer(Event::Loop& loop) : Timer(loop) {}
+    void handleTimerEvent() {}
+};
+
+struct LooseTimer : public Event::CoarseTimer {
+    explicit LooseTimer(Event::Loop& loop) : CoarseTimer(loop) {}
+    void handleTimerEvent() {}
+};
+
+/**
+ * Reschedule 'numTimers' timers round-robin, the way sessions push their
+ * timeouts back on every response, with the event loop running on another
+ * thread.
+ */
+template<typename T>
+void
+reschedule(Bench::State& state, uint32_t numTimers,
+           Event::Loop::Backend backend = Event::Loop::Backend::LIBEVENT)
+{
+    state.pauseTiming();
+    Event::Loop loop(backend);
+    std::thread loopThread(&Event::Loop::runForever, &loop);
+    std::vector<std::unique_ptr<T>> timers;
+    for (uint32_t i = 0; i < numTimers; ++i) {
+        timers.emplace_back(new T(loop));
+        timers.back()->schedule(TIMEOUT_NANOS);
+    }
+    state.resumeTiming();
+    for (uint64_t i = 0; i < state.iterations; ++i)
+        timers.at(i % numTimers)->schedule(TIMEOUT_NANOS);
+    state.pauseTiming();
+    for (uint32_t i = 0; i < numTimers; ++i)
+        timers.at(i)->deschedule();
+    loop.exit();
+    loopThread.join();
+    timers.clear();
+}
+
+BENCHMARK(EventTimer, reschedule1) {
+    reschedule<PreciseTimer>(state, 1);
+}
+
+BENCHMARK(EventTimer, reschedule10000) {
+    reschedule<PreciseTimer>(state, 10000);
+}
+
+BENCHMARK(EventTimer, reschedule1_epoll) {
+    reschedule<PreciseTimer>(state, 1, Event::Loop::Backend::EPOLL);
+}
+
+BENCHMARK(EventCoarseTimer, reschedule1) {
+    reschedule<LooseTimer>(state, 1);
+}
+
+BENCHMARK(EventCoarseTimer, reschedule10000) {
+    reschedule<LooseTimer>(state, 10000);
+}
+
+} // namespace LogCabin::Event::<anonymous>
+} // namespace LogCabin::Event
+} // namespace LogCabin
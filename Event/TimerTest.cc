@@ -16,7 +16,10 @@
 #include <event2/event.h>
 #include <gtest/gtest.h>
 #include <sys/time.h>
+#include <thread>
+#include <unistd.h>
 
+#include "Epoll.h"
 #include "Internal.h"
 #include "Timer.h"
 
@@ -28,14 +31,17 @@ struct MyTimer : public Event::Timer {
     explicit MyTimer(Event::Loop& loop)
         : Timer(loop)
         , triggerCount(0)
+        , sleepMs(0)
     {
     }
     void handleTimerEvent() {
         EXPECT_FALSE(isScheduled());
+        usleep(sleepMs * 1000);
         ++triggerCount;
         eventLoop.exit();
     }
     uint32_t triggerCount;
+    uint32_t sleepMs;
 };
 
 struct EventTimerTest : public ::testing::Test {
@@ -101,6 +107,71 @@ TEST_F(EventTimerTest, isScheduled) {
     // Tested sufficiently in schedule, deschedule tests.
 }
 
+struct EventTimerEpollTest : public ::testing::Test {
+    EventTimerEpollTest()
+        : loop(Event::Loop::Backend::EPOLL)
+        , timer1(loop)
+    {
+    }
+    Event::Loop loop;
+    MyTimer timer1;
+};
+
+TEST_F(EventTimerEpollTest, constructor) {
+    EXPECT_TRUE(timer1.event == NULL);
+    EXPECT_LE(0, timer1.timerFd);
+    EXPECT_FALSE(timer1.isScheduled());
+}
+
+TEST_F(EventTimerEpollTest, schedule_immediate) {
+    timer1.schedule(0);
+    EXPECT_TRUE(timer1.isScheduled());
+    loop.runForever();
+    EXPECT_EQ(1U, timer1.triggerCount);
+    EXPECT_FALSE(timer1.isScheduled());
+}
+
+TEST_F(EventTimerEpollTest, schedule_reschedule) {
+    timer1.schedule(0);
+    usleep(1000);
+    // the expiry that hasn't been handled yet is forgotten
+    timer1.schedule(1000 * 1000 * 1000);
+    MyTimer timer2(loop);
+    timer2.schedule(5 * 1000 * 1000);
+    loop.runForever();
+    EXPECT_EQ(0U, timer1.triggerCount);
+    EXPECT_EQ(1U, timer2.triggerCount);
+    EXPECT_TRUE(timer1.isScheduled());
+}
+
+TEST_F(EventTimerEpollTest, deschedule) {
+    timer1.schedule(0);
+    usleep(1000);
+    timer1.deschedule();
+    EXPECT_FALSE(timer1.isScheduled());
+    MyTimer timer2(loop);
+    timer2.schedule(10);
+    loop.runForever();
+    EXPECT_EQ(0U, timer1.triggerCount);
+    EXPECT_EQ(1U, timer2.triggerCount);
+}
+
+TEST_F(EventTimerEpollTest, deschedule_waitsForHandler) {
+    timer1.sleepMs = 20;
+    timer1.schedule(0);
+    std::thread thread(&Event::Loop::runForever, &loop);
+    while (true) {
+        std::unique_lock<Core::Mutex> lockGuard(loop.epoll->mutex);
+        if (loop.epoll->running == timer1.epollId)
+            break;
+        lockGuard.unlock();
+        usleep(100);
+    }
+    timer1.deschedule();
+    EXPECT_EQ(1U, timer1.triggerCount);
+    thread.join();
+}
+
 } // namespace LogCabin::Event::<anonymous>
 } // namespace LogCabin::Event
 } // namespace LogCabin
@@ -0,0 +1,289 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <algorithm>
+
+#include "Core/Debug.h"
+#include "Core/ThreadId.h"
+#include "Event/CoarseTimer.h"
+#include "Event/TimerWheel.h"
+
+namespace LogCabin {
+namespace Event {
+
+namespace {
+
+/**
+ * Mask for the slot index within a level.
+ */
+const uint64_t SLOT_MASK = TimerWheel::NUM_SLOTS - 1;
+
+/**
+ * The number of ticks that the wheel spans.
+ */
+const uint64_t WHEEL_TICKS =
+    1UL << (TimerWheel::SLOT_BITS * TimerWheel::NUM_LEVELS);
+
+/**
+ * Timers are never scheduled further out than this many nanoseconds, which
+ * keeps the tick arithmetic from overflowing. That's about 146 years.
+ */
+const uint64_t MAX_NANOS = 1UL << 62;
+
+/**
+ * Value of TimerWheel::wakeUpTick when the driver isn't scheduled.
+ */
+const uint64_t NOT_WAKING = ~0UL;
+
+} // anonymous namespace
+
+////////// TimerWheel::Link //////////
+
+TimerWheel::Link::Link()
+    : prev(this)
+    , next(this)
+    , timer(NULL)
+{
+}
+
+TimerWheel::Link::Link(CoarseTimer* timer)
+    : prev(NULL)
+    , next(NULL)
+    , timer(timer)
+{
+}
+
+////////// TimerWheel::Driver //////////
+
+TimerWheel::Driver::Driver(Event::Loop& eventLoop, TimerWheel& wheel)
+    : Timer(eventLoop)
+    , wheel(wheel)
+{
+}
+
+void
+TimerWheel::Driver::handleTimerEvent()
+{
+    wheel.advance();
+}
+
+////////// TimerWheel //////////
+
+const uint64_t TimerWheel::TICK_NANOS;
+
+TimerWheel::TimerWheel(Event::Loop& eventLoop)
+    : mutex("Event::TimerWheel::mutex")
+    , start(Clock::now())
+    , nextTick(0)
+    , numScheduled(0)
+    , wakeUpTick(NOT_WAKING)
+    , firing(NULL)
+    , firingThread(Core::ThreadId::NONE)
+    , firingDone()
+    , slots()
+    , driver(eventLoop, *this)
+{
+}
+
+TimerWheel::~TimerWheel()
+{
+    if (numScheduled > 0) {
+        PANIC("Destroying TimerWheel with %lu timers still scheduled",
+              numScheduled);
+    }
+}
+
+void
+TimerWheel::schedule(CoarseTimer& timer, uint64_t nanoseconds)
+{
+    nanoseconds = std::min(nanoseconds, MAX_NANOS);
+    TimePoint now = Clock::now();
+    uint64_t elapsed = 0;
+    if (now > start) {
+        elapsed = uint64_t(std::chrono::duration_cast<
+                               std::chrono::nanoseconds>(now - start).count());
+    }
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
+    unlink(timer);
+    timer.expiry = (elapsed + nanoseconds + TICK_NANOS - 1) / TICK_NANOS;
+    insert(timer);
+    uint64_t due = std::max(timer.expiry, nextTick);
+    if (due < wakeUpTick)
+        wakeUpAt(due);
+}
+
+void
+TimerWheel::deschedule(CoarseTimer& timer)
+{
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
+    unlink(timer);
+    if (firing == &timer && firingThread != Core::ThreadId::getId()) {
+        while (firing == &timer)
+            firingDone.wait(lockGuard);
+        // The handler may have rescheduled the timer.
+        unlink(timer);
+    }
+}
+
+bool
+TimerWheel::isScheduled(const CoarseTimer& timer) const
+{
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
+    return timer.link.next != NULL;
+}
+
+uint64_t
+TimerWheel::getTick(TimePoint time) const
+{
+    if (time <= start)
+        return 0;
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        time - start).count()) / TICK_NANOS;
+}
+
+void
+TimerWheel::advance()
+{
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
+    wakeUpTick = 0;
+    uint64_t now = getTick(Clock::now());
+    while (nextTick <= now) {
+        if (numScheduled == 0) {
+            // Nothing can be due, so skip ahead.
+            nextTick = now + 1;
+            break;
+        }
+        uint64_t tick = nextTick;
+        // Each time a level wraps around, move the timers in the next slot
+        // of the level above it down.
+        for (uint32_t level = 1; level < NUM_LEVELS; ++level) {
+            uint64_t shifted = tick >> (SLOT_BITS * (level - 1));
+            if ((shifted & SLOT_MASK) != 0)
+                break;
+            cascade(level,
+                    uint32_t((tick >> (SLOT_BITS * level)) & SLOT_MASK));
+        }
+        Link& slot = slots[0][tick & SLOT_MASK];
+        while (slot.next != &slot) {
+            CoarseTimer& timer = *slot.next->timer;
+            unlink(timer);
+            if (timer.expiry > tick) {
+                // This was clamped to the end of the wheel.
+                insert(timer);
+                continue;
+            }
+            firing = &timer;
+            firingThread = Core::ThreadId::getId();
+            lockGuard.unlock();
+            timer.handleTimerEvent();
+            lockGuard.lock();
+            firing = NULL;
+            firingDone.notify_all();
+        }
+        ++nextTick;
+    }
+
+    wakeUpTick = NOT_WAKING;
+    if (numScheduled == 0)
+        return;
+    // Wake up for the next non-empty slot on the lowest level, or to cascade
+    // once the lowest level wraps around, whichever comes first.
+    uint64_t wakeUp = nextTick;
+    if ((wakeUp & SLOT_MASK) != 0) {
+        uint64_t wrap = (nextTick | SLOT_MASK) + 1;
+        while (wakeUp < wrap) {
+            const Link& slot = slots[0][wakeUp & SLOT_MASK];
+            if (slot.next != &slot)
+                break;
+            ++wakeUp;
+        }
+    }
+    wakeUpAt(wakeUp);
+}
+
+void
+TimerWheel::insert(CoarseTimer& timer)
+{
+    uint64_t expiry = std::max(timer.expiry, nextTick);
+    uint64_t delta = expiry - nextTick;
+    if (delta >= WHEEL_TICKS) {
+        expiry = nextTick + WHEEL_TICKS - 1;
+        delta = WHEEL_TICKS - 1;
+    }
+    uint32_t level = 0;
+    while (level < NUM_LEVELS - 1 &&
+           delta >= (1UL << (SLOT_BITS * (level + 1)))) {
+        ++level;
+    }
+    Link& slot = slots[level][(expiry >> (SLOT_BITS * level)) & SLOT_MASK];
+    Link& link = timer.link;
+    link.prev = slot.prev;
+    link.next = &slot;
+    slot.prev->next = &link;
+    slot.prev = &link;
+    ++numScheduled;
+}
+
+void
+TimerWheel::unlink(CoarseTimer& timer)
+{
+    Link& link = timer.link;
+    if (link.next == NULL)
+        return;
+    link.prev->next = link.next;
+    link.next->prev = link.prev;
+    link.prev = NULL;
+    link.next = NULL;
+    --numScheduled;
+}
+
+void
+TimerWheel::cascade(uint32_t level, uint32_t slot)
+{
+    // Detach the whole list first, since insert() may put timers back on
+    // this same slot (if they were clamped to the end of the wheel).
+    Link& head = slots[level][slot];
+    if (head.next == &head)
+        return;
+    Link* link = head.next;
+    head.prev->next = NULL;
+    head.prev = &head;
+    head.next = &head;
+    while (link != NULL) {
+        Link* next = link->next;
+        link->prev = NULL;
+        link->next = NULL;
+        --numScheduled;
+        insert(*link->timer);
+        link = next;
+    }
+}
+
+void
+TimerWheel::wakeUpAt(uint64_t tick)
+{
+    wakeUpTick = tick;
+    TimePoint when = start + std::chrono::nanoseconds(tick * TICK_NANOS);
+    TimePoint now = Clock::now();
+    uint64_t nanos = 0;
+    if (when > now) {
+        nanos = uint64_t(std::chrono::duration_cast<
+                             std::chrono::nanoseconds>(when - now).count());
+    }
+    driver.schedule(nanos);
+}
+
+} // namespace LogCabin::Event
+} // namespace LogCabin
@@ -0,0 +1,239 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cinttypes>
+
+#include "Core/ConditionVariable.h"
+#include "Core/Mutex.h"
+#include "Core/Time.h"
+#include "Event/Timer.h"
+
+#ifndef LOGCABIN_EVENT_TIMERWHEEL_H
+#define LOGCABIN_EVENT_TIMERWHEEL_H
+
+namespace LogCabin {
+namespace Event {
+
+// forward declarations
+class CoarseTimer;
+class Loop;
+
+/**
+ * A hierarchical timing wheel that keeps track of the CoarseTimer objects of
+ * one Event::Loop. Each Loop owns one of these; it's created along with the
+ * Loop and should not be used directly.
+ *
+ * Time is divided into ticks of TICK_NANOS. Timers due within the next
+ * NUM_SLOTS ticks sit in the slot for their tick on the lowest level; timers
+ * further out sit on a higher level, where each slot covers NUM_SLOTS times
+ * as many ticks as a slot on the level below. Whenever the lowest level wraps
+ * around, the timers in the next slot of the level above are redistributed
+ * ("cascaded") to the lower levels. Each slot is an intrusive doubly-linked
+ * list, so scheduling and descheduling a timer take constant time and don't
+ * allocate memory. They only need #mutex, not an Event::Loop::Lock or
+ * libevent's own lock, except in the uncommon case that the timer becomes
+ * due before the wheel's next wake-up.
+ *
+ * The wheel itself is driven by a single Event::Timer, which only runs while
+ * timers are scheduled, and then at most once per tick.
+ */
+class TimerWheel {
+  public:
+    typedef Core::Time::SteadyClock Clock;
+    typedef Clock::time_point TimePoint;
+
+    /**
+     * The granularity of the wheel, in nanoseconds. Timers fire on the first
+     * tick at or after they're due, so they may fire up to this much late.
+     */
+    static const uint64_t TICK_NANOS = 1000 * 1000;
+
+    /**
+     * Log base 2 of the number of slots in each level.
+     */
+    enum { SLOT_BITS = 6 };
+
+    /**
+     * The number of slots in each level.
+     */
+    enum { NUM_SLOTS = 1 << SLOT_BITS };
+
+    /**
+     * The number of levels. The wheel spans NUM_SLOTS^NUM_LEVELS ticks, about
+     * 4.7 hours; timers that are due later than that are placed in the last
+     * slot that the wheel spans and put back in once they get there.
+     */
+    enum { NUM_LEVELS = 4 };
+
+    /**
+     * An entry in one of the wheel's slots. The slots themselves are circular
+     * lists headed by a Link whose #timer is NULL.
+     */
+    struct Link {
+        /// Constructor for an empty list head.
+        Link();
+        /**
+         * Constructor for a timer's entry, which starts out on no list.
+         * \param timer
+         *      The timer this link belongs to.
+         */
+        explicit Link(CoarseTimer* timer);
+        /// The previous entry on the list, or NULL if not on a list.
+        Link* prev;
+        /// The next entry on the list, or NULL if not on a list.
+        Link* next;
+        /// The timer this link belongs to, or NULL for a list head.
+        CoarseTimer* const timer;
+    };
+
+    /**
+     * Constructor.
+     * \param eventLoop
+     *      Event::Loop that will drive the wheel.
+     */
+    explicit TimerWheel(Event::Loop& eventLoop);
+
+    /**
+     * Destructor. No CoarseTimers may be scheduled.
+     */
+    ~TimerWheel();
+
+    /**
+     * See CoarseTimer::schedule().
+     */
+    void schedule(CoarseTimer& timer, uint64_t nanoseconds);
+
+    /**
+     * See CoarseTimer::deschedule().
+     */
+    void deschedule(CoarseTimer& timer);
+
+    /**
+     * See CoarseTimer::isScheduled().
+     */
+    bool isScheduled(const CoarseTimer& timer) const;
+
+  private:
+    /**
+     * The Event::Timer that calls advance().
+     */
+    class Driver : public Event::Timer {
+      public:
+        Driver(Event::Loop& eventLoop, TimerWheel& wheel);
+        void handleTimerEvent();
+        TimerWheel& wheel;
+    };
+
+    /**
+     * Return the number of whole ticks from #start to 'time'.
+     */
+    uint64_t getTick(TimePoint time) const;
+
+    /**
+     * Fire every timer that's due, then arrange for the next call.
+     * Called by #driver on the event loop thread.
+     */
+    void advance();
+
+    /**
+     * Put a timer on the slot for its CoarseTimer::expiry. This is relative
+     * to #nextTick: timers that are already due go on the slot for
+     * #nextTick. Must be called holding #mutex, with the timer unlinked.
+     */
+    void insert(CoarseTimer& timer);
+
+    /**
+     * Take a timer off of its slot, if it's on one.
+     * Must be called holding #mutex.
+     */
+    void unlink(CoarseTimer& timer);
+
+    /**
+     * Re-insert all of the timers in the given slot, moving them down to
+     * lower levels. Must be called holding #mutex.
+     */
+    void cascade(uint32_t level, uint32_t slot);
+
+    /**
+     * Schedule #driver to call advance() at the start of the given tick.
+     * Must be called holding #mutex.
+     */
+    void wakeUpAt(uint64_t tick);
+
+    /**
+     * Protects all of the members of this class defined below this point,
+     * as well as the CoarseTimer::link and CoarseTimer::expiry fields of
+     * every CoarseTimer using this wheel.
+     */
+    mutable Core::Mutex mutex;
+
+    /**
+     * Tick 0 starts here.
+     */
+    const TimePoint start;
+
+    /**
+     * The next tick for advance() to process. All earlier ticks' timers have
+     * been fired.
+     */
+    uint64_t nextTick;
+
+    /**
+     * The number of timers currently on the wheel.
+     */
+    uint64_t numScheduled;
+
+    /**
+     * The tick at which #driver will next call advance(), or ~0UL if it
+     * won't. schedule() only needs to wake up the driver for timers due
+     * before this. This is 0 while advance() is running, since it checks
+     * for the next wake-up before it returns.
+     */
+    uint64_t wakeUpTick;
+
+    /**
+     * The timer whose handleTimerEvent() advance() is calling, or NULL.
+     */
+    CoarseTimer* firing;
+
+    /**
+     * The ID of the thread calling #firing's handler, if #firing is set.
+     */
+    uint64_t firingThread;
+
+    /**
+     * Notified when #firing's handler returns.
+     */
+    Core::ConditionVariable firingDone;
+
+    /**
+     * The heads of each slot's list, by level and slot.
+     */
+    Link slots[NUM_LEVELS][NUM_SLOTS];
+
+    /**
+     * Calls advance() when timers may be due.
+     */
+    Driver driver;
+
+    // TimerWheel is not copyable.
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+}; // class TimerWheel
+
+} // namespace LogCabin::Event
+} // namespace LogCabin
+
+#endif /* LOGCABIN_EVENT_TIMERWHEEL_H */
@@ -0,0 +1,256 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "Event/CoarseTimer.h"
+#include "Event/Loop.h"
+#include "Event/TimerWheel.h"
+
+namespace LogCabin {
+namespace Event {
+namespace {
+
+typedef TimerWheel::Clock Clock;
+const uint64_t MS = 1000 * 1000;
+
+struct MyTimer : public Event::CoarseTimer {
+    MyTimer(Event::Loop& loop, std::vector<MyTimer*>& fired)
+        : CoarseTimer(loop)
+        , fired(fired)
+        , rescheduleNanos(0)
+    {
+    }
+    void handleTimerEvent() {
+        fired.push_back(this);
+        if (rescheduleNanos > 0)
+            schedule(rescheduleNanos);
+    }
+    std::vector<MyTimer*>& fired;
+    uint64_t rescheduleNanos;
+};
+
+class EventTimerWheelTest : public ::testing::Test {
+  public:
+    EventTimerWheelTest()
+        : loop()
+        , wheel(*loop.timerWheel)
+        , fired()
+        , timer1(loop, fired)
+        , timer2(loop, fired)
+        , timer3(loop, fired)
+    {
+        Clock::useMockValue = true;
+        Clock::mockValue = wheel.start;
+    }
+    ~EventTimerWheelTest()
+    {
+        Clock::useMockValue = false;
+    }
+
+    /// Set the mock clock to the start of the given tick.
+    void setTick(uint64_t tick) {
+        Clock::mockValue = wheel.start +
+            std::chrono::nanoseconds(tick * TimerWheel::TICK_NANOS);
+    }
+
+    /// Return true if the timer is on the given slot.
+    bool isOnSlot(const MyTimer& timer, uint32_t level, uint32_t slot) {
+        const TimerWheel::Link& head = wheel.slots[level][slot];
+        for (const TimerWheel::Link* link = head.next;
+             link != &head;
+             link = link->next) {
+            if (link == &timer.link)
+                return true;
+        }
+        return false;
+    }
+
+    Event::Loop loop;
+    TimerWheel& wheel;
+    std::vector<MyTimer*> fired;
+    MyTimer timer1;
+    MyTimer timer2;
+    MyTimer timer3;
+};
+
+TEST_F(EventTimerWheelTest, schedule) {
+    timer1.schedule(10 * MS);
+    EXPECT_EQ(10U, timer1.expiry);
+    EXPECT_TRUE(isOnSlot(timer1, 0, 10));
+    EXPECT_EQ(10U, wheel.wakeUpTick);
+    // rounds up to the next tick
+    timer2.schedule(5 * MS + 1);
+    EXPECT_EQ(6U, timer2.expiry);
+    EXPECT_EQ(6U, wheel.wakeUpTick);
+    // doesn't need to wake up the driver any sooner
+    timer3.schedule(20 * MS);
+    EXPECT_EQ(6U, wheel.wakeUpTick);
+    EXPECT_EQ(3U, wheel.numScheduled);
+    // rescheduling replaces the old time
+    timer1.schedule(30 * MS);
+    EXPECT_FALSE(isOnSlot(timer1, 0, 10));
+    EXPECT_TRUE(isOnSlot(timer1, 0, 30));
+    EXPECT_EQ(3U, wheel.numScheduled);
+}
+
+TEST_F(EventTimerWheelTest, schedule_relativeToNow) {
+    setTick(100);
+    wheel.nextTick = 101;
+    timer1.schedule(0);
+    EXPECT_EQ(100U, timer1.expiry);
+    // already due, so it goes in the next slot to be processed
+    EXPECT_TRUE(isOnSlot(timer1, 0, 101 % 64));
+    EXPECT_EQ(101U, wheel.wakeUpTick);
+}
+
+TEST_F(EventTimerWheelTest, deschedule) {
+    timer1.schedule(10 * MS);
+    timer2.schedule(10 * MS);
+    timer1.deschedule();
+    EXPECT_FALSE(timer1.isScheduled());
+    EXPECT_TRUE(timer2.isScheduled());
+    EXPECT_TRUE(isOnSlot(timer2, 0, 10));
+    EXPECT_EQ(1U, wheel.numScheduled);
+    timer1.deschedule();
+    EXPECT_EQ(1U, wheel.numScheduled);
+}
+
+TEST_F(EventTimerWheelTest, isScheduled) {
+    EXPECT_FALSE(timer1.isScheduled());
+    timer1.schedule(0);
+    EXPECT_TRUE(timer1.isScheduled());
+}
+
+TEST_F(EventTimerWheelTest, getTick) {
+    EXPECT_EQ(0U, wheel.getTick(wheel.start - std::chrono::seconds(1)));
+    EXPECT_EQ(0U, wheel.getTick(wheel.start));
+    EXPECT_EQ(0U, wheel.getTick(wheel.start + std::chrono::nanoseconds(
+                                    TimerWheel::TICK_NANOS - 1)));
+    EXPECT_EQ(3U, wheel.getTick(wheel.start + std::chrono::nanoseconds(
+                                    3 * TimerWheel::TICK_NANOS)));
+}
+
+TEST_F(EventTimerWheelTest, advance) {
+    timer1.schedule(3 * MS);
+    timer2.schedule(1 * MS);
+    timer3.schedule(3 * MS);
+    setTick(2);
+    wheel.advance();
+    ASSERT_EQ(1U, fired.size());
+    EXPECT_EQ(&timer2, fired.at(0));
+    EXPECT_EQ(3U, wheel.nextTick);
+    EXPECT_EQ(3U, wheel.wakeUpTick);
+    setTick(3);
+    wheel.advance();
+    ASSERT_EQ(3U, fired.size());
+    EXPECT_EQ(&timer1, fired.at(1));
+    EXPECT_EQ(&timer3, fired.at(2));
+    EXPECT_EQ(0U, wheel.numScheduled);
+    EXPECT_EQ(~0UL, wheel.wakeUpTick);
+}
+
+TEST_F(EventTimerWheelTest, advance_idle) {
+    setTick(1000);
+    wheel.advance();
+    EXPECT_EQ(1001U, wheel.nextTick);
+    EXPECT_EQ(~0UL, wheel.wakeUpTick);
+}
+
+TEST_F(EventTimerWheelTest, advance_reschedule) {
+    timer1.rescheduleNanos = 5 * MS;
+    timer1.schedule(1 * MS);
+    setTick(1);
+    wheel.advance();
+    EXPECT_EQ(1U, fired.size());
+    EXPECT_TRUE(timer1.isScheduled());
+    EXPECT_EQ(6U, timer1.expiry);
+    EXPECT_EQ(6U, wheel.wakeUpTick);
+}
+
+TEST_F(EventTimerWheelTest, advance_cascade) {
+    timer1.schedule(100 * MS);
+    // on the second level, which cascades at tick 64
+    EXPECT_TRUE(isOnSlot(timer1, 1, 1));
+    EXPECT_EQ(100U, wheel.wakeUpTick);
+    setTick(64);
+    wheel.advance();
+    EXPECT_TRUE(fired.empty());
+    EXPECT_TRUE(isOnSlot(timer1, 0, 100 % 64));
+    EXPECT_EQ(100U, wheel.wakeUpTick);
+    setTick(100);
+    wheel.advance();
+    EXPECT_EQ(1U, fired.size());
+}
+
+TEST_F(EventTimerWheelTest, advance_cascadeAllLevels) {
+    // Fire timers at a range of distances, going through the wheel one
+    // wake-up at a time, and check they fire on time and in order.
+    uint64_t expiries[] = { 4095, 4096, 300000 };
+    MyTimer* timers[] = { &timer1, &timer2, &timer3 };
+    for (uint32_t i = 0; i < 3; ++i)
+        timers[i]->schedule(expiries[i] * MS);
+    EXPECT_TRUE(isOnSlot(timer1, 1, 63));
+    EXPECT_TRUE(isOnSlot(timer2, 2, 1));
+    EXPECT_TRUE(isOnSlot(timer3, 3, 1));
+    uint32_t wakeUps = 0;
+    while (wheel.wakeUpTick != ~0UL) {
+        uint64_t tick = wheel.wakeUpTick;
+        setTick(tick);
+        size_t before = fired.size();
+        wheel.advance();
+        if (fired.size() > before) {
+            EXPECT_EQ(expiries[before], tick);
+        }
+        ++wakeUps;
+    }
+    ASSERT_EQ(3U, fired.size());
+    EXPECT_EQ(&timer1, fired.at(0));
+    EXPECT_EQ(&timer2, fired.at(1));
+    EXPECT_EQ(&timer3, fired.at(2));
+    // about one wake-up per 64 ticks, not one per tick
+    EXPECT_GT(300000U / 32, wakeUps);
+}
+
+TEST_F(EventTimerWheelTest, advance_late) {
+    timer1.schedule(10 * MS);
+    timer2.schedule(200 * MS);
+    setTick(500);
+    wheel.advance();
+    ASSERT_EQ(2U, fired.size());
+    EXPECT_EQ(&timer1, fired.at(0));
+    EXPECT_EQ(&timer2, fired.at(1));
+    EXPECT_EQ(501U, wheel.nextTick);
+}
+
+TEST_F(EventTimerWheelTest, insert_clamped) {
+    // further out than the wheel spans
+    uint64_t wheelTicks = 1UL << 24;
+    timer1.schedule(2 * wheelTicks * MS);
+    EXPECT_EQ(2 * wheelTicks, timer1.expiry);
+    EXPECT_TRUE(isOnSlot(timer1, 3, 63));
+    setTick(wheelTicks);
+    wheel.advance();
+    EXPECT_TRUE(fired.empty());
+    EXPECT_TRUE(timer1.isScheduled());
+    setTick(2 * wheelTicks);
+    wheel.advance();
+    EXPECT_EQ(1U, fired.size());
+}
+
+} // namespace LogCabin::Event::<anonymous>
+} // namespace LogCabin::Event
+} // namespace LogCabin
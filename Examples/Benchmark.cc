@@ -0,0 +1,542 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * A load generator that measures the throughput and latency of a LogCabin
+ * cluster.
+ *
+ * Worker threads issue a configurable mix of append, read, and getLastId
+ * operations, spread over one or more logs and one or more client sessions.
+ * The benchmark runs in one of two modes:
+ *  - Closed loop (the default): each thread issues its next operation as soon
+ *    as the previous one completes, so the offered load is limited by the
+ *    number of threads.
+ *  - Open loop (--rate): operations are scheduled at a fixed aggregate
+ *    arrival rate. Latency is measured from when each operation was scheduled
+ *    to start, not from when it actually started, so that a slow cluster
+ *    cannot hide its queueing delay by slowing down the benchmark (this is
+ *    known as coordinated omission).
+ *
+ * Throughput and latency percentiles are printed once per reporting interval
+ * and again for the whole run at the end.
+ */
+
+#include <getopt.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Client/Client.h"
+#include "Core/StringUtil.h"
+#include "Core/Time.h"
+
+namespace {
+
+using LogCabin::Client::Cluster;
+using LogCabin::Client::Entry;
+using LogCabin::Client::EntryId;
+using LogCabin::Client::Log;
+using LogCabin::Client::NO_ID;
+using LogCabin::Core::StringUtil::format;
+using LogCabin::Core::StringUtil::split;
+typedef LogCabin::Core::Time::SteadyClock Clock;
+typedef Clock::time_point TimePoint;
+
+/**
+ * The kinds of operations the benchmark issues.
+ */
+enum Op {
+    APPEND = 0,
+    READ = 1,
+    GET_LAST_ID = 2,
+    NUM_OPS = 3,
+};
+
+const char* opNames[NUM_OPS] = { "append", "read", "getLastId" };
+
+/**
+ * Parses argv for the main function.
+ */
+class OptionParser {
+  public:
+    OptionParser(int& argc, char**& argv)
+        : argc(argc)
+        , argv(argv)
+        , cluster("logcabin:61023")
+        , numThreads(4)
+        , numSessions(1)
+        , numLogs(1)
+        , rate(0)
+        , durationSecs(10)
+        , intervalSecs(1)
+        , mix()
+        , minSize(1024)
+        , maxSize(1024)
+        , conditionalPercent(0)
+    {
+        mix[APPEND] = 100;
+        mix[READ] = 0;
+        mix[GET_LAST_ID] = 0;
+        while (true) {
+            static struct option longOptions[] = {
+               {"cluster",  required_argument, NULL, 'c'},
+               {"conditional",  required_argument, NULL, 'C'},
+               {"duration",  required_argument, NULL, 'd'},
+               {"help",  no_argument, NULL, 'h'},
+               {"interval",  required_argument, NULL, 'i'},
+               {"logs",  required_argument, NULL, 'l'},
+               {"mix",  required_argument, NULL, 'm'},
+               {"rate",  required_argument, NULL, 'r'},
+               {"sessions",  required_argument, NULL, 's'},
+               {"threads",  required_argument, NULL, 't'},
+               {"size",  required_argument, NULL, 'z'},
+               {0, 0, 0, 0}
+            };
+            int c = getopt_long(argc, argv, "c:C:d:hi:l:m:r:s:t:z:",
+                                longOptions, NULL);
+
+            // Detect the end of the options.
+            if (c == -1)
+                break;
+
+            switch (c) {
+                case 'c':
+                    cluster = optarg;
+                    break;
+                case 'C':
+                    conditionalPercent = uint32_t(atol(optarg));
+                    break;
+                case 'd':
+                    durationSecs = uint32_t(atol(optarg));
+                    break;
+                case 'h':
+                    usage();
+                    exit(0);
+                case 'i':
+                    intervalSecs = uint32_t(atol(optarg));
+                    break;
+                case 'l':
+                    numLogs = uint32_t(atol(optarg));
+                    break;
+                case 'm': {
+                    std::vector<std::string> weights = split(optarg, ':');
+                    if (weights.size() != NUM_OPS) {
+                        usage();
+                        exit(1);
+                    }
+                    for (uint32_t i = 0; i < NUM_OPS; ++i)
+                        mix[i] = uint32_t(atol(weights.at(i).c_str()));
+                    break;
+                }
+                case 'r':
+                    rate = strtod(optarg, NULL);
+                    break;
+                case 's':
+                    numSessions = uint32_t(atol(optarg));
+                    break;
+                case 't':
+                    numThreads = uint32_t(atol(optarg));
+                    break;
+                case 'z': {
+                    std::vector<std::string> sizes = split(optarg, ':');
+                    if (sizes.empty() || sizes.size() > 2) {
+                        usage();
+                        exit(1);
+                    }
+                    minSize = uint32_t(atol(sizes.at(0).c_str()));
+                    maxSize = uint32_t(atol(sizes.back().c_str()));
+                    break;
+                }
+                case '?':
+                default:
+                    // getopt_long already printed an error message.
+                    usage();
+                    exit(1);
+            }
+        }
+
+        // We don't expect any additional command line arguments (not options).
+        if (optind != argc) {
+            usage();
+            exit(1);
+        }
+        if (numThreads == 0 || numSessions == 0 || numLogs == 0 ||
+            intervalSecs == 0 || minSize > maxSize ||
+            conditionalPercent > 100 ||
+            mix[APPEND] + mix[READ] + mix[GET_LAST_ID] == 0) {
+            usage();
+            exit(1);
+        }
+    }
+
+    void usage() {
+        std::cout << "Usage: " << argv[0] << " [options]" << std::endl;
+        std::cout << "Options: " << std::endl;
+        std::cout << "  -h, --help               "
+                  << "Print this usage information" << std::endl;
+        std::cout << "  -c, --cluster <hosts>    "
+                  << "Connect to the cluster at <hosts> "
+                  << "(default: logcabin:61023)" << std::endl;
+        std::cout << "  -t, --threads <n>        "
+                  << "Issue operations from <n> threads (default: 4)"
+                  << std::endl;
+        std::cout << "  -s, --sessions <n>       "
+                  << "Spread the threads over <n> client sessions "
+                  << "(default: 1)" << std::endl;
+        std::cout << "  -l, --logs <n>           "
+                  << "Spread the operations over <n> logs (default: 1)"
+                  << std::endl;
+        std::cout << "  -m, --mix <a:r:g>        "
+                  << "Relative weights of append, read, and getLastId "
+                  << "operations (default: 100:0:0)" << std::endl;
+        std::cout << "  -z, --size <min[:max]>   "
+                  << "Append entries of <min> to <max> bytes "
+                  << "(default: 1024)" << std::endl;
+        std::cout << "  -C, --conditional <pct>  "
+                  << "Make <pct> percent of appends conditional on the "
+                  << "last ID seen (default: 0)" << std::endl;
+        std::cout << "  -r, --rate <ops/s>       "
+                  << "Run open loop at this aggregate arrival rate "
+                  << "(default: 0, closed loop)" << std::endl;
+        std::cout << "  -d, --duration <secs>    "
+                  << "Run for <secs> seconds (default: 10)" << std::endl;
+        std::cout << "  -i, --interval <secs>    "
+                  << "Report every <secs> seconds (default: 1)" << std::endl;
+    }
+
+    int& argc;
+    char**& argv;
+    std::string cluster;
+    uint32_t numThreads;
+    uint32_t numSessions;
+    uint32_t numLogs;
+    double rate;
+    uint32_t durationSecs;
+    uint32_t intervalSecs;
+    uint32_t mix[NUM_OPS];
+    uint32_t minSize;
+    uint32_t maxSize;
+    uint32_t conditionalPercent;
+};
+
+/**
+ * Latencies and error counts collected by the worker threads. Each worker
+ * appends to its own instance; the reporter periodically takes the contents.
+ */
+struct Samples {
+    Samples()
+        : mutex()
+        , latencyMicros()
+        , conditionFailures(0)
+        , errors(0)
+    {
+    }
+
+    /**
+     * Move everything collected so far into 'out', leaving this empty.
+     */
+    void drainInto(Samples& out) {
+        std::unique_lock<std::mutex> lockGuard(mutex);
+        for (uint32_t i = 0; i < NUM_OPS; ++i) {
+            out.latencyMicros[i].insert(out.latencyMicros[i].end(),
+                                        latencyMicros[i].begin(),
+                                        latencyMicros[i].end());
+            latencyMicros[i].clear();
+        }
+        out.conditionFailures += conditionFailures;
+        conditionFailures = 0;
+        out.errors += errors;
+        errors = 0;
+    }
+
+    std::mutex mutex;
+    std::vector<uint64_t> latencyMicros[NUM_OPS];
+    uint64_t conditionFailures;
+    uint64_t errors;
+};
+
+/**
+ * Return the given quantile of an already sorted list of latencies.
+ */
+uint64_t
+percentile(const std::vector<uint64_t>& sorted, double quantile)
+{
+    if (sorted.empty())
+        return 0;
+    uint64_t rank = uint64_t(quantile * double(sorted.size()));
+    if (rank >= sorted.size())
+        rank = sorted.size() - 1;
+    return sorted.at(rank);
+}
+
+/**
+ * Print one line per operation type for the given samples.
+ * \param label
+ *      Printed at the start of each line, such as the elapsed time.
+ * \param samples
+ *      The latencies to summarize. These are sorted in place.
+ * \param seconds
+ *      The length of time over which the samples were collected.
+ */
+void
+report(const std::string& label, Samples& samples, double seconds)
+{
+    for (uint32_t i = 0; i < NUM_OPS; ++i) {
+        std::vector<uint64_t>& latencies = samples.latencyMicros[i];
+        if (latencies.empty())
+            continue;
+        std::sort(latencies.begin(), latencies.end());
+        printf("%8s %-9s %10.1f ops/s  p50 %7lu  p99 %7lu  "
+               "p999 %7lu  max %7lu us\n",
+               label.c_str(), opNames[i],
+               double(latencies.size()) / seconds,
+               percentile(latencies, 0.50),
+               percentile(latencies, 0.99),
+               percentile(latencies, 0.999),
+               latencies.back());
+    }
+    if (samples.conditionFailures > 0 || samples.errors > 0) {
+        printf("%8s conditional appends failed: %lu, errors: %lu\n",
+               label.c_str(), samples.conditionFailures, samples.errors);
+    }
+    fflush(stdout);
+}
+
+/**
+ * The body of each worker thread.
+ */
+class Worker {
+  public:
+    Worker(const OptionParser& options,
+           Cluster& cluster,
+           uint32_t id,
+           Samples& samples)
+        : options(options)
+        , cluster(cluster)
+        , id(id)
+        , samples(samples)
+        , random(id)
+        , logs()
+        , lastIds()
+        , data(options.maxSize, 'x')
+    {
+    }
+
+    void
+    run(TimePoint start, TimePoint end)
+    {
+        for (uint32_t i = 0; i < options.numLogs; ++i) {
+            logs.push_back(cluster.openLog(format("benchmark-%u", i)));
+            lastIds.push_back(NO_ID);
+        }
+        uint32_t totalWeight = 0;
+        for (uint32_t i = 0; i < NUM_OPS; ++i)
+            totalWeight += options.mix[i];
+        std::uniform_int_distribution<uint32_t> opDist(0, totalWeight - 1);
+        std::uniform_int_distribution<uint32_t> logDist(0,
+                                                        options.numLogs - 1);
+        std::uniform_int_distribution<uint32_t> sizeDist(options.minSize,
+                                                         options.maxSize);
+        std::uniform_int_distribution<uint32_t> percentDist(0, 99);
+
+        // In open loop mode, each thread takes an equal share of the rate.
+        bool openLoop = options.rate > 0;
+        std::chrono::nanoseconds period(0);
+        if (openLoop) {
+            period = std::chrono::nanoseconds(uint64_t(
+                1e9 * options.numThreads / options.rate));
+        }
+        // Stagger the threads' schedules so they don't arrive in bursts.
+        TimePoint intended = start + period * id / options.numThreads;
+
+        while (true) {
+            if (openLoop) {
+                if (intended >= end)
+                    break;
+                if (Clock::now() < intended)
+                    std::this_thread::sleep_until(intended);
+            } else {
+                intended = Clock::now();
+                if (intended >= end)
+                    break;
+            }
+
+            uint32_t choice = opDist(random);
+            Op op = GET_LAST_ID;
+            if (choice < options.mix[APPEND])
+                op = APPEND;
+            else if (choice < options.mix[APPEND] + options.mix[READ])
+                op = READ;
+            uint32_t logIndex = logDist(random);
+            bool conditionFailed = false;
+            bool error = false;
+            try {
+                execute(op, logIndex, sizeDist(random),
+                        percentDist(random) < options.conditionalPercent,
+                        conditionFailed);
+            } catch (const std::exception&) {
+                error = true;
+            }
+            TimePoint now = Clock::now();
+            uint64_t micros = 0;
+            if (now > intended) {
+                micros = uint64_t(
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        now - intended).count());
+            }
+
+            {
+                std::unique_lock<std::mutex> lockGuard(samples.mutex);
+                samples.latencyMicros[op].push_back(micros);
+                if (conditionFailed)
+                    ++samples.conditionFailures;
+                if (error)
+                    ++samples.errors;
+            }
+            if (openLoop)
+                intended += period;
+        }
+    }
+
+  private:
+    /**
+     * Issue a single operation against the cluster.
+     * \param op
+     *      Which operation to issue.
+     * \param logIndex
+     *      Which of the benchmark's logs to operate on.
+     * \param size
+     *      The number of bytes to append, for APPEND.
+     * \param conditional
+     *      For APPEND, whether to make the append conditional on the last
+     *      entry ID this thread saw in the log.
+     * \param[out] conditionFailed
+     *      Set to true if a conditional append was rejected.
+     */
+    void
+    execute(Op op, uint32_t logIndex, uint32_t size, bool conditional,
+            bool& conditionFailed)
+    {
+        Log& log = logs.at(logIndex);
+        EntryId& lastId = lastIds.at(logIndex);
+        switch (op) {
+            case APPEND: {
+                Entry entry(data.data(), size);
+                EntryId expectedId = NO_ID;
+                if (conditional)
+                    expectedId = (lastId == NO_ID ? 0 : lastId + 1);
+                EntryId entryId = log.append(entry, expectedId);
+                if (entryId == NO_ID) {
+                    conditionFailed = true;
+                    lastId = log.getLastId();
+                } else {
+                    lastId = entryId;
+                }
+                break;
+            }
+            case READ:
+                // Read only the tail of the log, so that the cost of a read
+                // does not grow as the benchmark appends more entries.
+                log.read(lastId == NO_ID ? 0 : lastId);
+                break;
+            case GET_LAST_ID:
+                lastId = log.getLastId();
+                break;
+            case NUM_OPS:
+                break;
+        }
+    }
+
+    const OptionParser& options;
+    Cluster& cluster;
+    const uint32_t id;
+    Samples& samples;
+    std::mt19937 random;
+    std::vector<Log> logs;
+    std::vector<EntryId> lastIds;
+    std::string data;
+};
+
+void
+workerMain(const OptionParser& options, Cluster& cluster, uint32_t id,
+           Samples& samples, TimePoint start, TimePoint end)
+{
+    Worker worker(options, cluster, id, samples);
+    worker.run(start, end);
+}
+
+} // anonymous namespace
+
+int
+main(int argc, char** argv)
+{
+    OptionParser options(argc, argv);
+
+    std::vector<std::unique_ptr<Cluster>> sessions;
+    for (uint32_t i = 0; i < options.numSessions; ++i)
+        sessions.emplace_back(new Cluster(options.cluster));
+
+    std::vector<Samples> samples(options.numThreads);
+    TimePoint start = Clock::now();
+    TimePoint end = start + std::chrono::seconds(options.durationSecs);
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < options.numThreads; ++i) {
+        threads.emplace_back(workerMain,
+                             std::cref(options),
+                             std::ref(*sessions.at(i % options.numSessions)),
+                             i,
+                             std::ref(samples.at(i)),
+                             start, end);
+    }
+
+    printf("%s loop, %u threads, %u sessions, %u logs\n",
+           options.rate > 0 ? "Open" : "Closed",
+           options.numThreads, options.numSessions, options.numLogs);
+    Samples total;
+    TimePoint intervalStart = start;
+    while (intervalStart < end) {
+        TimePoint intervalEnd = std::min(
+            intervalStart + std::chrono::seconds(options.intervalSecs), end);
+        std::this_thread::sleep_until(intervalEnd);
+        TimePoint now = Clock::now();
+        Samples interval;
+        for (auto it = samples.begin(); it != samples.end(); ++it)
+            it->drainInto(interval);
+        double elapsed = std::chrono::duration<double>(now - start).count();
+        double seconds =
+            std::chrono::duration<double>(now - intervalStart).count();
+        report(format("%.1fs", elapsed), interval, seconds);
+        interval.drainInto(total);
+        intervalStart = now;
+    }
+
+    for (auto it = threads.begin(); it != threads.end(); ++it)
+        it->join();
+    for (auto it = samples.begin(); it != samples.end(); ++it)
+        it->drainInto(total);
+    printf("Total:\n");
+    report("all", total,
+           std::chrono::duration<double>(Clock::now() - start).count());
+    return 0;
+}
@@ -21,17 +21,20 @@ namespace {
 
 using LogCabin::Client::Cluster;
 using LogCabin::Client::Entry;
+using LogCabin::Client::EntryView;
 using LogCabin::Client::Log;
+using LogCabin::Client::ReadResult;
 
 void
 printLogContents(Log& log, const char* logName)
 {
-    std::vector<Entry> entries = log.read(0);
+    ReadResult entries = log.read(0);
     std::cout << "Log " << logName << ":" << std::endl;
     for (auto it = entries.begin(); it != entries.end(); ++it) {
-        std::cout << "- " << it->getId() << ": "
-                  << std::string(static_cast<const char*>(it->getData()),
-                                 it->getLength())
+        EntryView entry = *it;
+        std::cout << "- " << entry.getId() << ": "
+                  << std::string(static_cast<const char*>(entry.getData()),
+                                 entry.getLength())
                   << std::endl;
     }
     std::cout << std::endl;
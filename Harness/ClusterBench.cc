@@ -0,0 +1,908 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Runs a LocalCluster in this process and measures it under simulated network
+ * conditions. Since the whole cluster runs on one machine with a fixed random
+ * seed, results are comparable from run to run without a real testbed.
+ *
+ * Eight benchmarks are available:
+ *  - commit: the latency of appending entries one at a time.
+ *  - failover: how long it takes to elect a new leader after the current one
+ *    is cut off from the cluster.
+ *  - transfer: how long a planned handoff of leadership with the
+ *    TransferLeadership RPC takes, and how long a client that was talking to
+ *    the old leader can't append.
+ *  - catchup: how long it takes a follower that missed a number of entries to
+ *    catch up once it rejoins the cluster, and how long the heartbeats sent
+ *    to it meanwhile take. With "--set raftGroups=<n>" and a limited
+ *    bandwidth, the catch-up traffic of some groups competes with the
+ *    heartbeats of the others; run it again with --fifo to see what the
+ *    control lane is worth.
+ *  - rejoin: how long appends stall when a follower that was cut off for a
+ *    few election timeouts rejoins the cluster, and whether it deposes the
+ *    leader.
+ *  - reads: read throughput with one client per server, first with every read
+ *    going through the leader and then with follower reads.
+ *  - tail: how long it takes a client following a log with Log::watch to see
+ *    each new entry, while many other clients wait idly on another log.
+ *  - fanout: how long it takes for all of a thousand clients following one
+ *    log to see each new entry, first with Log::watch and then with
+ *    Log::subscribe.
+ *
+ * Servers can also be given a slow disk with --set, for example
+ * "--set 2:raftLogLatencyAppend=exponential 5000" (see sample.conf), and
+ * every event loop in the process can be switched to the epoll backend with
+ * "--event-loop epoll" to compare it against libevent.
+ */
+
+#include <getopt.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Client/Client.h"
+#include "Core/Debug.h"
+#include "Core/Time.h"
+#include "Event/Loop.h"
+#include "Harness/LocalCluster.h"
+#include "Protocol/Common.h"
+#include "RPC/MessageSocket.h"
+
+namespace {
+
+using LogCabin::Client::Cluster;
+using LogCabin::Client::Entry;
+using LogCabin::Client::Log;
+using LogCabin::Client::Subscription;
+using LogCabin::Harness::LinkOptions;
+using LogCabin::Harness::LocalCluster;
+typedef LogCabin::Core::Time::SteadyClock Clock;
+typedef Clock::time_point TimePoint;
+
+/**
+ * Parses argv for the main function.
+ */
+class OptionParser {
+  public:
+    OptionParser(int& argc, char**& argv)
+        : argc(argc)
+        , argv(argv)
+        , benchmark("all")
+        , numServers(3)
+        , link()
+        , numEntries(1000)
+        , entrySize(1024)
+        , iterations(10)
+        , seed(1)
+        , storageDir()
+        , settings()
+        , verbose(false)
+        , eventLoopBackend(LogCabin::Event::Loop::Backend::LIBEVENT)
+        , controlLane(true)
+    {
+        while (true) {
+            static struct option longOptions[] = {
+               {"bandwidth",  required_argument, NULL, 'B'},
+               {"benchmark",  required_argument, NULL, 'b'},
+               {"delay",  required_argument, NULL, 'd'},
+               {"entries",  required_argument, NULL, 'e'},
+               {"event-loop",  required_argument, NULL, 'E'},
+               {"fifo",  no_argument, NULL, 'F'},
+               {"help",  no_argument, NULL, 'h'},
+               {"iterations",  required_argument, NULL, 'i'},
+               {"loss",  required_argument, NULL, 'l'},
+               {"servers",  required_argument, NULL, 'n'},
+               {"seed",  required_argument, NULL, 'S'},
+               {"set",  required_argument, NULL, 's'},
+               {"storage",  required_argument, NULL, 'D'},
+               {"verbose",  no_argument, NULL, 'v'},
+               {"size",  required_argument, NULL, 'z'},
+               {0, 0, 0, 0}
+            };
+            int c = getopt_long(argc, argv, "B:b:d:D:e:E:Fhi:l:n:s:S:vz:",
+                                longOptions, NULL);
+
+            // Detect the end of the options.
+            if (c == -1)
+                break;
+
+            switch (c) {
+                case 'B':
+                    link.bandwidth = uint64_t(atoll(optarg));
+                    break;
+                case 'b':
+                    benchmark = optarg;
+                    break;
+                case 'd':
+                    link.delay = std::chrono::microseconds(atoll(optarg));
+                    break;
+                case 'D':
+                    storageDir = optarg;
+                    break;
+                case 'e':
+                    numEntries = uint32_t(atol(optarg));
+                    break;
+                case 'E':
+                    if (std::string(optarg) == "libevent") {
+                        eventLoopBackend =
+                            LogCabin::Event::Loop::Backend::LIBEVENT;
+                    } else if (std::string(optarg) == "epoll") {
+                        eventLoopBackend =
+                            LogCabin::Event::Loop::Backend::EPOLL;
+                    } else {
+                        usage();
+                        exit(1);
+                    }
+                    break;
+                case 'F':
+                    controlLane = false;
+                    break;
+                case 'h':
+                    usage();
+                    exit(0);
+                case 'i':
+                    iterations = uint32_t(atol(optarg));
+                    break;
+                case 'l':
+                    link.lossRate = strtod(optarg, NULL);
+                    break;
+                case 'n':
+                    numServers = uint32_t(atol(optarg));
+                    break;
+                case 's':
+                    settings.push_back(parseSetting(optarg));
+                    break;
+                case 'S':
+                    seed = uint32_t(atol(optarg));
+                    break;
+                case 'v':
+                    verbose = true;
+                    break;
+                case 'z':
+                    entrySize = uint32_t(atol(optarg));
+                    break;
+                case '?':
+                default:
+                    // getopt_long already printed an error message.
+                    usage();
+                    exit(1);
+            }
+        }
+
+        // We don't expect any additional command line arguments (not options).
+        if (optind != argc) {
+            usage();
+            exit(1);
+        }
+        if (numServers == 0 || link.lossRate < 0 || link.lossRate >= 1 ||
+            (benchmark != "all" && benchmark != "commit" &&
+             benchmark != "failover" && benchmark != "catchup" &&
+             benchmark != "transfer" && benchmark != "rejoin" &&
+             benchmark != "reads" && benchmark != "tail" &&
+             benchmark != "fanout")) {
+            usage();
+            exit(1);
+        }
+    }
+
+    /**
+     * Parse the argument to --set, in the form [<id>:]<key>=<value>.
+     */
+    LocalCluster::Setting parseSetting(const std::string& arg) {
+        LocalCluster::Setting setting;
+        std::string::size_type equals = arg.find('=');
+        if (equals == std::string::npos || equals == 0) {
+            usage();
+            exit(1);
+        }
+        std::string key = arg.substr(0, equals);
+        std::string::size_type colon = key.find(':');
+        if (colon != std::string::npos) {
+            setting.serverId = uint64_t(atoll(key.substr(0, colon).c_str()));
+            key = key.substr(colon + 1);
+        }
+        setting.key = key;
+        setting.value = arg.substr(equals + 1);
+        return setting;
+    }
+
+    void usage() {
+        std::cout << "Usage: " << argv[0] << " [options]" << std::endl;
+        std::cout << "Options: " << std::endl;
+        std::cout << "  -h, --help               "
+                  << "Print this usage information" << std::endl;
+        std::cout << "  -b, --benchmark <name>   "
+                  << "Run commit, failover, catchup, transfer, rejoin, "
+                  << "reads, tail, fanout, or all (default: all)"
+                  << std::endl;
+        std::cout << "  -n, --servers <n>        "
+                  << "Run a cluster of <n> servers (default: 3)" << std::endl;
+        std::cout << "  -d, --delay <us>         "
+                  << "Add <us> microseconds of one-way delay to every link "
+                  << "(default: 0)" << std::endl;
+        std::cout << "  -B, --bandwidth <B/s>    "
+                  << "Limit every link to <B/s> bytes per second "
+                  << "(default: 0, unlimited)" << std::endl;
+        std::cout << "  -l, --loss <rate>        "
+                  << "Lose this fraction of messages, delaying them by a "
+                  << "retransmission timeout (default: 0)" << std::endl;
+        std::cout << "  -e, --entries <n>        "
+                  << "Append <n> entries in the commit, catchup, tail, and "
+                  << "fanout benchmarks, or read <n> times per client in the "
+                  << "reads benchmark (default: 1000)" << std::endl;
+        std::cout << "  -z, --size <bytes>       "
+                  << "Append entries of <bytes> bytes (default: 1024)"
+                  << std::endl;
+        std::cout << "  -i, --iterations <n>     "
+                  << "Fail over, transfer, or rejoin <n> times "
+                  << "(default: 10)" << std::endl;
+        std::cout << "  -S, --seed <n>           "
+                  << "Seed the simulated network with <n> (default: 1)"
+                  << std::endl;
+        std::cout << "  -s, --set [<id>:]<k>=<v> "
+                  << "Set config option <k> to <v> on server <id>, or on "
+                  << "all servers if <id> is omitted (may be repeated)"
+                  << std::endl;
+        std::cout << "  -D, --storage <dir>      "
+                  << "Keep the servers' logs in <dir> "
+                  << "(default: a temporary directory on tmpfs)" << std::endl;
+        std::cout << "  -E, --event-loop <name>  "
+                  << "Wait for events with libevent or epoll "
+                  << "(default: libevent)" << std::endl;
+        std::cout << "  -F, --fifo               "
+                  << "Send every message in FIFO order, without letting "
+                  << "heartbeats and votes skip ahead of queued bulk data"
+                  << std::endl;
+        std::cout << "  -v, --verbose            "
+                  << "Show the servers' log messages" << std::endl;
+    }
+
+    int& argc;
+    char**& argv;
+    std::string benchmark;
+    uint32_t numServers;
+    LinkOptions link;
+    uint32_t numEntries;
+    uint32_t entrySize;
+    uint32_t iterations;
+    uint32_t seed;
+    std::string storageDir;
+    std::vector<LocalCluster::Setting> settings;
+    bool verbose;
+    LogCabin::Event::Loop::Backend eventLoopBackend;
+    bool controlLane;
+};
+
+/**
+ * Return the microseconds elapsed since 'start'.
+ */
+uint64_t
+microsSince(TimePoint start)
+{
+    return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+                        Clock::now() - start).count());
+}
+
+/**
+ * Return the given quantile of an already sorted list of samples.
+ */
+uint64_t
+percentile(const std::vector<uint64_t>& sorted, double quantile)
+{
+    if (sorted.empty())
+        return 0;
+    uint64_t rank = uint64_t(quantile * double(sorted.size()));
+    if (rank >= sorted.size())
+        rank = sorted.size() - 1;
+    return sorted.at(rank);
+}
+
+/**
+ * Print a one-line summary of the given samples, in microseconds.
+ * The samples are sorted in place.
+ */
+void
+report(const std::string& label, std::vector<uint64_t>& samples)
+{
+    if (samples.empty()) {
+        printf("%-10s no samples\n", label.c_str());
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    printf("%-10s n %6lu  p50 %8lu  p99 %8lu  p999 %8lu  max %8lu us\n",
+           label.c_str(), samples.size(),
+           percentile(samples, 0.50),
+           percentile(samples, 0.99),
+           percentile(samples, 0.999),
+           samples.back());
+    fflush(stdout);
+}
+
+/**
+ * Wait for a leader or exit the program.
+ */
+uint64_t
+waitForLeader(LocalCluster& cluster, uint64_t excluding = 0)
+{
+    uint64_t leaderId = cluster.waitForLeader(std::chrono::seconds(10),
+                                              excluding);
+    if (leaderId == 0) {
+        fprintf(stderr, "No leader was elected within 10 seconds\n");
+        exit(1);
+    }
+    return leaderId;
+}
+
+/**
+ * Measure the latency of appending entries one at a time.
+ */
+void
+commitBenchmark(LocalCluster& cluster, const OptionParser& options)
+{
+    uint64_t leaderId = waitForLeader(cluster);
+    Cluster client(cluster.getAddress(leaderId));
+    Log log = client.openLog("commit");
+    std::string data(options.entrySize, 'x');
+    std::vector<uint64_t> latencies;
+    TimePoint begin = Clock::now();
+    for (uint32_t i = 0; i < options.numEntries; ++i) {
+        TimePoint start = Clock::now();
+        log.append(Entry(data.data(), uint32_t(data.size())));
+        latencies.push_back(microsSince(start));
+    }
+    double seconds = double(microsSince(begin)) / 1e6;
+    printf("commit     %.1f entries/s\n",
+           double(options.numEntries) / seconds);
+    report("commit", latencies);
+
+    // Each entry's data is in both the Raft log and the state machine's log.
+    // Report how much memory that takes per entry, and how much it would take
+    // if the state machine kept copies of its own. The state machine only
+    // shares entries' data with the Raft log with --set binaryCommands=true.
+    LogCabin::Protocol::Client::ServerStats stats =
+        cluster.getStats(leaderId);
+    if (stats.has_state_machine() &&
+        stats.state_machine().num_entries() > 0) {
+        const LogCabin::Protocol::Client::ServerStats::StateMachine& sm =
+            stats.state_machine();
+        double numEntries = double(sm.num_entries());
+        printf("memory     %.0f data bytes/entry, %.0f without sharing\n",
+               double(stats.log().bytes() + sm.unshared_bytes()) / numEntries,
+               double(stats.log().bytes() + sm.bytes()) / numEntries);
+    }
+}
+
+/**
+ * Measure the time to elect a new leader after isolating the current one.
+ */
+void
+failoverBenchmark(LocalCluster& cluster, const OptionParser& options)
+{
+    if (cluster.getNumServers() < 3) {
+        printf("failover   skipped: needs at least 3 servers\n");
+        return;
+    }
+    std::vector<uint64_t> latencies;
+    for (uint32_t i = 0; i < options.iterations; ++i) {
+        uint64_t oldLeaderId = waitForLeader(cluster);
+        uint64_t oldTerm = cluster.getStats(oldLeaderId).current_term();
+        TimePoint start = Clock::now();
+        cluster.isolate(oldLeaderId);
+        uint64_t newLeaderId = waitForLeader(cluster, oldLeaderId);
+        latencies.push_back(microsSince(start));
+        uint64_t newTerm = cluster.getStats(newLeaderId).current_term();
+        printf("failover   %3u: leader %lu -> %lu, term %lu -> %lu, %lu us\n",
+               i, oldLeaderId, newLeaderId, oldTerm, newTerm,
+               latencies.back());
+        cluster.rejoin(oldLeaderId);
+    }
+    report("failover", latencies);
+}
+
+/**
+ * Measure the time to hand off leadership on purpose, and the time until a
+ * client of the old leader gets its next entry appended.
+ */
+void
+transferBenchmark(LocalCluster& cluster, const OptionParser& options)
+{
+    if (cluster.getNumServers() < 2) {
+        printf("transfer   skipped: needs at least 2 servers\n");
+        return;
+    }
+    std::string data(options.entrySize, 'x');
+    std::vector<uint64_t> transferLatencies;
+    std::vector<uint64_t> writeLatencies;
+    for (uint32_t i = 0; i < options.iterations; ++i) {
+        uint64_t oldLeaderId = waitForLeader(cluster);
+        Cluster client(cluster.getAddress(oldLeaderId));
+        Log log = client.openLog("transfer");
+        TimePoint start = Clock::now();
+        LogCabin::Client::LeadershipTransferResult result =
+            client.transferLeadership();
+        transferLatencies.push_back(microsSince(start));
+        if (result.status != LogCabin::Client::LeadershipTransferResult::OK) {
+            printf("transfer   %3u: failed: %s\n", i, result.reason.c_str());
+            continue;
+        }
+        log.append(Entry(data.data(), uint32_t(data.size())));
+        writeLatencies.push_back(microsSince(start));
+        printf("transfer   %3u: leader %lu -> %lu, %lu us, "
+               "next append after %lu us\n",
+               i, oldLeaderId, result.leaderId,
+               transferLatencies.back(), writeLatencies.back());
+    }
+    report("transfer", transferLatencies);
+    report("append", writeLatencies);
+}
+
+/**
+ * Return the newest term that any server other than 'excluding' has seen in
+ * the given Raft group.
+ */
+uint64_t
+getGroupTerm(LocalCluster& cluster, uint32_t groupId, uint64_t excluding)
+{
+    uint64_t term = 0;
+    for (uint64_t id = 1; id <= cluster.getNumServers(); ++id) {
+        if (id != excluding) {
+            term = std::max(term, cluster.getGroupStats(id, groupId).
+                                      current_term());
+        }
+    }
+    return term;
+}
+
+/**
+ * Return the round-trip times of all the Heartbeat RPCs that other servers
+ * have sent to the given server in any Raft group, as the number of samples
+ * in each histogram bucket, keyed by the bucket's upper bound.
+ */
+std::map<uint64_t, uint64_t>
+getHeartbeatRTTs(LocalCluster& cluster, uint64_t serverId)
+{
+    std::map<uint64_t, uint64_t> buckets;
+    for (uint64_t id = 1; id <= cluster.getNumServers(); ++id) {
+        if (id == serverId)
+            continue;
+        for (uint32_t groupId = 0; groupId < cluster.getNumGroups();
+             ++groupId) {
+            LogCabin::Protocol::Client::ServerStats stats =
+                cluster.getGroupStats(id, groupId);
+            for (int i = 0; i < stats.peers_size(); ++i) {
+                const LogCabin::Protocol::Client::ServerStats::Peer& peer =
+                    stats.peers(i);
+                if (peer.server_id() != serverId || !peer.has_heartbeat_rtt())
+                    continue;
+                const LogCabin::Protocol::Client::ServerStats::Histogram& rtt =
+                    peer.heartbeat_rtt();
+                for (int j = 0; j < rtt.buckets_size(); ++j) {
+                    buckets[rtt.buckets(j).upper_bound()] +=
+                        rtt.buckets(j).count();
+                }
+            }
+        }
+    }
+    return buckets;
+}
+
+/**
+ * Measure the time for a follower to catch up on entries it missed while it
+ * was cut off from the cluster. The follower falls behind in half of the
+ * Raft groups. In the other half, it keeps getting heartbeats. One server
+ * leads every group, so the heartbeats share its connection to the follower
+ * with the catch-up traffic. This also reports how long those heartbeats
+ * took and whether any group held an election meanwhile.
+ *
+ * A backlog only builds up at the leader if the bandwidth is limited and the
+ * follower is sent full-size requests, for example with
+ * "--bandwidth 10000000 --entries 500 --size 8192 --set raftGroups=16
+ * --set bulkCatchUpThreshold=100 --set replicationMaxBytesInFlight=262144".
+ * Larger requests take longer to send than the RPC session's 100 ms ping
+ * timeout, which drops the connection whatever the lanes do. Heartbeat
+ * round-trip times are only recorded with "--set heartbeatCoalescing=true",
+ * and the rejoining follower forces elections of its own unless
+ * "--set preVote=true".
+ */
+void
+catchupBenchmark(LocalCluster& cluster, const OptionParser& options)
+{
+    if (cluster.getNumServers() < 3) {
+        printf("catchup    skipped: needs at least 3 servers\n");
+        return;
+    }
+    uint32_t numGroups = cluster.getNumGroups();
+    uint64_t leaderId = waitForLeader(cluster);
+    for (uint32_t groupId = 1; groupId < numGroups; ++groupId) {
+        if (!cluster.transferLeadership(groupId, leaderId,
+                                        std::chrono::seconds(10))) {
+            printf("catchup    skipped: server %lu did not take over "
+                   "group %u\n", leaderId, groupId);
+            return;
+        }
+    }
+    uint64_t followerId = leaderId % cluster.getNumServers() + 1;
+    cluster.isolate(followerId);
+
+    // Find a log name in each of the even-numbered groups, which the
+    // follower will fall behind in. It will stay caught up in the others.
+    uint32_t numBehind = (numGroups + 1) / 2;
+    std::vector<std::string> logNames(numGroups);
+    uint32_t numNamed = 0;
+    for (uint32_t i = 0; numNamed < numBehind; ++i) {
+        std::string name = "catchup";
+        if (i > 0)
+            name += std::to_string(i);
+        uint32_t groupId =
+            LogCabin::Protocol::Common::getRaftGroup(name, numGroups);
+        if (groupId % 2 == 0 && logNames.at(groupId).empty()) {
+            logNames.at(groupId) = name;
+            ++numNamed;
+        }
+    }
+
+    Cluster client(cluster.getAddress(leaderId));
+    std::string data(options.entrySize, 'x');
+    for (uint32_t groupId = 0; groupId < numGroups; groupId += 2) {
+        Log log = client.openLog(logNames.at(groupId));
+        for (uint32_t i = 0; i < options.numEntries; ++i)
+            log.append(Entry(data.data(), uint32_t(data.size())));
+    }
+    std::vector<uint64_t> targets;
+    std::vector<uint64_t> terms;
+    uint64_t behind = 0;
+    for (uint32_t groupId = 0; groupId < numGroups; ++groupId) {
+        uint64_t target = 0;
+        for (uint64_t id = 1; id <= cluster.getNumServers(); ++id) {
+            target = std::max(target, cluster.getGroupStats(id, groupId).
+                                          log().num_entries());
+        }
+        targets.push_back(target);
+        terms.push_back(getGroupTerm(cluster, groupId, followerId));
+        behind += target - cluster.getGroupStats(followerId, groupId).
+                               log().num_entries();
+    }
+
+    std::map<uint64_t, uint64_t> rttsBefore =
+        getHeartbeatRTTs(cluster, followerId);
+
+    TimePoint start = Clock::now();
+    cluster.rejoin(followerId);
+    for (uint32_t groupId = 0; groupId < numGroups; ++groupId) {
+        while (cluster.getGroupStats(followerId, groupId).
+                   log().num_entries() < targets.at(groupId)) {
+            usleep(100);
+        }
+    }
+    uint64_t micros = microsSince(start);
+
+    std::map<uint64_t, uint64_t> rttsAfter =
+        getHeartbeatRTTs(cluster, followerId);
+    std::map<uint64_t, uint64_t> rtts;
+    uint64_t heartbeats = 0;
+    for (auto it = rttsAfter.begin(); it != rttsAfter.end(); ++it) {
+        uint64_t count = it->second - rttsBefore[it->first];
+        if (count > 0) {
+            rtts[it->first] = count;
+            heartbeats += count;
+        }
+    }
+    // Upper bounds on the median, 99th percentile, and slowest heartbeat.
+    uint64_t median = 0;
+    uint64_t p99 = 0;
+    uint64_t slowest = 0;
+    uint64_t seen = 0;
+    for (auto it = rtts.begin(); it != rtts.end(); ++it) {
+        seen += it->second;
+        if (median == 0 && seen * 2 >= heartbeats)
+            median = it->first;
+        if (p99 == 0 && seen * 100 >= heartbeats * 99)
+            p99 = it->first;
+        slowest = it->first;
+    }
+    uint32_t elections = 0;
+    for (uint32_t groupId = 0; groupId < numGroups; ++groupId) {
+        if (getGroupTerm(cluster, groupId, 0) != terms.at(groupId))
+            ++elections;
+    }
+    printf("catchup    server %lu caught up on %lu entries in %u of %u "
+           "groups in %lu us (%.1f entries/s)\n",
+           followerId, behind, numBehind, numGroups, micros,
+           double(behind) / (double(micros) / 1e6));
+    printf("catchup    meanwhile: %lu heartbeats, median under %lu us, "
+           "99%% under %lu us, slowest under %lu us; elections in %u "
+           "groups\n",
+           heartbeats, median, p99, slowest, elections);
+    fflush(stdout);
+}
+
+/**
+ * Measure the slowest append while a follower that was cut off for a while
+ * rejoins the cluster. Without pre-votes, the follower comes back with a
+ * newer term and forces the leader to step down; compare with
+ * --set preVote=true.
+ */
+void
+rejoinBenchmark(LocalCluster& cluster, const OptionParser& options)
+{
+    if (cluster.getNumServers() < 3) {
+        printf("rejoin     skipped: needs at least 3 servers\n");
+        return;
+    }
+    std::string data(options.entrySize, 'x');
+    std::vector<uint64_t> latencies;
+    for (uint32_t i = 0; i < options.iterations; ++i) {
+        uint64_t leaderId = waitForLeader(cluster);
+        uint64_t term = cluster.getStats(leaderId).current_term();
+        uint64_t followerId = leaderId % cluster.getNumServers() + 1;
+        Cluster client(cluster.getAddress(leaderId));
+        Log log = client.openLog("rejoin");
+        cluster.isolate(followerId);
+        usleep(500 * 1000); // a few election timeouts
+        cluster.rejoin(followerId);
+        TimePoint start = Clock::now();
+        uint64_t slowest = 0;
+        while (microsSince(start) < 500 * 1000) {
+            TimePoint appendStart = Clock::now();
+            log.append(Entry(data.data(), uint32_t(data.size())));
+            slowest = std::max(slowest, microsSince(appendStart));
+        }
+        latencies.push_back(slowest);
+        uint64_t newLeaderId = waitForLeader(cluster);
+        uint64_t newTerm = cluster.getStats(newLeaderId).current_term();
+        printf("rejoin     %3u: server %lu, leader %lu -> %lu, "
+               "term %lu -> %lu, slowest append %lu us\n",
+               i, followerId, leaderId, newLeaderId, term, newTerm,
+               slowest);
+    }
+    report("rejoin", latencies);
+}
+
+/**
+ * Measure read throughput with one client per server. Without follower reads,
+ * every client's reads end up at the leader; with them, each client's own
+ * server answers.
+ */
+void
+readsBenchmark(LocalCluster& cluster, const OptionParser& options)
+{
+    uint32_t numServers = cluster.getNumServers();
+    uint64_t leaderId = waitForLeader(cluster);
+    {
+        Cluster client(cluster.getAddress(leaderId));
+        Log log = client.openLog("reads");
+        std::string data(options.entrySize, 'x');
+        log.append(Entry(data.data(), uint32_t(data.size())));
+    }
+    for (uint32_t followerReads = 0; followerReads < 2; ++followerReads) {
+        std::vector<std::vector<uint64_t>> latencies(numServers);
+        std::vector<std::thread> threads;
+        TimePoint begin = Clock::now();
+        for (uint32_t i = 0; i < numServers; ++i) {
+            threads.emplace_back([&cluster, &options, &latencies,
+                                  followerReads, i] () {
+                Cluster client(cluster.getAddress(i + 1));
+                if (followerReads)
+                    client.enableFollowerReads(1000);
+                Log log = client.openLog("reads");
+                for (uint32_t j = 0; j < options.numEntries; ++j) {
+                    TimePoint start = Clock::now();
+                    log.read(0);
+                    latencies.at(i).push_back(microsSince(start));
+                }
+            });
+        }
+        for (auto it = threads.begin(); it != threads.end(); ++it)
+            it->join();
+        double seconds = double(microsSince(begin)) / 1e6;
+        std::vector<uint64_t> all;
+        for (auto it = latencies.begin(); it != latencies.end(); ++it)
+            all.insert(all.end(), it->begin(), it->end());
+        const char* label = followerReads ? "follower" : "leader";
+        printf("reads      %-8s %u clients, %.1f reads/s\n",
+               label, numServers, double(all.size()) / seconds);
+        report(label, all);
+    }
+}
+
+/**
+ * Measure how long a client following a log with Log::watch takes to see each
+ * entry after the writer starts appending it. Meanwhile, 100 other clients
+ * wait on a log that never grows, which shouldn't slow anything down.
+ */
+void
+tailBenchmark(LocalCluster& cluster, const OptionParser& options)
+{
+    const uint32_t numIdleWatchers = 100;
+    uint64_t leaderId = waitForLeader(cluster);
+    Cluster client(cluster.getAddress(leaderId));
+    Log idleLog = client.openLog("idle");
+    Log log = client.openLog("tail");
+
+    std::vector<std::thread> idleWatchers;
+    for (uint32_t i = 0; i < numIdleWatchers; ++i) {
+        idleWatchers.emplace_back([&idleLog] () {
+            while (idleLog.watch(0, 60000).empty()) {
+            }
+        });
+    }
+
+    std::mutex mutex;
+    std::vector<TimePoint> appendStarts(options.numEntries);
+    std::vector<uint64_t> latencies;
+    std::thread tailer([&log, &options, &mutex, &appendStarts,
+                        &latencies] () {
+        uint64_t next = 0;
+        while (next < options.numEntries) {
+            std::vector<Entry> entries = log.watch(next, 60000);
+            std::unique_lock<std::mutex> lockGuard(mutex);
+            for (auto it = entries.begin(); it != entries.end(); ++it) {
+                latencies.push_back(microsSince(appendStarts.at(it->getId())));
+                next = it->getId() + 1;
+            }
+        }
+    });
+
+    std::string data(options.entrySize, 'x');
+    std::vector<uint64_t> appendLatencies;
+    for (uint32_t i = 0; i < options.numEntries; ++i) {
+        TimePoint start = Clock::now();
+        {
+            std::unique_lock<std::mutex> lockGuard(mutex);
+            appendStarts.at(i) = start;
+        }
+        log.append(Entry(data.data(), uint32_t(data.size())));
+        appendLatencies.push_back(microsSince(start));
+    }
+    tailer.join();
+    idleLog.append(Entry(data.data(), uint32_t(data.size())));
+    for (auto it = idleWatchers.begin(); it != idleWatchers.end(); ++it)
+        it->join();
+
+    printf("tail       %u idle watchers\n", numIdleWatchers);
+    report("append", appendLatencies);
+    report("tail", latencies);
+}
+
+/**
+ * Measure how long it takes for every one of 1000 clients following the same
+ * log to see each entry after the writer starts appending it. This runs once
+ * with the followers using Log::watch and once with Log::subscribe.
+ */
+void
+fanoutBenchmark(LocalCluster& cluster, const OptionParser& options)
+{
+    const uint32_t numFollowers = 1000;
+    uint64_t leaderId = waitForLeader(cluster);
+    Cluster client(cluster.getAddress(leaderId));
+    std::string data(options.entrySize, 'x');
+    for (uint32_t subscribe = 0; subscribe < 2; ++subscribe) {
+        const char* method = (subscribe ? "subscribe" : "watch");
+        Log log = client.openLog(std::string("fanout-") + method);
+
+        std::mutex mutex;
+        std::vector<TimePoint> appendStarts(options.numEntries);
+        // The number of followers that have yet to see each entry.
+        std::vector<uint32_t> remaining(options.numEntries, numFollowers);
+        std::vector<uint64_t> latencies;
+        auto seen = [&] (const std::vector<Entry>& entries) {
+            std::unique_lock<std::mutex> lockGuard(mutex);
+            for (auto it = entries.begin(); it != entries.end(); ++it) {
+                if (--remaining.at(it->getId()) == 0) {
+                    latencies.push_back(
+                        microsSince(appendStarts.at(it->getId())));
+                }
+            }
+        };
+        std::vector<std::thread> followers;
+        for (uint32_t i = 0; i < numFollowers; ++i) {
+            followers.emplace_back([&log, &options, &seen, subscribe] () {
+                Subscription subscription = log.subscribe(0);
+                uint64_t next = 0;
+                while (next < options.numEntries) {
+                    std::vector<Entry> entries =
+                        (subscribe ? subscription.next(60000)
+                                   : log.watch(next, 60000));
+                    if (!entries.empty())
+                        next = entries.back().getId() + 1;
+                    seen(entries);
+                }
+            });
+        }
+        // Give the followers a moment to start waiting.
+        usleep(1000 * 1000);
+
+        std::vector<uint64_t> appendLatencies;
+        for (uint32_t i = 0; i < options.numEntries; ++i) {
+            TimePoint start = Clock::now();
+            {
+                std::unique_lock<std::mutex> lockGuard(mutex);
+                appendStarts.at(i) = start;
+            }
+            log.append(Entry(data.data(), uint32_t(data.size())));
+            appendLatencies.push_back(microsSince(start));
+        }
+        for (auto it = followers.begin(); it != followers.end(); ++it)
+            it->join();
+
+        printf("fanout     %u followers using %s\n", numFollowers, method);
+        report("append", appendLatencies);
+        report(method, latencies);
+    }
+}
+
+} // anonymous namespace
+
+int
+main(int argc, char** argv)
+{
+    OptionParser options(argc, argv);
+    if (!options.verbose)
+        LogCabin::Core::Debug::setLogPolicy({{"", "WARNING"}});
+    LogCabin::Event::Loop::defaultBackend = options.eventLoopBackend;
+    LogCabin::RPC::MessageSocket::controlLane = options.controlLane;
+
+    LocalCluster cluster(options.numServers,
+                         options.storageDir,
+                         options.seed,
+                         options.settings);
+    cluster.network.setAllLinks(options.numServers, options.link);
+    printf("cluster    %u servers, delay %ld us, bandwidth %lu B/s, "
+           "loss %.3f, seed %u, %s event loop, control lane %s\n",
+           options.numServers, long(options.link.delay.count()),
+           options.link.bandwidth, options.link.lossRate, options.seed,
+           (options.eventLoopBackend ==
+                LogCabin::Event::Loop::Backend::EPOLL
+            ? "epoll" : "libevent"),
+           options.controlLane ? "on" : "off");
+    for (auto it = options.settings.begin();
+         it != options.settings.end();
+         ++it) {
+        if (it->serverId == 0) {
+            printf("setting    all servers: %s = %s\n",
+                   it->key.c_str(), it->value.c_str());
+        } else {
+            printf("setting    server %lu: %s = %s\n",
+                   it->serverId, it->key.c_str(), it->value.c_str());
+        }
+    }
+
+    if (options.benchmark == "all" || options.benchmark == "commit")
+        commitBenchmark(cluster, options);
+    if (options.benchmark == "all" || options.benchmark == "catchup")
+        catchupBenchmark(cluster, options);
+    if (options.benchmark == "all" || options.benchmark == "failover")
+        failoverBenchmark(cluster, options);
+    if (options.benchmark == "all" || options.benchmark == "transfer")
+        transferBenchmark(cluster, options);
+    if (options.benchmark == "all" || options.benchmark == "rejoin")
+        rejoinBenchmark(cluster, options);
+    if (options.benchmark == "all" || options.benchmark == "reads")
+        readsBenchmark(cluster, options);
+    if (options.benchmark == "all" || options.benchmark == "tail")
+        tailBenchmark(cluster, options);
+    if (options.benchmark == "all" || options.benchmark == "fanout")
+        fanoutBenchmark(cluster, options);
+    return 0;
+}
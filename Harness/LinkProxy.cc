@@ -0,0 +1,462 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <arpa/inet.h>
+#include <endian.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <deque>
+#include <string>
+
+#include "build/Protocol/Raft.pb.h"
+#include "Core/Debug.h"
+#include "Core/ThreadId.h"
+#include "Harness/LinkProxy.h"
+#include "Protocol/Common.h"
+#include "RPC/Protocol.h"
+
+namespace LogCabin {
+namespace Harness {
+
+namespace {
+
+/**
+ * The size of the header RPC::MessageSocket places in front of each message:
+ * a 64-bit message ID followed by a 32-bit payload length, in big endian.
+ */
+const uint32_t MESSAGE_HEADER_LENGTH = 12;
+
+/**
+ * Return a loopback socket address with the given port.
+ */
+struct sockaddr_in
+loopbackAddress(uint16_t port)
+{
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    return address;
+}
+
+/**
+ * The receive buffer size for the proxy's sockets. The kernel would otherwise
+ * grow it to several megabytes, letting senders push that much data past a
+ * bandwidth-limited link before they notice it's congested.
+ */
+const int RECEIVE_BUFFER_BYTES = 64 * 1024;
+
+/**
+ * Set the receive buffer size to RECEIVE_BUFFER_BYTES. This must be called
+ * before the socket is connected (or, for accepted sockets, on the listening
+ * socket) to limit the TCP window.
+ */
+void
+setReceiveBuffer(int fd)
+{
+    int size = RECEIVE_BUFFER_BYTES;
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) != 0) {
+        WARNING("Could not set SO_RCVBUF on socket %d: %s",
+                fd, strerror(errno));
+    }
+}
+
+/**
+ * Disable Nagle's algorithm, since the proxy writes whole messages at once.
+ */
+void
+setNoDelay(int fd)
+{
+    int flag = 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag)) != 0) {
+        WARNING("Could not set TCP_NODELAY on socket %d: %s",
+                fd, strerror(errno));
+    }
+}
+
+/**
+ * Read exactly 'length' bytes. Returns false on EOF or error.
+ */
+bool
+readFully(int fd, char* buf, size_t length)
+{
+    while (length > 0) {
+        ssize_t bytesRead = read(fd, buf, length);
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+        if (bytesRead <= 0)
+            return false;
+        buf += bytesRead;
+        length -= size_t(bytesRead);
+    }
+    return true;
+}
+
+/**
+ * Write exactly 'length' bytes. Returns false on error.
+ */
+bool
+writeFully(int fd, const char* buf, size_t length)
+{
+    while (length > 0) {
+        ssize_t bytesWritten = send(fd, buf, length, MSG_NOSIGNAL);
+        if (bytesWritten < 0 && errno == EINTR)
+            continue;
+        if (bytesWritten <= 0)
+            return false;
+        buf += bytesWritten;
+        length -= size_t(bytesWritten);
+    }
+    return true;
+}
+
+/**
+ * If the given message is a Raft RPC request, return the ID of the server
+ * that sent it. Otherwise, return 0.
+ */
+uint64_t
+getRaftSender(const std::string& message)
+{
+    using RPC::Protocol::RequestHeaderPrefix;
+    using RPC::Protocol::RequestHeaderVersion1;
+    using RPC::Protocol::RequestHeaderVersion2;
+    const char* payload = message.data() + MESSAGE_HEADER_LENGTH;
+    size_t length = message.size() - MESSAGE_HEADER_LENGTH;
+    if (length < sizeof(RequestHeaderPrefix))
+        return 0;
+    RequestHeaderPrefix prefix;
+    memcpy(&prefix, payload, sizeof(prefix));
+    prefix.fromBigEndian();
+    uint16_t service;
+    uint16_t opCode;
+    size_t headerLength;
+    if (prefix.version == 1 && length >= sizeof(RequestHeaderVersion1)) {
+        RequestHeaderVersion1 header;
+        memcpy(&header, payload, sizeof(header));
+        header.fromBigEndian();
+        service = header.service;
+        opCode = header.opCode;
+        headerLength = sizeof(header);
+    } else if (prefix.version == 2 &&
+               length >= sizeof(RequestHeaderVersion2)) {
+        RequestHeaderVersion2 header;
+        memcpy(&header, payload, sizeof(header));
+        header.fromBigEndian();
+        service = header.service;
+        opCode = header.opCode;
+        headerLength = sizeof(header);
+    } else {
+        return 0;
+    }
+    if (service != Protocol::Common::ServiceId::RAFT_SERVICE)
+        return 0;
+    const void* body = payload + headerLength;
+    int bodyLength = int(length - headerLength);
+    switch (opCode) {
+        case Protocol::Raft::OpCode::REQUEST_VOTE: {
+            Protocol::Raft::RequestVote::Request request;
+            if (request.ParsePartialFromArray(body, bodyLength) &&
+                request.has_server_id()) {
+                return request.server_id();
+            }
+            return 0;
+        }
+        case Protocol::Raft::OpCode::APPEND_ENTRY: {
+            Protocol::Raft::AppendEntry::Request request;
+            if (request.ParsePartialFromArray(body, bodyLength) &&
+                request.has_server_id()) {
+                return request.server_id();
+            }
+            return 0;
+        }
+        default:
+            return 0;
+    }
+}
+
+} // anonymous namespace
+
+////////// LinkProxy::Connection //////////
+
+/**
+ * One proxied connection. Each direction has a reader thread, which reads
+ * messages and asks the Network when to deliver them, and a writer thread,
+ * which delivers them at that time.
+ */
+class LinkProxy::Connection {
+  public:
+    Connection(Network& network, uint64_t targetId,
+               int clientFd, int serverFd)
+        : network(network)
+        , targetId(targetId)
+        , fds()
+        , mutex()
+        , changed()
+        , closed(false)
+        , sourceId(0)
+        , queues()
+        , threads()
+    {
+        fds[TO_SERVER] = serverFd;
+        fds[TO_CLIENT] = clientFd;
+        threads[0] = std::thread(&Connection::readerMain, this, TO_SERVER);
+        threads[1] = std::thread(&Connection::readerMain, this, TO_CLIENT);
+        threads[2] = std::thread(&Connection::writerMain, this, TO_SERVER);
+        threads[3] = std::thread(&Connection::writerMain, this, TO_CLIENT);
+    }
+
+    ~Connection()
+    {
+        close();
+        for (uint32_t i = 0; i < NUM_THREADS; ++i)
+            threads[i].join();
+        ::close(fds[TO_SERVER]);
+        ::close(fds[TO_CLIENT]);
+    }
+
+    bool isClosed() {
+        std::unique_lock<std::mutex> lockGuard(mutex);
+        return closed;
+    }
+
+  private:
+    enum Direction { TO_SERVER = 0, TO_CLIENT = 1 };
+    enum { NUM_THREADS = 4 };
+
+    struct Message {
+        Network::TimePoint deliveryAt;
+        std::string bytes;
+    };
+
+    /**
+     * Stop forwarding in both directions and wake up all threads.
+     */
+    void close() {
+        std::unique_lock<std::mutex> lockGuard(mutex);
+        if (!closed) {
+            closed = true;
+            shutdown(fds[TO_SERVER], SHUT_RDWR);
+            shutdown(fds[TO_CLIENT], SHUT_RDWR);
+        }
+        changed.notify_all();
+    }
+
+    /**
+     * Return the endpoints of the link used for the given direction.
+     * Must be called with #mutex held.
+     */
+    std::pair<uint64_t, uint64_t> getLink(Direction direction) const {
+        if (direction == TO_SERVER)
+            return {sourceId, targetId};
+        else
+            return {targetId, sourceId};
+    }
+
+    void readerMain(Direction direction) {
+        Core::ThreadId::setName("LinkProxy");
+        // Messages are read from the opposite socket they're written to.
+        int fd = fds[direction == TO_SERVER ? TO_CLIENT : TO_SERVER];
+        while (true) {
+            std::string message(MESSAGE_HEADER_LENGTH, '\0');
+            if (!readFully(fd, &message[0], MESSAGE_HEADER_LENGTH))
+                break;
+            uint32_t payloadLength;
+            memcpy(&payloadLength, message.data() + 8, sizeof(payloadLength));
+            payloadLength = be32toh(payloadLength);
+            message.resize(MESSAGE_HEADER_LENGTH + payloadLength);
+            if (!readFully(fd, &message[MESSAGE_HEADER_LENGTH],
+                           payloadLength)) {
+                break;
+            }
+            std::pair<uint64_t, uint64_t> link;
+            {
+                std::unique_lock<std::mutex> lockGuard(mutex);
+                if (direction == TO_SERVER && sourceId == 0)
+                    sourceId = getRaftSender(message);
+                link = getLink(direction);
+            }
+            Network::TimePoint deliveryAt =
+                network.schedule(link.first, link.second, message.size());
+            Network::TimePoint busyUntil =
+                network.getBusyUntil(link.first, link.second);
+            {
+                std::unique_lock<std::mutex> lockGuard(mutex);
+                queues[direction].push_back({deliveryAt, std::move(message)});
+                changed.notify_all();
+                // Like a real bottleneck link, don't take in the next message
+                // until this one has been transmitted. That way, the backlog
+                // builds up at the sender, which decides what to send next
+                // (see RPC::MessageSocket::Priority).
+                while (!closed && Network::Clock::now() < busyUntil)
+                    changed.wait_until(lockGuard, busyUntil);
+            }
+        }
+        close();
+    }
+
+    void writerMain(Direction direction) {
+        Core::ThreadId::setName("LinkProxy");
+        std::unique_lock<std::mutex> lockGuard(mutex);
+        std::deque<Message>& queue = queues[direction];
+        while (true) {
+            if (closed)
+                return;
+            if (queue.empty()) {
+                changed.wait(lockGuard);
+                continue;
+            }
+            Network::TimePoint deliveryAt = queue.front().deliveryAt;
+            if (Network::Clock::now() < deliveryAt) {
+                changed.wait_until(lockGuard, deliveryAt);
+                continue;
+            }
+            std::pair<uint64_t, uint64_t> link = getLink(direction);
+            if (!network.isUp(link.first, link.second)) {
+                // There's no notification for links coming back up, so poll.
+                changed.wait_for(lockGuard, std::chrono::milliseconds(1));
+                continue;
+            }
+            std::string bytes = std::move(queue.front().bytes);
+            queue.pop_front();
+            lockGuard.unlock();
+            bool ok = writeFully(fds[direction], bytes.data(), bytes.size());
+            lockGuard.lock();
+            if (!ok) {
+                lockGuard.unlock();
+                close();
+                return;
+            }
+        }
+    }
+
+    Network& network;
+    const uint64_t targetId;
+    /// Sockets to write to, indexed by Direction.
+    int fds[2];
+    /// Protects the following members.
+    std::mutex mutex;
+    /// Notified when a message is queued or the connection is closed.
+    std::condition_variable changed;
+    bool closed;
+    /// The server ID of the connecting side, or 0 if unknown or a client.
+    uint64_t sourceId;
+    /// Messages awaiting delivery, indexed by Direction.
+    std::deque<Message> queues[2];
+    std::thread threads[NUM_THREADS];
+
+    // Connection is non-copyable.
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+};
+
+////////// LinkProxy //////////
+
+LinkProxy::LinkProxy(Network& network, uint64_t targetId, uint16_t targetPort)
+    : network(network)
+    , targetId(targetId)
+    , targetPort(targetPort)
+    , listenFd(-1)
+    , port(0)
+    , mutex()
+    , connections()
+    , acceptThread()
+{
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0)
+        PANIC("Could not create socket: %s", strerror(errno));
+    int flag = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    setReceiveBuffer(listenFd);
+    struct sockaddr_in address = loopbackAddress(0);
+    if (bind(listenFd, reinterpret_cast<struct sockaddr*>(&address),
+             sizeof(address)) != 0) {
+        PANIC("Could not bind proxy socket: %s", strerror(errno));
+    }
+    if (listen(listenFd, 64) != 0)
+        PANIC("Could not listen on proxy socket: %s", strerror(errno));
+    socklen_t addressLength = sizeof(address);
+    if (getsockname(listenFd, reinterpret_cast<struct sockaddr*>(&address),
+                    &addressLength) != 0) {
+        PANIC("getsockname failed: %s", strerror(errno));
+    }
+    port = ntohs(address.sin_port);
+    acceptThread = std::thread(&LinkProxy::acceptThreadMain, this);
+}
+
+LinkProxy::~LinkProxy()
+{
+    // This wakes up the accept thread.
+    shutdown(listenFd, SHUT_RDWR);
+    acceptThread.join();
+    close(listenFd);
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    connections.clear();
+}
+
+uint16_t
+LinkProxy::getPort() const
+{
+    return port;
+}
+
+void
+LinkProxy::acceptThreadMain()
+{
+    Core::ThreadId::setName("LinkProxy");
+    while (true) {
+        int clientFd = accept(listenFd, NULL, NULL);
+        if (clientFd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            return; // the listening socket was shut down
+        }
+        int serverFd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in address = loopbackAddress(targetPort);
+        if (serverFd >= 0)
+            setReceiveBuffer(serverFd);
+        if (serverFd < 0 ||
+            connect(serverFd, reinterpret_cast<struct sockaddr*>(&address),
+                    sizeof(address)) != 0) {
+            VERBOSE("Could not connect to server %lu on port %u: %s",
+                    targetId, targetPort, strerror(errno));
+            if (serverFd >= 0)
+                close(serverFd);
+            close(clientFd);
+            continue;
+        }
+        setNoDelay(clientFd);
+        setNoDelay(serverFd);
+
+        std::unique_lock<std::mutex> lockGuard(mutex);
+        for (auto it = connections.begin(); it != connections.end(); ) {
+            if ((*it)->isClosed())
+                it = connections.erase(it);
+            else
+                ++it;
+        }
+        connections.emplace_back(
+            new Connection(network, targetId, clientFd, serverFd));
+    }
+}
+
+} // namespace LogCabin::Harness
+} // namespace LogCabin
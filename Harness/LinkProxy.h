@@ -0,0 +1,124 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cinttypes>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Harness/Network.h"
+
+#ifndef LOGCABIN_HARNESS_LINKPROXY_H
+#define LOGCABIN_HARNESS_LINKPROXY_H
+
+namespace LogCabin {
+namespace Harness {
+
+/**
+ * Listens on a loopback port in front of one server and forwards every
+ * connection to that server, subjecting each message to the conditions that
+ * the Network prescribes for its link.
+ *
+ * The proxy understands the framing of RPC::MessageSocket, so it delays and
+ * holds whole messages. It learns which server is on the other end of a
+ * connection from the server_id field of the first Raft RPC sent over it;
+ * until then (and for client connections) the sender is taken to be 0.
+ *
+ * Each connection is served by its own threads using blocking I/O. This keeps
+ * the proxy simple and independent of the event loops of the servers it sits
+ * between.
+ */
+class LinkProxy {
+  public:
+    /**
+     * Constructor. This starts listening right away.
+     * \param network
+     *      Decides when messages are delivered.
+     * \param targetId
+     *      The server ID of the server to forward connections to.
+     * \param targetPort
+     *      The loopback port on which that server listens.
+     */
+    LinkProxy(Network& network, uint64_t targetId, uint16_t targetPort);
+
+    /**
+     * Destructor. Closes all connections.
+     */
+    ~LinkProxy();
+
+    /**
+     * Return the loopback port on which this proxy listens.
+     */
+    uint16_t getPort() const;
+
+  private:
+    class Connection; // defined in LinkProxy.cc
+
+    /**
+     * Accepts connections until the listening socket is shut down.
+     */
+    void acceptThreadMain();
+
+    /**
+     * See constructor.
+     */
+    Network& network;
+
+    /**
+     * See constructor.
+     */
+    const uint64_t targetId;
+
+    /**
+     * See constructor.
+     */
+    const uint16_t targetPort;
+
+    /**
+     * The listening socket.
+     */
+    int listenFd;
+
+    /**
+     * See getPort().
+     */
+    uint16_t port;
+
+    /**
+     * Protects #connections.
+     */
+    std::mutex mutex;
+
+    /**
+     * Connections accepted so far. Closed connections are cleaned up as new
+     * ones are accepted.
+     */
+    std::vector<std::unique_ptr<Connection>> connections;
+
+    /**
+     * Runs acceptThreadMain().
+     */
+    std::thread acceptThread;
+
+    // LinkProxy is non-copyable.
+    LinkProxy(const LinkProxy&) = delete;
+    LinkProxy& operator=(const LinkProxy&) = delete;
+}; // class LinkProxy
+
+} // namespace LogCabin::Harness
+} // namespace LogCabin
+
+#endif /* LOGCABIN_HARNESS_LINKPROXY_H */
@@ -0,0 +1,356 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+
+#include "Core/Debug.h"
+#include "Core/StringUtil.h"
+#include "Harness/LocalCluster.h"
+#include "Server/RaftConsensus.h"
+#include "Server/Globals.h"
+#include "Server/ServerStats.h"
+#include "Storage/FilesystemUtil.h"
+
+namespace LogCabin {
+namespace Harness {
+
+namespace {
+
+using Core::StringUtil::format;
+
+/**
+ * Return 'count' distinct loopback ports that are currently free.
+ */
+std::vector<uint16_t>
+getFreePorts(uint32_t count)
+{
+    std::vector<int> fds;
+    std::vector<uint16_t> ports;
+    for (uint32_t i = 0; i < count; ++i) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            PANIC("Could not create socket: %s", strerror(errno));
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+        socklen_t addressLength = sizeof(address);
+        if (bind(fd, reinterpret_cast<struct sockaddr*>(&address),
+                 addressLength) != 0 ||
+            getsockname(fd, reinterpret_cast<struct sockaddr*>(&address),
+                        &addressLength) != 0) {
+            PANIC("Could not find a free port: %s", strerror(errno));
+        }
+        // Keep the socket open until all ports are chosen so that they are
+        // distinct.
+        fds.push_back(fd);
+        ports.push_back(ntohs(address.sin_port));
+    }
+    for (auto it = fds.begin(); it != fds.end(); ++it)
+        close(*it);
+    return ports;
+}
+
+/**
+ * Concatenate the given strings, separated by semicolons.
+ */
+std::string
+join(const std::vector<std::string>& strings)
+{
+    std::string result;
+    for (auto it = strings.begin(); it != strings.end(); ++it) {
+        if (!result.empty())
+            result += ";";
+        result += *it;
+    }
+    return result;
+}
+
+} // anonymous namespace
+
+////////// LocalCluster::Setting //////////
+
+LocalCluster::Setting::Setting()
+    : serverId(0)
+    , key()
+    , value()
+{
+}
+
+////////// LocalCluster::Server //////////
+
+LocalCluster::Server::Server()
+    : globals()
+    , thread()
+    , proxy()
+{
+}
+
+LocalCluster::Server::~Server()
+{
+}
+
+////////// LocalCluster //////////
+
+LocalCluster::LocalCluster(uint32_t numServers,
+                           const std::string& storageDir,
+                           uint32_t seed,
+                           const std::vector<Setting>& settings)
+    : storageDir(storageDir)
+    , removeStorageDir(false)
+    , servers()
+    , network(seed)
+{
+    if (numServers == 0)
+        PANIC("A cluster needs at least one server");
+    if (this->storageDir.empty()) {
+        // Prefer tmpfs so that disk writes don't dominate the measurements.
+        const char* parent = "/tmp";
+        struct stat st;
+        if (stat("/dev/shm", &st) == 0 && S_ISDIR(st.st_mode))
+            parent = "/dev/shm";
+        std::string pattern = format("%s/logcabin-cluster-XXXXXX", parent);
+        if (mkdtemp(&pattern[0]) == NULL) {
+            PANIC("Could not create storage directory %s: %s",
+                  pattern.c_str(), strerror(errno));
+        }
+        this->storageDir = pattern;
+        removeStorageDir = true;
+    } else {
+        if (mkdir(this->storageDir.c_str(), 0755) != 0 && errno != EEXIST) {
+            PANIC("Could not create storage directory %s: %s",
+                  this->storageDir.c_str(), strerror(errno));
+        }
+    }
+    NOTICE("Starting a cluster of %u servers in %s",
+           numServers, this->storageDir.c_str());
+
+    std::vector<uint16_t> serverPorts = getFreePorts(numServers);
+    std::vector<std::string> listenAddresses;
+    for (uint32_t i = 0; i < numServers; ++i) {
+        listenAddresses.push_back(format("127.0.0.1:%u", serverPorts.at(i)));
+        servers.emplace_back(new Server());
+    }
+
+    std::vector<uint16_t> proxyPorts;
+    for (uint32_t i = 0; i < numServers; ++i) {
+        servers.at(i)->proxy.reset(
+            new LinkProxy(network, i + 1, serverPorts.at(i)));
+        proxyPorts.push_back(servers.at(i)->proxy->getPort());
+    }
+    uint32_t numGroups = 1;
+    for (auto it = settings.begin(); it != settings.end(); ++it) {
+        if (it->key == "raftGroups")
+            numGroups = uint32_t(std::stoul(it->value));
+    }
+    bootstrap(proxyPorts, numGroups);
+
+    std::string servers = join(listenAddresses);
+    for (uint32_t i = 0; i < numServers; ++i) {
+        Server& server = *this->servers.at(i);
+        server.globals.reset(new LogCabin::Server::Globals());
+        Core::Config& config = server.globals->config;
+        config.set("storageModule", "memory");
+        config.set("uuid", format("local-cluster-%u", i + 1));
+        config.set("servers", servers);
+        config.set("raftLogPath", this->storageDir);
+        for (auto it = settings.begin(); it != settings.end(); ++it) {
+            if (it->serverId == 0 || it->serverId == i + 1)
+                config.set(it->key, it->value);
+        }
+        server.globals->init(i + 1);
+        server.thread = std::thread(&LogCabin::Server::Globals::run,
+                                    server.globals.get());
+    }
+}
+
+LocalCluster::~LocalCluster()
+{
+    // Peers wait for their RPCs with no timeout once the event loops stop,
+    // so cut every connection first. With the proxies gone, in-flight RPCs
+    // fail as soon as the event loops notice, and new ones fail to connect.
+    for (auto it = servers.begin(); it != servers.end(); ++it)
+        (*it)->proxy.reset();
+    usleep(100 * 1000);
+    // Then shut down the servers the same way SIGINT does.
+    for (auto it = servers.begin(); it != servers.end(); ++it) {
+        Server& server = **it;
+        server.globals->eventLoop.exit();
+        server.thread.join();
+    }
+    for (auto it = servers.begin(); it != servers.end(); ++it)
+        (*it)->globals.reset();
+    servers.clear();
+    if (removeStorageDir)
+        Storage::FilesystemUtil::remove(storageDir);
+}
+
+uint32_t
+LocalCluster::getNumServers() const
+{
+    return uint32_t(servers.size());
+}
+
+uint32_t
+LocalCluster::getNumGroups() const
+{
+    return uint32_t(servers.at(0)->globals->rafts.size());
+}
+
+std::string
+LocalCluster::getAddress(uint64_t serverId) const
+{
+    return format("127.0.0.1:%u", servers.at(serverId - 1)->proxy->getPort());
+}
+
+Protocol::Client::ServerStats
+LocalCluster::getStats(uint64_t serverId)
+{
+    return servers.at(serverId - 1)->globals->serverStats->getCurrent();
+}
+
+Protocol::Client::ServerStats
+LocalCluster::getGroupStats(uint64_t serverId, uint32_t groupId)
+{
+    Protocol::Client::ServerStats stats;
+    servers.at(serverId - 1)->globals->rafts.at(groupId)->
+        updateServerStats(stats);
+    return stats;
+}
+
+uint64_t
+LocalCluster::waitForLeader(std::chrono::milliseconds timeout,
+                            uint64_t excluding)
+{
+    typedef Core::Time::SteadyClock Clock;
+    Clock::time_point deadline = Clock::now() + timeout;
+    while (true) {
+        // Count the servers that agree on each (term, leader) pair.
+        std::vector<Protocol::Client::ServerStats> stats;
+        std::map<std::pair<uint64_t, uint64_t>, uint32_t> votes;
+        for (uint64_t id = 1; id <= servers.size(); ++id) {
+            stats.push_back(getStats(id));
+            if (stats.back().leader_id() != 0) {
+                ++votes[{stats.back().current_term(),
+                         stats.back().leader_id()}];
+            }
+        }
+        // A deposed leader may not know it yet, so check every claimant.
+        for (uint64_t id = 1; id <= servers.size(); ++id) {
+            const Protocol::Client::ServerStats& leader = stats.at(id - 1);
+            if (id != excluding &&
+                leader.state() == "State::LEADER" &&
+                votes[{leader.current_term(), id}] > servers.size() / 2) {
+                return id;
+            }
+        }
+        if (Clock::now() >= deadline)
+            return 0;
+        usleep(1000);
+    }
+}
+
+bool
+LocalCluster::transferLeadership(uint32_t groupId, uint64_t serverId,
+                                 std::chrono::milliseconds timeout)
+{
+    typedef Core::Time::SteadyClock Clock;
+    Clock::time_point deadline = Clock::now() + timeout;
+    while (true) {
+        // A deposed leader may not know it yet, so go by the newest term.
+        uint64_t leaderId = 0;
+        uint64_t leaderTerm = 0;
+        for (uint64_t id = 1; id <= servers.size(); ++id) {
+            Protocol::Client::ServerStats stats = getGroupStats(id, groupId);
+            if (stats.state() == "State::LEADER" &&
+                stats.current_term() >= leaderTerm) {
+                leaderId = id;
+                leaderTerm = stats.current_term();
+            }
+        }
+        if (leaderId == serverId)
+            return true;
+        if (leaderId != 0) {
+            uint64_t newLeaderId = 0;
+            std::string reason;
+            servers.at(leaderId - 1)->globals->rafts.at(groupId)->
+                transferLeadership(serverId, newLeaderId, reason);
+        }
+        if (Clock::now() >= deadline)
+            return false;
+        usleep(1000);
+    }
+}
+
+void
+LocalCluster::isolate(uint64_t serverId)
+{
+    network.setServerUp(serverId, servers.size(), false);
+}
+
+void
+LocalCluster::rejoin(uint64_t serverId)
+{
+    network.setServerUp(serverId, servers.size(), true);
+}
+
+void
+LocalCluster::bootstrap(const std::vector<uint16_t>& proxyPorts,
+                        uint32_t numGroups)
+{
+    using LogCabin::Server::RaftConsensusInternal::Log;
+    Protocol::Raft::Configuration configuration;
+    for (uint32_t i = 0; i < proxyPorts.size(); ++i) {
+        Protocol::Raft::Server& server =
+            *configuration.mutable_prev_configuration()->add_servers();
+        server.set_server_id(i + 1);
+        server.set_address(format("127.0.0.1:%u", proxyPorts.at(i)));
+    }
+    for (uint32_t i = 0; i < proxyPorts.size(); ++i) {
+        for (uint32_t groupId = 0; groupId < numGroups; ++groupId) {
+            // This matches the path in RaftConsensus::init().
+            std::string path = format("%s/%u", storageDir.c_str(), i + 1);
+            if (groupId != 0)
+                path += format(".%u", groupId);
+            Log log(path);
+            if (log.getLastLogId() > 0) {
+                // Reusing a storage directory: the old servers' addresses
+                // are stale, so start over.
+                PANIC("Storage directory %s already contains a Raft log",
+                      storageDir.c_str());
+            }
+            Log::Entry entry;
+            entry.term = 1;
+            entry.type = Protocol::Raft::EntryType::CONFIGURATION;
+            entry.configuration = configuration;
+            log.append(entry);
+            log.metadata.set_current_term(1);
+            log.updateMetadata();
+        }
+    }
+}
+
+} // namespace LogCabin::Harness
+} // namespace LogCabin
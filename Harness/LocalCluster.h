@@ -0,0 +1,219 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <chrono>
+#include <cinttypes>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "build/Protocol/Client.pb.h"
+#include "Harness/LinkProxy.h"
+#include "Harness/Network.h"
+
+#ifndef LOGCABIN_HARNESS_LOCALCLUSTER_H
+#define LOGCABIN_HARNESS_LOCALCLUSTER_H
+
+namespace LogCabin {
+
+// forward declaration
+namespace Server {
+class Globals;
+}
+
+namespace Harness {
+
+/**
+ * Runs a complete LogCabin cluster inside the current process, for
+ * benchmarks and tests that need several servers but not several machines.
+ *
+ * Each server is a full Server::Globals with its own event loop thread,
+ * listening on a loopback port. The servers only know each other (and
+ * clients only know them) by the addresses of LinkProxy objects, so every
+ * message between two servers or between a client and a server crosses the
+ * simulated #network, whose conditions can be changed at any time.
+ *
+ * The servers keep their Raft logs under a storage directory, which defaults
+ * to a fresh directory on tmpfs, and use the in-memory storage module. The
+ * cluster starts out with all servers in its configuration and no leader.
+ */
+class LocalCluster {
+  public:
+    /**
+     * A config file setting for some of the servers, such as
+     * "raftLogLatencyAppend" to give them a slow disk.
+     */
+    struct Setting {
+        Setting();
+        /// The server to apply this to, or 0 for every server.
+        uint64_t serverId;
+        /// The name of the setting.
+        std::string key;
+        /// The value of the setting.
+        std::string value;
+    };
+
+    /**
+     * Constructor. This starts all of the servers.
+     * \param numServers
+     *      The number of servers, with IDs 1 through numServers.
+     * \param storageDir
+     *      The directory to keep the servers' Raft logs in. If empty, a
+     *      temporary directory is created, and it is removed again by the
+     *      destructor.
+     * \param seed
+     *      Seeds the #network's random number generator.
+     * \param settings
+     *      Added to the servers' configuration, overriding the defaults.
+     */
+    explicit LocalCluster(uint32_t numServers,
+                          const std::string& storageDir = "",
+                          uint32_t seed = 1,
+                          const std::vector<Setting>& settings =
+                            std::vector<Setting>());
+
+    /**
+     * Destructor. Stops all of the servers.
+     */
+    ~LocalCluster();
+
+    /**
+     * Return the number of servers in the cluster.
+     */
+    uint32_t getNumServers() const;
+
+    /**
+     * Return the number of Raft groups each server runs (see the
+     * "raftGroups" setting).
+     */
+    uint32_t getNumGroups() const;
+
+    /**
+     * Return the address at which clients can reach the given server through
+     * the #network, for use with Client::Cluster. Other servers redirect
+     * clients to the leader once they know it, but starting out at the
+     * leader saves a round trip.
+     */
+    std::string getAddress(uint64_t serverId) const;
+
+    /**
+     * Return the statistics of the given server, as the GetServerStats RPC
+     * would.
+     */
+    Protocol::Client::ServerStats getStats(uint64_t serverId);
+
+    /**
+     * Return the Raft statistics of one of the given server's Raft groups:
+     * its term, state, leader, and log, but none of the server-wide fields
+     * that getStats() also fills in.
+     */
+    Protocol::Client::ServerStats getGroupStats(uint64_t serverId,
+                                                uint32_t groupId);
+
+    /**
+     * Wait until a majority of the servers agree on a leader.
+     * \param timeout
+     *      Give up after this long.
+     * \param excluding
+     *      Don't accept this server as leader, for example because it was
+     *      just isolated and hasn't noticed yet. 0 accepts any server.
+     * \return
+     *      The leader's server ID, or 0 if the timeout expired first.
+     */
+    uint64_t waitForLeader(std::chrono::milliseconds timeout,
+                           uint64_t excluding = 0);
+
+    /**
+     * Hand off leadership of one Raft group to the given server, as the
+     * TransferLeadership RPC does for group 0.
+     * \param groupId
+     *      The Raft group to move.
+     * \param serverId
+     *      The server that should lead it.
+     * \param timeout
+     *      Give up after this long.
+     * \return
+     *      True if the server leads the group, false if the timeout expired
+     *      first.
+     */
+    bool transferLeadership(uint32_t groupId, uint64_t serverId,
+                            std::chrono::milliseconds timeout);
+
+    /**
+     * Cut the given server off from the rest of the cluster and from
+     * clients. Its messages are held until rejoin() is called.
+     */
+    void isolate(uint64_t serverId);
+
+    /**
+     * Undo isolate().
+     */
+    void rejoin(uint64_t serverId);
+
+  private:
+    /**
+     * One server of the cluster.
+     */
+    struct Server {
+        Server();
+        ~Server();
+        /// The server itself.
+        std::unique_ptr<LogCabin::Server::Globals> globals;
+        /// Runs globals->run().
+        std::thread thread;
+        /// Sits in front of the server.
+        std::unique_ptr<LinkProxy> proxy;
+    };
+
+    /**
+     * Write the initial configuration to the Raft log of each server, once
+     * for each of the numGroups Raft groups.
+     */
+    void bootstrap(const std::vector<uint16_t>& proxyPorts,
+                   uint32_t numGroups);
+
+    /**
+     * See constructor.
+     */
+    std::string storageDir;
+
+    /**
+     * True if #storageDir was created by the constructor.
+     */
+    bool removeStorageDir;
+
+    /**
+     * The servers, indexed by server ID - 1.
+     */
+    std::vector<std::unique_ptr<Server>> servers;
+
+  public:
+    /**
+     * The simulated network connecting the servers and their clients. Server
+     * IDs name its endpoints, and 0 stands for all clients.
+     */
+    Network network;
+
+  private:
+    // LocalCluster is non-copyable.
+    LocalCluster(const LocalCluster&) = delete;
+    LocalCluster& operator=(const LocalCluster&) = delete;
+}; // class LocalCluster
+
+} // namespace LogCabin::Harness
+} // namespace LogCabin
+
+#endif /* LOGCABIN_HARNESS_LOCALCLUSTER_H */
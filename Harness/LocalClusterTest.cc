@@ -0,0 +1,66 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "Client/Client.h"
+#include "Harness/LocalCluster.h"
+
+namespace LogCabin {
+namespace Harness {
+namespace {
+
+TEST(HarnessLocalClusterTest, basics) {
+    LocalCluster cluster(3);
+    EXPECT_EQ(3U, cluster.getNumServers());
+    uint64_t leaderId = cluster.waitForLeader(std::chrono::seconds(10));
+    ASSERT_NE(0U, leaderId);
+
+    Client::Cluster client(cluster.getAddress(leaderId));
+    Client::Log log = client.openLog("test");
+    EXPECT_EQ(0U, log.append(Client::Entry("hello", 5)));
+    Client::ReadResult entries = log.read(0);
+    ASSERT_EQ(1U, entries.size());
+    EXPECT_EQ("hello",
+              std::string(static_cast<const char*>(entries.at(0).getData()),
+                          entries.at(0).getLength()));
+
+    uint64_t term = cluster.getStats(leaderId).current_term();
+    cluster.isolate(leaderId);
+    uint64_t newLeaderId = cluster.waitForLeader(std::chrono::seconds(10),
+                                                 leaderId);
+    ASSERT_NE(0U, newLeaderId);
+    EXPECT_NE(leaderId, newLeaderId);
+    EXPECT_LT(term, cluster.getStats(newLeaderId).current_term());
+    cluster.rejoin(leaderId);
+}
+
+TEST(HarnessLocalClusterTest, transferLeadership) {
+    LocalCluster cluster(3);
+    uint64_t leaderId = cluster.waitForLeader(std::chrono::seconds(10));
+    ASSERT_NE(0U, leaderId);
+    uint64_t newLeaderId = leaderId % 3 + 1;
+    EXPECT_TRUE(cluster.transferLeadership(0, newLeaderId,
+                                           std::chrono::seconds(10)));
+    EXPECT_EQ(newLeaderId, cluster.waitForLeader(std::chrono::seconds(10)));
+    EXPECT_TRUE(cluster.transferLeadership(0, newLeaderId,
+                                           std::chrono::seconds(0)));
+}
+
+} // namespace LogCabin::Harness::<anonymous>
+} // namespace LogCabin::Harness
+} // namespace LogCabin
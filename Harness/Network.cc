@@ -0,0 +1,156 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <algorithm>
+
+#include "Harness/Network.h"
+
+namespace LogCabin {
+namespace Harness {
+
+////////// LinkOptions //////////
+
+LinkOptions::LinkOptions()
+    : delay(0)
+    , bandwidth(0)
+    , lossRate(0)
+    , retransmitTimeout(200 * 1000)
+    , up(true)
+{
+}
+
+////////// Network::Link //////////
+
+Network::Link::Link()
+    : options()
+    , busyUntil(TimePoint::min())
+    , lastDeliveryAt(TimePoint::min())
+{
+}
+
+////////// Network //////////
+
+Network::Network(uint32_t seed)
+    : mutex()
+    , defaultOptions()
+    , links()
+    , random(seed)
+{
+}
+
+Network::~Network()
+{
+}
+
+void
+Network::setLink(uint64_t from, uint64_t to, const LinkOptions& options)
+{
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    getLinkState(from, to).options = options;
+}
+
+void
+Network::setAllLinks(uint64_t maxServerId, const LinkOptions& options)
+{
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    defaultOptions = options;
+    for (uint64_t from = 0; from <= maxServerId; ++from) {
+        for (uint64_t to = 0; to <= maxServerId; ++to)
+            getLinkState(from, to).options = options;
+    }
+}
+
+LinkOptions
+Network::getLink(uint64_t from, uint64_t to) const
+{
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    auto it = links.find({from, to});
+    if (it == links.end())
+        return defaultOptions;
+    return it->second.options;
+}
+
+void
+Network::setServerUp(uint64_t serverId, uint64_t maxServerId, bool up)
+{
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    for (uint64_t other = 0; other <= maxServerId; ++other) {
+        if (other == serverId)
+            continue;
+        getLinkState(serverId, other).options.up = up;
+        getLinkState(other, serverId).options.up = up;
+    }
+}
+
+bool
+Network::isUp(uint64_t from, uint64_t to) const
+{
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    auto it = links.find({from, to});
+    if (it == links.end())
+        return defaultOptions.up;
+    return it->second.options.up;
+}
+
+Network::TimePoint
+Network::schedule(uint64_t from, uint64_t to, uint64_t bytes)
+{
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    Link& link = getLinkState(from, to);
+    const LinkOptions& options = link.options;
+    TimePoint now = Clock::now();
+
+    // Transmission: wait for the bytes queued ahead to go out first.
+    TimePoint start = std::max(now, link.busyUntil);
+    link.busyUntil = start;
+    if (options.bandwidth > 0) {
+        link.busyUntil += std::chrono::microseconds(
+            bytes * 1000 * 1000 / options.bandwidth);
+    }
+
+    // Propagation, plus retransmissions for lost messages.
+    TimePoint deliveryAt = link.busyUntil + options.delay;
+    if (options.lossRate > 0) {
+        std::uniform_real_distribution<double> coin(0, 1);
+        while (coin(random) < options.lossRate)
+            deliveryAt += options.retransmitTimeout;
+    }
+
+    // TCP delivers in order.
+    deliveryAt = std::max(deliveryAt, link.lastDeliveryAt);
+    link.lastDeliveryAt = deliveryAt;
+    return deliveryAt;
+}
+
+Network::TimePoint
+Network::getBusyUntil(uint64_t from, uint64_t to)
+{
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    return getLinkState(from, to).busyUntil;
+}
+
+Network::Link&
+Network::getLinkState(uint64_t from, uint64_t to)
+{
+    auto it = links.find({from, to});
+    if (it == links.end()) {
+        it = links.insert({{from, to}, Link()}).first;
+        it->second.options = defaultOptions;
+    }
+    return it->second;
+}
+
+} // namespace LogCabin::Harness
+} // namespace LogCabin
@@ -0,0 +1,204 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cinttypes>
+#include <map>
+#include <mutex>
+#include <random>
+#include <utility>
+
+#include "Core/Time.h"
+
+#ifndef LOGCABIN_HARNESS_NETWORK_H
+#define LOGCABIN_HARNESS_NETWORK_H
+
+namespace LogCabin {
+namespace Harness {
+
+/**
+ * The conditions to simulate on a one-way network link.
+ */
+struct LinkOptions {
+    /// Constructor. The defaults describe a perfect network.
+    LinkOptions();
+
+    /**
+     * Added to the time it takes every message to cross the link.
+     */
+    std::chrono::microseconds delay;
+
+    /**
+     * The number of bytes per second the link can carry, or 0 for no limit.
+     * Messages queue up behind each other when this is exceeded.
+     */
+    uint64_t bandwidth;
+
+    /**
+     * The probability that a message is lost in transit. Since LogCabin runs
+     * over TCP, losing a message doesn't drop it: it is delivered after an
+     * extra #retransmitTimeout (possibly more than once), and the messages
+     * behind it on the link wait for it.
+     */
+    double lossRate;
+
+    /**
+     * See #lossRate.
+     */
+    std::chrono::microseconds retransmitTimeout;
+
+    /**
+     * If false, the link is partitioned: messages are held until the link
+     * comes back up or the connection is closed, just like a TCP connection
+     * whose packets are not getting through.
+     */
+    bool up;
+};
+
+/**
+ * A simulated network between the servers of a LocalCluster. This holds the
+ * LinkOptions for every directed pair of endpoints and decides when each
+ * message sent across a link will arrive. LinkProxy objects consult it to
+ * forward real messages.
+ *
+ * Endpoints are named by server ID; ID 0 stands for clients.
+ *
+ * This class is thread-safe.
+ */
+class Network {
+  public:
+    typedef Core::Time::SteadyClock Clock;
+    typedef Clock::time_point TimePoint;
+
+    /**
+     * Constructor.
+     * \param seed
+     *      Seeds the random number generator that simulates message loss,
+     *      so that runs are repeatable.
+     */
+    explicit Network(uint32_t seed = 1);
+
+    /**
+     * Destructor.
+     */
+    ~Network();
+
+    /**
+     * Set the conditions for messages from 'from' to 'to'.
+     */
+    void setLink(uint64_t from, uint64_t to, const LinkOptions& options);
+
+    /**
+     * Set the conditions for all links in both directions between the given
+     * endpoints, including links to and from clients. This also becomes the
+     * default for links that have not been set explicitly.
+     * \param maxServerId
+     *      The largest server ID in use.
+     * \param options
+     *      The conditions to apply.
+     */
+    void setAllLinks(uint64_t maxServerId, const LinkOptions& options);
+
+    /**
+     * Return the conditions for messages from 'from' to 'to'.
+     */
+    LinkOptions getLink(uint64_t from, uint64_t to) const;
+
+    /**
+     * Take down or bring up every link to and from the given server.
+     * \param serverId
+     *      The server to isolate or reconnect.
+     * \param maxServerId
+     *      The largest server ID in use.
+     * \param up
+     *      False to isolate the server, true to reconnect it.
+     */
+    void setServerUp(uint64_t serverId, uint64_t maxServerId, bool up);
+
+    /**
+     * Return whether messages can currently cross the link from 'from' to
+     * 'to'.
+     */
+    bool isUp(uint64_t from, uint64_t to) const;
+
+    /**
+     * Account for a message being sent across a link now.
+     * \param from
+     *      The sending endpoint.
+     * \param to
+     *      The receiving endpoint.
+     * \param bytes
+     *      The size of the message.
+     * \return
+     *      The time at which the message should be delivered, assuming the
+     *      link is up. Messages on the same link are delivered in the order
+     *      they were sent.
+     */
+    TimePoint schedule(uint64_t from, uint64_t to, uint64_t bytes);
+
+    /**
+     * Return the time at which the link from 'from' to 'to' finishes
+     * transmitting the messages scheduled on it so far. This is in the past
+     * if the link is idle.
+     */
+    TimePoint getBusyUntil(uint64_t from, uint64_t to);
+
+  private:
+    /**
+     * The state of one directed link.
+     */
+    struct Link {
+        Link();
+        /// See LinkOptions.
+        LinkOptions options;
+        /// The time when the link finishes transmitting the queued bytes.
+        TimePoint busyUntil;
+        /// The delivery time of the last message scheduled.
+        TimePoint lastDeliveryAt;
+    };
+
+    /**
+     * Find or create the given link. Must be called with #mutex held.
+     */
+    Link& getLinkState(uint64_t from, uint64_t to);
+
+    /**
+     * Protects all of the following members.
+     */
+    mutable std::mutex mutex;
+
+    /**
+     * Used for links that have not been set explicitly.
+     */
+    LinkOptions defaultOptions;
+
+    /**
+     * Directed links, keyed by (from, to).
+     */
+    std::map<std::pair<uint64_t, uint64_t>, Link> links;
+
+    /**
+     * Simulates message loss.
+     */
+    std::mt19937 random;
+
+    // Network is non-copyable.
+    Network(const Network&) = delete;
+    Network& operator=(const Network&) = delete;
+}; // class Network
+
+} // namespace LogCabin::Harness
+} // namespace LogCabin
+
+#endif /* LOGCABIN_HARNESS_NETWORK_H */
@@ -0,0 +1,121 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Harness/Network.h"
+
+namespace LogCabin {
+namespace Harness {
+namespace {
+
+typedef Network::Clock Clock;
+using std::chrono::microseconds;
+
+class HarnessNetworkTest : public ::testing::Test {
+    HarnessNetworkTest()
+        : network()
+        , now(Clock::now())
+    {
+        Clock::useMockValue = true;
+        Clock::mockValue = now;
+    }
+    ~HarnessNetworkTest()
+    {
+        Clock::useMockValue = false;
+    }
+    Network network;
+    Clock::time_point now;
+};
+
+TEST_F(HarnessNetworkTest, schedule_perfect) {
+    EXPECT_EQ(now, network.schedule(0, 1, 1000));
+    EXPECT_EQ(now, network.schedule(1, 0, 1000));
+}
+
+TEST_F(HarnessNetworkTest, schedule_delay) {
+    LinkOptions options;
+    options.delay = microseconds(500);
+    network.setLink(1, 2, options);
+    EXPECT_EQ(now + microseconds(500), network.schedule(1, 2, 10));
+    EXPECT_EQ(now, network.schedule(2, 1, 10));
+}
+
+TEST_F(HarnessNetworkTest, schedule_bandwidth) {
+    LinkOptions options;
+    options.bandwidth = 1000 * 1000; // 1 byte per microsecond
+    network.setLink(1, 2, options);
+    EXPECT_EQ(now + microseconds(100), network.schedule(1, 2, 100));
+    // queues behind the first message
+    EXPECT_EQ(now + microseconds(150), network.schedule(1, 2, 50));
+    // the link has drained by then
+    Clock::mockValue = now + microseconds(1000);
+    EXPECT_EQ(now + microseconds(1010), network.schedule(1, 2, 10));
+}
+
+TEST_F(HarnessNetworkTest, schedule_loss) {
+    LinkOptions options;
+    options.lossRate = 0.5;
+    options.retransmitTimeout = microseconds(1000);
+    network.setLink(1, 2, options);
+    uint32_t delayed = 0;
+    for (uint32_t i = 0; i < 100; ++i) {
+        // far enough apart that earlier messages don't hold this one up
+        Clock::mockValue = now + std::chrono::seconds(i);
+        Clock::time_point deliveryAt = network.schedule(1, 2, 10);
+        EXPECT_EQ(0, std::chrono::duration_cast<microseconds>(
+                        deliveryAt - Clock::mockValue).count() % 1000);
+        if (deliveryAt > Clock::mockValue)
+            ++delayed;
+    }
+    EXPECT_LT(10U, delayed);
+    EXPECT_GT(90U, delayed);
+}
+
+TEST_F(HarnessNetworkTest, schedule_fifo) {
+    LinkOptions options;
+    options.delay = microseconds(500);
+    network.setLink(1, 2, options);
+    EXPECT_EQ(now + microseconds(500), network.schedule(1, 2, 10));
+    options.delay = microseconds(0);
+    network.setLink(1, 2, options);
+    EXPECT_EQ(now + microseconds(500), network.schedule(1, 2, 10));
+}
+
+TEST_F(HarnessNetworkTest, setAllLinks) {
+    LinkOptions options;
+    options.delay = microseconds(7);
+    network.setAllLinks(3, options);
+    EXPECT_EQ(7, network.getLink(0, 3).delay.count());
+    EXPECT_EQ(7, network.getLink(3, 1).delay.count());
+    // also the default for links not covered
+    EXPECT_EQ(7, network.getLink(4, 5).delay.count());
+}
+
+TEST_F(HarnessNetworkTest, setServerUp) {
+    network.setServerUp(2, 3, false);
+    EXPECT_FALSE(network.isUp(0, 2));
+    EXPECT_FALSE(network.isUp(2, 1));
+    EXPECT_FALSE(network.isUp(3, 2));
+    EXPECT_TRUE(network.isUp(1, 3));
+    EXPECT_TRUE(network.isUp(2, 2));
+    network.setServerUp(2, 3, true);
+    EXPECT_TRUE(network.isUp(0, 2));
+    EXPECT_TRUE(network.isUp(2, 1));
+}
+
+} // namespace LogCabin::Harness::<anonymous>
+} // namespace LogCabin::Harness
+} // namespace LogCabin
@@ -21,6 +21,9 @@
 #ifndef LOGCABIN_PROTOCOL_COMMON_H
 #define LOGCABIN_PROTOCOL_COMMON_H
 
+#include <cinttypes>
+#include <string>
+
 namespace LogCabin {
 namespace Protocol {
 namespace Common {
@@ -33,10 +36,19 @@ enum { DEFAULT_PORT = 61023 };
 /**
  * The maximum number of bytes per RPC request or response, including these
  * headers. This is set to slightly over 1 MB because the maximum size of log
- * entries is 1 MB.
+ * entries sent in one piece is 1 MB.
  */
 enum { MAX_MESSAGE_LENGTH = 1024 + 1024 * 1024 };
 
+/**
+ * Clients append entries with more data than this in chunks of at most this
+ * many bytes (see the AppendChunk RPC), and servers return at most this many
+ * bytes of an entry's data in a response (see Read.Response.OK.Entry). Each
+ * chunk is replicated as a separate Raft entry, so a large entry does not
+ * tie up replication for long.
+ */
+enum { MAX_CHUNK_LENGTH = 256 * 1024 };
+
 // This is not an enum class because it is usually used as a uint16_t;
 // enum class is too strict about conversions.
 namespace ServiceId {
@@ -57,6 +69,45 @@ enum {
 };
 }
 
+/**
+ * A server may host several independent Raft groups (see the raftGroups
+ * setting), each with its own leader and its own share of the logs. Log IDs
+ * and subscription IDs carry the ID of the group that assigned them in the
+ * bits from this one up, so that clients and servers can route requests
+ * about a log to its group without a lookup.
+ */
+enum { RAFT_GROUP_SHIFT = 48 };
+
+/**
+ * Return the ID of the Raft group that assigned the given log ID or
+ * subscription ID.
+ */
+inline uint32_t
+getRaftGroup(uint64_t id)
+{
+    return uint32_t(id >> RAFT_GROUP_SHIFT);
+}
+
+/**
+ * Return the ID of the Raft group that holds the log with the given name.
+ * Clients and servers must agree on this, so it uses a fixed hash function
+ * (FNV-1a) rather than std::hash.
+ * \param logName
+ *      The name of the log.
+ * \param numGroups
+ *      The number of Raft groups in the cluster.
+ */
+inline uint32_t
+getRaftGroup(const std::string& logName, uint32_t numGroups)
+{
+    uint64_t hash = 14695981039346656037UL;
+    for (auto it = logName.begin(); it != logName.end(); ++it) {
+        hash ^= uint8_t(*it);
+        hash *= 1099511628211UL;
+    }
+    return uint32_t(hash % numGroups);
+}
+
 } // namespace LogCabin::Protocol::Common
 } // namespace LogCabin::Protocol
 } // namespace LogCabin
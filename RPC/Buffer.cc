@@ -13,11 +13,45 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#if __GNUC__ >= 4 && __GNUC_MINOR__ >= 5
+#include <atomic>
+#else
+#include <cstdatomic>
+#endif
+#include <new>
+
+#include "Core/Debug.h"
 #include "Buffer.h"
 
 namespace LogCabin {
 namespace RPC {
 
+namespace {
+
+/**
+ * Precedes the data of Buffers created with Buffer::allocateShared() in
+ * memory. Its size keeps the data that follows it 8-byte aligned.
+ */
+struct SharedHeader {
+    SharedHeader()
+        : refCount(1)
+    {
+    }
+    /**
+     * The number of Buffers referring to the data.
+     */
+    std::atomic<uint64_t> refCount;
+};
+
+SharedHeader*
+getSharedHeader(void* data)
+{
+    return reinterpret_cast<SharedHeader*>(
+        static_cast<char*>(data) - sizeof(SharedHeader));
+}
+
+} // anonymous namespace
+
 Buffer::Buffer()
     : data(NULL)
     , length(0)
@@ -82,5 +116,32 @@ Buffer::reset()
     deleter = NULL;
 }
 
+Buffer
+Buffer::allocateShared(uint32_t length)
+{
+    char* block = new char[sizeof(SharedHeader) + length];
+    new(block) SharedHeader();
+    return Buffer(block + sizeof(SharedHeader), length, releaseShared);
+}
+
+Buffer
+Buffer::share() const
+{
+    if (deleter != releaseShared)
+        PANIC("Only Buffers from allocateShared() can be shared");
+    getSharedHeader(data)->refCount.fetch_add(1);
+    return Buffer(data, length, releaseShared);
+}
+
+void
+Buffer::releaseShared(void* data)
+{
+    SharedHeader* header = getSharedHeader(data);
+    if (header->refCount.fetch_sub(1) == 1) {
+        header->~SharedHeader();
+        delete[] reinterpret_cast<char*>(header);
+    }
+}
+
 } // namespace LogCabin::RPC
 } // namespace LogCabin
@@ -141,7 +141,28 @@ class Buffer {
      */
     void reset();
 
+    /**
+     * Return a Buffer with room for 'length' bytes whose data may later be
+     * handed out to other Buffers with share(), for example to send the same
+     * message to many clients without copying it. The memory is reclaimed
+     * once the last Buffer referring to it is destroyed.
+     */
+    static Buffer allocateShared(uint32_t length);
+
+    /**
+     * Return another Buffer that refers to the same data as this one.
+     * This Buffer's data must have come from allocateShared(). The data
+     * should not be modified once it is shared.
+     */
+    Buffer share() const;
+
   private:
+    /**
+     * The Deleter for data that came from allocateShared(): it drops a
+     * reference and frees the memory along with the last one.
+     */
+    static void releaseShared(void* data);
+
     /**
      * A pointer to the data or NULL if none has been set.
      */
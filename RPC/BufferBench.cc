@@ -0,0 +1,65 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "bench/Bench.h"
+#include "RPC/Buffer.h"
+
+namespace LogCabin {
+namespace RPC {
+namespace {
+
+char staticData[64];
+
+BENCHMARK(RPCBuffer, construct) {
+    for (uint64_t i = 0; i < state.iterations; ++i) {
+        Buffer buffer;
+        Bench::doNotOptimize(buffer);
+    }
+}
+
+BENCHMARK(RPCBuffer, constructStatic) {
+    for (uint64_t i = 0; i < state.iterations; ++i) {
+        Buffer buffer(staticData, sizeof(staticData), NULL);
+        Bench::doNotOptimize(buffer);
+    }
+}
+
+BENCHMARK(RPCBuffer, constructHeap) {
+    for (uint64_t i = 0; i < state.iterations; ++i) {
+        Buffer buffer(new char[64], 64, Buffer::deleteArrayFn<char>);
+        Bench::doNotOptimize(buffer);
+    }
+}
+
+BENCHMARK(RPCBuffer, move) {
+    Buffer a(staticData, sizeof(staticData), NULL);
+    Buffer b;
+    for (uint64_t i = 0; i < state.iterations; ++i) {
+        b = std::move(a);
+        a = std::move(b);
+    }
+    Bench::doNotOptimize(a);
+}
+
+BENCHMARK(RPCBuffer, setData) {
+    Buffer buffer;
+    for (uint64_t i = 0; i < state.iterations; ++i)
+        buffer.setData(new char[64], 64, Buffer::deleteArrayFn<char>);
+    Bench::doNotOptimize(buffer);
+}
+
+} // namespace LogCabin::RPC::<anonymous>
+} // namespace LogCabin::RPC
+} // namespace LogCabin
@@ -126,6 +126,33 @@ TEST_F(RPCBufferTest, reset) {
     EXPECT_EQ(1U, deleterCount);
 }
 
+TEST_F(RPCBufferTest, allocateShared) {
+    Buffer buffer = Buffer::allocateShared(10);
+    EXPECT_TRUE(NULL != buffer.getData());
+    EXPECT_EQ(10U, buffer.getLength());
+    EXPECT_EQ(0U, reinterpret_cast<uintptr_t>(buffer.getData()) % 8);
+    Buffer empty = Buffer::allocateShared(0);
+    EXPECT_EQ(0U, empty.getLength());
+}
+
+TEST_F(RPCBufferTest, share) {
+    Buffer copy1;
+    {
+        Buffer buffer = Buffer::allocateShared(sizeof(buf));
+        memcpy(buffer.getData(), buf, sizeof(buf));
+        copy1 = buffer.share();
+        Buffer copy2 = buffer.share();
+        EXPECT_EQ(buffer.getData(), copy1.getData());
+        EXPECT_EQ(buffer.getData(), copy2.getData());
+        EXPECT_EQ(sizeof(buf), copy2.getLength());
+    }
+    // copy1 outlives the others (valgrind would catch a use-after-free).
+    EXPECT_EQ(0, memcmp(buf, copy1.getData(), sizeof(buf)));
+    Buffer copy3 = copy1.share();
+    copy1.reset();
+    EXPECT_EQ(0, memcmp(buf, copy3.getData(), sizeof(buf)));
+}
+
 } // namespace LogCabin::RPC::<anonymous>
 } // namespace LogCabin::RPC
 } // namespace LogCabin
@@ -24,78 +24,23 @@ namespace RPC {
 
 using RPC::Protocol::RequestHeaderPrefix;
 using RPC::Protocol::RequestHeaderVersion1;
+using RPC::Protocol::RequestHeaderVersion2;
 using RPC::Protocol::ResponseHeaderPrefix;
 using RPC::Protocol::ResponseHeaderVersion1;
 typedef RPC::Protocol::Status ProtocolStatus;
 
-ClientRPC::ClientRPC(std::shared_ptr<RPC::ClientSession> session,
-                     uint16_t service,
-                     uint8_t serviceSpecificErrorVersion,
-                     uint16_t opCode,
-                     const google::protobuf::Message& request)
-    : opaqueRPC() // placeholder, set again below
-{
-    // Serialize the request into a Buffer
-    Buffer requestBuffer;
-    ProtoBuf::serialize(request, requestBuffer,
-                        sizeof(RequestHeaderVersion1));
-    auto& requestHeader =
-        *static_cast<RequestHeaderVersion1*>(requestBuffer.getData());
-    requestHeader.prefix.version = 1;
-    requestHeader.prefix.toBigEndian();
-    requestHeader.service = service;
-    requestHeader.serviceSpecificErrorVersion = serviceSpecificErrorVersion;
-    requestHeader.opCode = opCode;
-    requestHeader.toBigEndian();
-
-    // Send the request to the server
-    assert(session); // makes debugging more obvious for somewhat common error
-    opaqueRPC = session->sendRequest(std::move(requestBuffer));
-}
-
-ClientRPC::ClientRPC()
-    : opaqueRPC()
-{
-}
-
-ClientRPC::ClientRPC(ClientRPC&& other)
-    : opaqueRPC(std::move(other.opaqueRPC))
-{
-}
-
-ClientRPC::~ClientRPC()
-{
-}
-
-ClientRPC&
-ClientRPC::operator=(ClientRPC&& other)
-{
-    opaqueRPC = std::move(other.opaqueRPC);
-    return *this;
-}
-
-void
-ClientRPC::cancel()
-{
-    if (!isReady())
-        opaqueRPC.cancel();
-}
-
-bool
-ClientRPC::isReady()
-{
-    return opaqueRPC.isReady();
-}
+namespace {
 
+/**
+ * Interpret a response from the server. This is used by
+ * ClientRPC::waitForReply() and ClientRPC::waitForStreamReply().
+ */
 ClientRPC::Status
-ClientRPC::waitForReply(google::protobuf::Message* response,
-                        google::protobuf::Message* serviceSpecificError)
+parseReply(const Buffer& responseBuffer,
+           google::protobuf::Message* response,
+           google::protobuf::Message* serviceSpecificError)
 {
-    opaqueRPC.waitForReply();
-    std::string error = opaqueRPC.getErrorMessage();
-    if (!error.empty())
-        return Status::RPC_FAILED;
-    const Buffer& responseBuffer = *opaqueRPC.peekReply();
+    typedef ClientRPC::Status Status;
 
     // Extract the response's status field.
     if (responseBuffer.getLength() < sizeof(ResponseHeaderPrefix)) {
@@ -166,7 +111,118 @@ ClientRPC::waitForReply(google::protobuf::Message* response,
                   "indicates a bug in the server.",
                   responseHeader.prefix.status);
     }
+}
+
+} // anonymous namespace
+
+ClientRPC::ClientRPC(std::shared_ptr<RPC::ClientSession> session,
+                     uint16_t service,
+                     uint8_t serviceSpecificErrorVersion,
+                     uint16_t opCode,
+                     const google::protobuf::Message& request,
+                     uint64_t traceId,
+                     bool stream,
+                     MessageSocket::Priority priority)
+    : opaqueRPC() // placeholder, set again below
+{
+    // Serialize the request into a Buffer
+    Buffer requestBuffer;
+    if (traceId == 0) {
+        ProtoBuf::serialize(request, requestBuffer,
+                            sizeof(RequestHeaderVersion1));
+        auto& requestHeader =
+            *static_cast<RequestHeaderVersion1*>(requestBuffer.getData());
+        requestHeader.prefix.version = 1;
+        requestHeader.prefix.toBigEndian();
+        requestHeader.service = service;
+        requestHeader.serviceSpecificErrorVersion =
+            serviceSpecificErrorVersion;
+        requestHeader.opCode = opCode;
+        requestHeader.toBigEndian();
+    } else {
+        ProtoBuf::serialize(request, requestBuffer,
+                            sizeof(RequestHeaderVersion2));
+        auto& requestHeader =
+            *static_cast<RequestHeaderVersion2*>(requestBuffer.getData());
+        requestHeader.prefix.version = 2;
+        requestHeader.prefix.toBigEndian();
+        requestHeader.service = service;
+        requestHeader.serviceSpecificErrorVersion =
+            serviceSpecificErrorVersion;
+        requestHeader.opCode = opCode;
+        requestHeader.traceId = traceId;
+        requestHeader.toBigEndian();
+    }
+
+    // Send the request to the server
+    assert(session); // makes debugging more obvious for somewhat common error
+    opaqueRPC = session->sendRequest(std::move(requestBuffer), stream,
+                                     priority);
+}
+
+ClientRPC::ClientRPC()
+    : opaqueRPC()
+{
+}
 
+ClientRPC::ClientRPC(ClientRPC&& other)
+    : opaqueRPC(std::move(other.opaqueRPC))
+{
+}
+
+ClientRPC::~ClientRPC()
+{
+}
+
+ClientRPC&
+ClientRPC::operator=(ClientRPC&& other)
+{
+    opaqueRPC = std::move(other.opaqueRPC);
+    return *this;
+}
+
+void
+ClientRPC::cancel()
+{
+    if (!isReady())
+        opaqueRPC.cancel();
+}
+
+bool
+ClientRPC::isReady()
+{
+    return opaqueRPC.isReady();
+}
+
+void
+ClientRPC::setReadyCallback(std::function<void()> callback)
+{
+    opaqueRPC.setReadyCallback(std::move(callback));
+}
+
+ClientRPC::Status
+ClientRPC::waitForReply(google::protobuf::Message* response,
+                        google::protobuf::Message* serviceSpecificError)
+{
+    opaqueRPC.waitForReply();
+    std::string error = opaqueRPC.getErrorMessage();
+    if (!error.empty())
+        return Status::RPC_FAILED;
+    return parseReply(*opaqueRPC.peekReply(), response, serviceSpecificError);
+}
+
+ClientRPC::Status
+ClientRPC::waitForStreamReply(google::protobuf::Message* response,
+                              google::protobuf::Message* serviceSpecificError,
+                              Core::Time::SteadyClock::time_point deadline)
+{
+    Buffer responseBuffer;
+    if (!opaqueRPC.waitForStreamReply(responseBuffer, deadline)) {
+        if (opaqueRPC.getErrorMessage().empty())
+            return Status::TIMEOUT;
+        return Status::RPC_FAILED;
+    }
+    return parseReply(responseBuffer, response, serviceSpecificError);
 }
 
 std::string
@@ -186,6 +242,8 @@ operator<<(::std::ostream& os, ClientRPC::Status status)
             return os << "SERVICE_SPECIFIC_ERROR";
         case Status::RPC_FAILED:
             return os << "RPC_FAILED";
+        case Status::TIMEOUT:
+            return os << "TIMEOUT";
         default:
             return os << "(INVALID VALUE)";
     }
@@ -14,12 +14,15 @@
  */
 
 #include <cinttypes>
+#include <functional>
 #include <google/protobuf/message.h>
 #include <iostream>
 #include <memory>
 #include <string>
 
+#include "Core/Time.h"
 #include "RPC/Buffer.h"
+#include "RPC/MessageSocket.h"
 #include "RPC/OpaqueClientRPC.h"
 
 #ifndef LOGCABIN_RPC_CLIENTRPC_H
@@ -57,12 +60,28 @@ class ClientRPC {
      *      Identifies the remote procedure within the Service to execute.
      * \param request
      *      The arguments to the remote procedure.
+     * \param traceId
+     *      If nonzero, ask the server to trace this request under the given
+     *      ID (see Core::Trace). This requires a server that understands
+     *      version 2 of the RPC protocol.
+     * \param stream
+     *      If true, the server may send back any number of responses, which
+     *      are retrieved with waitForStreamReply() rather than
+     *      waitForReply(). See ClientSession::sendRequest().
+     * \param priority
+     *      CONTROL for small, latency-sensitive requests that shouldn't queue
+     *      up behind large ones on the same session. See
+     *      MessageSocket::sendMessage().
      */
     ClientRPC(std::shared_ptr<RPC::ClientSession> session,
               uint16_t service,
               uint8_t serviceSpecificErrorVersion,
               uint16_t opCode,
-              const google::protobuf::Message& request);
+              const google::protobuf::Message& request,
+              uint64_t traceId = 0,
+              bool stream = false,
+              MessageSocket::Priority priority =
+                  MessageSocket::Priority::NORMAL);
 
     /**
      * Default constructor. This doesn't create a valid RPC, but it is useful
@@ -100,6 +119,11 @@ class ClientRPC {
      */
     bool isReady();
 
+    /**
+     * See OpaqueClientRPC::setReadyCallback().
+     */
+    void setReadyCallback(std::function<void()> callback);
+
     /**
      * The return type of waitForReply().
      */
@@ -121,6 +145,11 @@ class ClientRPC {
          * available with getErrorMessage().
          */
         RPC_FAILED,
+        /**
+         * No response arrived before the deadline. This is only returned by
+         * waitForStreamReply(), and the stream remains usable.
+         */
+        TIMEOUT,
     };
 
     /**
@@ -138,6 +167,24 @@ class ClientRPC {
     Status waitForReply(google::protobuf::Message* response,
                         google::protobuf::Message* serviceSpecificError);
 
+    /**
+     * Wait for the next response of a streaming RPC, a timeout, or an error.
+     * Panics if the server responds but is not running the same protocol.
+     *
+     * \param[out] response
+     *      If not NULL, this will be filled in if this method returns OK.
+     * \param[out] serviceSpecificError
+     *      If not NULL, this will be filled in if this method returns
+     *      SERVICE_SPECIFIC_ERROR.
+     * \param deadline
+     *      Return TIMEOUT if no response has arrived by this time.
+     * \return
+     *      See the individual values of #Status.
+     */
+    Status waitForStreamReply(google::protobuf::Message* response,
+                              google::protobuf::Message* serviceSpecificError,
+                              Core::Time::SteadyClock::time_point deadline);
+
     /**
      * If an RPC failure occurred, return a message describing that error.
      *
@@ -123,6 +123,8 @@ TEST_F(RPCClientRPCTest, constructor) {
 // move assignment: nothing to test
 
 TEST_F(RPCClientRPCTest, cancel) {
+    // Stop the event loop so that the reply can't arrive before the cancel.
+    deinit();
     ClientRPC rpc(session, 2, 3, 4, payload);
     rpc.cancel();
     EXPECT_EQ(ClientRPC::Status::RPC_FAILED, rpc.waitForReply(NULL, NULL));
@@ -195,6 +197,26 @@ TEST_F(RPCClientRPCTest, waitForReply_invalidRequest) {
                  }, "request.*invalid");
 }
 
+TEST_F(RPCClientRPCTest, waitForStreamReply) {
+    makeServerRPC().reply(payload);
+    ClientRPC rpc(session, 2, 3, 4, payload, 0, true);
+    LogCabin::ProtoBuf::TestMessage actual;
+    EXPECT_EQ(ClientRPC::Status::OK,
+              rpc.waitForStreamReply(&actual, NULL,
+                                     Core::Time::SteadyClock::now() +
+                                        std::chrono::seconds(10)));
+    EXPECT_EQ(payload, actual);
+    // The stream stays open for more.
+    EXPECT_FALSE(rpc.isReady());
+    EXPECT_EQ(ClientRPC::Status::TIMEOUT,
+              rpc.waitForStreamReply(&actual, NULL,
+                                     Core::Time::SteadyClock::now()));
+    rpc.cancel();
+    EXPECT_EQ(ClientRPC::Status::RPC_FAILED,
+              rpc.waitForStreamReply(&actual, NULL,
+                                     Core::Time::SteadyClock::now()));
+}
+
 TEST_F(RPCClientRPCTest, waitForReply_unknownStatus) {
     int bad = 255;
     makeServerRPC().reject(Protocol::Status(bad));
@@ -59,7 +59,7 @@ void
 ClientSession::ClientMessageSocket::onReceiveMessage(MessageId messageId,
                                                      Buffer message)
 {
-    std::unique_lock<std::mutex> mutexGuard(session.mutex);
+    std::unique_lock<Core::Mutex> mutexGuard(session.mutex);
 
     if (messageId == PING_MESSAGE_ID) {
         if (session.numActiveRPCs > 0 && session.activePing) {
@@ -87,6 +87,14 @@ ClientSession::ClientMessageSocket::onReceiveMessage(MessageId messageId,
         return;
     }
     Response& response = *it->second;
+    if (response.stream) {
+        // Streams remain outstanding until they're canceled, so only the
+        // timer needs updating.
+        session.timer.schedule(TIMEOUT_MS * 1000 * 1000);
+        response.streamReplies.push_back(std::move(message));
+        response.received.notify_all();
+        return;
+    }
     if (response.ready) {
         WARNING("Received a second response from the server for "
                 "message ID %lu. This indicates that either the client or "
@@ -106,9 +114,11 @@ ClientSession::ClientMessageSocket::onReceiveMessage(MessageId messageId,
     // Fill in the response
     response.ready = true;
     response.reply = std::move(message);
-    // This is inefficient when there are many RPCs outstanding, but that's
-    // not the expected case.
-    session.responseReceived.notify_all();
+    response.received.notify_all();
+    if (response.readyCallback) {
+        response.readyCallback();
+        response.readyCallback = nullptr;
+    }
 }
 
 void
@@ -116,28 +126,32 @@ ClientSession::ClientMessageSocket::onDisconnect()
 {
     VERBOSE("Disconnected from server %s",
             session.address.toString().c_str());
-    std::unique_lock<std::mutex> mutexGuard(session.mutex);
+    std::unique_lock<Core::Mutex> mutexGuard(session.mutex);
     if (session.errorMessage.empty()) {
         // Fail all current and future RPCs.
         session.errorMessage = ("Disconnected from server " +
                                 session.address.toString());
         // Notify any waiting RPCs.
-        session.responseReceived.notify_all();
+        session.notifyAllResponses();
     }
 }
 
 ////////// ClientSession::Response //////////
 
-ClientSession::Response::Response()
+ClientSession::Response::Response(bool stream)
     : ready(false)
     , reply()
+    , stream(stream)
+    , streamReplies()
+    , received()
+    , readyCallback()
 {
 }
 
 ////////// ClientSession::Timer //////////
 
 ClientSession::Timer::Timer(ClientSession& session)
-    : Event::Timer(session.eventLoop)
+    : Event::CoarseTimer(session.eventLoop)
     , session(session)
 {
 }
@@ -145,7 +159,7 @@ ClientSession::Timer::Timer(ClientSession& session)
 void
 ClientSession::Timer::handleTimerEvent()
 {
-    std::unique_lock<std::mutex> mutexGuard(session.mutex);
+    std::unique_lock<Core::Mutex> mutexGuard(session.mutex);
 
     // Handle "spurious" wake-ups.
     if (!session.messageSocket ||
@@ -158,7 +172,8 @@ ClientSession::Timer::handleTimerEvent()
     if (!session.activePing) {
         VERBOSE("ClientSession is suspicious. Sending ping.");
         session.activePing = true;
-        session.messageSocket->sendMessage(PING_MESSAGE_ID, Buffer());
+        session.messageSocket->sendMessage(
+            PING_MESSAGE_ID, Buffer(), 0, MessageSocket::Priority::CONTROL);
         schedule(TIMEOUT_MS * 1000 * 1000);
     } else {
         VERBOSE("ClientSession to %s timed out.",
@@ -168,7 +183,7 @@ ClientSession::Timer::handleTimerEvent()
                                 session.address.toString() +
                                 " timed out");
         // Notify any waiting RPCs.
-        session.responseReceived.notify_all();
+        session.notifyAllResponses();
     }
 }
 
@@ -182,9 +197,8 @@ ClientSession::ClientSession(Event::Loop& eventLoop,
     , address(address)
     , messageSocket()
     , timer(*this)
-    , mutex()
+    , mutex("ClientSession::mutex")
     , nextMessageId(1) // 0 is reserved for PING_MESSAGE_ID
-    , responseReceived()
     , responses()
     , errorMessage()
     , numActiveRPCs(0)
@@ -226,14 +240,15 @@ ClientSession::~ClientSession()
 }
 
 OpaqueClientRPC
-ClientSession::sendRequest(Buffer request)
+ClientSession::sendRequest(Buffer request, bool stream,
+                           MessageSocket::Priority priority)
 {
     MessageSocket::MessageId messageId;
     {
-        std::unique_lock<std::mutex> mutexGuard(mutex);
+        std::unique_lock<Core::Mutex> mutexGuard(mutex);
         messageId = nextMessageId;
         ++nextMessageId;
-        responses[messageId] = new Response();
+        responses[messageId] = new Response(stream);
 
         ++numActiveRPCs;
         if (numActiveRPCs == 1) {
@@ -245,7 +260,7 @@ ClientSession::sendRequest(Buffer request)
     // Release the mutex before sending so that receives can be processed
     // simultaneously with sends.
     if (messageSocket)
-        messageSocket->sendMessage(messageId, std::move(request));
+        messageSocket->sendMessage(messageId, std::move(request), 0, priority);
     OpaqueClientRPC rpc;
     rpc.session = self.lock();
     rpc.responseToken = messageId;
@@ -255,7 +270,7 @@ ClientSession::sendRequest(Buffer request)
 std::string
 ClientSession::getErrorMessage() const
 {
-    std::unique_lock<std::mutex> mutexGuard(mutex);
+    std::unique_lock<Core::Mutex> mutexGuard(mutex);
     return errorMessage;
 }
 
@@ -279,7 +294,7 @@ ClientSession::cancel(OpaqueClientRPC& rpc)
     // we return from this method. It must be the first line in this method.
     std::shared_ptr<ClientSession> selfGuard(self.lock());
 
-    std::unique_lock<std::mutex> mutexGuard(mutex);
+    std::unique_lock<Core::Mutex> mutexGuard(mutex);
 
     --numActiveRPCs;
     // Even if numActiveRPCs == 0, it's simpler here to just let the timer wake
@@ -301,7 +316,7 @@ ClientSession::update(OpaqueClientRPC& rpc)
     // we return from this method. It must be the first line in this method.
     std::shared_ptr<ClientSession> selfGuard(self.lock());
 
-    std::unique_lock<std::mutex> mutexGuard(mutex);
+    std::unique_lock<Core::Mutex> mutexGuard(mutex);
     auto it = responses.find(rpc.responseToken);
     assert(it != responses.end());
     Response* response = it->second;
@@ -326,10 +341,10 @@ ClientSession::wait(OpaqueClientRPC& rpc)
     // we return from this method. It must be the first line in this method.
     std::shared_ptr<ClientSession> selfGuard(self.lock());
 
-    std::unique_lock<std::mutex> mutexGuard(mutex);
+    std::unique_lock<Core::Mutex> mutexGuard(mutex);
     Response* response = responses[rpc.responseToken];
     while (!response->ready && errorMessage.empty())
-        responseReceived.wait(mutexGuard);
+        response->received.wait(mutexGuard);
     if (response->ready)
         rpc.reply = std::move(response->reply);
     else
@@ -343,5 +358,75 @@ ClientSession::wait(OpaqueClientRPC& rpc)
     responses.erase(rpc.responseToken);
 }
 
+bool
+ClientSession::waitForStreamReply(OpaqueClientRPC& rpc,
+                                  Buffer& message,
+                                  Core::Time::SteadyClock::time_point deadline)
+{
+    // The RPC may be holding the last reference to this session. This
+    // temporary reference makes sure this object isn't destroyed until after
+    // we return from this method. It must be the first line in this method.
+    std::shared_ptr<ClientSession> selfGuard(self.lock());
+
+    std::unique_lock<Core::Mutex> mutexGuard(mutex);
+    Response* response = responses[rpc.responseToken];
+    assert(response->stream);
+    while (response->streamReplies.empty() &&
+           errorMessage.empty() &&
+           Core::Time::SteadyClock::now() < deadline) {
+        response->received.wait_until(mutexGuard, deadline);
+    }
+    if (!response->streamReplies.empty()) {
+        message = std::move(response->streamReplies.front());
+        response->streamReplies.pop_front();
+        return true;
+    }
+    if (errorMessage.empty())
+        return false; // timed out
+    rpc.errorMessage = errorMessage;
+    rpc.ready = true;
+    rpc.session.reset();
+
+    delete response;
+    responses.erase(rpc.responseToken);
+    return false;
+}
+
+void
+ClientSession::setReadyCallback(OpaqueClientRPC& rpc,
+                                std::function<void()> callback)
+{
+    // The RPC may be holding the last reference to this session. This
+    // temporary reference makes sure this object isn't destroyed until after
+    // we return from this method. It must be the first line in this method.
+    std::shared_ptr<ClientSession> selfGuard(self.lock());
+
+    {
+        std::unique_lock<Core::Mutex> mutexGuard(mutex);
+        auto it = responses.find(rpc.responseToken);
+        assert(it != responses.end());
+        Response* response = it->second;
+        if (!response->ready && errorMessage.empty()) {
+            response->readyCallback = std::move(callback);
+            return;
+        }
+    }
+    // Already done, so call it right away.
+    callback();
+}
+
+void
+ClientSession::notifyAllResponses()
+{
+    for (auto it = responses.begin(); it != responses.end(); ++it) {
+        Response& response = *it->second;
+        response.received.notify_all();
+        if (response.readyCallback) {
+            response.readyCallback();
+            response.readyCallback = nullptr;
+        }
+    }
+}
+
 } // namespace LogCabin::RPC
 } // namespace LogCabin
@@ -13,13 +13,16 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
-#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <memory>
-#include <mutex>
 #include <string>
 #include <unordered_map>
 
-#include "Event/Timer.h"
+#include "Core/ConditionVariable.h"
+#include "Core/Mutex.h"
+#include "Core/Time.h"
+#include "Event/CoarseTimer.h"
 #include "RPC/Address.h"
 #include "RPC/Buffer.h"
 #include "RPC/OpaqueClientRPC.h"
@@ -86,10 +89,22 @@ class ClientSession {
      * This method is safe to call from any thread.
      * \param request
      *      The contents of the RPC request.
+     * \param stream
+     *      If true, the server may send back any number of messages for this
+     *      RPC, which are retrieved with
+     *      OpaqueClientRPC::waitForStreamReply(). The RPC then stays
+     *      outstanding until it is canceled or the session fails.
+     * \param priority
+     *      Pass CONTROL for small requests that shouldn't wait behind large
+     *      ones that were sent earlier (see MessageSocket::sendMessage()).
      * \return
      *      This is be used to wait for and retrieve the reply to the RPC.
      */
-    OpaqueClientRPC sendRequest(Buffer request);
+    OpaqueClientRPC sendRequest(
+            Buffer request,
+            bool stream = false,
+            MessageSocket::Priority priority =
+                MessageSocket::Priority::NORMAL);
 
     /**
      * If the socket has been disconnected, return a descriptive message.
@@ -142,27 +157,52 @@ class ClientSession {
      */
     struct Response {
         /// Constructor.
-        Response();
+        explicit Response(bool stream);
         /// True indicates #reply is valid.
         bool ready;
         /// The contents of the response. This is valid when #ready is set.
         Buffer reply;
+        /**
+         * True if the RPC was sent as a stream. Then, every message received
+         * for it is queued on #streamReplies, and #ready is never set.
+         */
+        const bool stream;
+        /**
+         * Messages received for a streaming RPC that haven't yet been
+         * retrieved with waitForStreamReply().
+         */
+        std::deque<Buffer> streamReplies;
+        /**
+         * The RPC waits on this inside of wait(). It is notified when #ready
+         * is set, a stream message arrives, or the session is disconnected.
+         * Each RPC has its own so that a response wakes up only the thread
+         * waiting for it, even when many RPCs are outstanding (for example,
+         * long-running Watch RPCs).
+         */
+        Core::ConditionVariable received;
+        /**
+         * If set, this is called once #ready is set or the session fails.
+         * See setReadyCallback().
+         */
+        std::function<void()> readyCallback;
     };
 
     /**
      * This is used to time out RPCs and sessions when the server is no longer
      * responding. After a timeout period, the client will send a ping to the
      * server. If no response is received within another timeout period, the
-     * session is closed.
+     * session is closed. It's rescheduled on every response, so it's kept on
+     * the event loop's timer wheel rather than in libevent.
      */
-    class Timer : public Event::Timer {
+    class Timer : public Event::CoarseTimer {
       public:
         explicit Timer(ClientSession& session);
         void handleTimerEvent();
         ClientSession& session;
     };
 
-    // The cancel(), update(), and wait() methods are used by OpaqueClientRPC.
+    // The cancel(), update(), wait(), and waitForStreamReply() methods are
+    // used by OpaqueClientRPC.
     friend class OpaqueClientRPC;
 
     /**
@@ -185,6 +225,36 @@ class ClientSession {
      */
     void wait(OpaqueClientRPC& rpc);
 
+    /**
+     * Called by a streaming RPC when it wants its next message (blocking).
+     * \param rpc
+     *      The RPC, which must have been sent as a stream.
+     * \param[out] message
+     *      Set to the next message, if this returns true.
+     * \param deadline
+     *      Give up waiting at this time.
+     * \return
+     *      True if a message was returned; false if the deadline passed or
+     *      the session failed. In the latter case, the RPC is updated with
+     *      the error.
+     */
+    bool waitForStreamReply(OpaqueClientRPC& rpc,
+                            Buffer& message,
+                            Core::Time::SteadyClock::time_point deadline);
+
+    /**
+     * Called by the RPC to be told when its response arrives or the session
+     * fails (non-blocking). See OpaqueClientRPC::setReadyCallback().
+     */
+    void setReadyCallback(OpaqueClientRPC& rpc,
+                          std::function<void()> callback);
+
+    /**
+     * Wake up every RPC waiting in wait(), after #errorMessage is set.
+     * Must be called holding #mutex.
+     */
+    void notifyAllResponses();
+
     /**
      * This is used to keep this object alive while there are outstanding RPCs.
      */
@@ -217,7 +287,7 @@ class ClientSession {
      * This mutex protects all of the members of this class defined below this
      * point.
      */
-    mutable std::mutex mutex;
+    mutable Core::Mutex mutex;
 
     /**
      * The message ID to assign to the next RPC. These start at 1 and
@@ -226,13 +296,6 @@ class ClientSession {
      */
     MessageSocket::MessageId nextMessageId;
 
-    /**
-     * OpaqueClientRPC objects wait on this condition variable inside of
-     * wait(). It is notified when a new response arrives or the session is
-     * disconnected.
-     */
-    std::condition_variable responseReceived;
-
     /**
      * A map from MessageId to Response objects that is used to store the
      * response to RPCs and look it up for OpaqueClientRPC objects. The
@@ -22,7 +22,7 @@
 #endif
 
 #include "Core/Debug.h"
-#include "Event/Timer.h"
+#include "Event/CoarseTimer.h"
 #include "RPC/ClientSession.h"
 
 namespace LogCabin {
@@ -84,7 +84,7 @@ TEST_F(RPCClientSessionTest, onReceiveMessage) {
 
     // Normal
     session->timer.schedule(1);
-    session->responses[1] = new ClientSession::Response();
+    session->responses[1] = new ClientSession::Response(false);
     session->messageSocket->onReceiveMessage(1, buf("b"));
     EXPECT_TRUE(session->responses[1]->ready);
     EXPECT_EQ("b", str(session->responses[1]->reply));
@@ -98,6 +98,22 @@ TEST_F(RPCClientSessionTest, onReceiveMessage) {
     EXPECT_EQ(0U, session->numActiveRPCs);
 }
 
+TEST_F(RPCClientSessionTest, onReceiveMessage_stream) {
+    session->numActiveRPCs = 1;
+    session->responses[1] = new ClientSession::Response(true);
+    session->messageSocket->onReceiveMessage(1, buf("a"));
+    session->messageSocket->onReceiveMessage(1, buf("b"));
+    ClientSession::Response& response = *session->responses[1];
+    EXPECT_FALSE(response.ready);
+    ASSERT_EQ(2U, response.streamReplies.size());
+    EXPECT_EQ("a", str(response.streamReplies.at(0)));
+    EXPECT_EQ("b", str(response.streamReplies.at(1)));
+    // Streams stay outstanding, so the session keeps checking on the server.
+    EXPECT_EQ(1U, session->numActiveRPCs);
+    EXPECT_TRUE(session->timer.isScheduled());
+    session->numActiveRPCs = 0;
+}
+
 TEST_F(RPCClientSessionTest, onReceiveMessage_ping) {
     // spurious
     session->messageSocket->onReceiveMessage(0, Buffer());
@@ -184,6 +200,13 @@ TEST_F(RPCClientSessionTest, sendRequest) {
     EXPECT_FALSE(response.ready);
 }
 
+TEST_F(RPCClientSessionTest, sendRequest_priority) {
+    session->sendRequest(buf("hi"));
+    session->sendRequest(buf("hi"), false, MessageSocket::Priority::CONTROL);
+    EXPECT_EQ(1U, session->messageSocket->outboundQueue.size());
+    EXPECT_EQ(1U, session->messageSocket->controlQueue.size());
+}
+
 TEST_F(RPCClientSessionTest, getErrorMessage) {
     EXPECT_EQ("", session->getErrorMessage());
     session->errorMessage = "x";
@@ -207,6 +230,40 @@ TEST_F(RPCClientSessionTest, cancel) {
     EXPECT_EQ(0U, session->responses.size());
 }
 
+TEST_F(RPCClientSessionTest, setReadyCallback) {
+    uint32_t calls = 0;
+    std::function<void()> callback = [&calls] () {
+        ++calls;
+    };
+
+    // reply arrives later
+    OpaqueClientRPC rpc1 = session->sendRequest(buf("hi"));
+    rpc1.setReadyCallback(callback);
+    EXPECT_EQ(0U, calls);
+    session->messageSocket->onReceiveMessage(1, buf("bye"));
+    EXPECT_EQ(1U, calls);
+
+    // reply already arrived
+    rpc1.setReadyCallback(callback);
+    EXPECT_EQ(2U, calls);
+    rpc1.update();
+    rpc1.setReadyCallback(callback);
+    EXPECT_EQ(3U, calls);
+
+    // session fails later, only called once
+    OpaqueClientRPC rpc2 = session->sendRequest(buf("hi"));
+    rpc2.setReadyCallback(callback);
+    session->messageSocket->onDisconnect();
+    EXPECT_EQ(4U, calls);
+    session->messageSocket->onDisconnect();
+    EXPECT_EQ(4U, calls);
+
+    // session already failed
+    OpaqueClientRPC rpc3 = session->sendRequest(buf("hi"));
+    rpc3.setReadyCallback(callback);
+    EXPECT_EQ(5U, calls);
+}
+
 TEST_F(RPCClientSessionTest, updateNotReady) {
     OpaqueClientRPC rpc = session->sendRequest(buf("hi"));
     rpc.update();
@@ -261,6 +318,45 @@ TEST_F(RPCClientSessionTest, waitReady) {
     EXPECT_EQ(0U, session->responses.size());
 }
 
+TEST_F(RPCClientSessionTest, waitForStreamReply) {
+    OpaqueClientRPC rpc = session->sendRequest(buf("hi"), true);
+    ClientSession::Response& response = *session->responses.at(1);
+    EXPECT_TRUE(response.stream);
+    response.streamReplies.push_back(buf("a"));
+    response.streamReplies.push_back(buf("b"));
+    Buffer message;
+    auto deadline = Core::Time::SteadyClock::now();
+    EXPECT_TRUE(rpc.waitForStreamReply(message, deadline));
+    EXPECT_EQ("a", str(message));
+    EXPECT_TRUE(rpc.waitForStreamReply(message, deadline));
+    EXPECT_EQ("b", str(message));
+    // timeout
+    EXPECT_FALSE(rpc.waitForStreamReply(message, deadline));
+    EXPECT_FALSE(rpc.ready);
+    EXPECT_EQ("", rpc.getErrorMessage());
+    EXPECT_EQ(1U, session->responses.size());
+    rpc.cancel();
+    EXPECT_EQ(0U, session->responses.size());
+    EXPECT_FALSE(rpc.waitForStreamReply(message, deadline));
+}
+
+TEST_F(RPCClientSessionTest, waitForStreamReply_error) {
+    OpaqueClientRPC rpc = session->sendRequest(buf("hi"), true);
+    session->responses.at(1)->streamReplies.push_back(buf("a"));
+    session->errorMessage = "some error";
+    Buffer message;
+    auto deadline = (Core::Time::SteadyClock::now() +
+                     std::chrono::seconds(10));
+    // Messages that arrived before the error are still delivered.
+    EXPECT_TRUE(rpc.waitForStreamReply(message, deadline));
+    EXPECT_EQ("a", str(message));
+    EXPECT_FALSE(rpc.waitForStreamReply(message, deadline));
+    EXPECT_TRUE(rpc.ready);
+    EXPECT_FALSE(rpc.session);
+    EXPECT_EQ("some error", rpc.errorMessage);
+    EXPECT_EQ(0U, session->responses.size());
+}
+
 TEST_F(RPCClientSessionTest, waitError) {
     OpaqueClientRPC rpc = session->sendRequest(buf("hi"));
     session->errorMessage = "some error";
@@ -15,17 +15,34 @@
 
 #include <endian.h>
 #include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include "Core/Debug.h"
+#include "Core/Trace.h"
 #include "RPC/MessageSocket.h"
 
 namespace LogCabin {
 namespace RPC {
 
+namespace {
+
+/**
+ * The most data that the kernel may hold for a socket without having sent it
+ * (TCP_NOTSENT_LOWAT). The kernel would otherwise take in megabytes, and
+ * once a message has been handed to it, a CONTROL message can no longer get
+ * ahead of it.
+ */
+const int MAX_UNSENT_BYTES = 128 * 1024;
+
+} // anonymous namespace
+
+bool MessageSocket::controlLane = true;
+
 ////////// MessageSocket::RawSocket //////////
 
 MessageSocket::RawSocket::RawSocket(Event::Loop& eventLoop,
@@ -33,6 +50,7 @@ MessageSocket::RawSocket::RawSocket(Event::Loop& eventLoop,
                                     MessageSocket& messageSocket)
     : Event::File(eventLoop, fd, Events::READABLE)
     , messageSocket(messageSocket)
+    , mutex()
     , closed(false)
 {
 }
@@ -46,6 +64,7 @@ void
 MessageSocket::RawSocket::close()
 {
     Event::Loop::Lock lock(eventLoop);
+    std::lock_guard<std::mutex> mutexGuard(mutex);
     if (!closed) {
         setEvents(0);
         ::close(fd);
@@ -56,7 +75,20 @@ MessageSocket::RawSocket::close()
 void
 MessageSocket::RawSocket::setNotifyWritable(bool shouldNotify)
 {
-    Event::Loop::Lock lock(eventLoop);
+    // The libevent backend needs the event loop stopped to change the events,
+    // whereas the epoll backend can change them while it keeps running.
+    if (eventLoop.backend == Event::Loop::Backend::LIBEVENT) {
+        Event::Loop::Lock lock(eventLoop);
+        setNotifyWritableUnlocked(shouldNotify);
+    } else {
+        setNotifyWritableUnlocked(shouldNotify);
+    }
+}
+
+void
+MessageSocket::RawSocket::setNotifyWritableUnlocked(bool shouldNotify)
+{
+    std::lock_guard<std::mutex> mutexGuard(mutex);
     if (!closed) {
         if (shouldNotify)
             setEvents(Events::READABLE | Events::WRITABLE);
@@ -105,10 +137,12 @@ MessageSocket::Inbound::Inbound()
 ////////// MessageSocket::Outbound //////////
 
 MessageSocket::Outbound::Outbound(MessageId messageId,
-                                  Buffer message)
+                                  Buffer message,
+                                  uint64_t traceId)
     : bytesSent(0)
     , header()
     , message(std::move(message))
+    , traceId(traceId)
 {
     header.messageId = messageId;
     header.payloadLength = this->message.getLength();
@@ -123,8 +157,15 @@ MessageSocket::MessageSocket(Event::Loop& eventLoop, int fd,
     , inbound()
     , outboundQueueMutex()
     , outboundQueue()
+    , controlQueue()
+    , outboundBytes(0)
+    , sendingQueue(NULL)
     , socket(eventLoop, fd, *this)
 {
+    // This fails for sockets other than TCP, such as socket pairs in unit
+    // tests, which don't need it.
+    int bytes = MAX_UNSENT_BYTES;
+    setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &bytes, sizeof(bytes));
 }
 
 MessageSocket::~MessageSocket()
@@ -132,7 +173,8 @@ MessageSocket::~MessageSocket()
 }
 
 void
-MessageSocket::sendMessage(MessageId messageId, Buffer contents)
+MessageSocket::sendMessage(MessageId messageId, Buffer contents,
+                           uint64_t traceId, Priority priority)
 {
     // Check the message length.
     if (contents.getLength() > maxMessageLength) {
@@ -142,12 +184,27 @@ MessageSocket::sendMessage(MessageId messageId, Buffer contents)
     }
     { // Place the message on the outbound queue.
         std::lock_guard<std::mutex> lock(outboundQueueMutex);
-        outboundQueue.emplace(messageId, std::move(contents));
+        OutboundQueue& queue = (controlLane &&
+                                priority == Priority::CONTROL
+                                    ? controlQueue
+                                    : outboundQueue);
+        outboundBytes += sizeof(Outbound) + contents.getLength();
+        queue.emplace(messageId, std::move(contents), traceId);
     }
     // Make sure the RawSocket is set up to call writable().
     socket.setNotifyWritable(true);
 }
 
+uint64_t
+MessageSocket::getBufferedBytes()
+{
+    uint64_t bytes = 0;
+    if (inbound.bytesRead >= sizeof(Header))
+        bytes += inbound.header.payloadLength;
+    std::lock_guard<std::mutex> lock(outboundQueueMutex);
+    return bytes + outboundBytes;
+}
+
 void
 MessageSocket::readable()
 {
@@ -226,12 +283,19 @@ MessageSocket::writable()
     Outbound* outbound;
     {
         std::lock_guard<std::mutex> lock(outboundQueueMutex);
-        if (outboundQueue.empty()) {
-            // This shouldn't happen, but it's easy to deal with.
-            socket.setNotifyWritable(false);
-            return;
+        if (sendingQueue == NULL) {
+            // Between messages: control messages go first.
+            if (!controlQueue.empty()) {
+                sendingQueue = &controlQueue;
+            } else if (!outboundQueue.empty()) {
+                sendingQueue = &outboundQueue;
+            } else {
+                // This shouldn't happen, but it's easy to deal with.
+                socket.setNotifyWritable(false);
+                return;
+            }
         }
-        outbound = &outboundQueue.front();
+        outbound = &sendingQueue->front();
     }
 
     // Use an iovec to send everything in one kernel call: one iov for the
@@ -271,9 +335,16 @@ MessageSocket::writable()
         if (outbound->bytesSent == (sizeof(Header) +
                                     outbound->message.getLength())) {
             // done with this message
+            if (outbound->traceId != 0) {
+                Core::Trace::record(outbound->traceId,
+                                    Core::Trace::Stage::SEND);
+                Core::Trace::finish(outbound->traceId);
+            }
             std::lock_guard<std::mutex> lock(outboundQueueMutex);
-            outboundQueue.pop();
-            if (outboundQueue.empty())
+            outboundBytes -= sizeof(Outbound) + outbound->message.getLength();
+            sendingQueue->pop();
+            sendingQueue = NULL;
+            if (controlQueue.empty() && outboundQueue.empty())
                 socket.setNotifyWritable(false);
         }
         return;
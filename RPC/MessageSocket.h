@@ -13,6 +13,7 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <list>
 #include <mutex>
 #include <queue>
 #include <vector>
@@ -54,6 +55,32 @@ class MessageSocket {
      */
     typedef uint64_t MessageId;
 
+    /**
+     * The class of an outbound message, which determines the order in which
+     * queued messages are sent. See sendMessage().
+     */
+    enum class Priority {
+        /**
+         * Ordinary messages, sent in FIFO order. These may be large, such as
+         * AppendEntry requests carrying a batch of entries.
+         */
+        NORMAL,
+        /**
+         * Small, latency-sensitive messages such as pings, heartbeats, and
+         * votes. These are sent ahead of any NORMAL messages that haven't
+         * started going out, so that they don't wait for a bulk transfer to
+         * drain.
+         */
+        CONTROL,
+    };
+
+    /**
+     * Whether CONTROL messages may be sent ahead of NORMAL ones. This is true
+     * unless changed; benchmarks turn it off to measure what the control lane
+     * buys, in which case every message is sent in FIFO order.
+     */
+    static bool controlLane;
+
     /**
      * Constructor.
      * \param eventLoop
@@ -85,8 +112,29 @@ class MessageSocket {
      * \param contents
      *      The data to send. This must be shorter than the maxMessageLength
      *      argument given to the constructor.
+     * \param traceId
+     *      If nonzero, once the message has been written to the socket, the
+     *      SEND stage is recorded under this trace ID and the trace is
+     *      finished. See Core::Trace.
+     * \param priority
+     *      Messages of the same priority are sent in the order they were
+     *      queued. CONTROL messages are sent before NORMAL ones, but only
+     *      between messages: a message that has started going out is always
+     *      finished first, so the two are never interleaved on the wire.
+     */
+    void sendMessage(MessageId messageId, Buffer contents,
+                     uint64_t traceId = 0,
+                     Priority priority = Priority::NORMAL);
+
+    /**
+     * Return the number of bytes of message data this socket holds in
+     * memory: the message being received and the messages waiting to be
+     * sent, including their bookkeeping. This is used to measure how much
+     * memory connections take up.
+     * This may only be called from the Event::Loop thread or while holding an
+     * Event::Loop::Lock.
      */
-    void sendMessage(MessageId messageId, Buffer contents);
+    uint64_t getBufferedBytes();
 
     /**
      * This method is overridden by a subclass and invoked when a new message
@@ -144,8 +192,9 @@ class MessageSocket {
 
         /**
          * Set whether the MessageSocket should be notified when writing to the
-         * socket wouldn't block. This may be called from any thread (it uses
-         * an Event::Loop::Lock internally).
+         * socket wouldn't block. This may be called from any thread. It uses
+         * an Event::Loop::Lock internally with the LIBEVENT backend; with the
+         * EPOLL backend, it doesn't need to stop the event loop.
          * \param shouldNotify
          *      True if the MessageSocket is interested in Events::Writable
          *      notifications, false otherwise.
@@ -158,11 +207,23 @@ class MessageSocket {
 
       private:
         void handleFileEvent(uint32_t events);
+        /**
+         * Helper for setNotifyWritable() that changes the events without
+         * taking an Event::Loop::Lock.
+         */
+        void setNotifyWritableUnlocked(bool shouldNotify);
         /// The MessageSocket to notify.
         MessageSocket& messageSocket;
+        /**
+         * Protects #closed and serializes close() with setNotifyWritable(),
+         * so that the events aren't changed once the fd has been closed.
+         */
+        std::mutex mutex;
         /**
          * Set to true if the socket has been closed.
-         * This can only be accessed while holding an Event::Loop::Lock.
+         * This may only be modified while holding both an Event::Loop::Lock
+         * and #mutex, so it may be read while holding either one (or from
+         * the event loop thread).
          */
         bool closed;
     };
@@ -222,7 +283,7 @@ class MessageSocket {
      */
     struct Outbound {
         /// Constructor.
-        Outbound(MessageId messageId, Buffer message);
+        Outbound(MessageId messageId, Buffer message, uint64_t traceId);
         /**
          * The number of bytes already sent for this message, including the
          * header.
@@ -236,8 +297,20 @@ class MessageSocket {
          * The contents of the message (after the header).
          */
         Buffer message;
+        /**
+         * The trace ID of the request this message replies to, or 0.
+         */
+        uint64_t traceId;
     };
 
+    /**
+     * A queue of messages waiting to be sent. This is backed by a std::list
+     * rather than the default std::deque, which allocates over half a
+     * kilobyte up front even when empty. Most sockets sit idle with empty
+     * queues most of the time, so that would dominate their memory usage.
+     */
+    typedef std::queue<Outbound, std::list<Outbound>> OutboundQueue;
+
     /**
      * Called when the socket has data that can be read without blocking.
      */
@@ -274,22 +347,43 @@ class MessageSocket {
     Inbound inbound;
 
     /**
-     * Protects #outboundQueue only from concurrent modification.
+     * Protects #outboundQueue and #controlQueue only from concurrent
+     * modification.
      */
     std::mutex outboundQueueMutex;
 
     /**
-     * A queue of messages waiting to be sent. The first one may be in the
-     * middle of transmission, while the others have not yet started. This
-     * queue is protected from concurrent modifications by #outboundQueueMutex.
+     * A queue of NORMAL priority messages waiting to be sent. The first one
+     * may be in the middle of transmission (see #sendingQueue), while the
+     * others have not yet started. This queue is protected from concurrent
+     * modifications by #outboundQueueMutex.
      *
-     * It's important that this remains a std::deque (or std::queue) because
+     * It's important that this remains a std::list or std::deque because
      * writable() holds a pointer to the first element without the lock, while
-     * sendMessage() may concurrently push onto the queue. std::deques are
-     * guaranteed not to invalidate pointers while elements are pushed and
-     * popped from the ends.
+     * sendMessage() may concurrently push onto the queue. Both are guaranteed
+     * not to invalidate pointers while elements are pushed and popped from
+     * the ends.
+     */
+    OutboundQueue outboundQueue;
+
+    /**
+     * Like #outboundQueue but for CONTROL priority messages. When writable()
+     * starts on a new message, it takes it from here if this is non-empty.
+     */
+    OutboundQueue controlQueue;
+
+    /**
+     * The sizes of the messages in #outboundQueue and #controlQueue plus
+     * sizeof(Outbound) for each one. Protected by #outboundQueueMutex.
+     */
+    uint64_t outboundBytes;
+
+    /**
+     * The queue whose first message has been partially sent, or NULL if no
+     * message is in the middle of transmission. This is only accessed from
+     * writable().
      */
-    std::queue<Outbound> outboundQueue;
+    OutboundQueue* sendingQueue;
 
     /**
      * Notifies MessageSocket when the socket can be read from or written to
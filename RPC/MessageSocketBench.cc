@@ -0,0 +1,125 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+#include "bench/Bench.h"
+#include "Core/Debug.h"
+#include "RPC/MessageSocket.h"
+
+namespace LogCabin {
+namespace RPC {
+namespace {
+
+/**
+ * Counts the messages it receives.
+ */
+class CountingMessageSocket : public MessageSocket {
+  public:
+    CountingMessageSocket(Event::Loop& eventLoop, int fd)
+        : MessageSocket(eventLoop, fd, 1024 * 1024)
+        , mutex()
+        , cond()
+        , received(0)
+    {
+    }
+    void onReceiveMessage(MessageId messageId, Buffer message) {
+        std::unique_lock<std::mutex> lockGuard(mutex);
+        ++received;
+        cond.notify_all();
+    }
+    void onDisconnect() {
+    }
+    void waitFor(uint64_t count) {
+        std::unique_lock<std::mutex> lockGuard(mutex);
+        while (received < count)
+            cond.wait(lockGuard);
+    }
+    std::mutex mutex;
+    std::condition_variable cond;
+    uint64_t received;
+};
+
+/**
+ * Send messages of the given size from one MessageSocket to another over a
+ * socketpair, with an event loop thread handling both ends.
+ * \param pipelined
+ *      If true, send all the messages up front. Otherwise, wait for each one
+ *      to arrive before sending the next.
+ * \param backend
+ *      The mechanism the event loop uses to wait for events.
+ */
+void
+sendMessages(Bench::State& state, uint32_t size, bool pipelined,
+             Event::Loop::Backend backend = Event::Loop::Backend::LIBEVENT)
+{
+    state.pauseTiming();
+    int socketPair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, socketPair) != 0)
+        PANIC("socketpair failed: %s", strerror(errno));
+    Event::Loop loop(backend);
+    CountingMessageSocket sender(loop, socketPair[0]);
+    CountingMessageSocket receiver(loop, socketPair[1]);
+    std::thread loopThread(&Event::Loop::runForever, &loop);
+    std::string payload(size, 'x');
+    state.setBytesPerIteration(size);
+    state.resumeTiming();
+
+    for (uint64_t i = 0; i < state.iterations; ++i) {
+        sender.sendMessage(i, Buffer(const_cast<char*>(payload.data()),
+                                     size, NULL));
+        if (!pipelined)
+            receiver.waitFor(i + 1);
+    }
+    receiver.waitFor(state.iterations);
+
+    state.pauseTiming();
+    loop.exit();
+    loopThread.join();
+}
+
+BENCHMARK(RPCMessageSocket, latency64B) {
+    sendMessages(state, 64, false);
+}
+
+BENCHMARK(RPCMessageSocket, stream64B) {
+    sendMessages(state, 64, true);
+}
+
+BENCHMARK(RPCMessageSocket, stream64KB) {
+    sendMessages(state, 64 * 1024, true);
+}
+
+BENCHMARK(RPCMessageSocket, latency64B_epoll) {
+    sendMessages(state, 64, false, Event::Loop::Backend::EPOLL);
+}
+
+BENCHMARK(RPCMessageSocket, stream64B_epoll) {
+    sendMessages(state, 64, true, Event::Loop::Backend::EPOLL);
+}
+
+BENCHMARK(RPCMessageSocket, stream64KB_epoll) {
+    sendMessages(state, 64 * 1024, true, Event::Loop::Backend::EPOLL);
+}
+
+} // namespace LogCabin::RPC::<anonymous>
+} // namespace LogCabin::RPC
+} // namespace LogCabin
@@ -95,6 +95,25 @@ TEST_F(RPCMessageSocketTest, sendMessage) {
     EXPECT_EQ(3U, outbound.message.getLength());
 }
 
+TEST_F(RPCMessageSocketTest, sendMessage_priority) {
+    msgSocket->sendMessage(1, Buffer());
+    msgSocket->sendMessage(2, Buffer(), 0, MessageSocket::Priority::CONTROL);
+    EXPECT_EQ(1U, msgSocket->outboundQueue.size());
+    ASSERT_EQ(1U, msgSocket->controlQueue.size());
+    MessageSocket::Header& header = msgSocket->controlQueue.front().header;
+    header.fromBigEndian();
+    EXPECT_EQ(2U, header.messageId);
+}
+
+TEST_F(RPCMessageSocketTest, sendMessage_noControlLane) {
+    MessageSocket::controlLane = false;
+    msgSocket->sendMessage(1, Buffer());
+    msgSocket->sendMessage(2, Buffer(), 0, MessageSocket::Priority::CONTROL);
+    MessageSocket::controlLane = true;
+    EXPECT_EQ(2U, msgSocket->outboundQueue.size());
+    EXPECT_EQ(0U, msgSocket->controlQueue.size());
+}
+
 TEST_F(RPCMessageSocketTest, readableSpurious) {
     msgSocket->readable();
     msgSocket->readable();
@@ -251,6 +270,66 @@ TEST_F(RPCMessageSocketTest, writableNormal) {
     }
 }
 
+/// Return a Buffer referring to the first 64 bytes of 'payload'.
+Buffer
+payloadBuffer()
+{
+    return Buffer(const_cast<char*>(payload), 64, NULL);
+}
+
+/// Receive one 64-byte message from 'fd' and return its ID.
+uint64_t
+recvMessageId(int fd)
+{
+    char buf[sizeof(MessageSocket::Header) + 64];
+    EXPECT_EQ(ssize_t(sizeof(buf)), recv(fd, buf, sizeof(buf), 0));
+    MessageSocket::Header header;
+    memcpy(&header, buf, sizeof(header));
+    header.fromBigEndian();
+    EXPECT_EQ(64U, header.payloadLength);
+    return header.messageId;
+}
+
+TEST_F(RPCMessageSocketTest, writable_controlFirst) {
+    msgSocket->sendMessage(1, payloadBuffer());
+    msgSocket->sendMessage(2, payloadBuffer());
+    msgSocket->sendMessage(3, payloadBuffer(), 0,
+                           MessageSocket::Priority::CONTROL);
+    msgSocket->sendMessage(4, payloadBuffer(), 0,
+                           MessageSocket::Priority::CONTROL);
+    for (uint32_t i = 0; i < 4; ++i)
+        msgSocket->writable();
+    ASSERT_FALSE(msgSocket->disconnected);
+    EXPECT_EQ(0U, msgSocket->outboundQueue.size());
+    EXPECT_EQ(0U, msgSocket->controlQueue.size());
+    EXPECT_EQ(3U, recvMessageId(remote));
+    EXPECT_EQ(4U, recvMessageId(remote));
+    EXPECT_EQ(1U, recvMessageId(remote));
+    EXPECT_EQ(2U, recvMessageId(remote));
+}
+
+TEST_F(RPCMessageSocketTest, writable_controlWaitsForMessageBoundary) {
+    msgSocket->sendMessage(1, payloadBuffer());
+    // Pretend message 1's header already went out.
+    msgSocket->sendingQueue = &msgSocket->outboundQueue;
+    msgSocket->outboundQueue.front().bytesSent = sizeof(MessageSocket::Header);
+    msgSocket->sendMessage(2, payloadBuffer(), 0,
+                           MessageSocket::Priority::CONTROL);
+
+    // The rest of message 1 goes out before message 2.
+    msgSocket->writable();
+    EXPECT_EQ(0U, msgSocket->outboundQueue.size());
+    EXPECT_EQ(1U, msgSocket->controlQueue.size());
+    EXPECT_TRUE(msgSocket->sendingQueue == NULL);
+    char buf[64];
+    ASSERT_EQ(64, recv(remote, buf, sizeof(buf), 0));
+    EXPECT_EQ(0, memcmp(payload, buf, sizeof(buf)));
+
+    msgSocket->writable();
+    EXPECT_EQ(0U, msgSocket->controlQueue.size());
+    EXPECT_EQ(2U, recvMessageId(remote));
+}
+
 } // namespace LogCabin::RPC::<anonymous>
 } // namespace LogCabin::RPC
 } // namespace LogCabin
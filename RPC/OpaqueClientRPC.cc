@@ -89,6 +89,15 @@ OpaqueClientRPC::isReady()
     return ready;
 }
 
+void
+OpaqueClientRPC::setReadyCallback(std::function<void()> callback)
+{
+    if (!ready && session)
+        session->setReadyCallback(*this, std::move(callback));
+    else
+        callback();
+}
+
 Buffer*
 OpaqueClientRPC::peekReply()
 {
@@ -112,6 +121,20 @@ OpaqueClientRPC::waitForReply()
     }
 }
 
+bool
+OpaqueClientRPC::waitForStreamReply(
+        Buffer& message,
+        Core::Time::SteadyClock::time_point deadline)
+{
+    if (ready)
+        return false;
+    if (session)
+        return session->waitForStreamReply(*this, message, deadline);
+    ready = true;
+    errorMessage = "This RPC was never associated with a ClientSession.";
+    return false;
+}
+
 ///// private methods /////
 
 void
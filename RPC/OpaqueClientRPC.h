@@ -14,10 +14,12 @@
  */
 
 #include <cinttypes>
+#include <functional>
 #include <memory>
 #include <stdexcept>
 #include <string>
 
+#include "Core/Time.h"
 #include "RPC/Buffer.h"
 
 #ifndef LOGCABIN_RPC_OPAQUECLIENTRPC_H
@@ -112,6 +114,18 @@ class OpaqueClientRPC {
      */
     bool isReady();
 
+    /**
+     * Arrange for a function to be called once the reply is ready or an error
+     * has occurred, so that a thread with several RPCs outstanding can sleep
+     * until one of them finishes rather than polling isReady(). The callback
+     * is called at most once. It runs right away if the RPC is already done;
+     * otherwise, it runs on the event loop thread with the ClientSession's
+     * lock held, so it must return quickly and must not use any RPCs.
+     * Canceling or destroying the RPC before then drops the callback.
+     * This may not be used with streaming RPCs.
+     */
+    void setReadyCallback(std::function<void()> callback);
+
     /**
      * Look at the reply buffer.
      *
@@ -131,6 +145,25 @@ class OpaqueClientRPC {
      */
     void waitForReply();
 
+    /**
+     * Block until the next message of a streaming RPC arrives, the deadline
+     * passes, or an error occurs. The RPC must have been sent as a stream
+     * (see ClientSession::sendRequest()); such RPCs never become ready
+     * except through an error or #cancel().
+     *
+     * This may be used from worker threads only, like waitForReply().
+     *
+     * \param[out] message
+     *      Set to the next message, if this returns true.
+     * \param deadline
+     *      Give up waiting at this time.
+     * \return
+     *      True if a message was returned. False if the deadline passed or an
+     *      error occurred; these are told apart with #getErrorMessage().
+     */
+    bool waitForStreamReply(Buffer& message,
+                            Core::Time::SteadyClock::time_point deadline);
+
   private:
 
     /**
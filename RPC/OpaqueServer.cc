@@ -13,6 +13,7 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <assert.h>
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
@@ -47,10 +48,12 @@ OpaqueServer::ServerTCPListener::handleNewConnection(
         if (close(fd) != 0)
             WARNING("close(%d) failed: %s", fd, strerror(errno));
     } else {
-        std::shared_ptr<ServerMessageSocket> messageSocket(
-                new ServerMessageSocket(server, fd, server->sockets.size()));
+        std::shared_ptr<ServerMessageSocket> messageSocket =
+            std::make_shared<ServerMessageSocket>(server, fd);
         messageSocket->self = messageSocket;
-        server->sockets.push_back(messageSocket);
+        messageSocket->socketsIndex = server->sockets.add(messageSocket);
+        messageSocket->resetIdleTimer();
+        ++server->numAccepted;
     }
 }
 
@@ -58,12 +61,13 @@ OpaqueServer::ServerTCPListener::handleNewConnection(
 
 OpaqueServer::ServerMessageSocket::ServerMessageSocket(
         OpaqueServer* server,
-        int fd,
-        size_t socketsIndex)
+        int fd)
     : MessageSocket(server->eventLoop, fd, server->maxMessageLength)
     , server(server)
-    , socketsIndex(socketsIndex)
+    , socketsIndex(SocketTable::NO_INDEX)
     , self()
+    , active(false)
+    , idleTimer(*this, server->eventLoop)
 {
 }
 
@@ -72,10 +76,11 @@ OpaqueServer::ServerMessageSocket::onReceiveMessage(
         MessageId messageId,
         Buffer message)
 {
+    active = true;
     // Reply to ping requests here.
     if (messageId == PING_MESSAGE_ID) {
         VERBOSE("Responding to ping");
-        sendMessage(PING_MESSAGE_ID, Buffer());
+        sendMessage(PING_MESSAGE_ID, Buffer(), 0, Priority::CONTROL);
         return;
     }
     if (server != NULL) {
@@ -97,13 +102,133 @@ OpaqueServer::ServerMessageSocket::close()
 {
     if (server != NULL) {
         Event::Loop::Lock lock(server->eventLoop);
-        auto& sockets = server->sockets;
-        std::swap(sockets[socketsIndex], sockets[sockets.size() - 1]);
-        sockets[socketsIndex]->socketsIndex = socketsIndex;
-        sockets.pop_back();
+        // The socket may have been closed already, for example by its idle
+        // timer while an RPC reply kept it alive.
+        if (socketsIndex == SocketTable::NO_INDEX)
+            return;
+        idleTimer.deschedule();
+        size_t index = socketsIndex;
+        socketsIndex = SocketTable::NO_INDEX;
+        // This may destroy the socket, so it must be the last use of 'this'.
+        server->sockets.remove(index);
+    }
+}
+
+void
+OpaqueServer::ServerMessageSocket::resetIdleTimer()
+{
+    if (server != NULL &&
+        server->idleTimeoutMs > 0 &&
+        socketsIndex != SocketTable::NO_INDEX) {
+        idleTimer.schedule(server->idleTimeoutMs * 1000 * 1000);
+    } else {
+        idleTimer.deschedule();
     }
 }
 
+////////// OpaqueServer::ServerMessageSocket::IdleTimer //////////
+
+OpaqueServer::ServerMessageSocket::IdleTimer::IdleTimer(
+        ServerMessageSocket& socket,
+        Event::Loop& eventLoop)
+    : CoarseTimer(eventLoop)
+    , socket(socket)
+{
+}
+
+void
+OpaqueServer::ServerMessageSocket::IdleTimer::handleTimerEvent()
+{
+    if (socket.server == NULL)
+        return;
+    if (socket.active) {
+        socket.active = false;
+        socket.resetIdleTimer();
+        return;
+    }
+    NOTICE("Closing connection that has been idle for %lu ms",
+           socket.server->idleTimeoutMs);
+    ++socket.server->numIdleClosed;
+    // This may destroy the socket and this timer.
+    socket.close();
+}
+
+////////// OpaqueServer::SocketTable //////////
+
+const size_t OpaqueServer::SocketTable::NO_INDEX;
+const size_t OpaqueServer::SocketTable::SLAB_SLOTS;
+
+OpaqueServer::SocketTable::SocketTable()
+    : slabs()
+    , freeIndexes()
+    , numSockets(0)
+{
+}
+
+size_t
+OpaqueServer::SocketTable::add(std::shared_ptr<ServerMessageSocket> socket)
+{
+    if (freeIndexes.empty()) {
+        size_t base = capacity();
+        slabs.emplace_back(
+            new std::shared_ptr<ServerMessageSocket>[SLAB_SLOTS]);
+        // Hand out the lowest indexes first.
+        for (size_t i = SLAB_SLOTS; i > 0; --i)
+            freeIndexes.push_back(base + i - 1);
+    }
+    size_t index = freeIndexes.back();
+    freeIndexes.pop_back();
+    at(index) = std::move(socket);
+    ++numSockets;
+    return index;
+}
+
+void
+OpaqueServer::SocketTable::remove(size_t index)
+{
+    std::shared_ptr<ServerMessageSocket> socket = std::move(at(index));
+    assert(socket);
+    freeIndexes.push_back(index);
+    --numSockets;
+    // 'socket' goes out of scope here, possibly destroying it, after the
+    // table is back in a consistent state.
+}
+
+std::shared_ptr<OpaqueServer::ServerMessageSocket>&
+OpaqueServer::SocketTable::at(size_t index)
+{
+    return slabs.at(index / SLAB_SLOTS)[index % SLAB_SLOTS];
+}
+
+size_t
+OpaqueServer::SocketTable::size() const
+{
+    return numSockets;
+}
+
+size_t
+OpaqueServer::SocketTable::capacity() const
+{
+    return slabs.size() * SLAB_SLOTS;
+}
+
+uint64_t
+OpaqueServer::SocketTable::getBytes() const
+{
+    return (capacity() * sizeof(std::shared_ptr<ServerMessageSocket>) +
+            freeIndexes.capacity() * sizeof(size_t));
+}
+
+////////// OpaqueServer::ConnectionStats //////////
+
+OpaqueServer::ConnectionStats::ConnectionStats()
+    : numOpen(0)
+    , numAccepted(0)
+    , numIdleClosed(0)
+    , bytes(0)
+{
+}
+
 ////////// OpaqueServer //////////
 
 OpaqueServer::OpaqueServer(Event::Loop& eventLoop,
@@ -111,6 +236,9 @@ OpaqueServer::OpaqueServer(Event::Loop& eventLoop,
     : eventLoop(eventLoop)
     , maxMessageLength(maxMessageLength)
     , sockets()
+    , idleTimeoutMs(0)
+    , numAccepted(0)
+    , numIdleClosed(0)
     , listener(this)
 {
 }
@@ -124,17 +252,51 @@ OpaqueServer::~OpaqueServer()
     listener.server = NULL;
 
     // Stop the socket objects from handling new RPCs and
-    // accessing the sockets vector.
-    for (auto it = sockets.begin(); it != sockets.end(); ++it) {
-        ServerMessageSocket& socket = **it;
-        socket.server = NULL;
+    // accessing the sockets table.
+    for (size_t i = 0; i < sockets.capacity(); ++i) {
+        std::shared_ptr<ServerMessageSocket>& socket = sockets.at(i);
+        if (socket) {
+            socket->server = NULL;
+            socket->idleTimer.deschedule();
+        }
     }
 }
 
 std::string
-OpaqueServer::bind(const Address& listenAddress)
+OpaqueServer::bind(const Address& listenAddress, bool reusePort)
+{
+    return listener.bind(listenAddress, reusePort);
+}
+
+void
+OpaqueServer::setIdleTimeout(uint64_t milliseconds)
 {
-    return listener.bind(listenAddress);
+    Event::Loop::Lock lockGuard(eventLoop);
+    idleTimeoutMs = milliseconds;
+    for (size_t i = 0; i < sockets.capacity(); ++i) {
+        std::shared_ptr<ServerMessageSocket>& socket = sockets.at(i);
+        if (socket)
+            socket->resetIdleTimer();
+    }
+}
+
+OpaqueServer::ConnectionStats
+OpaqueServer::getConnectionStats()
+{
+    Event::Loop::Lock lockGuard(eventLoop);
+    ConnectionStats stats;
+    stats.numOpen = sockets.size();
+    stats.numAccepted = numAccepted;
+    stats.numIdleClosed = numIdleClosed;
+    stats.bytes = sockets.getBytes();
+    for (size_t i = 0; i < sockets.capacity(); ++i) {
+        std::shared_ptr<ServerMessageSocket>& socket = sockets.at(i);
+        if (socket) {
+            stats.bytes += (sizeof(ServerMessageSocket) +
+                            socket->getBufferedBytes());
+        }
+    }
+    return stats;
 }
 
 } // namespace LogCabin::RPC
@@ -14,7 +14,9 @@
  */
 
 #include <memory>
+#include <vector>
 
+#include "Event/CoarseTimer.h"
 #include "RPC/MessageSocket.h"
 #include "RPC/TCPListener.h"
 
@@ -67,15 +69,59 @@ class OpaqueServer {
      * Listen on an address for new client connections. You can call this
      * multiple times to listen on multiple addresses. (But if you call this
      * twice with the same address, the second time will always throw an
-     * error.)
+     * error, unless reusePort is set both times.)
      * This method is thread-safe.
      * \param listenAddress
      *      The TCP address on listen for new client connections.
+     * \param reusePort
+     *      See TCPListener::bind(). This lets OpaqueServers on different
+     *      Event::Loops share the address.
      * \return
      *      An error message if this was not able to listen on the given
      *      address; the empty string otherwise.
      */
-    std::string bind(const Address& listenAddress);
+    std::string bind(const Address& listenAddress, bool reusePort = false);
+
+    /**
+     * Close connections that have not received anything in a while. This
+     * bounds the resources that clients which go away without closing their
+     * connections can hold on to. The timeout must be well above the period
+     * at which clients ping the server while they wait for replies (see
+     * ClientSession), or connections with slow RPCs outstanding will be
+     * dropped too.
+     * This method is thread-safe.
+     * \param milliseconds
+     *      Close a connection once it has received nothing for between one
+     *      and two times this many milliseconds, or never if this is 0 (the
+     *      default). This applies to existing connections as well as new
+     *      ones.
+     */
+    void setIdleTimeout(uint64_t milliseconds);
+
+    /**
+     * Counters describing the client connections to this server.
+     */
+    struct ConnectionStats {
+        ConnectionStats();
+        /// The number of connections currently open.
+        uint64_t numOpen;
+        /// The number of connections accepted since the server started.
+        uint64_t numAccepted;
+        /// The number of connections closed by the idle timeout.
+        uint64_t numIdleClosed;
+        /**
+         * The memory used by the open connections: the socket objects, the
+         * messages buffered on them, and the connection table. This doesn't
+         * count memory allocator overhead or the kernel's socket buffers.
+         */
+        uint64_t bytes;
+    };
+
+    /**
+     * Return the current ConnectionStats.
+     * This method is thread-safe.
+     */
+    ConnectionStats getConnectionStats();
 
     /**
      * This method is overridden by a subclass and invoked when a new RPC
@@ -112,16 +158,14 @@ class OpaqueServer {
     class ServerMessageSocket : public MessageSocket {
       public:
         /**
-         * Constructor.
+         * Constructor. The caller must then add the socket to
+         * OpaqueServer::sockets and set #socketsIndex and #self.
          * \param server
          *      OpaqueServer owning this socket.
          * \param fd
          *      A connected TCP socket.
-         * \param socketsIndex
-         *      The index into OpaqueServer::sockets at which this object can
-         *      be found.
          */
-        ServerMessageSocket(OpaqueServer* server, int fd, size_t socketsIndex);
+        ServerMessageSocket(OpaqueServer* server, int fd);
         void onReceiveMessage(MessageId messageId, Buffer message);
         void onDisconnect();
         /**
@@ -130,6 +174,25 @@ class OpaqueServer {
          * This may be called from any thread.
          */
         void close();
+        /**
+         * Schedule #idleTimer for one idle timeout from now, or stop it if
+         * the server has no idle timeout.
+         * This may only be called from the Event::Loop or while holding an
+         * Event::Loop::Lock.
+         */
+        void resetIdleTimer();
+        /**
+         * Closes the socket when it has been idle for too long. This fires
+         * once per idle timeout and closes the socket if nothing arrived
+         * since the last time, so that receiving a message costs no more
+         * than setting #active.
+         */
+        class IdleTimer : public Event::CoarseTimer {
+          public:
+            IdleTimer(ServerMessageSocket& socket, Event::Loop& eventLoop);
+            void handleTimerEvent();
+            ServerMessageSocket& socket;
+        };
         /**
          * The OpaqueServer which keeps a strong reference to this object, or
          * NULL if the server has gone away.
@@ -137,7 +200,9 @@ class OpaqueServer {
         OpaqueServer* server;
         /**
          * The index into OpaqueServer::sockets at which this object can be
-         * found.
+         * found, or SocketTable::NO_INDEX once it has been removed.
+         * This may only be accessed from the Event::Loop or while holding an
+         * Event::Loop::Lock.
          */
         size_t socketsIndex;
         /**
@@ -145,12 +210,90 @@ class OpaqueServer {
          * to send their replies back on their originating socket.
          */
         std::weak_ptr<ServerMessageSocket> self;
+        /**
+         * Set when a message arrives and cleared each time #idleTimer fires.
+         * This is only accessed from the Event::Loop thread.
+         */
+        bool active;
+        /**
+         * See OpaqueServer::setIdleTimeout(). This is declared last so that
+         * it's destroyed first, while the rest of the object is still
+         * intact for its handler.
+         */
+        IdleTimer idleTimer;
 
         // ServerMessageSocket is not copyable.
         ServerMessageSocket(const ServerMessageSocket&) = delete;
         ServerMessageSocket& operator=(const ServerMessageSocket&) = delete;
     };
 
+    /**
+     * Holds the open ServerMessageSockets. Sockets keep the same index for as
+     * long as they're in the table, and freed indexes are reused. The slots
+     * are allocated in fixed-size slabs that never move, so adding sockets
+     * never has to copy the existing ones, and the table costs only a
+     * pointer's worth of memory per connection.
+     * This may only be accessed from the Event::Loop or while holding an
+     * Event::Loop::Lock.
+     */
+    class SocketTable {
+      public:
+        SocketTable();
+        /**
+         * Add a socket to a free slot.
+         * \return
+         *      The index of the slot.
+         */
+        size_t add(std::shared_ptr<ServerMessageSocket> socket);
+        /**
+         * Remove the socket at the given index, dropping the table's
+         * reference to it. The socket may be destroyed before this returns.
+         */
+        void remove(size_t index);
+        /**
+         * Return the slot at the given index, which is NULL if it's free.
+         * \param index
+         *      Less than capacity().
+         */
+        std::shared_ptr<ServerMessageSocket>& at(size_t index);
+        /**
+         * Return the number of sockets in the table.
+         */
+        size_t size() const;
+        /**
+         * Return the number of slots allocated so far. All the sockets in the
+         * table have indexes below this.
+         */
+        size_t capacity() const;
+        /**
+         * Return the memory taken up by the slots, in bytes.
+         */
+        uint64_t getBytes() const;
+        /**
+         * Used for ServerMessageSocket::socketsIndex when the socket isn't in
+         * the table.
+         */
+        static const size_t NO_INDEX = ~0UL;
+        /**
+         * The number of slots in each slab.
+         */
+        static const size_t SLAB_SLOTS = 1024;
+      private:
+        /**
+         * Each slab holds SLAB_SLOTS slots.
+         */
+        std::vector<std::unique_ptr<std::shared_ptr<ServerMessageSocket>[]>>
+            slabs;
+        /**
+         * Indexes of the empty slots below capacity(), used as a stack.
+         */
+        std::vector<size_t> freeIndexes;
+        /**
+         * See size().
+         */
+        size_t numSockets;
+    };
+
   public:
 
     /**
@@ -174,7 +317,25 @@ class OpaqueServer {
      * This may only be accessed from the Event::Loop or while holding an
      * Event::Loop::Lock.
      */
-    std::vector<std::shared_ptr<ServerMessageSocket>> sockets;
+    SocketTable sockets;
+
+    /**
+     * See setIdleTimeout(). This may only be accessed from the Event::Loop or
+     * while holding an Event::Loop::Lock.
+     */
+    uint64_t idleTimeoutMs;
+
+    /**
+     * See ConnectionStats::numAccepted. This may only be accessed from the
+     * Event::Loop or while holding an Event::Loop::Lock.
+     */
+    uint64_t numAccepted;
+
+    /**
+     * See ConnectionStats::numIdleClosed. This may only be accessed from the
+     * Event::Loop or while holding an Event::Loop::Lock.
+     */
+    uint64_t numIdleClosed;
 
     /**
      * This listens for incoming TCP connections and accepts them.
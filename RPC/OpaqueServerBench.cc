@@ -0,0 +1,153 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <algorithm>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "bench/Bench.h"
+#include "Core/Debug.h"
+#include "Protocol/Common.h"
+#include "RPC/OpaqueServer.h"
+#include "RPC/OpaqueServerRPC.h"
+
+namespace LogCabin {
+namespace RPC {
+namespace {
+
+/**
+ * Drops every RPC.
+ */
+class NullServer : public OpaqueServer {
+  public:
+    explicit NullServer(Event::Loop& eventLoop)
+        : OpaqueServer(eventLoop, 1024)
+    {
+    }
+    void handleRPC(OpaqueServerRPC serverRPC) {
+    }
+};
+
+/**
+ * The number of client connections to have open at once.
+ */
+const uint64_t CONNECTIONS_PER_BATCH = 256;
+
+/**
+ * Open connections to an OpaqueServer, waiting for the server to accept each
+ * batch of them before closing them.
+ * \param backend
+ *      The mechanism the event loop uses to wait for events.
+ */
+void
+acceptConnections(Bench::State& state, Event::Loop::Backend backend)
+{
+    state.pauseTiming();
+    Event::Loop loop(backend);
+    std::thread loopThread(&Event::Loop::runForever, &loop);
+    {
+        NullServer server(loop);
+        Address address("127.0.0.1", Protocol::Common::DEFAULT_PORT);
+        std::string error = server.bind(address);
+        if (!error.empty())
+            PANIC("%s", error.c_str());
+        std::vector<int> fds;
+        uint64_t accepted = 0;
+        while (accepted < state.iterations) {
+            uint64_t batch = std::min(state.iterations - accepted,
+                                      CONNECTIONS_PER_BATCH);
+            state.resumeTiming();
+            for (uint64_t i = 0; i < batch; ++i) {
+                int fd = socket(AF_INET, SOCK_STREAM, 0);
+                if (fd < 0)
+                    PANIC("socket failed: %s", strerror(errno));
+                if (connect(fd, address.getSockAddr(),
+                            address.getSockAddrLen()) != 0) {
+                    PANIC("connect failed: %s", strerror(errno));
+                }
+                fds.push_back(fd);
+            }
+            accepted += batch;
+            while (server.getConnectionStats().numAccepted < accepted)
+                usleep(100);
+            state.pauseTiming();
+            // Reset the connections rather than leaving thousands of them in
+            // TIME_WAIT, which would run out of local ports.
+            struct linger linger;
+            linger.l_onoff = 1;
+            linger.l_linger = 0;
+            for (auto it = fds.begin(); it != fds.end(); ++it) {
+                setsockopt(*it, SOL_SOCKET, SO_LINGER,
+                           &linger, sizeof(linger));
+                close(*it);
+            }
+            fds.clear();
+        }
+        while (server.getConnectionStats().numOpen > 0)
+            usleep(100);
+    }
+    loop.exit();
+    loopThread.join();
+}
+
+/**
+ * Deliver requests to an OpaqueServer's socket directly, without going
+ * through the network.
+ * \param idleTimeoutMs
+ *      Passed to OpaqueServer::setIdleTimeout().
+ */
+void
+receiveMessages(Bench::State& state, uint64_t idleTimeoutMs)
+{
+    state.pauseTiming();
+    Event::Loop loop;
+    NullServer server(loop);
+    server.setIdleTimeout(idleTimeoutMs);
+    int socketPair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, socketPair) != 0)
+        PANIC("socketpair failed: %s", strerror(errno));
+    server.listener.handleNewConnection(socketPair[0]);
+    OpaqueServer::ServerMessageSocket& socket = *server.sockets.at(0);
+    state.resumeTiming();
+
+    for (uint64_t i = 0; i < state.iterations; ++i)
+        socket.onReceiveMessage(i + 1, Buffer());
+
+    state.pauseTiming();
+    close(socketPair[1]);
+}
+
+BENCHMARK(RPCOpaqueServer, accept) {
+    acceptConnections(state, Event::Loop::Backend::LIBEVENT);
+}
+
+BENCHMARK(RPCOpaqueServer, accept_epoll) {
+    acceptConnections(state, Event::Loop::Backend::EPOLL);
+}
+
+BENCHMARK(RPCOpaqueServer, onReceiveMessage) {
+    receiveMessages(state, 0);
+}
+
+BENCHMARK(RPCOpaqueServer, onReceiveMessage_idleTimeout) {
+    receiveMessages(state, 60 * 1000);
+}
+
+} // namespace LogCabin::RPC::<anonymous>
+} // namespace LogCabin::RPC
+} // namespace LogCabin
@@ -13,6 +13,7 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include "Core/Trace.h"
 #include "RPC/OpaqueServerRPC.h"
 
 namespace LogCabin {
@@ -21,6 +22,9 @@ namespace RPC {
 OpaqueServerRPC::OpaqueServerRPC()
     : request()
     , response()
+    , receivedAt()
+    , traceId(0)
+    , priority(MessageSocket::Priority::NORMAL)
     , messageSocket()
     , messageId(~0UL)
     , responseTarget(NULL)
@@ -33,6 +37,9 @@ OpaqueServerRPC::OpaqueServerRPC(
         Buffer request)
     : request(std::move(request))
     , response()
+    , receivedAt(Core::Time::SteadyClock::now())
+    , traceId(0)
+    , priority(MessageSocket::Priority::NORMAL)
     , messageSocket(messageSocket)
     , messageId(messageId)
     , responseTarget(NULL)
@@ -42,6 +49,9 @@ OpaqueServerRPC::OpaqueServerRPC(
 OpaqueServerRPC::OpaqueServerRPC(OpaqueServerRPC&& other)
     : request(std::move(other.request))
     , response(std::move(other.response))
+    , receivedAt(other.receivedAt)
+    , traceId(other.traceId)
+    , priority(other.priority)
     , messageSocket(std::move(other.messageSocket))
     , messageId(std::move(other.messageId))
     , responseTarget(std::move(other.responseTarget))
@@ -57,6 +67,9 @@ OpaqueServerRPC::operator=(OpaqueServerRPC&& other)
 {
     request = std::move(other.request);
     response = std::move(other.response);
+    receivedAt = other.receivedAt;
+    traceId = other.traceId;
+    priority = other.priority;
     messageSocket = std::move(other.messageSocket);
     messageId = std::move(other.messageId);
     responseTarget = std::move(other.responseTarget);
@@ -80,7 +93,8 @@ OpaqueServerRPC::sendReply()
     std::shared_ptr<OpaqueServer::ServerMessageSocket> socket =
         messageSocket.lock();
     if (socket) {
-        socket->sendMessage(messageId, std::move(response));
+        socket->sendMessage(messageId, std::move(response), traceId,
+                            priority);
     } else {
         // During normal operation, this indicates that either the socket has
         // been disconnected or the reply has already been sent.
@@ -94,9 +108,35 @@ OpaqueServerRPC::sendReply()
 
         // Drop the reply on the floor.
         response.reset();
+        Core::Trace::finish(traceId);
     }
     // Prevent the server from replying again.
     messageSocket.reset();
+    traceId = 0;
+}
+
+bool
+OpaqueServerRPC::sendPartialReply(Buffer message)
+{
+    std::shared_ptr<OpaqueServer::ServerMessageSocket> socket =
+        messageSocket.lock();
+    if (socket) {
+        socket->sendMessage(messageId, std::move(message), 0, priority);
+        return true;
+    }
+    // For unit testing only, we can store replies from mock RPCs that have
+    // no sessions.
+    if (responseTarget != NULL) {
+        *responseTarget = std::move(message);
+        return true;
+    }
+    return false;
+}
+
+bool
+OpaqueServerRPC::isSessionOpen() const
+{
+    return !messageSocket.expired() || responseTarget != NULL;
 }
 
 } // namespace LogCabin::RPC
@@ -15,6 +15,7 @@
 
 #include <memory>
 
+#include "Core/Time.h"
 #include "RPC/Buffer.h"
 #include "RPC/MessageSocket.h"
 #include "RPC/OpaqueServer.h"
@@ -85,6 +86,26 @@ class OpaqueServerRPC {
      */
     void sendReply();
 
+    /**
+     * Send one message of a streamed response back to the client without
+     * completing the RPC. The message carries the same message ID as the
+     * request, so the client must have asked for a stream (see
+     * ClientSession::sendRequest()).
+     * \param message
+     *      The contents of the message.
+     * \return
+     *      False if the session on which this request originated has closed
+     *      or the reply has already been sent, in which case the message is
+     *      dropped; true otherwise.
+     */
+    bool sendPartialReply(Buffer message);
+
+    /**
+     * Return false if the session on which this request originated has
+     * closed or the reply has already been sent; true otherwise.
+     */
+    bool isSessionOpen() const;
+
     /**
      * The RPC request received from the client.
      */
@@ -95,6 +116,23 @@ class OpaqueServerRPC {
      */
     Buffer response;
 
+    /**
+     * The time at which the request was received from the network.
+     */
+    Core::Time::SteadyClock::time_point receivedAt;
+
+    /**
+     * If nonzero, the reply is traced under this ID once it is sent.
+     * See Core::Trace.
+     */
+    uint64_t traceId;
+
+    /**
+     * The priority with which the reply and any partial replies are sent.
+     * See MessageSocket::sendMessage().
+     */
+    MessageSocket::Priority priority;
+
   private:
     /**
      * The socket on which to send the reply.
@@ -111,7 +149,8 @@ class OpaqueServerRPC {
     /**
      * This is used in unit testing only. During normal operation, this is
      * always NULL. If this is not NULL when sendReply() is invoked, the reply
-     * will be moved here.
+     * will be moved here. Partial replies are moved here too, each replacing
+     * the last.
      */
     Buffer* responseTarget;
 
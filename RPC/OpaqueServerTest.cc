@@ -14,6 +14,8 @@
  */
 
 #include <gtest/gtest.h>
+#include <thread>
+#include <unistd.h>
 
 #include "Core/Debug.h"
 #include "Protocol/Common.h"
@@ -71,11 +73,21 @@ TEST_F(RPCOpaqueServerTest, TCPListener_handleNewConnection) {
     EXPECT_EQ(&server, socket.server);
     EXPECT_EQ(0U, socket.socketsIndex);
     EXPECT_FALSE(socket.self.expired());
+    EXPECT_FALSE(socket.idleTimer.isScheduled());
+    EXPECT_EQ(1U, server.numAccepted);
 
     server.listener.server = NULL;
     server.listener.handleNewConnection(fd2);
     fd2 = -1;
     EXPECT_EQ(1U, server.sockets.size());
+    EXPECT_EQ(1U, server.numAccepted);
+}
+
+TEST_F(RPCOpaqueServerTest, TCPListener_handleNewConnection_idleTimeout) {
+    server.setIdleTimeout(1000);
+    server.listener.handleNewConnection(fd1);
+    fd1 = -1;
+    EXPECT_TRUE(server.sockets.at(0)->idleTimer.isScheduled());
 }
 
 TEST_F(RPCOpaqueServerTest, MessageSocket_onReceiveMessage) {
@@ -94,7 +106,15 @@ TEST_F(RPCOpaqueServerTest, MessageSocket_onReceiveMessage_ping) {
     OpaqueServer::ServerMessageSocket& socket = *server.sockets.at(0);
     socket.onReceiveMessage(0, Buffer());
     ASSERT_FALSE(server.lastRPC);
-    EXPECT_EQ(1U, socket.outboundQueue.size());
+    EXPECT_EQ(1U, socket.controlQueue.size());
+}
+
+TEST_F(RPCOpaqueServerTest, MessageSocket_onReceiveMessage_active) {
+    server.listener.handleNewConnection(fd1);
+    OpaqueServer::ServerMessageSocket& socket = *server.sockets.at(0);
+    EXPECT_FALSE(socket.active);
+    socket.onReceiveMessage(0, Buffer());
+    EXPECT_TRUE(socket.active);
 }
 
 TEST_F(RPCOpaqueServerTest, MessageSocket_onDisconnect) {
@@ -105,11 +125,81 @@ TEST_F(RPCOpaqueServerTest, MessageSocket_onDisconnect) {
     EXPECT_EQ(2U, server.sockets.size());
     server.sockets.at(0)->onDisconnect();
     EXPECT_EQ(1U, server.sockets.size());
-    EXPECT_EQ(0U, server.sockets.at(0)->socketsIndex);
+    // The other socket keeps its index.
+    EXPECT_FALSE(server.sockets.at(0));
+    EXPECT_EQ(1U, server.sockets.at(1)->socketsIndex);
 }
 
 TEST_F(RPCOpaqueServerTest, MessageSocket_close) {
-    // tested by onDisconnect
+    server.setIdleTimeout(1000);
+    server.listener.handleNewConnection(fd1);
+    fd1 = -1;
+    std::shared_ptr<OpaqueServer::ServerMessageSocket> socket =
+        server.sockets.at(0);
+    socket->close();
+    EXPECT_EQ(0U, server.sockets.size());
+    EXPECT_EQ(OpaqueServer::SocketTable::NO_INDEX, socket->socketsIndex);
+    EXPECT_FALSE(socket->idleTimer.isScheduled());
+    // A socket that's still around for an RPC may be closed again, and it
+    // won't take up the slot of another socket.
+    server.listener.handleNewConnection(fd2);
+    fd2 = -1;
+    socket->resetIdleTimer();
+    EXPECT_FALSE(socket->idleTimer.isScheduled());
+    socket->close();
+    EXPECT_EQ(1U, server.sockets.size());
+}
+
+TEST_F(RPCOpaqueServerTest, IdleTimer_handleTimerEvent) {
+    server.setIdleTimeout(1000);
+    server.listener.handleNewConnection(fd1);
+    fd1 = -1;
+    std::weak_ptr<OpaqueServer::ServerMessageSocket> socket =
+        server.sockets.at(0);
+    // received something since the last time: check again later
+    socket.lock()->active = true;
+    socket.lock()->idleTimer.handleTimerEvent();
+    EXPECT_FALSE(socket.lock()->active);
+    EXPECT_TRUE(socket.lock()->idleTimer.isScheduled());
+    EXPECT_EQ(0U, server.numIdleClosed);
+    // idle
+    socket.lock()->idleTimer.handleTimerEvent();
+    EXPECT_TRUE(socket.expired());
+    EXPECT_EQ(0U, server.sockets.size());
+    EXPECT_EQ(1U, server.numIdleClosed);
+}
+
+TEST_F(RPCOpaqueServerTest, IdleTimer_fires) {
+    server.setIdleTimeout(1);
+    server.listener.handleNewConnection(fd1);
+    fd1 = -1;
+    std::thread thread(&Event::Loop::runForever, &loop);
+    while (server.getConnectionStats().numOpen > 0)
+        usleep(1000);
+    loop.exit();
+    thread.join();
+    EXPECT_EQ(1U, server.numIdleClosed);
+}
+
+TEST_F(RPCOpaqueServerTest, SocketTable) {
+    OpaqueServer::SocketTable table;
+    EXPECT_EQ(0U, table.capacity());
+    // The table doesn't mind holding the same socket many times.
+    std::shared_ptr<OpaqueServer::ServerMessageSocket> socket =
+        std::make_shared<OpaqueServer::ServerMessageSocket>(&server, fd1);
+    fd1 = -1;
+    for (size_t i = 0; i < OpaqueServer::SocketTable::SLAB_SLOTS + 1; ++i)
+        EXPECT_EQ(i, table.add(socket));
+    EXPECT_EQ(OpaqueServer::SocketTable::SLAB_SLOTS + 1, table.size());
+    EXPECT_EQ(2 * OpaqueServer::SocketTable::SLAB_SLOTS, table.capacity());
+    table.remove(3);
+    EXPECT_FALSE(table.at(3));
+    EXPECT_EQ(OpaqueServer::SocketTable::SLAB_SLOTS, table.size());
+    // Freed slots are reused first.
+    EXPECT_EQ(3U, table.add(socket));
+    EXPECT_LT(2 * OpaqueServer::SocketTable::SLAB_SLOTS *
+              sizeof(std::shared_ptr<OpaqueServer::ServerMessageSocket>),
+              table.getBytes());
 }
 
 TEST_F(RPCOpaqueServerTest, constructor) {
@@ -120,6 +210,32 @@ TEST_F(RPCOpaqueServerTest, destructor) {
     // difficult to test
 }
 
+TEST_F(RPCOpaqueServerTest, setIdleTimeout) {
+    server.listener.handleNewConnection(fd1);
+    fd1 = -1;
+    OpaqueServer::ServerMessageSocket& socket = *server.sockets.at(0);
+    EXPECT_FALSE(socket.idleTimer.isScheduled());
+    // applies to existing connections
+    server.setIdleTimeout(1000);
+    EXPECT_TRUE(socket.idleTimer.isScheduled());
+    server.setIdleTimeout(0);
+    EXPECT_FALSE(socket.idleTimer.isScheduled());
+}
+
+TEST_F(RPCOpaqueServerTest, getConnectionStats) {
+    server.listener.handleNewConnection(fd1);
+    fd1 = -1;
+    OpaqueServer::ConnectionStats stats = server.getConnectionStats();
+    EXPECT_EQ(1U, stats.numOpen);
+    EXPECT_EQ(1U, stats.numAccepted);
+    EXPECT_EQ(0U, stats.numIdleClosed);
+    uint64_t idleBytes = stats.bytes;
+    EXPECT_LT(sizeof(OpaqueServer::ServerMessageSocket), idleBytes);
+    // counts buffered messages
+    server.sockets.at(0)->sendMessage(1, Buffer(NULL, 100, NULL));
+    EXPECT_LE(idleBytes + 100, server.getConnectionStats().bytes);
+}
+
 } // namespace LogCabin::RPC::<anonymous>
 } // namespace LogCabin::RPC
 } // namespace LogCabin
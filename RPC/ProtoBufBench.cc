@@ -0,0 +1,116 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <memory>
+#include <string>
+
+#include "bench/Bench.h"
+#include "build/Protocol/Client.pb.h"
+#include "Core/Debug.h"
+#include "RPC/Buffer.h"
+#include "RPC/ProtoBuf.h"
+
+namespace LogCabin {
+namespace RPC {
+namespace {
+
+namespace PC = LogCabin::Protocol::Client;
+
+/**
+ * Return an append command as a client would submit it, with a payload of the
+ * given size.
+ */
+PC::Command
+makeCommand(uint32_t dataLength)
+{
+    PC::Command command;
+    PC::Append::Request& append = *command.mutable_append();
+    append.set_log_id(1);
+    append.set_expected_entry_id(42);
+    append.add_invalidates(40);
+    append.add_invalidates(41);
+    append.set_data(std::string(dataLength, 'x'));
+    return command;
+}
+
+/**
+ * Return a read response as the server would send it, with the given number
+ * of entries of 64 bytes each.
+ */
+PC::Read::Response
+makeReadResponse(uint32_t numEntries)
+{
+    PC::Read::Response response;
+    for (uint32_t i = 0; i < numEntries; ++i) {
+        PC::Read::Response::OK::Entry& entry =
+            *response.mutable_ok()->add_entry();
+        entry.set_entry_id(i);
+        entry.set_data(std::string(64, 'x'));
+    }
+    return response;
+}
+
+void
+serialize(Bench::State& state, const google::protobuf::Message& message)
+{
+    state.setBytesPerIteration(message.ByteSize());
+    for (uint64_t i = 0; i < state.iterations; ++i) {
+        Buffer buffer;
+        ProtoBuf::serialize(message, buffer);
+        Bench::doNotOptimize(buffer);
+    }
+}
+
+void
+parse(Bench::State& state, const google::protobuf::Message& message)
+{
+    Buffer buffer;
+    ProtoBuf::serialize(message, buffer);
+    state.setBytesPerIteration(buffer.getLength());
+    std::unique_ptr<google::protobuf::Message> parsed(message.New());
+    for (uint64_t i = 0; i < state.iterations; ++i) {
+        parsed->Clear();
+        if (!ProtoBuf::parse(buffer, *parsed))
+            PANIC("Failed to parse %s", message.GetTypeName().c_str());
+    }
+}
+
+BENCHMARK(RPCProtoBuf, serializeAppend64B) {
+    serialize(state, makeCommand(64));
+}
+
+BENCHMARK(RPCProtoBuf, serializeAppend4KB) {
+    serialize(state, makeCommand(4096));
+}
+
+BENCHMARK(RPCProtoBuf, parseAppend64B) {
+    parse(state, makeCommand(64));
+}
+
+BENCHMARK(RPCProtoBuf, parseAppend4KB) {
+    parse(state, makeCommand(4096));
+}
+
+BENCHMARK(RPCProtoBuf, serializeRead100) {
+    serialize(state, makeReadResponse(100));
+}
+
+BENCHMARK(RPCProtoBuf, parseRead100) {
+    parse(state, makeReadResponse(100));
+}
+
+} // namespace LogCabin::RPC::<anonymous>
+} // namespace LogCabin::RPC
+} // namespace LogCabin
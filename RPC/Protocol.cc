@@ -49,6 +49,24 @@ RequestHeaderVersion1::toBigEndian()
     opCode = htobe16(opCode);
 }
 
+void
+RequestHeaderVersion2::fromBigEndian()
+{
+    service = be16toh(service);
+    // serviceSpecificErrorVersion is only 1 byte, nothing to flip
+    opCode = be16toh(opCode);
+    traceId = be64toh(traceId);
+}
+
+void
+RequestHeaderVersion2::toBigEndian()
+{
+    service = htobe16(service);
+    // serviceSpecificErrorVersion is only 1 byte, nothing to flip
+    opCode = htobe16(opCode);
+    traceId = htobe64(traceId);
+}
+
 ::std::ostream&
 operator<<(::std::ostream& stream, Status status)
 {
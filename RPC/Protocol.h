@@ -49,8 +49,8 @@ struct RequestHeaderPrefix {
     void toBigEndian();
 
     /**
-     * This is the version of the protocol. It should always be set to 1 for
-     * now.
+     * This is the version of the protocol. It should be set to 1, or to 2
+     * for requests that carry a trace ID.
      */
     uint8_t version;
 
@@ -103,6 +103,47 @@ struct RequestHeaderVersion1 {
 
 } __attribute__((packed));
 
+/**
+ * In version 2 of the protocol, this is the header format for requests from
+ * clients to servers. It is the same as version 1 followed by a trace ID.
+ * Responses to version 2 requests use the version 1 response header.
+ */
+struct RequestHeaderVersion2 {
+    /**
+     * Convert the contents to host order from big endian (how this header
+     * should be transferred on the network).
+     * \warning
+     *      This does not modify #prefix.
+     */
+    void fromBigEndian();
+    /**
+     * Convert the contents to big endian (how this header should be
+     * transferred on the network) from host order.
+     * \warning
+     *      This does not modify #prefix.
+     */
+    void toBigEndian();
+
+    /// See RequestHeaderVersion1::prefix.
+    RequestHeaderPrefix prefix;
+
+    /// See RequestHeaderVersion1::service.
+    uint16_t service;
+
+    /// See RequestHeaderVersion1::serviceSpecificErrorVersion.
+    uint8_t serviceSpecificErrorVersion;
+
+    /// See RequestHeaderVersion1::opCode.
+    uint16_t opCode;
+
+    /**
+     * If nonzero, the server will record the time the request reaches each
+     * stage of processing under this ID. See Core::Trace.
+     */
+    uint64_t traceId;
+
+} __attribute__((packed));
+
 /**
  * The status codes returned in server responses.
  */
@@ -13,6 +13,7 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include "Core/Random.h"
 #include "RPC/OpaqueServerRPC.h"
 #include "RPC/Server.h"
 #include "RPC/ServerRPC.h"
@@ -25,6 +26,8 @@ Server::Server(Event::Loop& eventLoop, uint32_t maxMessageLength)
     : OpaqueServer(eventLoop, maxMessageLength)
     , mutex()
     , services()
+    , traceSampleRate(0)
+    , numRPCsReceived(0)
 {
 }
 
@@ -42,6 +45,22 @@ Server::registerService(uint16_t serviceId,
         std::make_shared<ThreadDispatchService>(service, 0, maxThreads);
 }
 
+std::shared_ptr<ThreadDispatchService>
+Server::getService(uint16_t serviceId)
+{
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    auto it = services.find(serviceId);
+    if (it == services.end())
+        return std::shared_ptr<ThreadDispatchService>();
+    return it->second;
+}
+
+void
+Server::setTraceSampleRate(uint32_t everyN)
+{
+    traceSampleRate = everyN;
+}
+
 void
 Server::handleRPC(RPC::OpaqueServerRPC opaqueRPC)
 {
@@ -51,7 +70,17 @@ Server::handleRPC(RPC::OpaqueServerRPC opaqueRPC)
         // further action.
         return;
     }
-    std::shared_ptr<Service> service;
+    uint32_t sampleRate = traceSampleRate;
+    ++numRPCsReceived;
+    if (rpc.getTraceId() == 0 &&
+        sampleRate > 0 &&
+        numRPCsReceived % sampleRate == 0) {
+        uint64_t traceId = 0;
+        while (traceId == 0)
+            traceId = Core::Random::random64();
+        rpc.startTrace(traceId);
+    }
+    std::shared_ptr<ThreadDispatchService> service;
     {
         std::unique_lock<std::mutex> lockGuard(mutex);
         auto it = services.find(rpc.getService());
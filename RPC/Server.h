@@ -13,6 +13,11 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#if __GNUC__ >= 4 && __GNUC_MINOR__ >= 5
+#include <atomic>
+#else
+#include <cstdatomic>
+#endif
 #include <cinttypes>
 #include <memory>
 #include <mutex>
@@ -27,6 +32,9 @@
 namespace LogCabin {
 namespace RPC {
 
+// forward declaration
+class ThreadDispatchService;
+
 /**
  * A Server listens for incoming RPCs over TCP connections and dispatches these
  * to Services.
@@ -74,6 +82,20 @@ class Server : public OpaqueServer {
                          std::shared_ptr<Service> service,
                          uint32_t maxThreads);
 
+    /**
+     * Return the thread pool that runs the given service, or NULL if no
+     * service is registered with that ID. This is used to collect statistics.
+     */
+    std::shared_ptr<ThreadDispatchService> getService(uint16_t serviceId);
+
+    /**
+     * Trace a sample of the incoming RPCs that don't already carry a trace ID
+     * from the client. See Core::Trace. This may be called from any thread.
+     * \param everyN
+     *      Trace one out of every this many RPCs, or none if this is 0.
+     */
+    void setTraceSampleRate(uint32_t everyN);
+
   private:
     /**
      * This is called by the base class, OpaqueServer, when an RPC arrives.
@@ -89,7 +111,19 @@ class Server : public OpaqueServer {
      * Maps from service IDs to ThreadDispatchService instances.
      * Protected by #mutex.
      */
-    std::unordered_map<uint16_t, std::shared_ptr<Service>> services;
+    std::unordered_map<uint16_t,
+                       std::shared_ptr<ThreadDispatchService>> services;
+
+    /**
+     * See setTraceSampleRate().
+     */
+    std::atomic<uint32_t> traceSampleRate;
+
+    /**
+     * The number of RPCs received, used to pick which ones to trace. This is
+     * only accessed from the event loop thread.
+     */
+    uint64_t numRPCsReceived;
 
     // Server is non-copyable.
     Server(const Server&) = delete;
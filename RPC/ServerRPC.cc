@@ -13,6 +13,7 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include "Core/Trace.h"
 #include "RPC/ProtoBuf.h"
 #include "RPC/ServerRPC.h"
 
@@ -21,6 +22,7 @@ namespace RPC {
 
 using RPC::Protocol::RequestHeaderPrefix;
 using RPC::Protocol::RequestHeaderVersion1;
+using RPC::Protocol::RequestHeaderVersion2;
 using RPC::Protocol::ResponseHeaderPrefix;
 using RPC::Protocol::ResponseHeaderVersion1;
 using RPC::Protocol::Status;
@@ -31,6 +33,8 @@ ServerRPC::ServerRPC(OpaqueServerRPC opaqueRPC)
     , service(0)
     , serviceSpecificErrorVersion(0)
     , opCode(0)
+    , headerLength(0)
+    , traceId(0)
 {
     const Buffer& request = this->opaqueRPC.request;
 
@@ -42,18 +46,32 @@ ServerRPC::ServerRPC(OpaqueServerRPC opaqueRPC)
     RequestHeaderPrefix requestHeaderPrefix =
         *static_cast<const RequestHeaderPrefix*>(request.getData());
     requestHeaderPrefix.fromBigEndian();
-    if (requestHeaderPrefix.version != 1 ||
-        request.getLength() < sizeof(RequestHeaderVersion1)) {
+    if (requestHeaderPrefix.version == 1 &&
+        request.getLength() >= sizeof(RequestHeaderVersion1)) {
+        RequestHeaderVersion1 requestHeader =
+            *static_cast<const RequestHeaderVersion1*>(request.getData());
+        requestHeader.fromBigEndian();
+        service = requestHeader.service;
+        serviceSpecificErrorVersion =
+            requestHeader.serviceSpecificErrorVersion;
+        opCode = requestHeader.opCode;
+        headerLength = sizeof(RequestHeaderVersion1);
+    } else if (requestHeaderPrefix.version == 2 &&
+               request.getLength() >= sizeof(RequestHeaderVersion2)) {
+        RequestHeaderVersion2 requestHeader =
+            *static_cast<const RequestHeaderVersion2*>(request.getData());
+        requestHeader.fromBigEndian();
+        service = requestHeader.service;
+        serviceSpecificErrorVersion =
+            requestHeader.serviceSpecificErrorVersion;
+        opCode = requestHeader.opCode;
+        headerLength = sizeof(RequestHeaderVersion2);
+        if (requestHeader.traceId != 0)
+            startTrace(requestHeader.traceId);
+    } else {
         reject(Status::INVALID_VERSION);
         return;
     }
-    RequestHeaderVersion1 requestHeader =
-        *static_cast<const RequestHeaderVersion1*>(request.getData());
-    requestHeader.fromBigEndian();
-
-    service = requestHeader.service;
-    serviceSpecificErrorVersion = requestHeader.serviceSpecificErrorVersion;
-    opCode = requestHeader.opCode;
 }
 
 ServerRPC::ServerRPC()
@@ -62,6 +80,8 @@ ServerRPC::ServerRPC()
     , service(0)
     , serviceSpecificErrorVersion(0)
     , opCode(0)
+    , headerLength(0)
+    , traceId(0)
 {
 }
 
@@ -71,6 +91,8 @@ ServerRPC::ServerRPC(ServerRPC&& other)
     , service(other.service)
     , serviceSpecificErrorVersion(other.serviceSpecificErrorVersion)
     , opCode(other.opCode)
+    , headerLength(other.headerLength)
+    , traceId(other.traceId)
 {
     other.active = false;
 }
@@ -88,6 +110,8 @@ ServerRPC::operator=(ServerRPC&& other)
     service = other.service;
     serviceSpecificErrorVersion = other.serviceSpecificErrorVersion;
     opCode = other.opCode;
+    headerLength = other.headerLength;
+    traceId = other.traceId;
     return *this;
 }
 
@@ -96,8 +120,7 @@ ServerRPC::getRequest(google::protobuf::Message& request)
 {
     if (!active)
         return false;
-    if (!RPC::ProtoBuf::parse(opaqueRPC.request, request,
-                              sizeof(RequestHeaderVersion1))) {
+    if (!RPC::ProtoBuf::parse(opaqueRPC.request, request, headerLength)) {
         rejectInvalidRequest();
         return false;
     }
@@ -120,6 +143,33 @@ ServerRPC::reply(const google::protobuf::Message& payload)
     opaqueRPC.sendReply();
 }
 
+Buffer
+ServerRPC::makeSharedReply(const google::protobuf::Message& payload)
+{
+    uint32_t length = payload.ByteSize();
+    Buffer buffer = Buffer::allocateShared(
+        uint32_t(sizeof(ResponseHeaderVersion1)) + length);
+    auto& responseHeader =
+        *static_cast<ResponseHeaderVersion1*>(buffer.getData());
+    responseHeader.prefix.status = Status::OK;
+    responseHeader.prefix.toBigEndian();
+    responseHeader.toBigEndian();
+    payload.SerializeToArray(&responseHeader + 1, length);
+    return buffer;
+}
+
+bool
+ServerRPC::sendPartialReply(const Buffer& sharedReply)
+{
+    if (!active)
+        return false;
+    if (!opaqueRPC.sendPartialReply(sharedReply.share())) {
+        active = false;
+        return false;
+    }
+    return true;
+}
+
 void
 ServerRPC::returnError(const google::protobuf::Message& serviceSpecificError)
 {
@@ -170,6 +220,15 @@ ServerRPC::reject(RPC::Protocol::Status status)
     opaqueRPC.sendReply();
 }
 
+void
+ServerRPC::startTrace(uint64_t traceId)
+{
+    this->traceId = traceId;
+    opaqueRPC.traceId = traceId;
+    Core::Trace::record(traceId, Core::Trace::Stage::RECEIVE,
+                        opaqueRPC.receivedAt);
+}
+
 
 } // namespace LogCabin::RPC
 } // namespace LogCabin
@@ -98,6 +98,24 @@ class ServerRPC {
         return opCode;
     }
 
+    /**
+     * Return the ID under which this RPC is being traced, or 0 if it is not
+     * being traced. See Core::Trace.
+     */
+    uint64_t getTraceId() const {
+        return traceId;
+    }
+
+    /**
+     * Set the priority with which the reply is sent. This is NORMAL by
+     * default; services should use CONTROL only for small replies that
+     * must not be delayed by large messages queued on the same session (see
+     * MessageSocket::sendMessage()).
+     */
+    void setPriority(MessageSocket::Priority priority) {
+        opaqueRPC.priority = priority;
+    }
+
     /**
      * Parse the request out of the RPC.
      * \param[out] request
@@ -116,6 +134,39 @@ class ServerRPC {
      */
     void reply(const google::protobuf::Message& payload);
 
+    /**
+     * Serialize a normal response once so that it can be sent to many
+     * streaming RPCs with sendPartialReply() without being copied.
+     * \param payload
+     *      A protocol buffer to serialize into the response.
+     * \return
+     *      A Buffer from Buffer::allocateShared().
+     */
+    static Buffer makeSharedReply(const google::protobuf::Message& payload);
+
+    /**
+     * Send one normal response back to a client that issued this RPC as a
+     * stream. Unlike reply(), this leaves the RPC active, so it can be used
+     * again later.
+     * \param sharedReply
+     *      A response from makeSharedReply(). This shares the buffer rather
+     *      than copying it.
+     * \return
+     *      False if the client has gone away, in which case the caller should
+     *      discard this ServerRPC object; true otherwise.
+     */
+    bool sendPartialReply(const Buffer& sharedReply);
+
+    /**
+     * Return false if the client has gone away or the RPC has already been
+     * replied to; true otherwise. This is useful for long-lived streaming
+     * RPCs, which otherwise would only find out on their next
+     * sendPartialReply().
+     */
+    bool isSessionOpen() const {
+        return active && opaqueRPC.isSessionOpen();
+    }
+
     /**
      * Send a service-specific error back to the client.
      * \param serviceSpecificError
@@ -149,6 +200,14 @@ class ServerRPC {
      */
     void reject(RPC::Protocol::Status status);
 
+    /**
+     * Start tracing this RPC: record the time it was received and arrange
+     * for the time its reply is sent to be recorded.
+     * \param traceId
+     *      A nonzero ID for the trace.
+     */
+    void startTrace(uint64_t traceId);
+
     /**
      * The underlying transport-level RPC object. It doesn't know how to
      * interpret the raw bytes of the RPC, but it gets them from here to there.
@@ -166,6 +225,10 @@ class ServerRPC {
     uint8_t serviceSpecificErrorVersion;
     /// See getOpCode().
     uint16_t opCode;
+    /// The number of bytes in the request header.
+    uint32_t headerLength;
+    /// See getTraceId().
+    uint64_t traceId;
 
     friend class Server;
 
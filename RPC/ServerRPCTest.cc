@@ -18,6 +18,7 @@
 #include "build/Core/ProtoBufTest.pb.h"
 #include "Core/Debug.h"
 #include "Core/ProtoBuf.h"
+#include "Core/Trace.h"
 #include "RPC/Buffer.h"
 #include "RPC/OpaqueServerRPC.h"
 #include "RPC/ProtoBuf.h"
@@ -29,6 +30,7 @@ namespace RPC {
 namespace {
 
 using RPC::Protocol::RequestHeaderVersion1;
+using RPC::Protocol::RequestHeaderVersion2;
 using RPC::Protocol::ResponseHeaderVersion1;
 using RPC::Protocol::Status;
 
@@ -68,12 +70,29 @@ class RPCServerRPCTest : public ::testing::Test {
         header.toBigEndian();
     }
 
+    void
+    makeRequestVersion2(uint64_t traceId,
+                        const google::protobuf::Message& payload)
+    {
+        ProtoBuf::serialize(payload, request, sizeof(RequestHeaderVersion2));
+        RequestHeaderVersion2& header =
+            *static_cast<RequestHeaderVersion2*>(request.getData());
+        header.prefix.version = 2;
+        header.prefix.toBigEndian();
+        header.service = 2;
+        header.serviceSpecificErrorVersion = 3;
+        header.opCode = 4;
+        header.traceId = traceId;
+        header.toBigEndian();
+    }
+
     void
     call()
     {
         OpaqueServerRPC opaqueServerRPC;
         opaqueServerRPC.request = std::move(request);
         opaqueServerRPC.responseTarget = &response;
+        opaqueServerRPC.receivedAt = Core::Time::SteadyClock::now();
         serverRPC = ServerRPC(std::move(opaqueServerRPC));
     }
 
@@ -114,6 +133,29 @@ TEST_F(RPCServerRPCTest, constructor_normal) {
     EXPECT_TRUE(serverRPC.needsReply());
 }
 
+TEST_F(RPCServerRPCTest, constructor_version2) {
+    Core::Trace::reset();
+    makeRequestVersion2(0, payload);
+    call();
+    EXPECT_EQ(2U, serverRPC.getService());
+    EXPECT_EQ(3U, serverRPC.getServiceSpecificErrorVersion());
+    EXPECT_EQ(4U, serverRPC.getOpCode());
+    EXPECT_EQ(0U, serverRPC.getTraceId());
+    LogCabin::ProtoBuf::TestMessage actual;
+    EXPECT_TRUE(serverRPC.getRequest(actual));
+    EXPECT_EQ(payload, actual);
+
+    makeRequestVersion2(0x1234, payload);
+    call();
+    EXPECT_EQ(0x1234U, serverRPC.getTraceId());
+    serverRPC.reply(payload);
+    std::vector<Core::Trace::Record> traces = Core::Trace::getRecent();
+    ASSERT_EQ(1U, traces.size());
+    EXPECT_EQ(0x1234U, traces.at(0).traceId);
+    EXPECT_NE(0U, traces.at(0).timestamps[
+                    uint32_t(Core::Trace::Stage::RECEIVE)]);
+}
+
 // default constructor: nothing to test
 // move constructor: nothing to test
 // destructor: nothing to test
@@ -160,6 +202,38 @@ TEST_F(RPCServerRPCTest, reply) {
     EXPECT_EQ(payload, actual);
 }
 
+TEST_F(RPCServerRPCTest, sendPartialReply) {
+    makeRequest(1, 2, 3, 4, NULL);
+    call();
+    Buffer shared = ServerRPC::makeSharedReply(payload);
+    EXPECT_TRUE(serverRPC.sendPartialReply(shared));
+    EXPECT_EQ(Status::OK, getStatus());
+    EXPECT_EQ(shared.getData(), response.getData());
+    EXPECT_TRUE(serverRPC.needsReply());
+    EXPECT_TRUE(serverRPC.isSessionOpen());
+    LogCabin::ProtoBuf::TestMessage actual;
+    EXPECT_TRUE(ProtoBuf::parse(response,
+                                actual,
+                                sizeof(ResponseHeaderVersion1)));
+    EXPECT_EQ(payload, actual);
+    response.reset();
+    EXPECT_TRUE(serverRPC.sendPartialReply(shared));
+    EXPECT_EQ(shared.getData(), response.getData());
+    serverRPC.reply(payload);
+    EXPECT_FALSE(serverRPC.isSessionOpen());
+    EXPECT_FALSE(serverRPC.sendPartialReply(shared));
+}
+
+TEST_F(RPCServerRPCTest, sendPartialReply_sessionClosed) {
+    makeRequest(1, 2, 3, 4, NULL);
+    call();
+    serverRPC.opaqueRPC.responseTarget = NULL;
+    EXPECT_FALSE(serverRPC.isSessionOpen());
+    EXPECT_FALSE(serverRPC.sendPartialReply(
+                    ServerRPC::makeSharedReply(payload)));
+    EXPECT_FALSE(serverRPC.needsReply());
+}
+
 TEST_F(RPCServerRPCTest, returnError) {
     makeRequest(1, 2, 3, 4, NULL);
     call();
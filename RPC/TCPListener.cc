@@ -13,11 +13,16 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
-#include <event2/listener.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include "Core/Debug.h"
 #include "Core/StringUtil.h"
-#include "Event/Internal.h"
+#include "Event/CoarseTimer.h"
+#include "Event/File.h"
 #include "RPC/TCPListener.h"
 
 namespace LogCabin {
@@ -26,20 +31,90 @@ namespace RPC {
 namespace {
 
 /**
- * This is called by libevent when the listener accepts a new connection.
+ * The maximum number of connections to accept each time a listening socket
+ * becomes readable. Accepting a batch saves trips through the event loop when
+ * many clients connect at once, and the limit keeps a flood of connections
+ * from starving the other files in the event loop.
  */
-void
-onAccept(evconnlistener* libEventListener,
-         evutil_socket_t socket,
-         sockaddr* addr,
-         int addrLen,
-         void* listener)
-{
-    static_cast<TCPListener*>(listener)->handleNewConnection(socket);
-}
+const uint32_t MAX_ACCEPTS_PER_EVENT = 64;
+
+/**
+ * How long to stop accepting connections after running out of file
+ * descriptors or memory. The pending connections keep the listening socket
+ * readable, so trying again right away would just spin.
+ */
+const uint64_t ACCEPT_BACKOFF_MS = 100;
 
 } // anonymous namespace
 
+/**
+ * Watches one listening socket and hands off connections accepted on it to
+ * the TCPListener.
+ */
+class TCPListener::BoundListener : public Event::File {
+  public:
+    BoundListener(TCPListener& tcpListener, int fd)
+        : Event::File(tcpListener.eventLoop, fd, Events::READABLE)
+        , tcpListener(tcpListener)
+        , backoffTimer(*this)
+    {
+    }
+    ~BoundListener()
+    {
+        // The timer would otherwise turn the events back on.
+        backoffTimer.deschedule();
+        setEvents(0);
+        ::close(fd);
+    }
+    void handleFileEvent(uint32_t events)
+    {
+        for (uint32_t i = 0; i < MAX_ACCEPTS_PER_EVENT; ++i) {
+            int socket = accept4(fd, NULL, NULL,
+                                 SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (socket >= 0) {
+                tcpListener.handleNewConnection(socket);
+                continue;
+            }
+            // If the connection went away, try the next one.
+            if (errno == ECONNABORTED || errno == EINTR)
+                continue;
+            // If there are no more connections or another thread got to
+            // them first, there's nothing to do.
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            if (errno == EMFILE || errno == ENFILE ||
+                errno == ENOBUFS || errno == ENOMEM) {
+                WARNING("accept4 failed: %s. Not accepting new connections "
+                        "for %lu ms.", strerror(errno), ACCEPT_BACKOFF_MS);
+                setEvents(0);
+                backoffTimer.schedule(ACCEPT_BACKOFF_MS * 1000 * 1000);
+                return;
+            }
+            WARNING("accept4 failed: %s", strerror(errno));
+            return;
+        }
+    }
+
+    /**
+     * Resumes accepting connections after a failure.
+     */
+    class BackoffTimer : public Event::CoarseTimer {
+      public:
+        explicit BackoffTimer(BoundListener& boundListener)
+            : CoarseTimer(boundListener.eventLoop)
+            , boundListener(boundListener)
+        {
+        }
+        void handleTimerEvent() {
+            boundListener.setEvents(Events::READABLE);
+        }
+        BoundListener& boundListener;
+    };
+
+    TCPListener& tcpListener;
+    BackoffTimer backoffTimer;
+};
+
 TCPListener::TCPListener(Event::Loop& eventLoop)
     : eventLoop(eventLoop)
     , listeners()
@@ -47,7 +122,7 @@ TCPListener::TCPListener(Event::Loop& eventLoop)
 }
 
 std::string
-TCPListener::bind(const Address& listenAddress)
+TCPListener::bind(const Address& listenAddress, bool reusePort)
 {
     using Core::StringUtil::format;
 
@@ -60,28 +135,52 @@ TCPListener::bind(const Address& listenAddress)
                       listenAddress.toString().c_str());
     }
 
-    LibEvent::evconnlistener* listener = qualify(
-        evconnlistener_new_bind(
-            unqualify(eventLoop.base),
-            onAccept, this,
-            LEV_OPT_CLOSE_ON_FREE | LEV_OPT_CLOSE_ON_EXEC |
-            LEV_OPT_REUSEABLE | LEV_OPT_THREADSAFE,
-            -1 /* have libevent pick a sane default for backlog */,
-            listenAddress.getSockAddr(),
-            listenAddress.getSockAddrLen()));
-    if (listener == NULL) {
-        return format("evconnlistener_new_bind failed: "
-                      "Check to make sure the address (%s) is not in use.",
-                      listenAddress.toString().c_str());
+    int fd = socket(listenAddress.getSockAddr()->sa_family,
+                    SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return format("socket failed: %s", strerror(errno));
+    }
+
+    int flag = 1;
+    int r = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    if (r < 0) {
+        std::string error = format("setsockopt(SO_REUSEADDR) failed: %s",
+                                   strerror(errno));
+        ::close(fd);
+        return error;
     }
-    listeners.push_back(listener);
+
+    if (reusePort) {
+        r = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag));
+        if (r < 0) {
+            std::string error = format("setsockopt(SO_REUSEPORT) failed: %s",
+                                       strerror(errno));
+            ::close(fd);
+            return error;
+        }
+    }
+
+    r = ::bind(fd, listenAddress.getSockAddr(),
+               listenAddress.getSockAddrLen());
+    if (r == 0)
+        r = listen(fd, SOMAXCONN);
+    if (r < 0) {
+        std::string error = format("Failed to listen on %s: %s. "
+                                   "Check to make sure the address is not "
+                                   "in use.",
+                                   listenAddress.toString().c_str(),
+                                   strerror(errno));
+        ::close(fd);
+        return error;
+    }
+
+    listeners.emplace_back(new BoundListener(*this, fd));
     return "";
 }
 
 TCPListener::~TCPListener()
 {
-    for (auto it = listeners.begin(); it != listeners.end(); ++it)
-        evconnlistener_free(unqualify(*it));
+    listeners.clear();
 }
 
 } // namespace LogCabin::RPC
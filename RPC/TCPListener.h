@@ -16,16 +16,12 @@
 #ifndef LOGCABIN_RPC_TCPLISTENER_H
 #define LOGCABIN_RPC_TCPLISTENER_H
 
+#include <memory>
 #include <vector>
 
 #include "Event/Loop.h"
 #include "Address.h"
 
-// forward declaration
-namespace LibEvent {
-class evconnlistener;
-}
-
 namespace LogCabin {
 namespace RPC {
 
@@ -38,7 +34,7 @@ namespace RPC {
  * the thread running the Event::Loop.
  *
  * This is intended for use by RPC::Server only. It's not a very good
- * abstraction, but it encapsulates knowledge of libevent.
+ * abstraction, but it encapsulates knowledge of the sockets API.
  */
 class TCPListener {
   public:
@@ -59,20 +55,27 @@ class TCPListener {
     /**
      * Listen on a new address. You can call this multiple times to listen on
      * multiple addresses. (But if you call this twice with the same address,
-     * the second time will always throw an error.)
+     * the second time will always throw an error, unless reusePort is set
+     * both times.)
      * This method is thread-safe.
      * \param listenAddress
      *      The address to listen on.
+     * \param reusePort
+     *      If true, set SO_REUSEPORT on the listening socket. This allows
+     *      several TCPListeners, typically one per Event::Loop, to listen on
+     *      the same address; the kernel then spreads new connections across
+     *      them.
      * \return
      *      An error message if this was not able to listen on the given
      *      address; the empty string otherwise.
      */
-    std::string bind(const Address& listenAddress);
+    std::string bind(const Address& listenAddress, bool reusePort = false);
 
     /**
      * This method is overridden by a subclass and invoked when a new
      * connection is accepted. This method will be invoked by the main event
-     * loop on whatever thread is running the Event::Loop.
+     * loop on whatever thread is running the Event::Loop. The socket is
+     * already in non-blocking mode.
      *
      * The callee is in charge of closing the socket.
      */
@@ -86,10 +89,15 @@ class TCPListener {
   private:
 
     /**
-     * The listeners from libevent.
+     * Watches one listening socket and accepts connections on it.
+     */
+    class BoundListener;
+
+    /**
+     * One entry per successful call to bind().
      * These are never NULL.
      */
-    std::vector<LibEvent::evconnlistener*> listeners;
+    std::vector<std::unique_ptr<BoundListener>> listeners;
 
     // TCPListener is not copyable.
     TCPListener(const TCPListener&) = delete;
@@ -13,8 +13,10 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <fcntl.h>
 #include <gtest/gtest.h>
 #include <thread>
+#include <unistd.h>
 
 #include "Core/Debug.h"
 #include "Protocol/Common.h"
@@ -49,14 +51,17 @@ class Listener : public TCPListener {
     explicit Listener(Event::Loop& eventLoop)
         : TCPListener(eventLoop)
         , count(0)
+        , socketFlags(0)
     {
     }
     void handleNewConnection(int socket) {
+        socketFlags = fcntl(socket, F_GETFL);
         close(socket);
         ++count;
         eventLoop.exit();
     }
     uint32_t count;
+    int socketFlags;
 };
 
 TEST(RPCTCPListener, basics) {
@@ -70,10 +75,73 @@ TEST(RPCTCPListener, basics) {
     std::thread thread(connectThreadMain, address, &connectError);
     loop.runForever();
     EXPECT_EQ(1U, listener.count);
+    EXPECT_TRUE(listener.socketFlags & O_NONBLOCK);
     thread.join();
     EXPECT_EQ(0, connectError);
 }
 
+TEST(RPCTCPListener, basics_epoll) {
+    Event::Loop loop(Event::Loop::Backend::EPOLL);
+    Listener listener(loop);
+    Address address("127.0.0.1", Protocol::Common::DEFAULT_PORT);
+    EXPECT_EQ("", listener.bind(address));
+    int connectError = -1;
+    std::thread thread(connectThreadMain, address, &connectError);
+    loop.runForever();
+    EXPECT_EQ(1U, listener.count);
+    thread.join();
+    EXPECT_EQ(0, connectError);
+}
+
+TEST(RPCTCPListener, handleFileEvent_batch) {
+    Event::Loop loop;
+    Listener listener(loop);
+    Address address("127.0.0.1", Protocol::Common::DEFAULT_PORT);
+    EXPECT_EQ("", listener.bind(address));
+    // These complete in the kernel before the listener accepts them.
+    int fds[3];
+    for (uint32_t i = 0; i < 3; ++i) {
+        fds[i] = socket(AF_INET, SOCK_STREAM, 0);
+        ASSERT_LE(0, fds[i]);
+        EXPECT_EQ(0, connect(fds[i],
+                             address.getSockAddr(),
+                             address.getSockAddrLen()));
+    }
+    // A single event accepts all of them.
+    loop.runForever();
+    EXPECT_EQ(3U, listener.count);
+    for (uint32_t i = 0; i < 3; ++i)
+        EXPECT_EQ(0, close(fds[i]));
+}
+
+TEST(RPCTCPListener, reusePort) {
+    Event::Loop loop1;
+    Event::Loop loop2;
+    Listener listener1(loop1);
+    Listener listener2(loop2);
+    Address address("127.0.0.1", Protocol::Common::DEFAULT_PORT);
+    EXPECT_EQ("", listener1.bind(address, true));
+    EXPECT_EQ("", listener2.bind(address, true));
+    std::thread thread1(&Event::Loop::runForever, &loop1);
+    std::thread thread2(&Event::Loop::runForever, &loop2);
+    int connectError = -1;
+    connectThreadMain(address, &connectError);
+    EXPECT_EQ(0, connectError);
+    // Which listener gets the connection is up to the kernel.
+    uint32_t count = 0;
+    while (count == 0) {
+        usleep(1000);
+        Event::Loop::Lock lock1(loop1);
+        Event::Loop::Lock lock2(loop2);
+        count = listener1.count + listener2.count;
+    }
+    EXPECT_EQ(1U, count);
+    loop1.exit();
+    loop2.exit();
+    thread1.join();
+    thread2.join();
+}
+
 TEST(RPCTCPListener, badAddress) {
     Event::Loop loop;
     Listener listener(loop);
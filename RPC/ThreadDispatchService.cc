@@ -17,6 +17,7 @@
 
 #include "Core/StringUtil.h"
 #include "Core/ThreadId.h"
+#include "Core/Trace.h"
 #include "RPC/ThreadDispatchService.h"
 
 namespace LogCabin {
@@ -27,8 +28,9 @@ ThreadDispatchService::ThreadDispatchService(
         uint32_t minThreads,
         uint32_t maxThreads)
     : threadSafeService(threadSafeService)
+    , latency()
     , maxThreads(maxThreads)
-    , mutex()
+    , mutex("ThreadDispatchService::mutex")
     , threads()
     , numFreeWorkers(0)
     , conditionVariable()
@@ -45,7 +47,7 @@ ThreadDispatchService::~ThreadDispatchService()
 {
     // Signal the threads to exit.
     {
-        std::unique_lock<std::mutex> lockGuard(mutex);
+        std::unique_lock<Core::Mutex> lockGuard(mutex);
         exit = true;
     }
     conditionVariable.notify_all();
@@ -66,7 +68,7 @@ ThreadDispatchService::~ThreadDispatchService()
 void
 ThreadDispatchService::handleRPC(ServerRPC serverRPC)
 {
-    std::unique_lock<std::mutex> lockGuard(mutex);
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
     assert(!exit);
     rpcQueue.push(std::move(serverRPC));
     if (numFreeWorkers == 0 && threads.size() < maxThreads)
@@ -80,6 +82,20 @@ ThreadDispatchService::getName() const
     return threadSafeService->getName();
 }
 
+uint64_t
+ThreadDispatchService::getQueueDepth()
+{
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
+    return rpcQueue.size();
+}
+
+const Core::Stats::Histogram&
+ThreadDispatchService::getLatency(uint16_t opCode) const
+{
+    assert(opCode < MAX_OP_CODES);
+    return latency[opCode];
+}
+
 void
 ThreadDispatchService::workerMain()
 {
@@ -90,7 +106,7 @@ ThreadDispatchService::workerMain()
     while (true) {
         ServerRPC rpc;
         { // find an RPC to process
-            std::unique_lock<std::mutex> lockGuard(mutex);
+            std::unique_lock<Core::Mutex> lockGuard(mutex);
             ++numFreeWorkers;
             while (!exit && rpcQueue.empty())
                 conditionVariable.wait(lockGuard);
@@ -101,7 +117,15 @@ ThreadDispatchService::workerMain()
             rpcQueue.pop();
         }
         // execute RPC handler
+        uint16_t opCode = rpc.getOpCode();
+        Core::Time::SteadyClock::time_point start =
+            Core::Time::SteadyClock::now();
+        Core::Trace::record(rpc.getTraceId(), Core::Trace::Stage::DEQUEUE,
+                            start);
+        Core::Trace::Scope traceScope(rpc.getTraceId());
         threadSafeService->handleRPC(std::move(rpc));
+        if (opCode < MAX_OP_CODES)
+            latency[opCode].recordMicrosSince(start);
     }
 }
 
@@ -14,12 +14,13 @@
  */
 
 #include <cinttypes>
-#include <condition_variable>
-#include <mutex>
 #include <queue>
 #include <thread>
 #include <vector>
 
+#include "Core/ConditionVariable.h"
+#include "Core/Mutex.h"
+#include "Core/Stats.h"
 #include "RPC/ServerRPC.h"
 #include "RPC/Service.h"
 
@@ -64,6 +65,24 @@ class ThreadDispatchService : public Service {
     void handleRPC(ServerRPC serverRPC);
     std::string getName() const;
 
+    /**
+     * Return the number of RPCs that are waiting for a worker thread.
+     */
+    uint64_t getQueueDepth();
+
+    /**
+     * Return the distribution of time spent in the underlying service's
+     * handleRPC() for the given opcode, in microseconds.
+     * \param opCode
+     *      Must be less than MAX_OP_CODES.
+     */
+    const Core::Stats::Histogram& getLatency(uint16_t opCode) const;
+
+    /**
+     * Statistics are kept for RPCs with opcodes in [0, MAX_OP_CODES).
+     */
+    static const uint16_t MAX_OP_CODES = 16;
+
   private:
     /**
      * The main loop executed in workers.
@@ -76,6 +95,11 @@ class ThreadDispatchService : public Service {
      */
     std::shared_ptr<Service> threadSafeService;
 
+    /**
+     * See getLatency(). These are updated without holding #mutex.
+     */
+    Core::Stats::Histogram latency[MAX_OP_CODES];
+
     /**
      * The maximum number of threads this class is allowed to use for its
      * thread pool.
@@ -86,7 +110,7 @@ class ThreadDispatchService : public Service {
      * This mutex protects all of the members of this class defined below this
      * point.
      */
-    std::mutex mutex;
+    Core::Mutex mutex;
 
     /**
      * The thread pool of workers that process RPCs.
@@ -104,7 +128,7 @@ class ThreadDispatchService : public Service {
      * Notifies workers that there are available RPCs to process or #exit has
      * been set. To wait on this, one needs to hold #mutex.
      */
-    std::condition_variable conditionVariable;
+    Core::ConditionVariable conditionVariable;
 
     /**
      * A flag to tell workers that they should exit.
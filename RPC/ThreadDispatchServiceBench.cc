@@ -0,0 +1,94 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <condition_variable>
+#include <mutex>
+
+#include "bench/Bench.h"
+#include "RPC/ThreadDispatchService.h"
+
+namespace LogCabin {
+namespace RPC {
+namespace {
+
+/**
+ * Counts the RPCs it handles.
+ */
+class CountingService : public RPC::Service {
+  public:
+    CountingService()
+        : mutex()
+        , cond()
+        , count(0)
+    {
+    }
+    void handleRPC(RPC::ServerRPC serverRPC) {
+        std::unique_lock<std::mutex> lockGuard(mutex);
+        ++count;
+        cond.notify_all();
+    }
+    std::string getName() const {
+        return "CountingService";
+    }
+    void waitFor(uint64_t target) {
+        std::unique_lock<std::mutex> lockGuard(mutex);
+        while (count < target)
+            cond.wait(lockGuard);
+    }
+    std::mutex mutex;
+    std::condition_variable cond;
+    uint64_t count;
+};
+
+/**
+ * Hand empty RPCs to a ThreadDispatchService with the given number of worker
+ * threads and wait for them all to be handled.
+ * \param pipelined
+ *      If true, queue all the RPCs up front. Otherwise, wait for each one to
+ *      be handled before dispatching the next.
+ */
+void
+dispatch(Bench::State& state, uint32_t threads, bool pipelined)
+{
+    state.pauseTiming();
+    auto service = std::make_shared<CountingService>();
+    ThreadDispatchService dispatchService(service, threads, threads);
+    state.resumeTiming();
+
+    for (uint64_t i = 0; i < state.iterations; ++i) {
+        dispatchService.handleRPC(ServerRPC());
+        if (!pipelined)
+            service->waitFor(i + 1);
+    }
+    service->waitFor(state.iterations);
+
+    state.pauseTiming();
+}
+
+BENCHMARK(RPCThreadDispatchService, latency1Thread) {
+    dispatch(state, 1, false);
+}
+
+BENCHMARK(RPCThreadDispatchService, stream1Thread) {
+    dispatch(state, 1, true);
+}
+
+BENCHMARK(RPCThreadDispatchService, stream4Threads) {
+    dispatch(state, 4, true);
+}
+
+} // namespace LogCabin::RPC::<anonymous>
+} // namespace LogCabin::RPC
+} // namespace LogCabin
@@ -60,13 +60,13 @@ TEST_F(RPCThreadDispatchServiceTest, constructor)
     // Give the threads a chance to start up
     for (uint32_t i = 0; i < 10; ++i) {
         {
-            std::unique_lock<std::mutex> lockGuard(dispatchService.mutex);
+            std::unique_lock<Core::Mutex> lockGuard(dispatchService.mutex);
             if (dispatchService.numFreeWorkers == 5)
                 break;
         }
         usleep(1000);
     }
-    std::unique_lock<std::mutex> lockGuard(dispatchService.mutex);
+    std::unique_lock<Core::Mutex> lockGuard(dispatchService.mutex);
     EXPECT_EQ(5U, dispatchService.threads.size());
     EXPECT_EQ(5U, dispatchService.numFreeWorkers);
 }
@@ -95,6 +95,31 @@ TEST_F(RPCThreadDispatchServiceTest, handleRPC)
     EXPECT_EQ(2U, dispatchService.threads.size());
 }
 
+TEST_F(RPCThreadDispatchServiceTest, getQueueDepth)
+{
+    ThreadDispatchService dispatchService(echoService,
+                                          0, 1);
+    EXPECT_EQ(0U, dispatchService.getQueueDepth());
+    {
+        std::unique_lock<Core::Mutex> lockGuard(dispatchService.mutex);
+        dispatchService.rpcQueue.push(ServerRPC());
+        dispatchService.rpcQueue.push(ServerRPC());
+    }
+    EXPECT_EQ(2U, dispatchService.getQueueDepth());
+}
+
+TEST_F(RPCThreadDispatchServiceTest, getLatency)
+{
+    ThreadDispatchService dispatchService(echoService,
+                                          0, 2);
+    for (uint32_t i = 0; i < 3; ++i)
+        dispatchService.handleRPC(ServerRPC());
+    while (dispatchService.getLatency(0).getSnapshot().count < 3)
+        usleep(1000);
+    EXPECT_EQ(3U, echoService->count);
+    EXPECT_EQ(0U, dispatchService.getLatency(1).getSnapshot().count);
+}
+
 TEST_F(RPCThreadDispatchServiceTest, workerMain)
 {
     // most of this is tested already in the other tests
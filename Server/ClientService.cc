@@ -16,6 +16,10 @@
 #include <string.h>
 
 #include "build/Protocol/Client.pb.h"
+#include "Core/Debug.h"
+#include "Core/Payload.h"
+#include "Core/Trace.h"
+#include "Protocol/Common.h"
 #include "RPC/Buffer.h"
 #include "RPC/ProtoBuf.h"
 #include "RPC/ServerRPC.h"
@@ -23,6 +27,7 @@
 #include "Server/ClientService.h"
 #include "Server/Globals.h"
 #include "Server/LogManager.h"
+#include "Server/ServerStats.h"
 #include "Server/StateMachine.h"
 #include "Storage/Log.h"
 #include "Storage/LogEntry.h"
@@ -32,6 +37,7 @@ namespace Server {
 
 ClientService::ClientService(Globals& globals)
     : globals(globals)
+    , binaryCommands(globals.config.read<bool>("binaryCommands", false))
 {
 }
 
@@ -76,6 +82,27 @@ ClientService::handleRPC(RPC::ServerRPC rpc)
         case OpCode::SET_CONFIGURATION:
             setConfiguration(std::move(rpc));
             break;
+        case OpCode::GET_SERVER_STATS:
+            getServerStats(std::move(rpc));
+            break;
+        case OpCode::GET_TRACES:
+            getTraces(std::move(rpc));
+            break;
+        case OpCode::TRANSFER_LEADERSHIP:
+            transferLeadership(std::move(rpc));
+            break;
+        case OpCode::WATCH:
+            watch(std::move(rpc));
+            break;
+        case OpCode::SUBSCRIBE:
+            subscribe(std::move(rpc));
+            break;
+        case OpCode::UPDATE_SUBSCRIPTION:
+            updateSubscription(std::move(rpc));
+            break;
+        case OpCode::APPEND_CHUNK:
+            appendChunk(std::move(rpc));
+            break;
         default:
             rpc.rejectInvalidRequest();
     }
@@ -108,38 +135,77 @@ ClientService::getSupportedRPCVersions(RPC::ServerRPC rpc)
     PRELUDE(GetSupportedRPCVersions);
     response.set_min_version(1);
     response.set_max_version(1);
+    if (globals.rafts.size() > 1)
+        response.set_num_raft_groups(uint32_t(globals.rafts.size()));
     rpc.reply(response);
 }
 
 typedef RaftConsensus::ClientResult Result;
 typedef Protocol::Client::Command Command;
 
+bool
+ClientService::checkGroup(RPC::ServerRPC& rpc, uint32_t groupId)
+{
+    if (groupId < globals.rafts.size())
+        return true;
+    WARNING("Client sent request for Raft group %u, but the cluster only "
+            "has %lu groups", groupId, globals.rafts.size());
+    rpc.rejectInvalidRequest();
+    return false;
+}
+
+void
+ClientService::returnNotLeader(RPC::ServerRPC& rpc, uint32_t groupId)
+{
+    Protocol::Client::Error error;
+    error.set_error_code(Protocol::Client::Error::NOT_LEADER);
+    std::string leaderHint = globals.rafts.at(groupId)->getLeaderHint();
+    if (!leaderHint.empty())
+        error.set_leader_hint(leaderHint);
+    rpc.returnError(error);
+}
 
 std::pair<Result, uint64_t>
 ClientService::submit(RPC::ServerRPC& rpc,
+                      uint32_t groupId,
                       const google::protobuf::Message& command)
 {
-    std::string cmdStr = Core::ProtoBuf::dumpString(command, false);
-    std::pair<Result, uint64_t> result = globals.raft->replicate(cmdStr);
+    Core::Payload operation =
+        StateMachine::serializeCommand(command, binaryCommands);
+    std::pair<Result, uint64_t> result =
+        globals.rafts.at(groupId)->replicate(operation);
     if (result.first == Result::RETRY || result.first == Result::NOT_LEADER) {
-        Protocol::Client::Error error;
-        error.set_error_code(Protocol::Client::Error::NOT_LEADER);
-        rpc.returnError(error);
+        returnNotLeader(rpc, groupId);
     }
     return result;
 }
 
 Result
-ClientService::catchUpStateMachine(RPC::ServerRPC& rpc)
+ClientService::catchUpStateMachine(
+        RPC::ServerRPC& rpc,
+        uint32_t groupId,
+        const Protocol::Client::FollowerRead* followerRead,
+        uint64_t& appliedId)
 {
-    std::pair<Result, uint64_t> result = globals.raft->getLastCommittedId();
+    RaftConsensus& raft = *globals.rafts.at(groupId);
+    std::pair<Result, uint64_t> result;
+    if (followerRead == NULL) {
+        result = raft.getLastCommittedId();
+    } else {
+        result = raft.getFollowerReadId(followerRead->max_staleness_ms());
+        // If we don't have the client's own writes yet, it's better off
+        // asking the leader than waiting on us.
+        if (result.first == Result::SUCCESS &&
+            result.second < followerRead->min_applied_id()) {
+            result.first = Result::NOT_LEADER;
+        }
+    }
     if (result.first == Result::RETRY || result.first == Result::NOT_LEADER) {
-        Protocol::Client::Error error;
-        error.set_error_code(Protocol::Client::Error::NOT_LEADER);
-        rpc.returnError(error);
+        returnNotLeader(rpc, groupId);
         return result.first;
     }
-    globals.stateMachine->wait(result.second);
+    globals.stateMachines.at(groupId)->wait(result.second);
+    appliedId = result.second;
     return result.first;
 }
 
@@ -147,12 +213,16 @@ void
 ClientService::openLog(RPC::ServerRPC rpc)
 {
     PRELUDE(OpenLog);
+    uint32_t groupId = Protocol::Common::getRaftGroup(
+        request.log_name(), uint32_t(globals.rafts.size()));
     Command command;
     *command.mutable_open_log() = request;
-    std::pair<Result, uint64_t> result = submit(rpc, command);
+    std::pair<Result, uint64_t> result = submit(rpc, groupId, command);
     if (result.first != Result::SUCCESS)
         return;
-    response = globals.stateMachine->getResponse(result.second).open_log();
+    response = globals.stateMachines.at(groupId)->
+        getResponse(result.second).open_log();
+    response.set_applied_id(result.second);
     rpc.reply(response);
 }
 
@@ -160,11 +230,14 @@ void
 ClientService::deleteLog(RPC::ServerRPC rpc)
 {
     PRELUDE(DeleteLog);
+    uint32_t groupId = Protocol::Common::getRaftGroup(
+        request.log_name(), uint32_t(globals.rafts.size()));
     Command command;
     *command.mutable_delete_log() = request;
-    std::pair<Result, uint64_t> result = submit(rpc, command);
+    std::pair<Result, uint64_t> result = submit(rpc, groupId, command);
     if (result.first != Result::SUCCESS)
         return;
+    response.set_applied_id(result.second);
     rpc.reply(response);
 }
 
@@ -172,9 +245,19 @@ void
 ClientService::listLogs(RPC::ServerRPC rpc)
 {
     PRELUDE(ListLogs);
-    if (catchUpStateMachine(rpc) != Result::SUCCESS)
+    uint32_t groupId = request.group_id();
+    if (!checkGroup(rpc, groupId))
         return;
-    globals.stateMachine->listLogs(request, response);
+    uint64_t appliedId = 0;
+    if (catchUpStateMachine(rpc,
+                            groupId,
+                            (request.has_follower_read()
+                                ? &request.follower_read() : NULL),
+                            appliedId) != Result::SUCCESS) {
+        return;
+    }
+    globals.stateMachines.at(groupId)->listLogs(request, response);
+    response.set_applied_id(appliedId);
     rpc.reply(response);
 }
 
@@ -182,12 +265,39 @@ void
 ClientService::append(RPC::ServerRPC rpc)
 {
     PRELUDE(Append);
+    uint32_t groupId = Protocol::Common::getRaftGroup(request.log_id());
+    if (!checkGroup(rpc, groupId))
+        return;
     Command command;
-    *command.mutable_append() = request;
-    std::pair<Result, uint64_t> result = submit(rpc, command);
+    command.mutable_append()->Swap(&request);
+    std::pair<Result, uint64_t> result = submit(rpc, groupId, command);
     if (result.first != Result::SUCCESS)
         return;
-    response = globals.stateMachine->getResponse(result.second).append();
+    response = globals.stateMachines.at(groupId)->
+        getResponse(result.second).append();
+    response.set_applied_id(result.second);
+    rpc.reply(response);
+}
+
+void
+ClientService::appendChunk(RPC::ServerRPC rpc)
+{
+    PRELUDE(AppendChunk);
+    uint32_t groupId = Protocol::Common::getRaftGroup(request.log_id());
+    if (!checkGroup(rpc, groupId))
+        return;
+    if (request.data().size() > Protocol::Common::MAX_CHUNK_LENGTH) {
+        rpc.rejectInvalidRequest();
+        return;
+    }
+    Command command;
+    command.mutable_append_chunk()->Swap(&request);
+    std::pair<Result, uint64_t> result = submit(rpc, groupId, command);
+    if (result.first != Result::SUCCESS)
+        return;
+    response = globals.stateMachines.at(groupId)->
+        getResponse(result.second).append_chunk();
+    response.set_applied_id(result.second);
     rpc.reply(response);
 }
 
@@ -195,9 +305,19 @@ void
 ClientService::read(RPC::ServerRPC rpc)
 {
     PRELUDE(Read);
-    if (catchUpStateMachine(rpc) != Result::SUCCESS)
+    uint32_t groupId = Protocol::Common::getRaftGroup(request.log_id());
+    if (!checkGroup(rpc, groupId))
+        return;
+    uint64_t appliedId = 0;
+    if (catchUpStateMachine(rpc,
+                            groupId,
+                            (request.has_follower_read()
+                                ? &request.follower_read() : NULL),
+                            appliedId) != Result::SUCCESS) {
         return;
-    globals.stateMachine->read(request, response);
+    }
+    globals.stateMachines.at(groupId)->read(request, response);
+    response.set_applied_id(appliedId);
     rpc.reply(response);
 }
 
@@ -205,9 +325,19 @@ void
 ClientService::getLastId(RPC::ServerRPC rpc)
 {
     PRELUDE(GetLastId);
-    if (catchUpStateMachine(rpc) != Result::SUCCESS)
+    uint32_t groupId = Protocol::Common::getRaftGroup(request.log_id());
+    if (!checkGroup(rpc, groupId))
+        return;
+    uint64_t appliedId = 0;
+    if (catchUpStateMachine(rpc,
+                            groupId,
+                            (request.has_follower_read()
+                                ? &request.follower_read() : NULL),
+                            appliedId) != Result::SUCCESS) {
         return;
-    globals.stateMachine->getLastId(request, response);
+    }
+    globals.stateMachines.at(groupId)->getLastId(request, response);
+    response.set_applied_id(appliedId);
     rpc.reply(response);
 }
 
@@ -215,13 +345,17 @@ void
 ClientService::getConfiguration(RPC::ServerRPC rpc)
 {
     PRELUDE(GetConfiguration);
+    uint32_t groupId = request.group_id();
+    if (!checkGroup(rpc, groupId))
+        return;
     Protocol::Raft::SimpleConfiguration configuration;
+    Protocol::Raft::SimpleConfiguration learners;
     uint64_t id;
-    Result result = globals.raft->getConfiguration(configuration, id);
+    Result result = globals.rafts.at(groupId)->getConfiguration(configuration,
+                                                                learners,
+                                                                id);
     if (result == Result::RETRY || result == Result::NOT_LEADER) {
-        Protocol::Client::Error error;
-        error.set_error_code(Protocol::Client::Error::NOT_LEADER);
-        rpc.returnError(error);
+        returnNotLeader(rpc, groupId);
         return;
     }
     response.set_id(id);
@@ -232,6 +366,13 @@ ClientService::getConfiguration(RPC::ServerRPC rpc)
         server->set_server_id(it->server_id());
         server->set_address(it->address());
     }
+    for (auto it = learners.servers().begin();
+         it != learners.servers().end();
+         ++it) {
+        Protocol::Client::Server* server = response.add_learners();
+        server->set_server_id(it->server_id());
+        server->set_address(it->address());
+    }
     rpc.reply(response);
 }
 
@@ -239,6 +380,9 @@ void
 ClientService::setConfiguration(RPC::ServerRPC rpc)
 {
     PRELUDE(SetConfiguration);
+    uint32_t groupId = request.group_id();
+    if (!checkGroup(rpc, groupId))
+        return;
     Protocol::Raft::SimpleConfiguration newConfiguration;
     for (auto it = request.new_servers().begin();
          it != request.new_servers().end();
@@ -247,15 +391,22 @@ ClientService::setConfiguration(RPC::ServerRPC rpc)
         s->set_server_id(it->server_id());
         s->set_address(it->address());
     }
-    Result result = globals.raft->setConfiguration(
+    Protocol::Raft::SimpleConfiguration newLearners;
+    for (auto it = request.new_learners().servers().begin();
+         it != request.new_learners().servers().end();
+         ++it) {
+        Protocol::Raft::Server* s = newLearners.add_servers();
+        s->set_server_id(it->server_id());
+        s->set_address(it->address());
+    }
+    Result result = globals.rafts.at(groupId)->setConfiguration(
                         request.old_id(),
-                        newConfiguration);
+                        newConfiguration,
+                        request.has_new_learners() ? &newLearners : NULL);
     if (result == Result::SUCCESS) {
         response.mutable_ok();
     } else if (result == Result::RETRY || result == Result::NOT_LEADER) {
-        Protocol::Client::Error error;
-        error.set_error_code(Protocol::Client::Error::NOT_LEADER);
-        rpc.returnError(error);
+        returnNotLeader(rpc, groupId);
         return;
     } else if (result == Result::FAIL) {
         // TODO(ongaro): can't distinguish changed from bad
@@ -264,6 +415,108 @@ ClientService::setConfiguration(RPC::ServerRPC rpc)
     rpc.reply(response);
 }
 
+void
+ClientService::getServerStats(RPC::ServerRPC rpc)
+{
+    PRELUDE(GetServerStats);
+    *response.mutable_server_stats() = globals.serverStats->getCurrent();
+    rpc.reply(response);
+}
+
+void
+ClientService::getTraces(RPC::ServerRPC rpc)
+{
+    PRELUDE(GetTraces);
+    std::vector<Core::Trace::Record> records = Core::Trace::getRecent();
+    for (auto it = records.begin(); it != records.end(); ++it) {
+        Protocol::Client::Trace& trace = *response.add_traces();
+        trace.set_trace_id(it->traceId);
+        trace.set_entry_id(it->entryId);
+        uint64_t start =
+            it->timestamps[uint32_t(Core::Trace::Stage::RECEIVE)];
+        for (uint32_t i = 0; i < Core::Trace::NUM_STAGES; ++i) {
+            uint64_t timestamp = it->timestamps[i];
+            if (timestamp == 0 || timestamp < start)
+                continue;
+            Protocol::Client::Trace::Stage& stage = *trace.add_stages();
+            stage.set_name(
+                Core::Trace::stageToString(Core::Trace::Stage(i)));
+            stage.set_micros((timestamp - start) / 1000);
+        }
+    }
+    if (request.as_json())
+        response.set_json(Core::Trace::toJSON(records));
+    rpc.reply(response);
+}
+
+void
+ClientService::transferLeadership(RPC::ServerRPC rpc)
+{
+    PRELUDE(TransferLeadership);
+    uint64_t newLeaderId = 0;
+    std::string reason;
+    Result result = globals.raft->transferLeadership(request.server_id(),
+                                                     newLeaderId,
+                                                     reason);
+    if (result == Result::SUCCESS) {
+        response.mutable_ok()->set_leader_id(newLeaderId);
+    } else if (result == Result::RETRY || result == Result::NOT_LEADER) {
+        returnNotLeader(rpc, 0);
+        return;
+    } else if (result == Result::FAIL) {
+        response.mutable_failed()->set_reason(reason);
+    }
+    rpc.reply(response);
+}
+
+void
+ClientService::watch(RPC::ServerRPC rpc)
+{
+    PRELUDE(Watch);
+    // This catches up once per batch of new entries, rather than once per
+    // poll. The wait itself happens in the state machine, which answers the
+    // RPC from its own thread, so this thread is free to go.
+    uint32_t groupId = Protocol::Common::getRaftGroup(request.log_id());
+    if (!checkGroup(rpc, groupId))
+        return;
+    uint64_t appliedId = 0;
+    if (catchUpStateMachine(rpc,
+                            groupId,
+                            (request.has_follower_read()
+                                ? &request.follower_read() : NULL),
+                            appliedId) != Result::SUCCESS) {
+        return;
+    }
+    globals.stateMachines.at(groupId)->watch(request, std::move(rpc));
+}
+
+void
+ClientService::subscribe(RPC::ServerRPC rpc)
+{
+    PRELUDE(Subscribe);
+    // Once caught up, the state machine applies every later entry, whether
+    // or not this server stays leader, so the subscription stays here.
+    uint32_t groupId = Protocol::Common::getRaftGroup(request.log_id());
+    if (!checkGroup(rpc, groupId))
+        return;
+    uint64_t appliedId = 0;
+    if (catchUpStateMachine(rpc, groupId, NULL, appliedId) != Result::SUCCESS)
+        return;
+    globals.stateMachines.at(groupId)->subscribe(request, std::move(rpc));
+}
+
+void
+ClientService::updateSubscription(RPC::ServerRPC rpc)
+{
+    PRELUDE(UpdateSubscription);
+    uint32_t groupId =
+        Protocol::Common::getRaftGroup(request.subscription_id());
+    if (!checkGroup(rpc, groupId))
+        return;
+    globals.stateMachines.at(groupId)->updateSubscription(request, response);
+    rpc.reply(response);
+}
+
 
 } // namespace LogCabin::Server
 } // namespace LogCabin
@@ -16,6 +16,7 @@
 #include "RPC/Service.h"
 
 
+#include "build/Protocol/Client.pb.h"
 #include "build/Protocol/Raft.pb.h"
 #include "Core/Debug.h"
 #include "Core/ProtoBuf.h"
@@ -61,18 +62,69 @@ class ClientService : public RPC::Service {
     void getLastId(RPC::ServerRPC rpc);
     void getConfiguration(RPC::ServerRPC rpc);
     void setConfiguration(RPC::ServerRPC rpc);
+    void getServerStats(RPC::ServerRPC rpc);
+    void getTraces(RPC::ServerRPC rpc);
+    void transferLeadership(RPC::ServerRPC rpc);
+    void watch(RPC::ServerRPC rpc);
+    void subscribe(RPC::ServerRPC rpc);
+    void updateSubscription(RPC::ServerRPC rpc);
+    void appendChunk(RPC::ServerRPC rpc);
 
+    /**
+     * Return true if this server runs the given Raft group. Otherwise, reject
+     * the RPC, which names a log or subscription that no server could have
+     * handed out, and return false.
+     */
+    bool checkGroup(RPC::ServerRPC& rpc, uint32_t groupId);
+
+    /**
+     * Reply with a NOT_LEADER error, including the address of the server
+     * that is probably the leader of the given Raft group if this server
+     * knows it.
+     */
+    void returnNotLeader(RPC::ServerRPC& rpc, uint32_t groupId);
+
+    /**
+     * Replicate a command through the given Raft group. If this returns
+     * anything other than SUCCESS, it has already replied to the RPC.
+     */
     std::pair<RaftConsensus::ClientResult, uint64_t>
-    submit(RPC::ServerRPC& rpc, const google::protobuf::Message& command);
+    submit(RPC::ServerRPC& rpc,
+           uint32_t groupId,
+           const google::protobuf::Message& command);
 
+    /**
+     * Wait for the state machine to catch up before a read-only operation.
+     * If this returns anything other than SUCCESS, it has already replied to
+     * the RPC.
+     * \param rpc
+     *      The read-only RPC.
+     * \param groupId
+     *      The Raft group whose state machine the RPC reads.
+     * \param followerRead
+     *      NULL if the read must reflect every operation committed before it
+     *      arrived, which only the leader can answer. Otherwise, the bounds
+     *      within which this server may answer from its own state machine.
+     * \param[out] appliedId
+     *      On SUCCESS, the state machine has applied at least this entry.
+     */
     RaftConsensus::ClientResult
-    catchUpStateMachine(RPC::ServerRPC& rpc);
+    catchUpStateMachine(RPC::ServerRPC& rpc,
+                        uint32_t groupId,
+                        const Protocol::Client::FollowerRead* followerRead,
+                        uint64_t& appliedId);
 
     /**
      * The LogCabin daemon's top-level objects.
      */
     Globals& globals;
 
+    /**
+     * Whether to replicate commands in the binary format rather than the text
+     * format. See StateMachine::serializeCommand().
+     */
+    const bool binaryCommands;
+
     // ClientService is non-copyable.
     ClientService(const ClientService&) = delete;
     ClientService& operator=(const ClientService&) = delete;
@@ -18,6 +18,7 @@
 
 #include "build/Protocol/Client.pb.h"
 #include "Core/ProtoBuf.h"
+#include "Core/Trace.h"
 #include "Protocol/Common.h"
 #include "RPC/Buffer.h"
 #include "RPC/ClientRPC.h"
@@ -105,6 +106,71 @@ TEST_F(ServerClientServiceTest, getSupportedRPCVersions) {
               "max_version: 1", response);
 }
 
+TEST_F(ServerClientServiceTest, getServerStats) {
+    init();
+    Protocol::Client::GetSupportedRPCVersions::Request versionsRequest;
+    Protocol::Client::GetSupportedRPCVersions::Response versionsResponse;
+    call(OpCode::GET_SUPPORTED_RPC_VERSIONS,
+         versionsRequest, versionsResponse);
+    Protocol::Client::GetServerStats::Request request;
+    Protocol::Client::GetServerStats::Response response;
+    call(OpCode::GET_SERVER_STATS, request, response);
+    const Protocol::Client::ServerStats& stats = response.server_stats();
+    EXPECT_EQ(1U, stats.server_id());
+    EXPECT_EQ(0U, stats.apply_lag());
+    ASSERT_EQ(2, stats.services_size());
+    const Protocol::Client::ServerStats::Service& clientService =
+        stats.services(0);
+    EXPECT_EQ("ClientService", clientService.name());
+    ASSERT_LE(1, clientService.rpcs_size());
+    EXPECT_EQ(uint32_t(OpCode::GET_SUPPORTED_RPC_VERSIONS),
+              clientService.rpcs(0).op_code());
+    EXPECT_EQ(1U, clientService.rpcs(0).latency().count());
+}
+
+TEST_F(ServerClientServiceTest, getTraces) {
+    init();
+    Core::Trace::reset();
+    Protocol::Client::GetSupportedRPCVersions::Request versionsRequest;
+    Protocol::Client::GetSupportedRPCVersions::Response versionsResponse;
+    RPC::ClientRPC rpc(session,
+                       Protocol::Common::ServiceId::CLIENT_SERVICE,
+                       1, OpCode::GET_SUPPORTED_RPC_VERSIONS,
+                       versionsRequest, 0xabcd);
+    EXPECT_EQ(Status::OK, rpc.waitForReply(&versionsResponse, NULL))
+        << rpc.getErrorMessage();
+    Protocol::Client::GetTraces::Request request;
+    Protocol::Client::GetTraces::Response response;
+    request.set_as_json(true);
+    call(OpCode::GET_TRACES, request, response);
+    ASSERT_EQ(1, response.traces_size());
+    const Protocol::Client::Trace& trace = response.traces(0);
+    EXPECT_EQ(0xabcdU, trace.trace_id());
+    EXPECT_EQ(0U, trace.entry_id());
+    ASSERT_EQ(3, trace.stages_size());
+    EXPECT_EQ("receive", trace.stages(0).name());
+    EXPECT_EQ(0U, trace.stages(0).micros());
+    EXPECT_EQ("dequeue", trace.stages(1).name());
+    EXPECT_EQ("send", trace.stages(2).name());
+    EXPECT_NE(std::string::npos,
+              response.json().find("\"traceId\": \"000000000000abcd\""))
+        << response.json();
+}
+
+TEST_F(ServerClientServiceTest, transferLeadership_notLeader) {
+    init();
+    Protocol::Client::TransferLeadership::Request request;
+    Protocol::Client::TransferLeadership::Response response;
+    RPC::ClientRPC rpc(session,
+                       Protocol::Common::ServiceId::CLIENT_SERVICE,
+                       1, OpCode::TRANSFER_LEADERSHIP, request);
+    Protocol::Client::Error error;
+    EXPECT_EQ(Status::SERVICE_SPECIFIC_ERROR,
+              rpc.waitForReply(&response, &error));
+    // this server doesn't know of a leader, so there's no hint
+    EXPECT_EQ("error_code: NOT_LEADER", error);
+}
+
 // These tests were written for the LogManager version of the ClientService,
 // not for the Consensus/StateMachine version.
 #if 0
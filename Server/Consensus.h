@@ -18,6 +18,8 @@
 #include <string>
 #include <vector>
 
+#include "Core/Payload.h"
+
 #ifndef LOGCABIN_SERVER_CONSENSUS_H
 #define LOGCABIN_SERVER_CONSENSUS_H
 
@@ -41,7 +43,11 @@ class Consensus {
         // TODO(ongaro): client serial number
         uint64_t entryId;
         bool hasData;
-        std::string data;
+        /**
+         * The data as it was given to the consensus module. This shares
+         * memory with the consensus module's copy of the entry.
+         */
+        Core::Payload data;
     };
 
     Consensus();
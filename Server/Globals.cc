@@ -16,14 +16,18 @@
 #include <signal.h>
 
 #include "Core/Debug.h"
+#include "Core/LockProfiler.h"
 #include "Core/StringUtil.h"
 #include "Protocol/Common.h"
+#include "RPC/ClientSession.h"
 #include "RPC/Server.h"
 #include "Server/RaftService.h"
 #include "Server/RaftConsensus.h"
 #include "Server/ClientService.h"
 #include "Server/Globals.h"
+#include "Server/HeartbeatSender.h"
 #include "Server/LogManager.h"
+#include "Server/ServerStats.h"
 #include "Server/StateMachine.h"
 
 namespace LogCabin {
@@ -49,9 +53,15 @@ Globals::Globals()
     : config()
     , eventLoop()
     , sigIntHandler(eventLoop)
+    , peerSessionsMutex()
+    , peerSessions()
     , logManager()
     , raft()
     , stateMachine()
+    , rafts()
+    , stateMachines()
+    , heartbeatSender()
+    , serverStats(new ServerStats(*this))
     , raftService()
     , clientService()
     , rpcServer()
@@ -68,6 +78,8 @@ Globals::~Globals()
 void
 Globals::init(uint64_t serverId)
 {
+    Core::LockProfiler::setEnabled(config.read<bool>("lockProfiling", false));
+
     if (logManager.getExclusiveAccess().get() == NULL) {
         logManager.reset(new LogManager(config));
     }
@@ -75,6 +87,25 @@ Globals::init(uint64_t serverId)
     if (!raft) {
         raft.reset(new RaftConsensus(*this));
     }
+    if (rafts.empty()) {
+        uint32_t numGroups = config.read<uint32_t>("raftGroups", 1);
+        if (numGroups == 0 ||
+            numGroups > (1U << (64 - Protocol::Common::RAFT_GROUP_SHIFT))) {
+            PANIC("raftGroups must be between 1 and %u, not %u",
+                  1U << (64 - Protocol::Common::RAFT_GROUP_SHIFT),
+                  numGroups);
+        }
+        rafts.push_back(raft);
+        for (uint32_t groupId = 1; groupId < numGroups; ++groupId) {
+            rafts.push_back(std::make_shared<RaftConsensus>(*this));
+            rafts.back()->groupId = groupId;
+        }
+    }
+
+    // This must be set before the groups start their Peer threads, and
+    // rafts must not change once it's running.
+    if (!heartbeatSender && config.read<bool>("heartbeatCoalescing", false))
+        heartbeatSender.reset(new HeartbeatSender(*this));
 
     if (!raftService) {
         raftService.reset(new RaftService(*this));
@@ -95,7 +126,10 @@ Globals::init(uint64_t serverId)
         rpcServer->registerService(Protocol::Common::ServiceId::CLIENT_SERVICE,
                                    clientService,
                                    maxThreads);
-
+        rpcServer->setTraceSampleRate(
+            config.read<uint32_t>("traceSampleRate", 0));
+        rpcServer->setIdleTimeout(
+            config.read<uint64_t>("idleConnectionTimeoutMs", 0));
 
         std::string configServers = config.read<std::string>("servers", "");
         std::vector<std::string> listenAddresses =
@@ -113,10 +147,18 @@ Globals::init(uint64_t serverId)
             error = rpcServer->bind(address);
             if (error.empty()) {
                 NOTICE("Serving on %s", address.toString().c_str());
-                raft->serverId = i + 1;
                 Core::Debug::processName =
-                    Core::StringUtil::format("%lu", raft->serverId);
-                raft->init();
+                    Core::StringUtil::format("%u", i + 1);
+                for (auto it = rafts.begin(); it != rafts.end(); ++it) {
+                    RaftConsensus& group = **it;
+                    group.serverId = i + 1;
+                    // Give each server its turn at leading a group.
+                    if (rafts.size() > 1) {
+                        group.preferredLeader =
+                            (group.groupId % listenAddresses.size() == i);
+                    }
+                    group.init();
+                }
                 break;
             }
         }
@@ -131,7 +173,16 @@ Globals::init(uint64_t serverId)
     if (!stateMachine) {
         stateMachine.reset(new StateMachine(raft));
     }
+    if (stateMachines.empty()) {
+        stateMachines.push_back(stateMachine);
+        for (uint32_t groupId = 1; groupId < rafts.size(); ++groupId) {
+            stateMachines.push_back(
+                std::make_shared<StateMachine>(rafts.at(groupId), groupId));
+        }
+    }
 
+    if (heartbeatSender)
+        heartbeatSender->init();
 }
 
 void
@@ -140,5 +191,19 @@ Globals::run()
     eventLoop.runForever();
 }
 
+std::shared_ptr<RPC::ClientSession>
+Globals::getPeerSession(const std::string& address)
+{
+    std::unique_lock<std::mutex> lockGuard(peerSessionsMutex);
+    std::shared_ptr<RPC::ClientSession>& session = peerSessions[address];
+    if (!session || !session->getErrorMessage().empty()) {
+        session = RPC::ClientSession::makeSession(
+            eventLoop,
+            RPC::Address(address, Protocol::Common::DEFAULT_PORT),
+            Protocol::Common::MAX_MESSAGE_LENGTH);
+    }
+    return session;
+}
+
 } // namespace LogCabin::Server
 } // namespace LogCabin
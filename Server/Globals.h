@@ -13,7 +13,11 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <map>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include "Core/Config.h"
 #include "Core/RWPtr.h"
@@ -27,6 +31,7 @@ namespace LogCabin {
 
 // forward declarations
 namespace RPC {
+class ClientSession;
 class Server;
 }
 
@@ -36,7 +41,9 @@ namespace Server {
 class RaftConsensus;
 class RaftService;
 class ClientService;
+class HeartbeatSender;
 class LogManager;
+class ServerStats;
 class StateMachine;
 
 /**
@@ -76,6 +83,17 @@ class Globals {
      */
     void run();
 
+    /**
+     * Return a session to the given server for the consensus module's RPCs.
+     * Every Raft group's peers for a server share one session, and so one
+     * connection, unless that session has failed, in which case this makes a
+     * new one.
+     * \param address
+     *      The address of the server, as given in the Raft configuration.
+     */
+    std::shared_ptr<RPC::ClientSession>
+    getPeerSession(const std::string& address);
+
     /**
      * Global configuration options.
      */
@@ -93,6 +111,18 @@ class Globals {
      */
     SigIntHandler sigIntHandler;
 
+    /**
+     * Protects #peerSessions.
+     */
+    std::mutex peerSessionsMutex;
+
+    /**
+     * Sessions returned by getPeerSession(), keyed by address. This is
+     * declared before #rafts so that it outlives their Peer threads, which
+     * may call getPeerSession() until the groups are destroyed.
+     */
+    std::map<std::string, std::shared_ptr<RPC::ClientSession>> peerSessions;
+
   public:
     /**
      * Used by the client service for managing and accessing logs.
@@ -100,15 +130,42 @@ class Globals {
     Core::RWManager<LogManager> logManager;
 
     /**
-     * Consensus module.
+     * Consensus module for Raft group 0.
      */
     std::shared_ptr<Server::RaftConsensus> raft;
 
     /**
-     * State machine used to process client requests.
+     * State machine used to process client requests for Raft group 0.
      */
     std::shared_ptr<Server::StateMachine> stateMachine;
 
+    /**
+     * The consensus module of each Raft group, indexed by group ID, starting
+     * with #raft. There is one group unless the "raftGroups" setting asks
+     * for more, in which case logs are spread across the groups by name
+     * (see Protocol::Common::getRaftGroup()).
+     */
+    std::vector<std::shared_ptr<Server::RaftConsensus>> rafts;
+
+    /**
+     * The state machine of each Raft group, indexed by group ID, starting
+     * with #stateMachine.
+     */
+    std::vector<std::shared_ptr<Server::StateMachine>> stateMachines;
+
+    /**
+     * Sends the heartbeats for all of #rafts, batched by destination server,
+     * or NULL if the "heartbeatCoalescing" setting is off, in which case each
+     * group's Peer threads send their own. This is declared after #rafts so
+     * that it's destroyed first.
+     */
+    std::unique_ptr<Server::HeartbeatSender> heartbeatSender;
+
+    /**
+     * Collects statistics for the GetServerStats RPC.
+     */
+    std::unique_ptr<Server::ServerStats> serverStats;
+
   private:
 
     /**
@@ -126,6 +183,9 @@ class Globals {
      */
     std::unique_ptr<RPC::Server> rpcServer;
 
+    // ServerStats reads statistics from the RPC server.
+    friend class ServerStats;
+
     // Globals is non-copyable.
     Globals(const Globals&) = delete;
     Globals& operator=(const Globals&) = delete;
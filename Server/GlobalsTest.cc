@@ -14,11 +14,17 @@
  */
 
 #include <gtest/gtest.h>
+#include <sys/stat.h>
 
+#include "Core/Debug.h"
 #include "Protocol/Common.h"
 #include "RPC/Address.h"
+#include "RPC/ClientSession.h"
 #include "RPC/Server.h"
+#include "Server/RaftConsensus.h"
 #include "Server/Globals.h"
+#include "Server/StateMachine.h"
+#include "Storage/FilesystemUtil.h"
 
 namespace LogCabin {
 namespace Server {
@@ -76,6 +82,60 @@ TEST(ServerGlobalsTest, initBindToOneOnly) {
     globals.init();
 }
 
+TEST(ServerGlobalsTest, initRaftGroups) {
+    std::string tmpdir = Storage::FilesystemUtil::tmpnam();
+    if (mkdir(tmpdir.c_str(), 0755) != 0)
+        PANIC("Couldn't create temporary directory for tests");
+    {
+        Globals globals;
+        globals.config.set("storageModule", "memory");
+        globals.config.set("uuid", "my-fake-uuid-123");
+        globals.config.set("servers", "127.0.0.1:61023;127.0.0.1:61024");
+        globals.config.set("raftLogPath", tmpdir);
+        globals.config.set("raftGroups", "3");
+        globals.init();
+        ASSERT_EQ(3U, globals.rafts.size());
+        ASSERT_EQ(3U, globals.stateMachines.size());
+        EXPECT_EQ(globals.raft, globals.rafts.at(0));
+        EXPECT_EQ(globals.stateMachine, globals.stateMachines.at(0));
+        for (uint32_t i = 0; i < 3; ++i) {
+            EXPECT_EQ(i, globals.rafts.at(i)->groupId);
+            EXPECT_EQ(1U, globals.rafts.at(i)->serverId);
+        }
+        // Server 1 is first in line for groups 0 and 2.
+        EXPECT_TRUE(globals.rafts.at(0)->preferredLeader);
+        EXPECT_FALSE(globals.rafts.at(1)->preferredLeader);
+        EXPECT_TRUE(globals.rafts.at(2)->preferredLeader);
+        EXPECT_EQ(tmpdir + "/1.2", globals.rafts.at(2)->log->path);
+    }
+    Storage::FilesystemUtil::remove(tmpdir);
+}
+
+TEST(ServerGlobalsTest, initRaftGroupsZero) {
+    Globals globals;
+    globals.config.set("storageModule", "memory");
+    globals.config.set("uuid", "my-fake-uuid-123");
+    globals.config.set("servers", "127.0.0.1");
+    globals.config.set("raftGroups", "0");
+    EXPECT_DEATH(globals.init(),
+                 "raftGroups must be between");
+}
+
+TEST(ServerGlobalsTest, getPeerSession) {
+    Event::Loop eventLoop;
+    RPC::Server server(eventLoop, 1);
+    EXPECT_EQ("", server.bind(RPC::Address("127.0.0.1", 61024)));
+    Globals globals;
+    std::shared_ptr<RPC::ClientSession> session =
+        globals.getPeerSession("127.0.0.1:61024");
+    EXPECT_EQ(session, globals.getPeerSession("127.0.0.1:61024"));
+    // A failed session is replaced.
+    std::shared_ptr<RPC::ClientSession> failed =
+        globals.getPeerSession("127.0.0.1:0");
+    EXPECT_NE("", failed->getErrorMessage());
+    EXPECT_NE(failed, globals.getPeerSession("127.0.0.1:0"));
+}
+
 } // namespace LogCabin::Server::<anonymous>
 } // namespace LogCabin::Server
 } // namespace LogCabin
@@ -0,0 +1,211 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "Core/Debug.h"
+#include "Core/ThreadId.h"
+#include "Protocol/Common.h"
+#include "Server/RaftConsensus.h"
+#include "Server/Globals.h"
+#include "Server/HeartbeatSender.h"
+
+namespace LogCabin {
+namespace Server {
+
+////////// HeartbeatSender::Batch //////////
+
+HeartbeatSender::Batch::Batch()
+    : address()
+    , request()
+    , epochs()
+{
+}
+
+////////// HeartbeatSender::Outstanding //////////
+
+HeartbeatSender::Outstanding::Outstanding(
+        uint64_t serverId,
+        const Batch& batch,
+        TimePoint start,
+        RPC::ClientRPC rpc)
+    : serverId(serverId)
+    , request(batch.request)
+    , epochs(batch.epochs)
+    , start(start)
+    , rpc(std::move(rpc))
+{
+}
+
+HeartbeatSender::Outstanding::Outstanding(Outstanding&& other)
+    : serverId(other.serverId)
+    , request(other.request)
+    , epochs(other.epochs)
+    , start(other.start)
+    , rpc(std::move(other.rpc))
+{
+}
+
+HeartbeatSender::Outstanding&
+HeartbeatSender::Outstanding::operator=(Outstanding&& other)
+{
+    serverId = other.serverId;
+    request = other.request;
+    epochs = other.epochs;
+    start = other.start;
+    rpc = std::move(other.rpc);
+    return *this;
+}
+
+////////// HeartbeatSender //////////
+
+HeartbeatSender::HeartbeatSender(Globals& globals)
+    : globals(globals)
+    , mutex("HeartbeatSender::mutex")
+    , changed()
+    , exiting(false)
+    , wakeUpRequested(false)
+    , repliesReady(false)
+    , outstanding()
+    , thread()
+{
+}
+
+HeartbeatSender::~HeartbeatSender()
+{
+    {
+        std::unique_lock<Core::Mutex> lockGuard(mutex);
+        exiting = true;
+        changed.notify_all();
+    }
+    if (thread.joinable())
+        thread.join();
+}
+
+void
+HeartbeatSender::init()
+{
+    if (!thread.joinable())
+        thread = std::thread(&HeartbeatSender::threadMain, this);
+}
+
+void
+HeartbeatSender::wakeUp()
+{
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
+    wakeUpRequested = true;
+    changed.notify_all();
+}
+
+void
+HeartbeatSender::threadMain()
+{
+    Core::ThreadId::setName("HeartbeatSender");
+    std::chrono::milliseconds roundPeriod(
+        RaftConsensus::HEARTBEAT_PERIOD_MS / 2);
+    TimePoint nextRound = Clock::now();
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
+    while (!exiting) {
+        TimePoint now = Clock::now();
+        if (wakeUpRequested || now >= nextRound) {
+            // Stay on the schedule, unless this round is off of it or the
+            // last one ran very late.
+            TimePoint roundTime = nextRound;
+            if (wakeUpRequested || now >= nextRound + roundPeriod)
+                roundTime = now;
+            wakeUpRequested = false;
+            repliesReady = false;
+            nextRound = roundTime + roundPeriod;
+            lockGuard.unlock();
+            checkReplies();
+            sendRound(roundTime);
+            lockGuard.lock();
+            continue;
+        }
+        if (repliesReady) {
+            repliesReady = false;
+            lockGuard.unlock();
+            checkReplies();
+            lockGuard.lock();
+            continue;
+        }
+        changed.wait_until(lockGuard, nextRound);
+    }
+}
+
+void
+HeartbeatSender::sendRound(TimePoint roundTime)
+{
+    Batches batches;
+    for (auto it = globals.rafts.begin(); it != globals.rafts.end(); ++it)
+        (*it)->collectHeartbeats(roundTime, batches);
+    TimePoint start = Clock::now();
+    for (auto it = batches.begin(); it != batches.end(); ++it) {
+        const Batch& batch = it->second;
+        RPC::ClientRPC rpc(globals.getPeerSession(batch.address),
+                           Protocol::Common::ServiceId::RAFT_SERVICE,
+                           /* serviceSpecificErrorVersion = */ 0,
+                           Protocol::Raft::OpCode::HEARTBEAT,
+                           batch.request,
+                           /* traceId = */ 0,
+                           /* stream = */ false,
+                           RPC::MessageSocket::Priority::CONTROL);
+        outstanding.emplace_back(it->first, batch, start, std::move(rpc));
+        outstanding.back().rpc.setReadyCallback([this] () {
+            std::unique_lock<Core::Mutex> lockGuard(mutex);
+            repliesReady = true;
+            changed.notify_all();
+        });
+    }
+}
+
+void
+HeartbeatSender::checkReplies()
+{
+    typedef RPC::ClientRPC::Status RPCStatus;
+    auto it = outstanding.begin();
+    while (it != outstanding.end()) {
+        if (!it->rpc.isReady()) {
+            ++it;
+            continue;
+        }
+        Protocol::Raft::Heartbeat::Response response;
+        bool ok = false;
+        switch (it->rpc.waitForReply(&response, NULL)) {
+            case RPCStatus::OK:
+                ok = true;
+                break;
+            case RPCStatus::SERVICE_SPECIFIC_ERROR:
+                PANIC("unexpected service-specific error");
+            default:
+                WARNING("Heartbeat RPC to server %lu failed: %s",
+                        it->serverId, it->rpc.getErrorMessage().c_str());
+        }
+        if (ok && response.terms_size() != it->request.groups_size()) {
+            PANIC("Server %lu replied to a heartbeat for %d groups with %d "
+                  "terms", it->serverId, it->request.groups_size(),
+                  response.terms_size());
+        }
+        for (int i = 0; i < it->request.groups_size(); ++i) {
+            const Protocol::Raft::Heartbeat::Group& group =
+                it->request.groups(i);
+            globals.rafts.at(group.group_id())->handleHeartbeatReply(
+                it->serverId, group, it->epochs.at(size_t(i)), it->start,
+                ok, ok ? response.terms(i) : 0);
+        }
+        it = outstanding.erase(it);
+    }
+}
+
+} // namespace LogCabin::Server
+} // namespace LogCabin
@@ -0,0 +1,198 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "build/Protocol/Raft.pb.h"
+#include "Core/ConditionVariable.h"
+#include "Core/Mutex.h"
+#include "Core/Time.h"
+#include "RPC/ClientRPC.h"
+
+#ifndef LOGCABIN_SERVER_HEARTBEATSENDER_H
+#define LOGCABIN_SERVER_HEARTBEATSENDER_H
+
+namespace LogCabin {
+namespace Server {
+
+// forward declaration
+class Globals;
+
+/**
+ * Sends the heartbeats for all of this server's Raft groups from a single
+ * thread. Without this, each group's Peer threads send their own AppendEntry
+ * requests without entries, each on its own schedule.
+ *
+ * Every half heartbeat period, this asks each group that this server leads
+ * which followers will be due a heartbeat before the next round. It then
+ * sends each of those followers' servers one Heartbeat RPC covering all of
+ * the groups, on the session that the groups share (see
+ * Globals::getPeerSession()). A follower that's sent a heartbeat in one round
+ * is next due two rounds later, so once each follower has been sent a
+ * heartbeat, the heartbeats for all of the groups it's in go out together.
+ */
+class HeartbeatSender {
+  public:
+    typedef Core::Time::SteadyClock Clock;
+    typedef Clock::time_point TimePoint;
+
+    /**
+     * The heartbeats bound for one server.
+     */
+    struct Batch {
+        Batch();
+        /**
+         * The server's address, as given in the Raft configuration.
+         */
+        std::string address;
+        /**
+         * One Heartbeat::Group for each Raft group.
+         */
+        Protocol::Raft::Heartbeat::Request request;
+        /**
+         * The epoch of each group in #request when its heartbeat was
+         * collected, in the same order. A reply acknowledges the leader as of
+         * these epochs. They're kept here rather than sent, since the
+         * followers have no use for them.
+         */
+        std::vector<uint64_t> epochs;
+    };
+
+    /**
+     * Batches keyed by the ID of the server they're bound for.
+     */
+    typedef std::map<uint64_t, Batch> Batches;
+
+    /**
+     * Constructor. This doesn't start sending heartbeats until init().
+     * \param globals
+     *      Handle to LogCabin's top-level objects, in particular the
+     *      Globals::rafts to send heartbeats for.
+     */
+    explicit HeartbeatSender(Globals& globals);
+
+    /**
+     * Destructor. Stops the thread.
+     */
+    ~HeartbeatSender();
+
+    /**
+     * Start the thread. Globals::rafts must not change after this.
+     */
+    void init();
+
+    /**
+     * Send a round of heartbeats right away, rather than waiting for the next
+     * round. RaftConsensus calls this when it becomes leader, so that its
+     * followers hear about it promptly. This may be called with a
+     * RaftConsensus lock held.
+     */
+    void wakeUp();
+
+  private:
+    /**
+     * A Heartbeat RPC awaiting its reply.
+     */
+    struct Outstanding {
+        Outstanding(uint64_t serverId,
+                    const Batch& batch,
+                    TimePoint start,
+                    RPC::ClientRPC rpc);
+        Outstanding(Outstanding&& other);
+        Outstanding& operator=(Outstanding&& other);
+        uint64_t serverId;
+        Protocol::Raft::Heartbeat::Request request;
+        std::vector<uint64_t> epochs;
+        TimePoint start;
+        RPC::ClientRPC rpc;
+    };
+
+    /**
+     * The main loop of #thread: calls sendRound() every half heartbeat
+     * period, and checkReplies() whenever an RPC in #outstanding finishes.
+     */
+    void threadMain();
+
+    /**
+     * Collect heartbeats from every Raft group and send them out.
+     * \param roundTime
+     *      The time at which this round was scheduled. Followers that are sent
+     *      a heartbeat are next due one heartbeat period after this.
+     */
+    void sendRound(TimePoint roundTime);
+
+    /**
+     * Pass the replies to the RPCs in #outstanding that have finished on to
+     * their Raft groups.
+     */
+    void checkReplies();
+
+    /**
+     * The LogCabin daemon's top-level objects.
+     */
+    Globals& globals;
+
+    /**
+     * Protects #exiting, #wakeUpRequested, and #repliesReady. This is never
+     * held while calling into RaftConsensus, which may call wakeUp() with its
+     * own lock held, or into the RPCs in #outstanding, whose ready callbacks
+     * acquire it with the ClientSession's lock held.
+     */
+    Core::Mutex mutex;
+
+    /**
+     * Notified when #exiting, #wakeUpRequested, or #repliesReady is set.
+     */
+    Core::ConditionVariable changed;
+
+    /**
+     * Set to true when #thread should exit.
+     */
+    bool exiting;
+
+    /**
+     * Set by wakeUp().
+     */
+    bool wakeUpRequested;
+
+    /**
+     * Set from the event loop thread when an RPC in #outstanding finishes, so
+     * that #thread doesn't have to poll them.
+     */
+    bool repliesReady;
+
+    /**
+     * Heartbeat RPCs that have been sent but whose replies haven't been
+     * processed yet. Only #thread accesses this.
+     */
+    std::vector<Outstanding> outstanding;
+
+    /**
+     * Runs threadMain().
+     */
+    std::thread thread;
+
+    // HeartbeatSender is non-copyable.
+    HeartbeatSender(const HeartbeatSender&) = delete;
+    HeartbeatSender& operator=(const HeartbeatSender&) = delete;
+}; // class HeartbeatSender
+
+} // namespace LogCabin::Server
+} // namespace LogCabin
+
+#endif /* LOGCABIN_SERVER_HEARTBEATSENDER_H */
@@ -0,0 +1,208 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <thread>
+
+#include "build/Protocol/Raft.pb.h"
+#include "Core/Debug.h"
+#include "Core/ProtoBuf.h"
+#include "Core/StringUtil.h"
+#include "Protocol/Common.h"
+#include "RPC/ServiceMock.h"
+#include "RPC/Server.h"
+#include "Server/RaftConsensus.h"
+#include "Server/Globals.h"
+#include "Server/HeartbeatSender.h"
+
+namespace LogCabin {
+namespace Server {
+namespace {
+
+using namespace RaftConsensusInternal; // NOLINT
+using Core::ProtoBuf::fromString;
+using std::chrono::milliseconds;
+
+class ServerHeartbeatSenderTest : public ::testing::Test {
+    ServerHeartbeatSenderTest()
+        : globals()
+        , peerService()
+        , peerServer()
+        , eventLoopThread()
+        , raft()
+        , peer()
+        , sender()
+        , request()
+        , response()
+    {
+        RaftConsensus::HEARTBEAT_PERIOD_MS = 2000;
+        RaftConsensus::RPC_FAILURE_BACKOFF_MS = 3000;
+        startThreads = false;
+
+        peerService = std::make_shared<RPC::ServiceMock>();
+        peerServer.reset(new RPC::Server(globals.eventLoop,
+                                     Protocol::Common::MAX_MESSAGE_LENGTH));
+        RPC::Address address("127.0.0.1:61024", 0);
+        EXPECT_EQ("", peerServer->bind(address));
+        peerServer->registerService(
+                            Protocol::Common::ServiceId::RAFT_SERVICE,
+                            peerService, 1);
+        eventLoopThread = std::thread(&Event::Loop::runForever,
+                                      &globals.eventLoop);
+
+        // Make server 1 the leader of a two-server cluster in term 6.
+        raft = std::make_shared<RaftConsensus>(globals);
+        raft->serverId = 1;
+        raft->log.reset(new Log());
+        raft->init();
+        raft->stepDown(5);
+        Log::Entry entry;
+        entry.term = 1;
+        entry.type = Protocol::Raft::EntryType::CONFIGURATION;
+        entry.configuration = fromString<Protocol::Raft::Configuration>(
+            "prev_configuration {"
+            "    servers { server_id: 1, address: '127.0.0.1:61023' }"
+            "}");
+        raft->append(entry);
+        raft->startNewElection();
+        entry.term = 6;
+        entry.configuration = fromString<Protocol::Raft::Configuration>(
+            "prev_configuration {"
+            "    servers { server_id: 1, address: '127.0.0.1:61023' }"
+            "    servers { server_id: 2, address: '127.0.0.1:61024' }"
+            "}");
+        raft->append(entry);
+        EXPECT_EQ(RaftConsensus::State::LEADER, raft->state);
+        peer = std::dynamic_pointer_cast<Peer>(
+            raft->configuration->knownServers.at(2));
+        peer->requestVoteDone = true;
+        peer->lastAgreeId = 2;
+        raft->committedId = 2;
+        raft->stateChanged.notify_all();
+        globals.rafts.push_back(raft);
+
+        sender.reset(new HeartbeatSender(globals));
+        request = fromString<Protocol::Raft::Heartbeat::Request>(
+            "server_id: 1 "
+            "groups { term: 6, committed_id: 2, leader_committed_id: 2 }");
+        response = fromString<Protocol::Raft::Heartbeat::Response>(
+            "terms: 6");
+    }
+
+    ~ServerHeartbeatSenderTest()
+    {
+        sender.reset();
+        globals.eventLoop.exit();
+        eventLoopThread.join();
+        startThreads = true;
+    }
+
+    /// Call checkReplies() until every outstanding RPC has been handled.
+    void waitForReplies() {
+        for (uint64_t i = 0; i < 1000 && !sender->outstanding.empty(); ++i) {
+            sender->checkReplies();
+            if (!sender->outstanding.empty())
+                usleep(1000);
+        }
+        EXPECT_TRUE(sender->outstanding.empty());
+    }
+
+    Globals globals;
+    std::shared_ptr<RPC::ServiceMock> peerService;
+    std::unique_ptr<RPC::Server> peerServer;
+    std::thread eventLoopThread;
+    std::shared_ptr<RaftConsensus> raft;
+    std::shared_ptr<Peer> peer;
+    std::unique_ptr<HeartbeatSender> sender;
+    Protocol::Raft::Heartbeat::Request request;
+    Protocol::Raft::Heartbeat::Response response;
+};
+
+TEST_F(ServerHeartbeatSenderTest, sendRound)
+{
+    peerService->reply(Protocol::Raft::OpCode::HEARTBEAT, request, response);
+    sender->sendRound(Clock::now());
+    EXPECT_EQ(1U, sender->outstanding.size());
+    // nothing more is due until the round after next
+    sender->sendRound(Clock::now());
+    EXPECT_EQ(1U, sender->outstanding.size());
+    waitForReplies();
+    EXPECT_EQ(raft->currentEpoch, peer->lastAckEpoch);
+    EXPECT_NE(TimePoint::min(), peer->lastAckTime);
+}
+
+TEST_F(ServerHeartbeatSenderTest, sendRound_batched)
+{
+    // A second group that this server also leads, with the same peer.
+    std::shared_ptr<RaftConsensus> raft2 =
+        std::make_shared<RaftConsensus>(globals);
+    raft2->groupId = 1;
+    raft2->serverId = 1;
+    raft2->log.reset(new Log());
+    raft2->init();
+    raft2->stepDown(2);
+    Log::Entry entry;
+    entry.term = 1;
+    entry.type = Protocol::Raft::EntryType::CONFIGURATION;
+    entry.configuration = raft->log->getEntry(2).configuration;
+    raft2->append(entry);
+    raft2->state = RaftConsensus::State::LEADER;
+    raft2->leaderId = 1;
+    raft2->votedFor = 1;
+    raft2->updateLogMetadata();
+    raft2->committedId = 1;
+    raft2->stateChanged.notify_all();
+    std::shared_ptr<Peer> peer2 = std::dynamic_pointer_cast<Peer>(
+        raft2->configuration->knownServers.at(2));
+    peer2->requestVoteDone = true;
+    peer2->lastAgreeId = 1;
+    globals.rafts.push_back(raft2);
+
+    Protocol::Raft::Heartbeat::Group* group = request.add_groups();
+    group->set_group_id(1);
+    group->set_term(2);
+    group->set_committed_id(1);
+    group->set_leader_committed_id(1);
+    response.add_terms(2);
+    peerService->reply(Protocol::Raft::OpCode::HEARTBEAT, request, response);
+    sender->sendRound(Clock::now());
+    EXPECT_EQ(1U, sender->outstanding.size());
+    waitForReplies();
+    EXPECT_EQ(raft2->currentEpoch, peer2->lastAckEpoch);
+}
+
+TEST_F(ServerHeartbeatSenderTest, checkReplies_rpcFailed)
+{
+    peerService->closeSession(Protocol::Raft::OpCode::HEARTBEAT, request);
+    // expect warning
+    LogCabin::Core::Debug::setLogPolicy({
+        {"Server/HeartbeatSender.cc", "ERROR"}
+    });
+    TimePoint start = Clock::now();
+    sender->sendRound(start);
+    waitForReplies();
+    EXPECT_LE(start + milliseconds(3000), peer->backoffUntil);
+    EXPECT_EQ(0U, peer->lastAckEpoch);
+}
+
+TEST_F(ServerHeartbeatSenderTest, wakeUp)
+{
+    sender->wakeUp();
+    EXPECT_TRUE(sender->wakeUpRequested);
+}
+
+} // namespace LogCabin::Server::<anonymous>
+} // namespace LogCabin::Server
+} // namespace LogCabin
@@ -21,6 +21,7 @@
 
 #include "Core/Debug.h"
 #include "Core/ThreadId.h"
+#include "Event/Loop.h"
 #include "Server/Globals.h"
 
 namespace {
@@ -35,15 +36,17 @@ class OptionParser {
         , argv(argv)
         , configFilename("logcabin.conf")
         , serverId(0)
+        , eventLoopBackend(LogCabin::Event::Loop::Backend::LIBEVENT)
     {
         while (true) {
             static struct option longOptions[] = {
                {"config",  required_argument, NULL, 'c'},
+               {"event-loop",  required_argument, NULL, 'e'},
                {"help",  no_argument, NULL, 'h'},
                {"id",  required_argument, NULL, 'i'},
                {0, 0, 0, 0}
             };
-            int c = getopt_long(argc, argv, "c:hi:", longOptions, NULL);
+            int c = getopt_long(argc, argv, "c:e:hi:", longOptions, NULL);
 
             // Detect the end of the options.
             if (c == -1)
@@ -56,6 +59,18 @@ class OptionParser {
                 case 'c':
                     configFilename = optarg;
                     break;
+                case 'e':
+                    if (std::string(optarg) == "libevent") {
+                        eventLoopBackend =
+                            LogCabin::Event::Loop::Backend::LIBEVENT;
+                    } else if (std::string(optarg) == "epoll") {
+                        eventLoopBackend =
+                            LogCabin::Event::Loop::Backend::EPOLL;
+                    } else {
+                        usage();
+                        exit(1);
+                    }
+                    break;
                 case 'i':
                     serverId = atol(optarg);
                     break;
@@ -82,6 +97,10 @@ class OptionParser {
         std::cout << "  -c, --config <file> "
                   << "Write output to <file> "
                   << "(default: logcabin.conf)" << std::endl;
+        std::cout << "  -e, --event-loop <backend> "
+                  << "Wait for events using <backend>, "
+                  << "libevent or epoll "
+                  << "(default: libevent)" << std::endl;
         std::cout << "  -i, --id <id>       "
                   << "Set server id to <id> "
                   << "(default: index of first bindable address + 1)"
@@ -92,6 +111,7 @@ class OptionParser {
     char**& argv;
     std::string configFilename;
     uint64_t serverId;
+    LogCabin::Event::Loop::Backend eventLoopBackend;
 };
 
 } // anonymous namespace
@@ -105,6 +125,9 @@ main(int argc, char** argv)
     // Parse command line args.
     OptionParser options(argc, argv);
     NOTICE("Using config file %s", options.configFilename.c_str());
+    // Globals constructs its Event::Loop right away, so this has to be set
+    // before then.
+    LogCabin::Event::Loop::defaultBackend = options.eventLoopBackend;
 
     // Initialize and run Globals.
     LogCabin::Server::Globals globals;
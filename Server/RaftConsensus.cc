@@ -14,15 +14,18 @@
  */
 
 #include <algorithm>
+#include <sstream>
 #include <string.h>
 #include <time.h>
 
+#include "build/Protocol/Client.pb.h"
 #include "build/Protocol/Raft.pb.h"
 #include "Core/Debug.h"
 #include "Core/ProtoBuf.h"
 #include "Core/Random.h"
 #include "Core/StringUtil.h"
 #include "Core/ThreadId.h"
+#include "Core/Trace.h"
 #include "Core/Util.h"
 #include "Protocol/Common.h"
 #include "RPC/Buffer.h"
@@ -32,7 +35,9 @@
 #include "RPC/ServerRPC.h"
 #include "Server/RaftConsensus.h"
 #include "Server/Globals.h"
+#include "Server/ServerStats.h"
 #include "Server/StateMachine.h"
+#include "Storage/LatencyModule.h"
 
 namespace LogCabin {
 namespace Server {
@@ -96,6 +101,9 @@ LocalServer::getLastAgreeId() const
 bool
 LocalServer::haveVote() const
 {
+    // A pre-candidate would vote for itself in the next term.
+    if (consensus.state == RaftConsensus::State::PRE_CANDIDATE)
+        return true;
     return (consensus.votedFor == serverId);
 }
 
@@ -117,11 +125,23 @@ Peer::Peer(uint64_t serverId, RaftConsensus& consensus)
     , lastAgreeId(0)
     , lastAckEpoch(0)
     , nextHeartbeatTime(TimePoint::min())
+    , heartbeatInFlight(false)
     , backoffUntil(TimePoint::min())
     , lastCatchUpIterationMs(~0UL)
     , thisCatchUpIterationStart(Clock::now())
     , thisCatchUpIterationGoalId(~0UL)
     , isCaughtUp_(false)
+    , lastAckTime(TimePoint::min())
+    , bulkCatchUp(false)
+    , batchBytes(0)
+    , minRTT(~0UL)
+    , smoothedRTT(0)
+    , bandwidth(0)
+    , appendEntryRTT()
+    , heartbeatRTT()
+    , lastRTT(0)
+    , bytesSent()
+    , heartbeatsSent()
     , session()
     , thread()
 {
@@ -145,6 +165,13 @@ Peer::beginRequestVote()
     requestVoteDone = false;
     haveVote_ = false;
     lastAgreeId = 0;
+    // If this election is won, announce the new leader right away rather
+    // than on the schedule of this server's previous term as leader.
+    nextHeartbeatTime = TimePoint::min();
+    // Each round gets one fresh try at every server, even one that failed
+    // recently: the candidate timer already spaces rounds out, and a server
+    // that was unreachable last round may be needed for a quorum this one.
+    backoffUntil = TimePoint::min();
 }
 
 void
@@ -181,7 +208,8 @@ Peer::isCaughtUp() const
 bool
 Peer::callRPC(Protocol::Raft::OpCode opCode,
         const google::protobuf::Message& request,
-        google::protobuf::Message& response)
+        google::protobuf::Message& response,
+        RPC::MessageSocket::Priority priority)
 {
     typedef RPC::ClientRPC::Status RPCStatus;
 
@@ -189,7 +217,13 @@ Peer::callRPC(Protocol::Raft::OpCode opCode,
                        Protocol::Common::ServiceId::RAFT_SERVICE,
                        /* serviceSpecificErrorVersion = */ 0,
                        opCode,
-                       request);
+                       request,
+                       /* traceId = */ 0,
+                       /* stream = */ false,
+                       priority);
+    // Constructing the ClientRPC serialized the request, so its size is
+    // already cached.
+    bytesSent.add(uint64_t(request.GetCachedSize()));
     switch (rpc.waitForReply(&response, NULL)) {
         case RPCStatus::OK:
             return true;
@@ -215,12 +249,8 @@ Peer::startThread(std::shared_ptr<Peer> self)
 std::shared_ptr<RPC::ClientSession>
 Peer::getSession()
 {
-    if (!session || !session->getErrorMessage().empty()) {
-        session = RPC::ClientSession::makeSession(
-            eventLoop,
-            RPC::Address(address, Protocol::Common::DEFAULT_PORT),
-            Protocol::Common::MAX_MESSAGE_LENGTH);
-    }
+    if (!session || !session->getErrorMessage().empty())
+        session = consensus.globals.getPeerSession(address);
     return session;
 }
 
@@ -309,6 +339,7 @@ Configuration::Configuration(uint64_t serverId, RaftConsensus& consensus)
     , description()
     , oldServers()
     , newServers()
+    , learners()
 {
     localServer.reset(new LocalServer(serverId, consensus));
     knownServers[serverId] = localServer;
@@ -336,6 +367,12 @@ Configuration::hasVote(std::shared_ptr<Server> server) const
     }
 }
 
+bool
+Configuration::isLearner(std::shared_ptr<Server> server) const
+{
+    return learners.contains(server);
+}
+
 bool
 Configuration::quorumAll(const Predicate& predicate) const
 {
@@ -391,6 +428,7 @@ Configuration::setConfiguration(
     description = newDescription;
     oldServers.servers.clear();
     newServers.servers.clear();
+    learners.servers.clear();
 
     // Build up the list of old servers
     for (auto confIt = description.prev_configuration().servers().begin();
@@ -410,10 +448,23 @@ Configuration::setConfiguration(
         newServers.servers.push_back(server);
     }
 
+    // Build up the list of learners. A voter that's being demoted to a
+    // learner keeps its vote until the transition completes.
+    for (auto confIt = description.learners().servers().begin();
+         confIt != description.learners().servers().end();
+         ++confIt) {
+        std::shared_ptr<Server> server = getServer(confIt->server_id());
+        if (oldServers.contains(server) || newServers.contains(server))
+            continue;
+        server->address = confIt->address();
+        learners.servers.push_back(server);
+    }
+
     // Servers not in the current configuration need to be told to exit
     setGCFlag(localServer);
     oldServers.forEach(setGCFlag);
     newServers.forEach(setGCFlag);
+    learners.forEach(setGCFlag);
     auto it = knownServers.begin();
     while (it != knownServers.end()) {
         std::shared_ptr<Server> server = it->second;
@@ -501,6 +552,19 @@ Configuration::getServer(uint64_t newServerId)
 
 ////////// RaftConsensus //////////
 
+namespace {
+/**
+ * The default for the invariantChecking setting. Checking every acquisition
+ * of the mutex is too slow for release builds, but it catches bugs closest to
+ * where they happen, so debug builds (and the unit tests) do it.
+ */
+#ifdef NDEBUG
+const char* DEFAULT_INVARIANT_CHECKING = "sampled";
+#else
+const char* DEFAULT_INVARIANT_CHECKING = "full";
+#endif
+} // anonymous namespace
+
 uint64_t RaftConsensus::FOLLOWER_TIMEOUT_MS = 150;
 
 uint64_t RaftConsensus::CANDIDATE_TIMEOUT_MS = 150;
@@ -513,9 +577,30 @@ uint64_t RaftConsensus::RPC_FAILURE_BACKOFF_MS = 2000;
 uint64_t RaftConsensus::SOFT_RPC_SIZE_LIMIT =
                 Protocol::Common::MAX_MESSAGE_LENGTH - 1024;
 
+RaftConsensus::Backpressure::Backpressure()
+    : replicationLagHigh(0)
+    , replicationLagLow(0)
+    , applyLagHigh(0)
+    , applyLagLow(0)
+    , throttled(false)
+    , throttleEvents()
+    , throttleWait()
+{
+}
+
+RaftConsensus::LeadershipTransfer::LeadershipTransfer()
+    : targetId(0)
+    , term(0)
+    , deadline(TimePoint::min())
+    , timeoutNowSent(false)
+{
+}
+
 RaftConsensus::RaftConsensus(Globals& globals)
-    : globals(globals)
-    , mutex()
+    : groupId(0)
+    , preferredLeader(false)
+    , globals(globals)
+    , mutex("RaftConsensus::mutex")
     , stateChanged()
     , exiting(false)
     , numPeerThreads(0)
@@ -529,6 +614,17 @@ RaftConsensus::RaftConsensus(Globals& globals)
     , votedFor(0)
     , currentEpoch(0)
     , startElectionAt(TimePoint::max())
+    , leaderCommitSeenAt(TimePoint::min())
+    , commitLatency()
+    , lastAppliedId(0)
+    , backpressure()
+    , leadershipTransfer()
+    , bulkCatchUpThreshold(1000)
+    , replicationBatchBytes(256 * 1024)
+    , replicationMinBatchBytes(16 * 1024)
+    , replicationMaxBytesInFlight(0)
+    , replicationTargetDelayMs(10)
+    , preVote(false)
     , candidacyThread()
     , stepDownThread()
     , invariants(*this)
@@ -551,12 +647,89 @@ void
 RaftConsensus::init()
 {
     std::unique_lock<Mutex> lockGuard(mutex);
-    mutex.callback = std::bind(&Invariants::checkAll, &invariants);
     NOTICE("My server ID is %lu", serverId);
+    if (groupId != 0)
+        NOTICE("Running Raft group %u", groupId);
+
+    const Core::Config& config = globals.config;
+    std::string invariantChecking =
+        config.read<std::string>("invariantChecking",
+                                 DEFAULT_INVARIANT_CHECKING);
+    Invariants::Mode invariantMode;
+    if (invariantChecking == "off") {
+        invariantMode = Invariants::Mode::OFF;
+    } else if (invariantChecking == "sampled") {
+        invariantMode = Invariants::Mode::SAMPLED;
+    } else if (invariantChecking == "full") {
+        invariantMode = Invariants::Mode::FULL;
+    } else {
+        PANIC("invariantChecking must be off, sampled, or full, not '%s'",
+              invariantChecking.c_str());
+    }
+    invariants.configure(
+        invariantMode,
+        config.read<uint64_t>("invariantSampleEvery", 1000),
+        config.read<uint64_t>("invariantSampleMilliseconds", 1000));
+    if (invariantMode != Invariants::Mode::OFF)
+        mutex.callback = std::bind(&Invariants::check, &invariants);
+    backpressure.replicationLagHigh =
+        config.read<uint64_t>("replicationLagHighWatermark", 0);
+    backpressure.replicationLagLow =
+        config.read<uint64_t>("replicationLagLowWatermark",
+                              backpressure.replicationLagHigh / 2);
+    backpressure.applyLagHigh =
+        config.read<uint64_t>("applyLagHighWatermark", 0);
+    backpressure.applyLagLow =
+        config.read<uint64_t>("applyLagLowWatermark",
+                              backpressure.applyLagHigh / 2);
+    if (backpressure.replicationLagLow > backpressure.replicationLagHigh ||
+        backpressure.applyLagLow > backpressure.applyLagHigh) {
+        PANIC("Low watermarks must not exceed high watermarks "
+              "(replication %lu/%lu, apply %lu/%lu)",
+              backpressure.replicationLagLow,
+              backpressure.replicationLagHigh,
+              backpressure.applyLagLow,
+              backpressure.applyLagHigh);
+    }
+    bulkCatchUpThreshold =
+        config.read<uint64_t>("bulkCatchUpThreshold", bulkCatchUpThreshold);
+    replicationBatchBytes =
+        config.read<uint64_t>("replicationBatchBytes", replicationBatchBytes);
+    replicationMinBatchBytes =
+        config.read<uint64_t>("replicationMinBatchBytes",
+                              replicationMinBatchBytes);
+    replicationMaxBytesInFlight =
+        config.read<uint64_t>("replicationMaxBytesInFlight",
+                              replicationMaxBytesInFlight);
+    replicationTargetDelayMs =
+        config.read<uint64_t>("replicationTargetDelayMs",
+                              replicationTargetDelayMs);
+    preVote = config.read<bool>("preVote", preVote);
+    if (replicationMaxBytesInFlight > 0 &&
+        replicationMinBatchBytes > replicationMaxBytesInFlight) {
+        PANIC("replicationMinBatchBytes (%lu) must not exceed "
+              "replicationMaxBytesInFlight (%lu)",
+              replicationMinBatchBytes,
+              replicationMaxBytesInFlight);
+    }
 
     if (!log) { // some unit tests pre-set the log; don't overwrite it
-        // TODO(ongaro): use configuration option instead of hard-coded string
-        log.reset(new Log(Core::StringUtil::format("log/%lu", serverId)));
+        std::string logPath =
+            globals.config.read<std::string>("raftLogPath", "log");
+        std::string path = Core::StringUtil::format("%s/%lu",
+                                                    logPath.c_str(),
+                                                    serverId);
+        if (groupId != 0)
+            path += Core::StringUtil::format(".%u", groupId);
+        std::unique_ptr<Storage::LatencyInjector> injector(
+            new Storage::LatencyInjector(globals.config, "raftLogLatency"));
+        if (injector->isEnabled()) {
+            NOTICE("Injecting Raft log latency: %s",
+                   injector->toString().c_str());
+            log.reset(new LatencyLog(path, std::move(injector)));
+        } else {
+            log.reset(new Log(path));
+        }
     }
     NOTICE("Last log ID: %lu", log->getLastLogId());
     if (log->metadata.has_current_term())
@@ -594,6 +767,7 @@ RaftConsensus::exit()
 RaftConsensus::ClientResult
 RaftConsensus::getConfiguration(
         Protocol::Raft::SimpleConfiguration& currentConfiguration,
+        Protocol::Raft::SimpleConfiguration& currentLearners,
         uint64_t& id) const
 {
     std::unique_lock<Mutex> lockGuard(mutex);
@@ -604,6 +778,7 @@ RaftConsensus::getConfiguration(
         return ClientResult::RETRY;
     }
     currentConfiguration = configuration->description.prev_configuration();
+    currentLearners = configuration->description.learners();
     id = configuration->id;
     return ClientResult::SUCCESS;
 }
@@ -618,10 +793,62 @@ RaftConsensus::getLastCommittedId() const
         return {ClientResult::SUCCESS, committedId};
 }
 
+std::pair<RaftConsensus::ClientResult, uint64_t>
+RaftConsensus::getFollowerReadId(uint64_t maxStalenessMs) const
+{
+    std::unique_lock<Mutex> lockGuard(mutex);
+    TimePoint now = Clock::now();
+
+    // Find the time as of which our state machine is known to be current.
+    TimePoint currentAsOf = leaderCommitSeenAt;
+    if (state == State::LEADER) {
+        // Nobody else could have committed anything before a quorum last
+        // acknowledged us. This saves the round of heartbeats that
+        // upToDateLeader() needs.
+        uint64_t ackedAt = configuration->quorumMin(
+            [now] (std::shared_ptr<Server> server) {
+                Peer* peer = dynamic_cast<Peer*>(server.get()); // NOLINT
+                TimePoint t = (peer == NULL ? now : peer->lastAckTime);
+                if (t == TimePoint::min())
+                    return uint64_t(0);
+                return uint64_t(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        t.time_since_epoch()).count());
+            });
+        currentAsOf = TimePoint::min();
+        if (ackedAt > 0) {
+            currentAsOf = TimePoint(
+                std::chrono::duration_cast<TimePoint::duration>(
+                    std::chrono::nanoseconds(ackedAt)));
+        }
+    }
+
+    uint64_t stalenessMs = ~0UL;
+    if (currentAsOf != TimePoint::min()) {
+        stalenessMs = 0;
+        if (now > currentAsOf) {
+            stalenessMs = uint64_t(
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    now - currentAsOf).count());
+        }
+    }
+    if (stalenessMs <= maxStalenessMs)
+        return {ClientResult::SUCCESS, committedId};
+    if (state == State::LEADER && upToDateLeader(lockGuard))
+        return {ClientResult::SUCCESS, committedId};
+    return {ClientResult::NOT_LEADER, 0};
+}
+
 Consensus::Entry
 RaftConsensus::getNextEntry(uint64_t lastEntryId) const
 {
     std::unique_lock<Mutex> lockGuard(mutex);
+    if (lastEntryId > lastAppliedId) {
+        lastAppliedId = lastEntryId;
+        // Client requests may be waiting for the state machine to catch up.
+        if (backpressure.throttled)
+            stateChanged.notify_all();
+    }
     uint64_t nextEntryId = lastEntryId + 1;
     while (true) {
         if (exiting)
@@ -668,7 +895,9 @@ RaftConsensus::handleAppendEntry(
         NOTICE("All hail leader %lu for term %lu", leaderId, currentTerm);
     }
     assert(leaderId == request.server_id());
-    assert(state == State::FOLLOWER);
+    // A pre-candidate that hears from its leader again goes back to following
+    // it below.
+    assert(state == State::FOLLOWER || state == State::PRE_CANDIDATE);
 
     // This request is a sign of life from the current leader. Reset our timer
     // so that we do not start a new election soon.
@@ -723,7 +952,7 @@ RaftConsensus::handleAppendEntry(
                 entry.configuration = it->configuration();
                 break;
             case Protocol::Raft::EntryType::DATA:
-                entry.data = it->data();
+                entry.data = Core::Payload(it->data());
                 break;
             default:
                 PANIC("bad entry type");
@@ -744,6 +973,13 @@ RaftConsensus::handleAppendEntry(
         VERBOSE("New committedId: %lu", committedId);
     }
 
+    // Once we have everything the leader knows to be committed, our state
+    // machine can serve follower reads for a while.
+    if (request.has_leader_committed_id() &&
+        committedId >= request.leader_committed_id()) {
+        sawLeaderCommit(request.leader_round_trip_us());
+    }
+
     response.set_term(currentTerm);
 }
 
@@ -754,6 +990,35 @@ RaftConsensus::handleRequestVote(
 {
     std::unique_lock<Mutex> lockGuard(mutex);
 
+    // If the caller has a less complete log, we can't give it our vote.
+    uint64_t lastLogId = log->getLastLogId();
+    uint64_t lastLogTerm = log->getTerm(lastLogId);
+    bool logIsOk = (request.last_log_term() > lastLogTerm ||
+                    (request.last_log_term() == lastLogTerm &&
+                     request.last_log_id() >= lastLogId));
+
+    if (request.pre_vote()) {
+        // Say whether we would vote for the caller if it started an election,
+        // without changing our term or vote. We also refuse while we believe
+        // a leader is alive, so that a server that was partitioned away can't
+        // depose it. Real RequestVotes don't get this check, so leadership
+        // transfers (TimeoutNow) still work.
+        bool leaderIsAlive = (state == State::LEADER ||
+                              (state == State::FOLLOWER && leaderId != 0 &&
+                               Clock::now() < startElectionAt));
+        bool granted = (request.term() > currentTerm && logIsOk &&
+                        !leaderIsAlive);
+        VERBOSE("%s pre-vote to %lu for term %lu",
+                granted ? "Granting" : "Refusing",
+                request.server_id(), request.term());
+        response.set_term(currentTerm);
+        response.set_granted(granted);
+        response.set_last_log_term(lastLogTerm);
+        response.set_last_log_id(lastLogId);
+        response.set_begin_last_term_id(log->getBeginLastTermId());
+        return;
+    }
+
     if (request.term() > currentTerm) {
         VERBOSE("Caller(%lu) has newer term, updating. "
                 "Ours was %lu, theirs is %lu",
@@ -769,13 +1034,6 @@ RaftConsensus::handleRequestVote(
     // However, this is just an optimization that does not affect correctness
     // or really even efficiency, so it's not worth the trouble.
 
-    // If the caller has a less complete log, we can't give it our vote.
-    uint64_t lastLogId = log->getLastLogId();
-    uint64_t lastLogTerm = log->getTerm(lastLogId);
-    bool logIsOk = (request.last_log_term() > lastLogTerm ||
-                    (request.last_log_term() == lastLogTerm &&
-                     request.last_log_id() >= lastLogId));
-
     if (request.term() == currentTerm && logIsOk && votedFor == 0) {
         // Give caller our vote
         VERBOSE("Voting for %lu in term %lu",
@@ -795,11 +1053,219 @@ RaftConsensus::handleRequestVote(
     response.set_begin_last_term_id(log->getBeginLastTermId());
 }
 
+void
+RaftConsensus::handleTimeoutNow(
+                    const Protocol::Raft::TimeoutNow::Request& request,
+                    Protocol::Raft::TimeoutNow::Response& response)
+{
+    std::unique_lock<Mutex> lockGuard(mutex);
+    assert(!exiting);
+
+    if (request.term() > currentTerm) {
+        VERBOSE("Caller(%lu) has newer term, updating. "
+                "Ours was %lu, theirs is %lu",
+                request.server_id(), currentTerm, request.term());
+        if (state == State::CANDIDATE) {
+            abortElection(request.term());
+        } else {
+            stepDown(request.term());
+        }
+    }
+
+    // The leader only sends this once our log matches its own, so we're
+    // likely to win, and we skip the pre-vote: the other servers would refuse
+    // it while they still hear from the leader. A stale request must be
+    // ignored, though, or a deposed leader could disrupt the cluster.
+    if (request.term() == currentTerm &&
+        (state == State::FOLLOWER || state == State::PRE_CANDIDATE)) {
+        NOTICE("Leader %lu is handing off leadership to us in term %lu",
+               request.server_id(), currentTerm);
+        startNewElection();
+    }
+    response.set_term(currentTerm);
+}
+
+uint64_t
+RaftConsensus::handleHeartbeat(uint64_t callerId,
+                               const Protocol::Raft::Heartbeat::Group& request)
+{
+    std::unique_lock<Mutex> lockGuard(mutex);
+    assert(!exiting);
+
+    // If the caller's term is stale, just return our term to it.
+    if (request.term() < currentTerm) {
+        VERBOSE("Caller(%lu) is stale. Our term is %lu, theirs is %lu",
+                 callerId, currentTerm, request.term());
+        return currentTerm;
+    }
+
+    // As with AppendEntry, the leader calls requestVote on this server
+    // before sending it heartbeats; thus, we should not see a new term here.
+    assert(request.term() == currentTerm);
+
+    // Record the leader ID as a hint for clients.
+    if (leaderId == 0) {
+        // Candidates must step down when they discover the current leader.
+        stepDown(currentTerm);
+        leaderId = callerId;
+        NOTICE("All hail leader %lu for term %lu", leaderId, currentTerm);
+    }
+    assert(leaderId == callerId);
+    assert(state == State::FOLLOWER || state == State::PRE_CANDIDATE);
+
+    // This request is a sign of life from the current leader. Reset our timer
+    // so that we do not start a new election soon.
+    stepDown(currentTerm);
+
+    // The leader only sends heartbeats once our log matches its own, so
+    // unlike handleAppendEntry(), there's no previous entry to check.
+    if (committedId < request.committed_id()) {
+        committedId = request.committed_id();
+        assert(committedId <= log->getLastLogId());
+        stateChanged.notify_all();
+        VERBOSE("New committedId: %lu", committedId);
+    }
+    if (committedId >= request.leader_committed_id())
+        sawLeaderCommit(request.leader_round_trip_us());
+
+    return currentTerm;
+}
+
+void
+RaftConsensus::collectHeartbeats(TimePoint roundTime,
+                                 HeartbeatSender::Batches& batches)
+{
+    std::unique_lock<Mutex> lockGuard(mutex);
+    if (exiting || state != State::LEADER)
+        return;
+    // A follower is included if it's due before the next round, which is
+    // half a heartbeat period away, so it never waits longer than a
+    // heartbeat period. Having been sent one, it's due two rounds later.
+    TimePoint nextRound =
+        roundTime + std::chrono::milliseconds(HEARTBEAT_PERIOD_MS / 2);
+    uint64_t lastLogId = log->getLastLogId();
+    configuration->forEach([&] (std::shared_ptr<Server> server) {
+        Peer* peer = dynamic_cast<Peer*>(server.get()); // NOLINT
+        if (peer == NULL ||
+            peer->exiting ||
+            !peer->requestVoteDone ||
+            peer->lastAgreeId != lastLogId ||
+            peer->backoffUntil > roundTime ||
+            peer->heartbeatInFlight ||
+            peer->nextHeartbeatTime >= nextRound) {
+            return;
+        }
+        HeartbeatSender::Batch& batch = batches[peer->serverId];
+        batch.address = peer->address;
+        batch.request.set_server_id(serverId);
+        Protocol::Raft::Heartbeat::Group& request =
+            *batch.request.add_groups();
+        if (groupId != 0)
+            request.set_group_id(groupId);
+        request.set_term(currentTerm);
+        request.set_committed_id(std::min(committedId, peer->lastAgreeId));
+        request.set_leader_committed_id(committedId);
+        batch.epochs.push_back(currentEpoch);
+        if (peer->lastRTT > 0)
+            request.set_leader_round_trip_us(peer->lastRTT);
+        peer->nextHeartbeatTime =
+            roundTime + std::chrono::milliseconds(HEARTBEAT_PERIOD_MS);
+        peer->heartbeatInFlight = true;
+        peer->heartbeatsSent.add();
+    });
+}
+
+void
+RaftConsensus::handleHeartbeatReply(
+        uint64_t peerId,
+        const Protocol::Raft::Heartbeat::Group& request,
+        uint64_t epoch,
+        TimePoint start,
+        bool ok,
+        uint64_t term)
+{
+    std::unique_lock<Mutex> lockGuard(mutex);
+    Peer* peer = NULL;
+    configuration->forEach([peerId, &peer] (std::shared_ptr<Server> server) {
+        if (server->serverId == peerId)
+            peer = dynamic_cast<Peer*>(server.get()); // NOLINT
+    });
+    // The next heartbeat may go out now, even if this reply is stale.
+    if (peer != NULL)
+        peer->heartbeatInFlight = false;
+    if (exiting || currentTerm != request.term()) {
+        // we don't care about result of RPC
+        return;
+    }
+    // Since we were leader in this term before, we must still be leader in
+    // this term.
+    assert(state == State::LEADER);
+    if (peer == NULL || peer->exiting)
+        return;
+    if (!ok) {
+        peer->backoffUntil = start +
+            std::chrono::milliseconds(RPC_FAILURE_BACKOFF_MS);
+        return;
+    }
+    peer->lastRTT = Core::Stats::microsSince(start);
+    peer->heartbeatRTT.record(peer->lastRTT);
+    if (term > currentTerm) {
+        stepDown(term);
+    } else {
+        assert(term == currentTerm);
+        // An AppendEntry request sent after this heartbeat may have been
+        // acknowledged already.
+        peer->lastAckEpoch = std::max(peer->lastAckEpoch, epoch);
+        peer->lastAckTime = std::max(peer->lastAckTime, start);
+        stateChanged.notify_all();
+    }
+}
+
+std::string
+RaftConsensus::getLeaderHint() const
+{
+    std::unique_lock<Mutex> lockGuard(mutex);
+    uint64_t hintId = leaderId;
+    // Between the old leader stepping down and hearing from the new one, the
+    // target of a leadership transfer is the best guess.
+    if (hintId == 0)
+        hintId = leadershipTransfer.targetId;
+    if (hintId == 0 || hintId == serverId || !configuration)
+        return "";
+    std::string address;
+    configuration->forEach([hintId, &address] (
+            std::shared_ptr<Server> server) {
+        if (server->serverId == hintId)
+            address = server->address;
+    });
+    return address;
+}
+
 std::pair<RaftConsensus::ClientResult, uint64_t>
-RaftConsensus::replicate(const std::string& operation)
+RaftConsensus::replicate(const Core::Payload& operation)
 {
     std::unique_lock<Mutex> lockGuard(mutex);
-    VERBOSE("replicate(%s)", operation.c_str());
+    VERBOSE("replicate(%lu bytes)", operation.size());
+    if (state == State::LEADER && isThrottled()) {
+        // Hold new requests back until the followers and the state machine
+        // catch up. This re-checks periodically, since followers that stop
+        // responding no longer count towards the replication lag.
+        uint64_t term = currentTerm;
+        TimePoint start = Clock::now();
+        while (!exiting && currentTerm == term && isThrottled()) {
+            stateChanged.wait_until(
+                lockGuard,
+                Clock::now() + std::chrono::milliseconds(HEARTBEAT_PERIOD_MS));
+        }
+        backpressure.throttleWait.recordMicrosSince(start);
+    }
+    // Hold new requests back while leadership is being handed off, so that
+    // the target can catch up. Once it takes over, they fail with NOT_LEADER.
+    while (!exiting &&
+           leadershipTransfer.targetId != 0 &&
+           leadershipTransfer.term == currentTerm) {
+        stateChanged.wait(lockGuard);
+    }
     Log::Entry entry;
     entry.type = Protocol::Raft::EntryType::DATA;
     entry.data = operation;
@@ -809,7 +1275,8 @@ RaftConsensus::replicate(const std::string& operation)
 RaftConsensus::ClientResult
 RaftConsensus::setConfiguration(
         uint64_t oldId,
-        const Protocol::Raft::SimpleConfiguration& nextConfiguration)
+        const Protocol::Raft::SimpleConfiguration& nextConfiguration,
+        const Protocol::Raft::SimpleConfiguration* nextLearners)
 {
     std::unique_lock<Mutex> lockGuard(mutex);
 
@@ -854,11 +1321,29 @@ RaftConsensus::setConfiguration(
         stateChanged.wait_until(lockGuard, checkProgressAt);
     }
 
-    // Write and commit transitional configuration
+    // Write and commit transitional configuration. Learners aren't staged:
+    // they don't count toward any quorum, so they can catch up afterwards.
+    // Any learner that's now listed as a voter is promoted.
     Protocol::Raft::Configuration newConfiguration;
     *newConfiguration.mutable_prev_configuration() =
         configuration->description.prev_configuration();
     *newConfiguration.mutable_next_configuration() = nextConfiguration;
+    const Protocol::Raft::SimpleConfiguration& learners =
+        (nextLearners != NULL ? *nextLearners
+                              : configuration->description.learners());
+    for (auto it = learners.servers().begin();
+         it != learners.servers().end();
+         ++it) {
+        bool voter = false;
+        for (auto it2 = nextConfiguration.servers().begin();
+             it2 != nextConfiguration.servers().end();
+             ++it2) {
+            if (it2->server_id() == it->server_id())
+                voter = true;
+        }
+        if (!voter)
+            *newConfiguration.mutable_learners()->add_servers() = *it;
+    }
     Log::Entry entry;
     entry.type = Protocol::Raft::EntryType::CONFIGURATION;
     entry.configuration = newConfiguration;
@@ -884,6 +1369,155 @@ RaftConsensus::setConfiguration(
     }
 }
 
+RaftConsensus::ClientResult
+RaftConsensus::transferLeadership(uint64_t serverId,
+                                  uint64_t& newLeaderId,
+                                  std::string& reason)
+{
+    std::unique_lock<Mutex> lockGuard(mutex);
+    newLeaderId = 0;
+    if (state != State::LEADER)
+        return ClientResult::NOT_LEADER;
+    if (leadershipTransfer.targetId != 0) {
+        reason = Core::StringUtil::format(
+            "A transfer to server %lu is already in progress",
+            leadershipTransfer.targetId);
+        return ClientResult::FAIL;
+    }
+    if (configuration->state != Configuration::State::STABLE) {
+        reason = "A configuration change is in progress";
+        return ClientResult::FAIL;
+    }
+
+    // Choose the target: the given server, or the voting server with the
+    // longest matching log, which needs the least catching up.
+    Peer* target = NULL;
+    configuration->forEach([this, serverId, &target] (
+            std::shared_ptr<Server> server) {
+        Peer* peer = dynamic_cast<Peer*>(server.get()); // NOLINT
+        if (peer == NULL || !configuration->hasVote(server))
+            return;
+        if (serverId != 0) {
+            if (peer->serverId == serverId)
+                target = peer;
+        } else if (target == NULL || peer->lastAgreeId > target->lastAgreeId) {
+            target = peer;
+        }
+    });
+    if (target == NULL) {
+        if (serverId == 0)
+            reason = "There are no other voting servers";
+        else
+            reason = Core::StringUtil::format(
+                "Server %lu is not a voting server in the configuration",
+                serverId);
+        return ClientResult::FAIL;
+    }
+
+    // The follower thread for the target sends it a TimeoutNow RPC once its
+    // log is up to date (see followerThreadMain).
+    uint64_t term = currentTerm;
+    NOTICE("Transferring leadership to server %lu in term %lu",
+           target->serverId, term);
+    leadershipTransfer.targetId = target->serverId;
+    leadershipTransfer.term = term;
+    leadershipTransfer.deadline =
+        Clock::now() + std::chrono::milliseconds(FOLLOWER_TIMEOUT_MS);
+    leadershipTransfer.timeoutNowSent = false;
+    stateChanged.notify_all();
+
+    // Wait to step down and to hear from the new leader.
+    while (!exiting && Clock::now() < leadershipTransfer.deadline) {
+        if (currentTerm != term && leaderId != 0)
+            break;
+        stateChanged.wait_until(lockGuard, leadershipTransfer.deadline);
+    }
+    ClientResult result;
+    if (currentTerm == term) {
+        NOTICE("Server %lu did not take over leadership in time, remaining "
+               "leader", leadershipTransfer.targetId);
+        reason = Core::StringUtil::format(
+            "Server %lu did not win an election within %lu ms",
+            leadershipTransfer.targetId, FOLLOWER_TIMEOUT_MS);
+        result = ClientResult::FAIL;
+    } else {
+        newLeaderId = leaderId;
+        result = ClientResult::SUCCESS;
+    }
+    leadershipTransfer.targetId = 0;
+    stateChanged.notify_all();
+    return result;
+}
+
+void
+RaftConsensus::updateServerStats(
+        Protocol::Client::ServerStats& serverStats) const
+{
+    std::unique_lock<Mutex> lockGuard(mutex);
+    serverStats.set_server_id(serverId);
+    serverStats.set_current_term(currentTerm);
+    std::ostringstream stateStr;
+    stateStr << state;
+    serverStats.set_state(stateStr.str());
+    serverStats.set_leader_id(leaderId);
+    serverStats.set_committed_id(committedId);
+    ServerStats::setHistogram(commitLatency.getSnapshot(),
+                              *serverStats.mutable_commit_latency());
+
+    Protocol::Client::ServerStats::Log& logStats =
+        *serverStats.mutable_log();
+    logStats.set_num_entries(log->getLastLogId());
+    logStats.set_bytes(log->getDataBytes());
+    ServerStats::setHistogram(log->writeLatency.getSnapshot(),
+                              *logStats.mutable_write_latency());
+
+    Protocol::Client::ServerStats::Backpressure& backpressureStats =
+        *serverStats.mutable_backpressure();
+    backpressureStats.set_throttled(backpressure.throttled);
+    backpressureStats.set_replication_lag(
+        state == State::LEADER && configuration ? getReplicationLag() : 0);
+    backpressureStats.set_throttle_events(backpressure.throttleEvents.get());
+    ServerStats::setHistogram(backpressure.throttleWait.getSnapshot(),
+                              *backpressureStats.mutable_throttle_wait());
+
+    invariants.updateServerStats(serverStats);
+
+    if (!configuration)
+        return;
+    bool leader = (state == State::LEADER);
+    uint64_t lastLogId = log->getLastLogId();
+    const Configuration& config = *configuration;
+    configuration->forEach([&serverStats, &config, leader, lastLogId] (
+            std::shared_ptr<Server> server) {
+        Peer* peer = dynamic_cast<Peer*>(server.get()); // NOLINT
+        if (peer == NULL)
+            return;
+        Protocol::Client::ServerStats::Peer& peerStats =
+            *serverStats.add_peers();
+        peerStats.set_server_id(peer->serverId);
+        peerStats.set_address(peer->address);
+        peerStats.set_last_agree_id(peer->lastAgreeId);
+        ServerStats::setHistogram(peer->appendEntryRTT.getSnapshot(),
+                                  *peerStats.mutable_append_entry_rtt());
+        ServerStats::setHistogram(peer->heartbeatRTT.getSnapshot(),
+                                  *peerStats.mutable_heartbeat_rtt());
+        peerStats.set_bytes_sent(peer->bytesSent.get());
+        peerStats.set_heartbeats_sent(peer->heartbeatsSent.get());
+        peerStats.set_learner(config.isLearner(server));
+        if (leader) {
+            peerStats.set_lag(lastLogId -
+                              std::min(peer->lastAgreeId, lastLogId));
+            peerStats.set_bulk_catch_up(peer->bulkCatchUp);
+            peerStats.set_batch_bytes(peer->batchBytes);
+            if (peer->minRTT != ~0UL) {
+                peerStats.set_min_rtt(peer->minRTT);
+                peerStats.set_smoothed_rtt(peer->smoothedRTT);
+                peerStats.set_bandwidth(peer->bandwidth);
+            }
+        }
+    });
+}
+
 std::ostream&
 operator<<(std::ostream& os, const RaftConsensus& raft)
 {
@@ -902,6 +1536,7 @@ operator<<(std::ostream& os, const RaftConsensus& raft)
                 os << "given to " << raft.votedFor;
             os << std::endl;
             break;
+        case State::PRE_CANDIDATE:
         case State::CANDIDATE:
             break;
         case State::LEADER: {
@@ -920,8 +1555,12 @@ RaftConsensus::candidacyThreadMain()
     std::unique_lock<Mutex> lockGuard(mutex);
     Core::ThreadId::setName("startNewElection");
     while (!exiting) {
-        if (Clock::now() >= startElectionAt)
-            startNewElection();
+        if (Clock::now() >= startElectionAt) {
+            if (preVote)
+                startPreVote();
+            else
+                startNewElection();
+        }
         stateChanged.wait_until(lockGuard, startElectionAt);
     }
 }
@@ -948,6 +1587,14 @@ RaftConsensus::followerThreadMain(std::shared_ptr<Peer> peer)
                     waitUntil = TimePoint::max();
                     break;
 
+                // Pre-candidates ask whether they could get votes.
+                case State::PRE_CANDIDATE:
+                    if (!peer->requestVoteDone)
+                        requestPreVote(lockGuard, *peer);
+                    else
+                        waitUntil = TimePoint::max();
+                    break;
+
                 // Candidates request votes.
                 case State::CANDIDATE:
                     if (!peer->requestVoteDone)
@@ -962,7 +1609,17 @@ RaftConsensus::followerThreadMain(std::shared_ptr<Peer> peer)
                     if (!peer->requestVoteDone) {
                         requestVote(lockGuard, *peer);
                     } else {
-                        if (peer->lastAgreeId == log->getLastLogId() &&
+                        if (leadershipTransfer.targetId == peer->serverId &&
+                            leadershipTransfer.term == currentTerm &&
+                            !leadershipTransfer.timeoutNowSent &&
+                            peer->lastAgreeId == log->getLastLogId()) {
+                            timeoutNow(lockGuard, *peer);
+                        } else if (peer->lastAgreeId == log->getLastLogId() &&
+                                   globals.heartbeatSender) {
+                            // The HeartbeatSender sends this follower's
+                            // heartbeats; see collectHeartbeats().
+                            waitUntil = TimePoint::max();
+                        } else if (peer->lastAgreeId == log->getLastLogId() &&
                             now < peer->nextHeartbeatTime) {
                             waitUntil = peer->nextHeartbeatTime;
                         } else {
@@ -1081,6 +1738,10 @@ RaftConsensus::advanceCommittedId()
             entry.type = Protocol::Raft::EntryType::CONFIGURATION;
             *entry.configuration.mutable_prev_configuration() =
                 configuration->description.next_configuration();
+            if (configuration->description.has_learners()) {
+                *entry.configuration.mutable_learners() =
+                    configuration->description.learners();
+            }
             append(entry);
             advanceCommittedId();
             return;
@@ -1106,13 +1767,32 @@ RaftConsensus::appendEntry(std::unique_lock<Mutex>& lockGuard,
     // Build up request
     Protocol::Raft::AppendEntry::Request request;
     request.set_server_id(serverId);
+    // Group 0 is left implicit: it's the only group in most clusters.
+    if (groupId != 0)
+        request.set_group_id(groupId);
     request.set_term(currentTerm);
     uint64_t lastLogId = log->getLastLogId();
     uint64_t prevLogId = peer.lastAgreeId;
     request.set_prev_log_term(log->getTerm(prevLogId));
     request.set_prev_log_id(prevLogId);
+    // Followers that are far behind get requests as large as possible, so
+    // they catch up in fewer round trips.
+    if (bulkCatchUpThreshold > 0) {
+        uint64_t lag = lastLogId - std::min(prevLogId, lastLogId);
+        if (!peer.bulkCatchUp && lag >= bulkCatchUpThreshold) {
+            NOTICE("Server %lu is %lu entries behind, switching it to bulk "
+                   "catch-up mode", peer.serverId, lag);
+            peer.bulkCatchUp = true;
+        } else if (peer.bulkCatchUp && lag < bulkCatchUpThreshold / 2) {
+            NOTICE("Server %lu is %lu entries behind, switching it back from "
+                   "bulk catch-up mode", peer.serverId, lag);
+            peer.bulkCatchUp = false;
+        }
+    }
+    uint64_t sizeLimit = getBatchLimit(peer);
     // Add entries
     uint64_t numEntries = 0;
+    bool full = false;
     for (uint64_t entryId = prevLogId + 1; entryId <= lastLogId; ++entryId) {
         const Log::Entry& entry = log->getEntry(entryId);
         Protocol::Raft::Entry* e = request.add_entries();
@@ -1123,23 +1803,31 @@ RaftConsensus::appendEntry(std::unique_lock<Mutex>& lockGuard,
                 *e->mutable_configuration() = entry.configuration;
                 break;
             case Protocol::Raft::EntryType::DATA:
-                e->set_data(entry.data);
+                e->set_data(entry.data.data(), entry.data.size());
                 break;
             default:
                 PANIC("bad entry type");
         }
         uint64_t requestSize =
             Core::Util::downCast<uint64_t>(request.ByteSize());
-        if (requestSize < SOFT_RPC_SIZE_LIMIT || numEntries == 0) {
+        if (requestSize < sizeLimit || numEntries == 0) {
             // this entry fits, send it
             VERBOSE("sending entry <id=%lu,term=%lu>", entryId, entry.term);
             ++numEntries;
         } else {
-            // this entry doesn't fit, discard it
+            // this entry doesn't fit, discard it and leave the rest for the
+            // next request
             request.mutable_entries()->RemoveLast();
+            full = true;
+            break;
         }
     }
     request.set_committed_id(std::min(committedId, prevLogId + numEntries));
+    request.set_leader_committed_id(committedId);
+    if (peer.lastRTT > 0)
+        request.set_leader_round_trip_us(peer.lastRTT);
+    if (numEntries == 0)
+        peer.heartbeatsSent.add();
 
     // Execute RPC
     Protocol::Raft::AppendEntry::Response response;
@@ -1147,11 +1835,21 @@ RaftConsensus::appendEntry(std::unique_lock<Mutex>& lockGuard,
     uint64_t epoch = currentEpoch;
     lockGuard.unlock();
     bool ok = peer.callRPC(Protocol::Raft::OpCode::APPEND_ENTRY,
-                           request, response);
+                           request, response,
+                           numEntries == 0
+                               ? RPC::MessageSocket::Priority::CONTROL
+                               : RPC::MessageSocket::Priority::NORMAL);
+    uint64_t rttMicros = Core::Stats::microsSince(start);
+    if (ok)
+        peer.appendEntryRTT.record(rttMicros);
     lockGuard.lock();
     if (!ok) {
         peer.backoffUntil = start +
             std::chrono::milliseconds(RPC_FAILURE_BACKOFF_MS);
+        if (peer.batchBytes > 0) {
+            peer.batchBytes = std::max(replicationMinBatchBytes,
+                                       peer.batchBytes / 2);
+        }
         return;
     }
 
@@ -1169,10 +1867,21 @@ RaftConsensus::appendEntry(std::unique_lock<Mutex>& lockGuard,
     } else {
         assert(response.term() == currentTerm);
         peer.lastAckEpoch = epoch;
+        peer.lastAckTime = start;
+        peer.lastRTT = rttMicros;
         stateChanged.notify_all();
+        // Any acknowledged request, with or without entries, resets the
+        // follower's election timer, so heartbeats are only sent once
+        // replication has been idle for a heartbeat period.
         peer.nextHeartbeatTime = start +
             std::chrono::milliseconds(HEARTBEAT_PERIOD_MS);
         peer.lastAgreeId += numEntries;
+        if (numEntries > 0) {
+            updateFlowControl(peer,
+                              Core::Util::downCast<uint64_t>(
+                                  request.GetCachedSize()),
+                              full, rttMicros);
+        }
         advanceCommittedId();
 
         if (!peer.isCaughtUp_ &&
@@ -1205,6 +1914,9 @@ RaftConsensus::becomeLeader()
     startElectionAt = TimePoint::max();
     advanceCommittedId();
     stateChanged.notify_all();
+    // Announce the new leader right away rather than at the next round.
+    if (globals.heartbeatSender)
+        globals.heartbeatSender->wakeUp();
 }
 
 void
@@ -1215,6 +1927,119 @@ RaftConsensus::interruptAll()
     // objects aren't presently thread-safe
 }
 
+uint64_t
+RaftConsensus::getReplicationLag() const
+{
+    assert(state == State::LEADER);
+    uint64_t lastLogId = log->getLastLogId();
+    TimePoint responsiveSince =
+        Clock::now() - std::chrono::milliseconds(FOLLOWER_TIMEOUT_MS);
+    uint64_t lag = 0;
+    configuration->forEach([&] (std::shared_ptr<Server> server) {
+        Peer* peer = dynamic_cast<Peer*>(server.get()); // NOLINT
+        if (peer == NULL ||
+            peer->bulkCatchUp ||
+            peer->lastAckTime < responsiveSince) {
+            return;
+        }
+        lag = std::max(lag,
+                       lastLogId - std::min(peer->lastAgreeId, lastLogId));
+    });
+    return lag;
+}
+
+uint64_t
+RaftConsensus::getBatchLimit(Peer& peer)
+{
+    assert(state == State::LEADER);
+    uint64_t maxBytes = SOFT_RPC_SIZE_LIMIT;
+    if (replicationMaxBytesInFlight > 0)
+        maxBytes = std::min(maxBytes, replicationMaxBytesInFlight);
+    if (peer.bulkCatchUp)
+        return maxBytes;
+    if (peer.batchBytes == 0)
+        peer.batchBytes = replicationBatchBytes;
+    peer.batchBytes = std::max(peer.batchBytes, replicationMinBatchBytes);
+    peer.batchBytes = std::min(peer.batchBytes, maxBytes);
+    return peer.batchBytes;
+}
+
+void
+RaftConsensus::updateFlowControl(Peer& peer, uint64_t requestBytes, bool full,
+                                 uint64_t rttMicros)
+{
+    if (peer.minRTT == ~0UL) {
+        peer.smoothedRTT = rttMicros;
+        if (rttMicros > 0)
+            peer.bandwidth = requestBytes * 1000000 / rttMicros;
+    } else {
+        peer.smoothedRTT = (peer.smoothedRTT * 7 + rttMicros) / 8;
+        if (rttMicros > 0) {
+            peer.bandwidth = (peer.bandwidth * 7 +
+                              requestBytes * 1000000 / rttMicros) / 8;
+        }
+    }
+    peer.minRTT = std::min(peer.minRTT, rttMicros);
+
+    // Bulk catch-up requests aren't limited by batchBytes, so they say
+    // nothing about whether it's the right size.
+    if (peer.bulkCatchUp || peer.batchBytes == 0)
+        return;
+    uint64_t oldBatchBytes = peer.batchBytes;
+    if (rttMicros > peer.minRTT + replicationTargetDelayMs * 1000) {
+        // Replies are slowing down: the follower or the network is queuing.
+        peer.batchBytes /= 2;
+    } else if (full) {
+        // Replies are prompt and there's more to send: send more at once.
+        peer.batchBytes *= 2;
+    }
+    getBatchLimit(peer); // clamp
+    if (peer.batchBytes != oldBatchBytes) {
+        VERBOSE("Batch size for server %lu is now %lu bytes (RTT %lu us, "
+                "min %lu us)", peer.serverId, peer.batchBytes,
+                rttMicros, peer.minRTT);
+    }
+}
+
+uint64_t
+RaftConsensus::getApplyLag() const
+{
+    if (committedId <= lastAppliedId)
+        return 0;
+    return committedId - lastAppliedId;
+}
+
+bool
+RaftConsensus::isThrottled()
+{
+    assert(state == State::LEADER);
+    uint64_t replicationLag = 0;
+    if (backpressure.replicationLagHigh > 0)
+        replicationLag = getReplicationLag();
+    uint64_t applyLag = 0;
+    if (backpressure.applyLagHigh > 0)
+        applyLag = getApplyLag();
+    if (!backpressure.throttled) {
+        if ((backpressure.replicationLagHigh > 0 &&
+             replicationLag > backpressure.replicationLagHigh) ||
+            (backpressure.applyLagHigh > 0 &&
+             applyLag > backpressure.applyLagHigh)) {
+            NOTICE("Throttling client requests: replication lag %lu, "
+                   "apply lag %lu", replicationLag, applyLag);
+            backpressure.throttled = true;
+            backpressure.throttleEvents.add();
+        }
+    } else {
+        if (replicationLag <= backpressure.replicationLagLow &&
+            applyLag <= backpressure.applyLagLow) {
+            NOTICE("No longer throttling client requests: replication lag "
+                   "%lu, apply lag %lu", replicationLag, applyLag);
+            backpressure.throttled = false;
+        }
+    }
+    return backpressure.throttled;
+}
+
 bool
 RaftConsensus::isLeaderReady() const
 {
@@ -1231,11 +2056,17 @@ RaftConsensus::replicateEntry(Log::Entry& entry,
         if (!isLeaderReady())
             return {ClientResult::RETRY, 0};
         entry.term = currentTerm;
+        TimePoint start = Clock::now();
         uint64_t entryId = append(entry);
+        uint64_t traceId = Core::Trace::getCurrentTraceId();
+        Core::Trace::record(traceId, Core::Trace::Stage::APPEND);
+        Core::Trace::setEntryId(traceId, entryId);
         advanceCommittedId();
         while (!exiting && currentTerm == entry.term) {
             if (committedId >= entryId) {
                 VERBOSE("replicate succeeded");
+                commitLatency.recordMicrosSince(start);
+                Core::Trace::record(traceId, Core::Trace::Stage::COMMIT);
                 return {ClientResult::SUCCESS, entryId};
             }
             stateChanged.wait(lockGuard);
@@ -1249,6 +2080,8 @@ RaftConsensus::requestVote(std::unique_lock<Mutex>& lockGuard, Peer& peer)
 {
     Protocol::Raft::RequestVote::Request request;
     request.set_server_id(serverId);
+    if (groupId != 0)
+        request.set_group_id(groupId);
     request.set_term(currentTerm);
     request.set_last_log_term(log->getTerm(log->getLastLogId()));
     request.set_last_log_id(log->getLastLogId());
@@ -1269,7 +2102,7 @@ RaftConsensus::requestVote(std::unique_lock<Mutex>& lockGuard, Peer& peer)
     }
 
     if (currentTerm != request.term() || state == State::FOLLOWER ||
-        peer.exiting) {
+        state == State::PRE_CANDIDATE || peer.exiting) {
         VERBOSE("ignore RPC result");
         // we don't care about result of RPC
         return;
@@ -1318,6 +2151,103 @@ RaftConsensus::requestVote(std::unique_lock<Mutex>& lockGuard, Peer& peer)
     }
 }
 
+void
+RaftConsensus::requestPreVote(std::unique_lock<Mutex>& lockGuard, Peer& peer)
+{
+    Protocol::Raft::RequestVote::Request request;
+    request.set_server_id(serverId);
+    if (groupId != 0)
+        request.set_group_id(groupId);
+    request.set_term(currentTerm + 1);
+    request.set_last_log_term(log->getTerm(log->getLastLogId()));
+    request.set_last_log_id(log->getLastLogId());
+    request.set_pre_vote(true);
+    uint64_t attempt = electionAttempt;
+
+    Protocol::Raft::RequestVote::Response response;
+    TimePoint start = Clock::now();
+    lockGuard.unlock();
+    bool ok = peer.callRPC(Protocol::Raft::OpCode::REQUEST_VOTE,
+                           request, response);
+    lockGuard.lock();
+    if (!ok) {
+        peer.backoffUntil = start +
+            std::chrono::milliseconds(RPC_FAILURE_BACKOFF_MS);
+        return;
+    }
+
+    if (currentTerm + 1 != request.term() ||
+        state != State::PRE_CANDIDATE ||
+        electionAttempt != attempt ||
+        peer.exiting) {
+        VERBOSE("ignore RPC result");
+        // we don't care about result of RPC
+        return;
+    }
+
+    if (response.term() > currentTerm) {
+        // Adopting a newer term we've learned about doesn't disrupt anyone.
+        stepDown(response.term());
+        return;
+    }
+
+    peer.requestVoteDone = true;
+    stateChanged.notify_all();
+    if (response.granted()) {
+        peer.haveVote_ = true;
+        VERBOSE("Got pre-vote for term %lu", currentTerm + 1);
+        if (configuration->quorumAll(&Server::haveVote))
+            startNewElection();
+    } else {
+        VERBOSE("pre-vote not granted");
+    }
+}
+
+void
+RaftConsensus::timeoutNow(std::unique_lock<Mutex>& lockGuard, Peer& peer)
+{
+    Protocol::Raft::TimeoutNow::Request request;
+    request.set_server_id(serverId);
+    if (groupId != 0)
+        request.set_group_id(groupId);
+    request.set_term(currentTerm);
+    leadershipTransfer.timeoutNowSent = true;
+
+    Protocol::Raft::TimeoutNow::Response response;
+    TimePoint start = Clock::now();
+    lockGuard.unlock();
+    bool ok = peer.callRPC(Protocol::Raft::OpCode::TIMEOUT_NOW,
+                           request, response);
+    lockGuard.lock();
+    if (!ok) {
+        peer.backoffUntil = start +
+            std::chrono::milliseconds(RPC_FAILURE_BACKOFF_MS);
+        // try again if the transfer is still on
+        if (leadershipTransfer.targetId == peer.serverId &&
+            leadershipTransfer.term == request.term()) {
+            leadershipTransfer.timeoutNowSent = false;
+        }
+        return;
+    }
+
+    if (currentTerm != request.term() || peer.exiting) {
+        // we don't care about result of RPC
+        return;
+    }
+    // The target started an election, so its term is probably ahead of ours
+    // now; stepping down early saves waiting for its RequestVote.
+    if (response.term() > currentTerm)
+        stepDown(response.term());
+}
+
+void
+RaftConsensus::sawLeaderCommit(uint64_t roundTripMicros)
+{
+    TimePoint sentAt = (Clock::now() -
+                        std::chrono::microseconds(roundTripMicros));
+    leaderCommitSeenAt = std::max(leaderCommitSeenAt, sentAt);
+}
+
 void
 RaftConsensus::scanForConfiguration()
 {
@@ -1335,9 +2265,18 @@ RaftConsensus::scanForConfiguration()
 void
 RaftConsensus::setFollowerTimer()
 {
-    uint64_t ms = Core::Random::randomRange(
+    uint64_t ms;
+    if (preferredLeader) {
+        // Still well after the next heartbeat is due, but ahead of the
+        // other servers' timers.
+        ms = Core::Random::randomRange(
+                            uint64_t(double(FOLLOWER_TIMEOUT_MS) * 0.75),
+                            FOLLOWER_TIMEOUT_MS);
+    } else {
+        ms = Core::Random::randomRange(
                             FOLLOWER_TIMEOUT_MS,
                             uint64_t(double(FOLLOWER_TIMEOUT_MS) * 1.25));
+    }
     VERBOSE("Will become candidate in %lu ms", ms);
     startElectionAt = Clock::now() + std::chrono::milliseconds(ms);
     stateChanged.notify_all();
@@ -1374,11 +2313,12 @@ void
 RaftConsensus::startNewElection()
 {
     if (!configuration->hasVote(configuration->localServer)) {
-        // Don't have a configuration or not part of the current configuration:
-        // go back to sleep.
+        // Don't have a configuration, not part of the current configuration,
+        // or only a learner: go back to sleep.
+        setFollowerTimer();
         return;
     }
-    if (electionAttempt == 0) {
+    if (electionAttempt == 0 || state == State::PRE_CANDIDATE) {
         // too verbose otherwise when server is partitioned
         NOTICE("Running for election in term %lu", currentTerm + 1);
     }
@@ -1397,6 +2337,31 @@ RaftConsensus::startNewElection()
         becomeLeader();
 }
 
+void
+RaftConsensus::startPreVote()
+{
+    if (!configuration->hasVote(configuration->localServer)) {
+        // Don't have a configuration, not part of the current configuration,
+        // or only a learner: go back to sleep.
+        setFollowerTimer();
+        return;
+    }
+    if (electionAttempt == 0) {
+        // too verbose otherwise when server is partitioned
+        NOTICE("Checking whether an election in term %lu could succeed",
+               currentTerm + 1);
+    }
+    state = State::PRE_CANDIDATE;
+    ++electionAttempt;
+    setCandidateTimer(electionAttempt);
+    configuration->forEach(&Server::beginRequestVote);
+    interruptAll();
+
+    // if we're the only server, we already know we'd win
+    if (configuration->quorumAll(&Server::haveVote))
+        startNewElection();
+}
+
 void
 RaftConsensus::stepDown(uint64_t newTerm)
 {
@@ -1470,6 +2435,9 @@ operator<<(std::ostream& os, RaftConsensus::State state)
         case State::FOLLOWER:
             os << "State::FOLLOWER";
             break;
+        case State::PRE_CANDIDATE:
+            os << "State::PRE_CANDIDATE";
+            break;
         case State::CANDIDATE:
             os << "State::CANDIDATE";
             break;
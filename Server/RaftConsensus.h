@@ -22,7 +22,10 @@
 #include "build/Protocol/Raft.pb.h"
 #include "Core/Mutex.h"
 #include "Core/ConditionVariable.h"
+#include "Core/Stats.h"
 #include "Core/Time.h"
+#include "RPC/MessageSocket.h"
+#include "Server/HeartbeatSender.h"
 #include "Server/RaftLog.h"
 #include "Server/Consensus.h"
 
@@ -35,6 +38,11 @@ namespace LogCabin {
 namespace Event {
 class Loop;
 }
+namespace Protocol {
+namespace Client {
+class ServerStats;
+}
+}
 namespace RPC {
 class ClientRPC;
 class ClientSession;
@@ -50,21 +58,140 @@ namespace RaftConsensusInternal {
 // forward declaration
 class RaftConsensus;
 
+/**
+ * Checks that a RaftConsensus's state makes sense. RaftConsensus calls
+ * check() every time its mutex is acquired and just before it's released.
+ * Each false invariant is logged as a warning and counted.
+ */
 class Invariants {
   public:
+    /**
+     * How often check() actually checks. See the invariantChecking setting.
+     */
+    enum class Mode {
+        /// Never.
+        OFF,
+        /// Every so many acquisitions of the mutex or milliseconds.
+        SAMPLED,
+        /// Every time.
+        FULL,
+    };
+
     explicit Invariants(RaftConsensus&);
     ~Invariants();
+
+    /**
+     * Set how often check() checks.
+     * \param mode
+     *      See Mode.
+     * \param sampleEvery
+     *      In SAMPLED mode, check after this many calls to check(), or 0 to
+     *      not sample by count.
+     * \param sampleMs
+     *      In SAMPLED mode, check once this many milliseconds have passed
+     *      since the last check, or 0 to not sample by time. To keep reading
+     *      the clock off of the mutex's fast path, this is only noticed on
+     *      every CALLS_PER_CLOCK_READ-th call to check().
+     */
+    void configure(Mode mode, uint64_t sampleEvery, uint64_t sampleMs);
+
+    /**
+     * Return the current mode.
+     */
+    Mode getMode() const;
+
+    /**
+     * Called with the mutex held whenever it's acquired or about to be
+     * released. Depending on the mode, this calls checkAll(), does nothing,
+     * or checks a sample. A sample runs the basic checks on one call and the
+     * delta checks on the next, so that the deltas are still between
+     * consecutive states.
+     */
+    void check();
+
+    /**
+     * Run every check now.
+     */
     void checkAll();
+
+    /**
+     * Fill in the invariants section of the server's statistics.
+     */
+    void updateServerStats(Protocol::Client::ServerStats& serverStats) const;
+
   private:
+    /**
+     * When sampling by time, check() only reads the clock once every this
+     * many calls.
+     */
+    static const uint64_t CALLS_PER_CLOCK_READ = 64;
+
     void checkBasic();
     void checkPeerBasic();
     void checkDelta();
     void checkPeerDelta();
 
     const RaftConsensus& consensus;
+    /**
+     * The number of invariants found to be false.
+     */
     uint64_t errors;
     struct ConsensusSnapshot;
+    /**
+     * The state as of the last call to checkDelta(), if #havePrevious.
+     * This is allocated once and then overwritten.
+     */
     std::unique_ptr<ConsensusSnapshot> previous;
+    /**
+     * Whether #previous holds a snapshot to compare against.
+     */
+    bool havePrevious;
+
+    /**
+     * See configure().
+     */
+    Mode mode;
+    uint64_t sampleEvery;
+    std::chrono::milliseconds sampleInterval;
+    /**
+     * The number of calls to check() since the last sample.
+     */
+    uint64_t callsSinceSample;
+    /**
+     * When the next sample is due, if sampling by time.
+     */
+    Core::Time::SteadyClock::time_point nextSampleAt;
+    /**
+     * Set when a sample has run the basic checks, so that the next call to
+     * check() runs the delta checks.
+     */
+    bool deltaPending;
+
+    /**
+     * checkBasic() only scans the log entries appended since it last ran.
+     * This is the last entry it has scanned.
+     */
+    uint64_t checkedLogId;
+    /**
+     * The term of the entry at #checkedLogId, or 0. If the entry there now
+     * has a different term, the log was truncated, and checkBasic() starts
+     * over.
+     */
+    uint64_t checkedLogTerm;
+    /**
+     * The last configuration entry among the entries scanned, or 0.
+     */
+    uint64_t lastConfigurationId;
+
+    /**
+     * The number of times checks were run (a sample counts twice: once for
+     * its basic checks and once for its delta checks).
+     */
+    Core::Stats::Counter checks;
+    /**
+     * The time each of those took, in nanoseconds.
+     */
+    Core::Stats::Histogram checkNanos;
 };
 
 
@@ -223,6 +350,9 @@ class Peer : public Server {
      *      The request that was received from the other server.
      * \param[out] response
      *      Where the reply should be placed.
+     * \param priority
+     *      NORMAL for requests that may be large (AppendEntry with entries),
+     *      so that they don't delay heartbeats and votes to the same server.
      * \return
      *      True if the RPC succeeded and the response was filled in; false
      *      otherwise.
@@ -230,7 +360,9 @@ class Peer : public Server {
     bool
     callRPC(Protocol::Raft::OpCode opCode,
             const google::protobuf::Message& request,
-            google::protobuf::Message& response);
+            google::protobuf::Message& response,
+            RPC::MessageSocket::Priority priority =
+                RPC::MessageSocket::Priority::CONTROL);
 
     /**
      * Launch this Peer's thread, which should run
@@ -245,8 +377,10 @@ class Peer : public Server {
 
     /**
      * Get the current session for this server. (This is cached in the #session
-     * member for efficiency.) As this operation might take a while, it should
-     * be called without RaftConsensus lock.
+     * member for efficiency.) The session is shared with the other Raft
+     * groups' peers for the same server; see Globals::getPeerSession(). As
+     * this operation might take a while, it should be called without
+     * RaftConsensus lock.
      */
     std::shared_ptr<RPC::ClientSession> getSession();
 
@@ -296,11 +430,19 @@ class Peer : public Server {
      * if it has no new data to send, to stop the follower from starting a new
      * election.
      * \invariant
-     *      This is never more than HEARTBEAT_PERIOD_MS in the future, since
-     *      new leaders don't reset it.
+     *      This is never more than HEARTBEAT_PERIOD_MS in the future. It is
+     *      reset when an election begins, so that a new leader sends its
+     *      first heartbeat right away.
      */
     TimePoint nextHeartbeatTime;
 
+    /**
+     * True while a Heartbeat RPC that HeartbeatSender sent to this server
+     * for this group awaits its reply. collectHeartbeats() skips the server
+     * until then, so that a slow or hung server doesn't pile up heartbeats.
+     */
+    bool heartbeatInFlight;
+
     /**
      * The minimum time at which the next RPC should be sent.
      * Only valid while we're a candidate or leader. This is set when an RPC
@@ -320,6 +462,86 @@ class Peer : public Server {
      */
     bool isCaughtUp_;
 
+    /**
+     * When the server last acknowledged an AppendEntry RPC in the current
+     * term, measured from when the RPC was sent. Only valid while we're
+     * leader. A server that hasn't acknowledged anything in
+     * FOLLOWER_TIMEOUT_MS doesn't hold back new client requests (see
+     * RaftConsensus::getReplicationLag()).
+     */
+    TimePoint lastAckTime;
+
+    /**
+     * Set while the server is far enough behind that the leader sends it
+     * the largest AppendEntry requests it can, rather than the usual
+     * RaftConsensus::replicationBatchBytes. Only valid while we're leader.
+     * See RaftConsensus::bulkCatchUpThreshold.
+     */
+    bool bulkCatchUp;
+
+    /**
+     * The size to which AppendEntry requests to this server are currently
+     * limited while it's not in bulk catch-up mode, in bytes, or 0 if no
+     * request has been sent yet. This adapts to the round-trip times observed;
+     * see RaftConsensus::updateFlowControl(). Only valid while we're leader.
+     */
+    uint64_t batchBytes;
+
+    /**
+     * The fastest round-trip time observed for an AppendEntry request
+     * carrying entries to this server, in microseconds, or ~0UL if none has
+     * completed. Only valid while we're leader.
+     */
+    uint64_t minRTT;
+
+    /**
+     * A moving average of the round-trip times of AppendEntry requests
+     * carrying entries to this server, in microseconds. Only valid while
+     * we're leader.
+     */
+    uint64_t smoothedRTT;
+
+    /**
+     * A moving average of the rate at which AppendEntry requests carrying
+     * entries are delivered to this server, in bytes per second. Only valid
+     * while we're leader.
+     */
+    uint64_t bandwidth;
+
+    /**
+     * The round-trip times of successful AppendEntry RPCs to this server, in
+     * microseconds. This may be accessed without the RaftConsensus lock.
+     */
+    Core::Stats::Histogram appendEntryRTT;
+
+    /**
+     * The round-trip times of successful Heartbeat RPCs to this server (see
+     * HeartbeatSender), in microseconds. This may be accessed without the
+     * RaftConsensus lock.
+     */
+    Core::Stats::Histogram heartbeatRTT;
+
+    /**
+     * The round-trip time of the last AppendEntry or Heartbeat RPC this
+     * server acknowledged, in microseconds, or 0 if none yet. Sent along in
+     * later requests as their leader_round_trip_us. Only valid while we're
+     * leader.
+     */
+    uint64_t lastRTT;
+
+    /**
+     * The total size of the RPC requests sent to this server, in bytes. This
+     * may be accessed without the RaftConsensus lock.
+     */
+    Core::Stats::Counter bytesSent;
+
+    /**
+     * The number of AppendEntry requests without entries sent to this server
+     * to maintain leadership. This may be accessed without the RaftConsensus
+     * lock.
+     */
+    Core::Stats::Counter heartbeatsSent;
+
   private:
 
     /**
@@ -416,6 +638,12 @@ class Configuration {
      */
     bool hasVote(ServerRef server) const;
 
+    /**
+     * Return true if the given server is a learner in this configuration:
+     * it receives log entries but has no vote.
+     */
+    bool isLearner(ServerRef server) const;
+
     /**
      * Return true if there exists a quorum for which every server satisfies
      * the predicate, false otherwise.
@@ -444,7 +672,8 @@ class Configuration {
      * \param newDescription
      *      The IDs and addresses of the servers in the configuration. If any
      *      newServers are listed in the description, it is considered
-     *      TRANSITIONAL; otherwise, it is STABLE.
+     *      TRANSITIONAL; otherwise, it is STABLE. Any learners listed are
+     *      replicated to in either case.
      */
     void setConfiguration(
             uint64_t newId,
@@ -536,6 +765,12 @@ class Configuration {
      */
     SimpleConfiguration newServers;
 
+    /**
+     * These servers receive log entries under every configuration state but
+     * never have a vote. See Protocol::Raft::Configuration::learners.
+     */
+    SimpleConfiguration learners;
+
     friend class Invariants;
 };
 
@@ -580,9 +815,16 @@ class RaftConsensus : public Consensus {
     /**
      * Get the current leader's active, committed, simple cluster
      * configuration.
+     * \param[out] configuration
+     *      The voting servers.
+     * \param[out] learners
+     *      The servers that receive the log but have no vote.
+     * \param[out] id
+     *      Identifies the configuration; see setConfiguration().
      */
     ClientResult getConfiguration(
             Protocol::Raft::SimpleConfiguration& configuration,
+            Protocol::Raft::SimpleConfiguration& learners,
             uint64_t& id) const;
 
     /**
@@ -592,6 +834,18 @@ class RaftConsensus : public Consensus {
      */
     std::pair<ClientResult, uint64_t> getLastCommittedId() const;
 
+    /**
+     * Like getLastCommittedId(), but this may be called on any server, for
+     * reads that tolerate some staleness. A follower answers with its own
+     * committed ID if it had every entry the leader knew to be committed no
+     * more than maxStalenessMs ago (see #leaderCommitSeenAt); otherwise, it
+     * returns NOT_LEADER. A
+     * leader answers right away if a quorum acknowledged it no more than
+     * maxStalenessMs ago, and as in getLastCommittedId() otherwise.
+     */
+    std::pair<ClientResult, uint64_t>
+    getFollowerReadId(uint64_t maxStalenessMs) const;
+
     // See Consensus::getNextEntry().
     Consensus::Entry getNextEntry(uint64_t lastEntryId) const;
 
@@ -615,13 +869,83 @@ class RaftConsensus : public Consensus {
     void handleRequestVote(const Protocol::Raft::RequestVote::Request& request,
                            Protocol::Raft::RequestVote::Response& response);
 
+    /**
+     * Process a TimeoutNow RPC from the leader, which is handing off
+     * leadership to this server. Called by RaftService.
+     * \param[in] request
+     *      The request that was received from the other server.
+     * \param[out] response
+     *      Where the reply should be placed.
+     */
+    void handleTimeoutNow(const Protocol::Raft::TimeoutNow::Request& request,
+                          Protocol::Raft::TimeoutNow::Response& response);
+
+    /**
+     * Process this group's part of a Heartbeat RPC from the leader. This is
+     * like an AppendEntry RPC without entries. Called by RaftService.
+     * \param callerId
+     *      The ID of the server that sent the request.
+     * \param request
+     *      This group's part of the request.
+     * \return
+     *      This server's term, for the caller to update itself.
+     */
+    uint64_t handleHeartbeat(uint64_t callerId,
+                             const Protocol::Raft::Heartbeat::Group& request);
+
+    /**
+     * If this server is leader, add a heartbeat to 'batches' for each
+     * follower whose log is up to date and that will be due a heartbeat
+     * before the following round. Called by HeartbeatSender, which then sends
+     * the heartbeats instead of the Peer threads.
+     * \param roundTime
+     *      The time at which HeartbeatSender scheduled this round. Rounds are
+     *      half a heartbeat period apart.
+     * \param[in,out] batches
+     *      The heartbeats for each server, across all of the Raft groups.
+     */
+    void collectHeartbeats(TimePoint roundTime,
+                           HeartbeatSender::Batches& batches);
+
+    /**
+     * Process the reply to a heartbeat added by collectHeartbeats(). Called by
+     * HeartbeatSender.
+     * \param peerId
+     *      The ID of the server that the heartbeat was sent to.
+     * \param request
+     *      This group's part of the heartbeat.
+     * \param epoch
+     *      #currentEpoch when the heartbeat was collected.
+     * \param start
+     *      When the heartbeat was sent.
+     * \param ok
+     *      False if the RPC failed.
+     * \param term
+     *      If 'ok', the term returned by the peer.
+     */
+    void handleHeartbeatReply(uint64_t peerId,
+                              const Protocol::Raft::Heartbeat::Group& request,
+                              uint64_t epoch,
+                              TimePoint start,
+                              bool ok,
+                              uint64_t term);
+
+    /**
+     * Return the address of the server that is probably the leader, for
+     * clients that contacted some other server, or an empty string if this
+     * server doesn't know. This server itself is never returned.
+     */
+    std::string getLeaderHint() const;
+
     /**
      * Submit an operation to the replicated log.
      * \param operation
      *      If the cluster accepts this operation, then it will be added to the
-     *      log and the state machine will eventually apply it.
+     *      log and the state machine will eventually apply it. The log shares
+     *      the operation's memory rather than copying it.
      */
-    std::pair<ClientResult, uint64_t> replicate(const std::string& operation);
+    std::pair<ClientResult, uint64_t>
+    replicate(const Core::Payload& operation);
 
     /**
      * Change the cluster's configuration.
@@ -630,12 +954,46 @@ class RaftConsensus : public Consensus {
      *      Identifies a cluster configuration previously returned by
      *      getConfiguration().
      * \param newConfiguration
-     *      Servers in new config, only use new_servers() part.
+     *      Servers in new config, only use new_servers() part. New voters
+     *      must catch up before the change is made, which is quick for
+     *      servers that are already learners.
+     * \param newLearners
+     *      Learners in the new config, or NULL to keep the current learners.
+     *      Either way, any learner listed in newConfiguration is promoted to a
+     *      voter instead.
      */
     ClientResult
     setConfiguration(
             uint64_t id,
-            const Protocol::Raft::SimpleConfiguration& newConfiguration);
+            const Protocol::Raft::SimpleConfiguration& newConfiguration,
+            const Protocol::Raft::SimpleConfiguration* newLearners = NULL);
+
+    /**
+     * Hand off leadership to another server. New client requests wait while
+     * the target catches up, then the target is sent a TimeoutNow RPC so that
+     * it starts an election right away. This gives up if this server is
+     * still leader after FOLLOWER_TIMEOUT_MS.
+     * \param serverId
+     *      The server that should become leader, or 0 to choose the voting
+     *      server whose log is most up to date.
+     * \param[out] newLeaderId
+     *      On SUCCESS, the new leader's ID, or 0 if this server stepped down
+     *      but hasn't heard from the new leader in time.
+     * \param[out] reason
+     *      On FAIL, why leadership was not transferred.
+     * \return
+     *      SUCCESS if this server stepped down, NOT_LEADER if it wasn't
+     *      leader to begin with, or FAIL.
+     */
+    ClientResult transferLeadership(uint64_t serverId,
+                                    uint64_t& newLeaderId,
+                                    std::string& reason);
+
+    /**
+     * Add information about this server's Raft state, its log, and its
+     * peers to the given stats. Called by ServerStats.
+     */
+    void updateServerStats(Protocol::Client::ServerStats& serverStats) const;
 
     /**
      * Print out the contents of this class for debugging purposes.
@@ -643,19 +1001,45 @@ class RaftConsensus : public Consensus {
     friend std::ostream& operator<<(std::ostream& os,
                                     const RaftConsensus& raft);
 
+    /**
+     * The Raft group that this instance of the protocol runs. A server runs
+     * one instance per group (see Globals), each with its own log and its
+     * own leader. Set before init(), like #serverId.
+     */
+    uint32_t groupId;
+
+    /**
+     * If true, this server starts elections a bit sooner than its peers, so
+     * that it usually ends up leading this group. Globals sets this for a
+     * different server in each group to spread the leaders across the
+     * cluster. Set before init().
+     */
+    bool preferredLeader;
+
   private:
     /**
      * See #state.
      */
     enum class State {
         /**
-         * A follower does not initiate RPCs. It becomes a candidate with
-         * startNewElection() when a timeout elapses without hearing from a
+         * A follower does not initiate RPCs. It becomes a pre-candidate with
+         * startPreVote() (or a candidate with startNewElection(), if #preVote
+         * is off) when a timeout elapses without hearing from a
          * candidate/leader. This is the initial state for servers when they
          * start up.
          */
         FOLLOWER,
 
+        /**
+         * A pre-candidate sends RequestVote RPCs marked as pre-votes to find
+         * out whether it could win an election, without incrementing its term.
+         * It becomes a candidate once a quorum says it could, and it steps
+         * down to be a follower if it hears from a current leader or discovers
+         * a newer term. This keeps a server that was partitioned away from
+         * bumping the term and deposing a healthy leader when it returns.
+         */
+        PRE_CANDIDATE,
+
         /**
          * A candidate sends RequestVote RPCs in an attempt to become a leader.
          * It steps down to be a follower if it discovers a current leader, and
@@ -678,8 +1062,8 @@ class RaftConsensus : public Consensus {
     //// The following private methods MUST acquire the lock.
 
     /**
-     * Start new elections when it's time to do so. This is the method that
-     * #candidacyThread executes.
+     * Start new elections (or pre-votes) when it's time to do so. This is the
+     * method that #candidacyThread executes.
      * TODO(ongaro): rename to timerThreadMain?
      */
     void candidacyThreadMain();
@@ -768,6 +1152,59 @@ class RaftConsensus : public Consensus {
      */
     void interruptAll();
 
+    /**
+     * Return the number of entries the leader has that the slowest
+     * responsive follower has not acknowledged. Followers in bulk catch-up
+     * mode and followers that haven't acknowledged anything for
+     * FOLLOWER_TIMEOUT_MS are left out, so that a crashed or hopelessly slow
+     * follower doesn't hold back the rest of the cluster.
+     * \pre
+     *      state is LEADER.
+     */
+    uint64_t getReplicationLag() const;
+
+    /**
+     * Return the number of committed entries that the state machine has not
+     * yet applied.
+     */
+    uint64_t getApplyLag() const;
+
+    /**
+     * Return true if new client requests should wait because the leader has
+     * gotten too far ahead of its followers or its state machine. This
+     * starts returning true once either lag exceeds its high watermark and
+     * continues until both lags are back down to their low watermarks.
+     * \pre
+     *      state is LEADER.
+     */
+    bool isThrottled();
+
+    /**
+     * Return the size to which the next AppendEntry request to the given
+     * follower should be limited, in bytes.
+     * \pre
+     *      state is LEADER.
+     */
+    uint64_t getBatchLimit(Peer& peer);
+
+    /**
+     * Fold a completed AppendEntry request into the follower's round-trip
+     * time and bandwidth estimates, then resize Peer::batchBytes: it doubles
+     * when a full request came back within #replicationTargetDelayMs of the
+     * fastest round trip seen, and it halves when a request took longer.
+     * \param peer
+     *      The follower the request was sent to.
+     * \param requestBytes
+     *      The size of the request.
+     * \param full
+     *      Whether entries were left out of the request because of its size
+     *      limit.
+     * \param rttMicros
+     *      How long the request took, in microseconds.
+     */
+    void updateFlowControl(Peer& peer, uint64_t requestBytes, bool full,
+                           uint64_t rttMicros);
+
     /**
      * Return true if the leader has committed all entries from prior terms,
      * false otherwise. Used to defer log appends until the leader may service
@@ -797,6 +1234,29 @@ class RaftConsensus : public Consensus {
      */
     void requestVote(std::unique_lock<Mutex>& lockGuard, Peer& peer);
 
+    /**
+     * Send a RequestVote RPC marked as a pre-vote to the server. This is used
+     * by pre-candidates to find out whether they could win an election in the
+     * next term.
+     * \param lockGuard
+     *      Used to temporarily release the lock while invoking the RPC, so as
+     *      to allow for some concurrency.
+     * \param peer
+     *      State used in communicating with the follower, building the RPC
+     *      request, and processing its result.
+     */
+    void requestPreVote(std::unique_lock<Mutex>& lockGuard, Peer& peer);
+
+    /**
+     * Send a TimeoutNow RPC to the target of a leadership transfer.
+     * \param lockGuard
+     *      Used to temporarily release the lock while invoking the RPC, so as
+     *      to allow for some concurrency.
+     * \param peer
+     *      The target of #leadershipTransfer.
+     */
+    void timeoutNow(std::unique_lock<Mutex>& lockGuard, Peer& peer);
+
     /**
      * Search backwards in the log for the latest configuration and apply it.
      * This is called on followers that have truncated their logs and on newly
@@ -804,6 +1264,18 @@ class RaftConsensus : public Consensus {
      */
     void scanForConfiguration();
 
+    /**
+     * Called on a follower when a request from the leader shows that it has
+     * every entry the leader knew to be committed. This moves
+     * #leaderCommitSeenAt up to when the leader may have sent the request.
+     * \param roundTripMicros
+     *      The request's leader_round_trip_us: the time before now that the
+     *      leader is assumed to have sent the request. The assumption only
+     *      fails if the request took longer to arrive than the leader's last
+     *      round trip to this server did to complete.
+     */
+    void sawLeaderCommit(uint64_t roundTripMicros);
+
     /**
      * Set the timer to become a candidate to about FOLLOWER_TIMEOUT_MS from
      * now and notify #stateChanged.
@@ -828,6 +1300,15 @@ class RaftConsensus : public Consensus {
      */
     void startNewElection();
 
+    /**
+     * Transitions to being a pre-candidate from being a follower or
+     * candidate. This is called when a timeout elapses and #preVote is on.
+     * Unlike startNewElection(), it leaves #currentTerm alone. If the
+     * configuration is blank, it does nothing. If this server forms a quorum
+     * by itself, this will immediately start a real election.
+     */
+    void startPreVote();
+
     /**
      * Transition to being a follower. This is called when we
      * receive an RPC request with newer term, receive an RPC response
@@ -959,15 +1440,16 @@ class RaftConsensus : public Consensus {
     uint64_t currentTerm;
 
     /**
-     * The server's current role in the cluster (follower, candidate, or
-     * leader). See #State.
+     * The server's current role in the cluster (follower, pre-candidate,
+     * candidate, or leader). See #State.
      */
     State state;
 
     /**
      * How many elections this candidate has participated in since it
      * became a candidate. Set to 0 in stepDown() and incremented in
-     * startNewElection. Used as argument to setCandidateTimer.
+     * startNewElection() and startPreVote(). Used as argument to
+     * setCandidateTimer.
      */
     uint64_t electionAttempt;
 
@@ -1016,6 +1498,112 @@ class RaftConsensus : public Consensus {
      */
     TimePoint startElectionAt;
 
+    /**
+     * The latest time that this server is known to have had every entry its
+     * leader knew to be committed: when the leader sent the last request that
+     * showed so, which is estimated as the time it arrived less the leader's
+     * last round trip to this server (see sawLeaderCommit()). Used by
+     * getFollowerReadId().
+     */
+    TimePoint leaderCommitSeenAt;
+
+    /**
+     * The time it takes for entries submitted with replicate() and
+     * setConfiguration() to commit on this leader, in microseconds.
+     */
+    Core::Stats::Histogram commitLatency;
+
+    /**
+     * The last entry ID the state machine has asked for with getNextEntry(),
+     * which is the last entry it has applied.
+     */
+    mutable uint64_t lastAppliedId;
+
+    /**
+     * Limits on how far a leader may get ahead of its followers and its state
+     * machine before replicate() makes new client requests wait, and the
+     * statistics for them. The limits are read from the config file in
+     * init(); a high watermark of 0 disables that limit.
+     */
+    struct Backpressure {
+        Backpressure();
+        /// See getReplicationLag(). From "replicationLagHighWatermark".
+        uint64_t replicationLagHigh;
+        /// From "replicationLagLowWatermark".
+        uint64_t replicationLagLow;
+        /// See getApplyLag(). From "applyLagHighWatermark".
+        uint64_t applyLagHigh;
+        /// From "applyLagLowWatermark".
+        uint64_t applyLagLow;
+        /// See isThrottled().
+        bool throttled;
+        /// The number of times #throttled has become true.
+        Core::Stats::Counter throttleEvents;
+        /// The time client requests waited while throttled, in microseconds.
+        Core::Stats::Histogram throttleWait;
+    } backpressure;
+
+    /**
+     * The leadership transfer in progress, if any; see transferLeadership().
+     */
+    struct LeadershipTransfer {
+        LeadershipTransfer();
+        /// The server to hand leadership to, or 0 if no transfer is in
+        /// progress. New client requests wait while this is set.
+        uint64_t targetId;
+        /// The term in which the transfer was started. The transfer only
+        /// applies while #currentTerm is still this term.
+        uint64_t term;
+        /// When to give up on the transfer.
+        TimePoint deadline;
+        /// Whether the target has been sent a TimeoutNow RPC.
+        bool timeoutNowSent;
+    } leadershipTransfer;
+
+    /**
+     * A follower that is at least this many entries behind the leader is
+     * switched into bulk catch-up mode (see Peer::bulkCatchUp), and it
+     * switches back once it's less than half this many entries behind.
+     * 0 disables bulk catch-up mode. From "bulkCatchUpThreshold".
+     */
+    uint64_t bulkCatchUpThreshold;
+
+    /**
+     * The size that AppendEntry requests to followers that aren't in bulk
+     * catch-up mode are limited to at first; from there, each follower's
+     * limit adapts (see Peer::batchBytes). From "replicationBatchBytes".
+     */
+    uint64_t replicationBatchBytes;
+
+    /**
+     * The smallest that Peer::batchBytes may shrink to.
+     * From "replicationMinBatchBytes".
+     */
+    uint64_t replicationMinBatchBytes;
+
+    /**
+     * The most request data that may be outstanding to any one follower,
+     * in bytes, even in bulk catch-up mode. Since the leader only has one
+     * AppendEntry request outstanding per follower, this caps the size of
+     * each request. 0 means SOFT_RPC_SIZE_LIMIT.
+     * From "replicationMaxBytesInFlight".
+     */
+    uint64_t replicationMaxBytesInFlight;
+
+    /**
+     * How much longer than the fastest round trip observed to a follower an
+     * AppendEntry request may take before the follower's batch size shrinks,
+     * in milliseconds. From "replicationTargetDelayMs".
+     */
+    uint64_t replicationTargetDelayMs;
+
+    /**
+     * Whether to run a pre-vote round before each election; see
+     * State::PRE_CANDIDATE. From "preVote". Leadership transfers skip the
+     * pre-vote either way.
+     */
+    bool preVote;
+
     /**
      * The thread that executes candidacyThreadMain() to begin new elections
      * after periods of inactivity.
@@ -1033,6 +1621,7 @@ class RaftConsensus : public Consensus {
     friend class LocalServer;
     friend class Peer;
     friend class Invariants;
+    friend class LogCabin::Server::HeartbeatSender;
 };
 
 } // namespace RaftConsensusInternal
@@ -13,8 +13,10 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include "build/Protocol/Client.pb.h"
 #include "Core/Debug.h"
 #include "Server/RaftConsensus.h"
+#include "Server/ServerStats.h"
 
 namespace LogCabin {
 namespace Server {
@@ -63,10 +65,24 @@ struct Invariants::ConsensusSnapshot {
 };
 
 
+const uint64_t Invariants::CALLS_PER_CLOCK_READ;
+
 Invariants::Invariants(RaftConsensus& consensus)
     : consensus(consensus)
     , errors(0)
     , previous()
+    , havePrevious(false)
+    , mode(Mode::FULL)
+    , sampleEvery(0)
+    , sampleInterval(0)
+    , callsSinceSample(0)
+    , nextSampleAt(TimePoint::min())
+    , deltaPending(false)
+    , checkedLogId(0)
+    , checkedLogTerm(0)
+    , lastConfigurationId(0)
+    , checks()
+    , checkNanos()
 {
 }
 
@@ -74,45 +90,136 @@ Invariants::~Invariants()
 {
 }
 
+void
+Invariants::configure(Mode mode, uint64_t sampleEvery, uint64_t sampleMs)
+{
+    this->mode = mode;
+    this->sampleEvery = sampleEvery;
+    sampleInterval = std::chrono::milliseconds(sampleMs);
+    callsSinceSample = 0;
+    nextSampleAt = TimePoint::min();
+    deltaPending = false;
+    havePrevious = false;
+}
+
+Invariants::Mode
+Invariants::getMode() const
+{
+    return mode;
+}
+
+void
+Invariants::check()
+{
+    switch (mode) {
+        case Mode::OFF:
+            return;
+        case Mode::FULL:
+            checkAll();
+            return;
+        case Mode::SAMPLED:
+            break;
+    }
+    if (!deltaPending) {
+        // This runs on every acquisition and release of the mutex, so it
+        // avoids reading the clock until the count says it's time to.
+        ++callsSinceSample;
+        bool due = (sampleEvery > 0 && callsSinceSample >= sampleEvery);
+        if (!due &&
+            sampleInterval.count() > 0 &&
+            callsSinceSample % CALLS_PER_CLOCK_READ == 0) {
+            due = (Clock::now() >= nextSampleAt);
+        }
+        if (!due)
+            return;
+    }
+    TimePoint start = Clock::now();
+    if (deltaPending) {
+        checkDelta();
+        checkPeerDelta();
+        deltaPending = false;
+        havePrevious = false;
+    } else {
+        callsSinceSample = 0;
+        nextSampleAt = start + sampleInterval;
+        checkBasic();
+        checkPeerBasic();
+        checkDelta(); // just takes a snapshot for the next call
+        deltaPending = true;
+    }
+    checks.add();
+    checkNanos.record(Core::Stats::nanosSince(start));
+}
+
 void
 Invariants::checkAll()
 {
+    TimePoint start = Clock::now();
     checkBasic();
     checkDelta();
     checkPeerBasic();
     checkPeerDelta();
+    checks.add();
+    checkNanos.record(Core::Stats::nanosSince(start));
+}
+
+void
+Invariants::updateServerStats(
+        Protocol::Client::ServerStats& serverStats) const
+{
+    Protocol::Client::ServerStats::Invariants& stats =
+        *serverStats.mutable_invariants();
+    switch (mode) {
+        case Mode::OFF:
+            stats.set_mode("off");
+            break;
+        case Mode::SAMPLED:
+            stats.set_mode("sampled");
+            break;
+        case Mode::FULL:
+            stats.set_mode("full");
+            break;
+    }
+    stats.set_checks(checks.get());
+    stats.set_errors(errors);
+    ServerStats::setHistogram(checkNanos.getSnapshot(),
+                              *stats.mutable_check_ns());
 }
 
 void
 Invariants::checkBasic()
 {
+    // Only the entries appended since the last check are scanned, unless the
+    // log has since been truncated below them. By the log matching property,
+    // if the entry at checkedLogId still has the same term, the entries up
+    // to it haven't changed.
+    uint64_t lastLogId = consensus.log->getLastLogId();
+    if (checkedLogId > lastLogId ||
+        (checkedLogId > 0 &&
+         consensus.log->getTerm(checkedLogId) != checkedLogTerm)) {
+        checkedLogId = 0;
+        checkedLogTerm = 0;
+        lastConfigurationId = 0;
+    }
     // Log terms monotonically increase
-    uint64_t lastTerm = 0;
-    for (uint64_t entryId = 1;
-         entryId <= consensus.log->getLastLogId();
+    for (uint64_t entryId = checkedLogId + 1;
+         entryId <= lastLogId;
          ++entryId) {
         const Log::Entry& entry = consensus.log->getEntry(entryId);
-        expect(entry.term >= lastTerm);
-        lastTerm = entry.term;
+        expect(entry.term >= checkedLogTerm);
+        checkedLogTerm = entry.term;
+        if (entry.type == Protocol::Raft::EntryType::CONFIGURATION)
+            lastConfigurationId = entryId;
     }
+    checkedLogId = lastLogId;
     // The terms in the log do not exceed currentTerm
-    expect(lastTerm <= consensus.currentTerm);
+    expect(checkedLogTerm <= consensus.currentTerm);
 
     // The current configuration should be the last one found in the log
-    bool found = false;
-    for (uint64_t entryId = consensus.log->getLastLogId();
-         entryId > 0;
-         --entryId) {
-        const Log::Entry& entry = consensus.log->getEntry(entryId);
-        if (entry.type == Protocol::Raft::EntryType::CONFIGURATION) {
-            expect(consensus.configuration->id == entryId);
-            expect(consensus.configuration->state !=
-                   Configuration::State::BLANK);
-            found = true;
-            break;
-        }
-    }
-    if (!found) {
+    if (lastConfigurationId > 0) {
+        expect(consensus.configuration->id == lastConfigurationId);
+        expect(consensus.configuration->state != Configuration::State::BLANK);
+    } else {
         expect(consensus.configuration->id == 0);
         expect(consensus.configuration->state == Configuration::State::BLANK);
     }
@@ -129,16 +236,25 @@ Invariants::checkBasic()
     // it does not belong to.
     if (!consensus.configuration->hasVote(
                                 consensus.configuration->localServer)) {
+        expect(consensus.state != RaftConsensus::State::PRE_CANDIDATE);
         expect(consensus.state != RaftConsensus::State::CANDIDATE);
         if (consensus.configuration->id <= consensus.committedId)
             expect(consensus.state != RaftConsensus::State::LEADER);
     }
 
-    // A follower's electionAttempt should be 0, and a candidate's should be
-    // greater than 0.
+    // Learners never have a vote: a server is either a learner or a voter,
+    // never both.
+    expect(consensus.configuration->learners.all(
+        [this] (std::shared_ptr<Server> server) {
+            return !consensus.configuration->hasVote(server);
+        }));
+
+    // A follower's electionAttempt should be 0, and a (pre-)candidate's should
+    // be greater than 0.
     if (consensus.state == RaftConsensus::State::FOLLOWER)
         expect(consensus.electionAttempt == 0);
-    else if (consensus.state == RaftConsensus::State::CANDIDATE)
+    else if (consensus.state == RaftConsensus::State::PRE_CANDIDATE ||
+             consensus.state == RaftConsensus::State::CANDIDATE)
         expect(consensus.electionAttempt > 0);
 
     // The committedId doesn't exceed the length of the log.
@@ -168,12 +284,16 @@ Invariants::checkBasic()
 void
 Invariants::checkDelta()
 {
-    if (!previous) {
-        previous.reset(new ConsensusSnapshot(consensus));
+    ConsensusSnapshot snapshot(consensus);
+    if (!havePrevious) {
+        if (previous)
+            *previous = snapshot;
+        else
+            previous.reset(new ConsensusSnapshot(snapshot));
+        havePrevious = true;
         return;
     }
-    std::unique_ptr<ConsensusSnapshot> current(
-                                        new ConsensusSnapshot(consensus));
+    const ConsensusSnapshot* current = &snapshot;
     // Within a term, ...
     if (previous->currentTerm == current->currentTerm) {
         // the leader is set at most once.
@@ -185,6 +305,12 @@ Invariants::checkDelta()
         // a leader stays a leader.
         if (previous->state == RaftConsensus::State::LEADER)
             expect(current->state == RaftConsensus::State::LEADER);
+    } else {
+        // A pre-vote never changes the term: the term only goes up when a
+        // real election starts or a newer term is discovered, and either one
+        // ends the pre-vote.
+        expect(previous->state != RaftConsensus::State::PRE_CANDIDATE ||
+               current->state != RaftConsensus::State::PRE_CANDIDATE);
     }
 
     // Once exiting is set, it doesn't get unset.
@@ -213,7 +339,7 @@ Invariants::checkDelta()
      // a server goes from not caught up to caught up.
     }
 
-    previous = std::move(current);
+    *previous = snapshot;
 }
 
 void
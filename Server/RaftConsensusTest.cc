@@ -247,6 +247,49 @@ TEST_F(ServerRaftConsensusConfigurationTest, setConfiguration) {
     EXPECT_EQ(1U, cfg.knownServers.size());
 }
 
+TEST_F(ServerRaftConsensusConfigurationTest, setConfiguration_learners) {
+    cfg.setConfiguration(1, desc(
+        "prev_configuration {"
+        "    servers { server_id: 1, address: '127.0.0.1:61023' }"
+        "}"
+        "learners {"
+        "    servers { server_id: 2, address: '127.0.0.1:61024' }"
+        "}"));
+    EXPECT_EQ(Configuration::State::STABLE, cfg.state);
+    EXPECT_EQ(2U, cfg.knownServers.size());
+    auto s2 = cfg.getServer(2);
+    EXPECT_EQ("127.0.0.1:61024", s2->address);
+    EXPECT_TRUE(cfg.isLearner(s2));
+    EXPECT_FALSE(cfg.hasVote(s2));
+    EXPECT_FALSE(cfg.isLearner(cfg.localServer));
+    // the learner never counts toward a quorum
+    EXPECT_EQ(1U, cfg.quorumMin(getServerId));
+    EXPECT_TRUE(cfg.quorumAll([] (Configuration::ServerRef server) {
+        return server->serverId == 1;
+    }));
+
+    // a server being demoted from voter to learner keeps its vote until the
+    // transition completes
+    cfg.setConfiguration(2, desc(
+        "prev_configuration {"
+        "    servers { server_id: 1, address: '127.0.0.1:61023' }"
+        "    servers { server_id: 2, address: '127.0.0.1:61024' }"
+        "}"
+        "next_configuration {"
+        "    servers { server_id: 2, address: '127.0.0.1:61024' }"
+        "}"
+        "learners {"
+        "    servers { server_id: 1, address: '127.0.0.1:61023' }"
+        "}"));
+    EXPECT_FALSE(cfg.isLearner(cfg.localServer));
+    EXPECT_TRUE(cfg.hasVote(cfg.localServer));
+
+    // dropping the learner stops replicating to it
+    cfg.setConfiguration(3, desc(d));
+    EXPECT_FALSE(cfg.isLearner(s2));
+    EXPECT_EQ(1U, cfg.knownServers.size());
+}
+
 TEST_F(ServerRaftConsensusConfigurationTest, setStagingServers) {
     cfg.setConfiguration(1, desc(
         "prev_configuration {"
@@ -314,7 +357,7 @@ class ServerRaftConsensusTest : public ::testing::Test {
 
         entry2.term = 2;
         entry2.type = Protocol::Raft::EntryType::DATA;
-        entry2.data = "hello";
+        entry2.data = Core::Payload("hello");
 
         entry3.term = 3;
         entry3.type = Protocol::Raft::EntryType::CONFIGURATION;
@@ -322,7 +365,7 @@ class ServerRaftConsensusTest : public ::testing::Test {
 
         entry4.term = 4;
         entry4.type = Protocol::Raft::EntryType::DATA;
-        entry4.data = "goodbye";
+        entry4.data = Core::Payload("goodbye");
 
         entry5.term = 5;
         entry5.type = Protocol::Raft::EntryType::CONFIGURATION;
@@ -422,7 +465,7 @@ TEST_F(ServerRaftConsensusTest, init_nonblanklog)
     Log::Entry entry2;
     entry2.term = 2;
     entry2.type = Protocol::Raft::EntryType::DATA;
-    entry.data = "hello, world";
+    entry.data = Core::Payload("hello, world");
     log.append(entry2);
 
     consensus->init();
@@ -439,12 +482,86 @@ TEST_F(ServerRaftConsensusTest, init_nonblanklog)
 
 // TODO(ongaro): low-priority test: exit
 
+TEST_F(ServerRaftConsensusTest, init_invariantChecking)
+{
+    globals.config.set("invariantChecking", "off");
+    init();
+    EXPECT_EQ(Invariants::Mode::OFF, consensus->invariants.getMode());
+    EXPECT_FALSE(bool(consensus->mutex.callback));
+    consensus->stepDown(5);
+    EXPECT_EQ(0U, consensus->invariants.checks.get());
+}
+
+TEST_F(ServerRaftConsensusTest, invariants_sampled)
+{
+    init();
+    Invariants& invariants = consensus->invariants;
+    invariants.configure(Invariants::Mode::SAMPLED, 3, 0);
+    uint64_t checks = invariants.checks.get();
+    invariants.check();
+    invariants.check();
+    EXPECT_EQ(checks, invariants.checks.get());
+    invariants.check(); // basic checks
+    EXPECT_TRUE(invariants.deltaPending);
+    invariants.check(); // delta checks
+    EXPECT_FALSE(invariants.deltaPending);
+    EXPECT_FALSE(invariants.havePrevious);
+    EXPECT_EQ(checks + 2, invariants.checks.get());
+    EXPECT_EQ(0U, invariants.errors);
+
+    // sampling by time, which only reads the clock every so often
+    invariants.configure(Invariants::Mode::SAMPLED, 0, 100);
+    for (uint64_t i = 1; i < Invariants::CALLS_PER_CLOCK_READ; ++i)
+        invariants.check();
+    EXPECT_EQ(checks + 2, invariants.checks.get());
+    invariants.check(); // basic checks
+    invariants.check(); // delta checks
+    EXPECT_EQ(checks + 4, invariants.checks.get());
+    Clock::mockValue += milliseconds(99);
+    for (uint64_t i = 0; i < Invariants::CALLS_PER_CLOCK_READ; ++i)
+        invariants.check();
+    EXPECT_EQ(checks + 4, invariants.checks.get());
+    Clock::mockValue += milliseconds(1);
+    for (uint64_t i = 1; i < Invariants::CALLS_PER_CLOCK_READ; ++i)
+        invariants.check();
+    EXPECT_EQ(checks + 4, invariants.checks.get());
+    invariants.check();
+    EXPECT_EQ(checks + 5, invariants.checks.get());
+}
+
+TEST_F(ServerRaftConsensusTest, invariants_checkBasicIncremental)
+{
+    init();
+    consensus->stepDown(4);
+    consensus->append(entry1);
+    consensus->append(entry2);
+    Invariants& invariants = consensus->invariants;
+    invariants.checkAll();
+    EXPECT_EQ(2U, invariants.checkedLogId);
+    EXPECT_EQ(1U, invariants.lastConfigurationId);
+    consensus->append(entry3);
+    consensus->append(entry4);
+    invariants.checkAll();
+    EXPECT_EQ(4U, invariants.checkedLogId);
+    EXPECT_EQ(3U, invariants.lastConfigurationId);
+    // a truncated log is rescanned
+    consensus->log->truncate(2);
+    consensus->scanForConfiguration();
+    consensus->stateChanged.notify_all();
+    invariants.checkAll();
+    EXPECT_EQ(2U, invariants.checkedLogId);
+    EXPECT_EQ(1U, invariants.lastConfigurationId);
+    EXPECT_EQ(0U, invariants.errors);
+}
+
 TEST_F(ServerRaftConsensusTest, getConfiguration_notleader)
 {
     init();
     Protocol::Raft::SimpleConfiguration c;
+    Protocol::Raft::SimpleConfiguration learners;
     uint64_t id;
-    EXPECT_EQ(ClientResult::NOT_LEADER, consensus->getConfiguration(c, id));
+    EXPECT_EQ(ClientResult::NOT_LEADER,
+              consensus->getConfiguration(c, learners, id));
 }
 
 void
@@ -468,8 +585,10 @@ TEST_F(ServerRaftConsensusTest, getConfiguration_retry)
               consensus->configuration->state);
     consensus->stateChanged.callback = std::bind(setLastAckEpoch, getPeer(2));
     Protocol::Raft::SimpleConfiguration c;
+    Protocol::Raft::SimpleConfiguration learners;
     uint64_t id;
-    EXPECT_EQ(ClientResult::RETRY, consensus->getConfiguration(c, id));
+    EXPECT_EQ(ClientResult::RETRY,
+              consensus->getConfiguration(c, learners, id));
 }
 
 TEST_F(ServerRaftConsensusTest, getConfiguration_ok)
@@ -479,9 +598,12 @@ TEST_F(ServerRaftConsensusTest, getConfiguration_ok)
     consensus->startNewElection();
     EXPECT_EQ(State::LEADER, consensus->state);
     Protocol::Raft::SimpleConfiguration c;
+    Protocol::Raft::SimpleConfiguration learners;
     uint64_t id;
-    EXPECT_EQ(ClientResult::SUCCESS, consensus->getConfiguration(c, id));
+    EXPECT_EQ(ClientResult::SUCCESS,
+              consensus->getConfiguration(c, learners, id));
     EXPECT_EQ("servers { server_id: 1, address: '127.0.0.1:61023' }", c);
+    EXPECT_EQ("", learners);
     EXPECT_EQ(1U, id);
 }
 
@@ -494,7 +616,8 @@ class AppendAndCommit {
         using Core::StringUtil::format;
         Log::Entry entry;
         entry.term = 50;
-        entry.data = format("entry%lu", consensus.log->getLastLogId() + 1);
+        entry.data = Core::Payload(
+            format("entry%lu", consensus.log->getLastLogId() + 1));
         consensus.committedId = consensus.log->append(entry);
     }
     RaftConsensus& consensus;
@@ -502,6 +625,70 @@ class AppendAndCommit {
 
 // TODO(ongaro): getLastCommittedId: low-priority test
 
+TEST_F(ServerRaftConsensusTest, getFollowerReadId_follower)
+{
+    init();
+    typedef std::pair<ClientResult, uint64_t> P;
+    // never heard from a leader
+    EXPECT_EQ(P(ClientResult::NOT_LEADER, 0),
+              consensus->getFollowerReadId(1000));
+
+    Protocol::Raft::AppendEntry::Request request;
+    Protocol::Raft::AppendEntry::Response response;
+    request.set_server_id(3);
+    request.set_term(10);
+    request.set_prev_log_term(5);
+    request.set_prev_log_id(1);
+    request.set_committed_id(1);
+    request.set_leader_committed_id(2);
+    consensus->stepDown(10);
+    consensus->append(entry5);
+
+    // missing committed entries
+    consensus->handleAppendEntry(request, response);
+    EXPECT_EQ(1U, consensus->committedId);
+    EXPECT_EQ(P(ClientResult::NOT_LEADER, 0),
+              consensus->getFollowerReadId(1000));
+
+    // caught up
+    request.set_leader_committed_id(1);
+    consensus->handleAppendEntry(request, response);
+    EXPECT_EQ(P(ClientResult::SUCCESS, 1),
+              consensus->getFollowerReadId(100));
+
+    // too stale
+    Clock::mockValue += milliseconds(101);
+    EXPECT_EQ(P(ClientResult::NOT_LEADER, 0),
+              consensus->getFollowerReadId(100));
+    EXPECT_EQ(P(ClientResult::SUCCESS, 1),
+              consensus->getFollowerReadId(1000));
+
+    // the request may have been sent as long before it arrived as the
+    // leader's last round trip took
+    request.set_leader_round_trip_us(50000);
+    consensus->handleAppendEntry(request, response);
+    EXPECT_EQ(P(ClientResult::NOT_LEADER, 0),
+              consensus->getFollowerReadId(40));
+    EXPECT_EQ(P(ClientResult::SUCCESS, 1),
+              consensus->getFollowerReadId(50));
+
+    // an older request doesn't set the time back
+    request.set_leader_round_trip_us(80000);
+    consensus->handleAppendEntry(request, response);
+    EXPECT_EQ(P(ClientResult::SUCCESS, 1),
+              consensus->getFollowerReadId(50));
+}
+
+TEST_F(ServerRaftConsensusTest, getFollowerReadId_leader)
+{
+    init();
+    consensus->append(entry1);
+    consensus->startNewElection();
+    EXPECT_EQ(State::LEADER, consensus->state);
+    EXPECT_EQ((std::pair<ClientResult, uint64_t>(ClientResult::SUCCESS, 1)),
+              consensus->getFollowerReadId(0));
+}
+
 TEST_F(ServerRaftConsensusTest, getNextEntry)
 {
     init();
@@ -521,14 +708,14 @@ TEST_F(ServerRaftConsensusTest, getNextEntry)
     Consensus::Entry e2 = consensus->getNextEntry(e1.entryId);
     EXPECT_EQ(2U, e2.entryId);
     EXPECT_TRUE(e2.hasData);
-    EXPECT_EQ("hello", e2.data);
+    EXPECT_EQ("hello", e2.data.toString());
     Consensus::Entry e3 = consensus->getNextEntry(e2.entryId);
     EXPECT_EQ(3U, e3.entryId);
     EXPECT_FALSE(e3.hasData);
     Consensus::Entry e4 = consensus->getNextEntry(e3.entryId);
     EXPECT_EQ(4U, e4.entryId);
     EXPECT_TRUE(e4.hasData);
-    EXPECT_EQ("goodbye", e4.data);
+    EXPECT_EQ("goodbye", e4.data.toString());
     EXPECT_THROW(consensus->getNextEntry(e4.entryId),
                  ThreadInterruptedException);
 }
@@ -579,6 +766,31 @@ TEST_F(ServerRaftConsensusTest, handleAppendEntry_newLeaderAndCommittedId)
     EXPECT_EQ("term: 10", response);
 }
 
+TEST_F(ServerRaftConsensusTest, handleAppendEntry_preCandidate)
+{
+    init();
+    Protocol::Raft::AppendEntry::Request request;
+    Protocol::Raft::AppendEntry::Response response;
+    request.set_server_id(3);
+    request.set_term(9);
+    request.set_prev_log_term(5);
+    request.set_prev_log_id(1);
+    request.set_committed_id(0);
+    consensus->stepDown(9);
+    consensus->append(entry5);
+    consensus->handleAppendEntry(request, response);
+    EXPECT_EQ(3U, consensus->leaderId);
+    // the leader went quiet for a while, but it's back
+    consensus->startPreVote();
+    EXPECT_EQ(State::PRE_CANDIDATE, consensus->state);
+    consensus->handleAppendEntry(request, response);
+    EXPECT_EQ(State::FOLLOWER, consensus->state);
+    EXPECT_EQ(0U, consensus->electionAttempt);
+    EXPECT_EQ(3U, consensus->leaderId);
+    EXPECT_EQ(9U, consensus->currentTerm);
+    EXPECT_EQ("term: 9", response);
+}
+
 TEST_F(ServerRaftConsensusTest, handleAppendEntry_append)
 {
     init();
@@ -612,7 +824,7 @@ TEST_F(ServerRaftConsensusTest, handleAppendEntry_append)
     EXPECT_EQ(2U, l2.entryId);
     EXPECT_EQ(5U, l2.term);
     EXPECT_EQ(Protocol::Raft::EntryType::DATA, l2.type);
-    EXPECT_EQ("hello", l2.data);
+    EXPECT_EQ("hello", l2.data.toString());
 }
 
 TEST_F(ServerRaftConsensusTest, handleAppendEntry_truncate)
@@ -648,11 +860,11 @@ TEST_F(ServerRaftConsensusTest, handleAppendEntry_truncate)
     EXPECT_EQ(Protocol::Raft::EntryType::CONFIGURATION, l1.type);
     EXPECT_EQ(d, l1.configuration);
     const Log::Entry& l2 = consensus->log->getEntry(2);
-    EXPECT_EQ("hello", l2.data);
+    EXPECT_EQ("hello", l2.data.toString());
     const Log::Entry& l3 = consensus->log->getEntry(3);
-    EXPECT_EQ("foo", l3.data);
+    EXPECT_EQ("foo", l3.data.toString());
     const Log::Entry& l4 = consensus->log->getEntry(4);
-    EXPECT_EQ("bar", l4.data);
+    EXPECT_EQ("bar", l4.data.toString());
 }
 
 TEST_F(ServerRaftConsensusTest, handleAppendEntry_duplicate)
@@ -677,7 +889,44 @@ TEST_F(ServerRaftConsensusTest, handleAppendEntry_duplicate)
     const Log::Entry& l1 = consensus->log->getEntry(1);
     EXPECT_EQ(Protocol::Raft::EntryType::CONFIGURATION, l1.type);
     EXPECT_EQ(d, l1.configuration);
-    EXPECT_EQ("", l1.data);
+    EXPECT_EQ("", l1.data.toString());
+}
+
+TEST_F(ServerRaftConsensusTest, handleHeartbeat_callerStale)
+{
+    init();
+    Protocol::Raft::Heartbeat::Group request;
+    request.set_term(10);
+    request.set_committed_id(0);
+    request.set_leader_committed_id(0);
+    consensus->stepDown(11);
+    EXPECT_EQ(11U, consensus->handleHeartbeat(3, request));
+    EXPECT_EQ(0U, consensus->leaderId);
+}
+
+TEST_F(ServerRaftConsensusTest, handleHeartbeat_newLeaderAndCommittedId)
+{
+    init();
+    Protocol::Raft::Heartbeat::Group request;
+    request.set_term(10);
+    request.set_committed_id(1);
+    request.set_leader_committed_id(2);
+    consensus->stepDown(9);
+    consensus->append(entry5);
+    consensus->startNewElection();
+    EXPECT_EQ(State::CANDIDATE, consensus->state);
+    Clock::mockValue += milliseconds(10000);
+    EXPECT_EQ(10U, consensus->handleHeartbeat(3, request));
+    EXPECT_EQ(3U, consensus->leaderId);
+    EXPECT_EQ(State::FOLLOWER, consensus->state);
+    EXPECT_LT(Clock::mockValue, consensus->startElectionAt);
+    EXPECT_EQ(1U, consensus->committedId);
+    // missing the leader's last committed entry
+    EXPECT_EQ(TimePoint::min(), consensus->leaderCommitSeenAt);
+
+    request.set_leader_committed_id(1);
+    EXPECT_EQ(10U, consensus->handleHeartbeat(3, request));
+    EXPECT_EQ(Clock::mockValue, consensus->leaderCommitSeenAt);
 }
 
 TEST_F(ServerRaftConsensusTest, handleRequestVote)
@@ -755,6 +1004,98 @@ TEST_F(ServerRaftConsensusTest, handleRequestVote_termStale)
     EXPECT_GT(Clock::mockValue, consensus->startElectionAt);
 }
 
+TEST_F(ServerRaftConsensusTest, handleRequestVote_preVote)
+{
+    init();
+    Protocol::Raft::RequestVote::Request request;
+    Protocol::Raft::RequestVote::Response response;
+    request.set_server_id(3);
+    request.set_term(10);
+    request.set_last_log_term(5);
+    request.set_last_log_id(1);
+    request.set_pre_vote(true);
+    consensus->stepDown(9);
+    consensus->append(entry5);
+
+    // log is ok, no leader
+    consensus->handleRequestVote(request, response);
+    EXPECT_EQ("term: 9 "
+              "granted: true "
+              "last_log_term: 5 "
+              "last_log_id: 1 "
+              "begin_last_term_id: 1 ",
+              response);
+    // nothing changed
+    EXPECT_EQ(State::FOLLOWER, consensus->state);
+    EXPECT_EQ(9U, consensus->currentTerm);
+    EXPECT_EQ(0U, consensus->votedFor);
+
+    // caller would not be in a newer term
+    request.set_term(9);
+    consensus->handleRequestVote(request, response);
+    EXPECT_FALSE(response.granted());
+    request.set_term(10);
+
+    // log is not ok
+    request.set_last_log_term(4);
+    consensus->handleRequestVote(request, response);
+    EXPECT_FALSE(response.granted());
+    request.set_last_log_term(5);
+
+    // heard from a leader recently
+    consensus->leaderId = 2;
+    consensus->handleRequestVote(request, response);
+    EXPECT_FALSE(response.granted());
+    EXPECT_EQ(2U, consensus->leaderId);
+    EXPECT_EQ(9U, consensus->currentTerm);
+
+    // leader timed out
+    Clock::mockValue = consensus->startElectionAt;
+    consensus->handleRequestVote(request, response);
+    EXPECT_TRUE(response.granted());
+    EXPECT_EQ(9U, consensus->currentTerm);
+
+    // as leader
+    consensus->stepDown(10);
+    entry1.term = 10;
+    consensus->append(entry1);
+    consensus->startNewElection();
+    request.set_term(12);
+    request.set_last_log_term(10);
+    consensus->handleRequestVote(request, response);
+    EXPECT_FALSE(response.granted());
+    EXPECT_EQ(State::LEADER, consensus->state);
+    EXPECT_EQ(11U, consensus->currentTerm);
+}
+
+TEST_F(ServerRaftConsensusTest, handleTimeoutNow)
+{
+    init();
+    consensus->stepDown(5);
+    consensus->append(entry1);
+    Protocol::Raft::TimeoutNow::Request request;
+    Protocol::Raft::TimeoutNow::Response response;
+    request.set_server_id(2);
+
+    // stale
+    request.set_term(4);
+    consensus->handleTimeoutNow(request, response);
+    EXPECT_EQ("term: 5", response);
+    EXPECT_EQ(State::FOLLOWER, consensus->state);
+
+    // current: starts an election, which we win by ourselves
+    request.set_term(5);
+    consensus->handleTimeoutNow(request, response);
+    EXPECT_EQ("term: 6", response);
+    EXPECT_EQ(State::LEADER, consensus->state);
+
+    // leaders ignore it
+    request.set_term(6);
+    consensus->handleTimeoutNow(request, response);
+    EXPECT_EQ("term: 6", response);
+    EXPECT_EQ(State::LEADER, consensus->state);
+}
+
 // TODO(ongardie): low-priority test: replicate
 
 TEST_F(ServerRaftConsensusTest, setConfiguration_notLeader)
@@ -892,6 +1233,55 @@ TEST_F(ServerRaftConsensusTest, setConfiguration_replicateOkNontrivial)
     EXPECT_EQ(3U, consensus->log->getLastLogId());
 }
 
+TEST_F(ServerRaftConsensusTest, setConfiguration_learners)
+{
+    init();
+    consensus->append(entry1);
+    consensus->stepDown(1);
+    consensus->startNewElection();
+
+    // adding a learner doesn't wait for it to catch up, and the learner is
+    // carried into the final configuration
+    Protocol::Raft::SimpleConfiguration c = sdesc(
+        "servers { server_id: 1, address: '127.0.0.1:61023' }");
+    Protocol::Raft::SimpleConfiguration learners = sdesc(
+        "servers { server_id: 2, address: '127.0.0.1:61024' }");
+    EXPECT_EQ(ClientResult::SUCCESS,
+              consensus->setConfiguration(1, c, &learners));
+    EXPECT_EQ(3U, consensus->log->getLastLogId());
+    EXPECT_EQ("prev_configuration {"
+                  "servers { server_id: 1, address: '127.0.0.1:61023' }"
+              "}"
+              "learners {"
+                  "servers { server_id: 2, address: '127.0.0.1:61024' }"
+              "}",
+              consensus->log->getEntry(3).configuration);
+    Protocol::Raft::SimpleConfiguration c2;
+    Protocol::Raft::SimpleConfiguration learners2;
+    uint64_t id;
+    EXPECT_EQ(ClientResult::SUCCESS,
+              consensus->getConfiguration(c2, learners2, id));
+    EXPECT_EQ(learners, learners2);
+    EXPECT_EQ(3U, id);
+
+    // listing the learner as a voter promotes it
+    getPeer(2)->isCaughtUp_ = true;
+    consensus->stateChanged.callback = std::bind(&RaftConsensus::stepDown,
+                                                 consensus.get(), 10);
+    c = sdesc("servers { server_id: 1, address: '127.0.0.1:61023' }"
+              "servers { server_id: 2, address: '127.0.0.1:61024' }");
+    EXPECT_EQ(ClientResult::NOT_LEADER, consensus->setConfiguration(3, c));
+    EXPECT_EQ(4U, consensus->log->getLastLogId());
+    EXPECT_EQ("prev_configuration {"
+                  "servers { server_id: 1, address: '127.0.0.1:61023' }"
+              "}"
+              "next_configuration {"
+                  "servers { server_id: 1, address: '127.0.0.1:61023' }"
+                  "servers { server_id: 2, address: '127.0.0.1:61024' }"
+              "}",
+              consensus->log->getEntry(4).configuration);
+}
+
 class CandidacyThreadMainHelper {
     explicit CandidacyThreadMainHelper(RaftConsensus& consensus)
         : consensus(consensus)
@@ -903,7 +1293,13 @@ class CandidacyThreadMainHelper {
             EXPECT_EQ(State::FOLLOWER, consensus.state);
             Clock::mockValue = consensus.startElectionAt + milliseconds(1);
         } else {
-            EXPECT_EQ(State::CANDIDATE, consensus.state);
+            if (consensus.preVote) {
+                EXPECT_EQ(State::PRE_CANDIDATE, consensus.state);
+                EXPECT_EQ(5U, consensus.currentTerm);
+            } else {
+                EXPECT_EQ(State::CANDIDATE, consensus.state);
+                EXPECT_EQ(6U, consensus.currentTerm);
+            }
             consensus.exit();
         }
         ++iter;
@@ -914,7 +1310,7 @@ class CandidacyThreadMainHelper {
 
 // The first time through the while loop, we don't want to start a new election
 // and want to wait on the condition variable. The second time through, we want
-// to start a new election. Then we want to exit.
+// to start a new election (or a pre-vote). Then we want to exit.
 TEST_F(ServerRaftConsensusTest, candidacyThreadMain)
 {
     init();
@@ -927,6 +1323,19 @@ TEST_F(ServerRaftConsensusTest, candidacyThreadMain)
     consensus->candidacyThreadMain();
 }
 
+TEST_F(ServerRaftConsensusTest, candidacyThreadMain_preVote)
+{
+    init();
+    consensus->preVote = true;
+    Clock::mockValue = consensus->startElectionAt - milliseconds(1);
+    Clock::useMockValue = true;
+    consensus->stepDown(5);
+    consensus->append(entry1);
+    consensus->append(entry5);
+    consensus->stateChanged.callback = CandidacyThreadMainHelper(*consensus);
+    consensus->candidacyThreadMain();
+}
+
 class FollowerThreadMainHelper {
     explicit FollowerThreadMainHelper(RaftConsensus& consensus, Peer& peer)
         : consensus(consensus)
@@ -1031,6 +1440,7 @@ TEST_F(ServerRaftConsensusPTest, followerThreadMain)
     arequest.set_prev_log_term(0);
     arequest.set_prev_log_id(0);
     arequest.set_committed_id(0);
+    arequest.set_leader_committed_id(0);
     Protocol::Raft::Entry* e = arequest.add_entries();
     e->set_term(5);
     e->set_type(Protocol::Raft::EntryType::CONFIGURATION);
@@ -1227,6 +1637,7 @@ class ServerRaftConsensusPATest : public ServerRaftConsensusPTest {
         request.set_prev_log_term(0);
         request.set_prev_log_id(0);
         request.set_committed_id(2);
+        request.set_leader_committed_id(2);
         Protocol::Raft::Entry* e1 = request.add_entries();
         e1->set_term(1);
         e1->set_type(Protocol::Raft::EntryType::CONFIGURATION);
@@ -1234,7 +1645,7 @@ class ServerRaftConsensusPATest : public ServerRaftConsensusPTest {
         Protocol::Raft::Entry* e2 = request.add_entries();
         e2->set_term(2);
         e2->set_type(Protocol::Raft::EntryType::DATA);
-        e2->set_data(entry2.data);
+        e2->set_data(entry2.data.toString());
         Protocol::Raft::Entry* e3 = request.add_entries();
         e3->set_term(5);
         e3->set_type(Protocol::Raft::EntryType::CONFIGURATION);
@@ -1255,10 +1666,13 @@ TEST_F(ServerRaftConsensusPATest, appendEntry_rpcFailed)
     LogCabin::Core::Debug::setLogPolicy({
         {"Server/RaftConsensus.cc", "ERROR"}
     });
+    consensus->replicationMinBatchBytes = 100;
+    peer->batchBytes = 800;
     std::unique_lock<Mutex> lockGuard(consensus->mutex);
     consensus->appendEntry(lockGuard, *peer);
     EXPECT_LT(Clock::now(), peer->backoffUntil);
     EXPECT_EQ(0U, peer->lastAgreeId);
+    EXPECT_EQ(400U, peer->batchBytes);
 }
 
 TEST_F(ServerRaftConsensusPATest, appendEntry_limitSizeAndIgnoreResult)
@@ -1289,10 +1703,14 @@ TEST_F(ServerRaftConsensusPATest, appendEntry_termStale)
 
 TEST_F(ServerRaftConsensusPATest, appendEntry_ok)
 {
+    // the last round trip is passed along
+    peer->lastRTT = 7;
+    request.set_leader_round_trip_us(7);
     peerService->reply(Protocol::Raft::OpCode::APPEND_ENTRY,
                        request, response);
     std::unique_lock<Mutex> lockGuard(consensus->mutex);
     consensus->appendEntry(lockGuard, *peer);
+    EXPECT_EQ(0U, peer->lastRTT);
     EXPECT_EQ(consensus->currentEpoch, peer->lastAckEpoch);
     EXPECT_EQ(3U, peer->lastAgreeId);
     EXPECT_EQ(Clock::mockValue +
@@ -1302,45 +1720,498 @@ TEST_F(ServerRaftConsensusPATest, appendEntry_ok)
     // TODO(ongaro): test catchup code
 }
 
-TEST_F(ServerRaftConsensusTest, becomeLeader)
+TEST_F(ServerRaftConsensusPATest, appendEntry_bulkCatchUp)
 {
-    init();
-    consensus->stepDown(5);
-    consensus->append(entry1);
-    EXPECT_EQ(5U, consensus->currentTerm);
-    consensus->startNewElection(); // calls becomeLeader
-    EXPECT_EQ(State::LEADER, consensus->state);
-    EXPECT_EQ(6U, consensus->currentTerm);
-    EXPECT_EQ(1U, consensus->leaderId);
-    EXPECT_EQ(TimePoint::max(), consensus->startElectionAt);
+    // Normally, only one entry would fit.
+    consensus->replicationBatchBytes = 1;
+    consensus->bulkCatchUpThreshold = 3;
+    peerService->reply(Protocol::Raft::OpCode::APPEND_ENTRY,
+                       request, response);
+    std::unique_lock<Mutex> lockGuard(consensus->mutex);
+    consensus->appendEntry(lockGuard, *peer);
+    EXPECT_TRUE(peer->bulkCatchUp);
+    EXPECT_EQ(3U, peer->lastAgreeId);
+    EXPECT_EQ(Clock::mockValue, peer->lastAckTime);
 }
 
-TEST_F(ServerRaftConsensusTest, interruptAll)
+TEST_F(ServerRaftConsensusPATest, appendEntry_adaptiveBatch)
 {
-    init();
-    consensus->stateChanged.notificationCount = 0;
-    consensus->interruptAll();
-    EXPECT_EQ(1U, consensus->stateChanged.notificationCount);
+    consensus->replicationBatchBytes = 1;
+    consensus->replicationMinBatchBytes = 1;
+    request.mutable_entries()->RemoveLast();
+    request.mutable_entries()->RemoveLast();
+    request.set_committed_id(1);
+    peerService->reply(Protocol::Raft::OpCode::APPEND_ENTRY,
+                       request, response);
+    std::unique_lock<Mutex> lockGuard(consensus->mutex);
+    consensus->appendEntry(lockGuard, *peer);
+    EXPECT_EQ(1U, peer->lastAgreeId);
+    // the request was full and came back promptly
+    EXPECT_EQ(2U, peer->batchBytes);
+    EXPECT_EQ(0U, peer->minRTT);
+    EXPECT_EQ(0U, peer->heartbeatsSent.get());
 }
 
-TEST_F(ServerRaftConsensusTest, isLeaderReady)
+TEST_F(ServerRaftConsensusPATest, appendEntry_heartbeat)
 {
-    init();
-    consensus->stepDown(5);
-    consensus->append(entry1);
-    consensus->startNewElection();
-    EXPECT_TRUE(consensus->isLeaderReady());
-    consensus->append(entry2);
-    EXPECT_FALSE(consensus->isLeaderReady());
-    consensus->advanceCommittedId();
-    EXPECT_TRUE(consensus->isLeaderReady());
-    entry2.term = 6;
-    EXPECT_TRUE(consensus->isLeaderReady());
-    consensus->advanceCommittedId();
-    EXPECT_TRUE(consensus->isLeaderReady());
+    consensus->replicationBatchBytes = 500;
+    consensus->replicationMinBatchBytes = 100;
+    consensus->committedId = 3;
+    peer->lastAgreeId = 3;
+    request.clear_entries();
+    request.set_prev_log_term(5);
+    request.set_prev_log_id(3);
+    request.set_committed_id(3);
+    request.set_leader_committed_id(3);
+    peerService->reply(Protocol::Raft::OpCode::APPEND_ENTRY,
+                       request, response);
+    std::unique_lock<Mutex> lockGuard(consensus->mutex);
+    consensus->appendEntry(lockGuard, *peer);
+    EXPECT_EQ(1U, peer->heartbeatsSent.get());
+    EXPECT_EQ(500U, peer->batchBytes);
+    EXPECT_EQ(~0UL, peer->minRTT);
 }
 
-TEST_F(ServerRaftConsensusTest, replicateEntry_notLeader)
+TEST_F(ServerRaftConsensusPATest, collectHeartbeats)
+{
+    RaftConsensus::HEARTBEAT_PERIOD_MS = 2000;
+    HeartbeatSender::Batches batches;
+    // peer is missing entries
+    consensus->collectHeartbeats(Clock::mockValue, batches);
+    EXPECT_TRUE(batches.empty());
+
+    consensus->committedId = 3;
+    consensus->stateChanged.notify_all();
+    peer->lastAgreeId = 3;
+    consensus->groupId = 2;
+    consensus->collectHeartbeats(Clock::mockValue, batches);
+    ASSERT_EQ(1U, batches.size());
+    EXPECT_EQ("127.0.0.1:61024", batches.at(2).address);
+    EXPECT_EQ("server_id: 1 "
+              "groups { group_id: 2, term: 6, committed_id: 3, "
+              "         leader_committed_id: 3 }",
+              batches.at(2).request);
+    EXPECT_EQ(std::vector<uint64_t>({consensus->currentEpoch}),
+              batches.at(2).epochs);
+    EXPECT_EQ(Clock::mockValue + milliseconds(2000),
+              peer->nextHeartbeatTime);
+    EXPECT_EQ(1U, peer->heartbeatsSent.get());
+
+    // not due until two rounds later
+    batches.clear();
+    EXPECT_TRUE(peer->heartbeatInFlight);
+    peer->heartbeatInFlight = false;
+    Clock::mockValue += milliseconds(1000);
+    consensus->collectHeartbeats(Clock::mockValue, batches);
+    EXPECT_TRUE(batches.empty());
+    Clock::mockValue += milliseconds(1000);
+    consensus->collectHeartbeats(Clock::mockValue, batches);
+    EXPECT_EQ(1U, batches.size());
+
+    // previous heartbeat hasn't been answered
+    batches.clear();
+    peer->nextHeartbeatTime = TimePoint::min();
+    ASSERT_TRUE(peer->heartbeatInFlight);
+    consensus->collectHeartbeats(Clock::mockValue, batches);
+    EXPECT_TRUE(batches.empty());
+    peer->heartbeatInFlight = false;
+
+    // backing off
+    peer->backoffUntil = Clock::mockValue + milliseconds(1);
+    consensus->collectHeartbeats(Clock::mockValue, batches);
+    EXPECT_TRUE(batches.empty());
+
+    // not leader
+    peer->backoffUntil = TimePoint::min();
+    consensus->stepDown(7);
+    consensus->collectHeartbeats(Clock::mockValue, batches);
+    EXPECT_TRUE(batches.empty());
+}
+
+TEST_F(ServerRaftConsensusPATest, handleHeartbeatReply)
+{
+    Protocol::Raft::Heartbeat::Group request;
+    request.set_term(6);
+    request.set_committed_id(1);
+    request.set_leader_committed_id(1);
+    consensus->currentEpoch = 10;
+    peer->lastAckEpoch = 5;
+    peer->heartbeatInFlight = true;
+    consensus->handleHeartbeatReply(2, request, 4,
+                                    Clock::mockValue - milliseconds(3),
+                                    true, 6);
+    EXPECT_FALSE(peer->heartbeatInFlight);
+    EXPECT_EQ(3000U, peer->lastRTT);
+    // a later request was acknowledged already
+    EXPECT_EQ(5U, peer->lastAckEpoch);
+    EXPECT_EQ(Clock::mockValue - milliseconds(3), peer->lastAckTime);
+    consensus->handleHeartbeatReply(2, request, 7, Clock::mockValue, true, 6);
+    EXPECT_EQ(7U, peer->lastAckEpoch);
+
+    consensus->handleHeartbeatReply(2, request, 7, Clock::mockValue, false, 0);
+    EXPECT_EQ(Clock::mockValue +
+              milliseconds(RaftConsensus::RPC_FAILURE_BACKOFF_MS),
+              peer->backoffUntil);
+
+    consensus->handleHeartbeatReply(2, request, 7, Clock::mockValue, true, 8);
+    EXPECT_EQ(State::FOLLOWER, consensus->state);
+    EXPECT_EQ(8U, consensus->currentTerm);
+
+    // stale, but the next heartbeat may go out
+    peer->heartbeatInFlight = true;
+    consensus->handleHeartbeatReply(2, request, 7, Clock::mockValue, true, 9);
+    EXPECT_EQ(8U, consensus->currentTerm);
+    EXPECT_FALSE(peer->heartbeatInFlight);
+}
+
+TEST_F(ServerRaftConsensusPATest, getBatchLimit)
+{
+    RaftConsensus::SOFT_RPC_SIZE_LIMIT = 1024 * 1024;
+    consensus->replicationBatchBytes = 1000;
+    consensus->replicationMinBatchBytes = 100;
+    EXPECT_EQ(1000U, consensus->getBatchLimit(*peer));
+    peer->batchBytes = 10;
+    EXPECT_EQ(100U, consensus->getBatchLimit(*peer));
+    peer->batchBytes = 1UL << 40;
+    EXPECT_EQ(RaftConsensus::SOFT_RPC_SIZE_LIMIT,
+              consensus->getBatchLimit(*peer));
+    consensus->replicationMaxBytesInFlight = 5000;
+    EXPECT_EQ(5000U, consensus->getBatchLimit(*peer));
+    peer->batchBytes = 1000;
+    peer->bulkCatchUp = true;
+    EXPECT_EQ(5000U, consensus->getBatchLimit(*peer));
+    EXPECT_EQ(1000U, peer->batchBytes);
+}
+
+TEST_F(ServerRaftConsensusPATest, updateFlowControl)
+{
+    RaftConsensus::SOFT_RPC_SIZE_LIMIT = 1024 * 1024;
+    consensus->replicationMinBatchBytes = 1000;
+    consensus->replicationMaxBytesInFlight = 8000;
+    consensus->replicationTargetDelayMs = 1;
+    peer->batchBytes = 2000;
+
+    // first sample
+    consensus->updateFlowControl(*peer, 2000, true, 1000);
+    EXPECT_EQ(1000U, peer->minRTT);
+    EXPECT_EQ(1000U, peer->smoothedRTT);
+    EXPECT_EQ(2000000U, peer->bandwidth);
+    EXPECT_EQ(4000U, peer->batchBytes);
+
+    // prompt but not full: no change
+    consensus->updateFlowControl(*peer, 1000, false, 1800);
+    EXPECT_EQ(1100U, peer->smoothedRTT);
+    EXPECT_EQ(1000U, peer->minRTT);
+    EXPECT_EQ(4000U, peer->batchBytes);
+
+    // prompt and full: grows up to the in-flight limit
+    consensus->updateFlowControl(*peer, 4000, true, 2000);
+    EXPECT_EQ(8000U, peer->batchBytes);
+    consensus->updateFlowControl(*peer, 8000, true, 2000);
+    EXPECT_EQ(8000U, peer->batchBytes);
+
+    // slow: shrinks down to the minimum
+    consensus->updateFlowControl(*peer, 8000, true, 2001);
+    EXPECT_EQ(4000U, peer->batchBytes);
+    consensus->updateFlowControl(*peer, 4000, true, 5000);
+    consensus->updateFlowControl(*peer, 2000, true, 5000);
+    consensus->updateFlowControl(*peer, 1000, true, 5000);
+    EXPECT_EQ(1000U, peer->batchBytes);
+
+    // bulk catch-up requests only update the estimates
+    peer->bulkCatchUp = true;
+    consensus->updateFlowControl(*peer, 8000, true, 500);
+    EXPECT_EQ(500U, peer->minRTT);
+    EXPECT_EQ(1000U, peer->batchBytes);
+}
+
+TEST_F(ServerRaftConsensusPATest, getLeaderHint)
+{
+    // this server is leader
+    EXPECT_EQ("", consensus->getLeaderHint());
+    consensus->stepDown(7);
+    EXPECT_EQ("", consensus->getLeaderHint());
+    consensus->leadershipTransfer.targetId = 2;
+    EXPECT_EQ("127.0.0.1:61024", consensus->getLeaderHint());
+    consensus->leadershipTransfer.targetId = 0;
+    consensus->leaderId = 2;
+    EXPECT_EQ("127.0.0.1:61024", consensus->getLeaderHint());
+    consensus->stepDown(8);
+    consensus->leaderId = 3; // not in the configuration
+    EXPECT_EQ("", consensus->getLeaderHint());
+}
+
+TEST_F(ServerRaftConsensusPATest, transferLeadership_refused)
+{
+    uint64_t newLeaderId;
+    std::string reason;
+    EXPECT_EQ(ClientResult::FAIL,
+              consensus->transferLeadership(3, newLeaderId, reason));
+    EXPECT_EQ("Server 3 is not a voting server in the configuration",
+              reason);
+    consensus->leadershipTransfer.targetId = 2;
+    EXPECT_EQ(ClientResult::FAIL,
+              consensus->transferLeadership(2, newLeaderId, reason));
+    EXPECT_EQ("A transfer to server 2 is already in progress", reason);
+    consensus->leadershipTransfer.targetId = 0;
+}
+
+void
+transferLeadershipTimeoutHelper(RaftConsensus* consensus)
+{
+    EXPECT_EQ(2U, consensus->leadershipTransfer.targetId);
+    EXPECT_EQ(6U, consensus->leadershipTransfer.term);
+    Clock::mockValue += milliseconds(RaftConsensus::FOLLOWER_TIMEOUT_MS);
+}
+
+TEST_F(ServerRaftConsensusPATest, transferLeadership_timeout)
+{
+    consensus->stateChanged.callback =
+        std::bind(transferLeadershipTimeoutHelper, consensus.get());
+    uint64_t newLeaderId;
+    std::string reason;
+    EXPECT_EQ(ClientResult::FAIL,
+              consensus->transferLeadership(2, newLeaderId, reason));
+    EXPECT_EQ("Server 2 did not win an election within 5000 ms", reason);
+    EXPECT_EQ(State::LEADER, consensus->state);
+    EXPECT_EQ(0U, consensus->leadershipTransfer.targetId);
+}
+
+void
+transferLeadershipHelper(RaftConsensus* consensus)
+{
+    EXPECT_EQ(2U, consensus->leadershipTransfer.targetId);
+    consensus->stepDown(7);
+    consensus->leaderId = 2;
+}
+
+TEST_F(ServerRaftConsensusPATest, transferLeadership_ok)
+{
+    consensus->stateChanged.callback =
+        std::bind(transferLeadershipHelper, consensus.get());
+    uint64_t newLeaderId;
+    std::string reason;
+    EXPECT_EQ(ClientResult::SUCCESS,
+              consensus->transferLeadership(0, newLeaderId, reason));
+    EXPECT_EQ(2U, newLeaderId);
+    EXPECT_EQ(0U, consensus->leadershipTransfer.targetId);
+}
+
+TEST_F(ServerRaftConsensusPATest, timeoutNow_rpcFailed)
+{
+    Protocol::Raft::TimeoutNow::Request request;
+    request.set_server_id(1);
+    request.set_term(6);
+    peerService->closeSession(Protocol::Raft::OpCode::TIMEOUT_NOW, request);
+    // expect warning
+    LogCabin::Core::Debug::setLogPolicy({
+        {"Server/RaftConsensus.cc", "ERROR"}
+    });
+    consensus->leadershipTransfer.targetId = 2;
+    consensus->leadershipTransfer.term = 6;
+    std::unique_lock<Mutex> lockGuard(consensus->mutex);
+    consensus->timeoutNow(lockGuard, *peer);
+    EXPECT_LT(Clock::now(), peer->backoffUntil);
+    EXPECT_FALSE(consensus->leadershipTransfer.timeoutNowSent);
+    consensus->leadershipTransfer.targetId = 0;
+}
+
+TEST_F(ServerRaftConsensusPATest, timeoutNow_ok)
+{
+    Protocol::Raft::TimeoutNow::Request request;
+    request.set_server_id(1);
+    request.set_term(6);
+    Protocol::Raft::TimeoutNow::Response response;
+    response.set_term(7);
+    peerService->reply(Protocol::Raft::OpCode::TIMEOUT_NOW,
+                       request, response);
+    consensus->leadershipTransfer.targetId = 2;
+    consensus->leadershipTransfer.term = 6;
+    std::unique_lock<Mutex> lockGuard(consensus->mutex);
+    consensus->timeoutNow(lockGuard, *peer);
+    EXPECT_TRUE(consensus->leadershipTransfer.timeoutNowSent);
+    EXPECT_EQ(State::FOLLOWER, consensus->state);
+    EXPECT_EQ(7U, consensus->currentTerm);
+}
+
+TEST_F(ServerRaftConsensusPATest, appendEntry_leaveBulkCatchUp)
+{
+    consensus->replicationBatchBytes = 1;
+    consensus->replicationMinBatchBytes = 1;
+    consensus->bulkCatchUpThreshold = 100;
+    peer->bulkCatchUp = true;
+    request.mutable_entries()->RemoveLast();
+    request.mutable_entries()->RemoveLast();
+    request.set_committed_id(1);
+    peer->exiting = true;
+    peerService->reply(Protocol::Raft::OpCode::APPEND_ENTRY,
+                       request, response);
+    std::unique_lock<Mutex> lockGuard(consensus->mutex);
+    consensus->appendEntry(lockGuard, *peer);
+    EXPECT_FALSE(peer->bulkCatchUp);
+}
+
+TEST_F(ServerRaftConsensusTest, becomeLeader)
+{
+    init();
+    consensus->stepDown(5);
+    consensus->append(entry1);
+    EXPECT_EQ(5U, consensus->currentTerm);
+    consensus->startNewElection(); // calls becomeLeader
+    EXPECT_EQ(State::LEADER, consensus->state);
+    EXPECT_EQ(6U, consensus->currentTerm);
+    EXPECT_EQ(1U, consensus->leaderId);
+    EXPECT_EQ(TimePoint::max(), consensus->startElectionAt);
+}
+
+TEST_F(ServerRaftConsensusTest, interruptAll)
+{
+    init();
+    consensus->stateChanged.notificationCount = 0;
+    consensus->interruptAll();
+    EXPECT_EQ(1U, consensus->stateChanged.notificationCount);
+}
+
+TEST_F(ServerRaftConsensusTest, isLeaderReady)
+{
+    init();
+    consensus->stepDown(5);
+    consensus->append(entry1);
+    consensus->startNewElection();
+    EXPECT_TRUE(consensus->isLeaderReady());
+    consensus->append(entry2);
+    EXPECT_FALSE(consensus->isLeaderReady());
+    consensus->advanceCommittedId();
+    EXPECT_TRUE(consensus->isLeaderReady());
+    entry2.term = 6;
+    EXPECT_TRUE(consensus->isLeaderReady());
+    consensus->advanceCommittedId();
+    EXPECT_TRUE(consensus->isLeaderReady());
+}
+
+TEST_F(ServerRaftConsensusPATest, getReplicationLag)
+{
+    // peer hasn't responded yet
+    EXPECT_EQ(0U, consensus->getReplicationLag());
+    peer->lastAckTime = Clock::now();
+    EXPECT_EQ(3U, consensus->getReplicationLag());
+    peer->lastAgreeId = 2;
+    EXPECT_EQ(1U, consensus->getReplicationLag());
+    peer->bulkCatchUp = true;
+    EXPECT_EQ(0U, consensus->getReplicationLag());
+    peer->bulkCatchUp = false;
+    peer->lastAckTime = Clock::now() -
+        milliseconds(RaftConsensus::FOLLOWER_TIMEOUT_MS + 1);
+    EXPECT_EQ(0U, consensus->getReplicationLag());
+}
+
+TEST_F(ServerRaftConsensusTest, getApplyLag)
+{
+    init();
+    consensus->stepDown(5);
+    consensus->append(entry1);
+    consensus->startNewElection();
+    EXPECT_EQ(1U, consensus->committedId);
+    EXPECT_EQ(1U, consensus->getApplyLag());
+    consensus->getNextEntry(0);
+    EXPECT_EQ(1U, consensus->getApplyLag());
+    consensus->lastAppliedId = 1;
+    EXPECT_EQ(0U, consensus->getApplyLag());
+}
+
+TEST_F(ServerRaftConsensusPATest, isThrottled)
+{
+    EXPECT_FALSE(consensus->isThrottled());
+    consensus->backpressure.replicationLagHigh = 2;
+    consensus->backpressure.replicationLagLow = 1;
+    peer->lastAckTime = Clock::now();
+    EXPECT_TRUE(consensus->isThrottled());
+    EXPECT_EQ(1U, consensus->backpressure.throttleEvents.get());
+    peer->lastAgreeId = 1;
+    EXPECT_TRUE(consensus->isThrottled());
+    peer->lastAgreeId = 2;
+    EXPECT_FALSE(consensus->isThrottled());
+
+    consensus->backpressure.applyLagHigh = 1;
+    consensus->lastAppliedId = 0;
+    consensus->committedId = 2;
+    EXPECT_TRUE(consensus->isThrottled());
+    EXPECT_EQ(2U, consensus->backpressure.throttleEvents.get());
+    consensus->lastAppliedId = 2;
+    EXPECT_FALSE(consensus->isThrottled());
+}
+
+class ApplyHelper {
+    explicit ApplyHelper(RaftConsensus& consensus)
+        : consensus(consensus)
+        , iter(0)
+    {
+    }
+    void operator()() {
+        ++iter;
+        consensus.lastAppliedId = consensus.committedId;
+    }
+    RaftConsensus& consensus;
+    uint64_t iter;
+};
+
+TEST_F(ServerRaftConsensusTest, replicate_throttled)
+{
+    init();
+    consensus->stepDown(5);
+    consensus->append(entry1);
+    consensus->startNewElection();
+    consensus->backpressure.applyLagHigh = 1;
+    consensus->backpressure.applyLagLow = 0;
+    EXPECT_EQ(ClientResult::SUCCESS,
+              consensus->replicate(Core::Payload("a")).first);
+    EXPECT_EQ(0U, consensus->backpressure.throttleWait.getSnapshot().count);
+
+    ApplyHelper helper(*consensus);
+    consensus->stateChanged.callback = std::ref(helper);
+    std::pair<ClientResult, uint64_t> result =
+        consensus->replicate(Core::Payload("b"));
+    EXPECT_EQ(ClientResult::SUCCESS, result.first);
+    EXPECT_EQ(3U, result.second);
+    EXPECT_EQ(1U, helper.iter);
+    EXPECT_FALSE(consensus->backpressure.throttled);
+    EXPECT_EQ(1U, consensus->backpressure.throttleEvents.get());
+    EXPECT_EQ(1U, consensus->backpressure.throttleWait.getSnapshot().count);
+}
+
+TEST_F(ServerRaftConsensusTest, replicate_leadershipTransfer)
+{
+    init();
+    consensus->stepDown(5);
+    consensus->append(entry1);
+    consensus->startNewElection();
+    consensus->leadershipTransfer.targetId = 2;
+    consensus->leadershipTransfer.term = consensus->currentTerm;
+    consensus->stateChanged.callback = std::bind(&RaftConsensus::stepDown,
+                                                 consensus.get(), 7);
+    EXPECT_EQ(ClientResult::NOT_LEADER,
+              consensus->replicate(Core::Payload("a")).first);
+    EXPECT_EQ(1U, consensus->log->getLastLogId());
+}
+
+TEST_F(ServerRaftConsensusTest, transferLeadership_noOtherServers)
+{
+    init();
+    uint64_t newLeaderId = 5;
+    std::string reason;
+    EXPECT_EQ(ClientResult::NOT_LEADER,
+              consensus->transferLeadership(0, newLeaderId, reason));
+    EXPECT_EQ(0U, newLeaderId);
+    consensus->stepDown(5);
+    consensus->append(entry1);
+    consensus->startNewElection();
+    EXPECT_EQ(ClientResult::FAIL,
+              consensus->transferLeadership(0, newLeaderId, reason));
+    EXPECT_EQ("There are no other voting servers", reason);
+    EXPECT_EQ(0U, consensus->leadershipTransfer.targetId);
+}
+
+TEST_F(ServerRaftConsensusTest, replicateEntry_notLeader)
 {
     init();
     std::unique_lock<Mutex> lockGuard(consensus->mutex);
@@ -1443,6 +2314,36 @@ TEST_F(ServerRaftConsensusPTest, requestVote_ignoreResult)
     EXPECT_FALSE(peer.requestVoteDone);
 }
 
+TEST_F(ServerRaftConsensusPTest, requestVote_groupId)
+{
+    consensus->groupId = 2;
+    init();
+    consensus->stepDown(5);
+    consensus->append(entry5);
+    Peer& peer = *getPeer(2);
+
+    Protocol::Raft::RequestVote::Request request;
+    request.set_server_id(1);
+    request.set_term(5);
+    request.set_last_log_term(5);
+    request.set_last_log_id(1);
+    request.set_group_id(2);
+
+    Protocol::Raft::RequestVote::Response response;
+    response.set_term(5);
+    response.set_granted(false);
+    response.set_last_log_term(0);
+    response.set_last_log_id(0);
+    response.set_begin_last_term_id(0);
+
+    // The mock service only replies if the request matches.
+    peerService->reply(Protocol::Raft::OpCode::REQUEST_VOTE,
+                       request, response);
+    std::unique_lock<Mutex> lockGuard(consensus->mutex);
+    consensus->requestVote(lockGuard, peer);
+    EXPECT_FALSE(peer.requestVoteDone);
+}
+
 TEST_F(ServerRaftConsensusPTest, requestVote_termStale)
 {
     init();
@@ -1488,6 +2389,144 @@ TEST_F(ServerRaftConsensusPTest, requestVote_termStale)
     EXPECT_EQ(9U, consensus->currentTerm);
 }
 
+TEST_F(ServerRaftConsensusPTest, requestPreVote_rpcFailed)
+{
+    init();
+    consensus->stepDown(5);
+    consensus->append(entry5);
+    consensus->startPreVote();
+    EXPECT_EQ(State::PRE_CANDIDATE, consensus->state);
+    Peer& peer = *getPeer(2);
+
+    Protocol::Raft::RequestVote::Request request;
+    request.set_server_id(1);
+    request.set_term(6);
+    request.set_last_log_term(5);
+    request.set_last_log_id(1);
+    request.set_pre_vote(true);
+
+    peerService->closeSession(Protocol::Raft::OpCode::REQUEST_VOTE, request);
+    // expect warning
+    LogCabin::Core::Debug::setLogPolicy({
+        {"Server/RaftConsensus.cc", "ERROR"}
+    });
+    std::unique_lock<Mutex> lockGuard(consensus->mutex);
+    consensus->requestPreVote(lockGuard, peer);
+    EXPECT_LT(Clock::now(), peer.backoffUntil);
+    EXPECT_FALSE(peer.requestVoteDone);
+
+    // the next round tries again right away
+    consensus->startPreVote();
+    EXPECT_EQ(TimePoint::min(), peer.backoffUntil);
+}
+
+TEST_F(ServerRaftConsensusPTest, requestPreVote_ignoreResult)
+{
+    init();
+    consensus->stepDown(5);
+    consensus->append(entry5);
+    // don't become pre-candidate so the response is ignored
+    Peer& peer = *getPeer(2);
+
+    Protocol::Raft::RequestVote::Request request;
+    request.set_server_id(1);
+    request.set_term(6);
+    request.set_last_log_term(5);
+    request.set_last_log_id(1);
+    request.set_pre_vote(true);
+
+    Protocol::Raft::RequestVote::Response response;
+    response.set_term(5);
+    response.set_granted(true);
+    response.set_last_log_term(0);
+    response.set_last_log_id(0);
+    response.set_begin_last_term_id(0);
+
+    peerService->reply(Protocol::Raft::OpCode::REQUEST_VOTE,
+                       request, response);
+    std::unique_lock<Mutex> lockGuard(consensus->mutex);
+    consensus->requestPreVote(lockGuard, peer);
+    EXPECT_FALSE(peer.requestVoteDone);
+    EXPECT_EQ(State::FOLLOWER, consensus->state);
+    EXPECT_EQ(5U, consensus->currentTerm);
+}
+
+TEST_F(ServerRaftConsensusPTest, requestPreVote_termStale)
+{
+    init();
+    consensus->stepDown(5);
+    consensus->append(entry5);
+    consensus->startPreVote();
+    Peer& peer = *getPeer(2);
+
+    Protocol::Raft::RequestVote::Request request;
+    request.set_server_id(1);
+    request.set_term(6);
+    request.set_last_log_term(5);
+    request.set_last_log_id(1);
+    request.set_pre_vote(true);
+
+    Protocol::Raft::RequestVote::Response response;
+    response.set_term(8);
+    response.set_granted(false);
+    response.set_last_log_term(0);
+    response.set_last_log_id(0);
+    response.set_begin_last_term_id(0);
+
+    peerService->reply(Protocol::Raft::OpCode::REQUEST_VOTE,
+                       request, response);
+    std::unique_lock<Mutex> lockGuard(consensus->mutex);
+    consensus->requestPreVote(lockGuard, peer);
+    EXPECT_EQ(State::FOLLOWER, consensus->state);
+    EXPECT_EQ(8U, consensus->currentTerm);
+    EXPECT_EQ(0U, consensus->votedFor);
+}
+
+TEST_F(ServerRaftConsensusPTest, requestPreVote_granted)
+{
+    init();
+    consensus->stepDown(5);
+    consensus->append(entry5);
+    consensus->startPreVote();
+    Peer& peer = *getPeer(2);
+
+    Protocol::Raft::RequestVote::Request request;
+    request.set_server_id(1);
+    request.set_term(6);
+    request.set_last_log_term(5);
+    request.set_last_log_id(1);
+    request.set_pre_vote(true);
+
+    Protocol::Raft::RequestVote::Response response;
+    response.set_term(5);
+    response.set_granted(false);
+    response.set_last_log_term(0);
+    response.set_last_log_id(0);
+    response.set_begin_last_term_id(0);
+
+    // refused
+    peerService->reply(Protocol::Raft::OpCode::REQUEST_VOTE,
+                       request, response);
+    std::unique_lock<Mutex> lockGuard(consensus->mutex);
+    consensus->requestPreVote(lockGuard, peer);
+    EXPECT_TRUE(peer.requestVoteDone);
+    EXPECT_FALSE(peer.haveVote_);
+    EXPECT_EQ(State::PRE_CANDIDATE, consensus->state);
+    EXPECT_EQ(5U, consensus->currentTerm);
+
+    // granted: with 2 of 2 servers, that's enough to run for real
+    consensus->startPreVote();
+    response.set_granted(true);
+    peerService->reply(Protocol::Raft::OpCode::REQUEST_VOTE,
+                       request, response);
+    consensus->requestPreVote(lockGuard, peer);
+    EXPECT_EQ(State::CANDIDATE, consensus->state);
+    EXPECT_EQ(6U, consensus->currentTerm);
+    EXPECT_EQ(1U, consensus->votedFor);
+    // the real election asks again
+    EXPECT_FALSE(peer.requestVoteDone);
+}
+
 TEST_F(ServerRaftConsensusPTest, requestVote_termOkAsLeader)
 {
     init();
@@ -1612,6 +2651,22 @@ TEST_F(ServerRaftConsensusTest, setFollowerTimer)
     }
 }
 
+TEST_F(ServerRaftConsensusTest, setFollowerTimer_preferredLeader)
+{
+    init();
+    consensus->preferredLeader = true;
+    for (uint64_t i = 0; i < 100; ++i) {
+        TimePoint before = Clock::now();
+        consensus->setFollowerTimer();
+        EXPECT_LE(before +
+                  milliseconds(RaftConsensus::FOLLOWER_TIMEOUT_MS * 3 / 4),
+                  consensus->startElectionAt);
+        EXPECT_GE(Clock::now() +
+                  milliseconds(RaftConsensus::FOLLOWER_TIMEOUT_MS),
+                  consensus->startElectionAt);
+    }
+}
+
 TEST_F(ServerRaftConsensusTest, setCandidateTimer)
 {
     // TODO(ongaro): seed the random number generator and make sure the values
@@ -1674,6 +2729,80 @@ TEST_F(ServerRaftConsensusTest, startNewElection)
     EXPECT_EQ(State::FOLLOWER, consensus->state);
 }
 
+TEST_F(ServerRaftConsensusTest, startNewElection_learner)
+{
+    init();
+    entry1.configuration = desc(
+        "prev_configuration {"
+        "    servers { server_id: 2, address: '127.0.0.1:61024' }"
+        "}"
+        "learners {"
+        "    servers { server_id: 1, address: '127.0.0.1:61023' }"
+        "}");
+    consensus->stepDown(1);
+    consensus->append(entry1);
+    EXPECT_TRUE(consensus->configuration->isLearner(
+                    consensus->configuration->localServer));
+
+    // learners never run, but they do reset their timer so that the
+    // candidacy thread goes back to sleep
+    Clock::mockValue = consensus->startElectionAt + milliseconds(1);
+    consensus->startNewElection();
+    EXPECT_EQ(State::FOLLOWER, consensus->state);
+    EXPECT_EQ(1U, consensus->currentTerm);
+    EXPECT_LT(Clock::now(), consensus->startElectionAt);
+    Clock::mockValue = consensus->startElectionAt + milliseconds(1);
+    consensus->startPreVote();
+    EXPECT_EQ(State::FOLLOWER, consensus->state);
+    EXPECT_EQ(0U, consensus->electionAttempt);
+    EXPECT_LT(Clock::now(), consensus->startElectionAt);
+}
+
+TEST_F(ServerRaftConsensusTest, startPreVote)
+{
+    init();
+
+    // need other votes
+    consensus->stepDown(5);
+    consensus->append(entry1);
+    consensus->append(entry5);
+    consensus->startPreVote();
+    EXPECT_EQ(State::PRE_CANDIDATE, consensus->state);
+    EXPECT_EQ(1U, consensus->electionAttempt);
+    EXPECT_EQ(5U, consensus->currentTerm);
+    EXPECT_EQ(0U, consensus->votedFor);
+    EXPECT_LT(Clock::now(), consensus->startElectionAt);
+
+    // a candidate that times out goes back to pre-voting in its term
+    consensus->startNewElection();
+    EXPECT_EQ(State::CANDIDATE, consensus->state);
+    EXPECT_EQ(6U, consensus->currentTerm);
+    consensus->startPreVote();
+    EXPECT_EQ(State::PRE_CANDIDATE, consensus->state);
+    EXPECT_EQ(6U, consensus->currentTerm);
+    EXPECT_EQ(1U, consensus->votedFor);
+
+    // already won
+    consensus->stepDown(7);
+    entry1.term = 7;
+    consensus->append(entry1);
+    consensus->startPreVote();
+    EXPECT_EQ(State::LEADER, consensus->state);
+    EXPECT_EQ(8U, consensus->currentTerm);
+
+    // not part of current configuration
+    consensus->stepDown(10);
+    entry1.term = 9;
+    entry1.configuration = desc(
+        "prev_configuration {"
+            "servers { server_id: 2, address: '127.0.0.1:61025' }"
+        "}");
+    consensus->append(entry1);
+    consensus->startPreVote();
+    EXPECT_EQ(State::FOLLOWER, consensus->state);
+    EXPECT_EQ(10U, consensus->currentTerm);
+}
+
 TEST_F(ServerRaftConsensusTest, stepDown)
 {
     init();
@@ -25,6 +25,7 @@
 #include "RPC/Buffer.h"
 #include "RPC/ProtoBuf.h"
 #include "Storage/FilesystemUtil.h"
+#include "Storage/LatencyModule.h"
 #include "Server/RaftLog.h"
 
 namespace LogCabin {
@@ -95,7 +96,9 @@ Log::Entry::Entry()
 Log::Log(const std::string& path)
     : path(path)
     , metadata()
+    , writeLatency()
     , entries()
+    , dataBytes(0)
 {
     if (!path.empty()) {
         if (mkdir(path.c_str(), 0755) == 0) {
@@ -123,6 +126,10 @@ Log::Log(const std::string& path)
     }
 }
 
+Log::~Log()
+{
+}
+
 std::vector<uint64_t>
 Log::getEntryIds() const
 {
@@ -159,7 +166,7 @@ Log::read(const std::string& entryPath) const
     if (entry.type == Protocol::Raft::EntryType::CONFIGURATION)
         entry.configuration = entryProto.configuration();
     else
-        entry.data = entryProto.data();
+        entry.data = Core::Payload(std::move(*entryProto.mutable_data()));
     return entry;
 }
 
@@ -169,17 +176,21 @@ Log::append(const Entry& entry)
     entries.push_back(entry);
     uint64_t entryId = entries.size();
     entries.back().entryId = entryId;
+    dataBytes += entry.data.size();
     if (!path.empty()) {
+        Core::Time::SteadyClock::time_point start =
+            Core::Time::SteadyClock::now();
         Protocol::Raft::Entry entryProto;
         entryProto.set_term(entry.term);
         entryProto.set_type(entry.type);
         if (entry.type == Protocol::Raft::EntryType::CONFIGURATION)
             *entryProto.mutable_configuration() = entry.configuration;
         else
-            entryProto.set_data(entry.data);
+            entryProto.set_data(entry.data.data(), entry.data.size());
         protoToFile(entryProto, Core::StringUtil::format("%s/%016lx",
                                                          path.c_str(),
                                                          entryId));
+        writeLatency.recordMicrosSince(start);
     }
     return entryId;
 }
@@ -205,6 +216,12 @@ Log::getEntry(uint64_t entryId) const
     return entries.at(index);
 }
 
+uint64_t
+Log::getDataBytes() const
+{
+    return dataBytes;
+}
+
 uint64_t
 Log::getLastLogId() const
 {
@@ -234,6 +251,11 @@ Log::truncate(uint64_t lastEntryId)
                                                                  entryId));
             }
         }
+        for (auto it = entries.begin() + int64_t(lastEntryId);
+             it != entries.end();
+             ++it) {
+            dataBytes -= it->data.size();
+        }
         entries.resize(lastEntryId);
     }
 }
@@ -242,10 +264,48 @@ void
 Log::updateMetadata()
 {
     if (!path.empty()) {
+        Core::Time::SteadyClock::time_point start =
+            Core::Time::SteadyClock::now();
         protoToFile(metadata, path + "/metadata");
+        writeLatency.recordMicrosSince(start);
     }
 }
 
+////////// LatencyLog //////////
+
+LatencyLog::LatencyLog(const std::string& path,
+                       std::unique_ptr<Storage::LatencyInjector> injector)
+    : Log(path)
+    , injector(std::move(injector))
+{
+}
+
+LatencyLog::~LatencyLog()
+{
+}
+
+uint64_t
+LatencyLog::append(const Entry& entry)
+{
+    injector->write(entry.data.size());
+    return Log::append(entry);
+}
+
+void
+LatencyLog::truncate(uint64_t lastEntryId)
+{
+    if (lastEntryId < getLastLogId())
+        injector->sync();
+    Log::truncate(lastEntryId);
+}
+
+void
+LatencyLog::updateMetadata()
+{
+    injector->write(uint64_t(metadata.ByteSize()));
+    Log::updateMetadata();
+}
+
 // TODO(ongaro): worry about corruption
 // TODO(ongaro): worry about fail-stop
 
@@ -14,16 +14,25 @@
  */
 
 #include <cinttypes>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "build/Protocol/Raft.pb.h"
 #include "build/Server/RaftLogMetadata.pb.h"
+#include "Core/Payload.h"
+#include "Core/Stats.h"
 
 #ifndef LOGCABIN_SERVER_RAFTLOG_H
 #define LOGCABIN_SERVER_RAFTLOG_H
 
 namespace LogCabin {
+
+// forward declaration
+namespace Storage {
+class LatencyInjector;
+}
+
 namespace Server {
 
 // forward declaration
@@ -42,12 +51,19 @@ class Log {
         uint64_t entryId;
         uint64_t term;
         Protocol::Raft::EntryType type;
-        std::string data;
+        /**
+         * The operation for a DATA entry. Copies of the entry, including the
+         * ones handed to the state machine, share this memory.
+         */
+        Core::Payload data;
         Protocol::Raft::Configuration configuration;
     };
 
     explicit Log(const std::string& path = "");
 
+    /// Destructor.
+    virtual ~Log();
+
     /**
      * Append a new entry to the log.
      * \param entry
@@ -55,7 +71,7 @@ class Log {
      * \return
      *      The newly appended entry's entryId.
      */
-    uint64_t append(const Entry& entry);
+    virtual uint64_t append(const Entry& entry);
 
     /**
      * Get the entry ID of the earliest entry with the same term as the last
@@ -82,6 +98,13 @@ class Log {
      */
     uint64_t getLastLogId() const;
 
+    /**
+     * Get the total size of the data in the log's entries.
+     * \return
+     *      The sum of the lengths of every entry's data, in bytes.
+     */
+    uint64_t getDataBytes() const;
+
     /**
      * Get the term of an entry in the log.
      * \param entryId
@@ -99,12 +122,12 @@ class Log {
      *      than lastEntryId. This can be any entry ID, including 0 and those
      *      past the end of the log.
      */
-    void truncate(uint64_t lastEntryId);
+    virtual void truncate(uint64_t lastEntryId);
 
     /**
      * Call this after changing #metadata.
      */
-    void updateMetadata();
+    virtual void updateMetadata();
 
     std::string path;
 
@@ -113,6 +136,11 @@ class Log {
      */
     RaftLogMetadata::Metadata metadata;
 
+    /**
+     * The time spent writing entries and metadata to disk, in microseconds.
+     */
+    Core::Stats::Histogram writeLatency;
+
   private:
 
     std::vector<uint64_t> getEntryIds() const;
@@ -123,11 +151,42 @@ class Log {
     /** index is EntryId - 1 */
     std::vector<Entry> entries;
 
+    /**
+     * See getDataBytes().
+     */
+    uint64_t dataBytes;
+
     // Log is not copyable
     Log(const Log&) = delete;
     Log& operator=(const Log&) = delete;
 };
 
+/**
+ * A Log that delays its writes to simulate a slow disk, for benchmarking how
+ * disk latency affects commit latency and leader stability. The delays are
+ * configured as described in Storage::LatencyInjector, using the prefix
+ * "raftLogLatency". Reads and the initial load of the log are not delayed.
+ */
+class LatencyLog : public Log {
+  public:
+    /**
+     * Constructor.
+     * \param path
+     *      See Log::Log().
+     * \param injector
+     *      Decides how long to delay each write.
+     */
+    LatencyLog(const std::string& path,
+               std::unique_ptr<Storage::LatencyInjector> injector);
+    ~LatencyLog();
+    uint64_t append(const Entry& entry);
+    void truncate(uint64_t lastEntryId);
+    void updateMetadata();
+  private:
+    /// See constructor.
+    std::unique_ptr<Storage::LatencyInjector> injector;
+};
+
 } // namespace LogCabin::Server::RaftConsensusInternal
 } // namespace LogCabin::Server
 } // namespace LogCabin
@@ -0,0 +1,110 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string>
+
+#include "bench/Bench.h"
+#include "Server/RaftLog.h"
+#include "Storage/FilesystemUtil.h"
+
+namespace LogCabin {
+namespace Server {
+namespace {
+
+using namespace RaftConsensusInternal; // NOLINT
+
+/**
+ * Return an entry with a payload of the given size.
+ */
+Log::Entry
+makeEntry(uint32_t dataLength)
+{
+    Log::Entry entry;
+    entry.term = 1;
+    entry.type = Protocol::Raft::EntryType::DATA;
+    entry.data = Core::Payload(std::string(dataLength, 'x'));
+    return entry;
+}
+
+BENCHMARK(ServerRaftLog, appendMemory64B) {
+    Log log;
+    Log::Entry entry = makeEntry(64);
+    state.setBytesPerIteration(64);
+    for (uint64_t i = 0; i < state.iterations; ++i)
+        log.append(entry);
+}
+
+BENCHMARK(ServerRaftLog, appendMemory4KB) {
+    Log log;
+    Log::Entry entry = makeEntry(4096);
+    state.setBytesPerIteration(4096);
+    for (uint64_t i = 0; i < state.iterations; ++i)
+        log.append(entry);
+}
+
+BENCHMARK(ServerRaftLog, appendDisk64B) {
+    state.pauseTiming();
+    std::string path = Storage::FilesystemUtil::tmpnam();
+    {
+        Log log(path);
+        Log::Entry entry = makeEntry(64);
+        state.setBytesPerIteration(64);
+        state.resumeTiming();
+        for (uint64_t i = 0; i < state.iterations; ++i)
+            log.append(entry);
+        state.pauseTiming();
+    }
+    Storage::FilesystemUtil::remove(path);
+}
+
+BENCHMARK(ServerRaftLog, getEntry) {
+    state.pauseTiming();
+    Log log;
+    Log::Entry entry = makeEntry(64);
+    for (uint32_t i = 0; i < 1000; ++i)
+        log.append(entry);
+    state.resumeTiming();
+    for (uint64_t i = 0; i < state.iterations; ++i)
+        Bench::doNotOptimize(log.getEntry(i % 1000 + 1));
+}
+
+BENCHMARK(ServerRaftLog, getTerm) {
+    state.pauseTiming();
+    Log log;
+    Log::Entry entry = makeEntry(64);
+    for (uint32_t i = 0; i < 1000; ++i)
+        log.append(entry);
+    state.resumeTiming();
+    for (uint64_t i = 0; i < state.iterations; ++i)
+        Bench::doNotOptimize(log.getTerm(i % 1000 + 1));
+}
+
+BENCHMARK(ServerRaftLog, truncate) {
+    state.pauseTiming();
+    Log log;
+    Log::Entry entry = makeEntry(64);
+    log.append(entry);
+    state.resumeTiming();
+    // Each iteration truncates away one entry after appending it, so the
+    // cost of the append is included.
+    for (uint64_t i = 0; i < state.iterations; ++i) {
+        log.append(entry);
+        log.truncate(1);
+    }
+}
+
+} // namespace LogCabin::Server::<anonymous>
+} // namespace LogCabin::Server
+} // namespace LogCabin
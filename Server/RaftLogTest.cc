@@ -15,7 +15,9 @@
 
 #include <gtest/gtest.h>
 #include <stdexcept>
+#include "Core/Config.h"
 #include "Server/RaftLog.h"
+#include "Storage/LatencyModule.h"
 
 namespace LogCabin {
 namespace Server {
@@ -30,7 +32,7 @@ class ServerRaftLogTest : public ::testing::Test {
     {
         sampleEntry.entryId = 300;
         sampleEntry.term = 40;
-        sampleEntry.data = "foo";
+        sampleEntry.data = Core::Payload("foo");
     }
     Log log;
     Log::Entry sampleEntry;
@@ -42,7 +44,7 @@ TEST_F(ServerRaftLogTest, basic)
     Log::Entry entry = log.getEntry(1);
     EXPECT_EQ(1U, entry.entryId);
     EXPECT_EQ(40U, entry.term);
-    EXPECT_EQ("foo", entry.data);
+    EXPECT_EQ("foo", entry.data.toString());
 }
 
 TEST_F(ServerRaftLogTest, getBeginLastTermId)
@@ -57,12 +59,25 @@ TEST_F(ServerRaftLogTest, getBeginLastTermId)
     EXPECT_EQ(3U, log.getBeginLastTermId());
 }
 
+TEST_F(ServerRaftLogTest, getDataBytes)
+{
+    EXPECT_EQ(0U, log.getDataBytes());
+    log.append(sampleEntry);
+    sampleEntry.data = Core::Payload("hello");
+    log.append(sampleEntry);
+    EXPECT_EQ(8U, log.getDataBytes());
+    log.truncate(1);
+    EXPECT_EQ(3U, log.getDataBytes());
+    log.truncate(0);
+    EXPECT_EQ(0U, log.getDataBytes());
+}
+
 TEST_F(ServerRaftLogTest, getEntry)
 {
     Log::Entry entry = log.getEntry(log.append(sampleEntry));
     EXPECT_EQ(1U, entry.entryId);
     EXPECT_EQ(40U, entry.term);
-    EXPECT_EQ("foo", entry.data);
+    EXPECT_EQ("foo", entry.data.toString());
     EXPECT_THROW(log.getEntry(0), std::out_of_range);
     EXPECT_THROW(log.getEntry(2), std::out_of_range);
 }
@@ -102,6 +117,25 @@ TEST_F(ServerRaftLogTest, truncate)
     EXPECT_EQ(0U, log.getLastLogId());
 }
 
+TEST_F(ServerRaftLogTest, latencyLog)
+{
+    Core::Config config;
+    config.set("testAppend", "1000");
+    std::unique_ptr<Storage::LatencyInjector> injector(
+        new Storage::LatencyInjector(config, "test"));
+    LatencyLog latencyLog("", std::move(injector));
+    Log& log = latencyLog;
+    typedef Core::Time::SteadyClock Clock;
+    Clock::time_point start = Clock::now();
+    EXPECT_EQ(1U, log.append(sampleEntry));
+    log.metadata.set_current_term(4);
+    log.updateMetadata();
+    EXPECT_LE(std::chrono::microseconds(2000), Clock::now() - start);
+    EXPECT_EQ("foo", log.getEntry(1).data.toString());
+    log.truncate(0);
+    EXPECT_EQ(0U, log.getLastLogId());
+}
+
 #if 0
 TEST_F(ServerRaftLogTest, init)
 {
@@ -39,6 +39,11 @@ RaftService::handleRPC(RPC::ServerRPC rpc)
 {
     using Protocol::Raft::OpCode;
 
+    // Raft's replies are all small, and the leader relies on them arriving
+    // promptly (they acknowledge heartbeats and grant votes), so they're sent
+    // ahead of anything bulky this server has queued on the same session.
+    rpc.setPriority(RPC::MessageSocket::Priority::CONTROL);
+
     // Call the appropriate RPC handler based on the request's opCode.
     switch (rpc.getOpCode()) {
         case OpCode::APPEND_ENTRY:
@@ -47,6 +52,12 @@ RaftService::handleRPC(RPC::ServerRPC rpc)
         case OpCode::REQUEST_VOTE:
             requestVote(std::move(rpc));
             break;
+        case OpCode::TIMEOUT_NOW:
+            timeoutNow(std::move(rpc));
+            break;
+        case OpCode::HEARTBEAT:
+            heartbeat(std::move(rpc));
+            break;
         default:
             WARNING("Client sent request with bad op code (%u) to RaftService",
                     rpc.getOpCode());
@@ -60,15 +71,41 @@ RaftService::getName() const
     return "RaftService";
 }
 
+namespace {
+
+/**
+ * Return the consensus module for the given Raft group, or NULL if this
+ * server doesn't run that group, in which case the RPC is rejected.
+ */
+RaftConsensus*
+getGroup(Globals& globals, RPC::ServerRPC& rpc, uint32_t groupId)
+{
+    if (groupId < globals.rafts.size())
+        return globals.rafts.at(groupId).get();
+    if (groupId == 0) // some unit tests only set globals.raft
+        return globals.raft.get();
+    WARNING("Server sent request for Raft group %u, but this server only "
+            "runs %lu groups. Check the raftGroups setting.",
+            groupId, globals.rafts.size());
+    rpc.rejectInvalidRequest();
+    return NULL;
+}
+
+} // anonymous namespace
+
 /**
  * Place this at the top of each RPC handler. Afterwards, 'request' will refer
  * to the protocol buffer for the request with all required fields set.
  * 'response' will be an empty protocol buffer for you to fill in the response.
+ * 'raft' will refer to the consensus module for the request's Raft group.
  */
 #define PRELUDE(rpcClass) \
     Protocol::Raft::rpcClass::Request request; \
     Protocol::Raft::rpcClass::Response response; \
     if (!rpc.getRequest(request)) \
+        return; \
+    RaftConsensus* raft = getGroup(globals, rpc, request.group_id()); \
+    if (raft == NULL) \
         return;
 
 ////////// RPC handlers //////////
@@ -79,7 +116,7 @@ RaftService::appendEntry(RPC::ServerRPC rpc)
     PRELUDE(AppendEntry);
     //VERBOSE("AppendEntry:\n%s",
     //        Core::ProtoBuf::dumpString(request, false).c_str());
-    globals.raft->handleAppendEntry(request, response);
+    raft->handleAppendEntry(request, response);
     rpc.reply(response);
 }
 
@@ -89,7 +126,40 @@ RaftService::requestVote(RPC::ServerRPC rpc)
     PRELUDE(RequestVote);
     //VERBOSE("RequestVote:\n%s",
     //        Core::ProtoBuf::dumpString(request, false).c_str());
-    globals.raft->handleRequestVote(request, response);
+    raft->handleRequestVote(request, response);
+    rpc.reply(response);
+}
+
+void
+RaftService::timeoutNow(RPC::ServerRPC rpc)
+{
+    PRELUDE(TimeoutNow);
+    raft->handleTimeoutNow(request, response);
+    rpc.reply(response);
+}
+
+void
+RaftService::heartbeat(RPC::ServerRPC rpc)
+{
+    // This covers several Raft groups, so it doesn't use PRELUDE.
+    Protocol::Raft::Heartbeat::Request request;
+    Protocol::Raft::Heartbeat::Response response;
+    if (!rpc.getRequest(request))
+        return;
+    // Check every group first, so that a bad request has no effect.
+    std::vector<RaftConsensus*> rafts;
+    for (auto it = request.groups().begin();
+         it != request.groups().end();
+         ++it) {
+        RaftConsensus* raft = getGroup(globals, rpc, it->group_id());
+        if (raft == NULL)
+            return;
+        rafts.push_back(raft);
+    }
+    for (int i = 0; i < request.groups_size(); ++i) {
+        response.add_terms(rafts.at(uint64_t(i))->handleHeartbeat(
+            request.server_id(), request.groups(i)));
+    }
     rpc.reply(response);
 }
 
@@ -42,6 +42,8 @@ class RaftService : public RPC::Service {
 
     void requestVote(RPC::ServerRPC rpc);
     void appendEntry(RPC::ServerRPC rpc);
+    void timeoutNow(RPC::ServerRPC rpc);
+    void heartbeat(RPC::ServerRPC rpc);
 
     /**
      * The LogCabin daemon's top-level objects.
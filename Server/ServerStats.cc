@@ -0,0 +1,164 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "Core/LockProfiler.h"
+#include "Protocol/Common.h"
+#include "RPC/Server.h"
+#include "RPC/ThreadDispatchService.h"
+#include "Server/RaftConsensus.h"
+#include "Server/Globals.h"
+#include "Server/ServerStats.h"
+#include "Server/StateMachine.h"
+
+namespace LogCabin {
+namespace Server {
+
+ServerStats::ServerStats(Globals& globals)
+    : globals(globals)
+{
+}
+
+ServerStats::~ServerStats()
+{
+}
+
+Protocol::Client::ServerStats
+ServerStats::getCurrent()
+{
+    Protocol::Client::ServerStats stats;
+
+    // Read the state machine's progress first, so that the apply lag computed
+    // below is never negative.
+    uint64_t lastAppliedId = 0;
+    if (globals.stateMachine) {
+        lastAppliedId = globals.stateMachine->getLastAppliedId();
+        globals.stateMachine->updateServerStats(stats);
+    }
+    if (globals.raft) {
+        globals.raft->updateServerStats(stats);
+    } else {
+        stats.set_server_id(0);
+        stats.set_current_term(0);
+        stats.set_state("UNKNOWN");
+        stats.set_leader_id(0);
+        stats.set_committed_id(0);
+        setHistogram(Core::Stats::Histogram::Snapshot(),
+                     *stats.mutable_commit_latency());
+        Protocol::Client::ServerStats::Log& log = *stats.mutable_log();
+        log.set_num_entries(0);
+        log.set_bytes(0);
+        setHistogram(Core::Stats::Histogram::Snapshot(),
+                     *log.mutable_write_latency());
+    }
+    stats.set_last_applied_id(lastAppliedId);
+    if (stats.committed_id() > lastAppliedId)
+        stats.set_apply_lag(stats.committed_id() - lastAppliedId);
+    else
+        stats.set_apply_lag(0);
+
+    if (globals.rpcServer) {
+        RPC::OpaqueServer::ConnectionStats connectionStats =
+            globals.rpcServer->getConnectionStats();
+        Protocol::Client::ServerStats::Connections& connections =
+            *stats.mutable_connections();
+        connections.set_open(connectionStats.numOpen);
+        connections.set_accepted(connectionStats.numAccepted);
+        connections.set_idle_closed(connectionStats.numIdleClosed);
+        connections.set_bytes(connectionStats.bytes);
+
+        uint16_t serviceIds[] = {
+            Protocol::Common::ServiceId::CLIENT_SERVICE,
+            Protocol::Common::ServiceId::RAFT_SERVICE,
+        };
+        for (uint32_t i = 0; i < sizeof(serviceIds) / sizeof(serviceIds[0]);
+             ++i) {
+            std::shared_ptr<RPC::ThreadDispatchService> service =
+                globals.rpcServer->getService(serviceIds[i]);
+            if (!service)
+                continue;
+            Protocol::Client::ServerStats::Service& serviceStats =
+                *stats.add_services();
+            serviceStats.set_name(service->getName());
+            serviceStats.set_queue_depth(service->getQueueDepth());
+            for (uint16_t opCode = 0;
+                 opCode < RPC::ThreadDispatchService::MAX_OP_CODES;
+                 ++opCode) {
+                Core::Stats::Histogram::Snapshot latency =
+                    service->getLatency(opCode).getSnapshot();
+                if (latency.count == 0)
+                    continue;
+                Protocol::Client::ServerStats::RPC& rpcStats =
+                    *serviceStats.add_rpcs();
+                rpcStats.set_op_code(opCode);
+                setHistogram(latency, *rpcStats.mutable_latency());
+            }
+        }
+    }
+
+    if (Core::LockProfiler::isEnabled()) {
+        std::vector<const Core::LockProfiler::Profile*> profiles =
+            Core::LockProfiler::getProfiles();
+        for (auto it = profiles.begin(); it != profiles.end(); ++it) {
+            const Core::LockProfiler::Profile& profile = **it;
+            Protocol::Client::ServerStats::Lock& lockStats =
+                *stats.add_locks();
+            lockStats.set_name(profile.name);
+            lockStats.set_contended(profile.contended.get());
+            setHistogram(profile.waitNanos.getSnapshot(),
+                         *lockStats.mutable_wait_ns());
+            setHistogram(profile.holdNanos.getSnapshot(),
+                         *lockStats.mutable_hold_ns());
+            std::vector<Core::LockProfiler::Holder> holders =
+                profile.getTopHolders(MAX_LOCK_HOLDERS);
+            for (auto h = holders.begin(); h != holders.end(); ++h) {
+                Protocol::Client::ServerStats::Lock::Holder& holder =
+                    *lockStats.add_top_holders();
+                for (auto f = h->frames.begin(); f != h->frames.end(); ++f)
+                    holder.add_frames(*f);
+                holder.set_count(h->count);
+                holder.set_total_hold_ns(h->totalNanos);
+                holder.set_max_hold_ns(h->maxNanos);
+            }
+        }
+    }
+    return stats;
+}
+
+void
+ServerStats::setHistogram(const Core::Stats::Histogram::Snapshot& snapshot,
+                          Protocol::Client::ServerStats::Histogram& out)
+{
+    out.Clear();
+    out.set_count(snapshot.count);
+    out.set_sum(snapshot.sum);
+    out.set_max(snapshot.max);
+    if (snapshot.count > 0) {
+        out.set_p50(snapshot.getPercentile(0.50));
+        out.set_p99(snapshot.getPercentile(0.99));
+        out.set_p999(snapshot.getPercentile(0.999));
+    }
+    for (uint32_t i = 0; i < snapshot.buckets.size(); ++i) {
+        if (snapshot.buckets.at(i) == 0)
+            continue;
+        Protocol::Client::ServerStats::Histogram::Bucket& bucket =
+            *out.add_buckets();
+        bucket.set_upper_bound(
+            Core::Stats::Histogram::getBucketUpperBound(i));
+        bucket.set_count(snapshot.buckets.at(i));
+    }
+}
+
+} // namespace LogCabin::Server
+} // namespace LogCabin
@@ -0,0 +1,81 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "build/Protocol/Client.pb.h"
+#include "Core/Stats.h"
+
+#ifndef LOGCABIN_SERVER_SERVERSTATS_H
+#define LOGCABIN_SERVER_SERVERSTATS_H
+
+namespace LogCabin {
+namespace Server {
+
+// forward declaration
+class Globals;
+
+/**
+ * Collects statistics from the LogCabin daemon's top-level objects into a
+ * single protocol buffer, which is returned by the GetServerStats RPC.
+ *
+ * The objects themselves record their statistics in Core::Stats counters and
+ * histograms, which are cheap to update and need no locks. This class only
+ * reads them, so collecting a snapshot has little effect on the rest of the
+ * server.
+ */
+class ServerStats {
+  public:
+    /// Constructor.
+    explicit ServerStats(Globals& globals);
+
+    /// Destructor.
+    ~ServerStats();
+
+    /**
+     * Gather up the current statistics.
+     */
+    Protocol::Client::ServerStats getCurrent();
+
+    /**
+     * Convert a histogram snapshot to its protocol buffer form.
+     * \param[in] snapshot
+     *      The histogram to convert.
+     * \param[out] out
+     *      Cleared and then filled in with the contents of 'snapshot'.
+     */
+    static void
+    setHistogram(const Core::Stats::Histogram::Snapshot& snapshot,
+                 Protocol::Client::ServerStats::Histogram& out);
+
+  private:
+    /**
+     * The number of call sites to report for each mutex profiled by
+     * Core::LockProfiler.
+     */
+    enum { MAX_LOCK_HOLDERS = 5 };
+
+    /**
+     * The LogCabin daemon's top-level objects.
+     */
+    Globals& globals;
+
+    // ServerStats is non-copyable.
+    ServerStats(const ServerStats&) = delete;
+    ServerStats& operator=(const ServerStats&) = delete;
+}; // class ServerStats
+
+} // namespace LogCabin::Server
+} // namespace LogCabin
+
+#endif /* LOGCABIN_SERVER_SERVERSTATS_H */
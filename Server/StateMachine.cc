@@ -13,9 +13,16 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <algorithm>
+#include <cstring>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
 #include "Core/Debug.h"
 #include "Core/ProtoBuf.h"
 #include "Core/ThreadId.h"
+#include "Core/Trace.h"
+#include "Protocol/Common.h"
 #include "RPC/ProtoBuf.h"
 #include "Server/Consensus.h"
 #include "Server/StateMachine.h"
@@ -27,16 +34,141 @@ namespace Server {
 namespace PC = LogCabin::Protocol::Client;
 static const uint64_t NO_ENTRY_ID = ~0UL;
 
-StateMachine::StateMachine(std::shared_ptr<Consensus> consensus)
+const char StateMachine::BINARY_COMMAND_MARKER;
+
+namespace {
+
+/**
+ * Find the last occurrence of a length-delimited field in a serialized
+ * protocol buffer message.
+ * \param message
+ *      The serialized message.
+ * \param fieldNumber
+ *      The field to look for.
+ * \param[out] field
+ *      Set to the field's contents, as a slice of 'message', if found.
+ * \return
+ *      True if the field was found, false otherwise.
+ */
+bool
+findField(const Core::Payload& message, uint32_t fieldNumber,
+          Core::Payload& field)
+{
+    using google::protobuf::internal::WireFormatLite;
+    google::protobuf::io::CodedInputStream stream(
+        reinterpret_cast<const uint8_t*>(message.data()),
+        int(message.size()));
+    bool found = false;
+    while (true) {
+        uint32_t tag = stream.ReadTag();
+        if (tag == 0)
+            return found;
+        if (WireFormatLite::GetTagFieldNumber(tag) == int(fieldNumber) &&
+            WireFormatLite::GetTagWireType(tag) ==
+                WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+            uint32_t length;
+            if (!stream.ReadVarint32(&length))
+                return false;
+            uint64_t offset = uint64_t(stream.CurrentPosition());
+            if (!stream.Skip(int(length)))
+                return false;
+            field = Core::Payload(message, offset, length);
+            found = true;
+        } else if (!WireFormatLite::SkipField(&stream, tag)) {
+            return false;
+        }
+    }
+}
+
+/**
+ * Return the data of an Append command as a slice of the serialized command,
+ * so that the state machine and the replicated log share the bytes. Falls
+ * back to a copy of request.data() if the serialized command isn't laid out
+ * as expected.
+ * \param command
+ *      The serialized Command.
+ * \param request
+ *      The Append request parsed out of 'command'.
+ */
+Core::Payload
+getAppendData(const Core::Payload& command, const PC::Append::Request& request)
+{
+    Core::Payload append;
+    Core::Payload data;
+    if (findField(command, PC::Command::kAppendFieldNumber, append) &&
+        findField(append, PC::Append::Request::kDataFieldNumber, data) &&
+        data.size() == request.data().size() &&
+        memcmp(data.data(), request.data().data(), data.size()) == 0) {
+        return data;
+    }
+    return Core::Payload(request.data());
+}
+
+} // anonymous namespace
+
+uint64_t StateMachine::MAX_STAGED_BYTES = 1024 * 1024 * 1024;
+
+StateMachine::StateMachine(std::shared_ptr<Consensus> consensus,
+                           uint32_t groupId)
     : consensus(consensus)
-    , mutex()
+    , mutex("StateMachine::mutex")
     , cond()
-    , thread(&StateMachine::threadMain, this)
+    , thread()
     , lastEntryId(0)
+    , exiting(false)
+    , watchTimerCond()
+    , watchTimer()
+    , nextWatcherId(1)
+    , watchers()
+    , watchDeadlines()
+    , watchReplies()
+    , nextSubscriptionId(
+        (uint64_t(groupId) << Protocol::Common::RAFT_GROUP_SHIFT) + 1)
+    , subscribers()
+    , subscriptionLogs()
+    , changedLogs()
     , responses()
-    , nextLogId(1)
+    , nextLogId((uint64_t(groupId) << Protocol::Common::RAFT_GROUP_SHIFT) + 1)
     , logNames()
     , logs()
+    , uploads()
+    , stagedBytes(0)
+{
+    // Start the threads only once every member has been constructed.
+    thread = std::thread(&StateMachine::threadMain, this);
+    watchTimer = std::thread(&StateMachine::watchTimerMain, this);
+}
+
+StateMachine::Watcher::Watcher(RPC::ServerRPC rpc,
+                               uint64_t fromEntryId,
+                               TimePoint deadline)
+    : rpc(std::move(rpc))
+    , fromEntryId(fromEntryId)
+    , deadline(deadline)
+{
+}
+
+StateMachine::Entry::Entry()
+    : entryId(0)
+    , invalidates()
+    , hasData(false)
+    , data()
+{
+}
+
+StateMachine::Upload::Upload(uint64_t logId, uint64_t startId)
+    : logId(logId)
+    , startId(startId)
+    , data()
+{
+}
+
+StateMachine::Subscriber::Subscriber(RPC::ServerRPC rpc,
+                                     uint64_t nextEntryId,
+                                     uint64_t credits)
+    : rpc(std::move(rpc))
+    , nextEntryId(nextEntryId)
+    , credits(credits)
 {
 }
 
@@ -44,12 +176,18 @@ StateMachine::~StateMachine()
 {
     consensus->exit();
     thread.join();
+    {
+        std::unique_lock<Core::Mutex> lockGuard(mutex);
+        exiting = true;
+        watchTimerCond.notify_all();
+    }
+    watchTimer.join();
 }
 
 PC::CommandResponse
 StateMachine::getResponse(uint64_t id) const
 {
-    std::unique_lock<std::mutex> lockGuard(mutex);
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
     while (lastEntryId < id)
         cond.wait(lockGuard);
     return responses.at(id);
@@ -58,7 +196,7 @@ StateMachine::getResponse(uint64_t id) const
 void
 StateMachine::wait(uint64_t entryId) const
 {
-    std::unique_lock<std::mutex> lockGuard(mutex);
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
     while (lastEntryId < entryId)
         cond.wait(lockGuard);
 }
@@ -67,7 +205,7 @@ void
 StateMachine::listLogs(const PC::ListLogs::Request& request,
                        PC::ListLogs::Response& response) const
 {
-    std::unique_lock<std::mutex> lockGuard(mutex);
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
     for (auto it = logNames.begin(); it != logNames.end(); ++it)
         response.add_log_names(it->first);
 }
@@ -76,7 +214,7 @@ void
 StateMachine::read(const PC::Read::Request& request,
                    PC::Read::Response& response) const
 {
-    std::unique_lock<std::mutex> lockGuard(mutex);
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
     auto logIt = logs.find(request.log_id());
     if (logIt == logs.end()) {
         response.mutable_log_disappeared();
@@ -84,10 +222,33 @@ StateMachine::read(const PC::Read::Request& request,
     }
     Log& log = *logIt->second;
     response.mutable_ok();
+    if (request.has_data_offset()) {
+        if (request.from_entry_id() >= log.size())
+            return;
+        const Entry& entry = log.at(request.from_entry_id());
+        PC::Read::Response::OK::Entry& chunk =
+            *response.mutable_ok()->add_entry();
+        chunk.set_entry_id(entry.entryId);
+        for (auto it = entry.invalidates.begin();
+             it != entry.invalidates.end();
+             ++it) {
+            chunk.add_invalidates(*it);
+        }
+        if (entry.hasData) {
+            uint64_t offset = std::min<uint64_t>(request.data_offset(),
+                                                 entry.data.size());
+            chunk.set_data(entry.data.data() + offset,
+                           std::min<uint64_t>(
+                                Protocol::Common::MAX_CHUNK_LENGTH,
+                                entry.data.size() - offset));
+            chunk.set_data_length(entry.data.size());
+        }
+        return;
+    }
     for (auto it = log.begin(); it != log.end(); ++it) {
-        if (it->entry_id() < request.from_entry_id())
+        if (it->entryId < request.from_entry_id())
             continue;
-        *response.mutable_ok()->add_entry() = *it;
+        copyEntry(*it, *response.mutable_ok()->add_entry());
     }
 }
 
@@ -95,7 +256,7 @@ void
 StateMachine::getLastId(const PC::GetLastId::Request& request,
                         PC::GetLastId::Response& response) const
 {
-    std::unique_lock<std::mutex> lockGuard(mutex);
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
     auto logIt = logs.find(request.log_id());
     if (logIt == logs.end()) {
         response.mutable_log_disappeared();
@@ -108,6 +269,118 @@ StateMachine::getLastId(const PC::GetLastId::Request& request,
         response.mutable_ok()->set_head_entry_id(log.size());
 }
 
+void
+StateMachine::watch(const PC::Watch::Request& request, RPC::ServerRPC rpc)
+{
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
+    Watcher watcher(std::move(rpc),
+                    request.from_entry_id(),
+                    Clock::now() +
+                        std::chrono::milliseconds(request.timeout_ms()));
+    auto logIt = logs.find(request.log_id());
+    if (logIt == logs.end() ||
+        logIt->second->size() > request.from_entry_id() ||
+        request.timeout_ms() == 0) {
+        queueWatchReply(watcher,
+                        logIt == logs.end() ? NULL : logIt->second.get());
+        sendWatchReplies(lockGuard);
+        return;
+    }
+    uint64_t watcherId = nextWatcherId;
+    ++nextWatcherId;
+    auto deadlineIt = watchDeadlines.insert(
+                            {watcher.deadline, {request.log_id(), watcherId}});
+    if (deadlineIt == watchDeadlines.begin())
+        watchTimerCond.notify_all();
+    watchers[request.log_id()].insert({watcherId, std::move(watcher)});
+}
+
+void
+StateMachine::subscribe(const PC::Subscribe::Request& request,
+                        RPC::ServerRPC rpc)
+{
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
+    Subscriber subscriber(std::move(rpc),
+                          request.from_entry_id(),
+                          request.credits());
+    uint64_t subscriptionId = nextSubscriptionId;
+    ++nextSubscriptionId;
+    auto logIt = logs.find(request.log_id());
+    if (!pushEntries(subscriber,
+                     logIt == logs.end() ? NULL : logIt->second.get(),
+                     subscriptionId)) {
+        return;
+    }
+    subscriptionLogs.insert({subscriptionId, request.log_id()});
+    subscribers[request.log_id()].insert(
+                                {subscriptionId, std::move(subscriber)});
+}
+
+void
+StateMachine::updateSubscription(const PC::UpdateSubscription::Request& request,
+                                 PC::UpdateSubscription::Response& response)
+{
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
+    auto it = subscriptionLogs.find(request.subscription_id());
+    if (it == subscriptionLogs.end()) {
+        response.mutable_unknown_subscription();
+        return;
+    }
+    response.mutable_ok();
+    uint64_t logId = it->second;
+    if (!request.cancel()) {
+        Subscriber& subscriber =
+            subscribers.at(logId).at(request.subscription_id());
+        subscriber.credits += request.add_credits();
+        // Subscribers are dropped when their log is deleted, so the log must
+        // still be around.
+        if (pushEntries(subscriber, logs.at(logId).get(), 0))
+            return;
+    }
+    removeSubscriber(logId, request.subscription_id());
+}
+
+uint64_t
+StateMachine::getLastAppliedId() const
+{
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
+    return lastEntryId;
+}
+
+void
+StateMachine::updateServerStats(PC::ServerStats& stats) const
+{
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
+    uint64_t numEntries = 0;
+    uint64_t bytes = 0;
+    uint64_t unsharedBytes = 0;
+    for (auto it = logs.begin(); it != logs.end(); ++it) {
+        const Log& log = *it->second;
+        numEntries += log.size();
+        for (auto entry = log.begin(); entry != log.end(); ++entry) {
+            bytes += entry->data.size();
+            if (!entry->data.isShared())
+                unsharedBytes += entry->data.size();
+        }
+    }
+    PC::ServerStats::StateMachine& smStats = *stats.mutable_state_machine();
+    smStats.set_num_entries(numEntries);
+    smStats.set_bytes(bytes);
+    smStats.set_unshared_bytes(unsharedBytes);
+}
+
+Core::Payload
+StateMachine::serializeCommand(const google::protobuf::Message& command,
+                               bool binary)
+{
+    if (!binary)
+        return Core::Payload(Core::ProtoBuf::dumpString(command, false));
+    std::string bytes(1, BINARY_COMMAND_MARKER);
+    if (!command.AppendToString(&bytes))
+        PANIC("Failed to serialize command");
+    return Core::Payload(std::move(bytes));
+}
+
 void
 StateMachine::threadMain()
 {
@@ -115,22 +388,229 @@ StateMachine::threadMain()
     try {
         while (true) {
             Consensus::Entry entry = consensus->getNextEntry(lastEntryId);
-            std::unique_lock<std::mutex> lockGuard(mutex);
-            if (entry.hasData)
+            std::unique_lock<Core::Mutex> lockGuard(mutex);
+            if (entry.hasData) {
                 advance(entry.entryId, entry.data);
+                Core::Trace::recordEntry(entry.entryId,
+                                         Core::Trace::Stage::APPLY);
+            }
             lastEntryId = entry.entryId;
             cond.notify_all();
+            if (!changedLogs.empty())
+                pushToSubscribers();
+            if (!watchReplies.empty())
+                sendWatchReplies(lockGuard);
         }
     } catch (const ThreadInterruptedException& e) {
         VERBOSE("exiting");
     }
 }
 
+void
+StateMachine::watchTimerMain()
+{
+    Core::ThreadId::setName("WatchTimer");
+    std::unique_lock<Core::Mutex> lockGuard(mutex);
+    while (!exiting) {
+        TimePoint now = Clock::now();
+        while (!watchDeadlines.empty() &&
+               watchDeadlines.begin()->first <= now) {
+            uint64_t logId = watchDeadlines.begin()->second.first;
+            uint64_t watcherId = watchDeadlines.begin()->second.second;
+            watchDeadlines.erase(watchDeadlines.begin());
+            auto logWatchersIt = watchers.find(logId);
+            std::map<uint64_t, Watcher>& logWatchers = logWatchersIt->second;
+            auto watcherIt = logWatchers.find(watcherId);
+            auto logIt = logs.find(logId);
+            queueWatchReply(watcherIt->second,
+                            logIt == logs.end() ? NULL : logIt->second.get());
+            logWatchers.erase(watcherIt);
+            if (logWatchers.empty())
+                watchers.erase(logWatchersIt);
+        }
+        if (!watchReplies.empty()) {
+            sendWatchReplies(lockGuard);
+            continue;
+        }
+        if (watchDeadlines.empty())
+            watchTimerCond.wait(lockGuard);
+        else
+            watchTimerCond.wait_until(lockGuard,
+                                      watchDeadlines.begin()->first);
+    }
+}
 
 void
-StateMachine::advance(uint64_t entryId, const std::string& data)
+StateMachine::wakeWatchers(uint64_t logId, const Log* log)
 {
-    PC::Command command = Core::ProtoBuf::fromString<PC::Command>(data);
+    auto logWatchersIt = watchers.find(logId);
+    if (logWatchersIt == watchers.end())
+        return;
+    std::map<uint64_t, Watcher>& logWatchers = logWatchersIt->second;
+    for (auto it = logWatchers.begin(); it != logWatchers.end(); ) {
+        Watcher& watcher = it->second;
+        if (log != NULL && log->size() <= watcher.fromEntryId) {
+            ++it;
+            continue;
+        }
+        auto range = watchDeadlines.equal_range(watcher.deadline);
+        for (auto deadlineIt = range.first;
+             deadlineIt != range.second;
+             ++deadlineIt) {
+            if (deadlineIt->second.second == it->first) {
+                watchDeadlines.erase(deadlineIt);
+                break;
+            }
+        }
+        queueWatchReply(watcher, log);
+        logWatchers.erase(it++);
+    }
+    if (logWatchers.empty())
+        watchers.erase(logWatchersIt);
+}
+
+void
+StateMachine::queueWatchReply(Watcher& watcher, const Log* log)
+{
+    PC::Watch::Response response;
+    if (log == NULL) {
+        response.mutable_log_disappeared();
+    } else {
+        response.mutable_ok();
+        for (uint64_t id = watcher.fromEntryId; id < log->size(); ++id)
+            copyEntry((*log)[id], *response.mutable_ok()->add_entry());
+    }
+    watchReplies.push_back({std::move(watcher.rpc), std::move(response)});
+}
+
+void
+StateMachine::sendWatchReplies(std::unique_lock<Core::Mutex>& lockGuard)
+{
+    std::vector<WatchReply> replies;
+    replies.swap(watchReplies);
+    for (auto it = replies.begin(); it != replies.end(); ++it)
+        it->second.set_applied_id(lastEntryId);
+    lockGuard.unlock();
+    for (auto it = replies.begin(); it != replies.end(); ++it)
+        it->first.reply(it->second);
+    lockGuard.lock();
+}
+
+void
+StateMachine::pushToSubscribers()
+{
+    for (auto logIdIt = changedLogs.begin();
+         logIdIt != changedLogs.end();
+         ++logIdIt) {
+        uint64_t logId = *logIdIt;
+        auto logSubscribersIt = subscribers.find(logId);
+        if (logSubscribersIt == subscribers.end())
+            continue;
+        std::map<uint64_t, Subscriber>& logSubscribers =
+            logSubscribersIt->second;
+        auto logIt = logs.find(logId);
+        const Log* log = (logIt == logs.end() ? NULL : logIt->second.get());
+        RPC::Buffer newestEntry; // serialized on first use
+        for (auto it = logSubscribers.begin(); it != logSubscribers.end(); ) {
+            Subscriber& subscriber = it->second;
+            bool keep;
+            if (log != NULL &&
+                subscriber.credits > 0 &&
+                subscriber.nextEntryId + 1 == log->size()) {
+                if (newestEntry.getData() == NULL) {
+                    PC::Subscribe::Response response;
+                    copyEntry(log->back(), *response.add_entry());
+                    response.set_applied_id(lastEntryId);
+                    newestEntry = RPC::ServerRPC::makeSharedReply(response);
+                }
+                ++subscriber.nextEntryId;
+                --subscriber.credits;
+                keep = subscriber.rpc.sendPartialReply(newestEntry);
+            } else {
+                keep = pushEntries(subscriber, log, 0);
+            }
+            if (keep) {
+                ++it;
+            } else {
+                subscriptionLogs.erase(it->first);
+                logSubscribers.erase(it++);
+            }
+        }
+        if (logSubscribers.empty())
+            subscribers.erase(logSubscribersIt);
+    }
+    changedLogs.clear();
+}
+
+bool
+StateMachine::pushEntries(Subscriber& subscriber,
+                          const Log* log,
+                          uint64_t subscriptionId)
+{
+    PC::Subscribe::Response response;
+    if (subscriptionId != 0)
+        response.set_subscription_id(subscriptionId);
+    if (log == NULL) {
+        response.mutable_log_disappeared();
+    } else {
+        while (subscriber.credits > 0 &&
+               subscriber.nextEntryId < log->size()) {
+            copyEntry((*log)[subscriber.nextEntryId], *response.add_entry());
+            ++subscriber.nextEntryId;
+            --subscriber.credits;
+        }
+        if (response.entry_size() == 0 && subscriptionId == 0)
+            return subscriber.rpc.isSessionOpen();
+    }
+    response.set_applied_id(lastEntryId);
+    bool open = subscriber.rpc.sendPartialReply(
+                        RPC::ServerRPC::makeSharedReply(response));
+    return open && log != NULL;
+}
+
+void
+StateMachine::removeSubscriber(uint64_t logId, uint64_t subscriptionId)
+{
+    auto logSubscribersIt = subscribers.find(logId);
+    logSubscribersIt->second.erase(subscriptionId);
+    if (logSubscribersIt->second.empty())
+        subscribers.erase(logSubscribersIt);
+    subscriptionLogs.erase(subscriptionId);
+}
+
+void
+StateMachine::copyEntry(const Entry& from, PC::Read::Response::OK::Entry& to)
+{
+    to.set_entry_id(from.entryId);
+    for (auto it = from.invalidates.begin();
+         it != from.invalidates.end();
+         ++it) {
+        to.add_invalidates(*it);
+    }
+    if (!from.hasData)
+        return;
+    if (from.data.size() <= Protocol::Common::MAX_CHUNK_LENGTH) {
+        to.set_data(from.data.data(), from.data.size());
+    } else {
+        to.set_data(from.data.data(), Protocol::Common::MAX_CHUNK_LENGTH);
+        to.set_data_length(from.data.size());
+    }
+}
+
+void
+StateMachine::advance(uint64_t entryId, const Core::Payload& data)
+{
+    PC::Command command;
+    Core::Payload binary;
+    if (!data.empty() && data.data()[0] == BINARY_COMMAND_MARKER) {
+        binary = Core::Payload(data, 1, data.size() - 1);
+        if (!command.ParseFromArray(binary.data(), int(binary.size()))) {
+            PANIC("could not parse command at %lu (%lu bytes)",
+                  entryId, data.size());
+        }
+    } else {
+        command = Core::ProtoBuf::fromString<PC::Command>(data.toString());
+    }
     PC::CommandResponse& commandResponse = responses[entryId];
     if (command.has_open_log()) {
         openLog(*command.mutable_open_log(),
@@ -139,10 +619,17 @@ StateMachine::advance(uint64_t entryId, const std::string& data)
         deleteLog(*command.mutable_delete_log(),
                   *commandResponse.mutable_delete_log());
     } else if (command.has_append()) {
-        append(*command.mutable_append(),
+        append(command.append(),
+               !binary.empty() ? getAppendData(binary, command.append())
+                               : Core::Payload(command.append().data()),
                *commandResponse.mutable_append());
+    } else if (command.has_append_chunk()) {
+        appendChunk(entryId,
+                    *command.mutable_append_chunk(),
+                    *commandResponse.mutable_append_chunk());
     } else {
-        PANIC("unknown command at %lu: %s", entryId, data.c_str());
+        PANIC("unknown command at %lu: %s",
+              entryId, Core::ProtoBuf::dumpString(command).c_str());
     }
 }
 
@@ -167,17 +654,26 @@ void
 StateMachine::deleteLog(const PC::DeleteLog::Request& request,
                         PC::DeleteLog::Response& response)
 {
-    std::unique_lock<std::mutex> lockGuard(mutex);
     auto it = logNames.find(request.log_name());
     if (it == logNames.end())
         return;
     uint64_t logId = it->second;
     logNames.erase(it);
     logs.erase(logId);
+    for (auto uploadIt = uploads.begin(); uploadIt != uploads.end(); ) {
+        if (uploadIt->second.logId == logId)
+            dropUpload(uploadIt++);
+        else
+            ++uploadIt;
+    }
+    wakeWatchers(logId, NULL);
+    if (subscribers.find(logId) != subscribers.end())
+        changedLogs.push_back(logId);
 }
 
 void
 StateMachine::append(const PC::Append::Request& request,
+                     const Core::Payload& data,
                      PC::Append::Response& response)
 {
     auto logIt = logs.find(request.log_id());
@@ -186,6 +682,19 @@ StateMachine::append(const PC::Append::Request& request,
         return;
     }
     Log& log = *logIt->second;
+    std::string uploadData;
+    if (request.has_upload_id()) {
+        auto uploadIt = uploads.find(request.upload_id());
+        if (uploadIt == uploads.end() ||
+            uploadIt->second.logId != request.log_id() ||
+            uploadIt->second.data.size() != request.upload_length()) {
+            response.mutable_upload_disappeared();
+            return;
+        }
+        stagedBytes -= uploadIt->second.data.size();
+        uploadData.swap(uploadIt->second.data);
+        uploads.erase(uploadIt);
+    }
     uint64_t newId = log.size();
     uint64_t expectedId = NO_ENTRY_ID;
     if (request.has_expected_entry_id())
@@ -195,12 +704,79 @@ StateMachine::append(const PC::Append::Request& request,
         return;
     }
     Entry entry;
-    entry.set_entry_id(newId);
-    *entry.mutable_invalidates() = request.invalidates();
-    if (request.has_data())
-        entry.set_data(request.data());
+    entry.entryId = newId;
+    entry.invalidates.assign(request.invalidates().begin(),
+                             request.invalidates().end());
+    if (request.has_upload_id()) {
+        entry.hasData = true;
+        entry.data = Core::Payload(std::move(uploadData));
+    } else if (request.has_data()) {
+        entry.hasData = true;
+        entry.data = data;
+    }
     log.push_back(entry);
     response.mutable_ok()->set_entry_id(newId);
+    wakeWatchers(request.log_id(), &log);
+    if (subscribers.find(request.log_id()) != subscribers.end())
+        changedLogs.push_back(request.log_id());
+}
+
+void
+StateMachine::appendChunk(uint64_t entryId,
+                          const PC::AppendChunk::Request& request,
+                          PC::AppendChunk::Response& response)
+{
+    if (logs.find(request.log_id()) == logs.end()) {
+        response.mutable_log_disappeared();
+        return;
+    }
+    auto it = uploads.find(request.upload_id());
+    if (request.offset() == 0) {
+        if (it != uploads.end())
+            dropUpload(it);
+        it = uploads.insert({request.upload_id(),
+                             Upload(request.log_id(), entryId)}).first;
+    }
+    if (it == uploads.end() || it->second.logId != request.log_id()) {
+        response.mutable_ok()->set_staged_length(0);
+        return;
+    }
+    Upload& upload = it->second;
+    // Anything other than the next chunk is a retry of an earlier one, or
+    // follows on from an upload that was dropped: either way, ignore it.
+    if (request.offset() == upload.data.size()) {
+        upload.data.append(request.data());
+        stagedBytes += request.data().size();
+        evictUploads(request.upload_id());
+    }
+    response.mutable_ok()->set_staged_length(upload.data.size());
+}
+
+void
+StateMachine::dropUpload(std::map<uint64_t, Upload>::iterator it)
+{
+    stagedBytes -= it->second.data.size();
+    uploads.erase(it);
+}
+
+void
+StateMachine::evictUploads(uint64_t keep)
+{
+    while (stagedBytes > MAX_STAGED_BYTES) {
+        auto oldest = uploads.end();
+        for (auto it = uploads.begin(); it != uploads.end(); ++it) {
+            if (it->first != keep &&
+                (oldest == uploads.end() ||
+                 it->second.startId < oldest->second.startId)) {
+                oldest = it;
+            }
+        }
+        if (oldest == uploads.end())
+            return;
+        NOTICE("Dropping upload %lu of %lu bytes to make room for others",
+               oldest->first, oldest->second.data.size());
+        dropUpload(oldest);
+    }
 }
 
 } // namespace LogCabin::Server
@@ -13,13 +13,20 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
-#include <condition_variable>
+#include <map>
 #include <memory>
-#include <mutex>
+#include <string>
 #include <thread>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "build/Protocol/Client.pb.h"
+#include "Core/ConditionVariable.h"
+#include "Core/Mutex.h"
+#include "Core/Payload.h"
+#include "Core/Time.h"
+#include "RPC/ServerRPC.h"
 
 #ifndef LOGCABIN_SERVER_STATEMACHINE_H
 #define LOGCABIN_SERVER_STATEMACHINE_H
@@ -32,7 +39,17 @@ class Consensus;
 
 class StateMachine {
   public:
-    explicit StateMachine(std::shared_ptr<Consensus> consensus);
+    /**
+     * Constructor.
+     * \param consensus
+     *      The replicated log to apply.
+     * \param groupId
+     *      The Raft group that 'consensus' belongs to. This is stamped into
+     *      the IDs of logs and subscriptions (see
+     *      Protocol::Common::getRaftGroup()).
+     */
+    explicit StateMachine(std::shared_ptr<Consensus> consensus,
+                          uint32_t groupId = 0);
     ~StateMachine();
 
     Protocol::Client::CommandResponse getResponse(uint64_t id) const;
@@ -48,26 +65,334 @@ class StateMachine {
     void getLastId(const Protocol::Client::GetLastId::Request& request,
                    Protocol::Client::GetLastId::Response& response) const;
 
+    /**
+     * Reply to a Watch RPC once the log has entries at or after
+     * request.from_entry_id(), once the log is deleted, or once the request's
+     * timeout elapses, whichever comes first. This doesn't block: until it
+     * can be answered, the RPC just sits on the log's list of watchers.
+     * \param request
+     *      The Watch request.
+     * \param rpc
+     *      The RPC to reply to.
+     */
+    void watch(const Protocol::Client::Watch::Request& request,
+               RPC::ServerRPC rpc);
+
+    /**
+     * Start a subscription for a Subscribe RPC. This immediately pushes the
+     * subscription's ID and whatever entries it has credits for, then keeps
+     * the RPC on the log's list of subscribers so that future entries are
+     * pushed to it as they are applied.
+     * \param request
+     *      The Subscribe request.
+     * \param rpc
+     *      The streaming RPC to push entries to.
+     */
+    void subscribe(const Protocol::Client::Subscribe::Request& request,
+                   RPC::ServerRPC rpc);
+
+    /**
+     * Grant a subscription more credits, pushing any entries it was held
+     * back from, or end it.
+     */
+    void updateSubscription(
+            const Protocol::Client::UpdateSubscription::Request& request,
+            Protocol::Client::UpdateSubscription::Response& response);
+
+    /**
+     * Return the ID of the last entry this state machine has applied.
+     */
+    uint64_t getLastAppliedId() const;
+
+    /**
+     * Fill in the state_machine section of the server's statistics. This
+     * walks every entry, so it's meant for occasional use.
+     */
+    void updateServerStats(Protocol::Client::ServerStats& stats) const;
+
+    /**
+     * The first byte of a command replicated in protobuf's binary format,
+     * which the serialized Command follows. Commands in the text format,
+     * which is all that servers predating the binary format can apply, start
+     * with a field name instead (or are empty), so they never start with
+     * this byte.
+     */
+    static const char BINARY_COMMAND_MARKER = '\x01';
+
+    /**
+     * Serialize a Protocol::Client::Command for the replicated log.
+     * \param command
+     *      The command to serialize.
+     * \param binary
+     *      If true, use the binary format, which advance() can apply without
+     *      copying Append data. Otherwise, use the text format, which servers
+     *      predating the binary format can also apply. Clusters switch to the
+     *      binary format using the binaryCommands option once every server
+     *      has been upgraded (see sample.conf).
+     */
+    static Core::Payload
+    serializeCommand(const google::protobuf::Message& command, bool binary);
+
+    /**
+     * The number of bytes of AppendChunk data that may be staged before the
+     * oldest uploads are dropped. This is a variable rather than a constant
+     * so that unit tests can change it.
+     */
+    static uint64_t MAX_STAGED_BYTES;
+
   private:
+    typedef Core::Time::SteadyClock Clock;
+    typedef Clock::time_point TimePoint;
+
+    /**
+     * The chunks staged so far for an entry that's being appended in pieces.
+     * See the AppendChunk RPC.
+     */
+    struct Upload {
+        Upload(uint64_t logId, uint64_t startId);
+        /// The log the entry will be appended to.
+        uint64_t logId;
+        /// The entry in the replicated log that started the upload.
+        uint64_t startId;
+        /// The chunks, concatenated.
+        std::string data;
+    };
+
     void threadMain();
 
-    typedef Protocol::Client::Read::Response::OK::Entry Entry;
+    /**
+     * Replies to Watch RPCs that have timed out. This sleeps until the
+     * earliest deadline in #watchDeadlines.
+     */
+    void watchTimerMain();
+
+    /**
+     * An entry in one of the logs. Its data is usually a slice of the Raft
+     * log entry whose Append command created it, so that the bytes are held
+     * once for both.
+     */
+    struct Entry {
+        Entry();
+        /// The entry's ID within its log.
+        uint64_t entryId;
+        /// The IDs of the entries this one invalidates.
+        std::vector<uint64_t> invalidates;
+        /// Whether the entry has data (the data may still be empty).
+        bool hasData;
+        /// The entry's data, if any.
+        Core::Payload data;
+    };
     typedef std::vector<Entry> Log;
 
-    void advance(uint64_t entryId, const std::string& data);
+    /**
+     * Fill in 'to' with 'from' for a reply, cutting its data short at
+     * Protocol::Common::MAX_CHUNK_LENGTH bytes. Clients fetch the rest with
+     * Read requests that set data_offset (see Read.Response.OK.Entry).
+     */
+    static void copyEntry(const Entry& from,
+                          Protocol::Client::Read::Response::OK::Entry& to);
+
+    /**
+     * Apply a command from the replicated log.
+     * \param entryId
+     *      The command's index in the replicated log.
+     * \param data
+     *      The Protocol::Client::Command, as serialized by serializeCommand().
+     */
+    void advance(uint64_t entryId, const Core::Payload& data);
 
     void openLog(const Protocol::Client::OpenLog::Request& request,
                  Protocol::Client::OpenLog::Response& response);
     void deleteLog(const Protocol::Client::DeleteLog::Request& request,
                    Protocol::Client::DeleteLog::Response& response);
+    /**
+     * Apply an Append command.
+     * \param request
+     *      The command.
+     * \param data
+     *      The entry's data, request.data() unless it's an upload. The caller
+     *      passes this separately so that it can be a slice of the replicated
+     *      log's copy.
+     * \param response
+     *      Filled in with the outcome.
+     */
     void append(const Protocol::Client::Append::Request& request,
+                const Core::Payload& data,
                 Protocol::Client::Append::Response& response);
+    void appendChunk(uint64_t entryId,
+                     const Protocol::Client::AppendChunk::Request& request,
+                     Protocol::Client::AppendChunk::Response& response);
+
+    /**
+     * Forget about a staged upload. Must be called holding #mutex.
+     */
+    void dropUpload(std::map<uint64_t, Upload>::iterator it);
+
+    /**
+     * Drop the oldest uploads other than 'keep' until no more than
+     * MAX_STAGED_BYTES are staged. Must be called holding #mutex.
+     */
+    void evictUploads(uint64_t keep);
+
+    /**
+     * A Watch RPC waiting for its log to grow.
+     */
+    struct Watcher {
+        Watcher(RPC::ServerRPC rpc, uint64_t fromEntryId, TimePoint deadline);
+        RPC::ServerRPC rpc;
+        /// The request's from_entry_id.
+        uint64_t fromEntryId;
+        /// When to give up and reply with no entries.
+        TimePoint deadline;
+    };
+
+    /**
+     * A reply to a Watch RPC, to be sent once #mutex is released.
+     */
+    typedef std::pair<RPC::ServerRPC,
+                      Protocol::Client::Watch::Response> WatchReply;
+
+    /**
+     * Answer all the watchers on the given log, removing them from
+     * #watchers and #watchDeadlines. Their replies are queued on
+     * #watchReplies. Must be called holding #mutex.
+     * \param logId
+     *      The log that grew or was deleted.
+     * \param log
+     *      The log's entries, or NULL if it was deleted.
+     */
+    void wakeWatchers(uint64_t logId, const Log* log);
+
+    /**
+     * Queue a reply to the given watcher on #watchReplies, containing the
+     * entries of 'log' at or after its from_entry_id. Must be called holding
+     * #mutex.
+     * \param watcher
+     *      The watcher to answer. Its rpc is moved out.
+     * \param log
+     *      The log's entries, or NULL if the log doesn't exist.
+     */
+    void queueWatchReply(Watcher& watcher, const Log* log);
+
+    /**
+     * Send the replies queued on #watchReplies. This releases #mutex while it
+     * does so, since replying may block on the network layer.
+     */
+    void sendWatchReplies(std::unique_lock<Core::Mutex>& lockGuard);
+
+    /**
+     * A Subscribe RPC, which stays open while entries are pushed to it.
+     */
+    struct Subscriber {
+        Subscriber(RPC::ServerRPC rpc, uint64_t nextEntryId, uint64_t credits);
+        RPC::ServerRPC rpc;
+        /// The ID of the next entry in the log to push.
+        uint64_t nextEntryId;
+        /// The number of entries that may be pushed before more are granted.
+        uint64_t credits;
+    };
+
+    /**
+     * Push new entries to the subscribers of the logs in #changedLogs, and
+     * drop subscribers whose clients have gone away. Entries are pushed as
+     * they are applied, so nearly all subscribers just need the newest entry:
+     * that is serialized once and shared by all of them. Must be called
+     * holding #mutex. Pushing only queues the messages on their sockets, so
+     * it doesn't block.
+     */
+    void pushToSubscribers();
+
+    /**
+     * Push a subscriber the entries it has credits for, serialized just for
+     * it. Must be called holding #mutex.
+     * \param subscriber
+     *      The subscriber to push to.
+     * \param log
+     *      The log's entries, or NULL if it doesn't exist.
+     * \param subscriptionId
+     *      If nonzero, this is included in the message and the message is
+     *      sent even if it has no entries.
+     * \return
+     *      False if the subscriber should be dropped, either because its
+     *      client has gone away or because the log doesn't exist.
+     */
+    bool pushEntries(Subscriber& subscriber,
+                     const Log* log,
+                     uint64_t subscriptionId);
+
+    /**
+     * Remove a subscriber from #subscribers and #subscriptionLogs.
+     * Must be called holding #mutex.
+     */
+    void removeSubscriber(uint64_t logId, uint64_t subscriptionId);
 
     std::shared_ptr<Consensus> consensus;
-    mutable std::mutex mutex;
-    mutable std::condition_variable cond;
+    mutable Core::Mutex mutex;
+    mutable Core::ConditionVariable cond;
     std::thread thread;
     uint64_t lastEntryId; // only written to by thread
+
+    /**
+     * Set by the destructor to stop #watchTimer.
+     */
+    bool exiting;
+
+    /**
+     * Notified when #watchDeadlines gets a new earliest deadline or
+     * #exiting is set.
+     */
+    Core::ConditionVariable watchTimerCond;
+
+    /**
+     * Runs watchTimerMain().
+     */
+    std::thread watchTimer;
+
+    /**
+     * Used to identify watchers in #watchDeadlines.
+     */
+    uint64_t nextWatcherId;
+
+    /**
+     * The Watch RPCs waiting on each log, keyed by log ID and then by watcher
+     * ID. Logs with no watchers have no entry here, so idle logs cost
+     * nothing when they grow.
+     */
+    std::unordered_map<uint64_t, std::map<uint64_t, Watcher>> watchers;
+
+    /**
+     * The log ID and watcher ID of every entry in #watchers, ordered by
+     * deadline.
+     */
+    std::multimap<TimePoint, std::pair<uint64_t, uint64_t>> watchDeadlines;
+
+    /**
+     * Replies queued by wakeWatchers() and the timer for sendWatchReplies().
+     */
+    std::vector<WatchReply> watchReplies;
+
+    /**
+     * Used to identify subscriptions.
+     */
+    uint64_t nextSubscriptionId;
+
+    /**
+     * The open subscriptions on each log, keyed by log ID and then by
+     * subscription ID. Like #watchers, logs with no subscribers have no entry
+     * here.
+     */
+    std::unordered_map<uint64_t, std::map<uint64_t, Subscriber>> subscribers;
+
+    /**
+     * Maps the ID of every subscription in #subscribers to its log ID.
+     */
+    std::unordered_map<uint64_t, uint64_t> subscriptionLogs;
+
+    /**
+     * Logs with subscribers that have grown or been deleted since
+     * pushToSubscribers() last ran.
+     */
+    std::vector<uint64_t> changedLogs;
     std::unordered_map<uint64_t, Protocol::Client::CommandResponse> responses;
 
     /**
@@ -82,6 +407,17 @@ class StateMachine {
     // This is a work-around for gcc 4.4, which can't handle move-only objects
     // in maps.
     std::unordered_map<uint64_t, std::shared_ptr<Log>> logs;
+
+    /**
+     * Uploads in progress, keyed by upload ID. These are part of the
+     * replicated state, so they survive a change of leader.
+     */
+    std::map<uint64_t, Upload> uploads;
+
+    /**
+     * The total size of the data in #uploads.
+     */
+    uint64_t stagedBytes;
 };
 
 } // namespace LogCabin::Server
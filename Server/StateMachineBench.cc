@@ -0,0 +1,133 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "bench/Bench.h"
+#include "build/Protocol/Client.pb.h"
+#include "Server/Consensus.h"
+#include "Server/StateMachine.h"
+
+namespace LogCabin {
+namespace Server {
+namespace {
+
+namespace PC = LogCabin::Protocol::Client;
+
+/**
+ * A Consensus module that never produces any entries, so that the benchmarks
+ * can feed the state machine directly without racing its thread.
+ */
+class IdleConsensus : public Consensus {
+  public:
+    IdleConsensus()
+        : mutex()
+        , cond()
+        , exiting(false)
+    {
+    }
+    void init() {
+    }
+    void exit() {
+        std::unique_lock<std::mutex> lockGuard(mutex);
+        exiting = true;
+        cond.notify_all();
+    }
+    Entry getNextEntry(uint64_t lastEntryId) const {
+        std::unique_lock<std::mutex> lockGuard(mutex);
+        while (!exiting)
+            cond.wait(lockGuard);
+        throw ThreadInterruptedException();
+    }
+    mutable std::mutex mutex;
+    mutable std::condition_variable cond;
+    bool exiting;
+};
+
+/**
+ * Return the log entry contents for an append command, the way the client
+ * service encodes it.
+ */
+Core::Payload
+appendCommand(uint64_t logId, uint32_t dataLength)
+{
+    PC::Command command;
+    command.mutable_append()->set_log_id(logId);
+    command.mutable_append()->set_data(std::string(dataLength, 'x'));
+    return StateMachine::serializeCommand(command, true);
+}
+
+/**
+ * Return a state machine containing one log, with ID 1.
+ */
+std::unique_ptr<StateMachine>
+makeStateMachine()
+{
+    std::unique_ptr<StateMachine> stateMachine(
+        new StateMachine(std::make_shared<IdleConsensus>()));
+    PC::Command command;
+    command.mutable_open_log()->set_log_name("bench");
+    stateMachine->advance(1, StateMachine::serializeCommand(command, true));
+    return stateMachine;
+}
+
+void
+advance(Bench::State& state, uint32_t dataLength)
+{
+    state.pauseTiming();
+    std::unique_ptr<StateMachine> stateMachine = makeStateMachine();
+    Core::Payload data = appendCommand(1, dataLength);
+    state.setBytesPerIteration(dataLength);
+    state.resumeTiming();
+    for (uint64_t i = 0; i < state.iterations; ++i)
+        stateMachine->advance(i + 2, data);
+    state.pauseTiming();
+}
+
+BENCHMARK(ServerStateMachine, advanceAppend64B) {
+    advance(state, 64);
+}
+
+BENCHMARK(ServerStateMachine, advanceAppend4KB) {
+    advance(state, 4096);
+}
+
+/**
+ * Each iteration reads the last 10 entries of a log of 1000 entries.
+ */
+BENCHMARK(ServerStateMachine, readTail) {
+    state.pauseTiming();
+    std::unique_ptr<StateMachine> stateMachine = makeStateMachine();
+    Core::Payload data = appendCommand(1, 64);
+    for (uint64_t i = 0; i < 1000; ++i)
+        stateMachine->advance(i + 2, data);
+    PC::Read::Request request;
+    request.set_log_id(1);
+    request.set_from_entry_id(990);
+    state.resumeTiming();
+    for (uint64_t i = 0; i < state.iterations; ++i) {
+        PC::Read::Response response;
+        stateMachine->read(request, response);
+        Bench::doNotOptimize(response);
+    }
+    state.pauseTiming();
+}
+
+} // namespace LogCabin::Server::<anonymous>
+} // namespace LogCabin::Server
+} // namespace LogCabin
@@ -0,0 +1,586 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "build/Protocol/Client.pb.h"
+#include "Core/ProtoBuf.h"
+#include "Core/StringUtil.h"
+#include "Protocol/Common.h"
+#include "RPC/Buffer.h"
+#include "RPC/OpaqueServerRPC.h"
+#include "RPC/ProtoBuf.h"
+#include "RPC/Protocol.h"
+#include "Server/Consensus.h"
+#include "Server/StateMachine.h"
+
+namespace LogCabin {
+namespace Server {
+namespace {
+
+namespace PC = LogCabin::Protocol::Client;
+using Core::ProtoBuf::fromString;
+
+/**
+ * A Consensus module that never produces any entries, so that the tests can
+ * feed the state machine directly without racing its thread.
+ */
+class IdleConsensus : public Consensus {
+  public:
+    IdleConsensus()
+        : mutex()
+        , cond()
+        , exiting(false)
+    {
+    }
+    void init() {
+    }
+    void exit() {
+        std::unique_lock<std::mutex> lockGuard(mutex);
+        exiting = true;
+        cond.notify_all();
+    }
+    Entry getNextEntry(uint64_t lastEntryId) const {
+        std::unique_lock<std::mutex> lockGuard(mutex);
+        while (!exiting)
+            cond.wait(lockGuard);
+        throw ThreadInterruptedException();
+    }
+    mutable std::mutex mutex;
+    mutable std::condition_variable cond;
+    bool exiting;
+};
+
+class ServerStateMachineTest : public ::testing::Test {
+    ServerStateMachineTest()
+        : stateMachine(new StateMachine(std::make_shared<IdleConsensus>()))
+        , replies()
+    {
+        apply(1, "open_log { log_name: 'foo' }");
+    }
+
+    /**
+     * Apply a command the way StateMachine::threadMain does.
+     */
+    void apply(uint64_t entryId, const std::string& command) {
+        std::unique_lock<Core::Mutex> lockGuard(stateMachine->mutex);
+        PC::Command parsed = fromString<PC::Command>(command);
+        stateMachine->advance(entryId,
+                              StateMachine::serializeCommand(parsed, true));
+        stateMachine->lastEntryId = entryId;
+        if (!stateMachine->changedLogs.empty())
+            stateMachine->pushToSubscribers();
+        stateMachine->sendWatchReplies(lockGuard);
+    }
+
+    /**
+     * Build an RPC carrying the given request. Its replies will show up in
+     * the next slot of #replies.
+     */
+    RPC::ServerRPC makeRPC(PC::OpCode opCode,
+                           const google::protobuf::Message& request) {
+        replies.emplace_back();
+        RPC::OpaqueServerRPC opaqueRPC;
+        RPC::ProtoBuf::serialize(request,
+                                 opaqueRPC.request,
+                                 sizeof(RPC::Protocol::RequestHeaderVersion1));
+        RPC::Protocol::RequestHeaderVersion1& header =
+            *static_cast<RPC::Protocol::RequestHeaderVersion1*>(
+                opaqueRPC.request.getData());
+        header.prefix.version = 1;
+        header.prefix.toBigEndian();
+        header.service = Protocol::Common::ServiceId::CLIENT_SERVICE;
+        header.serviceSpecificErrorVersion = 0;
+        header.opCode = opCode;
+        header.toBigEndian();
+        opaqueRPC.responseTarget = &replies.back();
+        return RPC::ServerRPC(std::move(opaqueRPC));
+    }
+
+    /**
+     * Start a Watch RPC. Its reply, if any, will show up in the next slot of
+     * #replies.
+     */
+    void watch(const std::string& request) {
+        PC::Watch::Request parsedRequest =
+            fromString<PC::Watch::Request>(request);
+        stateMachine->watch(parsedRequest,
+                            makeRPC(PC::OpCode::WATCH, parsedRequest));
+    }
+
+    /**
+     * Start a Subscribe RPC. The latest entries pushed to it will show up in
+     * the next slot of #replies.
+     */
+    void subscribe(const std::string& request) {
+        PC::Subscribe::Request parsedRequest =
+            fromString<PC::Subscribe::Request>(request);
+        stateMachine->subscribe(parsedRequest,
+                                makeRPC(PC::OpCode::SUBSCRIBE,
+                                        parsedRequest));
+    }
+
+    /**
+     * Return and clear the latest push to the i-th RPC, or an empty response
+     * if there is none.
+     */
+    PC::Subscribe::Response takePush(size_t i) {
+        PC::Subscribe::Response response;
+        if (replies.at(i).getLength() > 0) {
+            EXPECT_TRUE(RPC::ProtoBuf::parse(
+                replies.at(i), response,
+                sizeof(RPC::Protocol::ResponseHeaderVersion1)));
+        }
+        replies.at(i).reset();
+        return response;
+    }
+
+    PC::UpdateSubscription::Response
+    updateSubscription(const std::string& request) {
+        PC::UpdateSubscription::Response response;
+        stateMachine->updateSubscription(
+            fromString<PC::UpdateSubscription::Request>(request),
+            response);
+        return response;
+    }
+
+    size_t numSubscribers() {
+        std::unique_lock<Core::Mutex> lockGuard(stateMachine->mutex);
+        size_t count = 0;
+        for (auto it = stateMachine->subscribers.begin();
+             it != stateMachine->subscribers.end();
+             ++it) {
+            count += it->second.size();
+        }
+        EXPECT_EQ(stateMachine->subscriptionLogs.size(), count);
+        return count;
+    }
+
+    /**
+     * Return the reply to the i-th Watch RPC, or an empty response if it
+     * hasn't been answered.
+     */
+    PC::Watch::Response getReply(size_t i) {
+        PC::Watch::Response response;
+        if (replies.at(i).getLength() > 0) {
+            EXPECT_TRUE(RPC::ProtoBuf::parse(
+                replies.at(i), response,
+                sizeof(RPC::Protocol::ResponseHeaderVersion1)));
+        }
+        return response;
+    }
+
+    size_t numWatchers() {
+        std::unique_lock<Core::Mutex> lockGuard(stateMachine->mutex);
+        EXPECT_EQ(stateMachine->watchDeadlines.size(),
+                  (stateMachine->watchers.empty()
+                    ? 0
+                    : stateMachine->watchers.begin()->second.size()));
+        return stateMachine->watchDeadlines.size();
+    }
+
+    std::unique_ptr<StateMachine> stateMachine;
+    std::deque<RPC::Buffer> replies;
+};
+
+TEST_F(ServerStateMachineTest, watch_entriesAvailable) {
+    apply(2, "append { log_id: 1, data: 'a' }");
+    apply(3, "append { log_id: 1, data: 'b' }");
+    watch("log_id: 1, from_entry_id: 1, timeout_ms: 10000");
+    EXPECT_EQ(0U, numWatchers());
+    EXPECT_EQ("ok { entry { entry_id: 1, data: 'b' } } "
+              "applied_id: 3",
+              getReply(0));
+}
+
+TEST_F(ServerStateMachineTest, watch_logDisappeared) {
+    watch("log_id: 2, from_entry_id: 0, timeout_ms: 10000");
+    EXPECT_EQ(0U, numWatchers());
+    EXPECT_EQ("log_disappeared {} "
+              "applied_id: 1",
+              getReply(0));
+}
+
+TEST_F(ServerStateMachineTest, watch_zeroTimeout) {
+    watch("log_id: 1, from_entry_id: 0, timeout_ms: 0");
+    EXPECT_EQ(0U, numWatchers());
+    EXPECT_EQ("ok {} "
+              "applied_id: 1",
+              getReply(0));
+}
+
+TEST_F(ServerStateMachineTest, watch_wokenByAppend) {
+    watch("log_id: 1, from_entry_id: 0, timeout_ms: 10000");
+    watch("log_id: 1, from_entry_id: 1, timeout_ms: 10000");
+    EXPECT_EQ(2U, numWatchers());
+    EXPECT_EQ(0U, replies.at(0).getLength());
+
+    apply(2, "open_log { log_name: 'bar' }");
+    apply(3, "append { log_id: 2, data: 'other' }");
+    EXPECT_EQ(2U, numWatchers());
+
+    apply(4, "append { log_id: 1, data: 'a' }");
+    EXPECT_EQ(1U, numWatchers());
+    EXPECT_EQ("ok { entry { entry_id: 0, data: 'a' } } "
+              "applied_id: 4",
+              getReply(0));
+    EXPECT_EQ(0U, replies.at(1).getLength());
+
+    apply(5, "append { log_id: 1, data: 'b' }");
+    EXPECT_EQ(0U, numWatchers());
+    EXPECT_EQ("ok { entry { entry_id: 1, data: 'b' } } "
+              "applied_id: 5",
+              getReply(1));
+}
+
+TEST_F(ServerStateMachineTest, watch_wokenByDeleteLog) {
+    watch("log_id: 1, from_entry_id: 0, timeout_ms: 10000");
+    apply(2, "delete_log { log_name: 'foo' }");
+    EXPECT_EQ(0U, numWatchers());
+    EXPECT_EQ("log_disappeared {} "
+              "applied_id: 2",
+              getReply(0));
+}
+
+TEST_F(ServerStateMachineTest, watch_timeout) {
+    watch("log_id: 1, from_entry_id: 0, timeout_ms: 1");
+    for (uint32_t i = 0; i < 1000 && numWatchers() > 0; ++i)
+        usleep(1000);
+    EXPECT_EQ(0U, numWatchers());
+    // Join the timer thread so that its reply is visible here.
+    stateMachine.reset();
+    EXPECT_EQ("ok {} "
+              "applied_id: 1",
+              getReply(0));
+}
+
+TEST_F(ServerStateMachineTest, raftGroupIds) {
+    stateMachine.reset(new StateMachine(std::make_shared<IdleConsensus>(), 3));
+    apply(1, "open_log { log_name: 'foo' }");
+    uint64_t logId = stateMachine->getResponse(1).open_log().log_id();
+    EXPECT_EQ(3U, Protocol::Common::getRaftGroup(logId));
+    EXPECT_EQ(1U, logId & ((1UL << Protocol::Common::RAFT_GROUP_SHIFT) - 1));
+    PC::Subscribe::Request request;
+    request.set_log_id(logId);
+    request.set_from_entry_id(0);
+    request.set_credits(10);
+    stateMachine->subscribe(request, makeRPC(PC::OpCode::SUBSCRIBE, request));
+    EXPECT_EQ(3U, Protocol::Common::getRaftGroup(
+                        takePush(0).subscription_id()));
+}
+
+TEST_F(ServerStateMachineTest, subscribe_entriesAvailable) {
+    apply(2, "append { log_id: 1, data: 'a' }");
+    apply(3, "append { log_id: 1, data: 'b' }");
+    apply(4, "append { log_id: 1, data: 'c' }");
+    subscribe("log_id: 1, from_entry_id: 1, credits: 10");
+    EXPECT_EQ(1U, numSubscribers());
+    EXPECT_EQ("subscription_id: 1 "
+              "entry { entry_id: 1, data: 'b' } "
+              "entry { entry_id: 2, data: 'c' } "
+              "applied_id: 4",
+              takePush(0));
+}
+
+TEST_F(ServerStateMachineTest, subscribe_logDisappeared) {
+    subscribe("log_id: 2, from_entry_id: 0, credits: 10");
+    EXPECT_EQ(0U, numSubscribers());
+    EXPECT_EQ("subscription_id: 1 "
+              "log_disappeared {} "
+              "applied_id: 1",
+              takePush(0));
+}
+
+TEST_F(ServerStateMachineTest, subscribe_sharedPush) {
+    subscribe("log_id: 1, from_entry_id: 0, credits: 10");
+    subscribe("log_id: 1, from_entry_id: 0, credits: 10");
+    EXPECT_EQ("subscription_id: 1 applied_id: 1", takePush(0));
+    EXPECT_EQ("subscription_id: 2 applied_id: 1", takePush(1));
+
+    apply(2, "open_log { log_name: 'bar' }");
+    apply(3, "append { log_id: 2, data: 'other' }");
+    EXPECT_EQ(0U, replies.at(0).getLength());
+
+    apply(4, "append { log_id: 1, data: 'a' }");
+    // Both subscribers were sent the same copy.
+    EXPECT_TRUE(replies.at(0).getData() != NULL);
+    EXPECT_EQ(replies.at(0).getData(), replies.at(1).getData());
+    EXPECT_EQ("entry { entry_id: 0, data: 'a' } "
+              "applied_id: 4",
+              takePush(0));
+    EXPECT_EQ("entry { entry_id: 0, data: 'a' } "
+              "applied_id: 4",
+              takePush(1));
+    EXPECT_EQ(2U, numSubscribers());
+}
+
+TEST_F(ServerStateMachineTest, subscribe_credits) {
+    subscribe("log_id: 1, from_entry_id: 0, credits: 1");
+    takePush(0);
+    apply(2, "append { log_id: 1, data: 'a' }");
+    EXPECT_EQ("entry { entry_id: 0, data: 'a' } "
+              "applied_id: 2",
+              takePush(0));
+    apply(3, "append { log_id: 1, data: 'b' }");
+    apply(4, "append { log_id: 1, data: 'c' }");
+    EXPECT_EQ(0U, replies.at(0).getLength());
+
+    EXPECT_EQ("ok {}",
+              updateSubscription("subscription_id: 1, add_credits: 5"));
+    EXPECT_EQ("entry { entry_id: 1, data: 'b' } "
+              "entry { entry_id: 2, data: 'c' } "
+              "applied_id: 4",
+              takePush(0));
+    apply(5, "append { log_id: 1, data: 'd' }");
+    EXPECT_EQ("entry { entry_id: 3, data: 'd' } "
+              "applied_id: 5",
+              takePush(0));
+}
+
+TEST_F(ServerStateMachineTest, subscribe_deleteLog) {
+    subscribe("log_id: 1, from_entry_id: 0, credits: 10");
+    takePush(0);
+    apply(2, "delete_log { log_name: 'foo' }");
+    EXPECT_EQ(0U, numSubscribers());
+    EXPECT_EQ("log_disappeared {} "
+              "applied_id: 2",
+              takePush(0));
+}
+
+TEST_F(ServerStateMachineTest, subscribe_clientGone) {
+    subscribe("log_id: 1, from_entry_id: 0, credits: 10");
+    subscribe("log_id: 1, from_entry_id: 0, credits: 10");
+    {
+        std::unique_lock<Core::Mutex> lockGuard(stateMachine->mutex);
+        stateMachine->subscribers.at(1).at(1).rpc.opaqueRPC.responseTarget =
+            NULL;
+    }
+    apply(2, "append { log_id: 1, data: 'a' }");
+    EXPECT_EQ(1U, numSubscribers());
+    EXPECT_EQ(1U, stateMachine->subscribers.at(1).count(2));
+}
+
+TEST_F(ServerStateMachineTest, updateSubscription_cancel) {
+    subscribe("log_id: 1, from_entry_id: 0, credits: 10");
+    EXPECT_EQ("ok {}",
+              updateSubscription("subscription_id: 1, cancel: true"));
+    EXPECT_EQ(0U, numSubscribers());
+    EXPECT_EQ("unknown_subscription {}",
+              updateSubscription("subscription_id: 1, add_credits: 5"));
+}
+
+TEST_F(ServerStateMachineTest, appendChunk) {
+    apply(2, "append_chunk { log_id: 1, upload_id: 7, offset: 0, "
+             "               data: 'ab' }");
+    EXPECT_EQ("ok { staged_length: 2 }",
+              stateMachine->getResponse(2).append_chunk());
+    apply(3, "append_chunk { log_id: 1, upload_id: 7, offset: 2, "
+             "               data: 'cd' }");
+    // retried chunk is ignored
+    apply(4, "append_chunk { log_id: 1, upload_id: 7, offset: 2, "
+             "               data: 'cd' }");
+    EXPECT_EQ("ok { staged_length: 4 }",
+              stateMachine->getResponse(4).append_chunk());
+    EXPECT_EQ(4U, stateMachine->stagedBytes);
+    apply(5, "append { log_id: 1, upload_id: 7, upload_length: 4 }");
+    EXPECT_EQ("ok { entry_id: 0 }",
+              stateMachine->getResponse(5).append());
+    EXPECT_EQ(0U, stateMachine->uploads.size());
+    EXPECT_EQ(0U, stateMachine->stagedBytes);
+    PC::Read::Request request;
+    request.set_log_id(1);
+    request.set_from_entry_id(0);
+    PC::Read::Response response;
+    stateMachine->read(request, response);
+    EXPECT_EQ("ok { entry { entry_id: 0, data: 'abcd' } }",
+              response);
+}
+
+TEST_F(ServerStateMachineTest, appendChunk_unknownUpload) {
+    apply(2, "append_chunk { log_id: 1, upload_id: 7, offset: 2, "
+             "               data: 'cd' }");
+    EXPECT_EQ("ok { staged_length: 0 }",
+              stateMachine->getResponse(2).append_chunk());
+    apply(3, "append_chunk { log_id: 2, upload_id: 7, offset: 0, "
+             "               data: 'ab' }");
+    EXPECT_EQ("log_disappeared {}",
+              stateMachine->getResponse(3).append_chunk());
+    EXPECT_EQ(0U, stateMachine->uploads.size());
+}
+
+TEST_F(ServerStateMachineTest, appendChunk_evict) {
+    uint64_t oldLimit = StateMachine::MAX_STAGED_BYTES;
+    StateMachine::MAX_STAGED_BYTES = 4;
+    apply(2, "append_chunk { log_id: 1, upload_id: 7, offset: 0, "
+             "               data: 'abc' }");
+    apply(3, "append_chunk { log_id: 1, upload_id: 8, offset: 0, "
+             "               data: 'de' }");
+    EXPECT_EQ(1U, stateMachine->uploads.count(8));
+    EXPECT_EQ(0U, stateMachine->uploads.count(7));
+    EXPECT_EQ(2U, stateMachine->stagedBytes);
+    // the upload being added to is never evicted
+    apply(4, "append_chunk { log_id: 1, upload_id: 8, offset: 2, "
+             "               data: 'fgh' }");
+    EXPECT_EQ("ok { staged_length: 5 }",
+              stateMachine->getResponse(4).append_chunk());
+    StateMachine::MAX_STAGED_BYTES = oldLimit;
+}
+
+TEST_F(ServerStateMachineTest, appendChunk_deleteLog) {
+    apply(2, "append_chunk { log_id: 1, upload_id: 7, offset: 0, "
+             "               data: 'abc' }");
+    apply(3, "delete_log { log_name: 'foo' }");
+    EXPECT_EQ(0U, stateMachine->uploads.size());
+    EXPECT_EQ(0U, stateMachine->stagedBytes);
+}
+
+TEST_F(ServerStateMachineTest, append_uploadDisappeared) {
+    apply(2, "append { log_id: 1, upload_id: 7, upload_length: 0 }");
+    EXPECT_EQ("upload_disappeared {}",
+              stateMachine->getResponse(2).append());
+    apply(3, "append_chunk { log_id: 1, upload_id: 7, offset: 0, "
+             "               data: 'abc' }");
+    apply(4, "append { log_id: 1, upload_id: 7, upload_length: 4 }");
+    EXPECT_EQ("upload_disappeared {}",
+              stateMachine->getResponse(4).append());
+    apply(5, "append { log_id: 1, data: 'x' }");
+    EXPECT_EQ("ok { entry_id: 0 }",
+              stateMachine->getResponse(5).append());
+}
+
+TEST_F(ServerStateMachineTest, advance_sharesAppendData) {
+    PC::Command command;
+    command.mutable_append()->set_log_id(1);
+    command.mutable_append()->set_data("hello");
+    Core::Payload data = StateMachine::serializeCommand(command, true);
+    {
+        std::unique_lock<Core::Mutex> lockGuard(stateMachine->mutex);
+        stateMachine->advance(2, data);
+    }
+    const StateMachine::Entry& entry = stateMachine->logs.at(1)->at(0);
+    EXPECT_EQ("hello", entry.data.toString());
+    EXPECT_TRUE(entry.data.isShared());
+    EXPECT_EQ(data.data() + data.size() - 5, entry.data.data());
+}
+
+TEST_F(ServerStateMachineTest, advance_textCommand) {
+    {
+        std::unique_lock<Core::Mutex> lockGuard(stateMachine->mutex);
+        stateMachine->advance(2, Core::Payload(
+            "append { log_id: 1 data: \"hi\" }"));
+        stateMachine->lastEntryId = 2;
+    }
+    EXPECT_EQ("ok { entry_id: 0 }",
+              stateMachine->getResponse(2).append());
+    EXPECT_EQ("hi", stateMachine->logs.at(1)->at(0).data.toString());
+}
+
+TEST_F(ServerStateMachineTest, advance_binaryCommandStartingWithLetter) {
+    // Field 13 as a varint has the tag 'h', so a binary command that starts
+    // with that field looks like text but for its marker.
+    PC::Command command;
+    command.mutable_append()->set_log_id(1);
+    command.mutable_append()->set_data("hi");
+    std::string bytes(1, StateMachine::BINARY_COMMAND_MARKER);
+    bytes += "h";
+    bytes += '\0';
+    bytes += command.SerializeAsString();
+    {
+        std::unique_lock<Core::Mutex> lockGuard(stateMachine->mutex);
+        stateMachine->advance(2, Core::Payload(bytes));
+        stateMachine->lastEntryId = 2;
+    }
+    EXPECT_EQ("ok { entry_id: 0 }",
+              stateMachine->getResponse(2).append());
+    EXPECT_EQ("hi", stateMachine->logs.at(1)->at(0).data.toString());
+}
+
+TEST_F(ServerStateMachineTest, serializeCommand) {
+    PC::Command command;
+    command.mutable_append()->set_log_id(1);
+    command.mutable_append()->set_data("hi");
+    EXPECT_EQ(command,
+              Core::ProtoBuf::fromString<PC::Command>(
+                  StateMachine::serializeCommand(command, false).toString()));
+    Core::Payload binary = StateMachine::serializeCommand(command, true);
+    ASSERT_LT(0U, binary.size());
+    EXPECT_EQ(StateMachine::BINARY_COMMAND_MARKER, binary.data()[0]);
+    PC::Command parsed;
+    EXPECT_TRUE(parsed.ParseFromArray(binary.data() + 1,
+                                      int(binary.size() - 1)));
+    EXPECT_EQ(command, parsed);
+}
+
+TEST_F(ServerStateMachineTest, updateServerStats) {
+    PC::Command command;
+    command.mutable_append()->set_log_id(1);
+    command.mutable_append()->set_data("hello");
+    Core::Payload data = StateMachine::serializeCommand(command, true);
+    {
+        std::unique_lock<Core::Mutex> lockGuard(stateMachine->mutex);
+        stateMachine->advance(2, data);
+    }
+    // this command's payload is gone once it's applied
+    apply(3, "append { log_id: 1, data: 'abc' }");
+    apply(4, "append { log_id: 1 }");
+    PC::ServerStats stats;
+    stateMachine->updateServerStats(stats);
+    EXPECT_EQ("num_entries: 3, bytes: 8, unshared_bytes: 3",
+              stats.state_machine());
+}
+
+TEST_F(ServerStateMachineTest, read_dataCutShort) {
+    std::string data(Protocol::Common::MAX_CHUNK_LENGTH + 3, 'x');
+    data.replace(data.size() - 3, 3, "abc");
+    PC::Command command;
+    command.mutable_append()->set_log_id(1);
+    command.mutable_append()->set_data(data);
+    apply(2, Core::ProtoBuf::dumpString(command, false));
+
+    PC::Read::Request request;
+    request.set_log_id(1);
+    request.set_from_entry_id(0);
+    PC::Read::Response response;
+    stateMachine->read(request, response);
+    ASSERT_EQ(1, response.ok().entry_size());
+    EXPECT_EQ(data.substr(0, Protocol::Common::MAX_CHUNK_LENGTH),
+              response.ok().entry(0).data());
+    EXPECT_EQ(data.size(), response.ok().entry(0).data_length());
+
+    request.set_data_offset(Protocol::Common::MAX_CHUNK_LENGTH);
+    response.Clear();
+    stateMachine->read(request, response);
+    EXPECT_EQ(Core::StringUtil::format(
+                "ok { entry { entry_id: 0, data: 'abc', data_length: %lu } }",
+                data.size()),
+              response);
+
+    request.set_from_entry_id(1);
+    response.Clear();
+    stateMachine->read(request, response);
+    EXPECT_EQ("ok {}", response);
+
+    watch("log_id: 1, from_entry_id: 0, timeout_ms: 10000");
+    ASSERT_EQ(1, getReply(0).ok().entry_size());
+    EXPECT_EQ(data.size(), getReply(0).ok().entry(0).data_length());
+}
+
+} // namespace LogCabin::Server::<anonymous>
+} // namespace LogCabin::Server
+} // namespace LogCabin
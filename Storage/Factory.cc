@@ -19,30 +19,52 @@
 #include "Core/Config.h"
 #include "Storage/Factory.h"
 #include "Storage/FilesystemModule.h"
+#include "Storage/LatencyModule.h"
 #include "Storage/MemoryModule.h"
 
 namespace LogCabin {
 namespace Storage {
 namespace Factory {
 
+namespace {
+
+/**
+ * Construct the storage module with the given name.
+ */
 std::unique_ptr<Module>
-createStorageModule(const Core::Config& config)
+createStorageModule(const std::string& moduleName,
+                    const Core::Config& config)
 {
     std::unique_ptr<Module> module;
-    std::string moduleName = config.read<std::string>("storageModule");
     NOTICE("Using '%s' storage module", moduleName.c_str());
     if (moduleName == "memory") {
         module.reset(new MemoryModule());
     } else if (moduleName == "filesystem") {
         module.reset(new FilesystemModule(config));
+    } else if (moduleName == "latency") {
+        std::string innerName =
+            config.read<std::string>("latencyStorageModule", "memory");
+        if (innerName == "latency")
+            PANIC("The latency storage module can't wrap itself");
+        module.reset(new LatencyModule(
+            config, createStorageModule(innerName, config)));
     } else {
         PANIC("Bad storage module given: %s\n"
-              "Choices are: memory, filesystem",
+              "Choices are: memory, filesystem, latency",
               moduleName.c_str());
     }
     return module;
 }
 
+} // anonymous namespace
+
+std::unique_ptr<Module>
+createStorageModule(const Core::Config& config)
+{
+    return createStorageModule(config.read<std::string>("storageModule"),
+                               config);
+}
+
 } // namespace LogCabin::Storage::Factory
 } // namespace LogCabin::Storage
 } // namespace LogCabin
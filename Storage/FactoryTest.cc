@@ -17,6 +17,8 @@
 
 #include "Core/Config.h"
 #include "Storage/Factory.h"
+#include "Storage/LatencyModule.h"
+#include "Storage/MemoryModule.h"
 #include "Storage/Module.h"
 
 namespace LogCabin {
@@ -29,6 +31,18 @@ TEST(StorageFactoryTest, normal) {
     m->getLogs();
 }
 
+TEST(StorageFactoryTest, latency) {
+    Core::Config config;
+    config.set("storageModule", "latency");
+    std::unique_ptr<Module> m = Factory::createStorageModule(config);
+    EXPECT_TRUE(dynamic_cast<LatencyModule*>(m.get()) != NULL);
+    EXPECT_TRUE(dynamic_cast<MemoryModule*>(
+                    static_cast<LatencyModule*>(m.get())->module.get())
+                != NULL);
+    config.set("latencyStorageModule", "latency");
+    EXPECT_DEATH(Factory::createStorageModule(config), "wrap itself");
+}
+
 TEST(StorageFactoryTest, badName) {
     Core::Config config;
     EXPECT_THROW(Factory::createStorageModule(config),
@@ -0,0 +1,108 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <memory>
+#include <string>
+
+#include "bench/Bench.h"
+#include "Core/Config.h"
+#include "Storage/FilesystemModule.h"
+#include "Storage/FilesystemUtil.h"
+#include "Storage/LogEntry.h"
+
+namespace LogCabin {
+namespace Storage {
+namespace {
+
+/**
+ * Creates a FilesystemModule in a temporary directory and removes the
+ * directory again when destroyed.
+ */
+class TemporaryModule {
+  public:
+    TemporaryModule()
+        : tmpdir(FilesystemUtil::tmpnam())
+        , module()
+    {
+        Core::Config config;
+        config.set("storagePath", tmpdir);
+        module.reset(new FilesystemModule(config));
+    }
+    ~TemporaryModule() {
+        module.reset();
+        FilesystemUtil::remove(tmpdir);
+    }
+    std::string tmpdir;
+    std::unique_ptr<FilesystemModule> module;
+};
+
+/**
+ * Return a log entry with a payload of the given size.
+ */
+LogEntry
+makeEntry(const std::string& data)
+{
+    return LogEntry(0, RPC::Buffer(const_cast<char*>(data.data()),
+                                   uint32_t(data.length()),
+                                   NULL));
+}
+
+void
+append(Bench::State& state, uint32_t dataLength)
+{
+    state.pauseTiming();
+    TemporaryModule tmp;
+    std::unique_ptr<Log> log(tmp.module->openLog(1));
+    std::string data(dataLength, 'x');
+    state.setBytesPerIteration(dataLength);
+    state.resumeTiming();
+    for (uint64_t i = 0; i < state.iterations; ++i)
+        log->append(makeEntry(data));
+    state.pauseTiming();
+}
+
+BENCHMARK(StorageFilesystemModule, append64B) {
+    append(state, 64);
+}
+
+BENCHMARK(StorageFilesystemModule, append4KB) {
+    append(state, 4096);
+}
+
+/**
+ * Each iteration reopens a log of 1000 entries, reading them all back in and
+ * verifying their checksums.
+ */
+BENCHMARK(StorageFilesystemModule, recover1000) {
+    state.pauseTiming();
+    TemporaryModule tmp;
+    std::string data(64, 'x');
+    {
+        std::unique_ptr<Log> log(tmp.module->openLog(1));
+        for (uint32_t i = 0; i < 1000; ++i)
+            log->append(makeEntry(data));
+    }
+    state.setBytesPerIteration(1000 * data.length());
+    state.resumeTiming();
+    for (uint64_t i = 0; i < state.iterations; ++i) {
+        std::unique_ptr<Log> log(tmp.module->openLog(1));
+        Bench::doNotOptimize(log->getLastId());
+    }
+    state.pauseTiming();
+}
+
+} // namespace LogCabin::Storage::<anonymous>
+} // namespace LogCabin::Storage
+} // namespace LogCabin
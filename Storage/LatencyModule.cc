@@ -0,0 +1,330 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include "Core/Config.h"
+#include "Core/Debug.h"
+#include "Core/StringUtil.h"
+#include "Storage/LatencyModule.h"
+#include "Storage/LogEntry.h"
+
+namespace LogCabin {
+namespace Storage {
+
+using Core::StringUtil::format;
+
+////////// LatencyInjector::Distribution //////////
+
+LatencyInjector::Distribution::Distribution()
+    : type(NONE)
+    , a(0)
+    , b(0)
+{
+}
+
+LatencyInjector::Distribution
+LatencyInjector::Distribution::parse(const std::string& description)
+{
+    Distribution distribution;
+    std::istringstream in(description);
+    std::string name;
+    in >> name;
+    if (name.empty())
+        return distribution;
+    uint32_t numParams = 0;
+    if (name == "none") {
+        distribution.type = NONE;
+    } else if (name == "constant") {
+        distribution.type = CONSTANT;
+        numParams = 1;
+    } else if (name == "uniform") {
+        distribution.type = UNIFORM;
+        numParams = 2;
+    } else if (name == "exponential") {
+        distribution.type = EXPONENTIAL;
+        numParams = 1;
+    } else if (name == "normal") {
+        distribution.type = NORMAL;
+        numParams = 2;
+    } else {
+        // A bare number is shorthand for "constant <number>".
+        in.clear();
+        in.str(description);
+        distribution.type = CONSTANT;
+        numParams = 1;
+    }
+    if (numParams >= 1)
+        in >> distribution.a;
+    if (numParams >= 2)
+        in >> distribution.b;
+    if (!in.eof())
+        in >> std::ws;
+    if (in.fail() || !in.eof() ||
+        distribution.a < 0 || distribution.b < 0 ||
+        (distribution.type == UNIFORM && distribution.b < distribution.a)) {
+        PANIC("Bad latency distribution given: '%s'\n"
+              "Choices are: none, <us>, constant <us>, "
+              "uniform <min us> <max us>, exponential <mean us>, "
+              "normal <mean us> <stddev us>",
+              description.c_str());
+    }
+    if (distribution.type == CONSTANT && distribution.a == 0)
+        distribution.type = NONE;
+    return distribution;
+}
+
+std::chrono::microseconds
+LatencyInjector::Distribution::sample(std::mt19937& generator) const
+{
+    double micros = 0;
+    switch (type) {
+        case NONE:
+            break;
+        case CONSTANT:
+            micros = a;
+            break;
+        case UNIFORM: {
+            std::uniform_real_distribution<double> d(a, b);
+            micros = d(generator);
+            break;
+        }
+        case EXPONENTIAL: {
+            if (a > 0) {
+                std::exponential_distribution<double> d(1 / a);
+                micros = d(generator);
+            }
+            break;
+        }
+        case NORMAL: {
+            std::normal_distribution<double> d(a, b);
+            micros = std::max(0.0, d(generator));
+            break;
+        }
+    }
+    return std::chrono::microseconds(int64_t(micros));
+}
+
+bool
+LatencyInjector::Distribution::isZero() const
+{
+    switch (type) {
+        case NONE:
+            return true;
+        case CONSTANT:
+        case EXPONENTIAL:
+            return a == 0;
+        case UNIFORM:
+        case NORMAL:
+            return a == 0 && b == 0;
+    }
+    return true;
+}
+
+std::string
+LatencyInjector::Distribution::toString() const
+{
+    switch (type) {
+        case NONE:
+            return "none";
+        case CONSTANT:
+            return format("constant %g", a);
+        case UNIFORM:
+            return format("uniform %g %g", a, b);
+        case EXPONENTIAL:
+            return format("exponential %g", a);
+        case NORMAL:
+            return format("normal %g %g", a, b);
+    }
+    return "none";
+}
+
+////////// LatencyInjector //////////
+
+LatencyInjector::LatencyInjector(const Core::Config& config,
+                                 const std::string& prefix)
+    : appendLatency(Distribution::parse(
+        config.read<std::string>(prefix + "Append", "none")))
+    , syncLatency(Distribution::parse(
+        config.read<std::string>(prefix + "Sync", "none")))
+    , stallPeriod(config.read<uint64_t>(prefix + "StallPeriodMs", 0))
+    , stallDuration(config.read<uint64_t>(prefix + "StallMs", 0))
+    , bytesPerSecond(config.read<uint64_t>(prefix + "BytesPerSecond", 0))
+    , mutex()
+    , generator(config.read<uint32_t>(prefix + "Seed", 1))
+    , epoch(Clock::now())
+    , busyUntil(epoch)
+{
+    if (stallDuration > stallPeriod) {
+        PANIC("%sStallMs (%lu) must not exceed %sStallPeriodMs (%lu)",
+              prefix.c_str(), uint64_t(stallDuration.count()),
+              prefix.c_str(), uint64_t(stallPeriod.count()));
+    }
+}
+
+bool
+LatencyInjector::isEnabled() const
+{
+    return (!appendLatency.isZero() ||
+            !syncLatency.isZero() ||
+            stallDuration.count() > 0 ||
+            bytesPerSecond > 0);
+}
+
+void
+LatencyInjector::write(uint64_t bytes)
+{
+    sleep(getWriteDelay(bytes, Clock::now()));
+}
+
+void
+LatencyInjector::sync()
+{
+    sleep(getSyncDelay(Clock::now()));
+}
+
+std::string
+LatencyInjector::toString() const
+{
+    return format("append %s, sync %s, stall %lu of every %lu ms, "
+                  "%lu bytes/s",
+                  appendLatency.toString().c_str(),
+                  syncLatency.toString().c_str(),
+                  uint64_t(stallDuration.count()),
+                  uint64_t(stallPeriod.count()),
+                  bytesPerSecond);
+}
+
+std::chrono::nanoseconds
+LatencyInjector::getWriteDelay(uint64_t bytes, TimePoint now)
+{
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    // A stalled disk doesn't start on anything new until the stall ends.
+    TimePoint start = now + getStallDelay(now);
+    // Then the data has to get through the disk after everything else
+    // that's already queued up.
+    if (bytesPerSecond > 0) {
+        start = std::max(start, busyUntil);
+        busyUntil = start + std::chrono::nanoseconds(
+                        bytes * 1000000000UL / bytesPerSecond);
+        start = busyUntil;
+    }
+    TimePoint done = (start +
+                      appendLatency.sample(generator) +
+                      syncLatency.sample(generator));
+    return done - now;
+}
+
+std::chrono::nanoseconds
+LatencyInjector::getSyncDelay(TimePoint now)
+{
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    TimePoint start = now + getStallDelay(now);
+    // A sync can't finish before the writes queued ahead of it do.
+    if (bytesPerSecond > 0)
+        start = std::max(start, busyUntil);
+    TimePoint done = start + syncLatency.sample(generator);
+    return done - now;
+}
+
+std::chrono::nanoseconds
+LatencyInjector::getStallDelay(TimePoint now) const
+{
+    if (stallDuration.count() == 0 || now < epoch)
+        return std::chrono::nanoseconds(0);
+    std::chrono::nanoseconds period = stallPeriod;
+    std::chrono::nanoseconds intoPeriod = (now - epoch) % period;
+    std::chrono::nanoseconds duration = stallDuration;
+    if (intoPeriod < duration)
+        return duration - intoPeriod;
+    return std::chrono::nanoseconds(0);
+}
+
+void
+LatencyInjector::sleep(std::chrono::nanoseconds delay)
+{
+    int64_t micros =
+        std::chrono::duration_cast<std::chrono::microseconds>(delay).count();
+    if (micros > 0)
+        usleep(useconds_t(micros));
+}
+
+////////// LatencyLog //////////
+
+LatencyLog::LatencyLog(std::unique_ptr<Log> log, LatencyInjector& injector)
+    : Log(log->logId)
+    , log(std::move(log))
+    , injector(injector)
+{
+}
+
+EntryId
+LatencyLog::getLastId() const
+{
+    return log->getLastId();
+}
+
+std::deque<const LogEntry*>
+LatencyLog::readFrom(EntryId start) const
+{
+    return log->readFrom(start);
+}
+
+EntryId
+LatencyLog::append(LogEntry entry)
+{
+    injector.write(entry.data.getLength());
+    return log->append(std::move(entry));
+}
+
+////////// LatencyModule //////////
+
+LatencyModule::LatencyModule(const Core::Config& config,
+                             std::unique_ptr<Module> module)
+    : module(std::move(module))
+    , injector(config, "storageLatency")
+{
+    NOTICE("Injecting storage latency: %s", injector.toString().c_str());
+}
+
+LatencyModule::~LatencyModule()
+{
+}
+
+std::vector<LogId>
+LatencyModule::getLogs()
+{
+    return module->getLogs();
+}
+
+Log*
+LatencyModule::openLog(LogId logId)
+{
+    std::unique_ptr<Log> log(module->openLog(logId));
+    return new LatencyLog(std::move(log), injector);
+}
+
+void
+LatencyModule::deleteLog(LogId logId)
+{
+    injector.sync();
+    module->deleteLog(logId);
+}
+
+} // namespace LogCabin::Storage
+} // namespace LogCabin
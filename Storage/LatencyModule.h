@@ -0,0 +1,278 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Contains LatencyModule and LatencyInjector, which slow down writes to
+ * simulate a slow or misbehaving disk.
+ */
+
+#include <chrono>
+#include <cinttypes>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+
+#include "Core/Time.h"
+#include "Storage/Log.h"
+#include "Storage/Module.h"
+
+#ifndef LOGCABIN_STORAGE_LATENCYMODULE_H
+#define LOGCABIN_STORAGE_LATENCYMODULE_H
+
+namespace LogCabin {
+
+// forward declaration
+namespace Core {
+class Config;
+}
+
+namespace Storage {
+
+/**
+ * Decides how long to delay each write to simulate a slow disk, then sleeps
+ * for that long. It's shared by LatencyModule and the Raft log, which read
+ * their settings from the config file under different prefixes. Given the
+ * prefix 'p', the settings are:
+ *  - pAppend: the distribution of the time to write data (see
+ *    Distribution::parse()).
+ *  - pSync: the distribution of the time to make written data durable.
+ *  - pStallPeriodMs and pStallMs: writes are blocked for the first pStallMs
+ *    milliseconds of every pStallPeriodMs milliseconds, the way a disk stalls
+ *    during a background flush or garbage collection.
+ *  - pBytesPerSecond: the disk's throughput. Writes queue up behind each
+ *    other to go no faster than this.
+ *  - pSeed: seeds the random number generator, so that runs are repeatable.
+ * All of them default to no added latency.
+ */
+class LatencyInjector {
+  public:
+    typedef Core::Time::SteadyClock Clock;
+    typedef Clock::time_point TimePoint;
+
+    /**
+     * A distribution of delays, in microseconds.
+     */
+    class Distribution {
+      public:
+        /// Constructor. The distribution is always 0.
+        Distribution();
+
+        /**
+         * Parse a description of a distribution. Times are in microseconds.
+         * The forms accepted are:
+         *  - "none": no delay.
+         *  - "<t>" or "constant <t>": always t.
+         *  - "uniform <min> <max>": uniformly distributed in [min, max].
+         *  - "exponential <mean>": exponentially distributed with the given
+         *    mean, which gives a long tail.
+         *  - "normal <mean> <stddev>": normally distributed, but never
+         *    negative.
+         * PANICs if the description is not one of these.
+         */
+        static Distribution parse(const std::string& description);
+
+        /**
+         * Return a random delay from the distribution.
+         */
+        std::chrono::microseconds sample(std::mt19937& generator) const;
+
+        /**
+         * Return true if sample() always returns 0.
+         */
+        bool isZero() const;
+
+        /**
+         * Return a description of the distribution in the form parse()
+         * accepts.
+         */
+        std::string toString() const;
+
+      private:
+        enum Type { NONE, CONSTANT, UNIFORM, EXPONENTIAL, NORMAL };
+        /// The kind of distribution.
+        Type type;
+        /// The first parameter: the value, minimum, or mean.
+        double a;
+        /// The second parameter: the maximum or standard deviation.
+        double b;
+    };
+
+    /**
+     * Constructor.
+     * \param config
+     *      Settings are read from here.
+     * \param prefix
+     *      The prefix of the settings' names, as described above.
+     */
+    LatencyInjector(const Core::Config& config, const std::string& prefix);
+
+    /**
+     * Return false if this was configured to never add any latency, so that
+     * callers can avoid wrapping their logs at all.
+     */
+    bool isEnabled() const;
+
+    /**
+     * Delay the caller as if it wrote 'bytes' bytes and then waited for them
+     * to become durable.
+     */
+    void write(uint64_t bytes);
+
+    /**
+     * Delay the caller as if it waited for earlier writes to become durable.
+     */
+    void sync();
+
+    /**
+     * Return a one-line summary of the settings, for the log.
+     */
+    std::string toString() const;
+
+  private:
+    /**
+     * Return how long write() should block if called at 'now'. This is
+     * separate from write() so that it can be tested with a fake time.
+     */
+    std::chrono::nanoseconds getWriteDelay(uint64_t bytes, TimePoint now);
+
+    /**
+     * Return how long sync() should block if called at 'now'.
+     */
+    std::chrono::nanoseconds getSyncDelay(TimePoint now);
+
+    /**
+     * Return how long a request arriving at 'now' must wait for the current
+     * stall to end, or 0 if the disk isn't stalled at 'now'.
+     * The caller must hold #mutex.
+     */
+    std::chrono::nanoseconds getStallDelay(TimePoint now) const;
+
+    /**
+     * Sleep for the given amount of time.
+     */
+    static void sleep(std::chrono::nanoseconds delay);
+
+    /**
+     * See "pAppend".
+     */
+    Distribution appendLatency;
+
+    /**
+     * See "pSync".
+     */
+    Distribution syncLatency;
+
+    /**
+     * See "pStallPeriodMs".
+     */
+    std::chrono::milliseconds stallPeriod;
+
+    /**
+     * See "pStallMs".
+     */
+    std::chrono::milliseconds stallDuration;
+
+    /**
+     * See "pBytesPerSecond". 0 means unlimited.
+     */
+    uint64_t bytesPerSecond;
+
+    /**
+     * Protects the members below.
+     */
+    mutable std::mutex mutex;
+
+    /**
+     * Generates the samples from #appendLatency and #syncLatency.
+     */
+    std::mt19937 generator;
+
+    /**
+     * Stall periods are measured from this time.
+     */
+    TimePoint epoch;
+
+    /**
+     * When the simulated disk finishes the writes it has already accepted,
+     * under the #bytesPerSecond limit.
+     */
+    TimePoint busyUntil;
+
+    // LatencyInjector is non-copyable.
+    LatencyInjector(const LatencyInjector&) = delete;
+    LatencyInjector& operator=(const LatencyInjector&) = delete;
+};
+
+/**
+ * A Log that delays its writes using a LatencyInjector and otherwise passes
+ * everything through to another Log. See LatencyModule.
+ */
+class LatencyLog : public Log {
+  public:
+    /**
+     * Constructor.
+     * \param log
+     *      The log to wrap.
+     * \param injector
+     *      Decides how long to delay appends. Must outlive this object.
+     */
+    LatencyLog(std::unique_ptr<Log> log, LatencyInjector& injector);
+    EntryId getLastId() const;
+    std::deque<const LogEntry*> readFrom(EntryId start) const;
+    EntryId append(LogEntry entry);
+  private:
+    /// See constructor.
+    std::unique_ptr<Log> log;
+    /// See constructor.
+    LatencyInjector& injector;
+};
+
+/**
+ * A storage module that wraps another storage module and slows down its
+ * appends to simulate a slow disk. It's meant for testing and benchmarking
+ * how the rest of the system reacts when one server's storage misbehaves.
+ *
+ * It's selected with "storageModule = latency". The wrapped module is named
+ * by "latencyStorageModule" (default: memory) and reads its own settings as
+ * usual. The delays are configured as described in LatencyInjector, using
+ * the prefix "storageLatency".
+ */
+class LatencyModule : public Module {
+  public:
+    /**
+     * Constructor.
+     * \param config
+     *      Settings for this module and the module it wraps.
+     * \param module
+     *      The module to wrap.
+     */
+    LatencyModule(const Core::Config& config, std::unique_ptr<Module> module);
+    ~LatencyModule();
+    std::vector<LogId> getLogs();
+    Log* openLog(LogId logId);
+    void deleteLog(LogId logId);
+  private:
+    /// See constructor.
+    std::unique_ptr<Module> module;
+    /// Delays the appends to every log opened from this module.
+    LatencyInjector injector;
+};
+
+} // namespace LogCabin::Storage
+} // namespace LogCabin
+
+#endif /* LOGCABIN_STORAGE_LATENCYMODULE_H */
@@ -0,0 +1,225 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <gtest/gtest.h>
+
+#include "Core/Config.h"
+#include "Storage/LatencyModule.h"
+#include "Storage/LogEntry.h"
+#include "Storage/MemoryModule.h"
+
+namespace LogCabin {
+namespace Storage {
+namespace {
+
+typedef LatencyInjector::Distribution Distribution;
+typedef LatencyInjector::TimePoint TimePoint;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+
+RPC::Buffer
+buf(const char* str)
+{
+    return RPC::Buffer(strdup(str),
+                       uint32_t(strlen(str) + 1),
+                       free);
+}
+
+TEST(StorageLatencyDistributionTest, parse) {
+    EXPECT_EQ("none", Distribution::parse("").toString());
+    EXPECT_EQ("none", Distribution::parse("none").toString());
+    EXPECT_EQ("none", Distribution::parse("0").toString());
+    EXPECT_EQ("constant 250", Distribution::parse("250").toString());
+    EXPECT_EQ("constant 250", Distribution::parse(" constant 250 ").toString());
+    EXPECT_EQ("uniform 10 20", Distribution::parse("uniform 10 20").toString());
+    EXPECT_EQ("exponential 500",
+              Distribution::parse("exponential 500").toString());
+    EXPECT_EQ("normal 100 5", Distribution::parse("normal 100 5").toString());
+}
+
+TEST(StorageLatencyDistributionTest, parseBad) {
+    EXPECT_DEATH(Distribution::parse("bogus"), "Bad latency distribution");
+    EXPECT_DEATH(Distribution::parse("none 5"), "Bad latency distribution");
+    EXPECT_DEATH(Distribution::parse("constant"), "Bad latency distribution");
+    EXPECT_DEATH(Distribution::parse("uniform 10"),
+                 "Bad latency distribution");
+    EXPECT_DEATH(Distribution::parse("uniform 20 10"),
+                 "Bad latency distribution");
+    EXPECT_DEATH(Distribution::parse("exponential -1"),
+                 "Bad latency distribution");
+    EXPECT_DEATH(Distribution::parse("10 20"), "Bad latency distribution");
+}
+
+TEST(StorageLatencyDistributionTest, sample) {
+    std::mt19937 generator(1);
+    EXPECT_EQ(microseconds(0), Distribution().sample(generator));
+    EXPECT_EQ(microseconds(250), Distribution::parse("250").sample(generator));
+    for (uint32_t i = 0; i < 100; ++i) {
+        microseconds uniform =
+            Distribution::parse("uniform 10 20").sample(generator);
+        EXPECT_LE(microseconds(10), uniform);
+        EXPECT_GE(microseconds(20), uniform);
+        EXPECT_LE(microseconds(0),
+                  Distribution::parse("normal 1 100").sample(generator));
+        EXPECT_LE(microseconds(0),
+                  Distribution::parse("exponential 100").sample(generator));
+    }
+}
+
+TEST(StorageLatencyDistributionTest, isZero) {
+    EXPECT_TRUE(Distribution().isZero());
+    EXPECT_TRUE(Distribution::parse("constant 0").isZero());
+    EXPECT_TRUE(Distribution::parse("uniform 0 0").isZero());
+    EXPECT_TRUE(Distribution::parse("exponential 0").isZero());
+    EXPECT_FALSE(Distribution::parse("uniform 0 1").isZero());
+    EXPECT_FALSE(Distribution::parse("normal 0 1").isZero());
+}
+
+class StorageLatencyInjectorTest : public ::testing::Test {
+    StorageLatencyInjectorTest()
+        : config()
+        , injector()
+    {
+    }
+    void create() {
+        injector.reset(new LatencyInjector(config, "test"));
+        injector->epoch = TimePoint();
+        injector->busyUntil = TimePoint();
+    }
+    Core::Config config;
+    std::unique_ptr<LatencyInjector> injector;
+};
+
+TEST_F(StorageLatencyInjectorTest, constructor) {
+    create();
+    EXPECT_FALSE(injector->isEnabled());
+    EXPECT_EQ("append none, sync none, stall 0 of every 0 ms, 0 bytes/s",
+              injector->toString());
+    config.set("testAppend", "uniform 1 2");
+    config.set("testSync", "3");
+    config.set("testStallPeriodMs", "1000");
+    config.set("testStallMs", "100");
+    config.set("testBytesPerSecond", "4096");
+    create();
+    EXPECT_TRUE(injector->isEnabled());
+    EXPECT_EQ("append uniform 1 2, sync constant 3, "
+              "stall 100 of every 1000 ms, 4096 bytes/s",
+              injector->toString());
+    config.set("testStallMs", "2000");
+    EXPECT_DEATH(create(), "must not exceed");
+}
+
+TEST_F(StorageLatencyInjectorTest, isEnabled) {
+    config.set("testSync", "3");
+    create();
+    EXPECT_TRUE(injector->isEnabled());
+    config.set("testSync", "none");
+    config.set("testStallPeriodMs", "1000");
+    create();
+    EXPECT_FALSE(injector->isEnabled());
+    config.set("testStallMs", "1");
+    create();
+    EXPECT_TRUE(injector->isEnabled());
+}
+
+TEST_F(StorageLatencyInjectorTest, getWriteDelay) {
+    config.set("testAppend", "100");
+    config.set("testSync", "1000");
+    create();
+    TimePoint now = TimePoint() + milliseconds(5);
+    EXPECT_EQ(microseconds(1100), injector->getWriteDelay(10, now));
+    EXPECT_EQ(microseconds(1000), injector->getSyncDelay(now));
+}
+
+TEST_F(StorageLatencyInjectorTest, getWriteDelay_throughput) {
+    config.set("testBytesPerSecond", "1000");
+    create();
+    TimePoint now = TimePoint() + milliseconds(5);
+    // 100 bytes take 100ms on their own.
+    EXPECT_EQ(milliseconds(100), injector->getWriteDelay(100, now));
+    // The next write waits behind the first.
+    EXPECT_EQ(milliseconds(150), injector->getWriteDelay(50, now));
+    // So does a sync.
+    EXPECT_EQ(milliseconds(150), injector->getSyncDelay(now));
+    // Once the disk is idle, there's no queue.
+    now += milliseconds(1000);
+    EXPECT_EQ(milliseconds(10), injector->getWriteDelay(10, now));
+    EXPECT_EQ(milliseconds(10), injector->getSyncDelay(now));
+}
+
+TEST_F(StorageLatencyInjectorTest, getStallDelay) {
+    config.set("testStallPeriodMs", "1000");
+    config.set("testStallMs", "100");
+    create();
+    TimePoint epoch = TimePoint();
+    EXPECT_EQ(milliseconds(100), injector->getStallDelay(epoch));
+    EXPECT_EQ(milliseconds(70),
+              injector->getStallDelay(epoch + milliseconds(30)));
+    EXPECT_EQ(milliseconds(0),
+              injector->getStallDelay(epoch + milliseconds(100)));
+    EXPECT_EQ(milliseconds(0),
+              injector->getStallDelay(epoch + milliseconds(999)));
+    EXPECT_EQ(milliseconds(99),
+              injector->getStallDelay(epoch + milliseconds(3001)));
+    EXPECT_EQ(milliseconds(99),
+              injector->getWriteDelay(1, epoch + milliseconds(3001)));
+    EXPECT_EQ(milliseconds(99),
+              injector->getSyncDelay(epoch + milliseconds(3001)));
+}
+
+TEST_F(StorageLatencyInjectorTest, write) {
+    config.set("testAppend", "2000");
+    create();
+    injector->epoch = LatencyInjector::Clock::now();
+    TimePoint start = LatencyInjector::Clock::now();
+    injector->write(10);
+    EXPECT_LE(microseconds(2000), LatencyInjector::Clock::now() - start);
+}
+
+class StorageLatencyModuleTest : public ::testing::Test {
+    StorageLatencyModuleTest()
+        : config()
+        , module()
+    {
+        config.set("storageLatencyAppend", "1");
+        std::unique_ptr<Module> memory(new MemoryModule());
+        module.reset(new LatencyModule(config, std::move(memory)));
+    }
+    Core::Config config;
+    std::unique_ptr<LatencyModule> module;
+};
+
+TEST_F(StorageLatencyModuleTest, passThrough) {
+    EXPECT_EQ(0U, module->getLogs().size());
+    std::unique_ptr<Log> log(module->openLog(12));
+    EXPECT_EQ(12U, log->logId);
+    EXPECT_EQ(NO_ENTRY_ID, log->getLastId());
+    EXPECT_EQ(0U, log->append(LogEntry(3, buf("hello"))));
+    EXPECT_EQ(1U, log->append(LogEntry(4, buf("world"))));
+    EXPECT_EQ(1U, log->getLastId());
+    std::deque<const LogEntry*> entries = log->readFrom(1);
+    ASSERT_EQ(1U, entries.size());
+    EXPECT_EQ(4U, entries.at(0)->createTime);
+    log.reset();
+    module->deleteLog(12);
+}
+
+} // namespace LogCabin::Storage::<anonymous>
+} // namespace LogCabin::Storage
+} // namespace LogCabin
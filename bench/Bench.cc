@@ -0,0 +1,119 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <algorithm>
+
+#include "bench/Bench.h"
+#include "Core/Debug.h"
+
+namespace LogCabin {
+namespace Bench {
+
+namespace {
+
+/**
+ * Return the registry of benchmarks. This is a function-local static so that
+ * it's constructed before the first BENCHMARK registers itself, regardless of
+ * the order in which the translation units are initialized.
+ */
+std::vector<Benchmark>&
+registry()
+{
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+} // anonymous namespace
+
+////////// State //////////
+
+State::State(uint64_t iterations)
+    : iterations(iterations)
+    , bytesPerIteration(0)
+    , startedAt(Clock::now())
+    , running(true)
+    , elapsed(0)
+{
+}
+
+void
+State::pauseTiming()
+{
+    if (running) {
+        elapsed += Clock::now() - startedAt;
+        running = false;
+    }
+}
+
+void
+State::resumeTiming()
+{
+    if (!running) {
+        startedAt = Clock::now();
+        running = true;
+    }
+}
+
+void
+State::setBytesPerIteration(uint64_t bytes)
+{
+    bytesPerIteration = bytes;
+}
+
+std::chrono::nanoseconds
+State::getElapsed() const
+{
+    if (running)
+        return elapsed + (Clock::now() - startedAt);
+    return elapsed;
+}
+
+////////// Benchmark //////////
+
+Benchmark::Benchmark()
+    : name()
+    , function(NULL)
+{
+}
+
+////////// registry //////////
+
+bool
+registerBenchmark(const char* group, const char* name, Function function)
+{
+    Benchmark benchmark;
+    benchmark.name = std::string(group) + "." + name;
+    benchmark.function = function;
+    for (auto it = registry().begin(); it != registry().end(); ++it) {
+        if (it->name == benchmark.name)
+            PANIC("Benchmark %s is defined twice", benchmark.name.c_str());
+    }
+    registry().push_back(benchmark);
+    return true;
+}
+
+std::vector<Benchmark>
+getBenchmarks()
+{
+    std::vector<Benchmark> benchmarks = registry();
+    std::sort(benchmarks.begin(), benchmarks.end(),
+              [] (const Benchmark& a, const Benchmark& b) {
+                  return a.name < b.name;
+              });
+    return benchmarks;
+}
+
+} // namespace LogCabin::Bench
+} // namespace LogCabin
@@ -0,0 +1,165 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * A minimal microbenchmark framework. Benchmarks live next to the code they
+ * measure in files named *Bench.cc, the same way unit tests live in *Test.cc
+ * files, and bench/BenchRunner.cc runs them.
+ *
+ * A benchmark is declared with the BENCHMARK macro and must perform the
+ * operation it measures State::iterations times:
+ * \code
+ * BENCHMARK(RPCBuffer, construct) {
+ *     for (uint64_t i = 0; i < state.iterations; ++i)
+ *         RPC::Buffer buffer;
+ * }
+ * \endcode
+ * The runner picks the number of iterations so that each run takes long
+ * enough to time accurately.
+ */
+
+#include <chrono>
+#include <cinttypes>
+#include <string>
+#include <vector>
+
+#include "Core/Time.h"
+
+#ifndef LOGCABIN_BENCH_BENCH_H
+#define LOGCABIN_BENCH_BENCH_H
+
+namespace LogCabin {
+namespace Bench {
+
+/**
+ * Passed to each run of a benchmark. It tells the benchmark how many
+ * iterations to run and keeps track of the time they take.
+ */
+class State {
+  public:
+    typedef Core::Time::SteadyClock Clock;
+
+    /**
+     * Constructor. The clock starts running right away.
+     * \param iterations
+     *      See #iterations.
+     */
+    explicit State(uint64_t iterations);
+
+    /**
+     * Stop the clock, so that setup work inside the benchmark isn't counted.
+     */
+    void pauseTiming();
+
+    /**
+     * Restart the clock after pauseTiming().
+     */
+    void resumeTiming();
+
+    /**
+     * Declare how many bytes each iteration processes. The runner reports
+     * throughput for benchmarks that call this.
+     */
+    void setBytesPerIteration(uint64_t bytes);
+
+    /**
+     * Return the time counted so far.
+     */
+    std::chrono::nanoseconds getElapsed() const;
+
+    /**
+     * The number of times the benchmark should perform its operation.
+     */
+    const uint64_t iterations;
+
+    /**
+     * See setBytesPerIteration().
+     */
+    uint64_t bytesPerIteration;
+
+  private:
+    /**
+     * When the clock was last started, if it's running.
+     */
+    Clock::time_point startedAt;
+
+    /**
+     * True unless pauseTiming() was called more recently than
+     * resumeTiming().
+     */
+    bool running;
+
+    /**
+     * Time counted before #startedAt.
+     */
+    std::chrono::nanoseconds elapsed;
+};
+
+/**
+ * The signature of a benchmark function.
+ */
+typedef void (*Function)(State& state);
+
+/**
+ * A registered benchmark.
+ */
+struct Benchmark {
+    Benchmark();
+    /// The benchmark's name, in the form "group.name".
+    std::string name;
+    /// Runs the benchmark.
+    Function function;
+};
+
+/**
+ * Add a benchmark to the list that getBenchmarks() returns. This is called
+ * by the BENCHMARK macro during static initialization.
+ * \return
+ *      Always true.
+ */
+bool registerBenchmark(const char* group, const char* name, Function function);
+
+/**
+ * Return all registered benchmarks, sorted by name.
+ */
+std::vector<Benchmark> getBenchmarks();
+
+/**
+ * Prevent the compiler from optimizing away the computation of 'value'.
+ */
+template<typename T>
+inline void
+doNotOptimize(const T& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+/**
+ * Define and register a benchmark. The body that follows has access to a
+ * State named 'state'. This is meant to be used inside an anonymous
+ * namespace.
+ */
+#define BENCHMARK(group, name) \
+    void group##_##name##_Bench(::LogCabin::Bench::State& state); \
+    bool group##_##name##_Registered __attribute__((unused)) = \
+        ::LogCabin::Bench::registerBenchmark(#group, #name, \
+                                             group##_##name##_Bench); \
+    void group##_##name##_Bench(::LogCabin::Bench::State& state)
+
+} // namespace LogCabin::Bench
+} // namespace LogCabin
+
+#endif /* LOGCABIN_BENCH_BENCH_H */
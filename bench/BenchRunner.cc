@@ -0,0 +1,354 @@
+/* Copyright (c) 2012 Stanford University
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Runs the microbenchmarks defined in *Bench.cc files throughout the tree.
+ *
+ * Each benchmark is calibrated by doubling its iteration count until one run
+ * takes at least --min-time, then run --repetitions times at that count. The
+ * median time per iteration is reported. Results can be saved with --output
+ * and compared against a saved file with --baseline, in which case the
+ * program exits with status 1 if any benchmark got slower than --threshold.
+ */
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/text_format.h>
+
+#include "bench/Bench.h"
+#include "build/bench/Bench.pb.h"
+#include "Core/Debug.h"
+#include "Core/ProtoBuf.h"
+
+namespace {
+
+using LogCabin::Bench::Benchmark;
+using LogCabin::Bench::State;
+namespace BenchProto = LogCabin::Bench::Proto;
+
+/**
+ * Parses argv for the main function.
+ */
+class OptionParser {
+  public:
+    OptionParser(int& argc, char**& argv)
+        : argc(argc)
+        , argv(argv)
+        , filter()
+        , minTimeMs(100)
+        , repetitions(5)
+        , outputFile()
+        , baselineFile()
+        , thresholdPercent(10)
+        , list(false)
+        , verbose(false)
+    {
+        while (true) {
+            static struct option longOptions[] = {
+               {"baseline",  required_argument, NULL, 'b'},
+               {"filter",  required_argument, NULL, 'f'},
+               {"help",  no_argument, NULL, 'h'},
+               {"list",  no_argument, NULL, 'l'},
+               {"min-time",  required_argument, NULL, 'm'},
+               {"output",  required_argument, NULL, 'o'},
+               {"repetitions",  required_argument, NULL, 'r'},
+               {"threshold",  required_argument, NULL, 't'},
+               {"verbose",  no_argument, NULL, 'v'},
+               {0, 0, 0, 0}
+            };
+            int c = getopt_long(argc, argv, "b:f:hlm:o:r:t:v",
+                                longOptions, NULL);
+
+            // Detect the end of the options.
+            if (c == -1)
+                break;
+
+            switch (c) {
+                case 'b':
+                    baselineFile = optarg;
+                    break;
+                case 'f':
+                    filter = optarg;
+                    break;
+                case 'h':
+                    usage();
+                    exit(0);
+                case 'l':
+                    list = true;
+                    break;
+                case 'm':
+                    minTimeMs = uint64_t(atoll(optarg));
+                    break;
+                case 'o':
+                    outputFile = optarg;
+                    break;
+                case 'r':
+                    repetitions = uint32_t(atol(optarg));
+                    break;
+                case 't':
+                    thresholdPercent = strtod(optarg, NULL);
+                    break;
+                case 'v':
+                    verbose = true;
+                    break;
+                case '?':
+                default:
+                    // getopt_long already printed an error message.
+                    usage();
+                    exit(1);
+            }
+        }
+
+        // We don't expect any additional command line arguments (not options).
+        if (optind != argc || repetitions == 0 || thresholdPercent < 0) {
+            usage();
+            exit(1);
+        }
+    }
+
+    void usage() {
+        std::cout << "Usage: " << argv[0] << " [options]" << std::endl;
+        std::cout << "Options: " << std::endl;
+        std::cout << "  -h, --help               "
+                  << "Print this usage information" << std::endl;
+        std::cout << "  -l, --list               "
+                  << "List the benchmarks and exit" << std::endl;
+        std::cout << "  -f, --filter <text>      "
+                  << "Only run benchmarks whose names contain <text>"
+                  << std::endl;
+        std::cout << "  -m, --min-time <ms>      "
+                  << "Run each benchmark for at least <ms> milliseconds "
+                  << "(default: 100)" << std::endl;
+        std::cout << "  -r, --repetitions <n>    "
+                  << "Report the median of <n> runs (default: 5)"
+                  << std::endl;
+        std::cout << "  -o, --output <file>      "
+                  << "Save the results to <file>" << std::endl;
+        std::cout << "  -b, --baseline <file>    "
+                  << "Compare against results saved earlier with --output"
+                  << std::endl;
+        std::cout << "  -t, --threshold <pct>    "
+                  << "Count a benchmark as regressed if it is <pct> percent "
+                  << "slower than the baseline (default: 10)" << std::endl;
+        std::cout << "  -v, --verbose            "
+                  << "Show log messages from the code under test"
+                  << std::endl;
+    }
+
+    int& argc;
+    char**& argv;
+    std::string filter;
+    uint64_t minTimeMs;
+    uint32_t repetitions;
+    std::string outputFile;
+    std::string baselineFile;
+    double thresholdPercent;
+    bool list;
+    bool verbose;
+};
+
+/**
+ * Run a benchmark once with the given number of iterations.
+ * \return
+ *      The time the benchmark counted, in nanoseconds.
+ */
+uint64_t
+runOnce(const Benchmark& benchmark, uint64_t iterations,
+        uint64_t& bytesPerIteration)
+{
+    State state(iterations);
+    benchmark.function(state);
+    bytesPerIteration = state.bytesPerIteration;
+    return uint64_t(state.getElapsed().count());
+}
+
+/**
+ * Calibrate and run a benchmark.
+ */
+BenchProto::Result
+run(const Benchmark& benchmark, const OptionParser& options)
+{
+    uint64_t minTimeNs = options.minTimeMs * 1000 * 1000;
+    uint64_t bytesPerIteration = 0;
+    uint64_t iterations = 1;
+    while (true) {
+        uint64_t elapsed = runOnce(benchmark, iterations, bytesPerIteration);
+        if (elapsed >= minTimeNs)
+            break;
+        // Jump most of the way there once a run takes a measurable time,
+        // but never grow by more than 10x at a time.
+        uint64_t next = iterations * 2;
+        if (elapsed > minTimeNs / 100) {
+            next = std::max(next, uint64_t(double(iterations) * 1.2 *
+                                           double(minTimeNs) /
+                                           double(elapsed)));
+        }
+        iterations = std::min(next, iterations * 10);
+    }
+
+    std::vector<double> nsPerOp;
+    for (uint32_t i = 0; i < options.repetitions; ++i) {
+        uint64_t elapsed = runOnce(benchmark, iterations, bytesPerIteration);
+        nsPerOp.push_back(double(elapsed) / double(iterations));
+    }
+    std::sort(nsPerOp.begin(), nsPerOp.end());
+
+    BenchProto::Result result;
+    result.set_name(benchmark.name);
+    result.set_iterations(iterations);
+    result.set_ns_per_op(nsPerOp.at(nsPerOp.size() / 2));
+    result.set_min_ns_per_op(nsPerOp.front());
+    if (bytesPerIteration > 0) {
+        result.set_bytes_per_second(double(bytesPerIteration) * 1e9 /
+                                    result.ns_per_op());
+    }
+    return result;
+}
+
+/**
+ * Read results saved earlier with --output, or exit the program.
+ */
+std::map<std::string, BenchProto::Result>
+readBaseline(const std::string& filename)
+{
+    std::ifstream file(filename.c_str());
+    if (!file) {
+        fprintf(stderr, "Could not open baseline file %s\n",
+                filename.c_str());
+        exit(1);
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    BenchProto::Results results;
+    if (!google::protobuf::TextFormat::ParseFromString(contents.str(),
+                                                       &results)) {
+        fprintf(stderr, "Could not parse baseline file %s\n",
+                filename.c_str());
+        exit(1);
+    }
+    std::map<std::string, BenchProto::Result> baseline;
+    for (int i = 0; i < results.results_size(); ++i)
+        baseline[results.results(i).name()] = results.results(i);
+    return baseline;
+}
+
+/**
+ * Format a throughput in bytes per second for humans.
+ */
+std::string
+formatThroughput(double bytesPerSecond)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.1f MB/s", bytesPerSecond / 1e6);
+    return buf;
+}
+
+} // anonymous namespace
+
+int
+main(int argc, char** argv)
+{
+    OptionParser options(argc, argv);
+    if (!options.verbose)
+        LogCabin::Core::Debug::setLogPolicy({{"", "ERROR"}});
+
+    std::vector<Benchmark> benchmarks;
+    std::vector<Benchmark> all = LogCabin::Bench::getBenchmarks();
+    for (auto it = all.begin(); it != all.end(); ++it) {
+        if (it->name.find(options.filter) != std::string::npos)
+            benchmarks.push_back(*it);
+    }
+
+    if (options.list) {
+        for (auto it = benchmarks.begin(); it != benchmarks.end(); ++it)
+            printf("%s\n", it->name.c_str());
+        return 0;
+    }
+
+    std::map<std::string, BenchProto::Result> baseline;
+    bool haveBaseline = !options.baselineFile.empty();
+    if (haveBaseline)
+        baseline = readBaseline(options.baselineFile);
+
+    if (haveBaseline) {
+        printf("%-50s %12s %12s %8s\n",
+               "benchmark", "ns/op", "baseline", "change");
+    } else {
+        printf("%-50s %12s %12s %14s\n",
+               "benchmark", "ns/op", "iterations", "throughput");
+    }
+    fflush(stdout);
+
+    BenchProto::Results results;
+    uint32_t numRegressed = 0;
+    for (auto it = benchmarks.begin(); it != benchmarks.end(); ++it) {
+        BenchProto::Result result = run(*it, options);
+        *results.add_results() = result;
+        if (haveBaseline) {
+            auto base = baseline.find(result.name());
+            if (base == baseline.end()) {
+                printf("%-50s %12.1f %12s %8s\n",
+                       result.name().c_str(), result.ns_per_op(), "-", "new");
+            } else {
+                double change = 100.0 *
+                    (result.ns_per_op() - base->second.ns_per_op()) /
+                    base->second.ns_per_op();
+                bool regressed = change > options.thresholdPercent;
+                if (regressed)
+                    ++numRegressed;
+                printf("%-50s %12.1f %12.1f %+7.1f%%%s\n",
+                       result.name().c_str(), result.ns_per_op(),
+                       base->second.ns_per_op(), change,
+                       regressed ? "  REGRESSED" : "");
+            }
+        } else {
+            printf("%-50s %12.1f %12lu %14s\n",
+                   result.name().c_str(), result.ns_per_op(),
+                   result.iterations(),
+                   result.has_bytes_per_second()
+                       ? formatThroughput(result.bytes_per_second()).c_str()
+                       : "");
+        }
+        fflush(stdout);
+    }
+
+    if (!options.outputFile.empty()) {
+        std::ofstream file(options.outputFile.c_str());
+        file << LogCabin::Core::ProtoBuf::dumpString(results, false);
+        if (!file) {
+            fprintf(stderr, "Could not write results to %s\n",
+                    options.outputFile.c_str());
+            return 1;
+        }
+    }
+
+    if (numRegressed > 0) {
+        printf("%u of %d benchmarks regressed by more than %.1f%%\n",
+               numRegressed, results.results_size(),
+               options.thresholdPercent);
+        return 1;
+    }
+    return 0;
+}